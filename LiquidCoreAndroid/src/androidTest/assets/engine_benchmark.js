@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Cross-engine suite.  The same script runs in three places, so that the cost of the V82JSC
+ * shim can be told apart from the speed of JSC itself:
+ *
+ *   - node on V8 (Android):        as the bundle of Benchmark.startup()
+ *   - node on V82JSC (iOS):        as the bundle of process_startup_benchmark()
+ *   - bare JSC (iOS, no V82JSC):   through process_engine_benchmark()
+ *
+ * The engine cases run everywhere; the node cases (Buffer, EventEmitter, streams) only where
+ * there is a require().  Results go to __benchmark_report(json):
+ *
+ *   { "engine": "node"|"jsc", "benchmarks": [ { "name": ..., "ops": n, "ms": x,
+ *                                               "ops_per_sec": x }, ... ] }
+ */
+(function() {
+  const results = [];
+  const hasNode = typeof require === 'function' && typeof process === 'object';
+
+  // Bare JSC has no process.hrtime; its runner provides __benchmark_now() in milliseconds
+  const now = hasNode ? function() {
+    const t = process.hrtime();
+    return t[0] * 1e3 + t[1] / 1e6;
+  } : typeof __benchmark_now === 'function' ? __benchmark_now : Date.now;
+
+  // Runs |fn| once untimed, to warm up, then |ops| times
+  function measure(name, ops, fn) {
+    fn(0);
+    const t0 = now();
+    for (let i = 0; i < ops; i++) fn(i);
+    const ms = now() - t0;
+    results.push({ name: name, ops: ops, ms: ms, ops_per_sec: ops * 1e3 / ms });
+  }
+
+  function report() {
+    __benchmark_report(JSON.stringify({ engine: hasNode ? 'node' : 'jsc', benchmarks: results }));
+  }
+
+  // A small Richards-style scheduler: objects, virtual calls and property access
+  measure('richards (tasks)', 200, () => {
+    function Task(id, priority, next) { this.id = id; this.priority = priority; this.next = next; this.count = 0; }
+    Task.prototype.run = function() { this.count++; return this.next; };
+    let head = null;
+    for (let i = 0; i < 100; i++) head = new Task(i, i % 7, head);
+    for (let round = 0; round < 50; round++) {
+      for (let t = head; t; t = t.run()) {}
+    }
+  });
+
+  // Many small closures, each called once per round
+  measure('closures', 2000, () => {
+    const adders = [];
+    for (let i = 0; i < 100; i++) adders.push((x) => x + i);
+    let sum = 0;
+    for (let i = 0; i < adders.length; i++) sum = adders[i](sum);
+    return sum;
+  });
+
+  measure('array sort (1000 numbers)', 200, (n) => {
+    const a = [];
+    for (let i = 0; i < 1000; i++) a.push((i * 7919 + n) % 1000);
+    a.sort((x, y) => x - y);
+  });
+
+  measure('string building', 500, () => {
+    let s = '';
+    for (let i = 0; i < 200; i++) s += 'item' + i + ',';
+    return s.split(',').length;
+  });
+
+  const text = 'The quick brown fox jumps over the lazy dog. '.repeat(20);
+  measure('regexp', 2000, () => text.replace(/o(\w)/g, '0$1').match(/\b\w{5}\b/g));
+
+  const doc = { id: 42, name: 'benchmark', tags: ['a', 'b', 'c'],
+                nested: { x: 1.5, y: [1, 2, 3], z: { deep: true } } };
+  const json = JSON.stringify(doc);
+  measure('JSON.parse', 10000, () => JSON.parse(json));
+  measure('JSON.stringify', 10000, () => JSON.stringify(doc));
+
+  measure('typed arrays', 500, () => {
+    const a = new Float64Array(1024);
+    for (let i = 0; i < a.length; i++) a[i] = i * 0.5;
+    let sum = 0;
+    for (let i = 0; i < a.length; i++) sum += a[i];
+    return sum;
+  });
+
+  measure('Map/Set', 500, () => {
+    const m = new Map();
+    for (let i = 0; i < 200; i++) m.set('k' + i, i);
+    const s = new Set(m.values());
+    return s.size;
+  });
+
+  if (!hasNode) {
+    report();
+    return;
+  }
+
+  measure('Buffer.from/toString', 10000, () => Buffer.from('hello world, hello buffer').toString('hex'));
+  measure('Buffer.concat', 2000, () => {
+    const parts = [];
+    for (let i = 0; i < 16; i++) parts.push(Buffer.alloc(64, i));
+    return Buffer.concat(parts).length;
+  });
+
+  const EventEmitter = require('events');
+  const emitter = new EventEmitter();
+  let received = 0;
+  emitter.on('tick', (n) => { received += n; });
+  emitter.on('tick', () => {});
+  measure('EventEmitter.emit', 100000, () => emitter.emit('tick', 1));
+
+  // Streams are asynchronous, so this one is timed across its completion and reported last
+  const stream = require('stream');
+  const chunks = 2000;
+  const chunk = Buffer.alloc(1024, 1);
+  let sent = 0, bytes = 0;
+  const source = new stream.Readable({
+    read() { this.push(sent++ < chunks ? chunk : null); }
+  });
+  const passthrough = new stream.Transform({
+    transform(data, encoding, callback) { callback(null, data); }
+  });
+  const sink = new stream.Writable({
+    write(data, encoding, callback) { bytes += data.length; callback(); }
+  });
+  const t0 = now();
+  sink.on('finish', () => {
+    const ms = now() - t0;
+    results.push({ name: 'stream pipe (1 KB chunks)', ops: chunks, ms: ms,
+                   ops_per_sec: chunks * 1e3 / ms });
+    report();
+  });
+  source.pipe(passthrough).pipe(sink);
+})();
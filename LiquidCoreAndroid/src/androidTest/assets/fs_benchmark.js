@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * File system workload for the start-up benchmark (Benchmark.startup() on Android,
+ * process_startup_benchmark() on iOS).  Run it once with a sandbox root and once without; the
+ * difference, and the fs_()/alias_() counters reported with each case, are the sandbox's cost.
+ *
+ * Expects ROOT to be defined ahead of it, as the same directory given as the sandbox root, e.g.
+ * by prepending "var ROOT = '/data/.../bench';" to the bundle.  Everything is built under ROOT
+ * and removed afterwards.
+ */
+(function() {
+  const fs = require('fs');
+  const path = require('path');
+
+  const base = path.join(ROOT, 'fs_benchmark');
+  const results = [];
+
+  function now() {
+    const t = process.hrtime();
+    return t[0] * 1e3 + t[1] / 1e6;
+  }
+
+  function measure(name, ops, fn) {
+    const c0 = __benchmark_fs_counters();
+    const t0 = now();
+    fn();
+    const ms = now() - t0;
+    const c1 = __benchmark_fs_counters();
+    const checks = c1[0] - c0[0];
+    const check_ms = (c1[1] - c0[1]) / 1e6;
+    results.push({
+      name: name,
+      ops: ops,
+      total_ms: ms,
+      us_per_op: ms * 1e3 / ops,
+      sandbox_checks: checks,
+      sandbox_ms: check_ms,
+      sandbox_us_per_op: check_ms * 1e3 / ops
+    });
+  }
+
+  function rmrf(p) {
+    if (!fs.existsSync(p)) return;
+    if (fs.statSync(p).isDirectory()) {
+      fs.readdirSync(p).forEach((f) => rmrf(path.join(p, f)));
+      fs.rmdirSync(p);
+    } else {
+      fs.unlinkSync(p);
+    }
+  }
+
+  function mkdirp(p) {
+    if (fs.existsSync(p)) return;
+    mkdirp(path.dirname(p));
+    fs.mkdirSync(p);
+  }
+
+  rmrf(base);
+  mkdirp(base);
+
+  // A chain of packages each nested in the last one's node_modules, with a few siblings at
+  // every level so that resolution has directories to search
+  const depth = 12, siblings = 4;
+  let dir = path.join(base, 'app');
+  mkdirp(dir);
+  fs.writeFileSync(path.join(dir, 'index.js'), "module.exports = require('pkg0');\n");
+  for (let i = 0; i < depth; i++) {
+    const modules = path.join(dir, 'node_modules');
+    for (let s = 1; s <= siblings; s++) {
+      mkdirp(path.join(modules, 'sib' + i + '_' + s));
+      fs.writeFileSync(path.join(modules, 'sib' + i + '_' + s, 'index.js'), 'module.exports = 0;\n');
+    }
+    dir = path.join(modules, 'pkg' + i);
+    mkdirp(dir);
+    fs.writeFileSync(path.join(dir, 'package.json'), JSON.stringify({ name: 'pkg' + i, main: 'lib/main.js' }));
+    mkdirp(path.join(dir, 'lib'));
+    fs.writeFileSync(path.join(dir, 'lib', 'main.js'), i + 1 < depth ?
+      "module.exports = 1 + require('pkg" + (i + 1) + "');\n" : 'module.exports = 1;\n');
+  }
+
+  const entry = path.join(base, 'app', 'index.js');
+  const requires = 20;
+  measure('require (deep node_modules)', requires, () => {
+    for (let i = 0; i < requires; i++) {
+      Object.keys(require.cache).forEach((k) => {
+        if (k.indexOf(base) === 0) delete require.cache[k];
+      });
+      require(entry);
+    }
+  });
+
+  const stats = 10000;
+  measure('stat', stats, () => {
+    for (let i = 0; i < stats; i++) fs.statSync(entry);
+  });
+
+  const wide = path.join(base, 'wide');
+  const files = 1000;
+  mkdirp(wide);
+  for (let i = 0; i < files; i++) fs.writeFileSync(path.join(wide, 'f' + i), 'x');
+  measure('readdir + stat', files + 1, () => {
+    fs.readdirSync(wide).forEach((f) => fs.statSync(path.join(wide, f)));
+  });
+
+  const log = path.join(base, 'append.log');
+  const appends = 2000;
+  const line = 'x'.repeat(63) + '\n';
+  measure('small appends', appends, () => {
+    for (let i = 0; i < appends; i++) fs.appendFileSync(log, line);
+  });
+
+  const big = path.join(base, 'big.bin');
+  const chunk = 64 * 1024, chunks = 128;
+  fs.writeFileSync(big, Buffer.alloc(chunk * chunks, 1));
+  measure('sequential read (64 KB chunks)', chunks, () => {
+    const fd = fs.openSync(big, 'r');
+    const buffer = Buffer.allocUnsafe(chunk);
+    for (let i = 0; i < chunks; i++) fs.readSync(fd, buffer, 0, chunk, null);
+    fs.closeSync(fd);
+  });
+
+  rmrf(base);
+  __benchmark_report(JSON.stringify({ fs: results }));
+})();
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Bridge microbenchmarks.  Each case goes through the same JNI entry points that the Java API
+ * uses, so what is measured is the whole cost of a call: JNI marshalling, the hop onto the JS
+ * thread, locking, and the V8 work itself.
+ *
+ * Built into its own library (liquidcore-benchmark) when LIQUIDCORE_BENCHMARK is on, with the
+ * release flags, so that it measures what ships.  The result is a JSON string:
+ *
+ *   { "iterations": n, "has_loop": bool, "benchmarks": [
+ *       { "name": ..., "calls": n, "ops_per_sec": x,
+ *         "p50_ns": x, "p90_ns": x, "p99_ns": x, "max_ns": x }, ... ] }
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "JNI/JNI.h"
+
+NATIVE(JNIJSContext,jlong,getGlobalObject) (STATIC, jlong ctxRef);
+NATIVE(JNIJSContext,jlong,evaluateScript) (STATIC, jlong ctxRef, jstring script_,
+    jstring sourceURL_, jint startingLineNumber);
+NATIVE(JNIJSObject,jlong,make) (STATIC, jlong context_);
+NATIVE(JNIJSObject,jlong,getProperty) (STATIC, jlong objRef, jstring propertyName);
+NATIVE(JNIJSObject,void,setProperty) (STATIC, jlong objRef, jstring propertyName, jlong value,
+    jint attributes);
+NATIVE(JNIJSObject,jlong,callAsFunction) (STATIC, jlong objRef, jlong thisObject, jlongArray args);
+NATIVE(JNIJSObject,jobjectArray,copyPropertyNames) (STATIC, jlong objRef);
+NATIVE(JNIJSFunction,jlong,makeFunctionWithCallback) (STATIC, jobject jsfthis, jlong ctx,
+    jstring name);
+NATIVE(JNIJSValue,jlong,makeNumber) (STATIC, jlong ctxRef, jdouble number);
+NATIVE(JNIJSValue,jlong,makeFromJSONString) (STATIC, jlong ctxRef, jstring string);
+NATIVE(JNIJSValue,void,Finalize) (STATIC, jlong reference);
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+class Results {
+public:
+    Results(int iterations, bool has_loop) : m_json("{\"iterations\":")
+    {
+        m_json += std::to_string(iterations);
+        m_json += ",\"has_loop\":";
+        m_json += has_loop ? "true" : "false";
+        m_json += ",\"benchmarks\":[";
+    }
+
+    // |samples| are per-call latencies in nanoseconds; |total_ns| is wall time for all of them
+    void Add(const char *name, std::vector<uint64_t>& samples, uint64_t total_ns)
+    {
+        if (samples.empty()) return;
+        std::sort(samples.begin(), samples.end());
+        auto percentile = [&](double p) {
+            return samples[std::min(samples.size() - 1, (size_t) (p * samples.size()))];
+        };
+        if (m_count++) m_json += ",";
+        m_json += "{\"name\":\""; m_json += name; m_json += "\"";
+        m_json += ",\"calls\":" + std::to_string(samples.size());
+        m_json += ",\"ops_per_sec\":" +
+            std::to_string(total_ns ? samples.size() * 1e9 / total_ns : 0.0);
+        m_json += ",\"p50_ns\":" + std::to_string(percentile(0.50));
+        m_json += ",\"p90_ns\":" + std::to_string(percentile(0.90));
+        m_json += ",\"p99_ns\":" + std::to_string(percentile(0.99));
+        m_json += ",\"max_ns\":" + std::to_string(samples.back());
+        m_json += "}";
+    }
+
+    std::string Finish()
+    {
+        return m_json + "]}";
+    }
+
+private:
+    std::string m_json;
+    int m_count = 0;
+};
+
+// Times |iterations| calls of |fn|, after a few untimed ones to warm caches and the JIT
+template <typename F>
+void Measure(Results& results, const char *name, int iterations, F fn)
+{
+    const int warmup = std::max(1, iterations / 10);
+    for (int i = 0; i < warmup; i++) fn();
+
+    std::vector<uint64_t> samples;
+    samples.reserve((size_t) iterations);
+    auto begin = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        auto start = Clock::now();
+        fn();
+        samples.push_back((uint64_t)
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    auto total = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin);
+    results.Add(name, samples, (uint64_t) total.count());
+}
+
+} /* namespace */
+
+/*
+ * |jsFunction| is an org.liquidplayer.javascript.JSFunction whose callback is timed; pass null
+ * to skip that case.
+ */
+extern "C" JNIEXPORT jstring JNICALL Java_org_liquidplayer_jsctest_Benchmark_run(JNIEnv* env,
+    jobject thiz, jlong ctxRef, jobject jsFunction, jint iterations)
+{
+    jclass klass = env->GetObjectClass(thiz);
+    auto ctx = SharedWrap<JSContext>::Shared(ctxRef);
+    auto group = ctx->Group();
+    Results results(iterations, group->Loop() != nullptr);
+
+    jstring name = env->NewStringUTF("benchmark");
+    jstring json = env->NewStringUTF(
+        "{\"id\":42,\"name\":\"benchmark\",\"tags\":[\"a\",\"b\",\"c\"],\"nested\":{\"x\":1.5}}");
+    jstring identity = env->NewStringUTF("(function(a) { return a; })");
+    jstring source = env->NewStringUTF("benchmark.js");
+
+    jlong object =
+        Java_org_liquidplayer_javascript_JNIJSObject_make(env, klass, ctxRef);
+    jlong number =
+        Java_org_liquidplayer_javascript_JNIJSValue_makeNumber(env, klass, ctxRef, 42.0);
+    Java_org_liquidplayer_javascript_JNIJSObject_setProperty(env, klass, object, name, number, 0);
+    for (int i = 0; i < 16; i++) {
+        jstring key = env->NewStringUTF(("p" + std::to_string(i)).c_str());
+        Java_org_liquidplayer_javascript_JNIJSObject_setProperty(env, klass, object, key, number, 0);
+        env->DeleteLocalRef(key);
+    }
+    jlong function = Java_org_liquidplayer_javascript_JNIJSContext_evaluateScript(env, klass,
+        ctxRef, identity, source, 1);
+
+    jlongArray args = env->NewLongArray(1);
+    env->SetLongArrayRegion(args, 0, 1, &number);
+
+    Measure(results, "getProperty", iterations, [&]() {
+        jlong value =
+            Java_org_liquidplayer_javascript_JNIJSObject_getProperty(env, klass, object, name);
+        Java_org_liquidplayer_javascript_JNIJSValue_Finalize(env, klass, value);
+    });
+    Measure(results, "setProperty", iterations, [&]() {
+        Java_org_liquidplayer_javascript_JNIJSObject_setProperty(env, klass, object, name,
+                                                                 number, 0);
+    });
+    Measure(results, "callAsFunction", iterations, [&]() {
+        jlong value = Java_org_liquidplayer_javascript_JNIJSObject_callAsFunction(env, klass,
+            function, 0, args);
+        Java_org_liquidplayer_javascript_JNIJSValue_Finalize(env, klass, value);
+    });
+    if (jsFunction) {
+        jlong callback = Java_org_liquidplayer_javascript_JNIJSFunction_makeFunctionWithCallback(
+            env, klass, jsFunction, ctxRef, name);
+        Measure(results, "JSFunction callback", iterations, [&]() {
+            jlong value = Java_org_liquidplayer_javascript_JNIJSObject_callAsFunction(env, klass,
+                callback, 0, args);
+            Java_org_liquidplayer_javascript_JNIJSValue_Finalize(env, klass, value);
+        });
+        Java_org_liquidplayer_javascript_JNIJSValue_Finalize(env, klass, callback);
+    }
+    Measure(results, "makeFromJSONString", iterations, [&]() {
+        jlong value =
+            Java_org_liquidplayer_javascript_JNIJSValue_makeFromJSONString(env, klass, ctxRef, json);
+        Java_org_liquidplayer_javascript_JNIJSValue_Finalize(env, klass, value);
+    });
+    Measure(results, "copyPropertyNames", iterations, [&]() {
+        jobjectArray names =
+            Java_org_liquidplayer_javascript_JNIJSObject_copyPropertyNames(env, klass, object);
+        env->DeleteLocalRef(names);
+    });
+
+    // An empty runnable, so that only the cost of getting onto the JS thread is measured.  When
+    // the group has no loop both of these run in place.
+    std::thread foreign([&]() {
+        Measure(results, "ContextGroup::sync (foreign thread)", iterations, [&]() {
+            group->sync([]() {});
+        });
+        group->sync([&]() {
+            Measure(results, "ContextGroup::sync (JS thread)", iterations, [&]() {
+                group->sync([]() {});
+            });
+        });
+    });
+    foreign.join();
+
+    env->DeleteLocalRef(args);
+    Java_org_liquidplayer_javascript_JNIJSValue_Finalize(env, klass, function);
+    Java_org_liquidplayer_javascript_JNIJSValue_Finalize(env, klass, number);
+    Java_org_liquidplayer_javascript_JNIJSValue_Finalize(env, klass, object);
+    env->DeleteLocalRef(source);
+    env->DeleteLocalRef(identity);
+    env->DeleteLocalRef(json);
+    env->DeleteLocalRef(name);
+    env->DeleteLocalRef(klass);
+
+    if (env->ExceptionCheck()) {
+        // Whatever threw has already skewed the numbers; let the caller see the exception
+        return nullptr;
+    }
+    return env->NewStringUTF(results.Finish().c_str());
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Host-to-JS dispatch benchmark.  Floods a context group's loop with empty work from 1, 2, 4
+ * and 8 host threads at once, through each of the ways the host has of getting there, and
+ * measures the sustained rate and the end-to-end latency of a message (from the call on the
+ * host thread to the start of its work on the loop thread; for sync, the whole round trip).
+ * This is the runnable queue and its uv_async wake-ups under load, so that dispatcher changes
+ * can be held up against each other.
+ *
+ *   { "messages": n, "has_loop": bool, "benchmarks": [
+ *       { "path": ..., "threads": n, "messages_per_sec": x, "p50_ns": x, "p99_ns": x }, ... ] }
+ *
+ * Java runnables are run by the Java side, out of sight, so only their rate is reported and
+ * their latencies read -1.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "JNI/JNI.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+inline uint64_t Now()
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count();
+}
+
+// Waits for |total| messages to be accounted for
+class Countdown {
+public:
+    explicit Countdown(int total) : m_left(total) {}
+    void Done()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_left == 0) m_cv.notify_all();
+    }
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_left == 0; });
+    }
+private:
+    int m_left;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+void Add(std::string& json, const char *path, int threads, int messages, uint64_t total_ns,
+         std::vector<uint64_t>& latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) -> std::string {
+        if (latencies.empty()) return "-1";
+        return std::to_string(latencies[std::min(latencies.size() - 1,
+                                                 (size_t) (p * latencies.size()))]);
+    };
+    if (json.back() != '[') json += ",";
+    json += "{\"path\":\""; json += path; json += "\"";
+    json += ",\"threads\":" + std::to_string(threads);
+    json += ",\"messages_per_sec\":" +
+        std::to_string(total_ns ? messages * 1e9 / total_ns : 0.0);
+    json += ",\"p50_ns\":" + percentile(0.50);
+    json += ",\"p99_ns\":" + percentile(0.99);
+    json += "}";
+}
+
+// Runs |send| for |per_thread| messages on each of |threads| threads, all started together
+template <typename F>
+uint64_t Flood(int threads, int per_thread, F send)
+{
+    std::vector<std::thread> senders;
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    for (int t = 0; t < threads; t++) {
+        senders.emplace_back([&, t]() {
+            ready++;
+            while (!go) std::this_thread::yield();
+            for (int i = 0; i < per_thread; i++) send(t, i);
+        });
+    }
+    while (ready < threads) std::this_thread::yield();
+    uint64_t start = Now();
+    go = true;
+    for (auto& sender : senders) sender.join();
+    return start;
+}
+
+} /* namespace */
+
+/*
+ * For the Java-runnable path, |groupObj| is the context's JSContextGroup, whose
+ * inContextCallback() runs each one, and |runnable| a java.lang.Runnable that does nothing;
+ * pass null for either to skip it.  Must not be called on the group's thread.
+ */
+extern "C" JNIEXPORT jstring JNICALL Java_org_liquidplayer_jsctest_Benchmark_dispatch(JNIEnv* env,
+    jobject thiz, jlong ctxRef, jobject groupObj, jobject runnable, jint messages)
+{
+    auto group = SharedWrap<JSContext>::Shared(ctxRef)->Group();
+    JavaVM *jvm;
+    env->GetJavaVM(&jvm);
+
+    std::string json = "{\"messages\":" + std::to_string(messages);
+    json += ",\"has_loop\":";
+    json += group->Loop() ? "true" : "false";
+    json += ",\"benchmarks\":[";
+
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        const int per_thread = std::max(1, messages / threads);
+        const int total = per_thread * threads;
+
+        {
+            // Fire-and-forget, timed to when each one starts on the loop
+            std::vector<uint64_t> latencies((size_t) total);
+            Countdown countdown(total);
+            uint64_t start = Flood(threads, per_thread, [&](int t, int i) {
+                uint64_t sent = Now();
+                size_t slot = (size_t) (t * per_thread + i);
+                group->async([&latencies, &countdown, sent, slot]() {
+                    latencies[slot] = Now() - sent;
+                    countdown.Done();
+                });
+            });
+            countdown.Wait();
+            Add(json, "ContextGroup::async", threads, total, Now() - start, latencies);
+        }
+
+        {
+            std::vector<uint64_t> latencies((size_t) total);
+            uint64_t start = Flood(threads, per_thread, [&](int t, int i) {
+                uint64_t sent = Now();
+                group->sync([]() {});
+                latencies[(size_t) (t * per_thread + i)] = Now() - sent;
+            });
+            Add(json, "ContextGroup::sync", threads, total, Now() - start, latencies);
+        }
+
+        if (groupObj && runnable) {
+            // Local references don't travel between threads
+            jobject groupRef = env->NewGlobalRef(groupObj);
+            jobject runnableRef = env->NewGlobalRef(runnable);
+            uint64_t start = Flood(threads, per_thread, [&](int t, int i) {
+                // Each sender attaches for its first message and detaches after its last
+                JNIEnv *thread_env;
+                if (i == 0) jvm->AttachCurrentThread(&thread_env, nullptr);
+                else jvm->GetEnv((void**) &thread_env, JNI_VERSION_1_6);
+                group->schedule_java_runnable(thread_env, groupRef, runnableRef);
+                if (i == per_thread - 1) jvm->DetachCurrentThread();
+            });
+            // Java runnables share the events lane, so this runs after all of them
+            Countdown countdown(1);
+            group->async([&countdown]() { countdown.Done(); });
+            countdown.Wait();
+            std::vector<uint64_t> none;
+            Add(json, "ContextGroup::schedule_java_runnable", threads, total, Now() - start,
+                none);
+            env->DeleteGlobalRef(runnableRef);
+            env->DeleteGlobalRef(groupRef);
+        }
+    }
+
+    json += "]}";
+    return env->NewStringUTF(json.c_str());
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Work posted to a context group whose loop has gone idle.  Once the last turn has let go of
+ * the loop, a runnable posted from another thread must still get to run, and a sync() from
+ * another thread must still come back, rather than waiting for the group to be disposed.
+ */
+
+#include <chrono>
+#include <memory>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <android/log.h>
+#include "JNI/JNI.h"
+
+#undef printf
+#define printf(...) __android_log_print(ANDROID_LOG_INFO, __FILE__, __VA_ARGS__)
+
+namespace {
+
+// How long the loop is left alone so that its last turn unreferences the handle
+const int kIdleMs = 250;
+const int kTimeoutMs = 5000;
+
+class Flag {
+public:
+    void Set()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_set = true;
+        m_cv.notify_all();
+    }
+    bool Wait(int timeout_ms)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                             [this]() { return m_set; });
+    }
+private:
+    bool m_set = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+} /* namespace */
+
+/*
+ * |ctxRef| is a context in a node process that is still running but has nothing to do.
+ * Returns the number of failures.  Must not be called on the group's thread.
+ */
+extern "C" JNIEXPORT jint JNICALL Java_org_liquidplayer_jsctest_JSC_idleDispatch(JNIEnv* env,
+    jobject thiz, jlong ctxRef)
+{
+    auto group = SharedWrap<JSContext>::Shared(ctxRef)->Group();
+    int failed = 0;
+
+    if (!group->Loop()) {
+        printf("FAIL: group has no loop");
+        return 1;
+    }
+
+    // Let the loop drain whatever is in flight and settle
+    group->sync([]() {});
+    std::this_thread::sleep_for(std::chrono::milliseconds(kIdleMs));
+
+    {
+        std::shared_ptr<Flag> ran = std::make_shared<Flag>();
+        std::thread poster([group, ran]() {
+            group->async([ran]() { ran->Set(); });
+        });
+        poster.join();
+        if (ran->Wait(kTimeoutMs)) {
+            printf("PASS: async() on an idle loop ran");
+        } else {
+            printf("FAIL: async() on an idle loop did not run");
+            failed++;
+        }
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(kIdleMs));
+
+    {
+        std::shared_ptr<Flag> returned = std::make_shared<Flag>();
+        std::thread poster([group, returned]() {
+            group->sync([]() {});
+            returned->Set();
+        });
+        if (returned->Wait(kTimeoutMs)) {
+            printf("PASS: sync() on an idle loop returned");
+            poster.join();
+        } else {
+            printf("FAIL: sync() on an idle loop did not return");
+            failed++;
+            // It is still blocked on the group, which outlives the test
+            poster.detach();
+        }
+    }
+
+    return failed;
+}
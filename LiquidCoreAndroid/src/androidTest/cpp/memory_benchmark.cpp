@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Memory footprint benchmark.  For each count in |counts|, starts that many node processes
+ * side by side, all running the same bundle, lets them settle and measures the app's memory;
+ * then lets them exit before the next count.  What matters is the marginal cost of one more
+ * service, which is what snapshot sharing, isolate recycling and shared VMs are there to cut.
+ *
+ * Sizes are in KB.  PSS and private dirty come from /proc/self/smaps, relative to before the
+ * first process started.  The breakdown is: the V8 heaps, bytes held by the ArrayBuffer
+ * allocators, the native (malloc) heap and dirty thread stacks:
+ *
+ *   { "baseline": { ... }, "steps": [ { "services": n, "pss_kb": x, "private_dirty_kb": x,
+ *       "per_service_pss_kb": x, "marginal_pss_kb": x,
+ *       "components_kb": { "js_heap": x, "array_buffers": x, "native_heap": x,
+ *                          "thread_stacks": x } }, ... ] }
+ *
+ * "per_service_pss_kb" divides the step's PSS by its services; "marginal_pss_kb" is the cost
+ * of each service added since the previous step.  The bundle keeps running until it is told
+ * to stop, so it should do its set-up and leave nothing pending of its own.
+ */
+
+#include <malloc.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "JavaScriptCore/JavaScript.h"
+#include "JNI/JNI.h"
+#include "NodeInstance.h"
+
+namespace {
+
+std::atomic<bool> s_released(false);
+
+struct Service {
+    std::string bundle;
+    NodeInstance *instance = nullptr;
+    std::thread *thread = nullptr;
+    bool started = false;
+    bool exited = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+struct Footprint {
+    uint64_t pss_kb = 0;
+    uint64_t private_dirty_kb = 0;
+    uint64_t stack_dirty_kb = 0;
+    uint64_t native_heap_kb = 0;
+};
+
+Footprint Measure()
+{
+    Footprint f;
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool stack = false;
+    while (std::getline(smaps, line)) {
+        std::istringstream in(line);
+        std::string first;
+        in >> first;
+        if (first.find('-') != std::string::npos) {
+            // A mapping's header: range, perms, offset, device, inode and then the name
+            stack = line.find("stack") != std::string::npos;
+            continue;
+        }
+        uint64_t kb = 0;
+        in >> kb;
+        if (first == "Pss:") {
+            f.pss_kb += kb;
+        } else if (first == "Private_Dirty:") {
+            f.private_dirty_kb += kb;
+            if (stack) f.stack_dirty_kb += kb;
+        }
+    }
+    f.native_heap_kb = mallinfo().uordblks / 1024;
+    return f;
+}
+
+JSValueRef Released(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception)
+{
+    return JSValueMakeBoolean(ctx, s_released);
+}
+
+void OnStart(void *data, JSContextRef ctx, JSContextGroupRef group)
+{
+    auto service = reinterpret_cast<Service*>(data);
+
+    JSClassDefinition definition = kJSClassDefinitionEmpty;
+    definition.callAsFunction = Released;
+    JSClassRef cls = JSClassCreate(&definition);
+    JSStringRef name = JSStringCreateWithUTF8CString("__benchmark_released");
+    JSObjectSetProperty(ctx, JSContextGetGlobalObject(ctx), name,
+                        JSObjectMake(ctx, cls, nullptr), kJSPropertyAttributeDontEnum, nullptr);
+    JSStringRelease(name);
+    JSClassRelease(cls);
+
+    // Holds the process open until the benchmark lets go
+    std::string source = service->bundle +
+        "\n;(function() { var hold = setInterval(function() {"
+        " if (__benchmark_released()) clearInterval(hold); }, 50); })();\n";
+    JSStringRef script = JSStringCreateWithUTF8CString(source.c_str());
+    JSStringRef url = JSStringCreateWithUTF8CString("benchmark_bundle.js");
+    JSEvaluateScript(ctx, script, nullptr, url, 0, nullptr);
+    JSStringRelease(url);
+    JSStringRelease(script);
+
+    std::lock_guard<std::mutex> lk(service->mutex);
+    service->started = true;
+    service->cv.notify_all();
+}
+
+void OnExit(void *data, int code)
+{
+    auto service = reinterpret_cast<Service*>(data);
+    std::lock_guard<std::mutex> lk(service->mutex);
+    service->started = true;
+    service->exited = true;
+    service->cv.notify_all();
+}
+
+std::string Kb(const char *name, double kb, bool first = false)
+{
+    return std::string(first ? "\"" : ",\"") + name + "\":" + std::to_string(kb);
+}
+
+uint64_t Above(uint64_t value, uint64_t base)
+{
+    return value > base ? value - base : 0;
+}
+
+} /* namespace */
+
+extern "C" JNIEXPORT jstring JNICALL Java_org_liquidplayer_jsctest_Benchmark_memory(JNIEnv* env,
+    jobject thiz, jstring bundle_, jintArray counts_)
+{
+    const char *bundle = env->GetStringUTFChars(bundle_, nullptr);
+    std::vector<jint> counts((size_t) env->GetArrayLength(counts_));
+    env->GetIntArrayRegion(counts_, 0, (jsize) counts.size(), counts.data());
+
+    const Footprint baseline = Measure();
+    std::string json = "{\"baseline\":{";
+    json += Kb("pss_kb", baseline.pss_kb, true);
+    json += Kb("private_dirty_kb", baseline.private_dirty_kb);
+    json += "},\"steps\":[";
+
+    uint64_t previous_pss = 0;
+    int previous_count = 0;
+    for (size_t step = 0; step < counts.size(); step++) {
+        const int n = counts[step];
+        s_released = false;
+        std::vector<Service*> services;
+        for (int i = 0; i < n; i++) {
+            auto service = new Service();
+            service->bundle = bundle;
+            service->instance = new NodeInstance(OnStart, OnExit, service);
+            NodeInstance *instance = service->instance;
+            service->thread = new std::thread([instance]() { instance->spawnedThread(); });
+            services.push_back(service);
+        }
+        for (auto service : services) {
+            std::unique_lock<std::mutex> lk(service->mutex);
+            service->cv.wait(lk, [service]() { return service->started; });
+        }
+        // Let start-up garbage and lazily compiled code settle before looking
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        uint64_t js_heap = 0, array_buffers = 0;
+        for (auto service : services) {
+            NodeInstance::ResourceUsage usage;
+            if (service->instance->GetResourceUsage(&usage)) {
+                js_heap += usage.heap_used;
+                array_buffers += usage.external_memory;
+            }
+        }
+        const Footprint f = Measure();
+        const uint64_t pss = Above(f.pss_kb, baseline.pss_kb);
+
+        if (step) json += ",";
+        json += "{\"services\":" + std::to_string(n);
+        json += Kb("pss_kb", pss);
+        json += Kb("private_dirty_kb", Above(f.private_dirty_kb, baseline.private_dirty_kb));
+        json += Kb("per_service_pss_kb", n ? (double) pss / n : 0);
+        json += Kb("marginal_pss_kb", n != previous_count ?
+                   ((double) pss - previous_pss) / (n - previous_count) : 0);
+        json += ",\"components_kb\":{";
+        json += Kb("js_heap", js_heap / 1024.0, true);
+        json += Kb("array_buffers", array_buffers / 1024.0);
+        json += Kb("native_heap", Above(f.native_heap_kb, baseline.native_heap_kb));
+        json += Kb("thread_stacks", Above(f.stack_dirty_kb, baseline.stack_dirty_kb));
+        json += "}}";
+        previous_pss = pss;
+        previous_count = n;
+
+        s_released = true;
+        for (auto service : services) {
+            {
+                std::unique_lock<std::mutex> lk(service->mutex);
+                service->cv.wait(lk, [service]() { return service->exited; });
+            }
+            service->thread->join();
+            delete service->thread;
+            delete service->instance;
+            delete service;
+        }
+    }
+
+    env->ReleaseStringUTFChars(bundle_, bundle);
+    json += "]}";
+    return env->NewStringUTF(json.c_str());
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * The native sandbox mapping (nodedroid::PathPolicy) against the FileSystem object's own JS,
+ * with mounts nested inside each other both ways round: on the sandbox side, and on the real
+ * side in the opposite order.  Every path must come out of ToVirtual(), ToReal() and Access()
+ * exactly as it does out of the JS alias() and fs().
+ */
+
+#include <string>
+#include <android/log.h>
+#include "JNI/JNI.h"
+#include "nodedroid_file.h"
+
+#undef printf
+#define printf(...) __android_log_print(ANDROID_LOG_INFO, __FILE__, __VA_ARGS__)
+
+namespace {
+
+// The lookups of the FileSystem object's fs() and alias(), less path.resolve()
+const char *kReferenceJS =
+    "(function(aliases_, access_) {"
+    "  var keys = Object.keys(aliases_).sort().reverse();"
+    "  var acckeys = Object.keys(access_).sort().reverse();"
+    "  return {"
+    "    alias: function(file) {"
+    "      for (var p=0; p<keys.length; p++) {"
+    "        if (file.startsWith(aliases_[keys[p]] + '/')) {"
+    "          return keys[p] + '/' + file.substring(aliases_[keys[p]].length + 1);"
+    "        } else if (file == aliases_[keys[p]]) {"
+    "          return keys[p];"
+    "        }"
+    "      }"
+    "      return file;"
+    "    },"
+    "    real: function(file) {"
+    "      for (var p=0; p<keys.length; p++) {"
+    "        if (file.startsWith(keys[p] + '/')) {"
+    "          return aliases_[keys[p]] + '/' + file.substring(keys[p].length + 1);"
+    "        } else if (file == keys[p]) {"
+    "          return aliases_[keys[p]];"
+    "        }"
+    "      }"
+    "      return file;"
+    "    },"
+    "    access: function(file) {"
+    "      for (var p=0; p<acckeys.length; p++) {"
+    "        if (file.startsWith(acckeys[p] + '/') || acckeys[p] == file) {"
+    "          return access_[acckeys[p]];"
+    "        }"
+    "      }"
+    "      return 0;"
+    "    }"
+    "  };"
+    "})";
+
+const char *kAliases[][2] = {
+    // Nested in the sandbox, apart on disk
+    { "/home/module",              "/data/app/bundle" },
+    { "/home/module/node_modules", "/data/cache/modules" },
+    // Nested on disk the other way round from the sandbox: /home/zz sorts last but covers
+    // less of /data/user than /home/aa does
+    { "/home/zz",                  "/data/user" },
+    { "/home/aa",                  "/data/user/0/files" },
+    // Two aliases of one directory
+    { "/home/local",               "/data/shared" },
+    { "/home/public",              "/data/shared" },
+};
+
+const struct {
+    const char *path;
+    int mask;
+} kAccess[] = {
+    { "/home",                     _FS_ACCESS_RD },
+    { "/home/module/node_modules", _FS_ACCESS_RD | _FS_ACCESS_WR },
+    { "/home/aa",                  _FS_ACCESS_RD | _FS_ACCESS_WR },
+};
+
+const char *kRealPaths[] = {
+    "/data/app/bundle", "/data/app/bundle/index.js", "/data/cache/modules/x/y.js",
+    "/data/user", "/data/user/0", "/data/user/0/files", "/data/user/0/files/a.txt",
+    "/data/user/0/filesystem", "/data/shared/f", "/data/elsewhere/f", "/data",
+};
+
+const char *kVirtualPaths[] = {
+    "/home/module", "/home/module/index.js", "/home/module/node_modules",
+    "/home/module/node_modules/x/y.js", "/home/modules/x", "/home/zz/0/files/a.txt",
+    "/home/aa/a.txt", "/home/local/f", "/home/public/f", "/home", "/elsewhere",
+};
+
+} /* namespace */
+
+/*
+ * |ctxRef| is any context.  Returns the number of failures.
+ */
+extern "C" JNIEXPORT jint JNICALL Java_org_liquidplayer_jsctest_JSC_pathPolicyNestedMounts(
+    JNIEnv* env, jobject thiz, jlong ctxRef)
+{
+    auto ctx = SharedWrap<JSContext>::Shared(ctxRef);
+    int failed = 0;
+
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        Local<Object> aliases = Object::New(isolate);
+        for (auto alias : kAliases) {
+            aliases->Set(context, String::NewFromUtf8(isolate, alias[0]),
+                         String::NewFromUtf8(isolate, alias[1])).FromJust();
+        }
+        Local<Object> access = Object::New(isolate);
+        for (auto entry : kAccess) {
+            access->Set(context, String::NewFromUtf8(isolate, entry.path),
+                        Integer::New(isolate, entry.mask)).FromJust();
+        }
+        Local<Object> fsObj = Object::New(isolate);
+        fsObj->Set(context, String::NewFromUtf8(isolate, "aliases_"), aliases).FromJust();
+        fsObj->Set(context, String::NewFromUtf8(isolate, "access_"), access).FromJust();
+        nodedroid::PathPolicy::Install(context, fsObj);
+        nodedroid::PathPolicy *policy = nodedroid::PathPolicy::Get(context, fsObj);
+
+        Local<Function> make = Local<Function>::Cast(Script::Compile(context,
+            String::NewFromUtf8(isolate, kReferenceJS)).ToLocalChecked()
+            ->Run(context).ToLocalChecked());
+        Local<Value> args[] = { aliases, access };
+        Local<Object> reference = make->Call(context, context->Global(), 2, args)
+            .ToLocalChecked().As<Object>();
+        auto call = [&](const char *name, const char *path) {
+            Local<Function> function = Local<Function>::Cast(
+                reference->Get(context, String::NewFromUtf8(isolate, name)).ToLocalChecked());
+            Local<Value> arg = String::NewFromUtf8(isolate, path);
+            return function->Call(context, reference, 1, &arg).ToLocalChecked();
+        };
+
+        if (!policy) {
+            printf("FAIL: no policy was installed");
+            failed++;
+        } else {
+            for (auto path : kRealPaths) {
+                const std::string expected = *String::Utf8Value(call("alias", path));
+                const std::string actual = policy->ToVirtual(path);
+                if (actual != expected) {
+                    printf("FAIL: ToVirtual(%s) is %s, alias() gives %s", path,
+                           actual.c_str(), expected.c_str());
+                    failed++;
+                }
+            }
+            for (auto path : kVirtualPaths) {
+                const std::string expected = *String::Utf8Value(call("real", path));
+                const std::string actual = policy->ToReal(path);
+                if (actual != expected) {
+                    printf("FAIL: ToReal(%s) is %s, fs() gives %s", path,
+                           actual.c_str(), expected.c_str());
+                    failed++;
+                }
+                const int expected_access = call("access", path)->Int32Value(context).FromJust();
+                const int actual_access = policy->Access(path);
+                if (actual_access != expected_access) {
+                    printf("FAIL: Access(%s) is %d, fs() gives %d", path,
+                           actual_access, expected_access);
+                    failed++;
+                }
+            }
+        }
+    V8_UNLOCK()
+
+    if (!failed) printf("PASS: nested mounts map as the FileSystem object's JS does");
+    return failed;
+}
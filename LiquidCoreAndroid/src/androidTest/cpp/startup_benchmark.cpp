@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Start-up benchmark.  Starts |runs| node processes one after the other, each running the
+ * given bundle, and breaks down how long each took to get going.  The first run in the process
+ * is the cold one; the rest are warm, and show what the snapshot, code cache and isolate
+ * recycling buy.
+ *
+ * Times are milliseconds from the moment the instance was created.  Start-up phases come from
+ * the instance's StartupTimeline; on top of those, "started" is when the host was notified,
+ * "js_start" when the bundle's first statement ran, "js_done" when its evaluation returned and
+ * "exit" when the process exited, which it does as soon as the bundle leaves nothing pending:
+ *
+ *   { "runs": [ { "cold": bool, "exit_code": n, "phases_ms": { ... },
+ *                 "fs_checks": n, "fs_check_ms": x, "report": ... }, ... ] }
+ *
+ * The bundle may hand back results of its own with __benchmark_report(json), which appear as
+ * "report", and may read the sandbox counters (calls to fs_()/alias_() and the time spent in
+ * them) at any point with __benchmark_fs_counters(), which returns [checks, nanoseconds].
+ *
+ * Given a sandbox root, the process runs with a file system that maps /home onto it with read
+ * and write access, in the way a FileSystem object would, so that the cost of the sandbox can
+ * be set against a run without one.  assets/fs_benchmark.js is a workload for exactly that.
+ *
+ * With runs = 1 and assets/engine_benchmark.js as the bundle, this is also the node-on-V8 leg of
+ * the cross-engine suite.
+ */
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "JavaScriptCore/JavaScript.h"
+#include "JNI/JNI.h"
+#include "NodeInstance.h"
+#include "nodedroid_file.h"
+
+namespace {
+
+struct Run {
+    std::string bundle;
+    std::string sandbox_root;
+    NodeInstance *instance = nullptr;
+    std::string report;
+    uint64_t created = 0;
+    uint64_t started = 0;
+    uint64_t js_start = 0;
+    uint64_t js_done = 0;
+    uint64_t exited = 0;
+    int exit_code = 0;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+JSValueRef Mark(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception)
+{
+    auto run = reinterpret_cast<Run*>(JSObjectGetPrivate(function));
+    if (run && !run->js_start) run->js_start = uv_hrtime();
+    return JSValueMakeUndefined(ctx);
+}
+
+JSValueRef Report(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                  size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception)
+{
+    auto run = reinterpret_cast<Run*>(JSObjectGetPrivate(function));
+    if (run && argumentCount > 0) {
+        JSStringRef string = JSValueToStringCopy(ctx, arguments[0], nullptr);
+        if (string) {
+            size_t size = JSStringGetMaximumUTF8CStringSize(string);
+            std::vector<char> buffer(size);
+            JSStringGetUTF8CString(string, buffer.data(), size);
+            run->report = buffer.data();
+            JSStringRelease(string);
+        }
+    }
+    return JSValueMakeUndefined(ctx);
+}
+
+JSValueRef FsCounters(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                      size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception)
+{
+    auto run = reinterpret_cast<Run*>(JSObjectGetPrivate(function));
+    const nodedroid::FsStats& fs = run->instance->Timeline().fs;
+    JSValueRef counters[] = {
+        JSValueMakeNumber(ctx, (double) fs.checks),
+        JSValueMakeNumber(ctx, (double) fs.check_ns),
+    };
+    return JSObjectMakeArray(ctx, 2, counters, nullptr);
+}
+
+// A global function with the run as its private data
+void Install(JSContextRef ctx, const char *name, JSObjectCallAsFunctionCallback callback,
+             Run *run)
+{
+    JSClassDefinition definition = kJSClassDefinitionEmpty;
+    definition.callAsFunction = callback;
+    JSClassRef cls = JSClassCreate(&definition);
+    JSObjectRef function = JSObjectMake(ctx, cls, run);
+    JSClassRelease(cls);
+
+    JSStringRef jsname = JSStringCreateWithUTF8CString(name);
+    JSObjectSetProperty(ctx, JSContextGetGlobalObject(ctx), jsname, function,
+                        kJSPropertyAttributeDontEnum, nullptr);
+    JSStringRelease(jsname);
+}
+
+// As Process.setFileSystem() would with a FileSystem object that exposes only /home
+void InstallSandbox(JSContextRef ctxRef, const std::string& root)
+{
+    auto ctx = ctxRef->Context();
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        Local<String> real = String::NewFromUtf8(isolate, root.c_str());
+        Local<String> home = String::NewFromUtf8(isolate, "/home");
+        Local<Object> aliases = Object::New(isolate);
+        aliases->Set(context, home, real).FromJust();
+        Local<Object> access = Object::New(isolate);
+        access->Set(context, home,
+                    Integer::New(isolate, _FS_ACCESS_RD | _FS_ACCESS_WR)).FromJust();
+
+        Local<Object> fsObj = Object::New(isolate);
+        fsObj->Set(context, String::NewFromUtf8(isolate, "cwd"), real).FromJust();
+        fsObj->Set(context, String::NewFromUtf8(isolate, "aliases_"), aliases).FromJust();
+        fsObj->Set(context, String::NewFromUtf8(isolate, "access_"), access).FromJust();
+
+        Local<Private> privateKey = v8::Private::ForApi(isolate,
+                                                        String::NewFromUtf8(isolate, "__fs"));
+        context->Global()->SetPrivate(context, privateKey, fsObj);
+        nodedroid::PathPolicy::Install(context, fsObj);
+        nodedroid::InvalidateSandbox();
+        nodedroid::InvalidateModuleStatCache();
+    V8_UNLOCK()
+}
+
+void OnStart(void *data, JSContextRef ctx, JSContextGroupRef group)
+{
+    auto run = reinterpret_cast<Run*>(data);
+    run->started = uv_hrtime();
+
+    if (!run->sandbox_root.empty()) {
+        InstallSandbox(ctx, run->sandbox_root);
+    }
+    // So that the bundle's first statement can tell us it ran
+    Install(ctx, "__benchmark_mark", Mark, run);
+    Install(ctx, "__benchmark_report", Report, run);
+    Install(ctx, "__benchmark_fs_counters", FsCounters, run);
+
+    std::string source = "__benchmark_mark();\n" + run->bundle;
+    JSStringRef script = JSStringCreateWithUTF8CString(source.c_str());
+    JSStringRef url = JSStringCreateWithUTF8CString("benchmark_bundle.js");
+    JSEvaluateScript(ctx, script, nullptr, url, 0, nullptr);
+    JSStringRelease(url);
+    JSStringRelease(script);
+    run->js_done = uv_hrtime();
+}
+
+void OnExit(void *data, int code)
+{
+    auto run = reinterpret_cast<Run*>(data);
+    std::lock_guard<std::mutex> lk(run->mutex);
+    run->exit_code = code;
+    run->exited = uv_hrtime();
+    run->cv.notify_all();
+}
+
+std::string Phase(const char *name, uint64_t created, uint64_t at, bool first = false)
+{
+    std::string out = first ? "\"" : ",\"";
+    out += name;
+    out += "\":";
+    // Phases that were never reached (e.g. an instance that failed to start) read -1
+    out += at ? std::to_string((at - created) / 1e6) : "-1";
+    return out;
+}
+
+} /* namespace */
+
+/*
+ * |sandboxRoot| may be null to run without a file system sandbox.
+ */
+extern "C" JNIEXPORT jstring JNICALL Java_org_liquidplayer_jsctest_Benchmark_startup(JNIEnv* env,
+    jobject thiz, jstring bundle_, jint runs, jstring sandboxRoot_)
+{
+    static bool s_cold = true;
+
+    const char *bundle = env->GetStringUTFChars(bundle_, nullptr);
+    std::string sandbox_root;
+    if (sandboxRoot_) {
+        const char *root = env->GetStringUTFChars(sandboxRoot_, nullptr);
+        sandbox_root = root;
+        env->ReleaseStringUTFChars(sandboxRoot_, root);
+    }
+    std::string json = "{\"runs\":[";
+
+    for (int i = 0; i < runs; i++) {
+        Run run;
+        run.bundle = bundle;
+        run.sandbox_root = sandbox_root;
+        run.created = uv_hrtime();
+        auto instance = new NodeInstance(OnStart, OnExit, &run);
+        run.instance = instance;
+        std::thread thread([instance]() { instance->spawnedThread(); });
+        {
+            std::unique_lock<std::mutex> lk(run.mutex);
+            run.cv.wait(lk, [&run]() { return run.exited != 0; });
+        }
+        thread.join();
+
+        const NodeInstance::StartupTimeline& t = instance->Timeline();
+        if (i) json += ",";
+        json += "{\"cold\":";
+        json += s_cold ? "true" : "false";
+        json += ",\"exit_code\":" + std::to_string(run.exit_code);
+        json += ",\"phases_ms\":{";
+        json += Phase("thread_start", run.created, t.thread_start, true);
+        json += Phase("node_init_done", run.created, t.node_init_done);
+        json += Phase("v8_init_done", run.created, t.v8_init_done);
+        json += Phase("isolate_ready", run.created, t.isolate_ready);
+        json += Phase("environment_ready", run.created, t.environment_ready);
+        json += Phase("started", run.created, run.started);
+        json += Phase("js_start", run.created, run.js_start);
+        json += Phase("js_done", run.created, run.js_done);
+        json += Phase("bootstrap_done", run.created, t.bootstrap_done);
+        json += Phase("exit", run.created, run.exited);
+        json += "},\"fs_checks\":" + std::to_string(t.fs.checks);
+        json += ",\"fs_check_ms\":" + std::to_string(t.fs.check_ns / 1e6);
+        json += ",\"report\":" + (run.report.empty() ? std::string("null") : run.report);
+        json += "}";
+
+        delete instance;
+        s_cold = false;
+    }
+
+    env->ReleaseStringUTFChars(bundle_, bundle);
+    json += "]}";
+    return env->NewStringUTF(json.c_str());
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#include <boost/make_shared.hpp>
+#include "Common/AsyncTicket.h"
+#include "Common/JSValue.h"
+#include "Common/ContextGroup.h"
+
+boost::shared_ptr<AsyncTicket> AsyncTicket::New(boost::shared_ptr<ContextGroup> group)
+{
+    return boost::make_shared<AsyncTicket>(group);
+}
+
+AsyncTicket::AsyncTicket(boost::shared_ptr<ContextGroup> group) :
+    m_group(group), m_complete(false)
+{
+}
+
+AsyncTicket::~AsyncTicket()
+{
+}
+
+bool AsyncTicket::IsDefunct()
+{
+    boost::shared_ptr<ContextGroup> group = m_group.lock();
+    return !group || group->IsDefunct();
+}
+
+boost::shared_ptr<AsyncTicket::Completion> AsyncTicket::NewCompletion()
+{
+    return boost::make_shared<Completion>(shared_from_this());
+}
+
+void AsyncTicket::Complete()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_complete = true;
+    }
+    m_cv.notify_all();
+}
+
+bool AsyncTicket::IsComplete()
+{
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_complete;
+}
+
+boost::shared_ptr<JSValue> AsyncTicket::Wait()
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    m_cv.wait(lk, [&]{return m_complete;});
+    return m_exception;
+}
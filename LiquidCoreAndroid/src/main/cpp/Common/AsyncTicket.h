@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#ifndef LIQUIDCORE_ASYNCTICKET_H
+#define LIQUIDCORE_ASYNCTICKET_H
+
+#include <mutex>
+#include <condition_variable>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/smart_ptr/atomic_shared_ptr.hpp>
+#include <boost/smart_ptr/enable_shared_from_this.hpp>
+#include <boost/atomic.hpp>
+
+class ContextGroup;
+class JSValue;
+
+/*
+ * Returned by the asynchronous bridge calls.  The caller may poll it or block on it to
+ * collect the exception (if any) raised by the work item.
+ */
+class AsyncTicket : public boost::enable_shared_from_this<AsyncTicket>
+{
+public:
+    /*
+     * Held by the queued work item.  Signals the ticket when the work item is destroyed,
+     * whether or not it ever got to run (e.g. the group was disposed first).
+     */
+    class Completion {
+    public:
+        explicit Completion(boost::shared_ptr<AsyncTicket> ticket) : m_ticket(ticket) {}
+        ~Completion() { m_ticket->Complete(); }
+        inline void SetException(boost::shared_ptr<JSValue> exception)
+        {
+            m_ticket->m_exception = exception;
+        }
+
+    private:
+        boost::shared_ptr<AsyncTicket> m_ticket;
+    };
+
+    static boost::shared_ptr<AsyncTicket> New(boost::shared_ptr<ContextGroup> group);
+    AsyncTicket(boost::shared_ptr<ContextGroup> group);
+    virtual ~AsyncTicket();
+
+    boost::shared_ptr<Completion> NewCompletion();
+    boost::shared_ptr<JSValue> Wait();
+    bool IsComplete();
+    // True once the group has been disposed, or has gone altogether
+    bool IsDefunct();
+    // Empty if the group has gone
+    inline boost::shared_ptr<ContextGroup> Group() { return m_group.lock(); }
+
+private:
+    void Complete();
+
+    // Weak, so that a ticket held by Java doesn't keep a disposed group around
+    const boost::weak_ptr<ContextGroup> m_group;
+    boost::atomic_shared_ptr<JSValue> m_exception;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_complete;
+};
+
+#endif //LIQUIDCORE_ASYNCTICKET_H
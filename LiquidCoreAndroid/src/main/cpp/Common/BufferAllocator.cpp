@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#include <cstdlib>
+#include <cstring>
+#include "Common/BufferAllocator.h"
+
+// Size classes are powers of two from 1 << MIN_CLASS_SHIFT to 1 << MAX_CLASS_SHIFT bytes
+#define MIN_CLASS_SHIFT 4
+#define MAX_CLASS_SHIFT 12
+// Blocks kept per size class; anything beyond this goes back to the system
+#define MAX_POOLED_PER_CLASS 256
+
+static int SizeClass(size_t length)
+{
+    if (length > (1UL << MAX_CLASS_SHIFT)) return -1;
+    int shift = MIN_CLASS_SHIFT;
+    while ((1UL << shift) < length) shift++;
+    return shift - MIN_CLASS_SHIFT;
+}
+
+BufferAllocator::BufferAllocator(Policy policy) :
+    m_policy(policy), m_allocated(0), m_peak(0), m_limit(0)
+{
+    if (m_policy == kPooled) {
+        m_pools.resize(MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1);
+    }
+}
+
+BufferAllocator::~BufferAllocator()
+{
+    for (auto pool = m_pools.begin(); pool != m_pools.end(); ++pool) {
+        for (auto it = pool->begin(); it != pool->end(); ++it) {
+            free(*it);
+        }
+    }
+}
+
+bool BufferAllocator::Account(size_t length)
+{
+    size_t limit = m_limit;
+    size_t allocated = m_allocated.fetch_add(length) + length;
+    if (limit && allocated > limit) {
+        m_allocated.fetch_sub(length);
+        return false;
+    }
+    size_t peak = m_peak;
+    while (allocated > peak && !m_peak.compare_exchange_weak(peak, allocated));
+    return true;
+}
+
+void * BufferAllocator::Take(size_t length)
+{
+    int sc = m_policy == kPooled ? SizeClass(length) : -1;
+    if (sc < 0) {
+        return malloc(length ? length : 1);
+    }
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        std::vector<void *>& pool = m_pools[sc];
+        if (!pool.empty()) {
+            void *block = pool.back();
+            pool.pop_back();
+            return block;
+        }
+    }
+    return malloc(1UL << (sc + MIN_CLASS_SHIFT));
+}
+
+void* BufferAllocator::Allocate(size_t length)
+{
+    if (!Account(length)) return nullptr;
+
+    void *data;
+    if (m_policy == kPooled && SizeClass(length) >= 0) {
+        data = Take(length);
+        if (data) memset(data, 0, length);
+    } else {
+        // calloc can hand back fresh pages without touching them
+        data = calloc(length ? length : 1, 1);
+    }
+    if (!data) m_allocated.fetch_sub(length);
+    return data;
+}
+
+void* BufferAllocator::AllocateUninitialized(size_t length)
+{
+    if (!Account(length)) return nullptr;
+
+    void *data = Take(length);
+    if (!data) m_allocated.fetch_sub(length);
+    return data;
+}
+
+void BufferAllocator::Free(void* data, size_t length)
+{
+    if (!data) return;
+    m_allocated.fetch_sub(length);
+
+    int sc = m_policy == kPooled ? SizeClass(length) : -1;
+    if (sc >= 0) {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        std::vector<void *>& pool = m_pools[sc];
+        if (pool.size() < MAX_POOLED_PER_CLASS) {
+            pool.push_back(data);
+            return;
+        }
+    }
+    free(data);
+}
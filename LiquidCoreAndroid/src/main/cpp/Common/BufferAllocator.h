@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#ifndef LIQUIDCORE_BUFFERALLOCATOR_H
+#define LIQUIDCORE_BUFFERALLOCATOR_H
+
+#include "v8.h"
+#include <mutex>
+#include <vector>
+#include <boost/atomic.hpp>
+
+/*
+ * ArrayBuffer allocator owned by a single ContextGroup.  Zeroed memory comes from calloc.
+ * When pooling is on, small buffers are recycled through per-size-class free lists, which
+ * suits the churn of small node Buffers.  Bytes in use are counted and may be capped.
+ */
+class BufferAllocator : public v8::ArrayBuffer::Allocator {
+public:
+    enum Policy {
+        kCalloc = 0,
+        kPooled = 1
+    };
+
+    explicit BufferAllocator(Policy policy);
+    virtual ~BufferAllocator();
+
+    virtual void* Allocate(size_t length);
+    virtual void* AllocateUninitialized(size_t length);
+    virtual void Free(void* data, size_t length);
+
+    inline size_t AllocatedBytes() { return m_allocated; }
+    inline size_t PeakBytes() { return m_peak; }
+    // 0 means no limit.  Allocations that would go over it fail, which JS sees as a RangeError.
+    inline void SetLimit(size_t limit) { m_limit = limit; }
+
+private:
+    bool Account(size_t length);
+    void * Take(size_t length);
+
+    Policy m_policy;
+    boost::atomic<size_t> m_allocated;
+    boost::atomic<size_t> m_peak;
+    boost::atomic<size_t> m_limit;
+    std::mutex m_mutex;
+    std::vector<std::vector<void *>> m_pools;
+};
+
+#endif //LIQUIDCORE_BUFFERALLOCATOR_H
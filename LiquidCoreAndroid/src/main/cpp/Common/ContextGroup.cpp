@@ -8,58 +8,213 @@
 #include <malloc.h>
 #include <stdio.h>
 #include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <JSC/Macros.h>
 #include <boost/make_shared.hpp>
 #include "Common/ContextGroup.h"
 #include "Common/JSValue.h"
+#include "JNI/JNI.h"
+#include "Common/GCMonitor.h"
+#include "Common/JavaHeapTracer.h"
 #include "Macros.h"
 
 extern "C" void *__dso_handle = &__dso_handle;
 
-class GenericAllocator : public ArrayBuffer::Allocator {
+BufferAllocator::Policy ContextGroup::s_buffer_policy = BufferAllocator::kCalloc;
+
+// Upper bound on the number of JSValue zombies released per loop turn
+#define MAX_ZOMBIES_PER_TURN 512
+
+struct ZombieBatch {
+    bool open;
+    std::map<ContextGroup*, std::pair<boost::shared_ptr<ContextGroup>,
+        std::vector<boost::shared_ptr<JSValue>>>> groups;
+};
+static thread_local struct ZombieBatch s_zombie_batch;
+
+/*
+ * A snapshot file mapped read-only.  Groups created from the same file share one mapping,
+ * which is unmapped when the last of them goes away.
+ */
+class MappedSnapshot {
 public:
-    GenericAllocator() = default;
-    virtual void* Allocate(size_t length) {
-        auto mem =  (unsigned char *) malloc(length);
-        memset(mem, 0, length);
-        return (void*)mem;
-    }
-    virtual void* AllocateUninitialized(size_t length) {
-        return malloc(length);
+    static boost::shared_ptr<MappedSnapshot> Open(const char *path)
+    {
+        std::unique_lock<std::mutex> lk(s_mappings_mutex);
+        boost::shared_ptr<MappedSnapshot> mapping = s_mappings[path].lock();
+        if (mapping) return mapping;
+
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return mapping;
+        struct stat st;
+        void *data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            data = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (data == MAP_FAILED) return mapping;
+
+        mapping = boost::make_shared<MappedSnapshot>(path, data, (size_t) st.st_size);
+        s_mappings[path] = mapping;
+        return mapping;
     }
-    virtual void Free(void* data, size_t length) {
-        free(data);
+
+    MappedSnapshot(const char *path, void *data, size_t size) :
+        m_path(path), m_data(data), m_size(size) {}
+    ~MappedSnapshot()
+    {
+        munmap(m_data, m_size);
+        std::unique_lock<std::mutex> lk(s_mappings_mutex);
+        auto it = s_mappings.find(m_path);
+        if (it != s_mappings.end() && it->second.expired()) {
+            s_mappings.erase(it);
+        }
     }
+
+    inline char * Data() { return (char *) m_data; }
+    inline int Size() { return (int) m_size; }
+
+private:
+    static std::mutex s_mappings_mutex;
+    static std::map<std::string, boost::weak_ptr<MappedSnapshot>> s_mappings;
+
+    std::string m_path;
+    void *m_data;
+    size_t m_size;
 };
-static GenericAllocator s_allocator;
+std::mutex MappedSnapshot::s_mappings_mutex;
+std::map<std::string, boost::weak_ptr<MappedSnapshot>> MappedSnapshot::s_mappings;
+
+// A Java runnable, run through the owner's inContextCallback()
+struct JavaRunnable : nodedroid::LoopDispatcher::Task {
+    void Run() override;
 
-struct Runnable {
     jobject thiz;
     jobject runnable;
     JavaVM *jvm;
-    std::function<void()> c_runnable;
-};
-
-class ContextGroupData {
-public:
-    ContextGroupData(boost::shared_ptr<ContextGroup> cg) : m_context_group(cg) {}
-    ~ContextGroupData() { boost::shared_ptr<ContextGroup> group = m_context_group; group.reset(); }
-    boost::atomic_shared_ptr<ContextGroup> m_context_group;
 };
 
-void ContextGroup::StaticGCPrologueCallback(Isolate *isolate, GCType type, GCCallbackFlags flags)
+void JavaRunnable::Run()
 {
-    s_mutex.lock();
-    if (s_isolate_map.count(isolate)) {
-        s_isolate_map[isolate]->GCPrologueCallback(type, flags);
+    bool detach;
+    JNIEnv *env = threadEnv(jvm, detach);
+
+    jmethodID mid = findMethod(env, thiz, "inContextCallback", "(Ljava/lang/Runnable;)V");
+    if (mid == nullptr) {
+        if (detach) {
+            jvm->DetachCurrentThread();
+        }
+        __android_log_assert("FAIL", "ContextGroup::callback",
+            "Can't find the class to call back?");
     }
-    s_mutex.unlock();
+
+    env->CallVoidMethod(thiz, mid, runnable);
+
+    env->DeleteGlobalRef(thiz);
+    env->DeleteGlobalRef(runnable);
+
+    if (detach) {
+        jvm->DetachCurrentThread();
+    }
+
+    delete this;
+}
+
+/*
+ * The group is registered as the callback data, so dispatch needs neither a lookup nor a lock.
+ * Callbacks are removed in Dispose() before the group can go away.
+ */
+void ContextGroup::StaticGCPrologueCallback(Isolate *isolate, GCType type, GCCallbackFlags flags,
+                                            void *data)
+{
+    reinterpret_cast<ContextGroup*>(data)->GCPrologueCallback(type, flags);
+}
+
+void ContextGroup::StaticGCEpilogueCallback(Isolate *isolate, GCType type, GCCallbackFlags flags,
+                                            void *data)
+{
+    reinterpret_cast<ContextGroup*>(data)->GCEpilogueCallback(type, flags);
 }
 
+/*
+ * Wraps the default platform so that V8's background work (concurrent marking, compilation)
+ * runs at a lower priority than the app's own threads.
+ */
+class BackgroundPriorityPlatform : public v8::Platform {
+public:
+    BackgroundPriorityPlatform(v8::Platform *platform, int nice) :
+        m_platform(platform), m_nice(nice) {}
+    virtual ~BackgroundPriorityPlatform() { delete m_platform; }
+
+    size_t NumberOfAvailableBackgroundThreads() override
+    {
+        return m_platform->NumberOfAvailableBackgroundThreads();
+    }
+    void CallOnBackgroundThread(Task* task, ExpectedRuntime expected_runtime) override
+    {
+        m_platform->CallOnBackgroundThread(new NiceTask(task, m_nice), expected_runtime);
+    }
+    void CallOnForegroundThread(Isolate* isolate, Task* task) override
+    {
+        m_platform->CallOnForegroundThread(isolate, task);
+    }
+    void CallDelayedOnForegroundThread(Isolate* isolate, Task* task,
+                                       double delay_in_seconds) override
+    {
+        m_platform->CallDelayedOnForegroundThread(isolate, task, delay_in_seconds);
+    }
+    void CallIdleOnForegroundThread(Isolate* isolate, IdleTask* task) override
+    {
+        m_platform->CallIdleOnForegroundThread(isolate, task);
+    }
+    bool IdleTasksEnabled(Isolate* isolate) override
+    {
+        return m_platform->IdleTasksEnabled(isolate);
+    }
+    double MonotonicallyIncreasingTime() override
+    {
+        return m_platform->MonotonicallyIncreasingTime();
+    }
+    v8::TracingController* GetTracingController() override
+    {
+        return m_platform->GetTracingController();
+    }
+
+private:
+    class NiceTask : public Task {
+    public:
+        NiceTask(Task *task, int nice) : m_task(task), m_nice(nice) {}
+        virtual ~NiceTask() { delete m_task; }
+        void Run() override
+        {
+            // Worker threads are long lived; adjust each one the first time it picks up work
+            static thread_local bool s_adjusted = false;
+            if (!s_adjusted) {
+                setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), m_nice);
+                s_adjusted = true;
+            }
+            m_task->Run();
+        }
+    private:
+        Task *m_task;
+        int m_nice;
+    };
+
+    v8::Platform *m_platform;
+    int m_nice;
+};
+
 Platform *ContextGroup::s_platform = NULL;
+bool ContextGroup::s_host_platform = false;
+int ContextGroup::s_worker_threads = 4;
+int ContextGroup::s_background_nice = 0;
 int ContextGroup::s_init_count = 0;
 std::mutex ContextGroup::s_mutex;
-std::map<Isolate *, ContextGroup *> ContextGroup::s_isolate_map;
 
 void ContextGroup::init_v8()
 {
@@ -70,7 +225,12 @@ void ContextGroup::init_v8()
         V8::SetFlagsFromString(flags, strlen(flags));
         */
 
-        s_platform = platform::CreateDefaultPlatform(4);
+        if (!s_platform) {
+            s_platform = platform::CreateDefaultPlatform(s_worker_threads);
+            if (s_background_nice) {
+                s_platform = new BackgroundPriorityPlatform(s_platform, s_background_nice);
+            }
+        }
         V8::InitializePlatform(s_platform);
         V8::Initialize();
     }
@@ -87,8 +247,33 @@ void ContextGroup::dispose_v8()
     if (s_init_count == 0) {
         V8::Dispose();
         V8::ShutdownPlatform();
-        delete s_platform;
+        if (!s_host_platform) {
+            delete s_platform;
+        }
         s_platform = nullptr;
+        // The host's platform went with it; the next init makes a platform of its own
+        // unless it is handed another
+        s_host_platform = false;
+    }
+    s_mutex.unlock();
+}
+
+void ContextGroup::ConfigurePlatform(int worker_threads, int background_nice)
+{
+    s_mutex.lock();
+    if (s_init_count == 0) {
+        s_worker_threads = worker_threads;
+        s_background_nice = background_nice;
+    }
+    s_mutex.unlock();
+}
+
+void ContextGroup::SetPlatform(v8::Platform *platform)
+{
+    s_mutex.lock();
+    if (s_init_count == 0) {
+        s_platform = platform;
+        s_host_platform = true;
     }
     s_mutex.unlock();
 }
@@ -96,19 +281,21 @@ void ContextGroup::dispose_v8()
 ContextGroup::ContextGroup()
 {
     init_v8();
-    m_create_params.array_buffer_allocator = &s_allocator;
+    m_allocator = std::unique_ptr<BufferAllocator>(new BufferAllocator(s_buffer_policy));
+    m_create_params.array_buffer_allocator = m_allocator.get();
     m_isolate = Isolate::New(m_create_params);
     m_manage_isolate = true;
+    m_heap_tracer = std::unique_ptr<JavaHeapTracer>(new JavaHeapTracer(m_isolate));
+    m_isolate->SetEmbedderHeapTracer(m_heap_tracer.get());
     m_uv_loop = nullptr;
     m_thread_id = std::this_thread::get_id();
-    m_async_handle = nullptr;
     m_isDefunct = false;
     m_startup_data.data = nullptr;
     m_startup_data.raw_size = 0;
 
-    s_isolate_map[m_isolate] = this;
     m_gc_callbacks.clear();
-    m_isolate->AddGCPrologueCallback(StaticGCPrologueCallback);
+    m_isolate->AddGCPrologueCallback(StaticGCPrologueCallback, this);
+    m_isolate->AddGCEpilogueCallback(StaticGCEpilogueCallback, this);
     m_isolate->SetMicrotasksPolicy(v8::MicrotasksPolicy::kAuto);
 }
 
@@ -118,57 +305,100 @@ ContextGroup::ContextGroup(Isolate *isolate, uv_loop_t *uv_loop)
     m_manage_isolate = false;
     m_uv_loop = uv_loop;
     m_thread_id = std::this_thread::get_id();
-    m_async_handle = nullptr;
     m_isDefunct = false;
     m_startup_data.data = nullptr;
     m_startup_data.raw_size = 0;
+    m_warm_context = false;
+
+    m_dispatcher.Open(m_uv_loop, [this](nodedroid::LoopDispatcher& dispatcher) {
+        Turn(dispatcher);
+    });
 
-    s_mutex.lock();
-    s_isolate_map[m_isolate] = this;
-    s_mutex.unlock();
     m_gc_callbacks.clear();
-    m_isolate->AddGCPrologueCallback(StaticGCPrologueCallback);
+    m_isolate->AddGCPrologueCallback(StaticGCPrologueCallback, this);
+    m_isolate->AddGCEpilogueCallback(StaticGCEpilogueCallback, this);
+}
+
+ContextGroup::ContextGroup(boost::shared_ptr<MappedSnapshot> snapshot) :
+    ContextGroup(snapshot->Data(), snapshot->Size())
+{
+    // The data belongs to the mapping, which we keep for as long as the isolate lives
+    m_snapshot = snapshot;
 }
 
 ContextGroup::ContextGroup(char *snapshot, int size)
 {
     init_v8();
-    m_create_params.array_buffer_allocator = &s_allocator;
+    m_allocator = std::unique_ptr<BufferAllocator>(new BufferAllocator(s_buffer_policy));
+    m_create_params.array_buffer_allocator = m_allocator.get();
     m_startup_data.data = snapshot;
     m_startup_data.raw_size = size;
 
-    if (snapshot && size) {
+    m_warm_context = snapshot && size;
+    if (m_warm_context) {
         m_create_params.snapshot_blob = &m_startup_data;
     }
     m_isolate = Isolate::New(m_create_params);
     m_manage_isolate = true;
+    m_heap_tracer = std::unique_ptr<JavaHeapTracer>(new JavaHeapTracer(m_isolate));
+    m_isolate->SetEmbedderHeapTracer(m_heap_tracer.get());
     m_uv_loop = nullptr;
     m_thread_id = std::this_thread::get_id();
-    m_async_handle = nullptr;
     m_isDefunct = false;
 
-    s_isolate_map[m_isolate] = this;
     m_gc_callbacks.clear();
-    m_isolate->AddGCPrologueCallback(StaticGCPrologueCallback);
+    m_isolate->AddGCPrologueCallback(StaticGCPrologueCallback, this);
+    m_isolate->AddGCEpilogueCallback(StaticGCEpilogueCallback, this);
     m_isolate->SetMicrotasksPolicy(v8::MicrotasksPolicy::kAuto);
 }
 
 void ContextGroup::MarkZombie(boost::shared_ptr<JSValue> obj)
 {
     if ((void*)&*obj != this) {
+        if (s_zombie_batch.open) {
+            auto& entry = s_zombie_batch.groups[this];
+            if (!entry.first) {
+                entry.first = shared_from_this();
+            }
+            entry.second.push_back(obj);
+            return;
+        }
+
         m_zombie_mutex.lock();
         m_value_zombies.push_back(obj);
         m_zombie_mutex.unlock();
 
-        std::unique_lock<std::mutex> lk(m_async_mutex);
+        m_dispatcher.Wake();
+    }
+}
 
-        if (!m_async_handle) {
-            m_async_handle = new uv_async_t();
-            m_async_handle->data = new ContextGroupData(shared_from_this());
-            uv_async_init(Loop(), m_async_handle, ContextGroup::callback);
-            uv_async_send(m_async_handle);
-        }
+void ContextGroup::MarkZombies(std::vector<boost::shared_ptr<JSValue>>& zombies)
+{
+    m_zombie_mutex.lock();
+    if (m_value_zombies.empty()) {
+        m_value_zombies.swap(zombies);
+    } else {
+        m_value_zombies.insert(m_value_zombies.end(), zombies.begin(), zombies.end());
+        zombies.clear();
+    }
+    m_zombie_mutex.unlock();
+
+    m_dispatcher.Wake();
+}
+
+void ContextGroup::BeginZombieBatch()
+{
+    s_zombie_batch.open = true;
+}
+
+void ContextGroup::EndZombieBatch()
+{
+    s_zombie_batch.open = false;
+
+    for (auto it = s_zombie_batch.groups.begin(); it != s_zombie_batch.groups.end(); ++it) {
+        it->second.first->MarkZombies(it->second.second);
     }
+    s_zombie_batch.groups.clear();
 }
 
 void ContextGroup::MarkZombie(boost::shared_ptr<JSContext> obj)
@@ -178,26 +408,39 @@ void ContextGroup::MarkZombie(boost::shared_ptr<JSContext> obj)
         m_context_zombies.push_back(obj);
         m_zombie_mutex.unlock();
 
-        std::unique_lock<std::mutex> lk(m_async_mutex);
-
-        if (!m_async_handle) {
-            m_async_handle = new uv_async_t();
-            m_async_handle->data = new ContextGroupData(shared_from_this());
-            uv_async_init(Loop(), m_async_handle, ContextGroup::callback);
-            uv_async_send(m_async_handle);
-        }
+        m_dispatcher.Wake();
     }
 }
 
-void ContextGroup::FreeZombies()
+void ContextGroup::FreeZombies(size_t limit)
 {
+    // Take at most 'limit' values off the end and release them outside of the lock, so that
+    // the finalizer thread is never held up behind a long free.
+    std::vector<boost::shared_ptr<JSValue>> values;
     m_zombie_mutex.lock();
-    for (auto vit=m_value_zombies.begin(); vit!=m_value_zombies.end(); ) {
-        boost::shared_ptr<JSValue> value = *vit;
-        vit = m_value_zombies.erase(vit);
-        value.reset();
+    if (m_value_zombies.size() <= limit) {
+        values.swap(m_value_zombies);
+    } else {
+        auto begin = m_value_zombies.end() - limit;
+        values.assign(begin, m_value_zombies.end());
+        m_value_zombies.erase(begin, m_value_zombies.end());
     }
-    m_value_zombies.clear();
+    m_zombie_mutex.unlock();
+
+    if (!values.empty() && isolate()) {
+        // One lock for the whole slice; each JSValue's own locker then nests cheaply
+        v8::Locker lock(isolate());
+        for (auto it = values.begin(); it != values.end(); ++it) {
+            boost::shared_ptr<JSContext> context = (*it)->Context();
+            if (context) {
+                context->released(*it);
+            }
+            (*it).reset();
+        }
+    }
+    values.clear();
+
+    m_zombie_mutex.lock();
 
     /*
      * JSContext zombies indicate that Java is done with the context, however the process
@@ -230,118 +473,122 @@ void ContextGroup::FreeZombies()
     m_zombie_mutex.unlock();
 }
 
-void ContextGroup::callback(uv_async_t* handle)
+void ContextGroup::Turn(nodedroid::LoopDispatcher& dispatcher)
 {
-    ContextGroupData *data = reinterpret_cast<ContextGroupData*>(handle->data);
-    boost::shared_ptr<ContextGroup> group = data->m_context_group;
-    delete data;
-
-    // Since we are in the correct thread now, free the zombies!
-    group->FreeZombies();
-
-    group->m_async_mutex.lock();
-    struct Runnable *r = group->m_runnables.empty() ? nullptr :
-                         (struct Runnable *) group->m_runnables.front();
-
-    while (r) {
-        group->m_async_mutex.unlock();
-
-        if (r->c_runnable) {
-            r->c_runnable();
-        } else {
-            JNIEnv *env;
-            int getEnvStat = r->jvm->GetEnv((void**)&env, JNI_VERSION_1_6);
-            if (getEnvStat == JNI_EDETACHED) {
-                r->jvm->AttachCurrentThread(&env, NULL);
-            }
-
-            jclass cls = env->GetObjectClass(r->thiz);
-            jmethodID mid;
-            do {
-                mid = env->GetMethodID(cls,"inContextCallback","(Ljava/lang/Runnable;)V");
-                if (!env->ExceptionCheck()) break;
-                env->ExceptionClear();
-                jclass super = env->GetSuperclass(cls);
-                env->DeleteLocalRef(cls);
-                if (super == NULL || env->ExceptionCheck()) {
-                    if (super != NULL) env->DeleteLocalRef(super);
-                    if (getEnvStat == JNI_EDETACHED) {
-                        r->jvm->DetachCurrentThread();
-                    }
-                    __android_log_assert("FAIL", "ContextGroup::callback",
-                        "Can't find the class to call back?");
-                }
-                cls = super;
-            } while (true);
-            env->DeleteLocalRef(cls);
-
-            env->CallVoidMethod(r->thiz, mid, r->runnable);
-
-            env->DeleteGlobalRef(r->thiz);
-            env->DeleteGlobalRef(r->runnable);
-
-            if (getEnvStat == JNI_EDETACHED) {
-                r->jvm->DetachCurrentThread();
-            }
-        }
+    boost::shared_ptr<ContextGroup> group = weak_from_this().lock();
+    if (!group || group->IsDefunct()) {
+        // Lets go of the loop, unless the dispatcher has already been closed
+        dispatcher.FinishTurn(false);
+        return;
+    }
 
-        group->m_async_mutex.lock();
+    // Since we are in the correct thread now, free the zombies!  Only a slice per turn, so
+    // that a large GC on the Java side doesn't stall JS.
+    FreeZombies(MAX_ZOMBIES_PER_TURN);
 
-        group->m_runnables.erase(group->m_runnables.begin());
-        delete r;
+    bool pending = dispatcher.Drain();
 
-        r = group->m_runnables.empty() ? nullptr : (struct Runnable *) group->m_runnables.front();
+    // Zombies left over from the bounded free need another turn
+    {
+        std::unique_lock<std::mutex> zlk(m_zombie_mutex);
+        pending = pending || !m_value_zombies.empty() || !m_context_zombies.empty();
     }
-    // Close the handle.  We will create a new one if we
-    // need another.  This keeps the node process from staying alive
-    // indefinitely
-    uv_close((uv_handle_t*)handle, [](uv_handle_t *h){
-        delete (uv_async_t*)h;
-    });
-    group->m_async_handle = nullptr;
-    group->m_async_mutex.unlock();
+    dispatcher.FinishTurn(pending);
 }
 
-void ContextGroup::RegisterGCCallback(void (*cb)(GCType, GCCallbackFlags, void*), void *data)
+static void AddGCCallback(std::list<std::unique_ptr<struct ContextGroup::GCCallback>>& list,
+                          void (*cb)(GCType, GCCallbackFlags, void*), void *data)
 {
-    auto gc = std::unique_ptr<struct GCCallback>(new struct GCCallback);
+    auto gc = std::unique_ptr<struct ContextGroup::GCCallback>(new struct ContextGroup::GCCallback);
     gc->cb = cb;
     gc->data = data;
-    m_gc_callbacks.push_back(std::move(gc));
+    list.push_back(std::move(gc));
 }
 
-void ContextGroup::UnregisterGCCallback(void (*cb)(GCType, GCCallbackFlags, void*), void *data)
+static void RemoveGCCallback(std::list<std::unique_ptr<struct ContextGroup::GCCallback>>& list,
+                             void (*cb)(GCType, GCCallbackFlags, void*), void *data)
 {
-    auto it = m_gc_callbacks.begin();
+    auto it = list.begin();
 
-    while (it != m_gc_callbacks.end()) {
+    while (it != list.end()) {
         const auto& item = *it;
         ++it;
         if (item->cb == cb && item->data == data) {
-            m_gc_callbacks.remove(item);
+            list.remove(item);
         }
     }
 }
 
-void ContextGroup::GCPrologueCallback(GCType type, GCCallbackFlags flags)
+static void DispatchGCCallbacks(std::list<std::unique_ptr<struct ContextGroup::GCCallback>>& list,
+                                GCType type, GCCallbackFlags flags)
 {
-    auto it = m_gc_callbacks.begin();
+    auto it = list.begin();
 
-    while (it != m_gc_callbacks.end()) {
+    while (it != list.end()) {
         const auto& item = *it;
         ++it;
         item->cb(type, flags, item->data);
     }
 }
 
-void ContextGroup::Manage(boost::shared_ptr<JSValue> obj)
+void ContextGroup::RegisterGCCallback(void (*cb)(GCType, GCCallbackFlags, void*), void *data)
+{
+    AddGCCallback(m_gc_callbacks, cb, data);
+}
+
+void ContextGroup::UnregisterGCCallback(void (*cb)(GCType, GCCallbackFlags, void*), void *data)
+{
+    RemoveGCCallback(m_gc_callbacks, cb, data);
+}
+
+void ContextGroup::RegisterGCEpilogueCallback(void (*cb)(GCType, GCCallbackFlags, void*),
+                                              void *data)
+{
+    AddGCCallback(m_gc_epilogue_callbacks, cb, data);
+}
+
+void ContextGroup::UnregisterGCEpilogueCallback(void (*cb)(GCType, GCCallbackFlags, void*),
+                                                void *data)
+{
+    RemoveGCCallback(m_gc_epilogue_callbacks, cb, data);
+}
+
+void ContextGroup::SetGCMonitorEnabled(bool enabled)
+{
+    std::unique_lock<std::mutex> lk(m_gc_monitor_mutex);
+    if (enabled && !m_gc_monitor) {
+        m_gc_monitor = std::unique_ptr<GCMonitor>(new GCMonitor(this));
+    } else if (!enabled) {
+        m_gc_monitor.reset();
+    }
+}
+
+void ContextGroup::WithGCMonitor(const std::function<void(GCMonitor&)>& fn)
+{
+    std::unique_lock<std::mutex> lk(m_gc_monitor_mutex);
+    if (m_gc_monitor) {
+        fn(*m_gc_monitor);
+    }
+}
+
+void ContextGroup::GCPrologueCallback(GCType type, GCCallbackFlags flags)
+{
+    DispatchGCCallbacks(m_gc_callbacks, type, flags);
+}
+
+void ContextGroup::GCEpilogueCallback(GCType type, GCCallbackFlags flags)
+{
+    DispatchGCCallbacks(m_gc_epilogue_callbacks, type, flags);
+}
+
+ManagedSlot ContextGroup::Manage(boost::shared_ptr<JSValue> obj)
 {
-    m_managedValues.push_back(obj);
+    return m_managedValues.Add(obj);
 }
 
-void ContextGroup::Manage(boost::shared_ptr<JSContext> obj)
+ManagedSlot ContextGroup::Manage(boost::shared_ptr<JSContext> obj)
 {
-    m_managedContexts.push_back(obj);
+    return m_managedContexts.Add(obj);
 }
 
 void ContextGroup::Dispose()
@@ -350,40 +597,56 @@ void ContextGroup::Dispose()
         // Make sure we don't get destructed during the managed values/context disposal process
         auto wait = shared_from_this();
 
-        //ASSERTJSC(m_runnables.empty());
-        m_runnables.clear();
+        // Anyone still waiting in sync() is let go.  We may be on any thread here; if it isn't
+        // the loop's, the dispatcher leaves its handle for the loop to close.
+        m_dispatcher.Close();
 
-        m_isolate->RemoveGCPrologueCallback(StaticGCPrologueCallback);
+        {
+            std::unique_lock<std::mutex> lk(m_gc_monitor_mutex);
+            m_gc_monitor.reset();
+        }
+        m_isolate->RemoveGCPrologueCallback(StaticGCPrologueCallback, this);
+        m_isolate->RemoveGCEpilogueCallback(StaticGCEpilogueCallback, this);
 
-        for (auto it = m_managedValues.begin(); it != m_managedValues.end(); ++it) {
-            boost::shared_ptr<JSValue> valid = (*it).lock();
-            if (valid) {
-                valid->Dispose();
-            }
+        auto values = m_managedValues.Live();
+        for (auto it = values.begin(); it != values.end(); ++it) {
+            (*it)->Dispose();
         }
-        for (auto it = m_managedContexts.begin(); it != m_managedContexts.end(); ++it) {
-            boost::shared_ptr<JSContext> valid = (*it).lock();
-            if (valid) {
-                valid->Dispose();
-            }
+        values.clear();
+        auto contexts = m_managedContexts.Live();
+        for (auto it = contexts.begin(); it != contexts.end(); ++it) {
+            (*it)->Dispose();
         }
+        contexts.clear();
         m_isDefunct = true;
-        m_managedValues.clear();
-        m_managedContexts.clear();
+        m_managedValues.Clear();
+        m_managedContexts.Clear();
         FreeZombies();
 
-        s_mutex.lock();
-        if (s_isolate_map.count(m_isolate)) {
-            s_isolate_map.erase(m_isolate);
+        for (auto it = m_interned_names.begin(); it != m_interned_names.end(); ++it) {
+            (*it).Reset();
+        }
+        m_interned_names.clear();
+        m_interned_keys.clear();
+        m_value_ptr_key.Reset();
+
+        // No weak callback will get to whatever is still held outside of the isolate now
+        {
+            v8::Locker lock(m_isolate);
+            m_externals->ReleaseAll();
         }
-        s_mutex.unlock();
+
         if (m_manage_isolate) {
+            m_isolate->SetEmbedderHeapTracer(nullptr);
+            m_heap_tracer.reset();
             m_isolate->Dispose();
         } else {
             dispose_v8();
         }
 
-        if (m_startup_data.data && m_startup_data.raw_size) {
+        if (m_snapshot) {
+            m_snapshot.reset();
+        } else if (m_startup_data.data && m_startup_data.raw_size) {
             delete [] m_startup_data.data;
         }
 
@@ -398,77 +661,81 @@ ContextGroup::~ContextGroup()
 
 void ContextGroup::sync_(std::function<void()> runnable)
 {
-    std::condition_variable cv;
-    bool signaled = false;
-
-    struct Runnable *r = new struct Runnable;
-    r->thiz = nullptr;
-    r->runnable = nullptr;
-    r->jvm = nullptr;
-    r->c_runnable = [&]() {
-        runnable();
-        {
-            std::lock_guard<std::mutex> lk(m_async_mutex);
-            signaled = true;
-        }
-        cv.notify_one();
-    };
-
-    std::unique_lock<std::mutex> lk(m_async_mutex);
-    m_runnables.push_back((void*)r);
-
-    if (!m_async_handle) {
-        m_async_handle = new uv_async_t();
-        m_async_handle->data = new ContextGroupData(shared_from_this());
-        uv_async_init(Loop(), m_async_handle, ContextGroup::callback);
-        uv_async_send(m_async_handle);
-    }
+    m_dispatcher.Sync(runnable);
+}
 
-    cv.wait(lk, [&]{return signaled;});
-    lk.unlock();
+void ContextGroup::async_(std::function<void()> runnable)
+{
+    m_dispatcher.Async(runnable);
 }
 
 void ContextGroup::schedule_java_runnable(JNIEnv *env, jobject thiz, jobject runnable)
 {
-    m_async_mutex.lock();
-
-    struct Runnable *r = new struct Runnable;
+    JavaRunnable *r = new JavaRunnable;
     r->thiz = env->NewGlobalRef(thiz);
     r->runnable = env->NewGlobalRef(runnable);
-    r->c_runnable = nullptr;
     env->GetJavaVM(&r->jvm);
-    m_runnables.push_back((void*)r);
 
-    if (!m_async_handle) {
-        m_async_handle = new uv_async_t();
-        m_async_handle->data = new ContextGroupData(shared_from_this());
-        uv_async_init(Loop(), m_async_handle, ContextGroup::callback);
-        uv_async_send(m_async_handle);
+    m_dispatcher.Post(r);
+}
+
+jlong ContextGroup::InternName(const char *name)
+{
+    auto it = m_interned_keys.find(name);
+    if (it != m_interned_keys.end()) {
+        return it->second;
     }
-    m_async_mutex.unlock();
+
+    Local<String> interned =
+        String::NewFromUtf8(m_isolate, name, NewStringType::kInternalized).ToLocalChecked();
+    m_interned_names.push_back(Persistent<String, CopyablePersistentTraits<String>>(
+        m_isolate, interned));
+
+    // Keys are 1-based so that 0 can never be mistaken for a valid name
+    auto key = (jlong) m_interned_names.size();
+    m_interned_keys[name] = key;
+    return key;
 }
 
-boost::shared_ptr<ContextGroup> ContextGroup::New(const char *snapshotFile)
+MaybeLocal<String> ContextGroup::InternedName(jlong key)
 {
-    char *data = nullptr;
-    long size;
-
-    FILE *fp = fopen(snapshotFile, "rb");
-    if (fp) {
-        fseek(fp, 0L, SEEK_END);
-        size = ftell(fp);
-        rewind(fp);
-        data = new char[size];
-        size_t read = fread((void*)data, sizeof (char), (size_t)size, fp);
-        if (read != (size_t)size) {
-            delete[] data;
-            data = nullptr;
+    EscapableHandleScope scope(m_isolate);
+    if (key <= 0 || key > (jlong) m_interned_names.size()) {
+        return MaybeLocal<String>();
+    }
+    return scope.Escape(Local<String>::New(m_isolate, m_interned_names[key - 1]));
+}
+
+Local<Private> ContextGroup::ValuePtrKey()
+{
+    EscapableHandleScope scope(m_isolate);
+    if (m_value_ptr_key.IsEmpty()) {
+        m_value_ptr_key.Reset(m_isolate, v8::Private::ForApi(m_isolate,
+            String::NewFromUtf8(m_isolate, "__JSValue_ptr")));
+    }
+    return scope.Escape(Local<Private>::New(m_isolate, m_value_ptr_key));
+}
+
+Local<Context> ContextGroup::NewContext()
+{
+    EscapableHandleScope scope(m_isolate);
+    if (m_warm_context) {
+        Local<Context> context;
+        if (Context::FromSnapshot(m_isolate, kWarmContextIndex).ToLocal(&context)) {
+            return scope.Escape(context);
         }
-        fclose(fp);
+        // An older snapshot, whose script ran in the default context
+        m_warm_context = false;
     }
+    return scope.Escape(Context::New(m_isolate));
+}
+
+boost::shared_ptr<ContextGroup> ContextGroup::New(const char *snapshotFile)
+{
+    boost::shared_ptr<MappedSnapshot> snapshot = MappedSnapshot::Open(snapshotFile);
 
-    if (data) {
-        return boost::make_shared<ContextGroup>(data, size);
+    if (snapshot) {
+        return boost::make_shared<ContextGroup>(snapshot);
     } else {
         return boost::make_shared<ContextGroup>();
     }
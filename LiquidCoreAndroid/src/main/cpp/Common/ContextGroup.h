@@ -12,29 +12,41 @@
 #include "uv.h"
 
 #include <jni.h>
+#include <atomic>
+#include <cstdint>
 #include <thread>
 #include <mutex>
 #include <vector>
 #include <map>
+#include <string>
 #include <list>
 #include <boost/smart_ptr/atomic_shared_ptr.hpp>
 #include <boost/smart_ptr/enable_shared_from_this.hpp>
 #include <boost/atomic.hpp>
+#include "Common/ManagedRegistry.h"
+#include "Common/Slab.h"
+#include "Common/BufferAllocator.h"
+#include "ExternalRegistry.h"
+#include "LoopDispatcher.h"
 
 #define CONTEXT_GARBAGE_COLLECTED_BUT_PROCESS_STILL_ACTIVE 222
 
 using namespace v8;
 
-class GenericAllocator;
 class JSValue;
 class JSContext;
 class LoopPreserver;
+class AsyncTicket;
+class MappedSnapshot;
+class GCMonitor;
+class JavaHeapTracer;
 
 class ContextGroup : public boost::enable_shared_from_this<ContextGroup> {
 public:
     ContextGroup();
     ContextGroup(Isolate *isolate, uv_loop_t *uv_loop);
     ContextGroup(char *snapshot, int size);
+    ContextGroup(boost::shared_ptr<MappedSnapshot> snapshot);
     virtual ~ContextGroup();
 
     inline Isolate* isolate() { return m_isDefunct ? nullptr : m_isolate; }
@@ -50,62 +62,149 @@ public:
             sync_(runnable);
         }
     }
+    inline void async(std::function<void()> runnable)
+    {
+        if (!Loop() || std::this_thread::get_id() == Thread()) {
+            runnable();
+        } else {
+            async_(runnable);
+        }
+    }
+    // Like async(), but always waits for the next loop turn when there is a loop, even on the
+    // loop thread.  Without a loop the runnable runs immediately.
+    inline void defer(std::function<void()> runnable)
+    {
+        if (!Loop()) {
+            runnable();
+        } else {
+            async_(runnable);
+        }
+    }
     void RegisterGCCallback(void (*cb)(GCType type, GCCallbackFlags flags, void*), void *);
     void UnregisterGCCallback(void (*cb)(GCType type, GCCallbackFlags flags,void*), void *);
-    void Manage(boost::shared_ptr<JSValue> obj);
-    void Manage(boost::shared_ptr<JSContext> obj);
+    void RegisterGCEpilogueCallback(void (*cb)(GCType type, GCCallbackFlags flags, void*), void *);
+    void UnregisterGCEpilogueCallback(void (*cb)(GCType type, GCCallbackFlags flags,void*), void *);
+    ManagedSlot Manage(boost::shared_ptr<JSValue> obj);
+    ManagedSlot Manage(boost::shared_ptr<JSContext> obj);
+    void UnmanageValue(const ManagedSlot& slot) { m_managedValues.Remove(slot); }
+    void UnmanageContext(const ManagedSlot& slot) { m_managedContexts.Remove(slot); }
+    inline boost::shared_ptr<Slab> ValueSlab() { return m_value_slab; }
+    // Resources held outside of the isolate, let go of on Dispose() if nothing else has
+    inline boost::shared_ptr<nodedroid::ExternalRegistry> Externals() { return m_externals; }
+    // Null for groups running on an isolate we didn't create (i.e. node's)
+    inline BufferAllocator * Allocator() { return m_allocator.get(); }
+    // Policy for the ArrayBuffer allocator of groups created from now on
+    static inline void SetBufferPolicy(BufferAllocator::Policy policy) { s_buffer_policy = policy; }
+    // GC event recording is off until enabled.  Must be called with the isolate locked.
+    void SetGCMonitorEnabled(bool enabled);
+    // Runs |fn| on the GC monitor, if it is enabled, while holding it in place.  May be called
+    // from any thread.
+    void WithGCMonitor(const std::function<void(GCMonitor&)>& fn);
+    // Null for groups running on an isolate we didn't create
+    inline JavaHeapTracer * HeapTracer() { return m_heap_tracer.get(); }
     void Dispose();
     void MarkZombie(boost::shared_ptr<JSValue> obj);
     void MarkZombie(boost::shared_ptr<JSContext> obj);
     // These are just here for the SharedWrap template
     void MarkZombie(boost::shared_ptr<ContextGroup> obj) {}
     void MarkZombie(boost::shared_ptr<LoopPreserver> obj) {}
-    void FreeZombies();
+    void MarkZombie(boost::shared_ptr<AsyncTicket> obj) {}
+    void FreeZombies(size_t limit = SIZE_MAX);
+
+    // While a zombie batch is open on the calling thread, JSValue zombies are collected per
+    // group and handed over in one go (one lock, one wakeup) when the batch is closed.
+    static void BeginZombieBatch();
+    static void EndZombieBatch();
 
     void schedule_java_runnable(JNIEnv *env, jobject thiz, jobject runnable);
 
+    // Property names interned once per group and referenced by key.  Must be called
+    // with the isolate locked.
+    jlong InternName(const char *name);
+    // Empty if |key| was never handed out by InternName()
+    MaybeLocal<String> InternedName(jlong key);
+
+    // The private symbol under which wrapped objects point back to their JSValue, created
+    // once per group.  Must be called with the isolate locked.
+    Local<Private> ValuePtrKey();
+
+    struct GCCallback {
+        void (*cb)(GCType type, GCCallbackFlags flags, void*);
+        void *data;
+    };
+
     static void init_v8();
     static void dispose_v8();
+    // Platform setup; these only take effect before V8 is first initialized.  A host-supplied
+    // platform remains owned by the host.
+    static void ConfigurePlatform(int worker_threads, int background_nice);
+    static void SetPlatform(v8::Platform *platform);
     static inline std::mutex *Mutex() { return &s_mutex; }
     static inline v8::Platform * Platform() { return s_platform; }
-    static void callback(uv_async_t* handle);
-    static void StaticGCPrologueCallback(Isolate *isolate, GCType type, GCCallbackFlags flags);
+    static void StaticGCPrologueCallback(Isolate *isolate, GCType type, GCCallbackFlags flags,
+                                         void *data);
+    static void StaticGCEpilogueCallback(Isolate *isolate, GCType type, GCCallbackFlags flags,
+                                         void *data);
     static boost::shared_ptr<ContextGroup> New(const char *snapshotFile);
 
+    // Index of the warm context in snapshots from JNIJSContextGroup.createSnapshot(); the
+    // default context in those is left pristine
+    static const size_t kWarmContextIndex = 0;
+    // A new context, deserialized from the snapshot's warm context when the group was started
+    // from one that has it, or else from Context::New().  Must be called with the isolate locked.
+    Local<Context> NewContext();
+
 protected:
     void GCPrologueCallback(GCType type, GCCallbackFlags flags);
+    void GCEpilogueCallback(GCType type, GCCallbackFlags flags);
 
 private:
     static v8::Platform *s_platform;
+    static BufferAllocator::Policy s_buffer_policy;
+    static bool s_host_platform;
+    static int s_worker_threads;
+    static int s_background_nice;
     static int s_init_count;
     static std::mutex s_mutex;
-    static std::map<Isolate *, ContextGroup *> s_isolate_map;
 
+    void MarkZombies(std::vector<boost::shared_ptr<JSValue>>& zombies);
     void sync_(std::function<void()> runnable);
+    void async_(std::function<void()> runnable);
+    void Turn(nodedroid::LoopDispatcher& dispatcher);
 
     Isolate *m_isolate;
     Isolate::CreateParams m_create_params;
+    std::unique_ptr<BufferAllocator> m_allocator;
     bool m_manage_isolate;
     uv_loop_t *m_uv_loop;
     std::thread::id m_thread_id;
-    std::vector<boost::weak_ptr<JSValue>> m_managedValues;
-    std::vector<boost::weak_ptr<JSContext>> m_managedContexts;
+    ManagedRegistry<JSValue> m_managedValues;
+    ManagedRegistry<JSContext> m_managedContexts;
+    boost::shared_ptr<Slab> m_value_slab = boost::shared_ptr<Slab>(new Slab());
+    boost::shared_ptr<nodedroid::ExternalRegistry> m_externals =
+        boost::shared_ptr<nodedroid::ExternalRegistry>(new nodedroid::ExternalRegistry());
     std::vector<boost::shared_ptr<JSValue>> m_value_zombies;
     std::vector<boost::shared_ptr<JSContext>> m_context_zombies;
     std::mutex m_zombie_mutex;
-    bool m_isDefunct;
+    // Read from any thread (by SharedWrap finalizers and AsyncTicket among others)
+    std::atomic<bool> m_isDefunct;
 
-    struct GCCallback {
-        void (*cb)(GCType type, GCCallbackFlags flags, void*);
-        void *data;
-    };
     std::list<std::unique_ptr<struct GCCallback>> m_gc_callbacks;
+    std::list<std::unique_ptr<struct GCCallback>> m_gc_epilogue_callbacks;
+    std::unique_ptr<GCMonitor> m_gc_monitor;
+    std::mutex m_gc_monitor_mutex;
+    std::unique_ptr<JavaHeapTracer> m_heap_tracer;
 
-    uv_async_t *m_async_handle;
-    std::vector<void *> m_runnables;
-    std::mutex m_async_mutex;
+    nodedroid::LoopDispatcher m_dispatcher;
 
     v8::StartupData m_startup_data;
+    boost::shared_ptr<MappedSnapshot> m_snapshot;
+    // Cleared once the snapshot turns out to have no warm context
+    bool m_warm_context;
+
+    std::vector<Persistent<String, CopyablePersistentTraits<String>>> m_interned_names;
+    std::map<std::string, jlong> m_interned_keys;
+    Persistent<Private, CopyablePersistentTraits<Private>> m_value_ptr_key;
 };
 
 #endif //LIQUIDCORE_CONTEXTGROUP_H
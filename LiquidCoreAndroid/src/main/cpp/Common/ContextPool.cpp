@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#include <boost/make_shared.hpp>
+#include "Common/ContextPool.h"
+
+ContextPool::ContextPool(size_t size, const std::string& snapshotFile)
+{
+    m_slots.resize(size);
+    for (auto& slot : m_slots) {
+        slot.group = snapshotFile.empty() ? boost::make_shared<ContextGroup>() :
+            ContextGroup::New(snapshotFile.c_str());
+        slot.leased = false;
+    }
+}
+
+ContextPool::~ContextPool() = default;
+
+boost::shared_ptr<JSContext> ContextPool::Lease()
+{
+    const std::thread::id self = std::this_thread::get_id();
+    Slot *slot = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&]{
+            for (auto& s : m_slots) {
+                if (s.leased) continue;
+                if (!slot || s.last_thread == self) slot = &s;
+                if (s.last_thread == self) break;
+            }
+            return slot != nullptr;
+        });
+        slot->leased = true;
+        slot->last_thread = self;
+    }
+
+    boost::shared_ptr<ContextGroup> group = slot->group;
+    boost::shared_ptr<JSContext> context;
+    V8_ISOLATE(group, isolate)
+        context = JSContext::New(group, group->NewContext());
+    V8_UNLOCK()
+    return context;
+}
+
+void ContextPool::Release(boost::shared_ptr<JSContext> context)
+{
+    boost::shared_ptr<ContextGroup> group = context->Group();
+
+    V8_ISOLATE(group, isolate)
+        context->Dispose();
+        group->FreeZombies();
+        isolate->ContextDisposedNotification();
+    V8_UNLOCK()
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (auto& slot : m_slots) {
+        if (slot.group == group) {
+            slot.leased = false;
+            m_cv.notify_one();
+            break;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#ifndef LIQUIDCORE_CONTEXTPOOL_H
+#define LIQUIDCORE_CONTEXTPOOL_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Common/Common.h"
+
+/*
+ * A fixed set of loop-less context groups, for evaluating many short, independent scripts
+ * from any number of host threads at once.  Each lease is a fresh context alone on an isolate
+ * no one else is using, so leases on different threads run in parallel.  A thread is handed
+ * the isolate it used last whenever that one is free, which keeps its caches warm.  Leasing
+ * waits while every isolate is out.
+ */
+class ContextPool {
+public:
+    // 'snapshotFile' may be empty; otherwise every isolate starts from it
+    ContextPool(size_t size, const std::string& snapshotFile);
+    ~ContextPool();
+
+    boost::shared_ptr<JSContext> Lease();
+    // Disposes the leased context and hands its isolate back
+    void Release(boost::shared_ptr<JSContext> context);
+
+private:
+    struct Slot {
+        boost::shared_ptr<ContextGroup> group;
+        std::thread::id last_thread;
+        bool leased;
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<Slot> m_slots;
+};
+
+#endif //LIQUIDCORE_CONTEXTPOOL_H
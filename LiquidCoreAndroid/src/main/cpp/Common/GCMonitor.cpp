@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#include "Common/GCMonitor.h"
+#include "Common/ContextGroup.h"
+
+#define MAX_GC_EVENTS 256
+
+GCMonitor::GCMonitor(ContextGroup *group) : m_group(group), m_used_before(0)
+{
+    m_group->RegisterGCCallback(StaticPrologue, this);
+    m_group->RegisterGCEpilogueCallback(StaticEpilogue, this);
+}
+
+GCMonitor::~GCMonitor()
+{
+    m_group->UnregisterGCCallback(StaticPrologue, this);
+    m_group->UnregisterGCEpilogueCallback(StaticEpilogue, this);
+}
+
+void GCMonitor::StaticPrologue(v8::GCType /*type*/, v8::GCCallbackFlags /*flags*/, void *data)
+{
+    auto monitor = reinterpret_cast<GCMonitor*>(data);
+    v8::HeapStatistics stats;
+    monitor->m_group->isolate()->GetHeapStatistics(&stats);
+    monitor->m_used_before = stats.used_heap_size();
+    monitor->m_start = std::chrono::steady_clock::now();
+}
+
+void GCMonitor::StaticEpilogue(v8::GCType type, v8::GCCallbackFlags /*flags*/, void *data)
+{
+    auto monitor = reinterpret_cast<GCMonitor*>(data);
+    auto end = std::chrono::steady_clock::now();
+    v8::HeapStatistics stats;
+    monitor->m_group->isolate()->GetHeapStatistics(&stats);
+
+    Event event;
+    event.type = type;
+    event.duration_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(end - monitor->m_start).count();
+    event.bytes_freed = (int64_t) monitor->m_used_before - (int64_t) stats.used_heap_size();
+
+    std::unique_lock<std::mutex> lk(monitor->m_mutex);
+    if (monitor->m_events.size() == MAX_GC_EVENTS) {
+        monitor->m_events.pop_front();
+    }
+    monitor->m_events.push_back(event);
+}
+
+std::vector<GCMonitor::Event> GCMonitor::Drain()
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    std::vector<Event> events(m_events.begin(), m_events.end());
+    m_events.clear();
+    return events;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#ifndef LIQUIDCORE_GCMONITOR_H
+#define LIQUIDCORE_GCMONITOR_H
+
+#include "v8.h"
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class ContextGroup;
+
+/*
+ * Records one event per garbage collection of a group (type, pause and bytes freed) using
+ * the group's prologue/epilogue callbacks.  Only the most recent events are kept; callers
+ * drain them periodically.
+ */
+class GCMonitor {
+public:
+    struct Event {
+        v8::GCType type;
+        int64_t duration_us;
+        int64_t bytes_freed;
+    };
+
+    // Must be called with the isolate locked
+    GCMonitor(ContextGroup *group);
+    ~GCMonitor();
+
+    std::vector<Event> Drain();
+
+private:
+    static void StaticPrologue(v8::GCType type, v8::GCCallbackFlags flags, void *data);
+    static void StaticEpilogue(v8::GCType type, v8::GCCallbackFlags flags, void *data);
+
+    ContextGroup *m_group;
+    std::chrono::steady_clock::time_point m_start;
+    size_t m_used_before;
+    std::deque<Event> m_events;
+    std::mutex m_mutex;
+};
+
+#endif //LIQUIDCORE_GCMONITOR_H
@@ -12,7 +12,7 @@
 boost::shared_ptr<JSContext> JSContext::New(boost::shared_ptr<ContextGroup> isolate, Local<Context> val)
 {
     auto p = boost::make_shared<JSContext>(isolate, val);
-    isolate->Manage(p);
+    p->m_managed_slot = isolate->Manage(p);
     return p;
 }
 
@@ -32,15 +32,19 @@ void JSContext::Dispose() {
 
         m_set_mutex.lock();
         for (auto it = m_value_set.begin(); it != m_value_set.end(); ++it) {
-            auto p = boost::atomic_load<JSValue>(&(*it));
+            auto p = boost::atomic_load<JSValue>(&(it->second));
             p.reset();
         }
         m_value_set.clear();
         m_set_mutex.unlock();
+        m_global.reset();
 
         m_context.Reset();
         {
             boost::shared_ptr<ContextGroup> isolate = m_isolate;
+            if (isolate) {
+                isolate->UnmanageContext(m_managed_slot);
+            }
             isolate.reset();
         }
     }
@@ -48,12 +52,43 @@ void JSContext::Dispose() {
 
 void JSContext::retain(boost::shared_ptr<JSValue> value) {
     m_set_mutex.lock();
-    m_value_set.push_back(value);
+    m_value_set[&* value] = value;
     m_set_mutex.unlock();
 }
 
+void JSContext::release(JSValue *value) {
+    boost::shared_ptr<JSValue> p;
+    m_set_mutex.lock();
+    auto it = m_value_set.find(value);
+    if (it != m_value_set.end()) {
+        p = it->second;
+        m_value_set.erase(it);
+    }
+    m_set_mutex.unlock();
+    // 'value' may be destroyed here, outside the lock
+    p.reset();
+}
+
+/*
+ * Called with the isolate locked as Java lets go of a reference.  If the retained set is the
+ * only other owner, nobody on the Java side can reach the value anymore, so its JS handle is
+ * made weak and the entry is released once JS is done with it as well.
+ */
+void JSContext::released(const boost::shared_ptr<JSValue>& value) {
+    m_set_mutex.lock();
+    auto it = m_value_set.find(&* value);
+    if (it != m_value_set.end() && value.use_count() == 2) {
+        value->Weaken();
+    }
+    m_set_mutex.unlock();
+}
+
+// The global object never changes, so it is only looked up and wrapped the first time
 boost::shared_ptr<JSValue> JSContext::Global() {
-    Local<v8::Value> global = Value()->Global();
-    boost::shared_ptr<JSContext> ctx = shared_from_this();
-    return JSValue::New(ctx, global);
+    if (!m_global) {
+        Local<v8::Value> global = Value()->Global();
+        boost::shared_ptr<JSContext> ctx = shared_from_this();
+        m_global = JSValue::New(ctx, global);
+    }
+    return m_global;
 }
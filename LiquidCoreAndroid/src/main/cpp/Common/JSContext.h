@@ -8,11 +8,24 @@
 #define LIQUIDCORE_JSCONTEXT_H
 
 #include "Common/ContextGroup.h"
+#include <mutex>
+#include <unordered_map>
 
 using namespace v8;
 
 class JSValue;
 
+/*
+ * The Java reference each wrapped object of a context was last handed out as, and how many
+ * times it has been handed out since.  An object crosses to Java as the same reference for as
+ * long as Java holds any, so Java can compare references instead of asking for canonical ones.
+ * Kept by SharedWrap<JSValue>.
+ */
+struct JavaReferences {
+    std::mutex mutex;
+    std::unordered_map<JSValue*, std::pair<jlong, size_t>> map;
+};
+
 class JSContext : public boost::enable_shared_from_this<JSContext> {
 public:
     static boost::shared_ptr<JSContext> New(boost::shared_ptr<ContextGroup> isolate, Local<Context> val);
@@ -37,13 +50,20 @@ public:
     inline bool IsDefunct() { return m_isDefunct; }
 
     void retain(boost::shared_ptr<JSValue>);
+    void release(JSValue *value);
+    void released(const boost::shared_ptr<JSValue>& value);
+
+    inline JavaReferences& References() { return m_references; }
 
 private:
     Persistent<Context, CopyablePersistentTraits<Context>> m_context;
     boost::atomic_shared_ptr<ContextGroup> m_isolate;
     bool m_isDefunct;
-    std::vector<boost::shared_ptr<JSValue>> m_value_set;
+    ManagedSlot m_managed_slot;
+    std::unordered_map<JSValue*, boost::shared_ptr<JSValue>> m_value_set;
     std::recursive_mutex m_set_mutex;
+    boost::shared_ptr<JSValue> m_global;
+    JavaReferences m_references;
 };
 
 #endif //LIQUIDCORE_JSCONTEXT_H
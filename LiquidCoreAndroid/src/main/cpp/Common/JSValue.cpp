@@ -14,31 +14,31 @@ boost::shared_ptr<JSValue> JSValue::New(boost::shared_ptr<JSContext> context, Lo
     boost::shared_ptr<JSValue> value;
 
     if (val->IsObject()) {
-        Local<Private> privateKey = v8::Private::ForApi(context->isolate(),
-            String::NewFromUtf8(context->isolate(), "__JSValue_ptr"));
+        Local<Private> privateKey = context->Group()->ValuePtrKey();
         Local<Object> obj = val.As<Object>();
         Local<v8::Value> identifier;
-        Maybe<bool> result = obj->HasPrivate(context->Value(), privateKey);
-        bool hasPrivate = false;
-        if (result.IsJust() && result.FromJust()) {
-            hasPrivate = obj->GetPrivate(context->Value(), privateKey).ToLocal(&identifier);
-        }
+        // A missing private reads as undefined, so there is no need to ask HasPrivate first
+        bool hasPrivate = obj->GetPrivate(context->Value(), privateKey).ToLocal(&identifier);
         if (hasPrivate && !identifier->IsUndefined()) {
             // This object is already wrapped, let's re-use it
-            return Unwrap(identifier)->shared_from_this();
+            boost::shared_ptr<JSValue> wrapped = Unwrap(identifier)->shared_from_this();
+            wrapped->Strengthen();
+            return wrapped;
         } else {
             // First time wrap.  Create it new and mark it
-            value = boost::make_shared<JSValue>(context,val);
+            value = boost::allocate_shared<JSValue>(
+                SlabAllocator<JSValue>(context->Group()->ValueSlab()), context, val);
             context->retain(value);
             value->m_wrapped = true;
 
             obj->SetPrivate(context->Value(), privateKey, Wrap(&* value));
         }
     } else {
-        value = boost::make_shared<JSValue>(context,val);
+        value = boost::allocate_shared<JSValue>(
+            SlabAllocator<JSValue>(context->Group()->ValueSlab()), context, val);
     }
 
-    context->Group()->Manage(value);
+    value->m_managed_slot = context->Group()->Manage(value);
     return value;
 }
 
@@ -50,6 +50,8 @@ JSValue::JSValue(boost::shared_ptr<JSContext> context, Local<v8::Value> val) :
     m_isObject(val->IsObject()),
     m_isNumber(val->IsNumber()),
     m_isBoolean(val->IsBoolean()),
+    m_booleanValue(false),
+    m_isWeak(false),
     m_isDefunct(false)
 {
     if (!m_isUndefined && !m_isNull) {
@@ -62,7 +64,7 @@ JSValue::JSValue(boost::shared_ptr<JSContext> context, Local<v8::Value> val) :
     }
 }
 
-JSValue::JSValue() : m_isDefunct(false)
+JSValue::JSValue() : m_isWeak(false), m_isDefunct(false)
 {
 }
 
@@ -77,14 +79,16 @@ void JSValue::Dispose()
         m_isDefunct = true;
 
         boost::shared_ptr<JSContext> context = m_context;
+        if (context) {
+            context->Group()->UnmanageValue(m_managed_slot);
+        }
         if (context && !m_isUndefined && !m_isNull) {
             V8_ISOLATE(context->Group(), iso)
-                if (m_wrapped) {
+                if (m_wrapped && !m_value.IsEmpty()) {
                     Local<v8::Value> local = m_value.Get(iso);
                     Local<Object> obj = local->ToObject(context->Value()).ToLocalChecked();
                     // Clear wrapper pointer if it exists, in case this object is still held by JS
-                    Local<Private> privateKey = v8::Private::ForApi(iso,
-                        String::NewFromUtf8(iso, "__JSValue_ptr"));
+                    Local<Private> privateKey = context->Group()->ValuePtrKey();
                     obj->SetPrivate(context->Value(), privateKey,
                         Local<v8::Value>::New(iso,Undefined(iso)));
                 }
@@ -100,4 +104,35 @@ void JSValue::Dispose()
         m_isNumber = false;
         m_isBoolean = false;
     }
-}
\ No newline at end of file
+}
+
+/*
+ * A wrapped value that only the context's retained set still owns is held weakly, so that
+ * once JS can't reach it either it is dropped from the set.  Must be called with the isolate
+ * locked.
+ */
+void JSValue::Weaken()
+{
+    if (m_wrapped && !m_isWeak && !m_value.IsEmpty()) {
+        m_isWeak = true;
+        m_value.SetWeak<JSValue>(this, [](const WeakCallbackInfo<JSValue>& info) {
+            info.GetParameter()->m_value.Reset();
+            // Releasing disposes the value, which uses V8; that has to wait for the second pass
+            info.SetSecondPassCallback([](const WeakCallbackInfo<JSValue>& info) {
+                JSValue *value = info.GetParameter();
+                boost::shared_ptr<JSContext> context = value->m_context;
+                if (context) {
+                    context->release(value);
+                }
+            });
+        }, v8::WeakCallbackType::kParameter);
+    }
+}
+
+void JSValue::Strengthen()
+{
+    if (m_isWeak && !m_value.IsEmpty()) {
+        m_value.ClearWeak();
+        m_isWeak = false;
+    }
+}
@@ -7,6 +7,7 @@
 #ifndef LIQUIDCORE_JSVALUE_H
 #define LIQUIDCORE_JSVALUE_H
 
+#include <atomic>
 #include "Common/JSContext.h"
 
 using namespace v8;
@@ -55,6 +56,13 @@ public:
     inline double NumberValue() { return m_numberValue; }
 
     void Dispose();
+    void Weaken();
+    void Strengthen();
+    // Marks the value as reachable during an embedder heap trace
+    inline void Trace(Isolate *isolate)
+    {
+        if (!m_value.IsEmpty()) m_value.RegisterExternalReference(isolate);
+    }
 
     static inline Local<v8::Value> Wrap(JSValue *value)
     {
@@ -71,17 +79,22 @@ public:
 protected:
     Persistent<v8::Value> m_value;
     boost::atomic_shared_ptr<JSContext> m_context;
-    bool m_isUndefined;
-    bool m_isNull;
-    bool m_wrapped;
-    bool m_isObject;
-    bool m_isNumber;
     double m_numberValue;
-    bool m_isBoolean;
-    bool m_booleanValue;
+    ManagedSlot m_managed_slot;
+    // Type bits, packed.  Only ever written by the constructor.
+    bool m_isUndefined : 1;
+    bool m_isNull : 1;
+    bool m_wrapped : 1;
+    bool m_isObject : 1;
+    bool m_isNumber : 1;
+    bool m_isBoolean : 1;
+    bool m_booleanValue : 1;
+    // Changed on the loop thread after construction, so kept out of the bitfield above
+    bool m_isWeak;
 
 private:
-    bool m_isDefunct = false;
+    // Read from any thread
+    std::atomic<bool> m_isDefunct;
 };
 
 #endif //LIQUIDCORE_JSVALUE_H
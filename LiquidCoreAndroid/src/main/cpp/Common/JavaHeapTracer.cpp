@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#include <algorithm>
+#include "Common/JavaHeapTracer.h"
+#include "Common/JSValue.h"
+#include "JNI/JNI.h"
+
+namespace {
+// Only its address matters; it is aligned as V8 requires of internal field pointers
+alignas(8) char s_tag;
+
+// JNI is fine during GC as long as nothing calls back into V8
+class Env {
+public:
+    Env() { m_env = threadEnv(javaVM(), m_detach); }
+    ~Env() { if (m_detach) javaVM()->DetachCurrentThread(); }
+    JNIEnv * operator->() { return m_env; }
+private:
+    JNIEnv *m_env;
+    bool m_detach;
+};
+} /* namespace */
+
+JavaHeapTracer::JavaHeapTracer(v8::Isolate *isolate) :
+    m_isolate(isolate), m_tracing(false), m_java_only(false)
+{
+}
+
+JavaHeapTracer::~JavaHeapTracer()
+{
+    Env env;
+    for (JavaPeer *peer : m_peers) {
+        if (peer->pin) {
+            env->DeleteGlobalRef(peer->pin);
+            peer->pin = nullptr;
+        }
+    }
+}
+
+void * JavaHeapTracer::Tag()
+{
+    return &s_tag;
+}
+
+JavaPeer * JavaHeapTracer::PeerOf(v8::Local<v8::Object> wrapper)
+{
+    if (wrapper->InternalFieldCount() < 2 ||
+            wrapper->GetAlignedPointerFromInternalField(1) != Tag()) {
+        return nullptr;
+    }
+    return static_cast<JavaPeer*>(wrapper->GetAlignedPointerFromInternalField(0));
+}
+
+void JavaHeapTracer::Add(JavaPeer *peer)
+{
+    peer->fresh = true;
+    m_peers.insert(peer);
+}
+
+void JavaHeapTracer::Remove(JavaPeer *peer)
+{
+    m_peers.erase(peer);
+    m_pending.erase(std::remove(m_pending.begin(), m_pending.end(), peer), m_pending.end());
+}
+
+void JavaHeapTracer::Hold(JavaPeer *peer, boost::shared_ptr<JSValue> value, bool hold)
+{
+    auto found = std::find(peer->held.begin(), peer->held.end(), value);
+    if (hold && found == peer->held.end()) {
+        peer->held.push_back(value);
+        value->Weaken();
+        // Marking already under way won't come back for it
+        if (m_tracing) value->Trace(m_isolate);
+    } else if (!hold && found != peer->held.end()) {
+        peer->held.erase(found);
+        value->Strengthen();
+    }
+}
+
+void JavaHeapTracer::RegisterV8References(
+        const std::vector<std::pair<void*, void*>>& embedder_fields)
+{
+    for (auto& fields : embedder_fields) {
+        if (fields.second != Tag()) continue;
+        auto peer = static_cast<JavaPeer*>(fields.first);
+        if (peer->visited || m_peers.find(peer) == m_peers.end()) continue;
+        peer->visited = true;
+        peer->reached = !m_java_only;
+        m_pending.push_back(peer);
+    }
+}
+
+void JavaHeapTracer::TracePrologue()
+{
+    m_tracing = true;
+    m_java_only = false;
+    m_pending.clear();
+    for (JavaPeer *peer : m_peers) {
+        peer->fresh = peer->reached = peer->visited = false;
+    }
+}
+
+void JavaHeapTracer::TracePending()
+{
+    for (JavaPeer *peer : m_pending) {
+        for (auto& value : peer->held) {
+            value->Trace(m_isolate);
+        }
+    }
+    m_pending.clear();
+}
+
+bool JavaHeapTracer::AdvanceTracing(double /*deadline_in_ms*/, AdvanceTracingActions actions)
+{
+    TracePending();
+    // V8 only forces completion once its own marking is through, so anything not yet
+    // visited can't be reached from JS other than through a peer
+    if (!m_java_only && actions.force_completion == FORCE_COMPLETION) {
+        m_java_only = true;
+        Env env;
+        for (JavaPeer *peer : m_peers) {
+            if (peer->visited) continue;
+            if (peer->pin || !env->IsSameObject(peer->java, nullptr)) {
+                peer->visited = true;
+                m_pending.push_back(peer);
+            }
+        }
+        TracePending();
+    }
+    return false;
+}
+
+void JavaHeapTracer::TraceEpilogue()
+{
+    Env env;
+    for (JavaPeer *peer : m_peers) {
+        if (peer->fresh) continue;
+        if (peer->reached && !peer->pin) {
+            // Null if Java has already let it go, in which case there is nothing to keep
+            peer->pin = env->NewGlobalRef(peer->java);
+        } else if (!peer->reached && peer->pin) {
+            env->DeleteGlobalRef(peer->pin);
+            peer->pin = nullptr;
+        }
+    }
+    m_tracing = false;
+}
+
+void JavaHeapTracer::AbortTracing()
+{
+    m_pending.clear();
+    m_tracing = false;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#ifndef LIQUIDCORE_JAVAHEAPTRACER_H
+#define LIQUIDCORE_JAVAHEAPTRACER_H
+
+#include "v8.h"
+#include <jni.h>
+#include <unordered_set>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+class JSValue;
+
+/*
+ * A Java object that JS reaches through a wrapper object, whose internal fields 0 and 1 are
+ * the peer and JavaHeapTracer::Tag().  JS keeps the Java object alive through the wrapper,
+ * and the Java object keeps alive the JS values it holds.
+ */
+struct JavaPeer {
+    jweak java = nullptr;
+    jobject pin = nullptr;      // while JS can reach the wrapper
+    std::vector<boost::shared_ptr<JSValue>> held;
+    bool fresh = true;          // made since the current trace began
+    bool reached = false;       // wrapper reached from JS on its own this trace
+    bool visited = false;       // held values traced this trace
+};
+
+/*
+ * Lets cycles that run through both heaps (a Java object holding a JS value that reaches the
+ * Java object's own wrapper) be collected without releasing the context.  The values a peer
+ * holds are not GC roots; V8 traces them through the peer instead:
+ *
+ *  - first from the wrappers V8 marks by itself, whose Java objects JS can reach and which are
+ *    pinned for it until the next trace;
+ *  - then, once V8's own marking is done, from the Java objects only Java may still hold, as
+ *    told by their weak references.  These are left unpinned, so that once Java lets go of
+ *    one the next full collection finds it gone and its values, wrapper and all, go too.
+ *
+ * Installed on groups with an isolate of their own.  All calls are made with the isolate
+ * locked.
+ */
+class JavaHeapTracer : public v8::EmbedderHeapTracer {
+public:
+    explicit JavaHeapTracer(v8::Isolate *isolate);
+    ~JavaHeapTracer() override;
+
+    static void * Tag();
+    // The peer behind a wrapper, or null if it isn't one
+    static JavaPeer * PeerOf(v8::Local<v8::Object> wrapper);
+
+    void Add(JavaPeer *peer);
+    void Remove(JavaPeer *peer);
+    // Whether the peer's Java object holds 'value'
+    void Hold(JavaPeer *peer, boost::shared_ptr<JSValue> value, bool hold);
+
+    void RegisterV8References(
+            const std::vector<std::pair<void*, void*>>& embedder_fields) override;
+    void TracePrologue() override;
+    bool AdvanceTracing(double deadline_in_ms, AdvanceTracingActions actions) override;
+    void TraceEpilogue() override;
+    void EnterFinalPause() override {}
+    void AbortTracing() override;
+    size_t NumberOfWrappersToTrace() override { return m_pending.size(); }
+
+private:
+    void TracePending();
+
+    v8::Isolate *m_isolate;
+    std::unordered_set<JavaPeer*> m_peers;
+    std::vector<JavaPeer*> m_pending;
+    bool m_tracing;
+    bool m_java_only;   // tracing from peers only Java holds
+};
+
+#endif //LIQUIDCORE_JAVAHEAPTRACER_H
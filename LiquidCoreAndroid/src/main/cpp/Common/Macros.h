@@ -8,11 +8,17 @@
 #define LIQUIDCORE_MACROS_H
 
 #include "Common/JSContext.h"
+#include "BridgeProfiler.h"
+#include "TraceSpan.h"
 
 #define V8_ISOLATE(group,iso) \
         boost::shared_ptr<ContextGroup> group_ = (group); \
+        const char *trace_name_ = __func__; \
+        uint64_t bridge_entered_ = nodedroid::BridgeProfiler::Enter(); \
         auto runnable_ = [&]() \
         { \
+            nodedroid::TraceSpan trace_span_(trace_name_); \
+            nodedroid::BridgeProfiler::Call bridge_call_(trace_name_, bridge_entered_); \
             Isolate *iso = group_->isolate(); \
             v8::Locker lock_(group_->isolate()); \
             Isolate::Scope isolate_scope_(iso); \
@@ -26,4 +32,30 @@
 #define V8_UNLOCK() \
         }; group_->sync(runnable_);
 
+/*
+ * Fire-and-forget variants.  The block captures by value and may run after the caller has
+ * returned, so it must not touch JNIEnv or anything on the caller's stack by reference.
+ */
+#define V8_ISOLATE_ASYNC(group,iso) \
+        boost::shared_ptr<ContextGroup> group_ = (group); \
+        const char *trace_name_ = __func__; \
+        uint64_t bridge_entered_ = nodedroid::BridgeProfiler::Enter(); \
+        auto runnable_ = [=]() \
+        { \
+            Isolate *iso = group_->isolate(); \
+            if (!iso) return; \
+            nodedroid::TraceSpan trace_span_(trace_name_); \
+            nodedroid::BridgeProfiler::Call bridge_call_(trace_name_, bridge_entered_); \
+            v8::Locker lock_(group_->isolate()); \
+            Isolate::Scope isolate_scope_(iso); \
+            HandleScope handle_scope_(iso);
+
+#define V8_ISOLATE_CTX_ASYNC(ctx,iso,Ctx) \
+        V8_ISOLATE_ASYNC((ctx)->Group(),iso) \
+            Local<v8::Context> Ctx = (ctx)->Value(); \
+            v8::Context::Scope context_scope_(Ctx);
+
+#define V8_UNLOCK_ASYNC() \
+        }; group_->async(runnable_);
+
 #endif //LIQUIDCORE_MACROS_H
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#ifndef LIQUIDCORE_MANAGEDREGISTRY_H
+#define LIQUIDCORE_MANAGEDREGISTRY_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+/*
+ * Handle to an entry in a ManagedRegistry, kept by the owner so it can give the slot back
+ * when it dies.  A slot is reused once freed; the generation tells a stale handle from the
+ * current occupant.  Generation 0 is never issued.
+ */
+struct ManagedSlot {
+    uint32_t index = 0;
+    uint32_t generation = 0;
+};
+
+/*
+ * Weak registry of objects that must be disposed along with their group.  Storage is
+ * proportional to the number of live objects, not to the number ever registered.
+ */
+template <typename T>
+class ManagedRegistry {
+public:
+    ManagedSlot Add(const boost::shared_ptr<T>& obj)
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        ManagedSlot slot;
+        if (m_free.empty()) {
+            slot.index = (uint32_t) m_entries.size();
+            m_entries.push_back(Entry());
+        } else {
+            slot.index = m_free.back();
+            m_free.pop_back();
+        }
+        Entry& entry = m_entries[slot.index];
+        entry.obj = obj;
+        entry.generation = m_generation;
+        slot.generation = m_generation;
+        return slot;
+    }
+
+    void Remove(const ManagedSlot& slot)
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        if (slot.generation == 0 || slot.index >= m_entries.size()) return;
+        Entry& entry = m_entries[slot.index];
+        if (entry.generation != slot.generation) return;
+        entry.obj.reset();
+        entry.generation = 0;
+        m_free.push_back(slot.index);
+        if (++m_generation == 0) m_generation = 1;
+    }
+
+    // Snapshot of the live entries, taken so the caller can dispose them without holding
+    // the lock (disposal removes entries).
+    std::vector<boost::shared_ptr<T>> Live()
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        std::vector<boost::shared_ptr<T>> live;
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            boost::shared_ptr<T> valid = (*it).obj.lock();
+            if (valid) {
+                live.push_back(valid);
+            }
+        }
+        return live;
+    }
+
+    void Clear()
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_entries.clear();
+        m_free.clear();
+    }
+
+private:
+    struct Entry {
+        boost::weak_ptr<T> obj;
+        uint32_t generation = 0;
+    };
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_free;
+    uint32_t m_generation = 1;
+    std::mutex m_mutex;
+};
+
+#endif //LIQUIDCORE_MANAGEDREGISTRY_H
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+*/
+#ifndef LIQUIDCORE_SLAB_H
+#define LIQUIDCORE_SLAB_H
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <boost/shared_ptr.hpp>
+
+/*
+ * Fixed-size block pool.  Blocks are carved out of large chunks and recycled through a free
+ * list per chunk, so that the many small, short-lived objects of a group (JSValue and its
+ * control block) don't each go to malloc.  Requests larger than a block fall through to
+ * malloc.
+ *
+ * Chunks are aligned to their size, so a block finds its chunk from its address.  Once a chunk
+ * empties out it is given back, except for one kept spare so that a group hovering around a
+ * chunk boundary doesn't keep going to the system.
+ */
+class Slab {
+public:
+    static const size_t kBlockSize = 160;
+    static const size_t kChunkSize = 64 * 1024;
+
+    Slab() {}
+    ~Slab()
+    {
+        // Every block holds a reference on us, so by now every chunk is on the list
+        while (m_partial) {
+            struct Chunk *chunk = m_partial;
+            m_partial = chunk->next;
+            free(chunk);
+        }
+    }
+
+    void * Allocate(size_t size)
+    {
+        if (size > kBlockSize) {
+            void *p = malloc(size);
+            if (!p) throw std::bad_alloc();
+            return p;
+        }
+        std::unique_lock<std::mutex> lk(m_mutex);
+        struct Chunk *chunk = m_partial;
+        if (!chunk) {
+            chunk = NewChunk();
+            Link(chunk);
+        }
+        struct Block *block = chunk->free;
+        chunk->free = block->next;
+        if (chunk->used++ == 0) m_empty--;
+        if (!chunk->free) Unlink(chunk);
+        return block;
+    }
+
+    void Free(void *p, size_t size)
+    {
+        if (size > kBlockSize) {
+            free(p);
+            return;
+        }
+        std::unique_lock<std::mutex> lk(m_mutex);
+        auto block = reinterpret_cast<struct Block *>(p);
+        auto chunk = reinterpret_cast<struct Chunk *>(
+            reinterpret_cast<uintptr_t>(p) & ~(uintptr_t)(kChunkSize - 1));
+        block->next = chunk->free;
+        chunk->free = block;
+        if (chunk->used-- == kBlocksPerChunk) Link(chunk);
+        if (chunk->used == 0) {
+            if (m_empty) {
+                Unlink(chunk);
+                free(chunk);
+            } else {
+                m_empty++;
+            }
+        }
+    }
+
+private:
+    struct Block {
+        struct Block *next;
+    };
+    struct Chunk {
+        struct Chunk *prev;
+        struct Chunk *next;
+        struct Block *free;
+        size_t used;
+    };
+    static const size_t kHeaderSize = (sizeof(struct Chunk) + 15) & ~(size_t)15;
+    static const size_t kBlocksPerChunk = (kChunkSize - kHeaderSize) / kBlockSize;
+
+    struct Chunk * NewChunk()
+    {
+        void *memory = nullptr;
+        if (posix_memalign(&memory, kChunkSize, kChunkSize)) throw std::bad_alloc();
+        auto chunk = new (memory) Chunk();
+        auto blocks = static_cast<unsigned char *>(memory) + kHeaderSize;
+        for (size_t i=0; i<kBlocksPerChunk; i++) {
+            auto block = reinterpret_cast<struct Block *>(blocks + i * kBlockSize);
+            block->next = chunk->free;
+            chunk->free = block;
+        }
+        m_empty++;
+        return chunk;
+    }
+
+    // The list holds the chunks with a block free; full ones are off it until one is freed
+    void Link(struct Chunk *chunk)
+    {
+        chunk->prev = nullptr;
+        chunk->next = m_partial;
+        if (m_partial) m_partial->prev = chunk;
+        m_partial = chunk;
+    }
+    void Unlink(struct Chunk *chunk)
+    {
+        if (chunk->prev) chunk->prev->next = chunk->next;
+        else m_partial = chunk->next;
+        if (chunk->next) chunk->next->prev = chunk->prev;
+    }
+
+    struct Chunk *m_partial = nullptr;
+    size_t m_empty = 0;
+    std::mutex m_mutex;
+};
+
+/*
+ * Standard allocator over a shared Slab, for use with boost::allocate_shared().  Each copy
+ * holds a reference on the slab, so the slab lives until the last object allocated from it
+ * has been freed.
+ */
+template <typename T>
+class SlabAllocator {
+public:
+    typedef T value_type;
+
+    explicit SlabAllocator(const boost::shared_ptr<Slab>& slab) : m_slab(slab) {}
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U>& other) : m_slab(other.m_slab) {}
+
+    T * allocate(size_t n) { return static_cast<T *>(m_slab->Allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { m_slab->Free(p, n * sizeof(T)); }
+
+    template <typename U> struct rebind { typedef SlabAllocator<U> other; };
+    template <typename U>
+    bool operator==(const SlabAllocator<U>& other) const { return m_slab == other.m_slab; }
+    template <typename U>
+    bool operator!=(const SlabAllocator<U>& other) const { return m_slab != other.m_slab; }
+
+    boost::shared_ptr<Slab> m_slab;
+};
+
+#endif //LIQUIDCORE_SLAB_H
@@ -16,6 +16,32 @@
 #define PARAMS JNIEnv* env, jobject thiz
 #define STATIC JNIEnv* env, jclass klass
 
+// The VM the library was loaded into
+JavaVM *javaVM();
 jclass findClass(JNIEnv *env, const char* name);
+// Leaves a java.lang.IllegalArgumentException pending; the caller must return straight after
+void throwIllegalArgument(JNIEnv *env, const char *message);
+/*
+ * Finds |name| on the class of |object| or the nearest superclass that declares it.  The
+ * walk is done once per concrete class; after that it is a cached lookup.  |name| and
+ * |signature| are kept, so they must be string literals.  Returns nullptr if no class in the
+ * chain declares it, with no exception pending.
+ */
+jmethodID findMethod(JNIEnv *env, jobject object, const char *name, const char *signature);
+
+/*
+ * Attaches the calling thread to the JVM for the rest of its run, as a daemon thread named
+ * |name|, so that calls into Java from it don't each pay for an attach and detach.  Does
+ * nothing if the thread is already attached.  A thread attached here must call detachThread()
+ * before it exits.
+ */
+void attachThread(JavaVM *jvm, const char *name);
+void detachThread(JavaVM *jvm);
+/*
+ * The calling thread's JNIEnv.  A thread attached with attachThread() gets it straight from a
+ * thread-local.  A thread that isn't attached at all is attached for the call and |detach| is
+ * set; the caller must then DetachCurrentThread() when it is done with the env.
+ */
+JNIEnv *threadEnv(JavaVM *jvm, bool& detach);
 
 #endif //NODEDROID_JSJNI_H
@@ -7,4 +7,60 @@
 #include "JNIJSException.h"
 
 jmethodID JNIJSException::m_cid = nullptr;
+jmethodID JNIJSException::m_cid_detail = nullptr;
 jclass JNIJSException::m_clazz = nullptr;
+
+void JNIJSException::Init(JNIEnv *env)
+{
+    if (m_clazz) return;
+    auto clazz = (jclass) env->NewGlobalRef(
+            findClass(env, "org/liquidplayer/javascript/JNIJSException"));
+    m_cid = env->GetMethodID(clazz, "<init>", "(J)V");
+    // JNIJSException(long, String name, String message), if this build of the class has it
+    m_cid_detail = env->GetMethodID(clazz, "<init>", "(JLjava/lang/String;Ljava/lang/String;)V");
+    if (!m_cid_detail) {
+        env->ExceptionClear();
+    }
+    m_clazz = clazz;
+}
+
+JNIJSException::JNIJSException(JNIEnv *env, boost::shared_ptr<JSValue> exception) :
+    m_env(env), m_out(nullptr), m_exception(SharedWrap<JSValue>::New(exception))
+{
+    Init(m_env);
+    if (!m_exception) return;
+
+    boost::shared_ptr<JSContext> ctx = exception->Context();
+    if (!m_cid_detail || !exception->IsObject() || !ctx || exception->IsDefunct()) {
+        m_out = (jthrowable) m_env->NewObject(m_clazz, m_cid, m_exception);
+        return;
+    }
+
+    // Read as plain properties, without touching the stack, which Java asks for only if it
+    // wants it
+    bool has_name = false, has_message = false;
+    std::string name, message;
+    V8_ISOLATE_CTX(ctx, isolate, context)
+        TryCatch trycatch(isolate);
+        Local<v8::Object> object = exception->Value().As<v8::Object>();
+        Local<v8::Value> value;
+        if (object->Get(context, String::NewFromUtf8(isolate, "name")).ToLocal(&value) &&
+                value->IsString()) {
+            String::Utf8Value utf8(value);
+            name = *utf8;
+            has_name = true;
+        }
+        if (object->Get(context, String::NewFromUtf8(isolate, "message")).ToLocal(&value) &&
+                value->IsString()) {
+            String::Utf8Value utf8(value);
+            message = *utf8;
+            has_message = true;
+        }
+    V8_UNLOCK()
+
+    jstring jname = has_name ? m_env->NewStringUTF(name.c_str()) : nullptr;
+    jstring jmessage = has_message ? m_env->NewStringUTF(message.c_str()) : nullptr;
+    m_out = (jthrowable) m_env->NewObject(m_clazz, m_cid_detail, m_exception, jname, jmessage);
+    if (jname) m_env->DeleteLocalRef(jname);
+    if (jmessage) m_env->DeleteLocalRef(jmessage);
+}
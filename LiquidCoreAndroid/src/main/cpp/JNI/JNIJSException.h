@@ -13,11 +13,7 @@ class JNIJSException {
 public:
     inline JNIJSException(JNIEnv *env, jlong exception) : m_env(env), m_exception(exception)
     {
-        if (!m_clazz) {
-            m_clazz = (jclass) m_env->NewGlobalRef(
-                    findClass(m_env, "org/liquidplayer/javascript/JNIJSException"));
-            m_cid = m_env->GetMethodID(m_clazz, "<init>", "(J)V");
-        }
+        Init(m_env);
         if (m_exception) {
             m_out = (jthrowable) m_env->NewObject(m_clazz, m_cid, exception);
         } else {
@@ -25,6 +21,10 @@ public:
         }
     }
 
+    // Also hands over the exception's name and message, where they are strings, so that
+    // the Java side needn't call back into JS for them
+    JNIJSException(JNIEnv *env, boost::shared_ptr<JSValue> exception);
+
     void Throw()
     {
         if (m_exception) {
@@ -33,7 +33,10 @@ public:
     }
 
 private:
+    static void Init(JNIEnv *env);
+
     static jmethodID m_cid;
+    static jmethodID m_cid_detail;
     static jclass m_clazz;
 
     JNIEnv *m_env;
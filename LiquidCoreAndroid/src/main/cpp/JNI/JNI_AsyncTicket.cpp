@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+#include "JNI/JNI.h"
+#include "JNI/JNIJSException.h"
+#include "Common/AsyncTicket.h"
+
+NATIVE(JNIAsyncTicket,jboolean,isComplete) (STATIC, jlong ticketRef)
+{
+    return (jboolean) SharedWrap<AsyncTicket>::Shared(ticketRef)->IsComplete();
+}
+
+NATIVE(JNIAsyncTicket,void,waitFor) (STATIC, jlong ticketRef)
+{
+    boost::shared_ptr<JSValue> exception = SharedWrap<AsyncTicket>::Shared(ticketRef)->Wait();
+
+    if (exception) {
+        JNIJSException(env, exception).Throw();
+    }
+}
+
+NATIVE(JNIAsyncTicket,void,Finalize) (STATIC, jlong ticketRef)
+{
+    SharedWrap<AsyncTicket>::Dispose(ticketRef);
+}
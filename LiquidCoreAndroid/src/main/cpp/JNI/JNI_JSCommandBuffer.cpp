@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+#include <limits>
+#include <string>
+#include <vector>
+#include "JNI/JNI.h"
+#include "JNI/JNIJSException.h"
+
+/*
+ * Command buffers run a chain of property gets, sets, calls and constructs in a single entry
+ * into the context, instead of one JNI call (and lock, and SharedWrap for every intermediate
+ * value) per step.
+ *
+ * A program is an int[] of ops, each an op word followed by its operands:
+ *
+ *   kGet       object, name               -> object[name]
+ *   kSet       object, name, value        -> value
+ *   kGetIndex  object, index              -> object[index]
+ *   kSetIndex  object, index, value       -> value
+ *   kCall      function, this, argc, args -> function.call(this, args...)
+ *   kConstruct function, argc, args       -> new function(args...)
+ *
+ * The low byte of the op word is the op; kKeepResult set in it returns the op's result.  Every
+ * op produces a result, numbered from 0 in program order.  A value operand is the number of an
+ * earlier op's result, -(i+1) for inputs[i] (a JSValue reference from Java), or kUndefined.
+ * Names index into the names array.
+ *
+ * Returns a reference for each kept result, in program order.  The program stops at the first
+ * exception, which is thrown as a JSException and nothing is returned.  A malformed program
+ * is turned away with an IllegalArgumentException before any of it runs.
+ */
+
+namespace {
+
+enum Op {
+    kGet = 0,
+    kSet = 1,
+    kGetIndex = 2,
+    kSetIndex = 3,
+    kCall = 4,
+    kConstruct = 5
+};
+
+const jint kOpMask = 0xff;
+const jint kKeepResult = 0x100;
+const jint kUndefined = std::numeric_limits<jint>::min();
+// More than any call needs, and few enough to keep a bad count from eating the heap
+const jint kMaxArgs = 0xffff;
+
+// Walks the whole program without running it.  Returns why it is malformed, or nullptr if it
+// isn't, in which case Program needn't check anything as it goes.
+const char * Check(const std::vector<jint>& code, size_t inputs, size_t names)
+{
+    size_t pc = 0;
+    size_t results = 0;
+    const char *why = nullptr;
+
+    auto word = [&](jint& w) {
+        if (pc >= code.size()) {
+            why = "program ends in the middle of an op";
+            return false;
+        }
+        w = code[pc++];
+        return true;
+    };
+    auto value = [&]() {
+        jint ref;
+        if (!word(ref)) return false;
+        if (ref == kUndefined) return true;
+        if (ref >= 0) {
+            if ((size_t) ref < results) return true;
+            why = "result used before it is made";
+        } else {
+            if ((size_t) -(ref + 1) < inputs) return true;
+            why = "input out of range";
+        }
+        return false;
+    };
+    auto name = [&]() {
+        jint index;
+        if (!word(index)) return false;
+        if (index >= 0 && (size_t) index < names) return true;
+        why = "name out of range";
+        return false;
+    };
+    auto values = [&]() {
+        jint argc;
+        if (!word(argc)) return false;
+        if (argc < 0 || argc > kMaxArgs) {
+            why = "bad argument count";
+            return false;
+        }
+        for (jint i=0; i<argc; i++) {
+            if (!value()) return false;
+        }
+        return true;
+    };
+
+    while (pc < code.size()) {
+        jint op = code[pc++];
+        jint index;
+        bool ok;
+        switch (op & kOpMask) {
+            case kGet:       ok = value() && name(); break;
+            case kSet:       ok = value() && name() && value(); break;
+            case kGetIndex:  ok = value() && word(index); break;
+            case kSetIndex:  ok = value() && word(index) && value(); break;
+            case kCall:      ok = value() && value() && values(); break;
+            case kConstruct: ok = value() && values(); break;
+            default:         return "unknown op";
+        }
+        if (!ok) return why;
+        results++;
+    }
+    return nullptr;
+}
+
+class Program {
+public:
+    Program(const std::vector<jint>& code, const std::vector<jlong>& inputs,
+            const std::vector<std::string>& names, boost::shared_ptr<JSContext> ctx) :
+        m_code(code), m_inputs(inputs), m_names(names), m_ctx(ctx), m_pc(0),
+        m_keys(names.size()) {}
+
+    inline bool Done() const { return m_pc >= m_code.size(); }
+
+    jint Next()
+    {
+        return m_code[m_pc++];
+    }
+
+    Local<Value> Operand(Isolate *isolate, const std::vector<Local<Value>>& results)
+    {
+        jint ref = Next();
+        if (ref == kUndefined) {
+            return Local<Value>::New(isolate, Undefined(isolate));
+        }
+        if (ref >= 0) {
+            return results[ref];
+        }
+        return SharedWrap<JSValue>::Shared(m_ctx, m_inputs[(size_t) -(ref + 1)])->Value();
+    }
+
+    // Each name is only made into a V8 string once per run
+    Local<String> Name(Isolate *isolate)
+    {
+        jint index = Next();
+        if (m_keys[index].IsEmpty()) {
+            m_keys[index] = String::NewFromUtf8(isolate, m_names[index].c_str());
+        }
+        return m_keys[index];
+    }
+
+    void Operands(Isolate *isolate, const std::vector<Local<Value>>& results,
+                  std::vector<Local<Value>>& args)
+    {
+        args.resize((size_t) Next());
+        for (size_t i=0; i<args.size(); i++) args[i] = Operand(isolate, results);
+    }
+
+private:
+    const std::vector<jint>& m_code;
+    const std::vector<jlong>& m_inputs;
+    const std::vector<std::string>& m_names;
+    boost::shared_ptr<JSContext> m_ctx;
+    size_t m_pc;
+    std::vector<Local<String>> m_keys;
+};
+
+} /* namespace */
+
+NATIVE(JNIJSCommandBuffer,jlongArray,execute) (STATIC, jlong ctxRef, jintArray program_,
+    jlongArray inputs_, jobjectArray names_)
+{
+    auto ctx = SharedWrap<JSContext>::Shared(ctxRef);
+
+    // Everything JNI is done before and after; the program may run on the group's thread
+    std::vector<jint> code((size_t) env->GetArrayLength(program_));
+    env->GetIntArrayRegion(program_, 0, (jsize) code.size(), code.data());
+    std::vector<jlong> inputs(inputs_ ? (size_t) env->GetArrayLength(inputs_) : 0);
+    if (!inputs.empty()) {
+        env->GetLongArrayRegion(inputs_, 0, (jsize) inputs.size(), inputs.data());
+    }
+    std::vector<std::string> names(names_ ? (size_t) env->GetArrayLength(names_) : 0);
+    for (size_t i=0; i<names.size(); i++) {
+        auto name = (jstring) env->GetObjectArrayElement(names_, (jsize) i);
+        if (!name) {
+            throwIllegalArgument(env, "Malformed program: null name");
+            return nullptr;
+        }
+        const char *c_string = env->GetStringUTFChars(name, nullptr);
+        names[i] = c_string;
+        env->ReleaseStringUTFChars(name, c_string);
+        env->DeleteLocalRef(name);
+    }
+
+    const char *why = Check(code, inputs.size(), names.size());
+    if (why) {
+        std::string message = std::string("Malformed program: ") + why;
+        throwIllegalArgument(env, message.c_str());
+        return nullptr;
+    }
+
+    std::vector<jlong> out;
+    boost::shared_ptr<JSValue> exception;
+
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        Program program(code, inputs, names, ctx);
+        std::vector<Local<Value>> results;
+        results.reserve(code.size() / 2);
+        std::vector<Local<Value>> args;
+
+        TryCatch trycatch(isolate);
+
+        while (!exception && !program.Done()) {
+            jint op = program.Next();
+            MaybeLocal<Value> result;
+            MaybeLocal<Object> o;
+
+            switch (op & kOpMask) {
+                case kGet: {
+                    o = program.Operand(isolate, results)->ToObject(context);
+                    Local<String> name = program.Name(isolate);
+                    if (!o.IsEmpty()) {
+                        result = o.ToLocalChecked()->Get(context, name);
+                    }
+                    break;
+                }
+                case kSet: {
+                    o = program.Operand(isolate, results)->ToObject(context);
+                    Local<String> name = program.Name(isolate);
+                    Local<Value> value = program.Operand(isolate, results);
+                    if (!o.IsEmpty() &&
+                        !o.ToLocalChecked()->Set(context, name, value).IsNothing()) {
+                        result = value;
+                    }
+                    break;
+                }
+                case kGetIndex: {
+                    o = program.Operand(isolate, results)->ToObject(context);
+                    auto index = (uint32_t) program.Next();
+                    if (!o.IsEmpty()) {
+                        result = o.ToLocalChecked()->Get(context, index);
+                    }
+                    break;
+                }
+                case kSetIndex: {
+                    o = program.Operand(isolate, results)->ToObject(context);
+                    auto index = (uint32_t) program.Next();
+                    Local<Value> value = program.Operand(isolate, results);
+                    if (!o.IsEmpty() &&
+                        !o.ToLocalChecked()->Set(context, index, value).IsNothing()) {
+                        result = value;
+                    }
+                    break;
+                }
+                case kCall: {
+                    o = program.Operand(isolate, results)->ToObject(context);
+                    Local<Value> this_ = program.Operand(isolate, results);
+                    program.Operands(isolate, results, args);
+                    if (!o.IsEmpty()) {
+                        result = o.ToLocalChecked()->CallAsFunction(context, this_,
+                            (int) args.size(), args.data());
+                    }
+                    break;
+                }
+                case kConstruct: {
+                    o = program.Operand(isolate, results)->ToObject(context);
+                    program.Operands(isolate, results, args);
+                    if (!o.IsEmpty()) {
+                        result = o.ToLocalChecked()->CallAsConstructor(context,
+                            (int) args.size(), args.data());
+                    }
+                    break;
+                }
+            }
+
+            if (result.IsEmpty()) {
+                exception = JSValue::New(ctx, trycatch.Exception());
+            } else {
+                results.push_back(result.ToLocalChecked());
+                if (op & kKeepResult) {
+                    out.push_back(SharedWrap<JSValue>::New(
+                        JSValue::New(ctx, result.ToLocalChecked())));
+                }
+            }
+        }
+    V8_UNLOCK()
+
+    if (exception) {
+        // The references made for results kept so far were never handed out
+        for (jlong ref : out) SharedWrap<JSValue>::Dispose(ref);
+        JNIJSException(env, exception).Throw();
+        return nullptr;
+    }
+
+    jlongArray ret = env->NewLongArray((jsize) out.size());
+    env->SetLongArrayRegion(ret, 0, (jsize) out.size(), out.data());
+    return ret;
+}
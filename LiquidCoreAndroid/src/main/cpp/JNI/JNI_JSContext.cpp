@@ -5,6 +5,12 @@
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
 
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include "JNI/JNI.h"
 #include "JSC/JSC.h"
 #include "JNIJSException.h"
@@ -16,7 +22,7 @@ NATIVE(JNIJSContext,jlong,createInGroup) (STATIC,jlong grp)
     auto group = SharedWrap<ContextGroup>::Shared(grp);
     jlong ctx;
     { V8_ISOLATE(group,isolate)
-        ctx = SharedWrap<JSContext>::New(JSContext::New(group, Context::New(isolate)));
+        ctx = SharedWrap<JSContext>::New(JSContext::New(group, group->NewContext()));
     V8_UNLOCK() }
 
     return ctx;
@@ -45,8 +51,18 @@ NATIVE(JNIJSContext,jlong,getGroup) (STATIC, jlong grpRef)
     return SharedWrap<ContextGroup>::New(context->Group());
 }
 
-NATIVE(JNIJSContext,jlong,evaluateScript) (STATIC, jlong ctxRef, jstring script_,
-    jstring sourceURL_, jint startingLineNumber)
+/*
+ * Code cache for a single compile.  'in' is the data to consume (empty for none); 'out'
+ * receives freshly produced data when there was nothing to consume.
+ */
+struct CodeCache {
+    std::vector<uint8_t> in;
+    std::vector<uint8_t> out;
+    bool rejected = false;
+};
+
+static jlong EvaluateScript(JNIEnv *env, jlong ctxRef, jstring script_, jstring sourceURL_,
+                            jint startingLineNumber, CodeCache *cache)
 {
     auto ctx = SharedWrap<JSContext>::Shared(ctxRef);
 
@@ -75,7 +91,23 @@ NATIVE(JNIJSContext,jlong,evaluateScript) (STATIC, jlong ctxRef, jstring script_
             exception = JSValue::New(ctx, trycatch.Exception());
         }
 
-        if (!exception) {
+        if (!exception && cache) {
+            bool consume = !cache->in.empty();
+            ScriptCompiler::Source compile_source(source.ToLocalChecked(), script_origin,
+                consume ? new ScriptCompiler::CachedData(cache->in.data(),
+                                                         (int) cache->in.size()) : nullptr);
+            script = ScriptCompiler::Compile(context, &compile_source,
+                consume ? ScriptCompiler::kConsumeCodeCache : ScriptCompiler::kProduceCodeCache);
+            const ScriptCompiler::CachedData *data = compile_source.GetCachedData();
+            if (consume) {
+                cache->rejected = data && data->rejected;
+            } else if (data && data->length > 0) {
+                cache->out.assign(data->data, data->data + data->length);
+            }
+            if (script.IsEmpty()) {
+                exception = JSValue::New(ctx, trycatch.Exception());
+            }
+        } else if (!exception) {
             script = Script::Compile(context, source.ToLocalChecked(), &script_origin);
             if (script.IsEmpty()) {
                 exception = JSValue::New(ctx, trycatch.Exception());
@@ -101,7 +133,225 @@ NATIVE(JNIJSContext,jlong,evaluateScript) (STATIC, jlong ctxRef, jstring script_
     env->ReleaseStringUTFChars(sourceURL_, _sourceURL);
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
+    }
+
+    return ret;
+}
+
+NATIVE(JNIJSContext,jlong,evaluateScript) (STATIC, jlong ctxRef, jstring script_,
+    jstring sourceURL_, jint startingLineNumber)
+{
+    return EvaluateScript(env, ctxRef, script_, sourceURL_, startingLineNumber, nullptr);
+}
+
+/*
+ * Same as evaluateScript(), but compiles against 'cachedData' when it is not null.  If no
+ * cache was given, the code cache produced by this compile is stored in cacheOut[0].  If the
+ * given cache was rejected (e.g. the V8 version or flags changed), rejectedOut[0] is set and
+ * the caller should drop it; the next call without a cache produces a fresh one.
+ */
+NATIVE(JNIJSContext,jlong,evaluateScriptWithCache) (STATIC, jlong ctxRef, jstring script_,
+    jstring sourceURL_, jint startingLineNumber, jbyteArray cachedData, jobjectArray cacheOut,
+    jbooleanArray rejectedOut)
+{
+    CodeCache cache;
+    if (cachedData) {
+        jsize len = env->GetArrayLength(cachedData);
+        cache.in.resize((size_t) len);
+        env->GetByteArrayRegion(cachedData, 0, len, (jbyte *) cache.in.data());
+    }
+
+    jlong ret = EvaluateScript(env, ctxRef, script_, sourceURL_, startingLineNumber, &cache);
+
+    // Nothing more may be done through JNI while the script's exception is pending
+    if (env->ExceptionCheck()) {
+        return ret;
+    }
+
+    if (cacheOut && !cache.out.empty()) {
+        jbyteArray out = env->NewByteArray((jsize) cache.out.size());
+        env->SetByteArrayRegion(out, 0, (jsize) cache.out.size(),
+                                (const jbyte *) cache.out.data());
+        env->SetObjectArrayElement(cacheOut, 0, out);
+        env->DeleteLocalRef(out);
+    }
+    if (rejectedOut) {
+        jboolean rejected = (jboolean) cache.rejected;
+        env->SetBooleanArrayRegion(rejectedOut, 0, 1, &rejected);
+    }
+
+    return ret;
+}
+
+/*
+ * UTF-8 source handed to V8's streaming parser a chunk at a time, as it is read from Java.
+ * The parser runs on a thread of its own and waits here for whatever hasn't been read yet.
+ * The whole source is kept as well, since the final compile needs it as a string.
+ */
+class JavaSourceStream : public ScriptCompiler::ExternalSourceStream {
+public:
+    size_t GetMoreData(const uint8_t** src) override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]{ return m_ended || !m_chunks.empty(); });
+        if (m_chunks.empty()) return 0;
+        // The parser owns (and delete[]s) the chunk
+        std::pair<uint8_t*, size_t> chunk = m_chunks.front();
+        m_chunks.pop_front();
+        *src = chunk.first;
+        return chunk.second;
+    }
+
+    // Only the reading thread may call these
+    void Push(uint8_t *data, size_t length)
+    {
+        for (size_t i=0; i<length && m_ascii; i++) {
+            m_ascii = data[i] < 0x80;
+        }
+        m_source.append(reinterpret_cast<const char*>(data), length);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_chunks.push_back(std::make_pair(data, length));
+        m_cv.notify_one();
+    }
+    void End()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ended = true;
+        m_cv.notify_one();
+    }
+
+    // Once the parser is done.  A pure ASCII source is handed to V8 without another copy.
+    MaybeLocal<String> Source(Isolate *isolate)
+    {
+        if (m_ascii) {
+            return String::NewExternalOneByte(isolate, new Resource(std::move(m_source)));
+        }
+        return String::NewFromUtf8(isolate, m_source.data(), NewStringType::kNormal,
+                                   (int) m_source.size());
+    }
+
+    ~JavaSourceStream() override
+    {
+        for (auto& chunk : m_chunks) delete[] chunk.first;
+    }
+
+private:
+    class Resource : public String::ExternalOneByteStringResource {
+    public:
+        explicit Resource(std::string&& source) : m_source(std::move(source)) {}
+        const char* data() const override { return m_source.data(); }
+        size_t length() const override { return m_source.size(); }
+    private:
+        const std::string m_source;
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::pair<uint8_t*, size_t>> m_chunks;
+    bool m_ended = false;
+    std::string m_source;
+    bool m_ascii = true;
+};
+
+#define STREAMING_CHUNK_SIZE (64 * 1024)
+// V8 copes with a UTF-8 character split across two chunks, but not across three
+#define STREAMING_MIN_CHUNK 4
+
+/*
+ * Same as evaluateScript(), but the UTF-8 source is read from 'stream' (a java.io.InputStream)
+ * and parsed on a background thread while it is still coming in.  Neither Java nor V8 ever
+ * needs the whole script as a Java string.  A read that throws leaves its exception pending
+ * and nothing is run.
+ */
+NATIVE(JNIJSContext,jlong,evaluateScriptStreaming) (STATIC, jlong ctxRef, jobject stream,
+    jstring sourceURL_, jint startingLineNumber)
+{
+    auto ctx = SharedWrap<JSContext>::Shared(ctxRef);
+
+    jmethodID read = findMethod(env, stream, "read", "([BII)I");
+    if (read == nullptr) {
+        __android_log_assert("FAIL", "evaluateScriptStreaming", "Not an InputStream");
+    }
+
+    auto source_stream = new JavaSourceStream();
+    std::unique_ptr<ScriptCompiler::StreamedSource> source(
+        new ScriptCompiler::StreamedSource(source_stream, ScriptCompiler::StreamedSource::UTF8));
+    std::unique_ptr<ScriptCompiler::ScriptStreamingTask> task;
+
+    { V8_ISOLATE(ctx->Group(), isolate)
+        task.reset(ScriptCompiler::StartStreamingScript(isolate, &* source));
+    V8_UNLOCK() }
+
+    // The task doesn't need the isolate; only the final compile does
+    std::thread parser([&task]{ task->Run(); });
+
+    jbyteArray buffer = env->NewByteArray(STREAMING_CHUNK_SIZE);
+    bool failed = false;
+    jint filled = 0;
+    auto push = [&]() {
+        auto chunk = new uint8_t[filled];
+        env->GetByteArrayRegion(buffer, 0, filled, reinterpret_cast<jbyte*>(chunk));
+        source_stream->Push(chunk, (size_t) filled);
+        filled = 0;
+    };
+    for (;;) {
+        jint count = env->CallIntMethod(stream, read, buffer, filled,
+                                        STREAMING_CHUNK_SIZE - filled);
+        if (env->ExceptionCheck()) {
+            failed = true;
+            break;
+        }
+        if (count < 0) {
+            if (filled > 0) push();
+            break;
+        }
+        filled += count;
+        if (filled >= STREAMING_MIN_CHUNK) push();
+    }
+    source_stream->End();
+    parser.join();
+    env->DeleteLocalRef(buffer);
+
+    const char *_sourceURL = failed ? nullptr : env->GetStringUTFChars(sourceURL_, nullptr);
+    jlong ret = 0;
+    boost::shared_ptr<JSValue> exception;
+
+    { V8_ISOLATE(ctx->Group(), isolate)
+        if (!failed) {
+            TryCatch trycatch(isolate);
+
+            Local<Context> context = ctx->Value();
+            Context::Scope context_scope_(context);
+
+            ScriptOrigin script_origin(
+                String::NewFromUtf8(isolate, _sourceURL, NewStringType::kNormal).ToLocalChecked(),
+                Integer::New(isolate, startingLineNumber)
+            );
+
+            Local<String> full_source;
+            Local<Script> script;
+            Local<Value> result;
+            if (!source_stream->Source(isolate).ToLocal(&full_source) ||
+                !ScriptCompiler::Compile(context, &* source, full_source, script_origin)
+                    .ToLocal(&script) ||
+                !script->Run(context).ToLocal(&result)) {
+                exception = JSValue::New(ctx, trycatch.Exception());
+            } else {
+                ret = SharedWrap<JSValue>::New(JSValue::New(ctx, result));
+            }
+        }
+        // The parse data goes with the isolate locked
+        task.reset();
+        source.reset();
+    V8_UNLOCK() }
+
+    if (_sourceURL) {
+        env->ReleaseStringUTFChars(sourceURL_, _sourceURL);
+    }
+
+    if (exception) {
+        JNIJSException(env, exception).Throw();
     }
 
     return ret;
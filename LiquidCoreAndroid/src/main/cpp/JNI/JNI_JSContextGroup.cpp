@@ -7,6 +7,9 @@
 
 #include "JNI/JNI.h"
 #include "JSC/JSC.h"
+#include "Common/GCMonitor.h"
+#include "CpuProfile.h"
+#include "HeapProfile.h"
 
 NATIVE(JNIJSContextGroup,jlong,create) (STATIC)
 {
@@ -16,6 +19,275 @@ NATIVE(JNIJSContextGroup,jlong,create) (STATIC)
     );
 }
 
+/*
+ * Must be called before the first context group is created.  A positive 'backgroundNice'
+ * lowers the priority of V8's worker threads; 0 leaves them alone.
+ */
+NATIVE(JNIJSContextGroup,void,configurePlatform) (STATIC, jint workerThreads,
+                                                  jint backgroundNice)
+{
+    ContextGroup::ConfigurePlatform(workerThreads, backgroundNice);
+}
+
+NATIVE(JNIJSContextGroup,void,setArrayBufferPolicy) (STATIC, jint policy)
+{
+    ContextGroup::SetBufferPolicy(policy == BufferAllocator::kPooled ?
+        BufferAllocator::kPooled : BufferAllocator::kCalloc);
+}
+
+/*
+ * Returns { bytes in use, peak bytes } for the group's ArrayBuffers, or null if the group
+ * runs on node's allocator.
+ */
+NATIVE(JNIJSContextGroup,jlongArray,getArrayBufferBytes) (STATIC, jlong grpRef)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    BufferAllocator *allocator = group->Allocator();
+    if (!allocator) {
+        return nullptr;
+    }
+
+    jlong counts[] = { (jlong) allocator->AllocatedBytes(), (jlong) allocator->PeakBytes() };
+    jlongArray out = env->NewLongArray(2);
+    env->SetLongArrayRegion(out, 0, 2, counts);
+    return out;
+}
+
+NATIVE(JNIJSContextGroup,void,setArrayBufferLimit) (STATIC, jlong grpRef, jlong limit)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    BufferAllocator *allocator = group->Allocator();
+    if (allocator) {
+        allocator->SetLimit((size_t) limit);
+    }
+}
+
+/*
+ * Returns { total_heap_size, total_heap_size_executable, total_physical_size,
+ * total_available_size, used_heap_size, heap_size_limit, malloced_memory,
+ * peak_malloced_memory }
+ */
+NATIVE(JNIJSContextGroup,jlongArray,getHeapStatistics) (STATIC, jlong grpRef)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    HeapStatistics stats;
+
+    { V8_ISOLATE(group,isolate)
+        isolate->GetHeapStatistics(&stats);
+    V8_UNLOCK() }
+
+    jlong values[] = {
+        (jlong) stats.total_heap_size(),
+        (jlong) stats.total_heap_size_executable(),
+        (jlong) stats.total_physical_size(),
+        (jlong) stats.total_available_size(),
+        (jlong) stats.used_heap_size(),
+        (jlong) stats.heap_size_limit(),
+        (jlong) stats.malloced_memory(),
+        (jlong) stats.peak_malloced_memory()
+    };
+    jlongArray out = env->NewLongArray(8);
+    env->SetLongArrayRegion(out, 0, 8, values);
+    return out;
+}
+
+NATIVE(JNIJSContextGroup,jobjectArray,getHeapSpaceNames) (STATIC, jlong grpRef)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    std::vector<const char *> names;
+
+    { V8_ISOLATE(group,isolate)
+        size_t count = isolate->NumberOfHeapSpaces();
+        for (size_t i=0; i<count; i++) {
+            HeapSpaceStatistics stats;
+            isolate->GetHeapSpaceStatistics(&stats, i);
+            // Space names are static strings inside V8
+            names.push_back(stats.space_name());
+        }
+    V8_UNLOCK() }
+
+    auto out = (jobjectArray) env->NewObjectArray((jsize) names.size(),
+        env->FindClass("java/lang/String"), nullptr);
+    for (size_t i=0; i<names.size(); i++) {
+        jstring name = env->NewStringUTF(names[i]);
+        env->SetObjectArrayElement(out, (jsize) i, name);
+        env->DeleteLocalRef(name);
+    }
+    return out;
+}
+
+/*
+ * Returns { space_size, space_used_size, space_available_size, physical_space_size } for
+ * each space, in the order of getHeapSpaceNames()
+ */
+NATIVE(JNIJSContextGroup,jlongArray,getHeapSpaceStatistics) (STATIC, jlong grpRef)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    std::vector<jlong> values;
+
+    { V8_ISOLATE(group,isolate)
+        size_t count = isolate->NumberOfHeapSpaces();
+        for (size_t i=0; i<count; i++) {
+            HeapSpaceStatistics stats;
+            isolate->GetHeapSpaceStatistics(&stats, i);
+            values.push_back((jlong) stats.space_size());
+            values.push_back((jlong) stats.space_used_size());
+            values.push_back((jlong) stats.space_available_size());
+            values.push_back((jlong) stats.physical_space_size());
+        }
+    V8_UNLOCK() }
+
+    jlongArray out = env->NewLongArray((jsize) values.size());
+    env->SetLongArrayRegion(out, 0, (jsize) values.size(), values.data());
+    return out;
+}
+
+NATIVE(JNIJSContextGroup,void,setGCEventsEnabled) (STATIC, jlong grpRef, jboolean enabled)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+
+    { V8_ISOLATE(group,isolate)
+        group->SetGCMonitorEnabled(enabled);
+    V8_UNLOCK() }
+}
+
+/*
+ * Returns the GC events recorded since the last call as { type, pause (us), bytes freed }
+ * triples, oldest first.
+ */
+NATIVE(JNIJSContextGroup,jlongArray,drainGCEvents) (STATIC, jlong grpRef)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    std::vector<jlong> values;
+
+    std::vector<GCMonitor::Event> events;
+    group->WithGCMonitor([&events](GCMonitor& monitor) {
+        events = monitor.Drain();
+    });
+    for (auto it = events.begin(); it != events.end(); ++it) {
+        values.push_back((jlong) it->type);
+        values.push_back((jlong) it->duration_us);
+        values.push_back((jlong) it->bytes_freed);
+    }
+
+    jlongArray out = env->NewLongArray((jsize) values.size());
+    env->SetLongArrayRegion(out, 0, (jsize) values.size(), values.data());
+    return out;
+}
+
+/*
+ * level: 0 = none, 1 = moderate, 2 = critical.  Safe to call while JS is running.
+ */
+NATIVE(JNIJSContextGroup,void,memoryPressureNotification) (STATIC, jlong grpRef, jint level)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    Isolate *isolate = group->isolate();
+    if (isolate) {
+        isolate->MemoryPressureNotification(
+            level >= 2 ? MemoryPressureLevel::kCritical :
+            level == 1 ? MemoryPressureLevel::kModerate : MemoryPressureLevel::kNone);
+    }
+}
+
+NATIVE(JNIJSContextGroup,void,lowMemoryNotification) (STATIC, jlong grpRef)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+
+    { V8_ISOLATE(group,isolate)
+        isolate->LowMemoryNotification();
+    V8_UNLOCK() }
+}
+
+/*
+ * Writes a heap snapshot (.heapsnapshot JSON) to 'fd', as it is serialized.  The descriptor
+ * is left open.  Returns false if the snapshot could not be taken or written.
+ */
+NATIVE(JNIJSContextGroup,jboolean,takeHeapSnapshot) (STATIC, jlong grpRef, jint fd)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    bool ok = false;
+
+    { V8_ISOLATE(group,isolate)
+        ok = nodedroid::HeapProfile::WriteSnapshot(isolate, fd);
+    V8_UNLOCK() }
+
+    return (jboolean) ok;
+}
+
+/*
+ * Samples an allocation about every 'interval' bytes, recording up to 'depth' frames of its
+ * stack.  0 for either takes V8's default.
+ */
+NATIVE(JNIJSContextGroup,jboolean,startSamplingHeapProfiler) (STATIC, jlong grpRef,
+                                                              jlong interval, jint depth)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    bool ok = false;
+
+    { V8_ISOLATE(group,isolate)
+        ok = nodedroid::HeapProfile::StartSampling(isolate, (uint64_t) interval, depth);
+    V8_UNLOCK() }
+
+    return (jboolean) ok;
+}
+
+NATIVE(JNIJSContextGroup,void,stopSamplingHeapProfiler) (STATIC, jlong grpRef)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+
+    { V8_ISOLATE(group,isolate)
+        nodedroid::HeapProfile::StopSampling(isolate);
+    V8_UNLOCK() }
+}
+
+/*
+ * Writes the allocations sampled so far (.heapprofile JSON) to 'fd', which is left open.
+ * Sampling carries on.  Returns false if the sampling profiler isn't running.
+ */
+NATIVE(JNIJSContextGroup,jboolean,getAllocationProfile) (STATIC, jlong grpRef, jint fd)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    bool ok = false;
+
+    { V8_ISOLATE(group,isolate)
+        ok = nodedroid::HeapProfile::WriteAllocationProfile(isolate, fd);
+    V8_UNLOCK() }
+
+    return (jboolean) ok;
+}
+
+/*
+ * Starts CPU profiling the group, sampling every 'intervalUs' (0 for V8's default of 1 ms).
+ * Returns false if it is already being profiled.
+ */
+NATIVE(JNIJSContextGroup,jboolean,startCpuProfiler) (STATIC, jlong grpRef, jint intervalUs)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    bool ok = false;
+
+    { V8_ISOLATE(group,isolate)
+        ok = nodedroid::CpuProfile::Start(isolate, intervalUs);
+    V8_UNLOCK() }
+
+    return (jboolean) ok;
+}
+
+/*
+ * Stops the profile and writes it (.cpuprofile JSON) to 'fd', which is left open; a negative
+ * 'fd' discards it.  Returns false if no profile was being taken or it could not be written.
+ */
+NATIVE(JNIJSContextGroup,jboolean,stopCpuProfiler) (STATIC, jlong grpRef, jint fd)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    bool ok = false;
+
+    { V8_ISOLATE(group,isolate)
+        ok = nodedroid::CpuProfile::Stop(isolate, fd);
+    V8_UNLOCK() }
+
+    return (jboolean) ok;
+}
+
 NATIVE(JNIJSContextGroup,jboolean,isManaged) (STATIC, jlong grpRef)
 {
     auto group = SharedWrap<ContextGroup>::Shared(grpRef);
@@ -23,33 +295,77 @@ NATIVE(JNIJSContextGroup,jboolean,isManaged) (STATIC, jlong grpRef)
     return (jboolean) (group && group->Loop());
 }
 
+NATIVE(JNIJSContextGroup,jlong,internName) (STATIC, jlong grpRef, jstring name)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    jlong key = 0;
+    const char *c_string = env->GetStringUTFChars(name, nullptr);
+
+    { V8_ISOLATE(group,isolate)
+        key = group->InternName(c_string);
+    V8_UNLOCK() }
+
+    env->ReleaseStringUTFChars(name, c_string);
+    return key;
+}
+
 NATIVE(JNIJSContextGroup,void,runInContextGroup) (STATIC, jlong grpRef, jobject thisObj, jobject runnable) {
     auto group = SharedWrap<ContextGroup>::Shared(grpRef);
 
     if (group && group->Loop() && std::this_thread::get_id() != group->Thread()) {
         group->schedule_java_runnable(env, thisObj, runnable);
     } else {
-        jclass cls = env->GetObjectClass(thisObj);
-        jmethodID mid;
-        do {
-            mid = env->GetMethodID(cls,"inContextCallback","(Ljava/lang/Runnable;)V");
-            if (!env->ExceptionCheck()) break;
-            env->ExceptionClear();
-            jclass super = env->GetSuperclass(cls);
-            env->DeleteLocalRef(cls);
-            if (super == nullptr || env->ExceptionCheck()) {
-                if (super != nullptr) env->DeleteLocalRef(super);
-                __android_log_assert("FAIL", "runInContextGroup",
-                                     "Internal error.  Can't call back.");
-            }
-            cls = super;
-        } while (true);
-        env->DeleteLocalRef(cls);
+        jmethodID mid = findMethod(env, thisObj, "inContextCallback",
+                                   "(Ljava/lang/Runnable;)V");
+        if (mid == nullptr) {
+            __android_log_assert("FAIL", "runInContextGroup",
+                                 "Internal error.  Can't call back.");
+        }
 
         env->CallVoidMethod(thisObj, mid, runnable);
     }
 }
 
+/*
+ * Runs 'script' in a fresh context and serializes the resulting heap, keeping the compiled
+ * function code so that a group started from the snapshot doesn't have to compile the
+ * initialization code again.  The warm context is added at ContextGroup::kWarmContextIndex,
+ * from which ContextGroup::NewContext() deserializes each new context; the default context
+ * is left as Context::New() makes it.  Returns { nullptr, 0 } if the script fails.
+ */
+static v8::StartupData CreateSnapshotBlob(const char *script)
+{
+    SnapshotCreator creator;
+    Isolate *isolate = creator.GetIsolate();
+    bool ok;
+    {
+        HandleScope handle_scope(isolate);
+        creator.SetDefaultContext(Context::New(isolate));
+        Local<Context> context = Context::New(isolate);
+        {
+            Context::Scope context_scope(context);
+            TryCatch trycatch(isolate);
+            MaybeLocal<String> source =
+                String::NewFromUtf8(isolate, script, NewStringType::kNormal);
+            MaybeLocal<Script> compiled;
+            if (!source.IsEmpty()) {
+                compiled = Script::Compile(context, source.ToLocalChecked());
+            }
+            ok = !compiled.IsEmpty() && !compiled.ToLocalChecked()->Run(context).IsEmpty();
+        }
+        creator.AddContext(context);
+    }
+
+    v8::StartupData data =
+        creator.CreateBlob(SnapshotCreator::FunctionCodeHandling::kKeep);
+    if (!ok && data.data) {
+        delete[] data.data;
+        data.data = nullptr;
+        data.raw_size = 0;
+    }
+    return data;
+}
+
 /*
  * Error codes:
  * 0  = snapshot successfully taken and file written
@@ -66,7 +382,7 @@ NATIVE(JNIJSContextGroup,jint,createSnapshot) (STATIC, jstring script_, jstring
     int rval = 0;
 
     ContextGroup::init_v8();
-    v8::StartupData data = v8::V8::CreateSnapshotDataBlob(_script);
+    v8::StartupData data = CreateSnapshotBlob(_script);
     ContextGroup::dispose_v8();
 
     if (data.data == nullptr) {
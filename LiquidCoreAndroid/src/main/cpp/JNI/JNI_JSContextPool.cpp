@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+#include "JNI/JNI.h"
+#include "Common/ContextPool.h"
+
+// 'snapshotFile' may be null
+NATIVE(JNIJSContextPool,jlong,create) (STATIC, jint size, jstring snapshotFile_)
+{
+    std::string snapshotFile;
+    if (snapshotFile_) {
+        const char *c_string = env->GetStringUTFChars(snapshotFile_, nullptr);
+        snapshotFile = c_string;
+        env->ReleaseStringUTFChars(snapshotFile_, c_string);
+    }
+    return reinterpret_cast<jlong>(new ContextPool((size_t) size, snapshotFile));
+}
+
+/*
+ * Returns a JNIJSContext reference to a fresh context, waiting for a free isolate if needed.
+ * The context must be given back with release() before the reference is finalized.
+ */
+NATIVE(JNIJSContextPool,jlong,lease) (STATIC, jlong poolRef)
+{
+    return SharedWrap<JSContext>::New(reinterpret_cast<ContextPool*>(poolRef)->Lease());
+}
+
+NATIVE(JNIJSContextPool,void,release) (STATIC, jlong poolRef, jlong ctxRef)
+{
+    reinterpret_cast<ContextPool*>(poolRef)->Release(SharedWrap<JSContext>::Shared(ctxRef));
+}
+
+// Contexts still out keep their isolates alive until they are finalized
+NATIVE(JNIJSContextPool,void,Finalize) (STATIC, jlong poolRef)
+{
+    delete reinterpret_cast<ContextPool*>(poolRef);
+}
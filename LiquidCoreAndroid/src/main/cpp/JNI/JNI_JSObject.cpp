@@ -5,9 +5,12 @@
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
 
+#include <boost/make_shared.hpp>
 #include "JNI/JNI.h"
 #include "JNI/JSFunction.h"
+#include "JNI/JSExportClass.h"
 #include "JNI/JNIJSException.h"
+#include "Common/AsyncTicket.h"
 
 #define VALUE_ISOLATE(objRef,valueRef,isolate,context,value) \
     auto (valueRef) = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), objRef); \
@@ -18,6 +21,48 @@
     VALUE_ISOLATE(objRef,object,isolate,context,__v__) \
     Local<Object> (o) = __v__->ToObject(context).ToLocalChecked();
 
+#define V8_ISOLATE_OBJ_ASYNC(object,isolate,context,o) \
+    V8_ISOLATE_CTX_ASYNC((object)->Context(),isolate,context) \
+    Local<Object> (o) = (object)->Value()->ToObject(context).ToLocalChecked();
+
+/*
+ * A value reference that survives the hop onto the JS thread.  Pointer references are resolved
+ * up front so that Java is free to finalize them in the meantime; immediates carry their value.
+ */
+class AsyncValueRef {
+public:
+    AsyncValueRef(jlong ref) : m_ref(ref)
+    {
+        if (ISPOINTER(ref)) {
+            m_value = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), ref);
+        }
+    }
+    Local<Value> Resolve(boost::shared_ptr<JSContext> context) const
+    {
+        return (m_value ? m_value : SharedWrap<JSValue>::Shared(context, m_ref))->Value();
+    }
+
+private:
+    jlong m_ref;
+    boost::shared_ptr<JSValue> m_value;
+};
+
+static PropertyAttribute ToV8Attributes(jint attributes)
+{
+    enum {
+        kJSPropertyAttributeReadOnly = 0x2,
+        kJSPropertyAttributeDontEnum = 0x4,
+        kJSPropertyAttributeDontDelete = 0x8
+    };
+
+    unsigned int v8_attr = v8::None;
+    if ((unsigned long)attributes & kJSPropertyAttributeReadOnly) v8_attr |= v8::ReadOnly;
+    if ((unsigned long)attributes & kJSPropertyAttributeDontEnum) v8_attr |= v8::DontEnum;
+    if ((unsigned long)attributes & kJSPropertyAttributeDontDelete) v8_attr |= v8::DontDelete;
+
+    return static_cast<PropertyAttribute>(v8_attr);
+}
+
 NATIVE(JNIJSObject,jlong,make) (STATIC, jlong context_)
 {
     jlong value = 0;
@@ -35,6 +80,50 @@ NATIVE(JNIJSFunction,jlong,makeFunctionWithCallback) (STATIC, jobject jsfthis, j
     return SharedWrap<JSValue>::New(JSFunction::New(env, jsfthis, ctx, name));
 }
 
+// Calls go straight to |method| of |jsfthis|, which may only take and return primitives and Strings
+NATIVE(JNIJSFunction,jlong,makeTypedFunctionWithCallback) (STATIC, jobject jsfthis, jlong ctx,
+    jstring name, jstring method, jstring signature)
+{
+    return SharedWrap<JSValue>::New(JSFunction::New(env, jsfthis, ctx, name, method, signature));
+}
+
+/*
+ * Exported Java classes.  The reference is to be made once per class and group and handed
+ * back to finalizeExportClass(); instances may outlive it.
+ */
+NATIVE(JNIJSObject,jlong,makeExportClass) (STATIC, jlong grpRef, jclass cls, jobjectArray names,
+    jobjectArray types, jobjectArray fields, jobjectArray getters, jobjectArray setters)
+{
+    auto group = SharedWrap<ContextGroup>::Shared(grpRef);
+    auto exported = boost::make_shared<JSExportClass>(env, group, cls, names, types, fields,
+                                                      getters, setters);
+    return reinterpret_cast<jlong>(new boost::shared_ptr<JSExportClass>(exported));
+}
+
+NATIVE(JNIJSObject,jlong,makeExportInstance) (STATIC, jlong context_, jlong classRef, jobject thiz)
+{
+    auto exported = *reinterpret_cast<boost::shared_ptr<JSExportClass>*>(classRef);
+    return SharedWrap<JSValue>::New(
+        exported->NewInstance(env, SharedWrap<JSContext>::Shared(context_), thiz));
+}
+
+/*
+ * Tells the group's tracer that the Java object behind export instance 'objRef' holds (or no
+ * longer holds) 'valueRef', so that a cycle through the two can be collected.  Returns false
+ * if there is nothing to tell, in which case Java must keep its references as before.
+ */
+NATIVE(JNIJSObject,jboolean,setExportHeld) (STATIC, jlong objRef, jlong valueRef, jboolean held)
+{
+    auto instance = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), objRef);
+    return (jboolean) JSExportClass::Hold(instance,
+        SharedWrap<JSValue>::Shared(instance->Context(), valueRef), held);
+}
+
+NATIVE(JNIJSObject,void,finalizeExportClass) (STATIC, jlong classRef)
+{
+    delete reinterpret_cast<boost::shared_ptr<JSExportClass>*>(classRef);
+}
+
 NATIVE(JNIJSFunction,void,setException) (STATIC, jlong funcRef, jlong valueRef)
 {
     auto func = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), funcRef);
@@ -72,7 +161,7 @@ NATIVE(JNIJSObject,jlong,makeArray) (STATIC, jlong context_, jlongArray args)
     env->ReleaseLongArrayElements(args, args_, 0);
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
 
     return ret;
@@ -163,7 +252,7 @@ NATIVE(JNIJSObject,jlong,makeRegExp) (STATIC, jlong context_, jstring pattern_,
     env->ReleaseStringUTFChars(flags_, _flags);
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
     return out;
 }
@@ -218,12 +307,218 @@ NATIVE(JNIJSObject,jlong,makeFunction) (STATIC, jlong context_, jstring name_,
     env->ReleaseStringUTFChars(sourceURL_, _sourceURL);
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
+    }
+
+    return out;
+}
+
+/*
+ * Keeps a direct ByteBuffer alive for as long as the JS ArrayBuffer that borrows its memory.
+ * Once the ArrayBuffer is collected, the optional release Runnable is called and the
+ * ByteBuffer is handed back to the Java GC.
+ */
+struct ByteBufferBacking {
+    JavaVM *jvm;
+    jobject buffer;
+    jobject onRelease;
+    UniquePersistent<ArrayBuffer> weak;
+    boost::shared_ptr<nodedroid::ExternalRegistry> externals;
+};
+
+static void ReleaseByteBufferBacking(ByteBufferBacking *backing)
+{
+    bool detach;
+    JNIEnv *env = threadEnv(backing->jvm, detach);
+
+    if (backing->onRelease) {
+        jclass cls = env->GetObjectClass(backing->onRelease);
+        jmethodID mid = env->GetMethodID(cls, "run", "()V");
+        env->DeleteLocalRef(cls);
+        env->CallVoidMethod(backing->onRelease, mid);
+        env->DeleteGlobalRef(backing->onRelease);
+    }
+    env->DeleteGlobalRef(backing->buffer);
+
+    if (detach) {
+        backing->jvm->DetachCurrentThread();
+    }
+    delete backing;
+}
+
+static void ByteBufferBackingReleased(const WeakCallbackInfo<ByteBufferBacking>& info)
+{
+    ReleaseByteBufferBacking(info.GetParameter());
+}
+
+NATIVE(JNIJSObject,jlong,makeArrayBufferFromDirectByteBuffer) (STATIC, jlong context_,
+                                                              jobject byteBuffer, jobject onRelease)
+{
+    jlong value = 0;
+    auto ctx = SharedWrap<JSContext>::Shared(context_);
+
+    void *data = env->GetDirectBufferAddress(byteBuffer);
+    jlong capacity = env->GetDirectBufferCapacity(byteBuffer);
+    if (data == nullptr || capacity < 0) {
+        throwIllegalArgument(env, "Buffer is not a direct ByteBuffer");
+        return 0;
+    }
+
+    auto backing = new ByteBufferBacking();
+    env->GetJavaVM(&backing->jvm);
+    backing->buffer = env->NewGlobalRef(byteBuffer);
+    backing->onRelease = onRelease ? env->NewGlobalRef(onRelease) : nullptr;
+    backing->externals = ctx->Group()->Externals();
+
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, data, (size_t) capacity,
+                                                     ArrayBufferCreationMode::kExternalized);
+        backing->weak = UniquePersistent<ArrayBuffer>(isolate, buffer);
+        backing->weak.SetWeak<ByteBufferBacking>(
+            backing,
+            [](const WeakCallbackInfo<ByteBufferBacking>& info) {
+                // JNI is off limits during GC; call back into Java on the second pass
+                ByteBufferBacking *backing = info.GetParameter();
+                backing->externals->Remove(backing);
+                backing->weak.Reset();
+                info.SetSecondPassCallback(ByteBufferBackingReleased);
+            }, v8::WeakCallbackType::kParameter);
+        // If the isolate goes first, the group lets go of the ByteBuffer when it is disposed
+        backing->externals->Add(backing, [backing]() {
+            backing->weak.Reset();
+            ReleaseByteBufferBacking(backing);
+        });
+
+        value = SharedWrap<JSValue>::New(JSValue::New(ctx, buffer));
+    V8_UNLOCK()
+
+    return value;
+}
+
+/*
+ * Returns a direct ByteBuffer over the backing store of an ArrayBuffer or ArrayBuffer view,
+ * or null for anything else.  The memory belongs to JS: the ByteBuffer is only good for as long
+ * as the JSObject reference is held and the buffer is not detached.
+ */
+NATIVE(JNIJSObject,jobject,getArrayBufferBacking) (STATIC, jlong objRef)
+{
+    void *data = nullptr;
+    size_t length = 0;
+
+    VALUE_ISOLATE(objRef,object,isolate,context,value)
+        if (value->IsArrayBuffer()) {
+            ArrayBuffer::Contents contents = value.As<ArrayBuffer>()->GetContents();
+            data = contents.Data();
+            length = contents.ByteLength();
+        } else if (value->IsArrayBufferView()) {
+            Local<ArrayBufferView> view = value.As<ArrayBufferView>();
+            ArrayBuffer::Contents contents = view->Buffer()->GetContents();
+            data = (unsigned char *) contents.Data() + view->ByteOffset();
+            length = view->ByteLength();
+        }
+    V8_UNLOCK()
+
+    if (data == nullptr) {
+        return nullptr;
+    }
+    return env->NewDirectByteBuffer(data, (jlong) length);
+}
+
+/*
+ * Java primitive arrays to and from JS typed arrays in one crossing each way.  A new typed
+ * array gets its own ArrayBuffer, which JS can't yet see, so the elements are copied straight
+ * into it with a single Get<Type>ArrayRegion() once the isolate is let go.
+ */
+template <typename TypedArray, typename Element, typename JArray>
+static jlong MakeTypedArray(JNIEnv *env, jlong context_, JArray array,
+                            void (JNIEnv::*getRegion)(JArray, jsize, jsize, Element*))
+{
+    jlong value = 0;
+    void *data = nullptr;
+    auto ctx = SharedWrap<JSContext>::Shared(context_);
+    const jsize length = env->GetArrayLength(array);
+
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, length * sizeof(Element));
+        data = buffer->GetContents().Data();
+        value = SharedWrap<JSValue>::New(
+            JSValue::New(ctx, TypedArray::New(buffer, 0, (size_t) length)));
+    V8_UNLOCK()
+
+    if (length) {
+        (env->*getRegion)(array, 0, length, (Element *) data);
     }
+    return value;
+}
+
+/*
+ * A copy of a typed array's elements, or null if 'objRef' is not one of the kinds accepted by
+ * 'is'.  JS may detach the buffer as soon as the isolate is let go, so the elements are taken
+ * while it is held.
+ */
+template <typename Element, typename JArray>
+static JArray CopyTypedArray(JNIEnv *env, jlong objRef, bool (Value::*is)() const,
+                             JArray (JNIEnv::*newArray)(jsize),
+                             void (JNIEnv::*setRegion)(JArray, jsize, jsize, const Element*))
+{
+    bool matched = false;
+    std::vector<Element> elements;
+
+    VALUE_ISOLATE(objRef,object,isolate,context,value)
+        if (((*value)->*is)()) {
+            Local<ArrayBufferView> view = value.As<ArrayBufferView>();
+            auto start = (const Element *)
+                ((const unsigned char *) view->Buffer()->GetContents().Data() + view->ByteOffset());
+            elements.assign(start, start + view->ByteLength() / sizeof(Element));
+            matched = true;
+        }
+    V8_UNLOCK()
 
+    if (!matched) {
+        return nullptr;
+    }
+    JArray out = (env->*newArray)((jsize) elements.size());
+    if (out && !elements.empty()) {
+        (env->*setRegion)(out, 0, (jsize) elements.size(), elements.data());
+    }
     return out;
 }
 
+NATIVE(JNIJSObject,jlong,makeInt32Array) (STATIC, jlong context_, jintArray array)
+{
+    return MakeTypedArray<Int32Array, jint>(env, context_, array, &JNIEnv::GetIntArrayRegion);
+}
+
+NATIVE(JNIJSObject,jlong,makeFloat64Array) (STATIC, jlong context_, jdoubleArray array)
+{
+    return MakeTypedArray<Float64Array, jdouble>(env, context_, array,
+                                                 &JNIEnv::GetDoubleArrayRegion);
+}
+
+NATIVE(JNIJSObject,jlong,makeUint8Array) (STATIC, jlong context_, jbyteArray array)
+{
+    return MakeTypedArray<Uint8Array, jbyte>(env, context_, array, &JNIEnv::GetByteArrayRegion);
+}
+
+NATIVE(JNIJSObject,jintArray,copyInt32Array) (STATIC, jlong objRef)
+{
+    return CopyTypedArray<jint>(env, objRef, &Value::IsInt32Array,
+                                &JNIEnv::NewIntArray, &JNIEnv::SetIntArrayRegion);
+}
+
+NATIVE(JNIJSObject,jdoubleArray,copyFloat64Array) (STATIC, jlong objRef)
+{
+    return CopyTypedArray<jdouble>(env, objRef, &Value::IsFloat64Array,
+                                   &JNIEnv::NewDoubleArray, &JNIEnv::SetDoubleArrayRegion);
+}
+
+// Any view at all, byte for byte
+NATIVE(JNIJSObject,jbyteArray,copyUint8Array) (STATIC, jlong objRef)
+{
+    return CopyTypedArray<jbyte>(env, objRef, &Value::IsArrayBufferView,
+                                 &JNIEnv::NewByteArray, &JNIEnv::SetByteArrayRegion);
+}
+
 NATIVE(JNIJSObject,jlong,getPrototype) (STATIC, jlong objRef)
 {
     jlong out;
@@ -280,7 +575,7 @@ NATIVE(JNIJSObject,jlong,getProperty) (STATIC, jlong objRef, jstring propertyNam
     env->ReleaseStringUTFChars(propertyName, c_string);
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
 
     return out;
@@ -292,17 +587,6 @@ NATIVE(JNIJSObject,void,setProperty) (STATIC, jlong objRef, jstring propertyName
     const char *c_string = env->GetStringUTFChars(propertyName, nullptr);
 
     V8_ISOLATE_OBJ(objRef,object,isolate,context,o)
-        enum {
-            kJSPropertyAttributeReadOnly = 0x2,
-            kJSPropertyAttributeDontEnum = 0x4,
-            kJSPropertyAttributeDontDelete = 0x8
-        };
-
-        unsigned int v8_attr = v8::None;
-        if ((unsigned long)attributes & kJSPropertyAttributeReadOnly) v8_attr |= v8::ReadOnly;
-        if ((unsigned long)attributes & kJSPropertyAttributeDontEnum) v8_attr |= v8::DontEnum;
-        if ((unsigned long)attributes & kJSPropertyAttributeDontDelete) v8_attr |= v8::DontDelete;
-
         TryCatch trycatch(isolate);
 
         Maybe<bool> defined = attributes ?
@@ -310,7 +594,7 @@ NATIVE(JNIJSObject,void,setProperty) (STATIC, jlong objRef, jstring propertyName
                 context,
                 String::NewFromUtf8(isolate, c_string),
                 SharedWrap<JSValue>::Shared(object->Context(), value)->Value(),
-                static_cast<PropertyAttribute>(v8_attr))
+                ToV8Attributes(attributes))
             :
             o->Set(context, String::NewFromUtf8(isolate, c_string),
                 SharedWrap<JSValue>::Shared(object->Context(), value)->Value());
@@ -323,7 +607,197 @@ NATIVE(JNIJSObject,void,setProperty) (STATIC, jlong objRef, jstring propertyName
     env->ReleaseStringUTFChars(propertyName, c_string);
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
+    }
+}
+
+NATIVE(JNIJSObject,jlong,setPropertyAsync) (STATIC, jlong objRef, jstring propertyName,
+                                           jlong value, jint attributes)
+{
+    auto object = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), objRef);
+    auto ticket = AsyncTicket::New(object->Group());
+    auto completion = ticket->NewCompletion();
+    AsyncValueRef value_(value);
+
+    const char *c_string = env->GetStringUTFChars(propertyName, NULL);
+    std::string name(c_string);
+    env->ReleaseStringUTFChars(propertyName, c_string);
+
+    V8_ISOLATE_OBJ_ASYNC(object,isolate,context,o)
+        TryCatch trycatch(isolate);
+
+        Local<String> prop = String::NewFromUtf8(isolate, name.c_str());
+        Maybe<bool> defined = attributes ?
+            o->DefineOwnProperty(context, prop, value_.Resolve(object->Context()),
+                                 ToV8Attributes(attributes))
+            :
+            o->Set(context, prop, value_.Resolve(object->Context()));
+
+        if (defined.IsNothing()) {
+            completion->SetException(JSValue::New(object->Context(), trycatch.Exception()));
+        }
+    V8_UNLOCK_ASYNC()
+
+    return SharedWrap<AsyncTicket>::New(ticket);
+}
+
+NATIVE(JNIJSObject,jlongArray,getProperties) (STATIC, jlong objRef, jobjectArray propertyNames)
+{
+    boost::shared_ptr<JSValue> exception;
+    jsize len = env->GetArrayLength(propertyNames);
+    jstring names[len];
+    const char *c_strings[len];
+    jlong out[len];
+
+    for (jsize i=0; i<len; i++) {
+        names[i] = (jstring) env->GetObjectArrayElement(propertyNames, i);
+        c_strings[i] = env->GetStringUTFChars(names[i], nullptr);
+        out[i] = 0;
+    }
+
+    V8_ISOLATE_OBJ(objRef,object,isolate,context,o)
+
+        TryCatch trycatch(isolate);
+        // Nothing is handed to Java unless every property could be read
+        std::vector<boost::shared_ptr<JSValue>> values;
+
+        for (jsize i=0; !exception && i<len; i++) {
+            MaybeLocal<Value> value = o->Get(context, String::NewFromUtf8(isolate, c_strings[i]));
+            if (value.IsEmpty()) {
+                exception = JSValue::New(object->Context(), trycatch.Exception());
+            } else {
+                values.push_back(JSValue::New(object->Context(), value.ToLocalChecked()));
+            }
+        }
+        if (!exception) {
+            for (jsize i=0; i<len; i++) {
+                out[i] = SharedWrap<JSValue>::New(values[i]);
+            }
+        }
+    V8_UNLOCK()
+
+    for (jsize i=0; i<len; i++) {
+        env->ReleaseStringUTFChars(names[i], c_strings[i]);
+        env->DeleteLocalRef(names[i]);
+    }
+
+    if (exception) {
+        JNIJSException(env, exception).Throw();
+        return nullptr;
+    }
+
+    jlongArray ret = env->NewLongArray(len);
+    env->SetLongArrayRegion(ret, 0, len, out);
+    return ret;
+}
+
+NATIVE(JNIJSObject,void,setProperties) (STATIC, jlong objRef, jobjectArray propertyNames,
+        jlongArray values)
+{
+    boost::shared_ptr<JSValue> exception;
+    jsize len = env->GetArrayLength(propertyNames);
+    jstring names[len];
+    const char *c_strings[len];
+    jlong *values_ = env->GetLongArrayElements(values, nullptr);
+
+    if (env->GetArrayLength(values) < len) {
+        len = env->GetArrayLength(values);
+    }
+    for (jsize i=0; i<len; i++) {
+        names[i] = (jstring) env->GetObjectArrayElement(propertyNames, i);
+        c_strings[i] = env->GetStringUTFChars(names[i], nullptr);
+    }
+
+    V8_ISOLATE_OBJ(objRef,object,isolate,context,o)
+
+        TryCatch trycatch(isolate);
+
+        for (jsize i=0; !exception && i<len; i++) {
+            Maybe<bool> defined = o->Set(context, String::NewFromUtf8(isolate, c_strings[i]),
+                SharedWrap<JSValue>::Shared(object->Context(), values_[i])->Value());
+            if (defined.IsNothing()) {
+                exception = JSValue::New(object->Context(), trycatch.Exception());
+            }
+        }
+    V8_UNLOCK()
+
+    for (jsize i=0; i<len; i++) {
+        env->ReleaseStringUTFChars(names[i], c_strings[i]);
+        env->DeleteLocalRef(names[i]);
+    }
+    env->ReleaseLongArrayElements(values, values_, JNI_ABORT);
+
+    if (exception) {
+        JNIJSException(env, exception).Throw();
+    }
+}
+
+NATIVE(JNIJSObject,jlong,getPropertyByKey) (STATIC, jlong objRef, jlong key)
+{
+    jlong out = 0;
+    boost::shared_ptr<JSValue> exception;
+    bool valid = true;
+
+    V8_ISOLATE_OBJ(objRef,object,isolate,context,o)
+
+        TryCatch trycatch(isolate);
+
+        Local<String> name;
+        if (!group_->InternedName(key).ToLocal(&name)) {
+            valid = false;
+        } else {
+            MaybeLocal<Value> value = o->Get(context, name);
+            if (value.IsEmpty()) {
+                exception = JSValue::New(object->Context(), trycatch.Exception());
+            } else {
+                out = SharedWrap<JSValue>::New(
+                    JSValue::New(object->Context(), value.ToLocalChecked()));
+            }
+        }
+    V8_UNLOCK()
+
+    if (!valid) {
+        throwIllegalArgument(env, "Invalid property key");
+    } else if (exception) {
+        JNIJSException(env, exception).Throw();
+    }
+
+    return out;
+}
+
+NATIVE(JNIJSObject,void,setPropertyByKey) (STATIC, jlong objRef, jlong key, jlong value,
+        jint attributes)
+{
+    boost::shared_ptr<JSValue> exception;
+    bool valid = true;
+
+    V8_ISOLATE_OBJ(objRef,object,isolate,context,o)
+        TryCatch trycatch(isolate);
+
+        Local<String> name;
+        if (!group_->InternedName(key).ToLocal(&name)) {
+            valid = false;
+        } else {
+            Maybe<bool> defined = attributes ?
+                o->DefineOwnProperty(
+                    context,
+                    name,
+                    SharedWrap<JSValue>::Shared(object->Context(), value)->Value(),
+                    ToV8Attributes(attributes))
+                :
+                o->Set(context, name,
+                    SharedWrap<JSValue>::Shared(object->Context(), value)->Value());
+
+            if (defined.IsNothing()) {
+                exception = JSValue::New(object->Context(), trycatch.Exception());
+            }
+        }
+    V8_UNLOCK()
+
+    if (!valid) {
+        throwIllegalArgument(env, "Invalid property key");
+    } else if (exception) {
+        JNIJSException(env, exception).Throw();
     }
 }
 
@@ -347,7 +821,7 @@ NATIVE(JNIJSObject,jboolean,deleteProperty) (STATIC, jlong objRef, jstring prope
     env->ReleaseStringUTFChars(propertyName, c_string);
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
 
     return out;
@@ -372,7 +846,7 @@ NATIVE(JNIJSObject,jlong,getPropertyAtIndex) (STATIC, jlong objRef, jint propert
     V8_UNLOCK()
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
 
     return out;
@@ -396,10 +870,32 @@ NATIVE(JNIJSObject,void,setPropertyAtIndex) (STATIC, jlong objRef, jint property
     V8_UNLOCK()
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
 }
 
+NATIVE(JNIJSObject,jlong,setPropertyAtIndexAsync) (STATIC, jlong objRef, jint propertyIndex,
+                                                  jlong value)
+{
+    auto object = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), objRef);
+    auto ticket = AsyncTicket::New(object->Group());
+    auto completion = ticket->NewCompletion();
+    AsyncValueRef value_(value);
+
+    V8_ISOLATE_OBJ_ASYNC(object,isolate,context,o)
+        TryCatch trycatch(isolate);
+
+        Maybe<bool> defined =
+            o->Set(context, (uint32_t) propertyIndex, value_.Resolve(object->Context()));
+
+        if (defined.IsNothing()) {
+            completion->SetException(JSValue::New(object->Context(), trycatch.Exception()));
+        }
+    V8_UNLOCK_ASYNC()
+
+    return SharedWrap<AsyncTicket>::New(ticket);
+}
+
 NATIVE(JNIJSObject,jboolean,isFunction) (STATIC, jlong objRef)
 {
     bool v;
@@ -444,12 +940,47 @@ NATIVE(JNIJSObject,jlong,callAsFunction) (STATIC, jlong objRef, jlong thisObject
     env->ReleaseLongArrayElements(args, args_, 0);
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
 
     return out;
 }
 
+NATIVE(JNIJSObject,jlong,callAsFunctionAsync) (STATIC, jlong objRef, jlong thisObject,
+                                              jlongArray args)
+{
+    auto object = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), objRef);
+    auto ticket = AsyncTicket::New(object->Group());
+    auto completion = ticket->NewCompletion();
+    AsyncValueRef this_ref(thisObject);
+
+    jsize len = env->GetArrayLength(args);
+    jlong *args_ = env->GetLongArrayElements(args,nullptr);
+    std::vector<AsyncValueRef> arg_refs(args_, args_ + len);
+    env->ReleaseLongArrayElements(args, args_, JNI_ABORT);
+
+    V8_ISOLATE_OBJ_ASYNC(object,isolate,context,o)
+        Local<Value> this_ = thisObject ?
+            this_ref.Resolve(object->Context()) :
+            Local<Value>::New(isolate,Null(isolate));
+
+        int i;
+        Local<Value> elements[len];
+        for (i=0; i<len; i++) {
+            elements[i] = arg_refs[i].Resolve(object->Context());
+        }
+
+        TryCatch trycatch(isolate);
+
+        MaybeLocal<Value> value = o->CallAsFunction(context, this_, len, elements);
+        if (value.IsEmpty()) {
+            completion->SetException(JSValue::New(object->Context(), trycatch.Exception()));
+        }
+    V8_UNLOCK_ASYNC()
+
+    return SharedWrap<AsyncTicket>::New(ticket);
+}
+
 NATIVE(JNIJSObject,jboolean,isConstructor) (STATIC, jlong objRef)
 {
     bool v;
@@ -490,39 +1021,58 @@ NATIVE(JNIJSObject,jlong,callAsConstructor) (STATIC, jlong objRef, jlongArray ar
     env->ReleaseLongArrayElements(args, args_, 0);
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
 
     return out;
 }
 
-NATIVE(JNIJSObject,jobjectArray,copyPropertyNames) (STATIC, jlong objRef) {
-    jobjectArray ret;
-    jsize length;
-    const char **nameArray;
+static jobjectArray CopyPropertyNames(JNIEnv *env, jlong objRef, bool includePrototypeChain)
+{
+    static jclass s_stringClass = (jclass) env->NewGlobalRef(env->FindClass("java/lang/String"));
+
+    // All names are written as UTF-16 into one buffer while locked, and handed to NewString
+    // afterwards; JNIEnv may not be used on the JS thread.
+    std::vector<uint16_t> chars;
+    std::vector<size_t> offsets;
 
     V8_ISOLATE_OBJ(objRef,object,isolate,context,o)
-        Local<Array> names = o->GetPropertyNames(context).ToLocalChecked();
-        length = names->Length();
-        nameArray = new const char * [length];
+        Local<Array> names = includePrototypeChain ?
+            o->GetPropertyNames(context).ToLocalChecked() :
+            o->GetOwnPropertyNames(context).ToLocalChecked();
+        uint32_t length = names->Length();
+        offsets.reserve(length + 1);
 
-        for (uint32_t i=0; i<(uint32_t)length; i++) {
+        for (uint32_t i=0; i<length; i++) {
             Local<String> property =
                 names->Get(context, i).ToLocalChecked()->ToString(context).ToLocalChecked();
-            String::Utf8Value const str(property);
-            nameArray[i] = strdup(*str);
+            size_t offset = chars.size();
+            offsets.push_back(offset);
+            chars.resize(offset + property->Length());
+            property->Write(chars.data() + offset, 0, property->Length(),
+                            String::NO_NULL_TERMINATION);
         }
+        offsets.push_back(chars.size());
     V8_UNLOCK()
 
-    ret = (jobjectArray) env->NewObjectArray(
-            length,
-            env->FindClass("java/lang/String"),
-            env->NewStringUTF(""));
-    for (uint32_t i=0; i<(uint32_t)length; i++) {
-        env->SetObjectArrayElement(ret, i, env->NewStringUTF(nameArray[i]));
-        delete nameArray[i];
+    jsize length = (jsize) offsets.size() - 1;
+    auto ret = (jobjectArray) env->NewObjectArray(length, s_stringClass, nullptr);
+    for (jsize i=0; i<length; i++) {
+        jstring name = env->NewString((const jchar *) chars.data() + offsets[i],
+                                      (jsize) (offsets[i+1] - offsets[i]));
+        env->SetObjectArrayElement(ret, i, name);
+        env->DeleteLocalRef(name);
     }
-    delete nameArray;
 
     return ret;
+}
+
+NATIVE(JNIJSObject,jobjectArray,copyPropertyNames) (STATIC, jlong objRef)
+{
+    return CopyPropertyNames(env, objRef, true);
+}
+
+NATIVE(JNIJSObject,jobjectArray,copyOwnPropertyNames) (STATIC, jlong objRef)
+{
+    return CopyPropertyNames(env, objRef, false);
 }
\ No newline at end of file
@@ -7,9 +7,59 @@
 
 #include "JNI/JNI.h"
 #include "JNI/JNIJSException.h"
+#include <limits>
 
-#define IS_FUNCTION(TYPE) \
+/*
+ * Undefined, null, booleans and numbers answer type and conversion queries without the
+ * isolate: immediates from their bits, and wrapped ones from what JSValue cached when it was
+ * made.  Strings, objects and defunct values still go through V8.
+ */
+struct TaggedPrimitive {
+    enum Kind { kUndefined, kNull, kBoolean, kNumber } kind;
+    bool boolean;
+    double number;
+};
+
+static bool GetPrimitive(jlong reference, TaggedPrimitive& p)
+{
+    if (ISODDBALL(reference)) {
+        switch (reference) {
+            case ODDBALL_FALSE:     p.kind = TaggedPrimitive::kBoolean; p.boolean = false; break;
+            case ODDBALL_TRUE:      p.kind = TaggedPrimitive::kBoolean; p.boolean = true;  break;
+            case ODDBALL_NULL:      p.kind = TaggedPrimitive::kNull; break;
+            default:                p.kind = TaggedPrimitive::kUndefined; break;
+        }
+        return true;
+    }
+    if (CANPRIMITIVE(reference)) {
+        p.kind = TaggedPrimitive::kNumber;
+        p.number = * (double *) &reference;
+        return true;
+    }
+
+    // Heap references don't need a context to be looked up
+    auto value = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), reference);
+    if (!value || value->IsDefunct()) return false;
+    if (value->IsUndefined()) {
+        p.kind = TaggedPrimitive::kUndefined;
+    } else if (value->IsNull()) {
+        p.kind = TaggedPrimitive::kNull;
+    } else if (value->IsBoolean()) {
+        p.kind = TaggedPrimitive::kBoolean;
+        p.boolean = value->IsTrue();
+    } else if (value->IsNumber()) {
+        p.kind = TaggedPrimitive::kNumber;
+        p.number = value->NumberValue();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#define IS_FUNCTION(TYPE,PRIMITIVE) \
 NATIVE(JNIJSValue,jboolean,is##TYPE) (STATIC, jlong thiz) {\
+    TaggedPrimitive p; \
+    if (GetPrimitive(thiz, p)) return (jboolean) (PRIMITIVE); \
     auto valueRef = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), thiz); \
     bool defValue = false; \
     if (valueRef && !valueRef->IsDefunct() && !valueRef->Context()->IsDefunct() && \
@@ -22,23 +72,23 @@ NATIVE(JNIJSValue,jboolean,is##TYPE) (STATIC, jlong thiz) {\
     return (jboolean) defValue; \
 }
 
-IS_FUNCTION(Undefined)
-IS_FUNCTION(Null)
-IS_FUNCTION(Boolean)
-IS_FUNCTION(Number)
-IS_FUNCTION(String)
-IS_FUNCTION(Array)
-IS_FUNCTION(Date)
-IS_FUNCTION(TypedArray)
-IS_FUNCTION(Int8Array)
-IS_FUNCTION(Int16Array)
-IS_FUNCTION(Int32Array)
-IS_FUNCTION(Uint8Array)
-IS_FUNCTION(Uint16Array)
-IS_FUNCTION(Uint32Array)
-IS_FUNCTION(Uint8ClampedArray)
-IS_FUNCTION(Float32Array)
-IS_FUNCTION(Float64Array)
+IS_FUNCTION(Undefined, p.kind == TaggedPrimitive::kUndefined)
+IS_FUNCTION(Null, p.kind == TaggedPrimitive::kNull)
+IS_FUNCTION(Boolean, p.kind == TaggedPrimitive::kBoolean)
+IS_FUNCTION(Number, p.kind == TaggedPrimitive::kNumber)
+IS_FUNCTION(String, false)
+IS_FUNCTION(Array, false)
+IS_FUNCTION(Date, false)
+IS_FUNCTION(TypedArray, false)
+IS_FUNCTION(Int8Array, false)
+IS_FUNCTION(Int16Array, false)
+IS_FUNCTION(Int32Array, false)
+IS_FUNCTION(Uint8Array, false)
+IS_FUNCTION(Uint16Array, false)
+IS_FUNCTION(Uint32Array, false)
+IS_FUNCTION(Uint8ClampedArray, false)
+IS_FUNCTION(Float32Array, false)
+IS_FUNCTION(Float64Array, false)
 
 /* Comparing values */
 
@@ -63,7 +113,7 @@ NATIVE(JNIJSValue,jboolean,isEqual) (STATIC, jlong a_, jlong b_)
         V8_UNLOCK()
 
         if (exception) {
-            JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+            JNIJSException(env, exception).Throw();
         }
     }
     return (jboolean) out;
@@ -105,10 +155,15 @@ NATIVE(JNIJSValue,jlong,makeString) (STATIC, jlong ctxRef, jstring string)
     jlong value = 0;
 
     auto context_ = SharedWrap<JSContext>::Shared(ctxRef);
-    const char *c_string = env->GetStringUTFChars(string, nullptr);
+    // Java's UTF-16 goes straight in; the modified UTF-8 GetStringUTFChars() hands out would
+    // only have to be decoded again, and mangles anything outside the BMP on the way
+    jsize len = env->GetStringLength(string);
+    std::vector<jchar> chars((size_t)len);
+    env->GetStringRegion(string, 0, len, chars.data());
     V8_ISOLATE_CTX(context_,isolate,context)
 
-        MaybeLocal<String> str = String::NewFromUtf8(isolate, c_string, NewStringType::kNormal);
+        MaybeLocal<String> str = String::NewFromTwoByte(isolate, chars.data(),
+            NewStringType::kNormal, len);
         Local<Value> rval;
         if (str.IsEmpty()) {
             rval = Local<Value>::New(isolate,Undefined(isolate));
@@ -120,7 +175,6 @@ NATIVE(JNIJSValue,jlong,makeString) (STATIC, jlong ctxRef, jstring string)
             JSValue::New(context_,rval)
         );
     V8_UNLOCK()
-    env->ReleaseStringUTFChars(string, c_string);
 
     return value;
 }
@@ -178,9 +232,268 @@ NATIVE(JNIJSValue,jlong,createJSONString) (STATIC, jlong valueRef)
     return out;
 }
 
+/*
+ * UTF-16 and raw UTF-8 variants of the above.  These hand the characters to V8 as they are
+ * instead of transcoding through modified UTF-8, which dominates for large payloads.
+ */
+
+static jlong ParseJSON(const boost::shared_ptr<JSContext>& context_, Isolate *isolate,
+                       Local<v8::Context> context, MaybeLocal<String> str)
+{
+    if (!str.IsEmpty()) {
+        MaybeLocal<Value> parsed = JSON::Parse(context, str.ToLocalChecked());
+        if (!parsed.IsEmpty()) {
+            return SharedWrap<JSValue>::New(JSValue::New(context_,parsed.ToLocalChecked()));
+        }
+    }
+    return SharedWrap<JSValue>::New(
+        JSValue::New(context_,Local<Value>::New(isolate,Undefined(isolate)))
+    );
+}
+
+NATIVE(JNIJSValue,jlong,makeFromJSONStringUTF16) (STATIC, jlong ctxRef, jstring string)
+{
+    jlong value = 0;
+    auto context_ = SharedWrap<JSContext>::Shared(ctxRef);
+    jsize len = env->GetStringLength(string);
+
+    // Taking the isolate can block, and nothing may block inside a critical region, so the
+    // characters are copied out before it is taken
+    std::vector<jchar> chars((size_t)len);
+    env->GetStringRegion(string, 0, len, chars.data());
+
+    V8_ISOLATE_CTX(context_,isolate,context)
+        value = ParseJSON(context_, isolate, context,
+            String::NewFromTwoByte(isolate, chars.data(), NewStringType::kNormal, len));
+    V8_UNLOCK()
+
+    return value;
+}
+
+NATIVE(JNIJSValue,jlong,makeFromJSONByteBuffer) (STATIC, jlong ctxRef, jobject byteBuffer)
+{
+    jlong value = 0;
+    auto context_ = SharedWrap<JSContext>::Shared(ctxRef);
+    auto utf8 = (const char *) env->GetDirectBufferAddress(byteBuffer);
+    jlong len = env->GetDirectBufferCapacity(byteBuffer);
+    if (utf8 == nullptr || len < 0) {
+        throwIllegalArgument(env, "Buffer is not a direct ByteBuffer");
+        return 0;
+    }
+
+    V8_ISOLATE_CTX(context_,isolate,context)
+        value = ParseJSON(context_, isolate, context,
+            String::NewFromUtf8(isolate, utf8, NewStringType::kNormal, (int) len));
+    V8_UNLOCK()
+
+    return value;
+}
+
+NATIVE(JNIJSValue,jstring,createJSONStringUTF16) (STATIC, jlong valueRef)
+{
+    auto value = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), valueRef);
+    boost::shared_ptr<JSValue> exception;
+    std::vector<uint16_t> chars;
+    bool isString = false;
+
+    if (!value->IsDefunct()) {
+        V8_ISOLATE_CTX(value->Context(), isolate, context)
+            TryCatch trycatch(isolate);
+
+            // JSON.stringify itself rather than JSON::Stringify(), which only takes objects.
+            // A toJSON() or a getter may throw, and a cycle always does.
+            Local<Value> inValue = value->Value();
+            Local<Object> json = context->Global()->Get(
+                    String::NewFromUtf8(isolate, "JSON"))->ToObject();
+            Local<Function> stringify = json->Get(
+                    String::NewFromUtf8(isolate, "stringify")).As<Function>();
+            MaybeLocal<Value> result = stringify->Call(context, json, 1, &inValue);
+            if (result.IsEmpty()) {
+                exception = JSValue::New(value->Context(), trycatch.Exception());
+            } else if (result.ToLocalChecked()->IsString()) {
+                Local<String> str = result.ToLocalChecked().As<String>();
+                chars.resize((size_t) str->Length());
+                str->Write(chars.data(), 0, str->Length(), String::NO_NULL_TERMINATION);
+                isString = true;
+            }
+        V8_UNLOCK()
+    }
+
+    if (exception) {
+        JNIJSException(env, exception).Throw();
+        return nullptr;
+    }
+    if (!isString) {
+        return nullptr;
+    }
+    return env->NewString((const jchar *) chars.data(), (jsize) chars.size());
+}
+
+/*
+ * Structured clone.  Values are written in V8's own wire format, the same one V82JSC writes
+ * on iOS, so the bytes can go to disk or to another service (on either platform) and keep
+ * typed arrays, Maps, Sets, Dates and cycles intact.
+ *
+ * ArrayBuffers in the transfer list are written by their index in it instead of by value; the
+ * reader passes the buffers to use for those indices in its own transfer list.  The buffers
+ * are left as they are on the writing side.
+ */
+
+class SerializerDelegate : public ValueSerializer::Delegate {
+public:
+    explicit SerializerDelegate(Isolate *isolate) : m_isolate(isolate) {}
+    virtual void ThrowDataCloneError(Local<String> message)
+    {
+        m_isolate->ThrowException(Exception::Error(message));
+    }
+
+private:
+    Isolate *m_isolate;
+};
+
+static std::vector<jlong> TransferList(JNIEnv *env, jlongArray transfer)
+{
+    std::vector<jlong> list(transfer ? (size_t) env->GetArrayLength(transfer) : 0);
+    if (!list.empty()) {
+        env->GetLongArrayRegion(transfer, 0, (jsize) list.size(), list.data());
+    }
+    return list;
+}
+
+// Throws in |isolate| and returns false if something in the list is not an ArrayBuffer
+template <typename F>
+static bool ForEachTransfer(Isolate *isolate, boost::shared_ptr<JSContext> ctx,
+                            const std::vector<jlong>& transfer, F f)
+{
+    for (size_t i=0; i<transfer.size(); i++) {
+        Local<Value> buffer = SharedWrap<JSValue>::Shared(ctx, transfer[i])->Value();
+        if (!buffer->IsArrayBuffer()) {
+            isolate->ThrowException(Exception::TypeError(
+                String::NewFromUtf8(isolate, "Only ArrayBuffers can be transferred")));
+            return false;
+        }
+        f((uint32_t) i, buffer.As<ArrayBuffer>());
+    }
+    return true;
+}
+
+static boost::shared_ptr<JSValue> CloneException(boost::shared_ptr<JSContext> ctx,
+    Isolate *isolate, TryCatch& trycatch)
+{
+    return JSValue::New(ctx, trycatch.HasCaught() ? trycatch.Exception() :
+        Exception::Error(String::NewFromUtf8(isolate, "Unable to clone value")));
+}
+
+NATIVE(JNIJSValue,jbyteArray,serialize) (STATIC, jlong ctxRef, jlong valueRef,
+    jlongArray transfer_)
+{
+    auto ctx = SharedWrap<JSContext>::Shared(ctxRef);
+    std::vector<jlong> transfer = TransferList(env, transfer_);
+    std::vector<uint8_t> out;
+    boost::shared_ptr<JSValue> exception;
+
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        TryCatch trycatch(isolate);
+        SerializerDelegate delegate(isolate);
+        ValueSerializer serializer(isolate, &delegate);
+
+        bool ok = ForEachTransfer(isolate, ctx, transfer,
+            [&serializer](uint32_t id, Local<ArrayBuffer> buffer) {
+                serializer.TransferArrayBuffer(id, buffer);
+            });
+        if (ok) {
+            serializer.WriteHeader();
+            ok = serializer.WriteValue(context,
+                SharedWrap<JSValue>::Shared(ctx, valueRef)->Value()).FromMaybe(false);
+        }
+        if (ok) {
+            std::pair<uint8_t*, size_t> data = serializer.Release();
+            out.assign(data.first, data.first + data.second);
+            free(data.first);
+        } else {
+            exception = CloneException(ctx, isolate, trycatch);
+        }
+    V8_UNLOCK()
+
+    if (exception) {
+        JNIJSException(env, exception).Throw();
+        return nullptr;
+    }
+
+    jbyteArray ret = env->NewByteArray((jsize) out.size());
+    env->SetByteArrayRegion(ret, 0, (jsize) out.size(), (const jbyte *) out.data());
+    return ret;
+}
+
+static jlong Deserialize(JNIEnv *env, jlong ctxRef, const uint8_t *data, size_t size,
+    jlongArray transfer_)
+{
+    auto ctx = SharedWrap<JSContext>::Shared(ctxRef);
+    std::vector<jlong> transfer = TransferList(env, transfer_);
+    jlong out = 0;
+    boost::shared_ptr<JSValue> exception;
+
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        TryCatch trycatch(isolate);
+        ValueDeserializer deserializer(isolate, data, size);
+
+        MaybeLocal<Value> value;
+        bool ok = ForEachTransfer(isolate, ctx, transfer,
+            [&deserializer](uint32_t id, Local<ArrayBuffer> buffer) {
+                deserializer.TransferArrayBuffer(id, buffer);
+            });
+        if (ok && deserializer.ReadHeader(context).FromMaybe(false)) {
+            value = deserializer.ReadValue(context);
+        }
+        if (value.IsEmpty()) {
+            exception = CloneException(ctx, isolate, trycatch);
+        } else {
+            out = SharedWrap<JSValue>::New(JSValue::New(ctx, value.ToLocalChecked()));
+        }
+    V8_UNLOCK()
+
+    if (exception) {
+        JNIJSException(env, exception).Throw();
+    }
+
+    return out;
+}
+
+NATIVE(JNIJSValue,jlong,deserialize) (STATIC, jlong ctxRef, jbyteArray data_,
+    jlongArray transfer_)
+{
+    // The bytes may be read on the group's thread, where the array can't be pinned
+    std::vector<uint8_t> data((size_t) env->GetArrayLength(data_));
+    env->GetByteArrayRegion(data_, 0, (jsize) data.size(), (jbyte *) data.data());
+
+    return Deserialize(env, ctxRef, data.data(), data.size(), transfer_);
+}
+
+NATIVE(JNIJSValue,jlong,deserializeByteBuffer) (STATIC, jlong ctxRef, jobject byteBuffer,
+    jlongArray transfer_)
+{
+    auto data = (const uint8_t *) env->GetDirectBufferAddress(byteBuffer);
+    jlong len = env->GetDirectBufferCapacity(byteBuffer);
+    if (data == nullptr || len < 0) {
+        __android_log_assert("FAIL", "deserializeByteBuffer",
+                             "Buffer is not a direct ByteBuffer");
+    }
+
+    return Deserialize(env, ctxRef, data, (size_t) len, transfer_);
+}
+
 /* Converting to primitive values */
 
 NATIVE(JNIJSValue,jboolean,toBoolean) (STATIC, jlong thiz) {
+    TaggedPrimitive p;
+    if (GetPrimitive(thiz, p)) {
+        switch (p.kind) {
+            case TaggedPrimitive::kBoolean:   return (jboolean) p.boolean;
+            // Zero, minus zero and NaN are false
+            case TaggedPrimitive::kNumber:    return (jboolean) (p.number != 0 && p.number == p.number);
+            default:                    return (jboolean) false;
+        }
+    }
     auto valueRef = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), thiz);
     bool defValue = false;
     if (valueRef && !valueRef->IsDefunct() && !valueRef->Context()->IsDefunct() &&
@@ -196,6 +509,16 @@ NATIVE(JNIJSValue,jboolean,toBoolean) (STATIC, jlong thiz) {
 
 
 NATIVE(JNIJSValue,jdouble,toNumber) (STATIC, jlong valueRef) {
+    TaggedPrimitive p;
+    if (GetPrimitive(valueRef, p)) {
+        switch (p.kind) {
+            case TaggedPrimitive::kNumber:    return p.number;
+            case TaggedPrimitive::kBoolean:   return p.boolean ? 1.0 : 0.0;
+            case TaggedPrimitive::kNull:      return 0.0;
+            default:                    return std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+
     double out = 0.0;
     auto value = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), valueRef);
     boost::shared_ptr<JSValue> exception;
@@ -212,7 +535,7 @@ NATIVE(JNIJSValue,jdouble,toNumber) (STATIC, jlong valueRef) {
         }
     V8_UNLOCK()
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
     return out;
 }
@@ -221,7 +544,7 @@ NATIVE(JNIJSValue,jstring,toStringCopy) (STATIC, jlong valueRef) {
     jstring out = nullptr;
     auto value = SharedWrap<JSValue>::Shared(boost::shared_ptr<JSContext>(), valueRef);
     boost::shared_ptr<JSValue> exception;
-    const char *s = nullptr;
+    std::vector<jchar> chars;
 
     V8_ISOLATE_CTX(value->Context(), isolate, context)
 
@@ -229,19 +552,19 @@ NATIVE(JNIJSValue,jstring,toStringCopy) (STATIC, jlong valueRef) {
 
         MaybeLocal<String> string = value->Value()->ToString(context);
         if (!string.IsEmpty()) {
-            String::Utf8Value const str(string.ToLocalChecked());
-            s = strdup(*str);
+            // As UTF-16, which is what the Java string is made of anyway
+            Local<String> str = string.ToLocalChecked();
+            chars.resize((size_t)str->Length());
+            str->Write(chars.data(), 0, (int)chars.size(), String::NO_NULL_TERMINATION);
         } else {
-            s = strdup("");
             exception = JSValue::New(value->Context(), trycatch.Exception());
         }
     V8_UNLOCK()
 
-    out = env->NewStringUTF(s);
-    free((void*)s);
+    out = env->NewString(chars.data(), (jsize)chars.size());
 
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
 
     return out;
@@ -266,7 +589,7 @@ NATIVE(JNIJSValue,jlong,toObject) (STATIC, jlong valueRef) {
         }
     V8_UNLOCK()
     if (exception) {
-        JNIJSException(env, SharedWrap<JSValue>::New(exception)).Throw();
+        JNIJSException(env, exception).Throw();
     }
     return out;
 }
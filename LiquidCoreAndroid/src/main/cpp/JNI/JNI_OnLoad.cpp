@@ -6,6 +6,10 @@
  */
 
 #include <jni.h>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
 
 #ifdef DEBUG
 #include <sys/types.h>
@@ -51,6 +55,7 @@ int start_logger(const char *app_name)
 }
 #endif
 
+static JavaVM *s_JavaVM;
 static jobject s_ClassLoader;
 static jmethodID s_FindClassMethod;
 
@@ -61,6 +66,7 @@ jint JNI_OnLoad(JavaVM* vm, void*)
     start_logger("LiquidCore");
 #endif
 
+    s_JavaVM = vm;
     JNIEnv* env;
     if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_OK) {
         return -1;
@@ -78,10 +84,114 @@ jint JNI_OnLoad(JavaVM* vm, void*)
     return JNI_VERSION_1_6;
 }
 
+JavaVM *javaVM()
+{
+    return s_JavaVM;
+}
+
 jclass findClass(JNIEnv *env, const char* name)
 {
     jstring clsname =  env->NewStringUTF(name);
     jclass clazz = static_cast<jclass>(env->CallObjectMethod(s_ClassLoader, s_FindClassMethod, clsname));
     env->DeleteLocalRef(clsname);
     return clazz;
+}
+
+void throwIllegalArgument(JNIEnv *env, const char *message)
+{
+    jclass clazz = env->FindClass("java/lang/IllegalArgumentException");
+    env->ThrowNew(clazz, message);
+    env->DeleteLocalRef(clazz);
+}
+
+struct CachedMethod {
+    jclass cls;     // global reference to the concrete class
+    const char *name;
+    const char *signature;
+    jmethodID mid;
+};
+static std::shared_timed_mutex s_methods_mutex;
+static std::vector<CachedMethod> s_methods;
+
+static jmethodID LookUpMethod(JNIEnv *env, jclass cls, const char *name, const char *signature)
+{
+    jmethodID mid;
+    cls = (jclass) env->NewLocalRef(cls);
+    do {
+        mid = env->GetMethodID(cls, name, signature);
+        if (!env->ExceptionCheck()) break;
+        env->ExceptionClear();
+        jclass super = env->GetSuperclass(cls);
+        env->DeleteLocalRef(cls);
+        if (super == nullptr || env->ExceptionCheck()) {
+            env->ExceptionClear();
+            if (super != nullptr) env->DeleteLocalRef(super);
+            return nullptr;
+        }
+        cls = super;
+    } while (true);
+    env->DeleteLocalRef(cls);
+    return mid;
+}
+
+static thread_local JNIEnv *t_env = nullptr;
+
+void attachThread(JavaVM *jvm, const char *name)
+{
+    if (t_env) return;
+    JNIEnv *env;
+    if (jvm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_EDETACHED) {
+        // A Java thread, or attached by someone else who will detach it
+        return;
+    }
+    JavaVMAttachArgs args = { JNI_VERSION_1_6, name, nullptr };
+    if (jvm->AttachCurrentThreadAsDaemon(&env, &args) == JNI_OK) {
+        t_env = env;
+    }
+}
+
+void detachThread(JavaVM *jvm)
+{
+    if (t_env) {
+        t_env = nullptr;
+        jvm->DetachCurrentThread();
+    }
+}
+
+JNIEnv *threadEnv(JavaVM *jvm, bool& detach)
+{
+    detach = false;
+    if (t_env) return t_env;
+    JNIEnv *env;
+    if (jvm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) == JNI_EDETACHED) {
+        jvm->AttachCurrentThread(&env, nullptr);
+        detach = true;
+    }
+    return env;
+}
+
+jmethodID findMethod(JNIEnv *env, jobject object, const char *name, const char *signature)
+{
+    jclass cls = env->GetObjectClass(object);
+    jmethodID mid = nullptr;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(s_methods_mutex);
+        for (const CachedMethod& method : s_methods) {
+            if ((method.name == name || !strcmp(method.name, name)) &&
+                (method.signature == signature || !strcmp(method.signature, signature)) &&
+                env->IsSameObject(cls, method.cls)) {
+                mid = method.mid;
+                break;
+            }
+        }
+    }
+    if (!mid) {
+        mid = LookUpMethod(env, cls, name, signature);
+        if (mid) {
+            std::unique_lock<std::shared_timed_mutex> lock(s_methods_mutex);
+            s_methods.push_back({ (jclass) env->NewGlobalRef(cls), name, signature, mid });
+        }
+    }
+    env->DeleteLocalRef(cls);
+    return mid;
 }
\ No newline at end of file
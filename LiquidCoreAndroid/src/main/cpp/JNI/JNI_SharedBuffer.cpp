@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+#include "JNI/JNI.h"
+#include "SharedBacking.h"
+
+/*
+ * Shared backing stores, for memory that the host and any number of contexts (in any group or
+ * node instance) see at once.  A reference from here is one reference on the store; the store
+ * outlives it for as long as any SharedArrayBuffer over it is alive.
+ */
+
+using nodedroid::SharedBacking;
+
+NATIVE(JNISharedBuffer,jlong,create) (STATIC, jlong length)
+{
+    return reinterpret_cast<jlong>(SharedBacking::New((size_t) length));
+}
+
+NATIVE(JNISharedBuffer,void,Finalize) (STATIC, jlong storeRef)
+{
+    reinterpret_cast<SharedBacking*>(storeRef)->Release();
+}
+
+// A view for the host.  It holds no reference, so the JNISharedBuffer must outlive it.
+NATIVE(JNISharedBuffer,jobject,byteBuffer) (STATIC, jlong storeRef)
+{
+    auto store = reinterpret_cast<SharedBacking*>(storeRef);
+    return env->NewDirectByteBuffer(store->Data(), (jlong) store->Length());
+}
+
+// A new SharedArrayBuffer over the store in 'ctxRef'
+NATIVE(JNISharedBuffer,jlong,wrap) (STATIC, jlong ctxRef, jlong storeRef)
+{
+    auto ctx = SharedWrap<JSContext>::Shared(ctxRef);
+    auto store = reinterpret_cast<SharedBacking*>(storeRef);
+    jlong value = 0;
+
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        value = SharedWrap<JSValue>::New(JSValue::New(ctx, store->Wrap(isolate)));
+    V8_UNLOCK()
+
+    return value;
+}
+
+// The store behind a SharedArrayBuffer made in JS, or 0 if 'valueRef' isn't one that can be shared
+NATIVE(JNISharedBuffer,jlong,fromValue) (STATIC, jlong ctxRef, jlong valueRef)
+{
+    auto ctx = SharedWrap<JSContext>::Shared(ctxRef);
+    SharedBacking *store = nullptr;
+
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        Local<Value> value = SharedWrap<JSValue>::Shared(ctx, valueRef)->Value();
+        if (value->IsSharedArrayBuffer()) {
+            store = SharedBacking::From(isolate, value.As<SharedArrayBuffer>());
+        }
+    V8_UNLOCK()
+
+    return reinterpret_cast<jlong>(store);
+}
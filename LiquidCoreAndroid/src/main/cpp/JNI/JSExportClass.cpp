@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <cstring>
+#include <string>
+#include "JNI/JNI.h"
+#include "JNI/JSExportClass.h"
+#include "Common/JavaHeapTracer.h"
+
+using namespace v8;
+
+#define JAVA_STRING "Ljava/lang/String;"
+
+// What internal field 0 of an instance points to; field 1 is JavaHeapTracer::Tag()
+struct JSExportClass::Instance : JavaPeer {
+    boost::shared_ptr<JSExportClass> cls;
+    UniquePersistent<Object> weak;
+};
+
+JSExportClass::JSExportClass(JNIEnv *env, boost::shared_ptr<ContextGroup> group, jclass cls,
+                             jobjectArray names, jobjectArray types, jobjectArray fields,
+                             jobjectArray getters, jobjectArray setters)
+{
+    env->GetJavaVM(&m_jvm);
+    m_group = group;
+
+    auto string = [env](jobjectArray array, jsize i) -> std::string {
+        auto element = (jstring) env->GetObjectArrayElement(array, i);
+        if (!element) return std::string();
+        const char *c_string = env->GetStringUTFChars(element, nullptr);
+        std::string out = c_string;
+        env->ReleaseStringUTFChars(element, c_string);
+        env->DeleteLocalRef(element);
+        return out;
+    };
+
+    const jsize count = env->GetArrayLength(names);
+    std::vector<std::string> property_names;
+    m_properties.resize((size_t) count);
+    for (jsize i = 0; i < count; i++) {
+        Property& property = m_properties[i];
+        const std::string type = string(types, i);
+        if (type.size() == 1 && strchr("ZBCSIJFD", type[0])) {
+            property.type = type[0];
+        } else if (type == JAVA_STRING) {
+            property.type = 'L';
+        } else {
+            __android_log_assert("FAIL", "JSExportClass", "Unsupported property type %s",
+                                 type.c_str());
+        }
+
+        const std::string field = string(fields, i);
+        const std::string getter = field.empty() ? string(getters, i) : std::string();
+        const std::string setter = field.empty() ? string(setters, i) : std::string();
+        property.field = field.empty() ? nullptr :
+            env->GetFieldID(cls, field.c_str(), type.c_str());
+        property.getter = getter.empty() ? nullptr :
+            env->GetMethodID(cls, getter.c_str(), ("()" + type).c_str());
+        property.setter = setter.empty() ? nullptr :
+            env->GetMethodID(cls, setter.c_str(), ("(" + type + ")V").c_str());
+        if (!property.field && !property.getter) {
+            __android_log_assert("FAIL", "JSExportClass", "Did not find property %s",
+                                 string(names, i).c_str());
+        }
+        if (!setter.empty() && !property.setter) {
+            __android_log_assert("FAIL", "JSExportClass", "Did not find setter %s",
+                                 setter.c_str());
+        }
+        property_names.push_back(string(names, i));
+    }
+
+    V8_ISOLATE(group, isolate)
+        Local<ObjectTemplate> templ = ObjectTemplate::New(isolate);
+        templ->SetInternalFieldCount(2);
+        for (size_t i = 0; i < m_properties.size(); i++) {
+            const Property& property = m_properties[i];
+            const bool writable = property.field || property.setter;
+            templ->SetAccessor(
+                String::NewFromUtf8(isolate, property_names[i].c_str(),
+                                    NewStringType::kInternalized).ToLocalChecked(),
+                Getter, writable ? Setter : nullptr,
+                External::New(isolate, &m_properties[i]), v8::DEFAULT,
+                writable ? v8::None : v8::ReadOnly);
+        }
+        m_template.Reset(isolate, templ);
+    V8_UNLOCK()
+}
+
+JSExportClass::~JSExportClass()
+{
+    boost::shared_ptr<ContextGroup> group = m_group.lock();
+    if (group && !group->IsDefunct()) {
+        V8_ISOLATE(group, isolate)
+            m_template.Reset();
+        V8_UNLOCK()
+    }
+}
+
+boost::shared_ptr<JSValue> JSExportClass::NewInstance(JNIEnv *env,
+                                                      boost::shared_ptr<JSContext> ctx,
+                                                      jobject thiz)
+{
+    boost::shared_ptr<JSValue> value;
+    JavaHeapTracer *tracer = ctx->Group()->HeapTracer();
+    auto instance = new Instance();
+    instance->cls = shared_from_this();
+    instance->java = env->NewWeakGlobalRef(thiz);
+    if (tracer) {
+        instance->pin = env->NewGlobalRef(thiz);
+    }
+
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        Local<Object> object =
+            Local<ObjectTemplate>::New(isolate, m_template)->NewInstance(context)
+                .ToLocalChecked();
+        object->SetAlignedPointerInInternalField(0, static_cast<JavaPeer*>(instance));
+        object->SetAlignedPointerInInternalField(1, JavaHeapTracer::Tag());
+        if (tracer) {
+            tracer->Add(instance);
+        }
+        instance->weak = UniquePersistent<Object>(isolate, object);
+        instance->weak.SetWeak<Instance>(
+            instance,
+            [](const WeakCallbackInfo<Instance>& info) {
+                // JNI is off limits during GC; let go of the Java object on the second pass
+                info.GetParameter()->weak.Reset();
+                info.SetSecondPassCallback(InstanceReleased);
+            }, v8::WeakCallbackType::kParameter);
+        value = JSValue::New(ctx, object);
+    V8_UNLOCK()
+
+    return value;
+}
+
+void JSExportClass::InstanceReleased(const WeakCallbackInfo<Instance>& info)
+{
+    Instance *instance = info.GetParameter();
+    boost::shared_ptr<ContextGroup> group = instance->cls->m_group.lock();
+    if (group && group->HeapTracer()) {
+        group->HeapTracer()->Remove(instance);
+    }
+    JavaVM *jvm = instance->cls->m_jvm;
+    bool detach;
+    JNIEnv *env = threadEnv(jvm, detach);
+    if (instance->pin) {
+        env->DeleteGlobalRef(instance->pin);
+    }
+    env->DeleteWeakGlobalRef(instance->java);
+    if (detach) {
+        jvm->DetachCurrentThread();
+    }
+    delete instance;
+}
+
+bool JSExportClass::Hold(boost::shared_ptr<JSValue> instance, boost::shared_ptr<JSValue> value,
+                         bool hold)
+{
+    bool held = false;
+    boost::shared_ptr<JSContext> ctx = instance->Context();
+    if (!instance->IsObject() || !ctx || !ctx->Group()->HeapTracer()) {
+        return false;
+    }
+    V8_ISOLATE_CTX(ctx,isolate,context)
+        JavaPeer *peer = JavaHeapTracer::PeerOf(instance->Value().As<Object>());
+        if (peer) {
+            ctx->Group()->HeapTracer()->Hold(peer, value, hold);
+            held = true;
+        }
+    V8_UNLOCK()
+    return held;
+}
+
+namespace {
+
+// A Java exception left pending by a field access or call, rethrown in JS
+void ThrowPending(JNIEnv *env, Isolate *isolate)
+{
+    if (!env->ExceptionCheck()) return;
+    env->ExceptionClear();
+    isolate->ThrowException(Exception::Error(
+        String::NewFromUtf8(isolate, "Java exception in property accessor",
+                            NewStringType::kNormal).ToLocalChecked()));
+}
+
+} /* namespace */
+
+void JSExportClass::Getter(Local<String> /*name*/, const PropertyCallbackInfo<v8::Value>& info)
+{
+    auto property = static_cast<const Property *>(info.Data().As<External>()->Value());
+    auto instance = static_cast<Instance *>(static_cast<JavaPeer *>(
+        info.Holder()->GetAlignedPointerFromInternalField(0)));
+    JavaVM *jvm = instance->cls->m_jvm;
+    bool detach;
+    JNIEnv *env = threadEnv(jvm, detach);
+
+    jobject obj = env->NewLocalRef(instance->java);
+    if (obj) {
+        ReturnValue<v8::Value> ret = info.GetReturnValue();
+        const jfieldID fid = property->field;
+        const jmethodID mid = property->getter;
+        switch (property->type) {
+            case 'Z':
+                ret.Set((fid ? env->GetBooleanField(obj, fid) :
+                               env->CallBooleanMethod(obj, mid)) == JNI_TRUE);
+                break;
+            case 'B':
+                ret.Set((int32_t) (fid ? env->GetByteField(obj, fid) :
+                                         env->CallByteMethod(obj, mid)));
+                break;
+            case 'C':
+                ret.Set((uint32_t) (fid ? env->GetCharField(obj, fid) :
+                                          env->CallCharMethod(obj, mid)));
+                break;
+            case 'S':
+                ret.Set((int32_t) (fid ? env->GetShortField(obj, fid) :
+                                         env->CallShortMethod(obj, mid)));
+                break;
+            case 'I':
+                ret.Set((int32_t) (fid ? env->GetIntField(obj, fid) :
+                                         env->CallIntMethod(obj, mid)));
+                break;
+            case 'J':
+                ret.Set((double) (fid ? env->GetLongField(obj, fid) :
+                                        env->CallLongMethod(obj, mid)));
+                break;
+            case 'F':
+                ret.Set((double) (fid ? env->GetFloatField(obj, fid) :
+                                        env->CallFloatMethod(obj, mid)));
+                break;
+            case 'D':
+                ret.Set(fid ? env->GetDoubleField(obj, fid) : env->CallDoubleMethod(obj, mid));
+                break;
+            default: {
+                auto string = (jstring) (fid ? env->GetObjectField(obj, fid) :
+                                               env->CallObjectMethod(obj, mid));
+                if (string) {
+                    const jchar *chars = env->GetStringChars(string, nullptr);
+                    ret.Set(String::NewFromTwoByte(info.GetIsolate(),
+                        reinterpret_cast<const uint16_t *>(chars), NewStringType::kNormal,
+                        env->GetStringLength(string)).ToLocalChecked());
+                    env->ReleaseStringChars(string, chars);
+                    env->DeleteLocalRef(string);
+                } else if (!env->ExceptionCheck()) {
+                    ret.SetNull();
+                }
+                break;
+            }
+        }
+        ThrowPending(env, info.GetIsolate());
+        env->DeleteLocalRef(obj);
+    }
+
+    if (detach) {
+        jvm->DetachCurrentThread();
+    }
+}
+
+void JSExportClass::Setter(Local<String> /*name*/, Local<v8::Value> value,
+                           const PropertyCallbackInfo<void>& info)
+{
+    auto property = static_cast<const Property *>(info.Data().As<External>()->Value());
+    auto instance = static_cast<Instance *>(static_cast<JavaPeer *>(
+        info.Holder()->GetAlignedPointerFromInternalField(0)));
+    Isolate *isolate = info.GetIsolate();
+    Local<v8::Context> context = isolate->GetCurrentContext();
+
+    // Converted as JS would, before going anywhere near Java
+    jvalue arg;
+    switch (property->type) {
+        case 'Z': {
+            Maybe<bool> v = value->BooleanValue(context);
+            if (v.IsNothing()) return;
+            arg.z = (jboolean) v.FromJust();
+            break;
+        }
+        case 'B': case 'C': case 'S': case 'I': {
+            Maybe<int32_t> v = value->Int32Value(context);
+            if (v.IsNothing()) return;
+            switch (property->type) {
+                case 'B': arg.b = (jbyte) v.FromJust(); break;
+                case 'C': arg.c = (jchar) v.FromJust(); break;
+                case 'S': arg.s = (jshort) v.FromJust(); break;
+                default:  arg.i = (jint) v.FromJust(); break;
+            }
+            break;
+        }
+        case 'J': {
+            Maybe<int64_t> v = value->IntegerValue(context);
+            if (v.IsNothing()) return;
+            arg.j = (jlong) v.FromJust();
+            break;
+        }
+        case 'F': case 'D': {
+            Maybe<double> v = value->NumberValue(context);
+            if (v.IsNothing()) return;
+            if (property->type == 'F') arg.f = (jfloat) v.FromJust();
+            else arg.d = v.FromJust();
+            break;
+        }
+        default:
+            arg.l = nullptr;
+            break;
+    }
+    Local<String> string;
+    if (property->type == 'L' && !value->IsNull() && !value->ToString(context).ToLocal(&string)) {
+        return;
+    }
+
+    JavaVM *jvm = instance->cls->m_jvm;
+    bool detach;
+    JNIEnv *env = threadEnv(jvm, detach);
+
+    jobject obj = env->NewLocalRef(instance->java);
+    if (obj) {
+        if (!string.IsEmpty()) {
+            String::Value chars(string);
+            arg.l = env->NewString(reinterpret_cast<const jchar *>(*chars), chars.length());
+        }
+        const jfieldID fid = property->field;
+        if (property->setter) {
+            env->CallVoidMethodA(obj, property->setter, &arg);
+        } else switch (property->type) {
+            case 'Z': env->SetBooleanField(obj, fid, arg.z); break;
+            case 'B': env->SetByteField(obj, fid, arg.b); break;
+            case 'C': env->SetCharField(obj, fid, arg.c); break;
+            case 'S': env->SetShortField(obj, fid, arg.s); break;
+            case 'I': env->SetIntField(obj, fid, arg.i); break;
+            case 'J': env->SetLongField(obj, fid, arg.j); break;
+            case 'F': env->SetFloatField(obj, fid, arg.f); break;
+            case 'D': env->SetDoubleField(obj, fid, arg.d); break;
+            default: env->SetObjectField(obj, fid, arg.l); break;
+        }
+        if (arg.l && property->type == 'L') env->DeleteLocalRef(arg.l);
+        ThrowPending(env, isolate);
+        env->DeleteLocalRef(obj);
+    }
+
+    if (detach) {
+        jvm->DetachCurrentThread();
+    }
+}
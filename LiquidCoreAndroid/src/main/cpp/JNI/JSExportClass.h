@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef LIQUIDCORE_JSEXPORTCLASS_H
+#define LIQUIDCORE_JSEXPORTCLASS_H
+
+#include <vector>
+#include "Common/Common.h"
+
+using namespace v8;
+
+/*
+ * The exported properties of a Java class, laid down once per group as an ObjectTemplate of
+ * native accessors.  Each accessor is bound to its property's jfieldID, or getter and setter
+ * jmethodID, so that a read from JS is one JNI field access or call on the Java object, with
+ * no lookup by name and no JSValue made for the result.  Properties may only be of primitive
+ * and String types, given as their JNI type, e.g. "D" or "Ljava/lang/String;".
+ *
+ * Instances point back to their Java object weakly, as JSFunction does.  In groups with an
+ * isolate of their own they are also the Java object's peer for the group's JavaHeapTracer,
+ * which keeps the Java object alive for as long as JS can reach the instance, and the JS
+ * values it holds (see Hold()) for as long as either side can reach the Java object.
+ * Elsewhere, the Java object is expected to hold on to its instance.
+ */
+class JSExportClass : public boost::enable_shared_from_this<JSExportClass> {
+public:
+    /*
+     * Property i is named names[i] and of JNI type types[i].  It is the field fields[i] if that
+     * is set, and otherwise reads through getters[i] and writes through setters[i]; without a
+     * setter it is read-only.
+     */
+    JSExportClass(JNIEnv *env, boost::shared_ptr<ContextGroup> group, jclass cls,
+                  jobjectArray names, jobjectArray types, jobjectArray fields,
+                  jobjectArray getters, jobjectArray setters);
+    ~JSExportClass();
+
+    // A new instance over |thiz|
+    boost::shared_ptr<JSValue> NewInstance(JNIEnv *env, boost::shared_ptr<JSContext> ctx,
+                                           jobject thiz);
+    // Whether the Java object behind |instance| holds |value|, as a field or otherwise; the
+    // instance's own JSValue counts too.  False if |instance| is not an instance, or the
+    // group has no tracer.
+    static bool Hold(boost::shared_ptr<JSValue> instance, boost::shared_ptr<JSValue> value,
+                     bool hold);
+
+private:
+    struct Property {
+        char type;          // JNI type char, 'L' for String
+        jfieldID field;
+        jmethodID getter;
+        jmethodID setter;
+    };
+    struct Instance;
+
+    static void Getter(Local<String> name, const PropertyCallbackInfo<v8::Value>& info);
+    static void Setter(Local<String> name, Local<v8::Value> value,
+                       const PropertyCallbackInfo<void>& info);
+    static void InstanceReleased(const WeakCallbackInfo<Instance>& info);
+
+    JavaVM *m_jvm;
+    boost::weak_ptr<ContextGroup> m_group;
+    std::vector<Property> m_properties;
+    Persistent<ObjectTemplate> m_template;
+};
+
+#endif //LIQUIDCORE_JSEXPORTCLASS_H
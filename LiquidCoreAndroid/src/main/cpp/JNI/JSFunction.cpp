@@ -5,13 +5,18 @@
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
 #include <cstdlib>
+#include <cstring>
 #include <boost/make_shared.hpp>
 #include "JNI/JNI.h"
 #include "JNI/JSFunction.h"
+#include "TraceSpan.h"
 
 using namespace v8;
 
-JSFunction::JSFunction(JNIEnv* env, jobject thiz, boost::shared_ptr<JSContext> ctx, jstring name_)
+static thread_local int s_callback_depth = 0;
+
+JSFunction::JSFunction(JNIEnv* env, jobject thiz, boost::shared_ptr<JSContext> ctx, jstring name_,
+                       jstring method_, jstring signature_)
 {
     m_context = ctx;
     m_isUndefined = false;
@@ -23,29 +28,39 @@ JSFunction::JSFunction(JNIEnv* env, jobject thiz, boost::shared_ptr<JSContext> c
 
     env->GetJavaVM(&m_jvm);
     m_JavaThis = env->NewWeakGlobalRef(thiz);
+    m_externals = ctx->Group()->Externals();
+    m_externals->Add(this, [this]() { ReleaseJavaRefs(); });
 
     auto getMid = [&](const char* cb, const char *signature) -> jmethodID {
-        jmethodID mid;
-        jclass cls = env->GetObjectClass(thiz);
-        do {
-            mid = env->GetMethodID(cls,cb,signature);
-            if (!env->ExceptionCheck()) break;
-            env->ExceptionClear();
-            jclass super = env->GetSuperclass(cls);
-            env->DeleteLocalRef(cls);
-            if (super == nullptr || env->ExceptionCheck()) {
-                if (super != nullptr) env->DeleteLocalRef(super);
-                __android_log_assert("FAIL", "FunctionCallback",
-                                     "Did not find callback method");
-            }
-            cls = super;
-        } while (true);
-        env->DeleteLocalRef(cls);
+        jmethodID mid = findMethod(env, thiz, cb, signature);
+        if (mid == nullptr) {
+            __android_log_assert("FAIL", "FunctionCallback", "Did not find callback method");
+        }
         return mid;
     };
 
     m_constructorMid = getMid("constructorCallback","(J[J)V");
     m_functionMid = getMid("functionCallback","(J[J)J");
+
+    m_typedMid = nullptr;
+    m_returnType = 'V';
+    if (method_) {
+        const char *method = env->GetStringUTFChars(method_, nullptr);
+        const char *signature = env->GetStringUTFChars(signature_, nullptr);
+        if (!ParseSignature(signature)) {
+            __android_log_assert("FAIL", "FunctionCallback",
+                "Unsupported typed callback signature %s", signature);
+        }
+        jclass cls = env->GetObjectClass(thiz);
+        m_typedMid = env->GetMethodID(cls, method, signature);
+        env->DeleteLocalRef(cls);
+        if (m_typedMid == nullptr) {
+            __android_log_assert("FAIL", "FunctionCallback",
+                "Did not find callback method %s%s", method, signature);
+        }
+        env->ReleaseStringUTFChars(method_, method);
+        env->ReleaseStringUTFChars(signature_, signature);
+    }
     const char *c_string = env->GetStringUTFChars(name_, nullptr);
 
     V8_ISOLATE_CTX(ctx,isolate,context)
@@ -54,13 +69,12 @@ JSFunction::JSFunction(JNIEnv* env, jobject thiz, boost::shared_ptr<JSContext> c
         Local<String> name =
             String::NewFromUtf8(isolate, c_string, NewStringType::kNormal).ToLocalChecked();
 
-        Local<FunctionTemplate> ctor =
-            FunctionTemplate::New(isolate, StaticFunctionCallback, data);
+        Local<FunctionTemplate> ctor = FunctionTemplate::New(isolate,
+            m_typedMid ? TypedCallbackFor(m_returnType) : StaticFunctionCallback, data);
         Local<Function> function = ctor->GetFunction();
         function->SetName(name);
 
-        Local<Private> privateKey = v8::Private::ForApi(isolate,
-            String::NewFromUtf8(isolate, "__JSValue_ptr"));
+        Local<Private> privateKey = ctx->Group()->ValuePtrKey();
         function->SetPrivate(context, privateKey, data);
 
         m_value.Reset(isolate, function);
@@ -69,17 +83,41 @@ JSFunction::JSFunction(JNIEnv* env, jobject thiz, boost::shared_ptr<JSContext> c
     env->ReleaseStringUTFChars(name_, c_string);
 }
 
-boost::shared_ptr<JSValue> JSFunction::New(JNIEnv* env, jobject thiz,
-                                           jlong javaContext, jstring name_)
+boost::shared_ptr<JSValue> JSFunction::New(JNIEnv* env, jobject thiz, jlong javaContext,
+                                           jstring name_, jstring method_, jstring signature_)
 {
     auto ctx = SharedWrap<JSContext>::Shared(javaContext);
-    auto p = boost::make_shared<JSFunction>(env, thiz, ctx, name_);
+    auto p = boost::make_shared<JSFunction>(env, thiz, ctx, name_, method_, signature_);
     ctx->retain(p);
-    ctx->Group()->Manage(p);
+    p->m_managed_slot = ctx->Group()->Manage(p);
     return p;
 }
 
-JSFunction::~JSFunction() = default;
+JSFunction::~JSFunction()
+{
+    // Waits out the group's Dispose() if it is letting go of them right now
+    m_externals->Remove(this);
+    ReleaseJavaRefs();
+}
+
+void JSFunction::ReleaseJavaRefs()
+{
+    if (!m_JavaThis) return;
+
+    bool detach;
+    JNIEnv *env = threadEnv(m_jvm, detach);
+    env->DeleteWeakGlobalRef(m_JavaThis);
+    m_JavaThis = nullptr;
+    for (auto& args : m_args_cache) {
+        if (args) {
+            env->DeleteGlobalRef(args);
+            args = nullptr;
+        }
+    }
+    if (detach) {
+        m_jvm->DetachCurrentThread();
+    }
+}
 
 void JSFunction::StaticFunctionCallback(const FunctionCallbackInfo< v8::Value > &info)
 {
@@ -92,17 +130,15 @@ void JSFunction::StaticFunctionCallback(const FunctionCallbackInfo< v8::Value >
 
 void JSFunction::FunctionCallback(const FunctionCallbackInfo< v8::Value > &info)
 {
-    JNIEnv *env;
+    TRACE_SPAN("JSFunction callback");
     jlong objThis = 0;
     jlongArray argsArr = nullptr;
     bool isConstructCall = info.IsConstructCall();
     int argumentCount = info.Length();
     jlong args[argumentCount];
 
-    int getEnvStat = m_jvm->GetEnv((void**)&env, JNI_VERSION_1_6);
-    if (getEnvStat == JNI_EDETACHED) {
-        m_jvm->AttachCurrentThread(&env, nullptr);
-    }
+    bool detach;
+    JNIEnv *env = threadEnv(m_jvm, detach);
 
     Isolate *isolate = info.GetIsolate();
     HandleScope handle_scope(isolate);
@@ -110,26 +146,49 @@ void JSFunction::FunctionCallback(const FunctionCallbackInfo< v8::Value > &info)
     Local<v8::Context> context = ctxt->Value();
     Context::Scope context_scope_(context);
 
-    objThis = SharedWrap<JSValue>::New(JSValue::New(ctxt, info.This()));
+    // Primitives are passed as immediates; only objects and strings need a JSValue
+    auto reference = [&](Local<v8::Value> value) -> jlong {
+        jlong ref;
+        return ImmediateReference(value, ref) ? ref :
+            SharedWrap<JSValue>::New(JSValue::New(ctxt, value));
+    };
+
+    objThis = reference(info.This());
 
-    argsArr = env->NewLongArray(argumentCount);
+    bool cached = s_callback_depth == 0 && argumentCount <= kMaxCachedArity;
+    if (cached) {
+        if (!m_args_cache[argumentCount]) {
+            jlongArray local = env->NewLongArray(argumentCount);
+            m_args_cache[argumentCount] = (jlongArray) env->NewGlobalRef(local);
+            env->DeleteLocalRef(local);
+        }
+        argsArr = m_args_cache[argumentCount];
+    } else {
+        argsArr = env->NewLongArray(argumentCount);
+    }
     for (int i=0; i<argumentCount; i++) {
-        args[i] = SharedWrap<JSValue>::New(JSValue::New(ctxt, info[i]));
+        args[i] = reference(info[i]);
     }
     env->SetLongArrayRegion(argsArr,0,argumentCount,args);
 
+    s_callback_depth ++;
+
     clearException();
     if (isConstructCall) {
         env->CallVoidMethod(m_JavaThis, m_constructorMid, objThis, argsArr);
         info.GetReturnValue().Set(info.This());
     } else {
         jlong retval = env->CallLongMethod(m_JavaThis, m_functionMid, objThis, argsArr);
-        info.GetReturnValue().Set(
-                SharedWrap<JSValue>::Shared(ctxt, retval)->Value()
+        info.GetReturnValue().Set(ISPOINTER(retval) ?
+                SharedWrap<JSValue>::Shared(ctxt, retval)->Value() :
+                ImmediateValue(isolate, retval)
         );
     }
 
-    env->DeleteLocalRef(argsArr);
+    s_callback_depth --;
+    if (!cached) {
+        env->DeleteLocalRef(argsArr);
+    }
 
     boost::shared_ptr<JSValue> exception = m_exception;
     if (exception) {
@@ -137,7 +196,288 @@ void JSFunction::FunctionCallback(const FunctionCallbackInfo< v8::Value > &info)
         isolate->ThrowException(excp);
     }
 
-    if (getEnvStat == JNI_EDETACHED) {
+    if (detach) {
         m_jvm->DetachCurrentThread();
     }
 }
+
+/*
+ * Typed callbacks
+ *
+ * Each supported return type has a thunk of its own, so that the call into Java and the
+ * conversion of its result are fixed at compile time.  Arguments are converted straight from
+ * V8 into a jvalue array.
+ */
+
+#define JAVA_STRING "Ljava/lang/String;"
+
+bool JSFunction::ParseSignature(const char *signature)
+{
+    auto type = [](const char *&p, char& out) -> bool {
+        if (*p && strchr("ZBCSIJFD", *p)) {
+            out = *p++;
+            return true;
+        }
+        if (!strncmp(p, JAVA_STRING, sizeof(JAVA_STRING) - 1)) {
+            out = 'L';
+            p += sizeof(JAVA_STRING) - 1;
+            return true;
+        }
+        return false;
+    };
+
+    const char *p = signature;
+    if (*p++ != '(') return false;
+    m_argTypes.clear();
+    while (*p != ')') {
+        char arg;
+        if (!type(p, arg)) return false;
+        m_argTypes.push_back(arg);
+    }
+    p++;
+    if (*p == 'V') {
+        m_returnType = *p++;
+    } else if (!type(p, m_returnType)) {
+        return false;
+    }
+    return *p == '\0';
+}
+
+bool JSFunction::TypedArguments(JNIEnv *env, const FunctionCallbackInfo< v8::Value > &info,
+                                jvalue *args)
+{
+    Isolate *isolate = info.GetIsolate();
+    Local<v8::Context> context = isolate->GetCurrentContext();
+    for (size_t i=0; i<m_argTypes.size(); i++) {
+        Local<v8::Value> arg = i < (size_t) info.Length() ? info[(int)i] :
+            Local<v8::Value>::Cast(Undefined(isolate));
+        switch (m_argTypes[i]) {
+            case 'Z': {
+                Maybe<bool> v = arg->BooleanValue(context);
+                if (v.IsNothing()) return false;
+                args[i].z = (jboolean) v.FromJust();
+                break;
+            }
+            case 'B': case 'C': case 'S': case 'I': {
+                Maybe<int32_t> v = arg->Int32Value(context);
+                if (v.IsNothing()) return false;
+                switch (m_argTypes[i]) {
+                    case 'B': args[i].b = (jbyte) v.FromJust(); break;
+                    case 'C': args[i].c = (jchar) v.FromJust(); break;
+                    case 'S': args[i].s = (jshort) v.FromJust(); break;
+                    default:  args[i].i = (jint) v.FromJust(); break;
+                }
+                break;
+            }
+            case 'J': {
+                Maybe<int64_t> v = arg->IntegerValue(context);
+                if (v.IsNothing()) return false;
+                args[i].j = (jlong) v.FromJust();
+                break;
+            }
+            case 'F': case 'D': {
+                Maybe<double> v = arg->NumberValue(context);
+                if (v.IsNothing()) return false;
+                if (m_argTypes[i] == 'F') args[i].f = (jfloat) v.FromJust();
+                else args[i].d = v.FromJust();
+                break;
+            }
+            case 'L': {
+                if (arg->IsNull()) {
+                    args[i].l = nullptr;
+                    break;
+                }
+                Local<String> string;
+                if (!arg->ToString(context).ToLocal(&string)) return false;
+                String::Value chars(string);
+                args[i].l = env->NewString(reinterpret_cast<const jchar*>(*chars), chars.length());
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+void JSFunction::TypedException(JNIEnv *env, Isolate *isolate)
+{
+    if (env->ExceptionCheck()) {
+        // Not caught on the Java side; pass on what it says
+        jthrowable throwable = env->ExceptionOccurred();
+        env->ExceptionClear();
+        std::string message = "Java exception in callback";
+        jmethodID mid = findMethod(env, throwable, "toString", "()Ljava/lang/String;");
+        auto description = mid ? (jstring) env->CallObjectMethod(throwable, mid) : nullptr;
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+        } else if (description) {
+            const char *c_string = env->GetStringUTFChars(description, nullptr);
+            message = c_string;
+            env->ReleaseStringUTFChars(description, c_string);
+        }
+        if (description) env->DeleteLocalRef(description);
+        env->DeleteLocalRef(throwable);
+        m_exception = boost::shared_ptr<JSValue>();
+        isolate->ThrowException(Exception::Error(
+            String::NewFromUtf8(isolate, message.c_str(), NewStringType::kNormal).ToLocalChecked()));
+        return;
+    }
+
+    boost::shared_ptr<JSValue> exception = m_exception;
+    if (exception) {
+        isolate->ThrowException(exception->Value());
+    }
+}
+
+namespace {
+
+// Calls the Java method and sets its result as the return value
+template <typename R> struct TypedReturn;
+
+template <> struct TypedReturn<void> {
+    static void Call(JNIEnv *env, jobject obj, jmethodID mid, const jvalue *args,
+                     const FunctionCallbackInfo< v8::Value > &/*info*/)
+    {
+        env->CallVoidMethodA(obj, mid, args);
+    }
+};
+
+template <> struct TypedReturn<jboolean> {
+    static void Call(JNIEnv *env, jobject obj, jmethodID mid, const jvalue *args,
+                     const FunctionCallbackInfo< v8::Value > &info)
+    {
+        info.GetReturnValue().Set(env->CallBooleanMethodA(obj, mid, args) == JNI_TRUE);
+    }
+};
+
+template <> struct TypedReturn<jint> {
+    static void Call(JNIEnv *env, jobject obj, jmethodID mid, const jvalue *args,
+                     const FunctionCallbackInfo< v8::Value > &info)
+    {
+        info.GetReturnValue().Set((int32_t) env->CallIntMethodA(obj, mid, args));
+    }
+};
+
+template <> struct TypedReturn<jbyte> {
+    static void Call(JNIEnv *env, jobject obj, jmethodID mid, const jvalue *args,
+                     const FunctionCallbackInfo< v8::Value > &info)
+    {
+        info.GetReturnValue().Set((int32_t) env->CallByteMethodA(obj, mid, args));
+    }
+};
+
+template <> struct TypedReturn<jchar> {
+    static void Call(JNIEnv *env, jobject obj, jmethodID mid, const jvalue *args,
+                     const FunctionCallbackInfo< v8::Value > &info)
+    {
+        info.GetReturnValue().Set((uint32_t) env->CallCharMethodA(obj, mid, args));
+    }
+};
+
+template <> struct TypedReturn<jshort> {
+    static void Call(JNIEnv *env, jobject obj, jmethodID mid, const jvalue *args,
+                     const FunctionCallbackInfo< v8::Value > &info)
+    {
+        info.GetReturnValue().Set((int32_t) env->CallShortMethodA(obj, mid, args));
+    }
+};
+
+template <> struct TypedReturn<jlong> {
+    static void Call(JNIEnv *env, jobject obj, jmethodID mid, const jvalue *args,
+                     const FunctionCallbackInfo< v8::Value > &info)
+    {
+        info.GetReturnValue().Set((double) env->CallLongMethodA(obj, mid, args));
+    }
+};
+
+template <> struct TypedReturn<jfloat> {
+    static void Call(JNIEnv *env, jobject obj, jmethodID mid, const jvalue *args,
+                     const FunctionCallbackInfo< v8::Value > &info)
+    {
+        info.GetReturnValue().Set((double) env->CallFloatMethodA(obj, mid, args));
+    }
+};
+
+template <> struct TypedReturn<jdouble> {
+    static void Call(JNIEnv *env, jobject obj, jmethodID mid, const jvalue *args,
+                     const FunctionCallbackInfo< v8::Value > &info)
+    {
+        info.GetReturnValue().Set(env->CallDoubleMethodA(obj, mid, args));
+    }
+};
+
+template <> struct TypedReturn<jstring> {
+    static void Call(JNIEnv *env, jobject obj, jmethodID mid, const jvalue *args,
+                     const FunctionCallbackInfo< v8::Value > &info)
+    {
+        auto string = (jstring) env->CallObjectMethodA(obj, mid, args);
+        if (string == nullptr) {
+            info.GetReturnValue().SetNull();
+            return;
+        }
+        const jchar *chars = env->GetStringChars(string, nullptr);
+        info.GetReturnValue().Set(String::NewFromTwoByte(info.GetIsolate(),
+            reinterpret_cast<const uint16_t*>(chars), NewStringType::kNormal,
+            env->GetStringLength(string)).ToLocalChecked());
+        env->ReleaseStringChars(string, chars);
+        env->DeleteLocalRef(string);
+    }
+};
+
+} /* namespace */
+
+template <typename R>
+void JSFunction::TypedFunctionCallback(const FunctionCallbackInfo< v8::Value > &info)
+{
+    TRACE_SPAN("JSFunction typed callback");
+    Isolate *isolate = info.GetIsolate();
+    Isolate::Scope isolate_scope_(isolate);
+    HandleScope handle_scope_(isolate);
+
+    auto this_ = static_cast<JSFunction*>(Unwrap(info.Data()));
+    boost::shared_ptr<JSContext> ctxt = this_->m_context;
+    Context::Scope context_scope_(ctxt->Value());
+
+    bool detach;
+    JNIEnv *env = threadEnv(this_->m_jvm, detach);
+
+    const size_t argc = this_->m_argTypes.size();
+    jvalue args[argc + 1];
+    memset(args, 0, sizeof(args));
+
+    if (this_->TypedArguments(env, info, args)) {
+        this_->clearException();
+        TypedReturn<R>::Call(env, this_->m_JavaThis, this_->m_typedMid, args, info);
+        if (info.IsConstructCall()) {
+            info.GetReturnValue().Set(info.This());
+        }
+        this_->TypedException(env, isolate);
+    }
+
+    for (size_t i=0; i<argc; i++) {
+        if (this_->m_argTypes[i] == 'L' && args[i].l) {
+            env->DeleteLocalRef(args[i].l);
+        }
+    }
+
+    if (detach) {
+        this_->m_jvm->DetachCurrentThread();
+    }
+}
+
+v8::FunctionCallback JSFunction::TypedCallbackFor(char returnType)
+{
+    switch (returnType) {
+        case 'Z': return TypedFunctionCallback<jboolean>;
+        case 'B': return TypedFunctionCallback<jbyte>;
+        case 'C': return TypedFunctionCallback<jchar>;
+        case 'S': return TypedFunctionCallback<jshort>;
+        case 'I': return TypedFunctionCallback<jint>;
+        case 'J': return TypedFunctionCallback<jlong>;
+        case 'F': return TypedFunctionCallback<jfloat>;
+        case 'D': return TypedFunctionCallback<jdouble>;
+        case 'L': return TypedFunctionCallback<jstring>;
+        default:  return TypedFunctionCallback<void>;
+    }
+}
@@ -7,13 +7,21 @@
 #ifndef LIQUIDCORE_JSFUNCTION_H
 #define LIQUIDCORE_JSFUNCTION_H
 
+#include <string>
 #include "Common/Common.h"
 
 using namespace v8;
 
 class JSFunction : public JSValue {
 public:
-    JSFunction(JNIEnv* env, jobject thiz, boost::shared_ptr<JSContext> ctx, jstring name_);
+    /*
+     * With |method_| set, calls from JS go straight to that method of |thiz|, whose JNI
+     * |signature_| may only use primitive and String types, e.g. "(DD)D" or
+     * "(Ljava/lang/String;I)V".  Arguments are converted as JS would (ToNumber, ToString, ...)
+     * and no JSValue is made for them or the result.
+     */
+    JSFunction(JNIEnv* env, jobject thiz, boost::shared_ptr<JSContext> ctx, jstring name_,
+               jstring method_ = nullptr, jstring signature_ = nullptr);
     virtual ~JSFunction();
 
     void setException(boost::shared_ptr<JSValue> exception)
@@ -21,21 +29,43 @@ public:
         m_exception = exception;
     }
 
-    static boost::shared_ptr<JSValue> New(JNIEnv* env, jobject thiz, jlong javaContext, jstring name_);
+    static boost::shared_ptr<JSValue> New(JNIEnv* env, jobject thiz, jlong javaContext, jstring name_,
+                                          jstring method_ = nullptr, jstring signature_ = nullptr);
 
 private:
     static void StaticFunctionCallback(const FunctionCallbackInfo< v8::Value > &info);
     virtual void FunctionCallback(const FunctionCallbackInfo< v8::Value > &info);
+    template <typename R>
+    static void TypedFunctionCallback(const FunctionCallbackInfo< v8::Value > &info);
+    static v8::FunctionCallback TypedCallbackFor(char returnType);
+    bool ParseSignature(const char *signature);
+    bool TypedArguments(JNIEnv *env, const FunctionCallbackInfo< v8::Value > &info, jvalue *args);
+    void TypedException(JNIEnv *env, Isolate *isolate);
 
     void clearException()
     {
         m_exception = boost::shared_ptr<JSValue>();
     }
+    // Lets go of the Java callback object and the cached argument arrays; safe to call twice
+    void ReleaseJavaRefs();
+
+    /*
+     * Argument arrays for small arities are allocated once and reused.  Only the outermost
+     * callback on a thread uses them, since a nested call would overwrite the arguments of a
+     * Java callback that is still running.
+     */
+    static const int kMaxCachedArity = 8;
 
     JavaVM *m_jvm;
     jobject m_JavaThis;
+    jlongArray m_args_cache[kMaxCachedArity + 1] = { nullptr };
+    // Lets go of the references above if the group is disposed before this is
+    boost::shared_ptr<nodedroid::ExternalRegistry> m_externals;
     jmethodID m_constructorMid;
     jmethodID m_functionMid;
+    jmethodID m_typedMid;
+    std::string m_argTypes;  // one JNI type char per argument, 'L' for String
+    char m_returnType;
     boost::atomic_shared_ptr<JSValue> m_exception;
 };
 
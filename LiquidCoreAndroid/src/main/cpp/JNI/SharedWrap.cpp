@@ -12,8 +12,14 @@ static volatile bool stop = false;
 void SharedWrapBase::FreeZombiesThread()
 {
     while(!stop) {
-        auto wrap = s_zombies.pop();
-        delete wrap;
+        // Take everything finalized since the last pass, so that each group is handed its
+        // zombies as one batch rather than one at a time
+        auto wraps = s_zombies.pop_all();
+        ContextGroup::BeginZombieBatch();
+        for (auto it = wraps.begin(); it != wraps.end(); ++it) {
+            delete *it;
+        }
+        ContextGroup::EndZombieBatch();
     };
 }
 
@@ -23,6 +23,18 @@ class Queue
 {
     public:
 
+    std::deque<T> pop_all()
+    {
+        std::unique_lock<std::mutex> mlock(mutex_);
+        while (queue_.empty())
+        {
+            cond_.wait(mlock);
+        }
+        std::deque<T> items;
+        items.swap(queue_);
+        return items;
+    }
+
     T pop()
     {
         std::unique_lock<std::mutex> mlock(mutex_);
@@ -52,6 +64,7 @@ class Queue
 class SharedWrapBase {
 public:
     SharedWrapBase() = default;
+    virtual ~SharedWrapBase() = default;
     static Queue<SharedWrapBase*> s_zombies;
     static void FreeZombiesThread();
 };
@@ -87,24 +100,26 @@ public:
     }
 
 protected:
-    ~SharedWrap()
+    virtual ~SharedWrap()
     {
         boost::shared_ptr<T> shared = m_shared;
         if (shared) {
-            if (shared->Group()->Loop() != nullptr && !shared->IsDefunct()) {
-                shared->Group()->MarkZombie(shared);
+            // Some (AsyncTicket) only hold their group weakly, and may have outlived it
+            boost::shared_ptr<ContextGroup> group = shared->Group();
+            if (group && group->Loop() != nullptr && !shared->IsDefunct()) {
+                group->MarkZombie(shared);
             }
             shared.reset();
         }
     }
 
 private:
-    explicit SharedWrap(boost::shared_ptr<T> shared)
+    explicit SharedWrap(boost::shared_ptr<T> shared) : m_shared(shared)
     {
-        m_shared = shared;
     };
 
-    boost::atomic_shared_ptr<T> m_shared;
+    // Set once at construction and never reassigned, so concurrent copies need no atomics
+    const boost::shared_ptr<T> m_shared;
 };
 
 /*
@@ -136,13 +151,64 @@ private:
 #define TOSHAREDWRAP(x) (reinterpret_cast<SharedWrap<JSValue>*>(((unsigned long)(x)&~0x3UL)))
 #define ISPOINTER(x) (((unsigned long)(x)&0x1UL)==0x1UL)
 #define ISODDBALL(x) (((unsigned long)(x)&0x3UL)==0x2UL)
+#define ISOBJPTR(x) (((unsigned long)(x)&0x3UL)==0x3UL)
+
+/*
+ * Encodes undefined, null, booleans and doubles that fit the format above straight from a V8
+ * value, without creating a JSValue.  Returns false if the value needs a real reference.
+ */
+inline bool ImmediateReference(Local<v8::Value> value, jlong& reference)
+{
+    if (value->IsUndefined()) {
+        reference = ODDBALL_UNDEFINED;
+    } else if (value->IsNull()) {
+        reference = ODDBALL_NULL;
+    } else if (value->IsBoolean()) {
+        reference = value->IsTrue() ? ODDBALL_TRUE : ODDBALL_FALSE;
+    } else if (value->IsNumber()) {
+        double v = value.As<Number>()->Value();
+        auto pv = (jlong *) &v;
+        if (!CANPRIMITIVE(*pv)) return false;
+        reference = *pv;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * The reverse of ImmediateReference().  'reference' must not be a pointer.
+ */
+inline Local<v8::Value> ImmediateValue(Isolate *isolate, jlong reference)
+{
+    if (ISODDBALL(reference)) {
+        switch (reference) {
+            case ODDBALL_FALSE:     return False(isolate);
+            case ODDBALL_TRUE:      return True (isolate);
+            case ODDBALL_NULL:      return Null(isolate);
+            default:                return Undefined(isolate);
+        }
+    }
+    double dval = * (double *) &reference;
+    return Number::New(isolate, dval);
+}
 
 template<>
 inline jlong SharedWrap<JSValue>::New(const boost::shared_ptr<JSValue>& shared) {
     if (!shared) return 0L;
     if (shared->IsObject()) {
-        auto thiz = new SharedWrap<JSValue>(shared);
-        return TOOBJPTR(thiz);
+        boost::shared_ptr<JSContext> context = shared->Context();
+        if (!context) {
+            return TOOBJPTR(new SharedWrap<JSValue>(shared));
+        }
+        // Hand out the reference Java already has, if it has one
+        JavaReferences& references = context->References();
+        std::lock_guard<std::mutex> lock(references.mutex);
+        auto& entry = references.map[&* shared];
+        if (entry.second++ == 0) {
+            entry.first = TOOBJPTR(new SharedWrap<JSValue>(shared));
+        }
+        return entry.first;
     } else {
         jlong reference =
                 (shared->IsUndefined()) ? ODDBALL_UNDEFINED :
@@ -175,28 +241,25 @@ inline boost::shared_ptr<JSValue> SharedWrap<JSValue>::Shared(const boost::share
     Isolate::Scope isolate_scope_(Isolate::GetCurrent());
     HandleScope handle_scope_(Isolate::GetCurrent());
 
-    Local<v8::Value> value;
-
-    if (ISODDBALL(thiz)) {
-        switch (thiz) {
-            case ODDBALL_FALSE:     value = False(Isolate::GetCurrent()); break;
-            case ODDBALL_TRUE:      value = True (Isolate::GetCurrent()); break;
-            case ODDBALL_UNDEFINED: value = Undefined(Isolate::GetCurrent()); break;
-            case ODDBALL_NULL:      value = Null(Isolate::GetCurrent());; break;
-            default: break;
-        }
-    } else {
-        double dval = * (double *) &thiz;
-        value = Number::New(Isolate::GetCurrent(), dval);
-    }
-
-    return JSValue::New(context, value);
+    return JSValue::New(context, ImmediateValue(Isolate::GetCurrent(), thiz));
 }
 template<>
 inline void SharedWrap<JSValue>::Dispose(jlong reference)
 {
     if (ISPOINTER(reference)) {
         auto wrap = TOSHAREDWRAP(reference);
+        boost::shared_ptr<JSContext> context =
+            ISOBJPTR(reference) ? wrap->m_shared->Context() : boost::shared_ptr<JSContext>();
+        if (context) {
+            // Only the last Java holder of a shared reference lets go of the wrap
+            JavaReferences& references = context->References();
+            std::lock_guard<std::mutex> lock(references.mutex);
+            auto found = references.map.find(&* wrap->m_shared);
+            if (found != references.map.end() && found->second.first == reference) {
+                if (--found->second.second > 0) return;
+                references.map.erase(found);
+            }
+        }
         s_zombies.push(wrap);
     } else {
         __android_log_assert("FAIL", "SharedWrap<JSValue>::~", "Attempting to dispose a primitive");
@@ -7,6 +7,7 @@
 #ifndef LIQUIDCORE_JSCRETAINER_H
 #define LIQUIDCORE_JSCRETAINER_H
 
+#include <atomic>
 #include "Common/Common.h"
 #include "JSC/Macros.h"
 
@@ -25,7 +26,7 @@ public:
         }
     }
 protected:
-    int m_count;
+    std::atomic<int> m_count;
 };
 
 #endif //LIQUIDCORE_JSCRETAINER_H
@@ -6,6 +6,7 @@
  */
 #include <boost/make_shared.hpp>
 #include "JSC/JSC.h"
+#include "JavaScriptCore/JSContextRefBatch.h"
 
 class GlobalContextGroup : public OpaqueJSContextGroup
 {
@@ -151,3 +152,50 @@ JS_EXPORT void JSGlobalContextSetName(JSGlobalContextRef ctx, JSStringRef name)
         }
     V8_UNLOCK()
 }
+
+
+/*
+ * A batch holds the outermost Locker and scopes for its context.  The per-call macros still
+ * construct their own, but with the isolate already locked and entered by this thread those
+ * are only nesting checks, and the lock handoff and thread state restore happen once per batch.
+ */
+class ContextBatch {
+    public:
+        ContextBatch(boost::shared_ptr<JSContext> context) :
+            m_context(context),
+            m_locker(context->isolate()),
+            m_isolate_scope(context->isolate()),
+            m_handle_scope(context->isolate()),
+            m_context_scope(context->Value())
+        {
+        }
+
+    private:
+        boost::shared_ptr<JSContext> m_context;
+        v8::Locker m_locker;
+        Isolate::Scope m_isolate_scope;
+        HandleScope m_handle_scope;
+        v8::Context::Scope m_context_scope;
+};
+
+static thread_local std::vector<std::pair<JSContextRef, ContextBatch*>> s_batches;
+
+JS_EXPORT void JSContextBeginBatch(JSContextRef ctx)
+{
+    boost::shared_ptr<JSContext> context = ctx->Context();
+    boost::shared_ptr<ContextGroup> group = context->Group();
+
+    ContextBatch *batch = nullptr;
+    if (!group->Loop() || std::this_thread::get_id() == group->Thread()) {
+        batch = new ContextBatch(context);
+    }
+    s_batches.push_back(std::make_pair(ctx, batch));
+}
+
+JS_EXPORT void JSContextEndBatch(JSContextRef ctx)
+{
+    ASSERTJSC(!s_batches.empty() && s_batches.back().first == ctx);
+
+    delete s_batches.back().second;
+    s_batches.pop_back();
+}
@@ -5,6 +5,7 @@
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
 #include "JSC/JSC.h"
+#include "JavaScriptCore/JSContextGroupRefFinalizer.h"
 
 JS_EXPORT JSContextGroupRef JSContextGroupCreate()
 {
@@ -21,3 +22,9 @@ JS_EXPORT void JSContextGroupRelease(JSContextGroupRef group)
 {
     const_cast<OpaqueJSContextGroup*>(group)->Release();
 }
+
+
+JS_EXPORT void JSContextGroupSetFinalizerBudget(JSContextGroupRef group, unsigned budget)
+{
+    const_cast<OpaqueJSContextGroup*>(group)->SetFinalizerBudget(budget);
+}
@@ -42,7 +42,7 @@ JS_EXPORT JSObjectRef JSObjectMake(JSContextRef ctx, JSClassRef jsClass, void* d
         if (jsClass) {
             Local<Value> payload;
             Local<ObjectTemplate> templ;
-            jsClass->NewTemplate(context, &payload, &templ);
+            jsClass->NewTemplate(ctx, &payload, &templ);
             Local<Object> instance = templ->NewInstance(context).ToLocalChecked();
             value = jsClass->InitInstance(ctx, instance, payload, data);
         } else {
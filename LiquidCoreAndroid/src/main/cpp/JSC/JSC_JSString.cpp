@@ -13,7 +13,7 @@ JS_EXPORT JSStringRef JSStringCreateWithCharacters(const JSChar* chars, size_t n
 
 JS_EXPORT JSStringRef JSStringCreateWithUTF8CString(const char* chars)
 {
-    return &* OpaqueJSString::New(chars);
+    return &* OpaqueJSString::Intern(chars);
 }
 
 JS_EXPORT JSStringRef JSStringRetain(JSStringRef string)
@@ -44,10 +44,7 @@ JS_EXPORT size_t JSStringGetMaximumUTF8CStringSize(JSStringRef string)
 
 JS_EXPORT size_t JSStringGetUTF8CString(JSStringRef string, char* buffer, size_t bufferSize)
 {
-    std::string utf8str;
-    string->Utf8String(utf8str);
-    strncpy(buffer, utf8str.c_str(), bufferSize);
-    return strlen(buffer);
+    return string->Utf8String(buffer, bufferSize);
 }
 
 JS_EXPORT bool JSStringIsEqual(JSStringRef a, JSStringRef b)
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include "JSC/Macros.h"
+#include "JSC/JSC.h"
+#include "JSC/TempException.h"
+#include "JavaScriptCore/JSTypedArray.h"
+
+/*
+ * Typed arrays and array buffers map straight onto V8's.  V8 never moves a backing store once
+ * it is off the heap, so the pointers handed out stay good for the life of the buffer; small
+ * arrays V8 keeps on the heap are moved off it the first time their buffer is asked for.
+ */
+
+static size_t ElementSize(JSTypedArrayType type)
+{
+    switch (type) {
+        case kJSTypedArrayTypeInt8Array:
+        case kJSTypedArrayTypeUint8Array:
+        case kJSTypedArrayTypeUint8ClampedArray:    return 1;
+        case kJSTypedArrayTypeInt16Array:
+        case kJSTypedArrayTypeUint16Array:          return 2;
+        case kJSTypedArrayTypeInt32Array:
+        case kJSTypedArrayTypeUint32Array:
+        case kJSTypedArrayTypeFloat32Array:         return 4;
+        case kJSTypedArrayTypeFloat64Array:         return 8;
+        default:                                    return 0;
+    }
+}
+
+static Local<Value> NewTypedArray(JSTypedArrayType type, Local<ArrayBuffer> buffer,
+    size_t byteOffset, size_t length)
+{
+    switch (type) {
+        case kJSTypedArrayTypeInt8Array:
+            return Int8Array::New(buffer, byteOffset, length);
+        case kJSTypedArrayTypeInt16Array:
+            return Int16Array::New(buffer, byteOffset, length);
+        case kJSTypedArrayTypeInt32Array:
+            return Int32Array::New(buffer, byteOffset, length);
+        case kJSTypedArrayTypeUint8Array:
+            return Uint8Array::New(buffer, byteOffset, length);
+        case kJSTypedArrayTypeUint8ClampedArray:
+            return Uint8ClampedArray::New(buffer, byteOffset, length);
+        case kJSTypedArrayTypeUint16Array:
+            return Uint16Array::New(buffer, byteOffset, length);
+        case kJSTypedArrayTypeUint32Array:
+            return Uint32Array::New(buffer, byteOffset, length);
+        case kJSTypedArrayTypeFloat32Array:
+            return Float32Array::New(buffer, byteOffset, length);
+        case kJSTypedArrayTypeFloat64Array:
+            return Float64Array::New(buffer, byteOffset, length);
+        default:
+            return Local<Value>();
+    }
+}
+
+static void RangeError(Isolate *isolate, JSContextRef ctx, TempException& exception,
+    const char *message)
+{
+    exception.Set(ctx, Exception::RangeError(String::NewFromUtf8(isolate, message)));
+}
+
+/*
+ * Hands memory passed in by the embedder back to its deallocator once the buffer over it
+ * is collected
+ */
+struct NoCopyBacking {
+    UniquePersistent<ArrayBuffer> weak;
+    void *bytes;
+    JSTypedArrayBytesDeallocator deallocator;
+    void *deallocatorContext;
+};
+
+static void NoCopyBackingReleased(const WeakCallbackInfo<NoCopyBacking>& info)
+{
+    NoCopyBacking *backing = info.GetParameter();
+    if (backing->deallocator) {
+        backing->deallocator(backing->bytes, backing->deallocatorContext);
+    }
+    delete backing;
+}
+
+static Local<ArrayBuffer> NoCopyBuffer(Isolate *isolate, void* bytes, size_t byteLength,
+    JSTypedArrayBytesDeallocator bytesDeallocator, void* deallocatorContext)
+{
+    Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, bytes, byteLength,
+                                                 ArrayBufferCreationMode::kExternalized);
+    auto backing = new NoCopyBacking();
+    backing->bytes = bytes;
+    backing->deallocator = bytesDeallocator;
+    backing->deallocatorContext = deallocatorContext;
+    backing->weak = UniquePersistent<ArrayBuffer>(isolate, buffer);
+    backing->weak.SetWeak<NoCopyBacking>(
+        backing,
+        [](const WeakCallbackInfo<NoCopyBacking>& info) {
+            // The deallocator may do anything, so give it the second pass
+            info.GetParameter()->weak.Reset();
+            info.SetSecondPassCallback(NoCopyBackingReleased);
+        }, v8::WeakCallbackType::kParameter);
+    return buffer;
+}
+
+JS_EXPORT JSObjectRef JSObjectMakeTypedArray(JSContextRef ctx, JSTypedArrayType arrayType,
+    size_t length, JSValueRef* exceptionRef)
+{
+    size_t elementSize = ElementSize(arrayType);
+    if (!elementSize) return nullptr;
+
+    JSObjectRef out = nullptr;
+    V8_ISOLATE_CTX(CTX(ctx),isolate,context)
+        TempException exception(exceptionRef);
+        if (length > (size_t) INT32_MAX / elementSize) {
+            RangeError(isolate, ctx, exception, "Invalid typed array length");
+        } else {
+            // Comes zeroed from the group's allocator
+            Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, length * elementSize);
+            out = const_cast<JSObjectRef>(OpaqueJSValue::New(ctx,
+                NewTypedArray(arrayType, buffer, 0, length)));
+        }
+    V8_UNLOCK()
+
+    return out;
+}
+
+JS_EXPORT JSObjectRef JSObjectMakeTypedArrayWithBytesNoCopy(JSContextRef ctx,
+    JSTypedArrayType arrayType, void* bytes, size_t byteLength,
+    JSTypedArrayBytesDeallocator bytesDeallocator, void* deallocatorContext,
+    JSValueRef* exceptionRef)
+{
+    size_t elementSize = ElementSize(arrayType);
+    if (!elementSize) return nullptr;
+
+    JSObjectRef out = nullptr;
+    V8_ISOLATE_CTX(CTX(ctx),isolate,context)
+        TempException exception(exceptionRef);
+        if (byteLength % elementSize || byteLength > (size_t) INT32_MAX) {
+            RangeError(isolate, ctx, exception, "Invalid typed array length");
+            if (bytesDeallocator) bytesDeallocator(bytes, deallocatorContext);
+        } else {
+            Local<ArrayBuffer> buffer = NoCopyBuffer(isolate, bytes, byteLength,
+                                                     bytesDeallocator, deallocatorContext);
+            out = const_cast<JSObjectRef>(OpaqueJSValue::New(ctx,
+                NewTypedArray(arrayType, buffer, 0, byteLength / elementSize)));
+        }
+    V8_UNLOCK()
+
+    return out;
+}
+
+JS_EXPORT JSObjectRef JSObjectMakeTypedArrayWithArrayBufferAndOffset(JSContextRef ctx,
+    JSTypedArrayType arrayType, JSObjectRef bufferRef, size_t byteOffset, size_t length,
+    JSValueRef* exceptionRef)
+{
+    size_t elementSize = ElementSize(arrayType);
+    if (!elementSize || !bufferRef) return nullptr;
+
+    JSObjectRef out = nullptr;
+    VALUE_ISOLATE(CTX(ctx),bufferRef,isolate,context,value)
+        TempException exception(exceptionRef);
+        if (!value->IsArrayBuffer()) {
+            exception.Set(ctx, Exception::TypeError(
+                String::NewFromUtf8(isolate, "Argument is not an ArrayBuffer")));
+        } else {
+            Local<ArrayBuffer> buffer = value.As<ArrayBuffer>();
+            size_t bufferLength = buffer->ByteLength();
+            // V8 asserts on these rather than throwing
+            if (byteOffset % elementSize) {
+                RangeError(isolate, ctx, exception,
+                           "Start offset of typed array should be a multiple of its element size");
+            } else if (byteOffset > bufferLength ||
+                       length > (bufferLength - byteOffset) / elementSize) {
+                RangeError(isolate, ctx, exception, "Invalid typed array length");
+            } else {
+                out = const_cast<JSObjectRef>(OpaqueJSValue::New(ctx,
+                    NewTypedArray(arrayType, buffer, byteOffset, length)));
+            }
+        }
+    V8_UNLOCK()
+
+    return out;
+}
+
+JS_EXPORT JSObjectRef JSObjectMakeTypedArrayWithArrayBuffer(JSContextRef ctx,
+    JSTypedArrayType arrayType, JSObjectRef bufferRef, JSValueRef* exceptionRef)
+{
+    size_t elementSize = ElementSize(arrayType);
+    if (!elementSize || !bufferRef) return nullptr;
+
+    size_t byteLength = JSObjectGetArrayBufferByteLength(ctx, bufferRef, nullptr);
+    return JSObjectMakeTypedArrayWithArrayBufferAndOffset(ctx, arrayType, bufferRef, 0,
+        byteLength / elementSize, exceptionRef);
+}
+
+JS_EXPORT void* JSObjectGetTypedArrayBytesPtr(JSContextRef ctx, JSObjectRef object,
+    JSValueRef* )
+{
+    if (!object) return nullptr;
+    void *bytes = nullptr;
+
+    VALUE_ISOLATE(CTX(ctx),object,isolate,context,value)
+        if (value->IsTypedArray()) {
+            Local<TypedArray> array = value.As<TypedArray>();
+            bytes = (unsigned char *) array->Buffer()->GetContents().Data() + array->ByteOffset();
+        }
+    V8_UNLOCK()
+
+    return bytes;
+}
+
+JS_EXPORT size_t JSObjectGetTypedArrayLength(JSContextRef ctx, JSObjectRef object, JSValueRef* )
+{
+    if (!object) return 0;
+    size_t length = 0;
+
+    VALUE_ISOLATE(CTX(ctx),object,isolate,context,value)
+        if (value->IsTypedArray()) {
+            length = value.As<TypedArray>()->Length();
+        }
+    V8_UNLOCK()
+
+    return length;
+}
+
+JS_EXPORT size_t JSObjectGetTypedArrayByteLength(JSContextRef ctx, JSObjectRef object,
+    JSValueRef* )
+{
+    if (!object) return 0;
+    size_t length = 0;
+
+    VALUE_ISOLATE(CTX(ctx),object,isolate,context,value)
+        if (value->IsTypedArray()) {
+            length = value.As<TypedArray>()->ByteLength();
+        }
+    V8_UNLOCK()
+
+    return length;
+}
+
+JS_EXPORT size_t JSObjectGetTypedArrayByteOffset(JSContextRef ctx, JSObjectRef object,
+    JSValueRef* )
+{
+    if (!object) return 0;
+    size_t offset = 0;
+
+    VALUE_ISOLATE(CTX(ctx),object,isolate,context,value)
+        if (value->IsTypedArray()) {
+            offset = value.As<TypedArray>()->ByteOffset();
+        }
+    V8_UNLOCK()
+
+    return offset;
+}
+
+JS_EXPORT JSObjectRef JSObjectGetTypedArrayBuffer(JSContextRef ctx, JSObjectRef object,
+    JSValueRef* )
+{
+    if (!object) return nullptr;
+    JSObjectRef buffer = nullptr;
+
+    VALUE_ISOLATE(CTX(ctx),object,isolate,context,value)
+        if (value->IsTypedArray()) {
+            buffer = const_cast<JSObjectRef>(OpaqueJSValue::New(ctx,
+                value.As<TypedArray>()->Buffer()));
+        }
+    V8_UNLOCK()
+
+    return buffer;
+}
+
+JS_EXPORT JSObjectRef JSObjectMakeArrayBufferWithBytesNoCopy(JSContextRef ctx, void* bytes,
+    size_t byteLength, JSTypedArrayBytesDeallocator bytesDeallocator, void* deallocatorContext,
+    JSValueRef* )
+{
+    JSObjectRef out;
+
+    V8_ISOLATE_CTX(CTX(ctx),isolate,context)
+        out = const_cast<JSObjectRef>(OpaqueJSValue::New(ctx,
+            NoCopyBuffer(isolate, bytes, byteLength, bytesDeallocator, deallocatorContext)));
+    V8_UNLOCK()
+
+    return out;
+}
+
+JS_EXPORT void* JSObjectGetArrayBufferBytesPtr(JSContextRef ctx, JSObjectRef object,
+    JSValueRef* )
+{
+    if (!object) return nullptr;
+    void *bytes = nullptr;
+
+    VALUE_ISOLATE(CTX(ctx),object,isolate,context,value)
+        if (value->IsArrayBuffer()) {
+            bytes = value.As<ArrayBuffer>()->GetContents().Data();
+        }
+    V8_UNLOCK()
+
+    return bytes;
+}
+
+JS_EXPORT size_t JSObjectGetArrayBufferByteLength(JSContextRef ctx, JSObjectRef object,
+    JSValueRef* )
+{
+    if (!object) return 0;
+    size_t length = 0;
+
+    VALUE_ISOLATE(CTX(ctx),object,isolate,context,value)
+        if (value->IsArrayBuffer()) {
+            length = value.As<ArrayBuffer>()->ByteLength();
+        }
+    V8_UNLOCK()
+
+    return length;
+}
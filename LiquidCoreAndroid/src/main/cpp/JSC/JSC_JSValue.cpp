@@ -7,6 +7,7 @@
 #include "JSC/Macros.h"
 #include "JSC/JSC.h"
 #include "JSC/TempException.h"
+#include "JavaScriptCore/JSValueRefJSON.h"
 
 JS_EXPORT JSType JSValueGetType(JSContextRef ctxRef, JSValueRef valueRef)
 {
@@ -25,6 +26,29 @@ JS_EXPORT JSType JSValueGetType(JSContextRef ctxRef, JSValueRef valueRef)
     return type;
 }
 
+JS_EXPORT JSTypedArrayType JSValueGetTypedArrayType(JSContextRef ctxRef, JSValueRef valueRef,
+    JSValueRef* )
+{
+    if (!valueRef) return kJSTypedArrayTypeNone;
+
+    JSTypedArrayType type = kJSTypedArrayTypeNone;
+
+    VALUE_ISOLATE(CTX(ctxRef),valueRef,isolate,context,value)
+        if      (value->IsInt8Array())          type = kJSTypedArrayTypeInt8Array;
+        else if (value->IsInt16Array())         type = kJSTypedArrayTypeInt16Array;
+        else if (value->IsInt32Array())         type = kJSTypedArrayTypeInt32Array;
+        else if (value->IsUint8Array())         type = kJSTypedArrayTypeUint8Array;
+        else if (value->IsUint8ClampedArray())  type = kJSTypedArrayTypeUint8ClampedArray;
+        else if (value->IsUint16Array())        type = kJSTypedArrayTypeUint16Array;
+        else if (value->IsUint32Array())        type = kJSTypedArrayTypeUint32Array;
+        else if (value->IsFloat32Array())       type = kJSTypedArrayTypeFloat32Array;
+        else if (value->IsFloat64Array())       type = kJSTypedArrayTypeFloat64Array;
+        else if (value->IsArrayBuffer())        type = kJSTypedArrayTypeArrayBuffer;
+    V8_UNLOCK()
+
+    return type;
+}
+
 JS_EXPORT bool JSValueIsUndefined(JSContextRef ctxRef, JSValueRef valueRef)
 {
     if (!valueRef) return false;
@@ -291,6 +315,60 @@ JS_EXPORT JSValueRef JSValueMakeFromJSONString(JSContextRef ctx, JSStringRef str
     return value;
 }
 
+JS_EXPORT JSValueRef JSValueMakeFromJSONCharacters(JSContextRef ctx, const JSChar* chars,
+    size_t numChars)
+{
+    if (!chars) return nullptr;
+    JSValueRef value = nullptr;
+
+    V8_ISOLATE_CTX(CTX(ctx),isolate,context)
+        Local<String> string;
+        if (String::NewFromTwoByte(isolate, chars, NewStringType::kNormal, (int) numChars)
+                .ToLocal(&string)) {
+            TryCatch trycatch(isolate);
+            MaybeLocal<Value> parsed = JSON::Parse(context, string);
+            if (!parsed.IsEmpty())
+                value = &* OpaqueJSValue::New(ctx,parsed.ToLocalChecked());
+        }
+    V8_UNLOCK()
+
+    return value;
+}
+
+/* Must be called with the context entered.  Sets exception and returns an empty handle if the
+ * value cannot be serialized. */
+static MaybeLocal<String> Stringify(JSContextRef ctxRef, Local<Context> context,
+    Local<Value> inValue, unsigned indent, TempException& exception, bool reportUnserializable)
+{
+    Isolate *isolate = context->GetIsolate();
+    EscapableHandleScope scope(isolate);
+    TryCatch trycatch(isolate);
+
+    Local<Value> args[] = {
+        inValue,
+        Local<Value>::New(isolate,Null(isolate)),
+        Number::New(isolate, indent)
+    };
+
+    // FIXME: I don't understand why this hack works but will fail in a secondary context without
+    context->Global()->Get(context, String::NewFromUtf8(isolate, "JSON"));
+
+    Local<Object> json = context->Global()->Get(String::NewFromUtf8(isolate, "JSON"))->ToObject();
+    Local<Function> stringify = json->Get(String::NewFromUtf8(isolate, "stringify")).As<Function>();
+
+    MaybeLocal<Value> result = stringify->Call(context, json, 3, args);
+    if (result.IsEmpty()) {
+        exception.Set(ctxRef, trycatch.Exception());
+    } else if (!result.ToLocalChecked()->IsUndefined()) {
+        return scope.Escape(result.ToLocalChecked()->ToString(context).ToLocalChecked());
+    } else if (reportUnserializable) {
+        TempJSValue e(ctxRef, "Unserializable value");
+        JSValueRef args_[] = {*e};
+        exception.Set(JSObjectMakeError(ctxRef, 1, args_, nullptr));
+    }
+    return MaybeLocal<String>();
+}
+
 JS_EXPORT JSStringRef JSValueCreateJSONString(JSContextRef ctxRef, JSValueRef valueRef,
     unsigned indent, JSValueRef* exceptionRef)
 {
@@ -300,34 +378,45 @@ JS_EXPORT JSStringRef JSValueCreateJSONString(JSContextRef ctxRef, JSValueRef va
 
     VALUE_ISOLATE(CTX(ctxRef),valueRef,isolate,context,inValue)
         TempException exception(exceptionRef);
-        TryCatch trycatch(isolate);
 
-        Local<Value> args[] = {
-            inValue,
-            Local<Value>::New(isolate,Null(isolate)),
-            Number::New(isolate, indent)
-        };
+        Local<String> string;
+        if (Stringify(ctxRef, context, inValue, indent, exception, exceptionRef != nullptr)
+                .ToLocal(&string)) {
+            value = &* OpaqueJSString::New(string, CTX(ctxRef));
+        }
+    V8_UNLOCK()
 
-        // FIXME: I don't understand why this hack works but will fail in a secondary context without
-        context->Global()->Get(context, String::NewFromUtf8(isolate, "JSON"));
+    return value;
+}
 
-        Local<Object> json = context->Global()->Get(String::NewFromUtf8(isolate, "JSON"))->ToObject();
-        Local<Function> stringify = json->Get(String::NewFromUtf8(isolate, "stringify")).As<Function>();
+JS_EXPORT size_t JSValueCreateJSONStringInto(JSContextRef ctxRef, JSValueRef valueRef,
+    unsigned indent, JSChar* buffer, size_t capacity, JSValueRef* exceptionRef)
+{
+    static const JSChar null[] = { 'n', 'u', 'l', 'l' };
+    if (!valueRef) {
+        if (buffer) {
+            memcpy(buffer, null, std::min(capacity, sizeof null / sizeof null[0]) * sizeof(JSChar));
+        }
+        return sizeof null / sizeof null[0];
+    }
 
-        MaybeLocal<Value> result = stringify->Call(context, json, 3, args);
-        if (result.IsEmpty()) {
-            exception.Set(ctxRef, trycatch.Exception());
-        } else if (!result.ToLocalChecked()->IsUndefined()) {
-            Local<String> string = result.ToLocalChecked()->ToString(context).ToLocalChecked();
-            value = &* OpaqueJSString::New(string);
-        } else if (exceptionRef) {
-            TempJSValue e(ctxRef, "Unserializable value");
-            JSValueRef args_[] = {*e};
-            exception.Set(JSObjectMakeError(ctxRef, 1, args_, nullptr));
+    size_t length = 0;
+
+    VALUE_ISOLATE(CTX(ctxRef),valueRef,isolate,context,inValue)
+        TempException exception(exceptionRef);
+
+        Local<String> string;
+        if (Stringify(ctxRef, context, inValue, indent, exception, exceptionRef != nullptr)
+                .ToLocal(&string)) {
+            length = (size_t) string->Length();
+            size_t count = std::min(length, capacity);
+            if (buffer && count) {
+                string->Write(buffer, 0, (int) count, String::NO_NULL_TERMINATION);
+            }
         }
     V8_UNLOCK()
 
-    return value;
+    return length;
 }
 
 /* Converting to primitive values */
@@ -379,8 +468,7 @@ JS_EXPORT JSStringRef JSValueToStringCopy(JSContextRef ctxRef, JSValueRef valueR
 
         MaybeLocal<String> string = value->ToString(context);
         if (!string.IsEmpty()) {
-            String::Utf8Value chars(string.ToLocalChecked());
-            out = &* OpaqueJSString::New(*chars);
+            out = &* OpaqueJSString::New(string.ToLocalChecked(), CTX(ctxRef));
         } else {
             exception.Set(ctxRef, trycatch.Exception());
         }
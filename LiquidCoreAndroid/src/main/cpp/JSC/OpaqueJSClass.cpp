@@ -20,8 +20,25 @@ JSClassRef OpaqueJSClass::New(const JSClassDefinition *definition)
 
 OpaqueJSClass::OpaqueJSClass(const JSClassDefinition *definition)
 {
-    m_definition = new JSClassDefinition;
-    memcpy(const_cast<JSClassDefinition*>(m_definition), definition, sizeof(JSClassDefinition));
+    ClassDefinition *def = new ClassDefinition;
+    memcpy(static_cast<JSClassDefinition*>(def), definition, sizeof(JSClassDefinition));
+
+    // emplace() keeps the first of any duplicated names, which, with the entries lacking
+    // the callback left out, is the entry a linear scan for that callback would have found
+    for (int i=0; def->staticValues && def->staticValues[i].name; i++) {
+        if (def->staticValues[i].getProperty) {
+            def->values.emplace(def->staticValues[i].name, &def->staticValues[i]);
+        }
+        if (def->staticValues[i].setProperty) {
+            def->setters.emplace(def->staticValues[i].name, &def->staticValues[i]);
+        }
+    }
+    for (int i=0; def->staticFunctions && def->staticFunctions[i].name; i++) {
+        if (def->staticFunctions[i].callAsFunction) {
+            def->functions.emplace(def->staticFunctions[i].name, &def->staticFunctions[i]);
+        }
+    }
+    m_definition = def;
 
     if(m_definition->parentClass) {
         m_definition->parentClass->retain();
@@ -34,7 +51,31 @@ OpaqueJSClass::~OpaqueJSClass()
         m_definition->parentClass->release();
     }
 
-    delete m_definition;
+    delete static_cast<const ClassDefinition*>(m_definition);
+}
+
+const JSStaticValue * OpaqueJSClass::FindStaticValue(const JSClassDefinition *definition,
+    const char *name)
+{
+    auto tables = static_cast<const ClassDefinition*>(definition);
+    auto it = tables->values.find(name);
+    return it == tables->values.end() ? nullptr : it->second;
+}
+
+const JSStaticValue * OpaqueJSClass::FindStaticSetter(const JSClassDefinition *definition,
+    const char *name)
+{
+    auto tables = static_cast<const ClassDefinition*>(definition);
+    auto it = tables->setters.find(name);
+    return it == tables->setters.end() ? nullptr : it->second;
+}
+
+const JSStaticFunction * OpaqueJSClass::FindStaticFunction(const JSClassDefinition *definition,
+    const char *name)
+{
+    auto tables = static_cast<const ClassDefinition*>(definition);
+    auto it = tables->functions.find(name);
+    return it == tables->functions.end() ? nullptr : it->second;
 }
 
 void OpaqueJSClass::StaticFunctionCallHandler(const FunctionCallbackInfo< Value > &info)
@@ -54,21 +95,15 @@ void OpaqueJSClass::StaticFunctionCallHandler(const FunctionCallbackInfo< Value
         TempJSValue value;
 
         while (definition && !*exception && !*value) {
-            for (int i=0; !*value && !*exception &&
-                definition->staticFunctions && definition->staticFunctions[i].name;
-                i++) {
-
-                if (!strcmp(definition->staticFunctions[i].name, str) &&
-                    definition->staticFunctions[i].callAsFunction) {
-
-                    value.Set(definition->staticFunctions[i].callAsFunction(
-                        ctxRef_,
-                        const_cast<JSObjectRef>(*function),
-                        const_cast<JSObjectRef>(*thisObject),
-                        (size_t) info.Length(),
-                        arguments,
-                        &exception));
-                }
+            const JSStaticFunction *staticFunction = FindStaticFunction(definition, str);
+            if (staticFunction && staticFunction->callAsFunction) {
+                value.Set(staticFunction->callAsFunction(
+                    ctxRef_,
+                    const_cast<JSObjectRef>(*function),
+                    const_cast<JSObjectRef>(*thisObject),
+                    (size_t) info.Length(),
+                    arguments,
+                    &exception));
             }
 
             definition = definition->parentClass ? definition->parentClass->m_definition : nullptr;
@@ -182,7 +217,7 @@ void OpaqueJSClass::NamedPropertyQuerier(Local< String > property,
         TempJSValue thisObject(ctxRef_, info.This());
 
         String::Utf8Value const str(property);
-        OpaqueJSString string(*str);
+        OpaqueJSString string(property);
 
         bool has = false;
 
@@ -196,14 +231,9 @@ void OpaqueJSClass::NamedPropertyQuerier(Local< String > property,
 
             if (!has) {
                 // check static values
-                for (int i=0; !has && definition->staticValues && definition->staticValues[i].name;
-                    i++) {
-
-                    if (!strcmp(definition->staticValues[i].name, *str) &&
-                        !(definition->staticValues[i].attributes & kJSPropertyAttributeDontEnum)) {
-                        has = true;
-                    }
-                }
+                const JSStaticValue *staticValue = FindStaticValue(definition, *str);
+                if (!staticValue) staticValue = FindStaticSetter(definition, *str);
+                has = staticValue && !(staticValue->attributes & kJSPropertyAttributeDontEnum);
             }
             definition = definition->parentClass ? definition->parentClass->m_definition : nullptr;
         }
@@ -233,17 +263,9 @@ void OpaqueJSClass::ProtoPropertyQuerier(Local< String > property,
         bool has = false;
 
         while (definition && !has) {
-                // check static functions
-                for (int i=0; !has && definition->staticFunctions &&
-                    definition->staticFunctions[i].name;
-                    i++) {
-
-                    if (!strcmp(definition->staticFunctions[i].name, *str) &&
-                        !(definition->staticFunctions[i].attributes &
-                        kJSPropertyAttributeDontEnum)) {
-                        has = true;
-                    }
-                }
+            // check static functions
+            const JSStaticFunction *staticFunction = FindStaticFunction(definition, *str);
+            has = staticFunction && !(staticFunction->attributes & kJSPropertyAttributeDontEnum);
             definition = definition->parentClass ? definition->parentClass->m_definition : nullptr;
         }
 
@@ -262,7 +284,7 @@ void OpaqueJSClass::NamedPropertyGetter(Local< String > property,
         TempJSValue value;
 
         String::Utf8Value const str(property);
-        OpaqueJSString string(*str);
+        OpaqueJSString string(property);
 
         const JSClassDefinition *top = definition;
         while (definition && !*value && !*exception) {
@@ -285,14 +307,10 @@ void OpaqueJSClass::NamedPropertyGetter(Local< String > property,
             // If this function returns NULL, the get request forwards to object's statically
             // declared properties ...
             // Check static values
-            for (int i=0; !*value && !*exception &&
-                definition->staticValues && definition->staticValues[i].name;
-                i++) {
-
-                if (!strcmp(definition->staticValues[i].name, *str) &&
-                    definition->staticValues[i].getProperty) {
-
-                    value.Set(definition->staticValues[i].getProperty(
+            if (!*value && !*exception) {
+                const JSStaticValue *staticValue = FindStaticValue(definition, *str);
+                if (staticValue && staticValue->getProperty) {
+                    value.Set(staticValue->getProperty(
                         ctxRef_,
                         const_cast<JSObjectRef>(*thisObject),
                         &string,
@@ -354,26 +372,20 @@ void OpaqueJSClass::ProtoPropertyGetter(Local< String > property,
         TempJSValue value;
 
         String::Utf8Value const str(property);
-        OpaqueJSString string(*str);
+        OpaqueJSString string(property);
 
         while (definition && !*value && !*exception) {
             // Check static functions
-            for (int i=0; !*value && !*exception &&
-                definition->staticFunctions && definition->staticFunctions[i].name;
-                i++) {
-
-                if (!strcmp(definition->staticFunctions[i].name, *str) &&
-                    definition->staticFunctions[i].callAsFunction) {
-
-                    Local<Value> data = ObjectData::New(definition, ctxRef_);
-                    ObjectData::Get(data)->SetName(property);
-
-                    Local<FunctionTemplate> ftempl =
-                        FunctionTemplate::New(isolate, StaticFunctionCallHandler, data);
-                    Local<Function> func = ftempl->GetFunction();
-                    ObjectData::Get(data)->SetFunc(func);
-                    value.Set(ctxRef_, func);
-                }
+            const JSStaticFunction *staticFunction = FindStaticFunction(definition, *str);
+            if (staticFunction && staticFunction->callAsFunction) {
+                Local<Value> data = ObjectData::New(definition, ctxRef_);
+                ObjectData::Get(data)->SetName(property);
+
+                Local<FunctionTemplate> ftempl =
+                    FunctionTemplate::New(isolate, StaticFunctionCallHandler, data);
+                Local<Function> func = ftempl->GetFunction();
+                ObjectData::Get(data)->SetFunc(func);
+                value.Set(ctxRef_, func);
             }
 
             // then its parent class chain (which includes the default object class)
@@ -399,25 +411,19 @@ void OpaqueJSClass::NamedPropertySetter(Local< String > property, Local< Value >
         TempJSValue valueRef(ctxRef_,value);
 
         String::Utf8Value const str(property);
-        OpaqueJSString string(*str);
+        OpaqueJSString string(property);
 
         bool set = false;
         while (definition && !*exception && !set) {
             // Check static values
-            for (int i=0; !set && !*exception &&
-                definition->staticValues && definition->staticValues[i].name;
-                i++) {
-
-                if (!strcmp(definition->staticValues[i].name, *str) &&
-                    definition->staticValues[i].setProperty) {
-
-                    set = definition->staticValues[i].setProperty(
-                        ctxRef_,
-                        const_cast<JSObjectRef>(*thisObject),
-                        &string,
-                        *valueRef,
-                        &exception);
-                }
+            const JSStaticValue *staticValue = FindStaticSetter(definition, *str);
+            if (staticValue) {
+                set = staticValue->setProperty(
+                    ctxRef_,
+                    const_cast<JSObjectRef>(*thisObject),
+                    &string,
+                    *valueRef,
+                    &exception);
             }
 
             if( !set && !*exception) {
@@ -474,7 +480,7 @@ void OpaqueJSClass::NamedPropertyDeleter(Local< String > property,
         TempJSValue thisObject(ctxRef_, info.This());
 
         String::Utf8Value const str(property);
-        OpaqueJSString string(*str);
+        OpaqueJSString string(property);
 
         bool deleted = false;
         while (definition && !*exception && !deleted) {
@@ -723,7 +729,13 @@ void OpaqueJSClass::CallAsFunction(const FunctionCallbackInfo< Value > &info)
 
 void OpaqueJSClass::Finalize(const WeakCallbackInfo<UniquePersistent<Object>>& info)
 {
-    auto clazz = reinterpret_cast<OpaqueJSClass*>(info.GetInternalField(INSTANCE_OBJECT_CLASS));
+    info.GetParameter()->Reset();
+    delete info.GetParameter();
+    info.SetSecondPassCallback(FinalizeSecondPass);
+}
+
+void OpaqueJSClass::FinalizeSecondPass(const WeakCallbackInfo<UniquePersistent<Object>>& info)
+{
     auto objRef = reinterpret_cast<JSObjectRef>(info.GetInternalField(INSTANCE_OBJECT_JSOBJECT));
     /* Note: A weak callback will only retain the first two internal fields
      * But the first one is reserved.  So we will have nulled out the second one in the
@@ -732,19 +744,12 @@ void OpaqueJSClass::Finalize(const WeakCallbackInfo<UniquePersistent<Object>>& i
      * read position one, even if the indices move later.
      */
     if ((info.GetInternalField(1) != nullptr) && objRef && !objRef->HasFinalized()) {
-        objRef->SetFinalized();
-        const JSClassDefinition *definition = clazz ? clazz->m_definition : nullptr;
-        while (definition) {
-            if (definition->finalize) {
-                definition->finalize(objRef);
-            }
-            definition = definition->parentClass ? definition->parentClass->m_definition : nullptr;
-        }
+        // Don't run native code inside the GC; the context runs these in batches afterwards
+        const_cast<OpaqueJSContext*>(objRef->Context())->QueueFinalize(objRef);
     }
-    info.GetParameter()->Reset();
-    delete info.GetParameter();
 }
 
+
 bool OpaqueJSClass::IsFunction()
 {
     const JSClassDefinition *definition = m_definition;
@@ -816,13 +821,26 @@ JSGlobalContextRef OpaqueJSClass::NewContext(JSContextGroupRef group) {
     return ctx;
 }
 
-void OpaqueJSClass::NewTemplate(Local<Context> context, Local<Value> *data,
+void OpaqueJSClass::NewTemplate(JSContextRef ctx, Local<Value> *data,
     Local<ObjectTemplate> *object)
 {
+    Local<Context> context = ctx->Context()->Value();
     Isolate *isolate = context->GetIsolate();
 
     Context::Scope context_scope_(context);
 
+    // Function and constructor instances keep themselves in their data, so only plain
+    // object classes can share a template
+    bool cacheable = !IsFunction() && !IsConstructor();
+    if (cacheable) {
+        OpaqueJSContext::ClassTemplates *cached = const_cast<OpaqueJSContext*>(ctx)->Templates(this);
+        if (cached) {
+            *object = Local<ObjectTemplate>::New(isolate, cached->object);
+            *data = Local<Value>::New(isolate, cached->data);
+            return;
+        }
+    }
+
     *object = ObjectTemplate::New(isolate);
 
     // Create data object
@@ -849,6 +867,29 @@ void OpaqueJSClass::NewTemplate(Local<Context> context, Local<Value> *data,
     }
 
     (*object)->SetInternalFieldCount(INSTANCE_OBJECT_FIELDS);
+
+    if (cacheable) {
+        ObjectData::Get(*data)->SetContext(ctx);
+        const_cast<OpaqueJSContext*>(ctx)->SetTemplates(this, *object,
+            NewPrototypeTemplate(isolate, *data), *data);
+    }
+}
+
+Local<ObjectTemplate> OpaqueJSClass::NewPrototypeTemplate(Isolate *isolate, Local<Value> data)
+{
+    EscapableHandleScope scope(isolate);
+
+    // Set up a prototype object to handle static functions
+    Local<ObjectTemplate> protoTemplate = ObjectTemplate::New(isolate);
+    protoTemplate->SetNamedPropertyHandler(
+        ProtoPropertyGetter,
+        nullptr,
+        ProtoPropertyQuerier,
+        nullptr,
+        ProtoPropertyEnumerator,
+        data);
+
+    return scope.Escape(protoTemplate);
 }
 
 JSObjectRef OpaqueJSClass::InitInstance(JSContextRef ctx, Local<Object> instance,
@@ -879,15 +920,13 @@ JSObjectRef OpaqueJSClass::InitInstance(JSContextRef ctx, Local<Object> instance
         instance->SetAlignedPointerInInternalField(INSTANCE_OBJECT_JSOBJECT,(void*)retObj);
         retObj->SetPrivateData(privateData);
 
-        // Set up a prototype object to handle static functions
-        Local<ObjectTemplate> protoTemplate = ObjectTemplate::New(isolate);
-        protoTemplate->SetNamedPropertyHandler(
-            ProtoPropertyGetter,
-            nullptr,
-            ProtoPropertyQuerier,
-            nullptr,
-            ProtoPropertyEnumerator,
-            data);
+        Local<ObjectTemplate> protoTemplate;
+        OpaqueJSContext::ClassTemplates *cached = const_cast<OpaqueJSContext*>(ctx)->Templates(this);
+        if (cached && Local<Value>::New(isolate, cached->data)->StrictEquals(data)) {
+            protoTemplate = Local<ObjectTemplate>::New(isolate, cached->prototype);
+        } else {
+            protoTemplate = NewPrototypeTemplate(isolate, data);
+        }
         Local<Object> prototype = protoTemplate->NewInstance(context).ToLocalChecked();
         instance->SetPrototype(context, prototype);
 
@@ -897,10 +936,7 @@ JSObjectRef OpaqueJSClass::InitInstance(JSContextRef ctx, Local<Object> instance
             const char* sClassName = definition ? definition->className : "CallbackObject";
             if (sClassName) {
                 Local<String> className = String::NewFromUtf8(isolate, sClassName);
-                Local<Object> Symbol =
-                    context->Global()->Get(String::NewFromUtf8(isolate, "Symbol"))->ToObject();
-                Local<Value> toStringTag = Symbol->Get(String::NewFromUtf8(isolate, "toStringTag"));
-                prototype->Set(context, toStringTag, className);
+                prototype->Set(context, Symbol::GetToStringTag(isolate), className);
                 break;
             }
             if (!definition) break;
@@ -914,10 +950,7 @@ JSObjectRef OpaqueJSClass::InitInstance(JSContextRef ctx, Local<Object> instance
                 Local<FunctionTemplate> ftempl = FunctionTemplate::New(isolate,
                     ConvertFunctionCallHandler, data);
                 Local<Function> function = ftempl->GetFunction(context).ToLocalChecked();
-                Local<Object> Symbol =
-                    context->Global()->Get(String::NewFromUtf8(isolate, "Symbol"))->ToObject();
-                Local<Value> toPrimitive = Symbol->Get(String::NewFromUtf8(isolate, "toPrimitive"));
-                prototype->Set(context, toPrimitive, function);
+                prototype->Set(context, Symbol::GetToPrimitive(isolate), function);
                 break;
             }
             definition = definition->parentClass ? definition->parentClass->m_definition : nullptr;
@@ -930,10 +963,7 @@ JSObjectRef OpaqueJSClass::InitInstance(JSContextRef ctx, Local<Object> instance
                 Local<FunctionTemplate> ftempl = FunctionTemplate::New(isolate,
                     HasInstanceFunctionCallHandler, data);
                 Local<Function> function = ftempl->GetFunction(context).ToLocalChecked();
-                Local<Object> Symbol =
-                    context->Global()->Get(String::NewFromUtf8(isolate, "Symbol"))->ToObject();
-                Local<Value> hasInstance = Symbol->Get(String::NewFromUtf8(isolate, "hasInstance"));
-                prototype->Set(context, hasInstance, function);
+                prototype->Set(context, Symbol::GetHasInstance(isolate), function);
                 break;
             }
             definition = definition->parentClass ? definition->parentClass->m_definition : nullptr;
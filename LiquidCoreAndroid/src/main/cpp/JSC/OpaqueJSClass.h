@@ -9,6 +9,8 @@
 
 #include "JavaScriptCore/JavaScript.h"
 #include "JSC/JSCRetainer.h"
+#include <unordered_map>
+#include <cstring>
 
 struct OpaqueJSClass : public JSCRetainer {
     public:
@@ -17,8 +19,7 @@ struct OpaqueJSClass : public JSCRetainer {
         virtual ~OpaqueJSClass();
         inline const JSClassDefinition * Definition() { return m_definition; }
 
-        void NewTemplate(Local<Context> context, Local<Value> *data,
-            Local<ObjectTemplate> *templ);
+        void NewTemplate(JSContextRef ctx, Local<Value> *data, Local<ObjectTemplate> *templ);
         JSGlobalContextRef NewContext(JSContextGroupRef group);
         JSObjectRef InitInstance(JSContextRef ctx, Local<Object> instance,
             Local<Value> data, void *privateData);
@@ -27,10 +28,37 @@ struct OpaqueJSClass : public JSCRetainer {
         static void HasInstanceFunctionCallHandler(const FunctionCallbackInfo< Value > &);
 
     private:
+        struct NameHash {
+            size_t operator()(const char *s) const {
+                size_t h = 2166136261u;
+                for (; *s; s++) h = (h ^ (unsigned char)*s) * 16777619u;
+                return h;
+            }
+        };
+        struct NameEqual {
+            bool operator()(const char *a, const char *b) const { return !strcmp(a, b); }
+        };
+        // The class keeps its own copy of the definition, extended with name lookup tables
+        // built once at creation so the interceptors don't have to scan the static arrays.
+        // Each only holds entries with the callback it is looked up for.
+        struct ClassDefinition : public JSClassDefinition {
+            std::unordered_map<const char*, const JSStaticValue*, NameHash, NameEqual> values;
+            std::unordered_map<const char*, const JSStaticValue*, NameHash, NameEqual> setters;
+            std::unordered_map<const char*, const JSStaticFunction*, NameHash, NameEqual> functions;
+        };
+
         OpaqueJSClass(const JSClassDefinition *definition);
+        static const JSStaticValue * FindStaticValue(const JSClassDefinition *definition,
+            const char *name);
+        static const JSStaticValue * FindStaticSetter(const JSClassDefinition *definition,
+            const char *name);
+        static const JSStaticFunction * FindStaticFunction(const JSClassDefinition *definition,
+            const char *name);
+        static Local<ObjectTemplate> NewPrototypeTemplate(Isolate *isolate, Local<Value> data);
         static void StaticFunctionCallHandler(const FunctionCallbackInfo< Value > &);
         static void ConvertFunctionCallHandler(const FunctionCallbackInfo< Value > &);
         static void Finalize(const WeakCallbackInfo<UniquePersistent<Object>>&);
+        static void FinalizeSecondPass(const WeakCallbackInfo<UniquePersistent<Object>>&);
 
         static void NamedPropertyGetter(Local< String >, const PropertyCallbackInfo< Value > &);
         static void NamedPropertyQuerier(Local< String >, const PropertyCallbackInfo< Integer > &);
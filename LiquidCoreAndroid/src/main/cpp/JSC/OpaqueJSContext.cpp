@@ -4,10 +4,10 @@
  * Distributed under the MIT License.  See LICENSE.md at
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
-#include <algorithm>
 #include "JSC/OpaqueJSContextGroup.h"
 #include "JSC/OpaqueJSContext.h"
 #include "JSC/OpaqueJSValue.h"
+#include "JSC/OpaqueJSClass.h"
 
 JSGlobalContextRef OpaqueJSContext::New(boost::shared_ptr<JSContext> ctx)
 {
@@ -21,7 +21,8 @@ void OpaqueJSContext::StaticGCCallback(GCType type, GCCallbackFlags flags, void*
     reinterpret_cast<OpaqueJSContext*>(data)->GCCallback(type,flags);
 }
 
-OpaqueJSContext::OpaqueJSContext(boost::shared_ptr<JSContext> ctx) : m_context(ctx), m_isDefunct(false)
+OpaqueJSContext::OpaqueJSContext(boost::shared_ptr<JSContext> ctx) : m_context(ctx),
+    m_self_token(new OpaqueJSContext*(this)), m_isDefunct(false)
 {
     ctx->Group()->RegisterGCCallback(StaticGCCallback, this);
 }
@@ -41,31 +42,54 @@ void OpaqueJSContext::Dispose()
         boost::shared_ptr<JSContext> context = m_context;
         V8_ISOLATE(context->Group(), isolate);
             context->Group()->UnregisterGCCallback(StaticGCCallback, this);
+            *m_self_token = nullptr;
 
             ForceGC();
             //For testing only.  Must also specify --enable_gc flag in common.cpp
             //isolate->RequestGarbageCollectionForTesting(Isolate::kFullGarbageCollection);
 
+            for (auto& entry : m_class_templates) {
+                entry.second.object.Reset();
+                entry.second.prototype.Reset();
+                entry.second.data.Reset();
+                entry.first->release();
+            }
+            m_class_templates.clear();
+
             m_gc_lock.lock();
 
-            // First, look for all values that have a zero reference and clean them
-            auto iterator = m_collection.begin();
-            while (iterator != m_collection.end()) {
-                const auto& v = *iterator;
-                ++iterator;
-                v->Clean(true);
+            // Anything still waiting to be finalized is held, and is finalized and released
+            // with everything else below
+            m_finalize_queue.clear();
+
+            // First, look for all values that have a zero reference and clean them.  Each
+            // value is moved back onto the collection before it is cleaned, so that anything
+            // deleted along the way (including by finalizers) unlinks itself from whichever
+            // list it is on and the walk stays linear.
+            CollectionLink pending;
+            if (m_collection.Linked()) {
+                pending.InsertBefore(m_collection.next);
+                m_collection.Unlink();
+            }
+            while (pending.Linked()) {
+                CollectionLink *link = pending.next;
+                link->Unlink();
+                link->InsertBefore(&m_collection);
+                link->value->Clean(true);
             }
 
             // Then, release everything that has a reference count > 0
-            bool isEmpty =  m_collection.empty();
-            while (!isEmpty) {
-                const auto& v = m_collection.front();
-                const_cast<OpaqueJSValue *>(v)->Release();
-                isEmpty =  m_collection.empty();
+            while (m_collection.Linked()) {
+                const_cast<OpaqueJSValue *>(m_collection.next->value)->Release();
             }
             m_gc_lock.unlock();
 
-            ASSERTJSC(m_collection.empty());
+            ASSERTJSC(!m_collection.Linked());
+
+            for (auto& oddball : m_oddballs) {
+                delete oddball;
+                oddball = nullptr;
+            }
 
             context.reset();
         V8_UNLOCK();
@@ -81,7 +105,12 @@ void OpaqueJSContext::MarkForCollection(JSValueRef value)
 {
     ASSERTJSC(value->Context() == this);
     m_gc_lock.lock();
-    m_collection.push_back(value);
+    CollectionLink& link = value->m_collection_link;
+    if (!link.marked) {
+        link.marked = true;
+        link.value = value;
+        link.InsertBefore(&m_collection);
+    }
     m_gc_lock.unlock();
 }
 
@@ -89,16 +118,108 @@ void OpaqueJSContext::MarkCollected(JSValueRef value)
 {
     ASSERTJSC(value->Context() == this);
     m_gc_lock.lock();
-    auto it = std::find(m_collection.begin(), m_collection.end(), value);
-    if(it != m_collection.end())
-        m_collection.erase(it);
+    value->m_collection_link.Unlink();
     m_gc_lock.unlock();
 }
 
+JSValueRef OpaqueJSContext::Oddball(Local<Value> value)
+{
+    int index = value->IsUndefined() ? 0 : value->IsNull() ? 1 : value->IsTrue() ? 2 : 3;
+    if (!m_oddballs[index]) {
+        auto oddball = new OpaqueJSValue(this, value);
+        // Hold it strongly and keep it out of the collection; it is freed in Dispose()
+        oddball->Retain();
+        oddball->m_isImmortal = true;
+        m_gc_lock.lock();
+        oddball->m_collection_link.Unlink();
+        m_gc_lock.unlock();
+        m_oddballs[index] = oddball;
+    }
+    return m_oddballs[index];
+}
+
+OpaqueJSContext::ClassTemplates* OpaqueJSContext::Templates(JSClassRef cls)
+{
+    auto it = m_class_templates.find(cls);
+    return it == m_class_templates.end() ? nullptr : &it->second;
+}
+
+void OpaqueJSContext::SetTemplates(JSClassRef cls, Local<ObjectTemplate> object,
+    Local<ObjectTemplate> prototype, Local<Value> data)
+{
+    Isolate *isolate = Context()->isolate();
+    ClassTemplates& templates = m_class_templates[cls];
+    if (templates.object.IsEmpty()) {
+        // Keep the class alive for as long as its templates are cached
+        cls->retain();
+    }
+    templates.object.Reset(isolate, object);
+    templates.prototype.Reset(isolate, prototype);
+    templates.data.Reset(isolate, data);
+}
+
 void OpaqueJSContext::GCCallback(GCType type, GCCallbackFlags flags)
 {
 }
 
+void OpaqueJSContext::QueueFinalize(JSObjectRef object)
+{
+    ASSERTJSC(object->Context() == this);
+    m_gc_lock.lock();
+    object->Hold();
+    m_finalize_queue.push_back(object);
+    bool schedule = !m_finalize_scheduled;
+    m_finalize_scheduled = true;
+    m_gc_lock.unlock();
+
+    // Second pass callbacks run once the collection is over, so without a loop to defer to it
+    // is safe to run the finalizers straight away
+    if (schedule) {
+        ScheduleFinalizers();
+    }
+}
+
+void OpaqueJSContext::ScheduleFinalizers()
+{
+    boost::shared_ptr<ContextGroup> group = Context()->Group();
+    boost::shared_ptr<OpaqueJSContext*> token = m_self_token;
+    group->defer([group,token]() {
+        V8_ISOLATE(group, isolate)
+            OpaqueJSContext *ctx = *token;
+            if (ctx) {
+                ctx->RunFinalizers(
+                    static_cast<OpaqueJSContextGroup*>(&*group)->FinalizerBudget());
+            }
+        V8_UNLOCK()
+    });
+}
+
+void OpaqueJSContext::RunFinalizers(size_t budget)
+{
+    for (size_t i = 0; i < budget; i++) {
+        m_gc_lock.lock();
+        if (m_finalize_queue.empty()) {
+            m_gc_lock.unlock();
+            break;
+        }
+        JSObjectRef object = m_finalize_queue.front();
+        m_finalize_queue.pop_front();
+        m_gc_lock.unlock();
+
+        object->Finalize();
+        object->Release();
+    }
+
+    m_gc_lock.lock();
+    bool more = !m_finalize_queue.empty() && !m_isDefunct;
+    m_finalize_scheduled = more;
+    m_gc_lock.unlock();
+
+    if (more) {
+        ScheduleFinalizers();
+    }
+}
+
 void OpaqueJSContext::ForceGC()
 {
     V8_ISOLATE(Context()->Group(), isolate)
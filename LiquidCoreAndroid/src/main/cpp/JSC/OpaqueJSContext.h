@@ -8,16 +8,57 @@
 #define LIQUIDCORE_OPAQUEJSCONTEXT_H_H
 
 #include "JavaScriptCore/JavaScript.h"
+#include <deque>
+#include <unordered_map>
 #include "JSC/JSCRetainer.h"
 
 struct OpaqueJSContext : public JSCRetainer {
     public:
+        // Intrusive link embedded in each OpaqueJSValue so that values can be added to and
+        // removed from the collection in constant time
+        struct CollectionLink {
+            CollectionLink() : prev(this), next(this), value(nullptr), marked(false) {}
+            inline bool Linked() const { return next != this; }
+            inline void Unlink() {
+                prev->next = next;
+                next->prev = prev;
+                prev = next = this;
+            }
+            inline void InsertBefore(CollectionLink *link) {
+                prev = link->prev;
+                next = link;
+                link->prev->next = this;
+                link->prev = this;
+            }
+            CollectionLink *prev;
+            CollectionLink *next;
+            JSValueRef value;
+            // Set once the value has been marked for collection, so that it is only ever
+            // linked in once, even if it has since been taken out again
+            bool marked;
+        };
+
         static JSGlobalContextRef New(boost::shared_ptr<JSContext> ctx);
         virtual ~OpaqueJSContext();
 
         inline boost::shared_ptr<JSContext> Context() const { return m_context; }
         void MarkForCollection(JSValueRef value);
         void MarkCollected(JSValueRef value);
+        JSValueRef Oddball(Local<Value> value);
+
+        // Instance and prototype templates for a class, shared by every instance the class
+        // creates in this context
+        struct ClassTemplates {
+            UniquePersistent<ObjectTemplate> object;
+            UniquePersistent<ObjectTemplate> prototype;
+            UniquePersistent<Value> data;
+        };
+        ClassTemplates* Templates(JSClassRef cls);
+        void SetTemplates(JSClassRef cls, Local<ObjectTemplate> object,
+            Local<ObjectTemplate> prototype, Local<Value> data);
+        // Class finalizers for collected instances are queued from the weak callback and run
+        // on a later loop turn, a budgeted number per turn
+        void QueueFinalize(JSObjectRef object);
         void ForceGC();
         void Dispose();
         bool IsDefunct();
@@ -25,13 +66,22 @@ struct OpaqueJSContext : public JSCRetainer {
     private:
         OpaqueJSContext(boost::shared_ptr<JSContext> ctx);
         void GCCallback(GCType type, GCCallbackFlags flags);
+        void ScheduleFinalizers();
+        void RunFinalizers(size_t budget);
 
         boost::atomic_shared_ptr<JSContext> m_context;
-        std::vector<JSValueRef> m_collection;
+        CollectionLink m_collection;
+        JSValueRef m_oddballs[4] = { nullptr };
+        std::unordered_map<JSClassRef, ClassTemplates> m_class_templates;
         std::recursive_mutex m_gc_lock;
+        std::deque<JSObjectRef> m_finalize_queue;
+        bool m_finalize_scheduled = false;
+        // Lets deferred runnables find out whether this context is still around
+        boost::shared_ptr<OpaqueJSContext*> m_self_token;
         bool m_isDefunct;
 
         static void StaticGCCallback(GCType type, GCCallbackFlags flags, void*data);
+
 };
 
 #endif //LIQUIDCORE_OPAQUEJSCONTEXT_H_H
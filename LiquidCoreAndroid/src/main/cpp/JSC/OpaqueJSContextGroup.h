@@ -25,8 +25,13 @@ struct OpaqueJSContextGroup : public ContextGroup {
         void Retain();
         void Release();
 
+        // Maximum number of deferred class finalizers run per loop turn
+        inline size_t FinalizerBudget() { return m_finalizer_budget; }
+        inline void SetFinalizerBudget(size_t budget) { m_finalizer_budget = budget ? budget : 1; }
+
     private:
         int m_jsc_count;
+        boost::atomic<size_t> m_finalizer_budget { 256 };
         std::vector<const OpaqueJSContext *> m_associatedContexts;
         std::mutex m_mutex;
     protected:
@@ -5,12 +5,16 @@
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
 #include <string>
+#include <mutex>
+#include <unordered_map>
 #include "JSC/OpaqueJSString.h"
-#include "utf8.h"
+#include "Transcode.h"
 
-JSStringRef OpaqueJSString::New(Local<String> string)
+using nodedroid::Transcode;
+
+JSStringRef OpaqueJSString::New(Local<String> string, boost::shared_ptr<JSContext> context)
 {
-    return new OpaqueJSString(string);
+    return new OpaqueJSString(string, context);
 }
 
 JSStringRef OpaqueJSString::New(const JSChar * chars, size_t numChars)
@@ -23,10 +27,49 @@ JSStringRef OpaqueJSString::New(const char * chars)
     return new OpaqueJSString(chars);
 }
 
-OpaqueJSString::OpaqueJSString(Local<String> string) : m_isNull(false)
+// Longer strings are unlikely to be reused as names and are not worth hashing
+#define MAX_INTERNED_LENGTH 128
+// Past this many, further names are made afresh each time
+#define MAX_INTERNED_STRINGS 4096
+
+static std::mutex s_intern_mutex;
+static std::unordered_map<std::string, OpaqueJSString*> s_intern_pool;
+
+JSStringRef OpaqueJSString::Intern(const char * chars)
+{
+    if (!chars) return New(chars);
+
+    size_t length = strnlen(chars, MAX_INTERNED_LENGTH + 1);
+    if (length > MAX_INTERNED_LENGTH) return New(chars);
+
+    std::unique_lock<std::mutex> lock(s_intern_mutex);
+    auto it = s_intern_pool.find(std::string(chars, length));
+    if (it != s_intern_pool.end()) {
+        it->second->retain();
+        return it->second;
+    }
+    if (s_intern_pool.size() >= MAX_INTERNED_STRINGS) {
+        lock.unlock();
+        return New(chars);
+    }
+
+    // The pool holds one reference, so interned strings live for the life of the process
+    auto string = new OpaqueJSString(chars);
+    string->m_isInterned = true;
+    string->retain();
+    s_intern_pool[std::string(chars, length)] = string;
+    return string;
+}
+
+OpaqueJSString::OpaqueJSString(Local<String> string, boost::shared_ptr<JSContext> context) :
+    backstore((size_t) string->Length()),
+    m_value(context ? JSValue::New(context, string) : boost::shared_ptr<JSValue>()),
+    m_isNull(false)
 {
-    String::Utf8Value chars(string);
-    utf8::utf8to16(*chars, *chars + strlen(*chars), std::back_inserter(backstore));
+    // V8 and JSC both use UTF-16 code units, so copy them across directly
+    if (!backstore.empty()) {
+        string->Write(backstore.data(), 0, (int) backstore.size(), String::NO_NULL_TERMINATION);
+    }
 }
 
 OpaqueJSString::OpaqueJSString(const JSChar * chars, size_t numChars) :
@@ -37,7 +80,10 @@ OpaqueJSString::OpaqueJSString(const JSChar * chars, size_t numChars) :
 OpaqueJSString::OpaqueJSString(const char * chars) : m_isNull(!chars)
 {
     if (chars) {
-        utf8::utf8to16(chars, chars + strlen(chars), std::back_inserter(backstore));
+        // Never more units than bytes
+        size_t length = strlen(chars);
+        backstore.resize(length);
+        backstore.resize(Transcode::Utf8ToUtf16(chars, length, backstore.data()));
     }
 }
 
@@ -47,9 +93,14 @@ OpaqueJSString::~OpaqueJSString()
 
 Local<String> OpaqueJSString::Value(Isolate *isolate)
 {
-    std::string utf8str;
-    Utf8String(utf8str);
-    return String::NewFromUtf8(isolate, utf8str.c_str());
+    if (m_value && !m_value->IsDefunct() && m_value->isolate() == isolate) {
+        return m_value->Value().As<String>();
+    }
+    // Interned strings are names; internalizing them resolves to V8's existing copy and
+    // saves V8 from doing so on every property access
+    return String::NewFromTwoByte(isolate, Chars(),
+        m_isInterned ? NewStringType::kInternalized : NewStringType::kNormal, (int) Size())
+        .ToLocalChecked();
 }
 
 const JSChar * OpaqueJSString::Chars()
@@ -69,14 +120,24 @@ size_t OpaqueJSString::Size()
 
 size_t OpaqueJSString::Utf8Bytes()
 {
-    std::string utf8str;
-    utf8::utf16to8(backstore.begin(), backstore.end(), std::back_inserter(utf8str));
-    return utf8str.length() + 1;
+    return Transcode::Utf8Length(backstore.data(), backstore.size()) + 1;
 }
 
 void OpaqueJSString::Utf8String(std::string& utf8str)
 {
-    utf8::utf16to8(backstore.begin(), backstore.end(), std::back_inserter(utf8str));
+    const size_t start = utf8str.length();
+    const size_t length = Transcode::Utf8Length(backstore.data(), backstore.size());
+    utf8str.resize(start + length);
+    Transcode::Utf16ToUtf8(backstore.data(), backstore.size(), &utf8str[start], length);
+}
+
+size_t OpaqueJSString::Utf8String(char *buffer, size_t bufferSize)
+{
+    if (bufferSize == 0) return 0;
+    const size_t written = Transcode::Utf16ToUtf8(backstore.data(), backstore.size(), buffer,
+                                                  bufferSize - 1);
+    buffer[written] = 0;
+    return written;
 }
 
 bool OpaqueJSString::Equals(OpaqueJSString& other)
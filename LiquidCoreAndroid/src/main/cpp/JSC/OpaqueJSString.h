@@ -12,10 +12,14 @@
 
 struct OpaqueJSString : public JSCRetainer {
     public:
-        static JSStringRef New(Local<String> string);
+        static JSStringRef New(Local<String> string,
+            boost::shared_ptr<JSContext> context = boost::shared_ptr<JSContext>());
         static JSStringRef New(const JSChar * chars, size_t numChars);
         static JSStringRef New(const char * chars);
-        OpaqueJSString(Local<String> string);
+        // Returns a shared, immutable string for short UTF-8 names such as property keys
+        static JSStringRef Intern(const char * chars);
+        OpaqueJSString(Local<String> string,
+            boost::shared_ptr<JSContext> context = boost::shared_ptr<JSContext>());
         OpaqueJSString(const JSChar * chars, size_t numChars);
         OpaqueJSString(const char * chars);
         virtual ~OpaqueJSString();
@@ -24,11 +28,16 @@ struct OpaqueJSString : public JSCRetainer {
         size_t Size();
         size_t Utf8Bytes();
         void Utf8String(std::string&);
+        // Null-terminated, as much as fits; returns the bytes before the terminator
+        size_t Utf8String(char *buffer, size_t bufferSize);
         bool Equals(OpaqueJSString& other);
 
     private:
         std::vector<unsigned short> backstore;
+        // The V8 string this was copied from, if any, so Value() can hand it back as is
+        const boost::shared_ptr<JSValue> m_value;
         bool m_isNull;
+        bool m_isInterned = false;
 };
 
 #endif //LIQUIDCORE_OPAQUEJSSTRING_H
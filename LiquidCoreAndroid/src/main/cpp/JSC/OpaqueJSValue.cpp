@@ -15,7 +15,11 @@ JSValueRef OpaqueJSValue::New(JSContextRef ctx, Local<Value> v,
 {
     OpaqueJSValue* out = nullptr;
     V8_ISOLATE(ctx->Context()->Group(), isolate)
-        if (v->IsObject() && !fromClass) {
+        if (!fromClass && (v->IsUndefined() || v->IsNull() || v->IsBoolean())) {
+            out = const_cast<OpaqueJSValue*>(const_cast<OpaqueJSContext*>(ctx)->Oddball(v));
+        } else if (!fromClass && v->IsNumber()) {
+            out = new OpaqueJSValue(ctx, v.As<Number>()->Value());
+        } else if (v->IsObject() && !fromClass) {
             Local<v8::Context> context = ctx->Context()->Value();
             Context::Scope(ctx->Context()->Value());
             Local<Object> o = v->ToObject(context).ToLocalChecked();
@@ -75,25 +79,32 @@ OpaqueJSValue::~OpaqueJSValue()
 void OpaqueJSValue::Clean(bool fromGC) const
 {
     if (m_count <= 0) {
-        if (!HasFinalized()) {
-            const_cast<OpaqueJSValue *>(this)->m_finalized = true;
-            const JSClassDefinition * definition = m_fromClassDefinition;
-            while (definition) {
-                if (definition->finalize) {
-                    definition->finalize(const_cast<JSObjectRef>(this));
-                }
-                definition =
-                    definition->parentClass? definition->parentClass->Definition(): nullptr;
+        Finalize();
+        delete this;
+    }
+}
+
+void OpaqueJSValue::Finalize() const
+{
+    if (!HasFinalized()) {
+        const_cast<OpaqueJSValue *>(this)->m_finalized = true;
+        const JSClassDefinition * definition = m_fromClassDefinition;
+        while (definition) {
+            if (definition->finalize) {
+                definition->finalize(const_cast<JSObjectRef>(this));
             }
+            definition =
+                definition->parentClass? definition->parentClass->Definition(): nullptr;
         }
-        delete this;
     }
 }
 
 int OpaqueJSValue::Retain()
 {
+    if (m_isImmortal) return m_count;
+
     boost::shared_ptr<JSValue> value = m_value;
-    if (!value) {
+    if (!value && !m_isNumber) {
         V8_ISOLATE(m_ctx->Context()->Group(), isolate)
             Context::Scope(m_ctx->Context()->Value());
             m_value = JSValue::New(m_ctx->Context(), Local<Value>::New(isolate,weak));
@@ -105,6 +116,8 @@ int OpaqueJSValue::Retain()
 
 int OpaqueJSValue::Release(bool cleanOnZero)
 {
+    if (m_isImmortal) return m_count;
+
     int count = --m_count;
     ASSERTJSC(count >= 0)
     if (cleanOnZero) {
@@ -131,6 +144,13 @@ OpaqueJSValue::OpaqueJSValue(JSContextRef context, Local<Value> v, const JSClass
     const_cast<OpaqueJSContext *>(context)->MarkForCollection(this);
 }
 
+OpaqueJSValue::OpaqueJSValue(JSContextRef context, double number) :
+    m_value(nullptr), m_ctx(context), m_fromClassDefinition(nullptr), m_isNumber(true),
+    m_number(number), m_count(1)
+{
+    const_cast<OpaqueJSContext *>(context)->MarkForCollection(this);
+}
+
 void OpaqueJSValue::WeakCallback() {
     weak.Reset();
 }
@@ -18,13 +18,21 @@ struct OpaqueJSValue {
         inline Local<Value> L() const
         {
             EscapableHandleScope scope(Isolate::GetCurrent());
+            if (m_isNumber) {
+                return scope.Escape(Number::New(m_ctx->Context()->isolate(), m_number));
+            }
             boost::shared_ptr<JSValue> value = m_value;
             return value ? scope.Escape(value->Value()) :
                    scope.Escape(Local<Value>::New(m_ctx->Context()->isolate(), weak));
         }
         void Clean(bool fromGC=false) const;
+        // Runs the class finalizers, once
+        void Finalize() const;
         int Retain();
         int Release(bool cleanOnZero=true);
+        // Takes a reference without strengthening the handle, for values whose object may
+        // already be gone
+        inline int Hold() { return ++m_count; }
         inline JSContextRef Context() const { return m_ctx; }
         bool SetPrivateData(void *data);
         inline void *GetPrivateData() { return m_private_data; }
@@ -34,6 +42,7 @@ struct OpaqueJSValue {
 
     protected:
         OpaqueJSValue(JSContextRef context, Local<Value> v, const JSClassDefinition* fromClass=0);
+        OpaqueJSValue(JSContextRef context, double number);
 
     private:
         virtual void WeakCallback();
@@ -44,7 +53,15 @@ struct OpaqueJSValue {
         void *m_private_data = nullptr;
         const JSClassDefinition * m_fromClassDefinition;
         bool m_finalized = false;
+        // Numbers hold their value directly instead of a V8 handle
+        bool m_isNumber = false;
+        // Shared per-context undefined/null/true/false; never counted or cleaned
+        bool m_isImmortal = false;
+        double m_number = 0;
         int m_count;
+        mutable OpaqueJSContext::CollectionLink m_collection_link;
+
+        friend struct OpaqueJSContext;
 };
 
 #endif //LIQUIDCORE_OPAQUEJSVALUE_H
@@ -5,7 +5,11 @@
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
 #include "JNI/JNI.h"
+#include "BridgeProfiler.h"
+#include "NativeCrypto.h"
+#include "NativeHttp.h"
 #include "NodeInstance.h"
+#include "TraceSpan.h"
 
 #undef NATIVE
 #define NATIVE(package,rt,f) extern "C" JNIEXPORT \
@@ -19,12 +23,284 @@ NATIVE(Process,jlong,start) (PARAMS)
     return reinterpret_cast<jlong>(instance);
 }
 
+static NodeInstance* StartWithConfig(JNIEnv* env, jobject thiz, jint maxOldSpaceMB,
+    jint maxSemiSpaceMB, jint codeRangeMB, jint stackLimitKB, jint heapHeadroomMB,
+    jobjectArray args)
+{
+    NodeInstance::Config config;
+    config.max_old_space_mb = maxOldSpaceMB;
+    config.heap_headroom_mb = heapHeadroomMB < 0 ? 0 : heapHeadroomMB;
+    config.max_semi_space_mb = maxSemiSpaceMB;
+    config.code_range_mb = (size_t) (codeRangeMB < 0 ? 0 : codeRangeMB);
+    config.stack_limit_kb = (size_t) (stackLimitKB < 0 ? 0 : stackLimitKB);
+    jsize count = args ? env->GetArrayLength(args) : 0;
+    for (jsize i = 0; i < count; i++) {
+        jstring arg = (jstring) env->GetObjectArrayElement(args, i);
+        if (!arg) continue;
+        const char *c_string = env->GetStringUTFChars(arg, NULL);
+        config.args.push_back(c_string);
+        env->ReleaseStringUTFChars(arg, c_string);
+        env->DeleteLocalRef(arg);
+    }
+    return new NodeInstance(env, thiz, config);
+}
+
+NATIVE(Process,jlong,startWithConfig) (PARAMS, jint maxOldSpaceMB, jint maxSemiSpaceMB,
+    jint codeRangeMB, jint stackLimitKB, jobjectArray args)
+{
+    return reinterpret_cast<jlong>(StartWithConfig(env, thiz, maxOldSpaceMB, maxSemiSpaceMB,
+        codeRangeMB, stackLimitKB, 0, args));
+}
+
+/*
+ * As startWithConfig, with 'maxOldSpaceMB' a soft limit with 'heapHeadroomMB' behind it.
+ * Pressure is reported to onMemoryPressure(int event, long used, long limit), where event is
+ * 0 = near the limit, 1 = relieved, 2 = terminated.
+ */
+NATIVE(Process,jlong,startWithHeapGuard) (PARAMS, jint maxOldSpaceMB, jint maxSemiSpaceMB,
+    jint codeRangeMB, jint stackLimitKB, jint heapHeadroomMB, jobjectArray args)
+{
+    return reinterpret_cast<jlong>(StartWithConfig(env, thiz, maxOldSpaceMB, maxSemiSpaceMB,
+        codeRangeMB, stackLimitKB, heapHeadroomMB, args));
+}
+
+NATIVE(Process,jlong,claimWarmInstance) (PARAMS)
+{
+    // The returned instance is already running; don't call runInThread on it
+    return reinterpret_cast<jlong>(NodeInstance::ClaimWarmInstance(env, thiz));
+}
+
+NATIVE(Process,void,setWarmPoolSize) (JNIEnv* env, jclass klass, jint size)
+{
+    NodeInstance::SetWarmPoolSize((size_t) (size < 0 ? 0 : size));
+}
+
+NATIVE(Process,void,setIsolateRecycling) (JNIEnv* env, jclass klass, jint maxIsolates)
+{
+    NodeInstance::SetIsolateRecycling((size_t) (maxIsolates < 0 ? 0 : maxIsolates));
+}
+
+NATIVE(Process,void,setThreadPoolSize) (JNIEnv* env, jclass klass, jint size)
+{
+    NodeInstance::SetThreadPoolSize((unsigned) (size < 0 ? 0 : size));
+}
+
+// Spans show up in Perfetto/systrace under the app's process once atrace is capturing it
+NATIVE(Process,void,setTracing) (JNIEnv* env, jclass klass, jboolean enabled)
+{
+    nodedroid::TraceSpan::SetEnabled(enabled == JNI_TRUE);
+}
+
+// Counts and times every JNI call that goes through the JS thread, by entry point
+NATIVE(Process,void,setBridgeProfiling) (JNIEnv* env, jclass klass, jboolean enabled)
+{
+    nodedroid::BridgeProfiler::SetEnabled(enabled == JNI_TRUE);
+}
+
+// process.nativeRequest() and process.fetch() over HttpURLConnection, for instances started after
+NATIVE(Process,void,setNativeHttp) (JNIEnv* env, jclass klass, jboolean enabled)
+{
+    nodedroid::NativeHttp::SetEnabled(enabled == JNI_TRUE);
+}
+
+// Hashes, HMACs, AES and random bytes through the platform's providers, for instances started
+// after
+NATIVE(Process,void,setNativeCrypto) (JNIEnv* env, jclass klass, jboolean enabled)
+{
+    nodedroid::NativeCrypto::SetEnabled(enabled == JNI_TRUE);
+}
+
+NATIVE(Process,jstring,dumpBridgeProfile) (JNIEnv* env, jclass klass, jboolean reset)
+{
+    return env->NewStringUTF(nodedroid::BridgeProfiler::Dump(reset == JNI_TRUE).c_str());
+}
+
 NATIVE(Process,void,runInThread) (PARAMS, jlong ref)
 {
     NodeInstance *instance = reinterpret_cast<NodeInstance*>(ref);
     instance->spawnedThread();
 }
 
+NATIVE(Process,jlongArray,getStartupTimeline) (PARAMS, jlong ref)
+{
+    const NodeInstance::StartupTimeline& t =
+        reinterpret_cast<NodeInstance*>(ref)->Timeline();
+    jlong values[] = {
+        (jlong) t.thread_start.load(),
+        (jlong) t.node_init_done.load(),
+        (jlong) t.v8_init_done.load(),
+        (jlong) t.isolate_ready.load(),
+        (jlong) t.environment_ready.load(),
+        (jlong) t.host_notified.load(),
+        (jlong) t.bootstrap_done.load(),
+        (jlong) t.fs.checks.load(),
+        (jlong) t.fs.check_ns.load(),
+        (jlong) t.fs.module_reads.load(),
+        (jlong) t.fs.module_bytes.load(),
+    };
+    const jsize count = sizeof values / sizeof values[0];
+    jlongArray array = env->NewLongArray(count);
+    env->SetLongArrayRegion(array, 0, count, values);
+    return array;
+}
+
+NATIVE(Process,jlongArray,getResourceUsage) (PARAMS, jlong ref)
+{
+    NodeInstance::ResourceUsage u;
+    if (!reinterpret_cast<NodeInstance*>(ref)->GetResourceUsage(&u)) {
+        return nullptr;
+    }
+    jlong values[] = {
+        (jlong) u.cpu_time_ns,
+        (jlong) u.heap_used,
+        (jlong) u.heap_limit,
+        (jlong) u.external_memory,
+        (jlong) u.open_handles,
+        (jlong) u.loop_iterations,
+        (jlong) u.lag_p50_ns,
+        (jlong) u.lag_p90_ns,
+        (jlong) u.lag_p99_ns,
+        (jlong) u.lag_max_ns,
+    };
+    const jsize count = sizeof values / sizeof values[0];
+    jlongArray array = env->NewLongArray(count);
+    env->SetLongArrayRegion(array, 0, count, values);
+    return array;
+}
+
+NATIVE(Process,void,setLongTaskThreshold) (PARAMS, jlong ref, jint thresholdMs)
+{
+    NodeInstance *instance = reinterpret_cast<NodeInstance*>(ref);
+    if (thresholdMs <= 0) {
+        instance->SetLongTaskMonitor(0, nullptr);
+        return;
+    }
+
+    JavaVM *jvm;
+    env->GetJavaVM(&jvm);
+    auto with_env = [jvm](std::function<void(JNIEnv*)> fn) {
+        bool detach;
+        JNIEnv *env = threadEnv(jvm, detach);
+        fn(env);
+        if (detach) {
+            jvm->DetachCurrentThread();
+        }
+    };
+    // Let go of when the last copy of the callback goes
+    std::shared_ptr<_jobject> process(env->NewGlobalRef(thiz), [with_env](jobject ref) {
+        with_env([ref](JNIEnv *env) { env->DeleteGlobalRef(ref); });
+    });
+
+    instance->SetLongTaskMonitor((unsigned) thresholdMs,
+        [with_env, process](uint64_t busy_ns, const std::string& stack) {
+            with_env([&](JNIEnv *env) {
+                jmethodID mid = findMethod(env, process.get(), "onLongTask",
+                                           "(JLjava/lang/String;)V");
+                if (mid != nullptr) {
+                    jstring jstack = env->NewStringUTF(stack.c_str());
+                    env->CallVoidMethod(process.get(), mid, (jlong) busy_ns, jstack);
+                    env->DeleteLocalRef(jstack);
+                }
+            });
+        });
+}
+
+/*
+ * Also CPU profiles each long task caught while running, into 'dir' (null to stop)
+ */
+NATIVE(Process,void,setLongTaskProfiling) (PARAMS, jlong ref, jstring dir_, jint intervalUs)
+{
+    std::string dir;
+    if (dir_) {
+        const char *c_dir = env->GetStringUTFChars(dir_, nullptr);
+        dir = c_dir;
+        env->ReleaseStringUTFChars(dir_, c_dir);
+    }
+    reinterpret_cast<NodeInstance*>(ref)->SetLongTaskProfiling(dir, intervalUs);
+}
+
+/*
+ * Console output at 'minLevel' and up (0 = debug, 1 = log/info, 2 = warn, 3 = error, 4 = none)
+ * goes to onLogMessages(int[] levels, String[] messages) in batches if 'toHost', otherwise to
+ * Logcat
+ */
+NATIVE(Process,void,setLogSink) (PARAMS, jlong ref, jint minLevel, jboolean toHost)
+{
+    NodeInstance *instance = reinterpret_cast<NodeInstance*>(ref);
+    if (minLevel < nodedroid::kLogDebug || minLevel > nodedroid::kLogOff) {
+        minLevel = nodedroid::kLogOff;
+    }
+    if (!toHost) {
+        instance->SetLogSink((nodedroid::LogLevel) minLevel, nullptr);
+        return;
+    }
+
+    JavaVM *jvm;
+    env->GetJavaVM(&jvm);
+    auto with_env = [jvm](std::function<void(JNIEnv*)> fn) {
+        bool detach;
+        JNIEnv *env = threadEnv(jvm, detach);
+        fn(env);
+        if (detach) {
+            jvm->DetachCurrentThread();
+        }
+    };
+    std::shared_ptr<_jobject> process(env->NewGlobalRef(thiz), [with_env](jobject ref) {
+        with_env([ref](JNIEnv *env) { env->DeleteGlobalRef(ref); });
+    });
+
+    instance->SetLogSink((nodedroid::LogLevel) minLevel,
+        [with_env, process](const nodedroid::LogRecord *records, size_t count) {
+            with_env([&](JNIEnv *env) {
+                jmethodID mid = findMethod(env, process.get(), "onLogMessages",
+                                           "([I[Ljava/lang/String;)V");
+                if (mid == nullptr) return;
+
+                const jsize length = (jsize) count;
+                std::vector<jint> levels(count);
+                jclass string_class = env->FindClass("java/lang/String");
+                jobjectArray messages = env->NewObjectArray(length, string_class, nullptr);
+                for (jsize i = 0; i < length; i++) {
+                    levels[i] = records[i].level;
+                    jstring message = env->NewStringUTF(records[i].text.c_str());
+                    env->SetObjectArrayElement(messages, i, message);
+                    env->DeleteLocalRef(message);
+                }
+                jintArray jlevels = env->NewIntArray(length);
+                env->SetIntArrayRegion(jlevels, 0, length, levels.data());
+                env->CallVoidMethod(process.get(), mid, jlevels, messages);
+                env->DeleteLocalRef(jlevels);
+                env->DeleteLocalRef(messages);
+                env->DeleteLocalRef(string_class);
+            });
+        });
+}
+
+/*
+ * 0 = default, 1 = interactive, 2 = utility, 3 = background (slow cores only)
+ */
+NATIVE(Process,void,setThreadClass) (PARAMS, jlong ref, jint threadClass)
+{
+    if (threadClass < nodedroid::kThreadDefault || threadClass > nodedroid::kThreadBackground) {
+        threadClass = nodedroid::kThreadDefault;
+    }
+    reinterpret_cast<NodeInstance*>(ref)->SetThreadClass(
+        static_cast<nodedroid::ThreadClass>(threadClass));
+}
+
+NATIVE(Process,void,setThrottle) (PARAMS, jlong ref, jint minIntervalMs)
+{
+    reinterpret_cast<NodeInstance*>(ref)->SetThrottle(
+        (unsigned) (minIntervalMs < 0 ? 0 : minIntervalMs));
+}
+
+NATIVE(Process,void,notifyIdle) (PARAMS, jlong ref, jint deadlineMs)
+{
+    if (deadlineMs > 0) {
+        reinterpret_cast<NodeInstance*>(ref)->NotifyIdle((unsigned) deadlineMs);
+    }
+}
+
 NATIVE(Process,void,dispose) (PARAMS, jlong ref)
 {
     delete reinterpret_cast<NodeInstance*>(ref);
@@ -45,6 +321,9 @@ NATIVE(Process,void,setFileSystem) (PARAMS, jlong contextRef, jlong fsObjectRef)
         Local<Private> privateKey = v8::Private::ForApi(isolate,
                                                         String::NewFromUtf8(isolate, "__fs"));
         globalObj->SetPrivate(context, privateKey, fsObj);
+        nodedroid::PathPolicy::Install(context, fsObj);
+        nodedroid::InvalidateSandbox();
+        nodedroid::InvalidateModuleStatCache();
 
     V8_UNLOCK();
 }
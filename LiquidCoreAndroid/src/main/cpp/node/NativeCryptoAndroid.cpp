@@ -0,0 +1,410 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <cstdlib>
+#include <mutex>
+#include "JNI/JNI.h"
+#include "NativeCrypto.h"
+
+/*
+ * NativeCrypto over the java.security and javax.crypto providers, which Conscrypt backs with
+ * BoringSSL and the CPU's AES and SHA instructions.  Every call crosses JNI, so digests hold
+ * small updates back and pass them on in bulk.  Random bytes come straight from bionic's
+ * arc4random_buf(), over the kernel's generator.
+ */
+
+namespace nodedroid {
+
+namespace {
+
+// Held back until there is this much, or the digest is finished
+const size_t kDigestBatch = 16 * 1024;
+
+struct Classes {
+    jclass messageDigest;
+    jmethodID messageDigestGetInstance;
+    jmethodID messageDigestUpdate;
+    jmethodID messageDigestDigest;
+    jclass mac;
+    jmethodID macGetInstance;
+    jmethodID macInit;
+    jmethodID macUpdate;
+    jmethodID macDoFinal;
+    jclass cipher;
+    jmethodID cipherGetInstance;
+    jmethodID cipherInit;
+    jmethodID cipherUpdateAAD;
+    jmethodID cipherUpdate;
+    jmethodID cipherDoFinal;
+    jmethodID cipherDoFinalWith;
+    jclass secretKeySpec;
+    jmethodID secretKeySpecInit;
+    jclass ivParameterSpec;
+    jmethodID ivParameterSpecInit;
+    jclass gcmParameterSpec;
+    jmethodID gcmParameterSpecInit;
+};
+Classes s_classes;
+bool s_loaded = false;
+std::once_flag s_once;
+
+jclass Global(JNIEnv *env, const char *name)
+{
+    jclass local = env->FindClass(name);
+    if (!local) {
+        env->ExceptionClear();
+        return nullptr;
+    }
+    jclass global = (jclass) env->NewGlobalRef(local);
+    env->DeleteLocalRef(local);
+    return global;
+}
+
+// The calling thread's env for the life of a call
+class Env {
+public:
+    Env() : m_env(threadEnv(javaVM(), m_detach))
+    {
+        std::call_once(s_once, Load, m_env);
+    }
+    ~Env()
+    {
+        if (m_detach) {
+            javaVM()->DetachCurrentThread();
+        }
+    }
+    inline JNIEnv* operator->() const { return m_env; }
+    inline operator JNIEnv*() const { return m_env; }
+    // Clears whatever was thrown, and says whether anything was
+    inline bool Failed() const
+    {
+        if (!m_env->ExceptionCheck()) return false;
+        m_env->ExceptionClear();
+        return true;
+    }
+
+private:
+    static void Load(JNIEnv *env)
+    {
+        Classes& c = s_classes;
+        c.messageDigest = Global(env, "java/security/MessageDigest");
+        c.mac = Global(env, "javax/crypto/Mac");
+        c.cipher = Global(env, "javax/crypto/Cipher");
+        c.secretKeySpec = Global(env, "javax/crypto/spec/SecretKeySpec");
+        c.ivParameterSpec = Global(env, "javax/crypto/spec/IvParameterSpec");
+        c.gcmParameterSpec = Global(env, "javax/crypto/spec/GCMParameterSpec");
+        if (!c.messageDigest || !c.mac || !c.cipher || !c.secretKeySpec || !c.ivParameterSpec) {
+            return;
+        }
+        c.messageDigestGetInstance = env->GetStaticMethodID(c.messageDigest, "getInstance",
+            "(Ljava/lang/String;)Ljava/security/MessageDigest;");
+        c.messageDigestUpdate = env->GetMethodID(c.messageDigest, "update", "([BII)V");
+        c.messageDigestDigest = env->GetMethodID(c.messageDigest, "digest", "()[B");
+        c.macGetInstance = env->GetStaticMethodID(c.mac, "getInstance",
+            "(Ljava/lang/String;)Ljavax/crypto/Mac;");
+        c.macInit = env->GetMethodID(c.mac, "init", "(Ljava/security/Key;)V");
+        c.macUpdate = env->GetMethodID(c.mac, "update", "([BII)V");
+        c.macDoFinal = env->GetMethodID(c.mac, "doFinal", "()[B");
+        c.cipherGetInstance = env->GetStaticMethodID(c.cipher, "getInstance",
+            "(Ljava/lang/String;)Ljavax/crypto/Cipher;");
+        c.cipherInit = env->GetMethodID(c.cipher, "init",
+            "(ILjava/security/Key;Ljava/security/spec/AlgorithmParameterSpec;)V");
+        c.cipherUpdateAAD = env->GetMethodID(c.cipher, "updateAAD", "([B)V");
+        c.cipherUpdate = env->GetMethodID(c.cipher, "update", "([B)[B");
+        c.cipherDoFinal = env->GetMethodID(c.cipher, "doFinal", "()[B");
+        c.cipherDoFinalWith = env->GetMethodID(c.cipher, "doFinal", "([B)[B");
+        c.secretKeySpecInit = env->GetMethodID(c.secretKeySpec, "<init>",
+            "([BLjava/lang/String;)V");
+        c.ivParameterSpecInit = env->GetMethodID(c.ivParameterSpec, "<init>", "([B)V");
+        // API 19 and on
+        if (c.gcmParameterSpec) {
+            c.gcmParameterSpecInit = env->GetMethodID(c.gcmParameterSpec, "<init>", "(I[B)V");
+        }
+        s_loaded = !env->ExceptionCheck();
+        env->ExceptionClear();
+    }
+
+    bool m_detach;
+    JNIEnv *m_env;
+};
+
+jbyteArray NewBytes(JNIEnv *env, const unsigned char *data, size_t length)
+{
+    jbyteArray array = env->NewByteArray((jsize) length);
+    if (array) {
+        env->SetByteArrayRegion(array, 0, (jsize) length, reinterpret_cast<const jbyte*>(data));
+    }
+    return array;
+}
+
+// Appends |array|, which may be null, to |out|
+void Append(JNIEnv *env, jbyteArray array, std::vector<unsigned char>& out)
+{
+    if (!array) return;
+    const size_t start = out.size();
+    out.resize(start + env->GetArrayLength(array));
+    env->GetByteArrayRegion(array, 0, (jsize) (out.size() - start),
+                            reinterpret_cast<jbyte*>(out.data() + start));
+    env->DeleteLocalRef(array);
+}
+
+jstring NewString(JNIEnv *env, const char *string)
+{
+    return env->NewStringUTF(string);
+}
+
+jobject NewKey(JNIEnv *env, const unsigned char *key, size_t key_length, const char *algorithm)
+{
+    jbyteArray bytes = NewBytes(env, key, key_length);
+    jstring name = NewString(env, algorithm);
+    jobject spec = env->NewObject(s_classes.secretKeySpec, s_classes.secretKeySpecInit,
+                                  bytes, name);
+    env->DeleteLocalRef(name);
+    env->DeleteLocalRef(bytes);
+    return spec;
+}
+
+const char *JavaName(NativeCrypto::Algorithm algorithm, bool hmac)
+{
+    switch (algorithm) {
+        case NativeCrypto::kSHA1:   return hmac ? "HmacSHA1" : "SHA-1";
+        case NativeCrypto::kSHA256: return hmac ? "HmacSHA256" : "SHA-256";
+        case NativeCrypto::kSHA512: return hmac ? "HmacSHA512" : "SHA-512";
+    }
+    return nullptr;
+}
+
+// A MessageDigest or a Mac, which share the calls that matter here
+class JavaDigest : public NativeCrypto::Digest {
+public:
+    JavaDigest(jobject object, jmethodID update, jmethodID final) :
+        m_object(object), m_update(update), m_final(final) {}
+    ~JavaDigest() override
+    {
+        Env env;
+        env->DeleteGlobalRef(m_object);
+    }
+    bool Update(const unsigned char *data, size_t length) override
+    {
+        if (m_pending.size() + length < kDigestBatch) {
+            m_pending.insert(m_pending.end(), data, data + length);
+            return true;
+        }
+        Env env;
+        return Flush(env) && Pass(env, data, length);
+    }
+    bool Final(unsigned char *out) override
+    {
+        Env env;
+        if (!Flush(env)) return false;
+        jbyteArray digest = (jbyteArray) env->CallObjectMethod(m_object, m_final);
+        if (env.Failed() || !digest) return false;
+        const jsize length = env->GetArrayLength(digest);
+        if ((size_t) length <= NativeCrypto::kMaxDigestLength) {
+            env->GetByteArrayRegion(digest, 0, length, reinterpret_cast<jbyte*>(out));
+        }
+        env->DeleteLocalRef(digest);
+        return (size_t) length <= NativeCrypto::kMaxDigestLength;
+    }
+
+private:
+    bool Flush(const Env& env)
+    {
+        if (m_pending.empty()) return true;
+        const bool ok = Pass(env, m_pending.data(), m_pending.size());
+        m_pending.clear();
+        return ok;
+    }
+    bool Pass(const Env& env, const unsigned char *data, size_t length)
+    {
+        if (!length) return true;
+        jbyteArray bytes = NewBytes(env, data, length);
+        if (!bytes) {
+            env.Failed();
+            return false;
+        }
+        env->CallVoidMethod(m_object, m_update, bytes, 0, (jint) length);
+        env->DeleteLocalRef(bytes);
+        return !env.Failed();
+    }
+
+    jobject m_object;
+    jmethodID m_update;
+    jmethodID m_final;
+    std::vector<unsigned char> m_pending;
+};
+
+// Made on first use, once the padding is settled
+class JavaCipher : public NativeCrypto::Cipher {
+public:
+    explicit JavaCipher(const Params& params) : Cipher(params) {}
+    ~JavaCipher() override
+    {
+        if (m_cipher) {
+            Env env;
+            env->DeleteGlobalRef(m_cipher);
+        }
+    }
+    bool SetAAD(const unsigned char *data, size_t length) override
+    {
+        Env env;
+        if (!Create(env)) return false;
+        jbyteArray bytes = NewBytes(env, data, length);
+        env->CallVoidMethod(m_cipher, s_classes.cipherUpdateAAD, bytes);
+        env->DeleteLocalRef(bytes);
+        return !env.Failed();
+    }
+    bool Update(const unsigned char *data, size_t length,
+                std::vector<unsigned char>& out) override
+    {
+        Env env;
+        if (!Create(env)) return false;
+        if (!length) return true;
+        jbyteArray bytes = NewBytes(env, data, length);
+        jbyteArray result = (jbyteArray) env->CallObjectMethod(m_cipher,
+            s_classes.cipherUpdate, bytes);
+        env->DeleteLocalRef(bytes);
+        if (env.Failed()) return false;
+        Append(env, result, out);
+        return true;
+    }
+    bool Final(std::vector<unsigned char>& out) override
+    {
+        Env env;
+        if (!Create(env)) return false;
+        const bool gcm = params.mode == NativeCrypto::kGCM;
+        jbyteArray result;
+        if (gcm && !params.encrypt) {
+            // The tag is expected as the tail of the ciphertext
+            if (auth_tag.size() != NativeCrypto::kGcmTagLength) return false;
+            jbyteArray tag = NewBytes(env, auth_tag.data(), auth_tag.size());
+            result = (jbyteArray) env->CallObjectMethod(m_cipher,
+                s_classes.cipherDoFinalWith, tag);
+            env->DeleteLocalRef(tag);
+        } else {
+            result = (jbyteArray) env->CallObjectMethod(m_cipher, s_classes.cipherDoFinal);
+        }
+        if (env.Failed()) return false;
+        const size_t start = out.size();
+        Append(env, result, out);
+        if (gcm && params.encrypt) {
+            // And is produced as the tail of it
+            if (out.size() - start < NativeCrypto::kGcmTagLength) return false;
+            auth_tag.assign(out.end() - NativeCrypto::kGcmTagLength, out.end());
+            out.resize(out.size() - NativeCrypto::kGcmTagLength);
+        }
+        return true;
+    }
+
+private:
+    bool Create(const Env& env)
+    {
+        if (m_cipher) return true;
+        const char *transformation;
+        jobject spec;
+        jbyteArray iv = NewBytes(env, params.iv.data(), params.iv.size());
+        switch (params.mode) {
+            case NativeCrypto::kCBC:
+                transformation = params.padding ? "AES/CBC/PKCS5Padding" : "AES/CBC/NoPadding";
+                spec = env->NewObject(s_classes.ivParameterSpec,
+                                      s_classes.ivParameterSpecInit, iv);
+                break;
+            case NativeCrypto::kCTR:
+                transformation = "AES/CTR/NoPadding";
+                spec = env->NewObject(s_classes.ivParameterSpec,
+                                      s_classes.ivParameterSpecInit, iv);
+                break;
+            default:
+                transformation = "AES/GCM/NoPadding";
+                spec = env->NewObject(s_classes.gcmParameterSpec,
+                                      s_classes.gcmParameterSpecInit,
+                                      (jint) (NativeCrypto::kGcmTagLength * 8), iv);
+                break;
+        }
+        env->DeleteLocalRef(iv);
+        if (env.Failed()) return false;
+
+        jstring name = NewString(env, transformation);
+        jobject cipher = env->CallStaticObjectMethod(s_classes.cipher,
+            s_classes.cipherGetInstance, name);
+        env->DeleteLocalRef(name);
+        if (env.Failed()) {
+            env->DeleteLocalRef(spec);
+            return false;
+        }
+        jobject key = NewKey(env, params.key.data(), params.key.size(), "AES");
+        // Cipher.ENCRYPT_MODE and DECRYPT_MODE
+        env->CallVoidMethod(cipher, s_classes.cipherInit, (jint) (params.encrypt ? 1 : 2),
+                            key, spec);
+        env->DeleteLocalRef(key);
+        env->DeleteLocalRef(spec);
+        if (!env.Failed()) {
+            m_cipher = env->NewGlobalRef(cipher);
+        }
+        env->DeleteLocalRef(cipher);
+        return m_cipher != nullptr;
+    }
+
+    jobject m_cipher = nullptr;
+};
+
+} /* namespace */
+
+std::unique_ptr<NativeCrypto::Digest> NativeCrypto::NewHash(Algorithm algorithm)
+{
+    Env env;
+    if (!s_loaded) return nullptr;
+    jstring name = NewString(env, JavaName(algorithm, false));
+    jobject digest = env->CallStaticObjectMethod(s_classes.messageDigest,
+        s_classes.messageDigestGetInstance, name);
+    env->DeleteLocalRef(name);
+    if (env.Failed()) return nullptr;
+    jobject global = env->NewGlobalRef(digest);
+    env->DeleteLocalRef(digest);
+    return std::unique_ptr<Digest>(new JavaDigest(global, s_classes.messageDigestUpdate,
+                                                  s_classes.messageDigestDigest));
+}
+
+std::unique_ptr<NativeCrypto::Digest> NativeCrypto::NewHmac(Algorithm algorithm,
+    const unsigned char *key, size_t key_length)
+{
+    Env env;
+    // SecretKeySpec won't take an empty key, though HMAC will
+    if (!s_loaded || !key_length) return nullptr;
+    const char *java_name = JavaName(algorithm, true);
+    jstring name = NewString(env, java_name);
+    jobject mac = env->CallStaticObjectMethod(s_classes.mac, s_classes.macGetInstance, name);
+    env->DeleteLocalRef(name);
+    if (env.Failed()) return nullptr;
+    jobject spec = NewKey(env, key, key_length, java_name);
+    if (!env.Failed()) {
+        env->CallVoidMethod(mac, s_classes.macInit, spec);
+    }
+    env->DeleteLocalRef(spec);
+    if (env.Failed()) {
+        env->DeleteLocalRef(mac);
+        return nullptr;
+    }
+    jobject global = env->NewGlobalRef(mac);
+    env->DeleteLocalRef(mac);
+    return std::unique_ptr<Digest>(new JavaDigest(global, s_classes.macUpdate,
+                                                  s_classes.macDoFinal));
+}
+
+std::unique_ptr<NativeCrypto::Cipher> NativeCrypto::NewCipher(const Cipher::Params& params)
+{
+    Env env;
+    if (!s_loaded || (params.mode == kGCM && !s_classes.gcmParameterSpec)) return nullptr;
+    return std::unique_ptr<Cipher>(new JavaCipher(params));
+}
+
+bool NativeCrypto::RandomFill(unsigned char *out, size_t length)
+{
+    arc4random_buf(out, length);
+    return true;
+}
+
+} /* namespace nodedroid */
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <thread>
+#include "JNI/JNI.h"
+#include "NativeHttp.h"
+
+/*
+ * NativeHttp over java.net.HttpURLConnection, one attached thread per request.  Whatever
+ * HTTP client the platform backs it with (OkHttp, on every release in use) brings the
+ * system's pool, proxy and trust settings with it.
+ */
+
+namespace nodedroid {
+
+namespace {
+
+// Holds a pending Java exception's toString() in |error|, and clears it
+bool Failed(JNIEnv *env, std::string& error)
+{
+    jthrowable exception = env->ExceptionOccurred();
+    if (!exception) return false;
+    env->ExceptionClear();
+    jclass cls = env->FindClass("java/lang/Throwable");
+    jmethodID toString = env->GetMethodID(cls, "toString", "()Ljava/lang/String;");
+    jstring message = (jstring) env->CallObjectMethod(exception, toString);
+    if (message && !env->ExceptionCheck()) {
+        const char *c_message = env->GetStringUTFChars(message, nullptr);
+        error = c_message;
+        env->ReleaseStringUTFChars(message, c_message);
+        env->DeleteLocalRef(message);
+    } else {
+        env->ExceptionClear();
+        error = "Request failed";
+    }
+    env->DeleteLocalRef(cls);
+    env->DeleteLocalRef(exception);
+    return true;
+}
+
+std::string ToString(JNIEnv *env, jstring string)
+{
+    std::string out;
+    if (string) {
+        const char *c_string = env->GetStringUTFChars(string, nullptr);
+        out = c_string;
+        env->ReleaseStringUTFChars(string, c_string);
+    }
+    return out;
+}
+
+void Exchange(JNIEnv *env, std::shared_ptr<NativeHttp::Request> request)
+{
+    std::string error;
+    jclass urlClass = env->FindClass("java/net/URL");
+    jclass connectionClass = env->FindClass("java/net/HttpURLConnection");
+    jclass streamClass = env->FindClass("java/io/InputStream");
+
+    jstring jurl = env->NewStringUTF(request->url.c_str());
+    jobject url = env->NewObject(urlClass,
+        env->GetMethodID(urlClass, "<init>", "(Ljava/lang/String;)V"), jurl);
+    env->DeleteLocalRef(jurl);
+    if (Failed(env, error)) return request->OnComplete(error);
+
+    jobject local = env->CallObjectMethod(url,
+        env->GetMethodID(urlClass, "openConnection", "()Ljava/net/URLConnection;"));
+    if (Failed(env, error)) return request->OnComplete(error);
+    if (!env->IsInstanceOf(local, connectionClass)) {
+        return request->OnComplete("Not an HTTP(S) URL: " + request->url);
+    }
+    jobject connection = env->NewGlobalRef(local);
+    env->DeleteLocalRef(local);
+    // The canceller refers to both from another thread
+    connectionClass = (jclass) env->NewGlobalRef(connectionClass);
+
+    // From the instance's thread, which may or may not be attached
+    JavaVM *jvm = javaVM();
+    request->SetCanceller([jvm, connection, connectionClass]() {
+        bool detach;
+        JNIEnv *env = threadEnv(jvm, detach);
+        env->CallVoidMethod(connection,
+            env->GetMethodID(connectionClass, "disconnect", "()V"));
+        env->ExceptionClear();
+        if (detach) {
+            jvm->DetachCurrentThread();
+        }
+    });
+
+#define CALL(type, name, sig, ...) \
+    env->Call##type##Method(connection, \
+        env->GetMethodID(connectionClass, name, sig), ##__VA_ARGS__)
+
+    jstring method = env->NewStringUTF(request->method.c_str());
+    CALL(Void, "setRequestMethod", "(Ljava/lang/String;)V", method);
+    env->DeleteLocalRef(method);
+    if (request->timeout_ms) {
+        CALL(Void, "setConnectTimeout", "(I)V", (jint) request->timeout_ms);
+        CALL(Void, "setReadTimeout", "(I)V", (jint) request->timeout_ms);
+    }
+    CALL(Void, "setInstanceFollowRedirects", "(Z)V", JNI_TRUE);
+    for (auto& header : request->headers) {
+        jstring key = env->NewStringUTF(header.first.c_str());
+        jstring value = env->NewStringUTF(header.second.c_str());
+        CALL(Void, "addRequestProperty", "(Ljava/lang/String;Ljava/lang/String;)V", key, value);
+        env->DeleteLocalRef(key);
+        env->DeleteLocalRef(value);
+    }
+
+    if (!Failed(env, error) && !request->body.empty()) {
+        CALL(Void, "setDoOutput", "(Z)V", JNI_TRUE);
+        CALL(Void, "setFixedLengthStreamingMode", "(I)V", (jint) request->body.size());
+        jobject out = CALL(Object, "getOutputStream", "()Ljava/io/OutputStream;");
+        if (!Failed(env, error)) {
+            jclass outClass = env->GetObjectClass(out);
+            jbyteArray bytes = env->NewByteArray((jsize) request->body.size());
+            env->SetByteArrayRegion(bytes, 0, (jsize) request->body.size(),
+                                    reinterpret_cast<const jbyte*>(request->body.data()));
+            env->CallVoidMethod(out, env->GetMethodID(outClass, "write", "([B)V"), bytes);
+            env->CallVoidMethod(out, env->GetMethodID(outClass, "close", "()V"));
+            env->DeleteLocalRef(bytes);
+            env->DeleteLocalRef(outClass);
+            env->DeleteLocalRef(out);
+        }
+    }
+
+    jint status = 0;
+    if (!Failed(env, error)) {
+        status = CALL(Int, "getResponseCode", "()I");
+        Failed(env, error);
+    }
+    if (error.empty()) {
+        NativeHttp::Headers headers;
+        // Index 0 is the status line, with no key
+        for (jint i = 1;; i++) {
+            jstring key = (jstring) CALL(Object, "getHeaderFieldKey", "(I)Ljava/lang/String;", i);
+            if (!key || env->ExceptionCheck()) break;
+            jstring value = (jstring) CALL(Object, "getHeaderField", "(I)Ljava/lang/String;", i);
+            headers.emplace_back(ToString(env, key), ToString(env, value));
+            env->DeleteLocalRef(key);
+            if (value) env->DeleteLocalRef(value);
+        }
+        env->ExceptionClear();
+        jobject finalUrl = CALL(Object, "getURL", "()Ljava/net/URL;");
+        jstring finalString = (jstring) env->CallObjectMethod(finalUrl,
+            env->GetMethodID(urlClass, "toString", "()Ljava/lang/String;"));
+        request->OnResponse(status, std::move(headers), ToString(env, finalString));
+        env->DeleteLocalRef(finalString);
+        env->DeleteLocalRef(finalUrl);
+
+        // An error status has its body on the error stream, if it has one at all
+        jobject in = status >= 400 ?
+            CALL(Object, "getErrorStream", "()Ljava/io/InputStream;") :
+            CALL(Object, "getInputStream", "()Ljava/io/InputStream;");
+        if (!Failed(env, error) && in) {
+            const jsize kChunk = 64 * 1024;
+            jbyteArray chunk = env->NewByteArray(kChunk);
+            jmethodID read = env->GetMethodID(streamClass, "read", "([B)I");
+            jbyte *bytes = new jbyte[kChunk];
+            while (!request->Cancelled()) {
+                jint count = env->CallIntMethod(in, read, chunk);
+                if (Failed(env, error) || count < 0) break;
+                env->GetByteArrayRegion(chunk, 0, count, bytes);
+                request->OnData(bytes, (size_t) count);
+            }
+            delete[] bytes;
+            env->CallVoidMethod(in, env->GetMethodID(streamClass, "close", "()V"));
+            env->ExceptionClear();
+            env->DeleteLocalRef(chunk);
+            env->DeleteLocalRef(in);
+        }
+    }
+#undef CALL
+
+    request->SetCanceller(nullptr);
+    request->OnComplete(request->Cancelled() ? "Aborted" : error);
+    env->CallVoidMethod(connection, env->GetMethodID(connectionClass, "disconnect", "()V"));
+    env->ExceptionClear();
+    env->DeleteGlobalRef(connectionClass);
+    env->DeleteGlobalRef(connection);
+    env->DeleteLocalRef(url);
+}
+
+} /* namespace */
+
+void NativeHttp::Start(std::shared_ptr<Request> request)
+{
+    JavaVM *jvm = javaVM();
+    std::thread([jvm, request]() {
+        attachThread(jvm, "LiquidCore http");
+        bool detach;
+        JNIEnv *env = threadEnv(jvm, detach);
+        env->PushLocalFrame(32);
+        Exchange(env, request);
+        env->PopLocalFrame(nullptr);
+        if (detach) {
+            jvm->DetachCurrentThread();
+        }
+        detachThread(jvm);
+    }).detach();
+}
+
+} /* namespace nodedroid */
@@ -8,23 +8,51 @@
 #define _LIQUIDCORE_ADDON_H
 
 #include "v8.h"
+#include "node.h"
 
-namespace LiquidCore
-{
+/*
+ * Registers an addon that is linked into the app binary rather than shipped as its own
+ * library.  process.dlopen() then finds it by module name (the basename of the .node file,
+ * without the extension) with a single lookup.  Use LIQUIDCORE_STATIC_ADDON or
+ * LIQUIDCORE_STATIC_ADDON_CONTEXT_AWARE at file scope in place of NODE_MODULE.
+ */
+extern "C" NODE_EXTERN void liquidcore_register_static_addon(node::node_module *mp);
 
-inline v8::MaybeLocal<v8::Value> resolve(v8::Local<v8::Value> filename)
-{
-  v8::Local<v8::String> s_resolve = v8::String::NewFromUtf8(v8::Isolate::GetCurrent(),
-          "process.binding('fs').resolve", v8::String::NewStringType::kNormalString);
+#define LIQUIDCORE_STATIC_ADDON_X(modname, regfunc, ctxfunc)          \
+  extern "C" {                                                        \
+    static node::node_module _lc_module_ ## modname =                 \
+    {                                                                 \
+      NODE_MODULE_VERSION,                                            \
+      0,                                                              \
+      NULL,                                                           \
+      __FILE__,                                                       \
+      (node::addon_register_func) (regfunc),                          \
+      (node::addon_context_register_func) (ctxfunc),                  \
+      NODE_STRINGIFY(modname),                                        \
+      NULL,                                                           \
+      NULL                                                            \
+    };                                                                \
+    NODE_C_CTOR(_lc_register_ ## modname) {                           \
+      liquidcore_register_static_addon(&_lc_module_ ## modname);      \
+    }                                                                 \
+  }
 
-  v8::Local<v8::Context> context = v8::Isolate::GetCurrent()->GetCurrentContext();
-  v8::Local<v8::Script> script = v8::Script::Compile(context, s_resolve).ToLocalChecked();
-  v8::Local<v8::Function> resolve = script->Run(context).ToLocalChecked().As<v8::Function>();
+#define LIQUIDCORE_STATIC_ADDON(modname, regfunc)                     \
+  LIQUIDCORE_STATIC_ADDON_X(modname, regfunc, NULL)
 
-  v8::MaybeLocal<v8::Value> location = resolve->Call(context,
-   v8::Undefined(v8::Isolate::GetCurrent()), 1, &filename);
-  return location;
-}
+#define LIQUIDCORE_STATIC_ADDON_CONTEXT_AWARE(modname, regfunc)       \
+  LIQUIDCORE_STATIC_ADDON_X(modname, NULL, regfunc)
+
+namespace LiquidCore
+{
+
+/*
+ * Where |filename| (as the addon's JavaScript sees it) really is, through the instance's
+ * sandbox, or an empty handle with a pending exception if the addon may not read it.  Must be
+ * called on the instance's thread, with its context entered.  Absolute paths are remembered,
+ * so asking again costs a lookup.
+ */
+NODE_EXTERN v8::MaybeLocal<v8::Value> resolve(v8::Local<v8::Value> filename);
 
 }
 
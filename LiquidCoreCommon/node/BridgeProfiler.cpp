@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include "BridgeProfiler.h"
+
+using namespace nodedroid;
+
+std::atomic<bool> BridgeProfiler::s_enabled(false);
+
+namespace {
+
+// Bucket i holds latencies in (2^(i-1), 2^i] nanoseconds; the last one holds everything longer
+const int kBuckets = 40;
+
+struct Histogram {
+    uint64_t buckets[kBuckets] = {};
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+
+    void Add(uint64_t ns)
+    {
+        int bucket = 0;
+        while (bucket < kBuckets - 1 && ((uint64_t) 1 << bucket) < ns) bucket++;
+        buckets[bucket]++;
+        total_ns += ns;
+        max_ns = std::max(max_ns, ns);
+    }
+
+    // The bound of the bucket the percentile falls in
+    uint64_t Percentile(uint64_t calls, double p) const
+    {
+        uint64_t target = (uint64_t) (p * calls), seen = 0;
+        for (int i = 0; i < kBuckets; i++) {
+            seen += buckets[i];
+            if (seen > target) return std::min((uint64_t) 1 << i, max_ns);
+        }
+        return max_ns;
+    }
+
+    std::string ToJSON(uint64_t calls) const
+    {
+        std::string json = "{\"total_ns\":" + std::to_string(total_ns);
+        json += ",\"max_ns\":" + std::to_string(max_ns);
+        json += ",\"p50_ns\":" + std::to_string(Percentile(calls, 0.50));
+        json += ",\"p99_ns\":" + std::to_string(Percentile(calls, 0.99));
+        json += ",\"histogram\":[";
+        bool first = true;
+        for (int i = 0; i < kBuckets; i++) {
+            if (!buckets[i]) continue;
+            if (!first) json += ",";
+            first = false;
+            json += "[" + std::to_string((uint64_t) 1 << i) + "," + std::to_string(buckets[i]) + "]";
+        }
+        return json + "]}";
+    }
+};
+
+struct EntryPoint {
+    uint64_t calls = 0;
+    Histogram wait;
+    Histogram exec;
+};
+
+std::mutex s_mutex;
+std::map<std::string, EntryPoint> s_entry_points;
+
+} /* namespace */
+
+void BridgeProfiler::Record(const char *name, uint64_t wait_ns, uint64_t exec_ns)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    EntryPoint& entry = s_entry_points[name];
+    entry.calls++;
+    entry.wait.Add(wait_ns);
+    entry.exec.Add(exec_ns);
+}
+
+std::string BridgeProfiler::Dump(bool reset)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    std::string json = "{\"entry_points\":[";
+    bool first = true;
+    for (auto& it : s_entry_points) {
+        if (!first) json += ",";
+        first = false;
+        json += "{\"name\":\"" + it.first + "\"";
+        json += ",\"calls\":" + std::to_string(it.second.calls);
+        json += ",\"wait\":" + it.second.wait.ToJSON(it.second.calls);
+        json += ",\"exec\":" + it.second.exec.ToJSON(it.second.calls);
+        json += "}";
+    }
+    if (reset) s_entry_points.clear();
+    return json + "]}";
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_BRIDGEPROFILER_H
+#define NODEDROID_BRIDGEPROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace nodedroid {
+
+/*
+ * Counts calls across the host/JS bridge by entry point, with a latency histogram for each of
+ * the two halves of a call: the wait to get onto the JS thread, and the work done once there.
+ * Meant to be sampled in production to find the host call sites that lean hardest on the
+ * bridge.
+ *
+ * Off unless turned on at runtime.  While it is off a call costs a relaxed load at each end.
+ *
+ *   uint64_t entered = BridgeProfiler::Enter();      // where the host makes the call
+ *   ... queue the work for the JS thread ...
+ *   BridgeProfiler::Call call(name, entered);          // first thing once it runs there
+ */
+class BridgeProfiler {
+public:
+    static inline uint64_t Enter()
+    {
+        return Enabled() ? Now() : 0;
+    }
+
+    class Call {
+    public:
+        inline Call(const char *name, uint64_t entered) : m_name(nullptr)
+        {
+            // A call entered while profiling was off is not counted, even if it is on by now
+            if (entered && Enabled()) {
+                m_name = name;
+                m_started = Now();
+                m_wait = m_started - entered;
+            }
+        }
+        inline ~Call()
+        {
+            if (m_name) Record(m_name, m_wait, Now() - m_started);
+        }
+        Call(const Call&) = delete;
+        Call& operator=(const Call&) = delete;
+
+    private:
+        const char *m_name;
+        uint64_t m_started;
+        uint64_t m_wait;
+    };
+
+    static inline void SetEnabled(bool enabled) { s_enabled = enabled; }
+    static inline bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    /*
+     * Everything recorded since the last reset, as JSON.  Histogram buckets are powers of two
+     * in nanoseconds, each counting the calls no longer than its bound and longer than the
+     * previous one; empty buckets are left out:
+     *
+     *   { "entry_points": [ { "name": ..., "calls": n,
+     *       "wait": { "total_ns": n, "max_ns": n, "p50_ns": n, "p99_ns": n,
+     *                 "histogram": [ [ bound_ns, calls ], ... ] },
+     *       "exec": { ... } }, ... ] }
+     */
+    static std::string Dump(bool reset);
+
+private:
+    static inline uint64_t Now()
+    {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    static void Record(const char *name, uint64_t wait_ns, uint64_t exec_ns);
+
+    static std::atomic<bool> s_enabled;
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_BRIDGEPROFILER_H
@@ -0,0 +1,693 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __APPLE__
+# include <JavaScriptCore/JavaScript.h>
+#endif
+#include "ChildInstance.h"
+#include "StructuredClone.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+struct Endpoint;
+
+enum Side { kParent = 0, kChild = 1 };
+
+// One fork, shared by the parent's end, the child's end and the child instance's callbacks.
+// Each end's queue is filled by the other and drained on its own loop.
+struct Link {
+    std::mutex mutex;
+    Endpoint *ends[2] = { nullptr, nullptr };
+    std::deque<std::unique_ptr<ClonedValue>> queued[2];
+    bool connected = true;
+    bool exited = false;
+    int exit_code = 0;
+    bool kill_requested = false;
+    std::string signal;
+    // The child's, from its start until it disconnects, for kill()
+    Isolate *isolate = nullptr;
+
+    // What the child starts with
+    std::string main;
+    std::vector<std::string> argv;
+    std::string cwd;
+    std::unique_ptr<ClonedValue> sandbox;   // null if the parent has none
+
+    NodeInstance *instance = nullptr;
+#ifdef __ANDROID__
+    std::thread thread;
+#endif
+};
+
+struct Endpoint {
+    node::Environment *env;
+    std::shared_ptr<Link> link;
+    Side side;
+    uv_async_t *async = nullptr;  // null once closed
+    bool disconnected = false;    // reported to JS
+    bool listening = false;       // child only: whether JS wants the channel to hold the loop
+    Persistent<Object> end;
+};
+
+std::mutex s_mutex;
+std::multimap<node::Environment*, Endpoint*> s_endpoints;
+std::map<node::Environment*, std::unique_ptr<NodeInstance::Config>> s_configs;
+
+void Throw(Isolate *isolate, const char *message)
+{
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, message)));
+}
+
+Endpoint* FromData(const FunctionCallbackInfo<Value>& args)
+{
+    return reinterpret_cast<Endpoint*>(args.Data().As<External>()->Value());
+}
+
+// Calls end.|name|(), if JS has set it
+void Emit(Endpoint *endpoint, const char *name, int argc, Local<Value> *argv)
+{
+    Isolate *isolate = endpoint->env->isolate();
+    Local<Object> end = endpoint->end.Get(isolate);
+    Local<Value> fn;
+    if (end->Get(endpoint->env->context(), String::NewFromUtf8(isolate, name)).ToLocal(&fn) &&
+        fn->IsFunction()) {
+        node::MakeCallback(isolate, end, fn.As<Function>(), argc, argv, {0, 0});
+    }
+}
+
+void Disconnect(Link *link)
+{
+    std::lock_guard<std::mutex> lock(link->mutex);
+    if (!link->connected) return;
+    link->connected = false;
+    for (int side = kParent; side <= kChild; side++) {
+        link->queued[side].clear();
+        if (link->ends[side]) {
+            uv_async_send(link->ends[side]->async);
+        }
+    }
+}
+
+// The child's thread can't free its own instance, so a thread of its own does, once both
+// the instance is fully made and it has exited
+void Reap(const std::shared_ptr<Link>& link)
+{
+    std::thread([link]() {
+        NodeInstance *instance;
+#ifdef __ANDROID__
+        std::thread thread;
+#endif
+        {
+            std::lock_guard<std::mutex> lock(link->mutex);
+            instance = link->instance;
+            link->instance = nullptr;
+#ifdef __ANDROID__
+            thread = std::move(link->thread);
+#endif
+        }
+#ifdef __ANDROID__
+        if (thread.joinable()) thread.join();
+#endif
+        delete instance;
+    }).detach();
+}
+
+void Close(Endpoint *endpoint)
+{
+    if (!endpoint->async) return;
+
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (auto it = s_endpoints.find(endpoint->env);
+             it != s_endpoints.end() && it->first == endpoint->env; ++it) {
+            if (it->second == endpoint) {
+                s_endpoints.erase(it);
+                break;
+            }
+        }
+    }
+    Disconnect(endpoint->link.get());
+    {
+        std::lock_guard<std::mutex> lock(endpoint->link->mutex);
+        endpoint->link->ends[endpoint->side] = nullptr;
+        if (endpoint->side == kChild) {
+            endpoint->link->isolate = nullptr;
+        }
+    }
+
+    uv_close(reinterpret_cast<uv_handle_t*>(endpoint->async), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_async_t*>(handle);
+    });
+    endpoint->async = nullptr;
+
+    // The end's functions still point here, so it goes when they do
+    endpoint->end.SetWeak(endpoint, [](const WeakCallbackInfo<Endpoint>& info) {
+        Endpoint *endpoint = info.GetParameter();
+        endpoint->end.Reset();
+        delete endpoint;
+    }, WeakCallbackType::kParameter);
+}
+
+// Only a child's end that JS is listening on holds its loop open, as in node
+void UpdateRef(Endpoint *endpoint)
+{
+    if (!endpoint->async) return;
+    if (endpoint->listening && !endpoint->disconnected) {
+        uv_ref(reinterpret_cast<uv_handle_t*>(endpoint->async));
+    } else {
+        uv_unref(reinterpret_cast<uv_handle_t*>(endpoint->async));
+    }
+}
+
+void OnSignal(uv_async_t *handle)
+{
+    auto endpoint = reinterpret_cast<Endpoint*>(handle->data);
+    Link *link = endpoint->link.get();
+    std::deque<std::unique_ptr<ClonedValue>> inbox;
+    bool disconnect, exited = false, kill = false;
+    int exit_code = 0;
+    std::string signal;
+    {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        inbox.swap(link->queued[endpoint->side]);
+        disconnect = !link->connected && !endpoint->disconnected;
+        if (endpoint->side == kParent) {
+            exited = link->exited;
+            exit_code = link->exit_code;
+            signal = link->signal;
+        } else {
+            kill = link->kill_requested;
+        }
+    }
+
+    Isolate *isolate = endpoint->env->isolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = endpoint->env->context();
+    Context::Scope context_scope(context);
+
+    if (kill) {
+        // Whatever JS was running has already been stopped; this only has to end the loop
+        isolate->CancelTerminateExecution();
+        Local<Value> exit;
+        Local<Value> code = Integer::New(isolate, 1);
+        if (endpoint->env->process_object()->Get(context,
+                String::NewFromUtf8(isolate, "reallyExit")).ToLocal(&exit) &&
+            exit->IsFunction()) {
+            exit.As<Function>()->Call(context, endpoint->env->process_object(), 1, &code);
+        }
+        return;
+    }
+
+    for (auto& message : inbox) {
+        // An earlier handler may have disconnected
+        if (!endpoint->async || endpoint->disconnected) break;
+
+        Local<Value> value;
+        {
+            TryCatch trycatch(isolate);
+            StructuredClone::Revive(isolate, context, &* message).ToLocal(&value);
+        }
+        if (value.IsEmpty()) continue;
+        Emit(endpoint, "onmessage", 1, &value);
+    }
+
+    if (disconnect && endpoint->async) {
+        endpoint->disconnected = true;
+        if (endpoint->side == kChild) {
+            UpdateRef(endpoint);
+        }
+        Emit(endpoint, "ondisconnect", 0, nullptr);
+    }
+
+    if (exited && endpoint->async) {
+        Local<Value> argv[] = {
+            signal.empty() ? Integer::New(isolate, exit_code).As<Value>() :
+                Null(isolate).As<Value>(),
+            signal.empty() ? Null(isolate).As<Value>() :
+                String::NewFromUtf8(isolate, signal.c_str()).As<Value>()
+        };
+        Emit(endpoint, "onexit", 2, argv);
+        Close(endpoint);
+    }
+}
+
+void PostMessage(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    Local<Context> context = isolate->GetCurrentContext();
+    Endpoint *endpoint = FromData(args);
+    if (!endpoint->async) {
+        return Throw(isolate, "Channel closed");
+    }
+
+    std::unique_ptr<ClonedValue> message = StructuredClone::Clone(isolate, context, args[0],
+        args.Length() > 1 ? args[1] : Local<Value>());
+    if (!message) return;
+
+    Link *link = endpoint->link.get();
+    std::lock_guard<std::mutex> lock(link->mutex);
+    if (!link->connected) {
+        args.GetReturnValue().Set(false);
+        return;
+    }
+    const int peer = 1 - endpoint->side;
+    link->queued[peer].push_back(std::move(message));
+    if (link->ends[peer]) {
+        uv_async_send(link->ends[peer]->async);
+    }
+    args.GetReturnValue().Set(true);
+}
+
+void DisconnectEnd(const FunctionCallbackInfo<Value>& args)
+{
+    Disconnect(FromData(args)->link.get());
+}
+
+void Kill(const FunctionCallbackInfo<Value>& args)
+{
+    Link *link = FromData(args)->link.get();
+    std::lock_guard<std::mutex> lock(link->mutex);
+    if (link->exited || link->kill_requested) {
+        args.GetReturnValue().Set(false);
+        return;
+    }
+    link->kill_requested = true;
+    link->signal = args[0]->IsString() ? *String::Utf8Value(args[0]) : "SIGTERM";
+    // Stops a child that is busy in JS; the rest happens on its loop
+    if (link->isolate) {
+        link->isolate->TerminateExecution();
+    }
+    if (link->ends[kChild]) {
+        uv_async_send(link->ends[kChild]->async);
+    }
+    args.GetReturnValue().Set(true);
+}
+
+// The parent's end is ref'd like any child process handle; the child's by listeners
+void Ref(const FunctionCallbackInfo<Value>& args)
+{
+    Endpoint *endpoint = FromData(args);
+    if (endpoint->side == kChild) {
+        endpoint->listening = true;
+        UpdateRef(endpoint);
+    } else if (endpoint->async) {
+        uv_ref(reinterpret_cast<uv_handle_t*>(endpoint->async));
+    }
+}
+
+void Unref(const FunctionCallbackInfo<Value>& args)
+{
+    Endpoint *endpoint = FromData(args);
+    if (endpoint->side == kChild) {
+        endpoint->listening = false;
+        UpdateRef(endpoint);
+    } else if (endpoint->async) {
+        uv_unref(reinterpret_cast<uv_handle_t*>(endpoint->async));
+    }
+}
+
+Endpoint* NewEndpoint(node::Environment *env, const std::shared_ptr<Link>& link, Side side)
+{
+    Isolate *isolate = env->isolate();
+    Local<Context> context = env->context();
+
+    auto endpoint = new Endpoint();
+    endpoint->env = env;
+    endpoint->link = link;
+    endpoint->side = side;
+    endpoint->async = new uv_async_t();
+    endpoint->async->data = endpoint;
+    uv_async_init(env->event_loop(), endpoint->async, OnSignal);
+    if (side == kChild) {
+        UpdateRef(endpoint);
+    }
+
+    Local<External> data = External::New(isolate, endpoint);
+    Local<Object> end = Object::New(isolate);
+    end->Set(context, String::NewFromUtf8(isolate, "postMessage"),
+             Function::New(context, PostMessage, data).ToLocalChecked());
+    end->Set(context, String::NewFromUtf8(isolate, "disconnect"),
+             Function::New(context, DisconnectEnd, data).ToLocalChecked());
+    end->Set(context, String::NewFromUtf8(isolate, "ref"),
+             Function::New(context, Ref, data).ToLocalChecked());
+    end->Set(context, String::NewFromUtf8(isolate, "unref"),
+             Function::New(context, Unref, data).ToLocalChecked());
+    if (side == kParent) {
+        end->Set(context, String::NewFromUtf8(isolate, "kill"),
+                 Function::New(context, Kill, data).ToLocalChecked());
+    }
+    endpoint->end.Reset(isolate, end);
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_endpoints.insert(std::make_pair(env, endpoint));
+    return endpoint;
+}
+
+// The parent's sandbox tables, to be set up again in the child.  False, with an exception
+// thrown, if the parent is confined only by JS functions that can't be carried across.
+bool CloneSandbox(Isolate *isolate, Local<Context> context, std::unique_ptr<ClonedValue> *out)
+{
+    Local<Private> key = Private::ForApi(isolate, String::NewFromUtf8(isolate, "__fs"));
+    Local<Value> fs;
+    if (!context->Global()->GetPrivate(context, key).ToLocal(&fs) || !fs->IsObject()) {
+        return true;
+    }
+
+    Local<Object> tables = Object::New(isolate);
+    const char *kFields[] = { "cwd", "aliases_", "access_" };
+    for (const char *field : kFields) {
+        Local<String> name = String::NewFromUtf8(isolate, field);
+        Local<Value> value;
+        if (!fs.As<Object>()->Get(context, name).ToLocal(&value)) return false;
+        tables->Set(context, name, value).FromJust();
+    }
+    Local<Value> aliases = tables->Get(context, String::NewFromUtf8(isolate, "aliases_"))
+        .ToLocalChecked();
+    Local<Value> access = tables->Get(context, String::NewFromUtf8(isolate, "access_"))
+        .ToLocalChecked();
+    if (!aliases->IsObject() || !access->IsObject()) {
+        Throw(isolate, "fork() is not supported with this file system");
+        return false;
+    }
+
+    *out = StructuredClone::Clone(isolate, context, tables, Local<Value>());
+    return *out != nullptr;
+}
+
+void InstallSandbox(Isolate *isolate, Local<Context> context, ClonedValue *sandbox)
+{
+    Local<Value> tables;
+    {
+        TryCatch trycatch(isolate);
+        if (!StructuredClone::Revive(isolate, context, sandbox).ToLocal(&tables) ||
+            !tables->IsObject()) {
+            return;
+        }
+    }
+    Local<Private> key = Private::ForApi(isolate, String::NewFromUtf8(isolate, "__fs"));
+    context->Global()->SetPrivate(context, key, tables);
+    PathPolicy::Install(context, tables.As<Object>());
+    InvalidateSandbox();
+    InvalidateModuleStatCache();
+}
+
+// On the child's thread, once its environment is up and before anything has run
+void OnStart(void *data, JSContextRef, JSContextGroupRef)
+{
+    std::shared_ptr<Link> link = *reinterpret_cast<std::shared_ptr<Link>*>(data);
+    Isolate *isolate = Isolate::GetCurrent();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = isolate->GetCurrentContext();
+    node::Environment *env = node::Environment::GetCurrent(context);
+
+    if (link->sandbox) {
+        InstallSandbox(isolate, context, link->sandbox.get());
+    }
+
+    Endpoint *endpoint = NewEndpoint(env, link, kChild);
+    std::lock_guard<std::mutex> lock(link->mutex);
+    link->ends[kChild] = endpoint;
+    link->isolate = isolate;
+    // Whatever the parent sent or asked for while the child was starting
+    if (!link->queued[kChild].empty() || !link->connected || link->kill_requested) {
+        uv_async_send(endpoint->async);
+    }
+}
+
+// On the child's thread, once it is done with its isolate
+void OnExit(void *data, int code)
+{
+    auto held = reinterpret_cast<std::shared_ptr<Link>*>(data);
+    std::shared_ptr<Link> link = *held;
+    delete held;
+
+    bool reap;
+    {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        link->exited = true;
+        link->exit_code = code;
+        link->isolate = nullptr;
+        if (link->ends[kParent]) {
+            uv_async_send(link->ends[kParent]->async);
+        }
+        reap = link->instance != nullptr;
+    }
+    if (reap) Reap(link);
+}
+
+// fork(modulePath, args[, cwd]): the parent's end
+void Fork(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = node::Environment::GetCurrent(args);
+    Isolate *isolate = args.GetIsolate();
+    Local<Context> context = isolate->GetCurrentContext();
+    auto config = reinterpret_cast<NodeInstance::Config*>(args.Data().As<External>()->Value());
+    if (args.Length() < 2 || !args[0]->IsString() || !args[1]->IsArray()) {
+        return Throw(isolate, "fork(modulePath, args[, cwd])");
+    }
+
+    auto link = std::make_shared<Link>();
+    link->main = *String::Utf8Value(args[0]);
+    Local<Array> argv = args[1].As<Array>();
+    for (uint32_t i = 0; i < argv->Length(); i++) {
+        Local<Value> arg;
+        if (!argv->Get(context, i).ToLocal(&arg)) return;
+        link->argv.push_back(*String::Utf8Value(arg));
+    }
+    if (args.Length() > 2 && args[2]->IsString()) {
+        link->cwd = *String::Utf8Value(args[2]);
+    }
+    if (!CloneSandbox(isolate, context, &link->sandbox)) return;
+
+    Endpoint *endpoint = NewEndpoint(env, link, kParent);
+    {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        link->ends[kParent] = endpoint;
+    }
+
+    // Not under the link's lock: on a shared thread the child may start right here
+    auto instance = new NodeInstance(OnStart, OnExit, new std::shared_ptr<Link>(link), *config);
+    bool reap;
+    {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        link->instance = instance;
+#ifdef __ANDROID__
+        link->thread = std::thread([instance]() { instance->spawnedThread(); });
+#endif
+        reap = link->exited;
+    }
+    if (reap) Reap(link);
+
+    args.GetReturnValue().Set(endpoint->end.Get(isolate));
+}
+
+// Replaces child_process.fork(), and in a child sets up process.send() and friends and the
+// entry point.  Called with (process, require, fork, channel), channel being undefined except
+// in a child.
+const char kWrapper[] =
+    "(function(process, require, fork, channel) {\n"
+    "  const EventEmitter = require('events');\n"
+    "  const path = require('path');\n"
+    "  const util = require('util');\n"
+    "\n"
+    "  function connect(target, end) {\n"
+    "    target.connected = true;\n"
+    "    end.onmessage = function(message) { target.emit('message', message); };\n"
+    "    end.ondisconnect = function() {\n"
+    "      target.connected = false;\n"
+    "      target.emit('disconnect');\n"
+    "    };\n"
+    "    target.send = function(message, handle, options, callback) {\n"
+    "      if (typeof handle === 'function') callback = handle;\n"
+    "      else if (typeof options === 'function') callback = options;\n"
+    "      if (message === undefined) {\n"
+    "        throw new TypeError('\"message\" argument cannot be undefined');\n"
+    "      }\n"
+    "      const error = target.connected ? null : new Error('channel closed');\n"
+    "      const sent = !error && end.postMessage(message);\n"
+    "      if (typeof callback === 'function') process.nextTick(callback, error);\n"
+    "      else if (error) process.nextTick(function() { target.emit('error', error); });\n"
+    "      return sent;\n"
+    "    };\n"
+    "    target.disconnect = function() {\n"
+    "      if (!target.connected) {\n"
+    "        target.emit('error', new Error('IPC channel is already disconnected'));\n"
+    "        return;\n"
+    "      }\n"
+    "      target.connected = false;\n"
+    "      end.disconnect();\n"
+    "    };\n"
+    "  }\n"
+    "\n"
+    "  let lastPid = 0;\n"
+    "  function ChildProcess(end) {\n"
+    "    EventEmitter.call(this);\n"
+    "    this.pid = ++lastPid;\n"
+    "    this.exitCode = null;\n"
+    "    this.signalCode = null;\n"
+    "    this.killed = false;\n"
+    "    this.stdin = this.stdout = this.stderr = null;\n"
+    "    this.stdio = [null, null, null, null];\n"
+    "    this._end = end;\n"
+    "  }\n"
+    "  util.inherits(ChildProcess, EventEmitter);\n"
+    "  ChildProcess.prototype.kill = function(signal) {\n"
+    "    if (!this._end.kill(signal === undefined ? 'SIGTERM' : String(signal))) return false;\n"
+    "    this.killed = true;\n"
+    "    return true;\n"
+    "  };\n"
+    "  ChildProcess.prototype.ref = function() { this._end.ref(); };\n"
+    "  ChildProcess.prototype.unref = function() { this._end.unref(); };\n"
+    "\n"
+    "  require('child_process').fork = function(modulePath, args, options) {\n"
+    "    if (args == null) {\n"
+    "      args = [];\n"
+    "    } else if (typeof args === 'object' && !Array.isArray(args)) {\n"
+    "      options = args;\n"
+    "      args = [];\n"
+    "    } else if (!Array.isArray(args)) {\n"
+    "      throw new TypeError('Incorrect value of args option');\n"
+    "    }\n"
+    "    options = options || {};\n"
+    "    const end = fork(path.resolve(String(modulePath)), args.map(String),\n"
+    "                     options.cwd == null ? undefined : path.resolve(String(options.cwd)));\n"
+    "    const child = new ChildProcess(end);\n"
+    "    connect(child, end);\n"
+    "    end.onexit = function(code, signal) {\n"
+    "      child.exitCode = code;\n"
+    "      child.signalCode = signal;\n"
+    "      child.emit('exit', code, signal);\n"
+    "      child.emit('close', code, signal);\n"
+    "    };\n"
+    "    return child;\n"
+    "  };\n"
+    "\n"
+    "  if (!channel) return;\n"
+    "  const end = channel.end;\n"
+    "  connect(process, end);\n"
+    "  process.channel = { ref: function() { end.ref(); }, unref: function() { end.unref(); } };\n"
+    "  process.on('newListener', function(event) {\n"
+    "    if (event === 'message' || event === 'disconnect') end.ref();\n"
+    "  });\n"
+    "  process.on('removeListener', function(event) {\n"
+    "    if ((event === 'message' || event === 'disconnect') &&\n"
+    "        process.listenerCount('message') + process.listenerCount('disconnect') === 0) {\n"
+    "      end.unref();\n"
+    "    }\n"
+    "  });\n"
+    "  global.__nodedroid_onLoad = function() {\n"
+    "    delete global.__nodedroid_onLoad;\n"
+    "    if (channel.cwd) process.chdir(channel.cwd);\n"
+    "    process.argv = [process.argv[0], channel.main].concat(channel.argv);\n"
+    "    require('module').runMain();\n"
+    "  };\n"
+    "})";
+
+void AttachFork(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = node::Environment::GetCurrent(args);
+    Isolate *isolate = args.GetIsolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = env->context();
+    TryCatch trycatch(isolate);
+
+    Local<Value> require;
+    if (!context->Global()->Get(context, String::NewFromUtf8(isolate, "require"))
+            .ToLocal(&require) || !require->IsFunction()) {
+        return;
+    }
+
+    Endpoint *child = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (auto it = s_endpoints.find(env); it != s_endpoints.end() && it->first == env; ++it) {
+            if (it->second->side == kChild) {
+                child = it->second;
+                break;
+            }
+        }
+    }
+    Local<Value> channel = Undefined(isolate);
+    if (child) {
+        Link *link = child->link.get();
+        Local<Object> object = Object::New(isolate);
+        object->Set(context, String::NewFromUtf8(isolate, "end"), child->end.Get(isolate));
+        object->Set(context, String::NewFromUtf8(isolate, "main"),
+                    String::NewFromUtf8(isolate, link->main.c_str()));
+        Local<Array> argv = Array::New(isolate, (int) link->argv.size());
+        for (size_t i = 0; i < link->argv.size(); i++) {
+            argv->Set(context, (uint32_t) i, String::NewFromUtf8(isolate, link->argv[i].c_str()));
+        }
+        object->Set(context, String::NewFromUtf8(isolate, "argv"), argv);
+        if (!link->cwd.empty()) {
+            object->Set(context, String::NewFromUtf8(isolate, "cwd"),
+                        String::NewFromUtf8(isolate, link->cwd.c_str()));
+        }
+        channel = object;
+    }
+
+    Local<Script> script;
+    Local<Value> wrapper;
+    if (Script::Compile(context, String::NewFromUtf8(isolate, kWrapper)).ToLocal(&script) &&
+        script->Run(context).ToLocal(&wrapper) && wrapper->IsFunction()) {
+        Local<Value> argv[] = {
+            env->process_object(),
+            require,
+            Function::New(context, Fork, args.Data()).ToLocalChecked(),
+            channel
+        };
+        wrapper.As<Function>()->Call(context, Undefined(isolate), 4, argv);
+    }
+}
+
+} /* namespace */
+
+void ChildInstance::Install(node::Environment *env, const NodeInstance::Config& config)
+{
+    Isolate *isolate = env->isolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = env->context();
+
+    NodeInstance::Config *copy;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        std::unique_ptr<NodeInstance::Config>& held = s_configs[env];
+        held.reset(new NodeInstance::Config(config));
+        copy = held.get();
+    }
+    env->process_object()->Set(context, String::NewFromUtf8(isolate, "_attachFork"),
+        Function::New(context, AttachFork, External::New(isolate, copy)).ToLocalChecked());
+}
+
+void ChildInstance::CloseAll(node::Environment *env)
+{
+    for (;;) {
+        Endpoint *endpoint = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            auto found = s_endpoints.find(env);
+            if (found == s_endpoints.end()) {
+                s_configs.erase(env);
+                break;
+            }
+            endpoint = found->second;
+        }
+        Close(endpoint);
+    }
+}
+
+} /* namespace nodedroid */
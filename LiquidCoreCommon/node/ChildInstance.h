@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_CHILDINSTANCE_H
+#define NODEDROID_CHILDINSTANCE_H
+
+#include "NodeInstance.h"
+
+namespace nodedroid {
+
+/*
+ * child_process.fork() without a process.  Spawning is off the table on iOS and frowned upon
+ * on Android, so a forked module runs in a node instance of its own on its own thread
+ * instead, with the same heap limits and arguments as its parent and inside the same file
+ * system sandbox.  From JS nothing changes:
+ *
+ *   const child = require('child_process').fork(modulePath[, args][, { cwd }]);
+ *   child.on('message', function(value) { ... });
+ *   child.on('exit', function(code, signal) { ... });
+ *   child.send(value);
+ *   child.kill();
+ *
+ * and in the child, process.send(), process.on('message'), process.connected and
+ * process.disconnect() work as they would over the 'ipc' stdio channel.  The channel is an
+ * in-memory pair of queues, one per direction, each drained on its reader's loop; values are
+ * structured-clone serialized rather than sent as JSON.  The child has no stdio pipes of its
+ * own, and options other than cwd (env, execArgv, silent, stdio) are ignored.  kill() ends
+ * the child wherever it is, and its 'exit' then reports the signal rather than a code.
+ */
+class ChildInstance {
+public:
+    // Adds process._attachFork(), which the instance calls once bootstrapped and which swaps
+    // in fork() (and, in a child, the channel).  Children get |config|.  Must be called on
+    // the instance's thread.
+    static void Install(node::Environment *env, const NodeInstance::Config& config);
+    // Disconnects |env| from its children, and from its parent if it has one.  Children carry
+    // on regardless.  Must be called on the instance's thread before its loop is run for the
+    // last time.
+    static void CloseAll(node::Environment *env);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_CHILDINSTANCE_H
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <map>
+#include <mutex>
+#include <string>
+#include "CpuProfile.h"
+#include "HeapProfile.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+const char kTitle[] = "LiquidCore";
+
+std::mutex s_mutex;
+std::map<Isolate*, CpuProfiler*> s_profilers;
+
+// Nodes are listed flat, parents before their children, which are referred to by id
+void WriteNodes(FdStream& out, const CpuProfileNode *node, bool first)
+{
+    if (!first) out.Write(",", 1);
+    out.Write("{\"id\":" + std::to_string(node->GetNodeId()) +
+              ",\"callFrame\":{\"functionName\":");
+    out.WriteString(node->GetFunctionName());
+    out.Write(",\"scriptId\":\"" + std::to_string(node->GetScriptId()) + "\",\"url\":");
+    out.WriteString(node->GetScriptResourceName());
+    out.Write(",\"lineNumber\":" + std::to_string(node->GetLineNumber() - 1) +
+              ",\"columnNumber\":" + std::to_string(node->GetColumnNumber() - 1) +
+              "},\"hitCount\":" + std::to_string(node->GetHitCount()) + ",\"children\":[");
+    const int count = node->GetChildrenCount();
+    for (int i=0; i<count; i++) {
+        if (i) out.Write(",", 1);
+        out.Write(std::to_string(node->GetChild(i)->GetNodeId()));
+    }
+    out.Write("]}");
+    for (int i=0; i<count; i++) {
+        WriteNodes(out, node->GetChild(i), false);
+    }
+}
+
+bool Write(const v8::CpuProfile *profile, int fd)
+{
+    FdStream out(fd);
+    out.Write("{\"nodes\":[");
+    WriteNodes(out, profile->GetTopDownRoot(), true);
+    out.Write("],\"startTime\":" + std::to_string(profile->GetStartTime()) +
+              ",\"endTime\":" + std::to_string(profile->GetEndTime()) + ",\"samples\":[");
+    const int count = profile->GetSamplesCount();
+    for (int i=0; i<count; i++) {
+        if (i) out.Write(",", 1);
+        out.Write(std::to_string(profile->GetSample(i)->GetNodeId()));
+    }
+    out.Write("],\"timeDeltas\":[");
+    int64_t last = profile->GetStartTime();
+    for (int i=0; i<count; i++) {
+        if (i) out.Write(",", 1);
+        const int64_t timestamp = profile->GetSampleTimestamp(i);
+        out.Write(std::to_string(timestamp - last));
+        last = timestamp;
+    }
+    out.Write("]}");
+    return out.Flush();
+}
+
+} /* namespace */
+
+bool CpuProfile::Start(Isolate *isolate, int interval_us)
+{
+    CpuProfiler *profiler;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (s_profilers.count(isolate)) return false;
+        profiler = CpuProfiler::New(isolate);
+        s_profilers[isolate] = profiler;
+    }
+    if (interval_us > 0) {
+        profiler->SetSamplingInterval(interval_us);
+    }
+    HandleScope handle_scope(isolate);
+    profiler->StartProfiling(String::NewFromUtf8(isolate, kTitle), true);
+    return true;
+}
+
+bool CpuProfile::Stop(Isolate *isolate, int fd)
+{
+    CpuProfiler *profiler;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto found = s_profilers.find(isolate);
+        if (found == s_profilers.end()) return false;
+        profiler = found->second;
+        s_profilers.erase(found);
+    }
+
+    bool ok = false;
+    {
+        HandleScope handle_scope(isolate);
+        v8::CpuProfile *profile = profiler->StopProfiling(String::NewFromUtf8(isolate, kTitle));
+        if (profile) {
+            ok = fd < 0 || Write(profile, fd);
+            profile->Delete();
+        }
+    }
+    profiler->Dispose();
+    return ok;
+}
+
+bool CpuProfile::IsProfiling(Isolate *isolate)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    return s_profilers.count(isolate) != 0;
+}
+
+} /* namespace nodedroid */
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_CPUPROFILE_H
+#define NODEDROID_CPUPROFILE_H
+
+#include "v8.h"
+
+namespace nodedroid {
+
+/*
+ * One CPU profile at a time per isolate, written out as a DevTools .cpuprofile when it is
+ * stopped.  A profiler is only created while a profile is being taken, so an isolate nobody
+ * profiles pays nothing for it.  Used from Java on a ContextGroup, and by a node instance to
+ * profile its long tasks.
+ */
+class CpuProfile {
+public:
+    // The isolate must be locked.  False if a profile is already being taken.  A zero
+    // interval keeps V8's default (1 ms).
+    static bool Start(v8::Isolate *isolate, int interval_us);
+    // Stops the profile and writes it to |fd|, which is left open.  A negative |fd| just
+    // throws it away.  False if none was being taken, or if it could not be written.
+    static bool Stop(v8::Isolate *isolate, int fd);
+    static bool IsProfiling(v8::Isolate *isolate);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_CPUPROFILE_H
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_EXTERNALREGISTRY_H
+#define NODEDROID_EXTERNALREGISTRY_H
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+namespace nodedroid {
+
+/*
+ * Things outside of the isolate that JS values hold on to (global references to Java
+ * objects, mapped files), each with a way to let go of it.  Normally the value's weak
+ * callback, or its owner's destructor, removes its entry and lets go itself.  Neither may
+ * ever run once the isolate is gone, though, so whatever is left here when the isolate's
+ * owner (a context group, or a node instance) is done with it is let go of then.
+ *
+ * Shared between the owner and the callbacks, since on an isolate a context group doesn't own
+ * (node's), a callback can outlive the group.
+ */
+class ExternalRegistry {
+public:
+    // |release| must let go of everything |key| holds, its weak handle (if any) included.  It
+    // is called with the isolate locked.
+    void Add(void *key, std::function<void()> release)
+    {
+        std::unique_lock<std::recursive_mutex> lk(m_mutex);
+        m_entries[key] = release;
+    }
+
+    // Whatever holds |key| is letting go of it itself.  Safe to call from a first-pass weak
+    // callback.
+    // If ReleaseAll() is under way on another thread, waits for it, so that once this returns
+    // nothing here will touch |key| again.
+    void Remove(void *key)
+    {
+        std::unique_lock<std::recursive_mutex> lk(m_mutex);
+        m_entries.erase(key);
+    }
+
+    // Must be called with the isolate locked, before it is disposed.  A release may add or
+    // remove entries of its own.
+    void ReleaseAll()
+    {
+        std::unique_lock<std::recursive_mutex> lk(m_mutex);
+        while (!m_entries.empty()) {
+            auto it = m_entries.begin();
+            std::function<void()> release = it->second;
+            m_entries.erase(it);
+            release();
+        }
+    }
+
+private:
+    std::unordered_map<void *, std::function<void()>> m_entries;
+    std::recursive_mutex m_mutex;
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_EXTERNALREGISTRY_H
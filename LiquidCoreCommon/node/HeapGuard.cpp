@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include "env-inl.h"
+#include "HeapGuard.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+const int kStrikes = 3;
+
+} /* namespace */
+
+HeapGuard::HeapGuard(node::Environment *env, size_t limit, size_t headroom,
+                     Callback callback) :
+    m_env(env), m_limit(limit), m_headroom(headroom), m_callback(callback)
+{
+    m_async = new uv_async_t();
+    m_async->data = this;
+    uv_async_init(env->event_loop(), m_async, OnAsync);
+    // Only wakes the loop when there is something to say
+    uv_unref(reinterpret_cast<uv_handle_t*>(m_async));
+    env->isolate()->AddGCEpilogueCallback(OnGC, this);
+}
+
+HeapGuard::~HeapGuard()
+{
+    m_env->isolate()->RemoveGCEpilogueCallback(OnGC, this);
+    uv_close(reinterpret_cast<uv_handle_t*>(m_async), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_async_t*>(handle);
+    });
+}
+
+// No JS, and no allocation on the JS heap, in here; anything more waits for the loop
+void HeapGuard::OnGC(Isolate *isolate, GCType type, GCCallbackFlags flags, void *data)
+{
+    auto guard = reinterpret_cast<HeapGuard*>(data);
+    if (guard->m_terminate) return;
+
+    HeapStatistics stats;
+    isolate->GetHeapStatistics(&stats);
+    const size_t used = stats.used_heap_size();
+    guard->m_used = used;
+
+    bool wake = false;
+    if (!guard->m_near && used >= guard->m_limit / 10 * 9) {
+        guard->m_near = wake = guard->m_report_near = true;
+    } else if (guard->m_near && used < guard->m_limit / 10 * 8) {
+        guard->m_near = false;
+        guard->m_strikes = 0;
+        wake = guard->m_report_relieved = true;
+    }
+
+#ifdef __APPLE__
+    // JSC only reports one kind of collection
+    const bool full = true;
+#else
+    const bool full = (type & kGCTypeMarkSweepCompact) != 0;
+#endif
+    if (used > guard->m_limit) {
+        if (full) guard->m_strikes ++;
+        if (guard->m_strikes >= kStrikes || used > guard->m_limit + guard->m_headroom / 4 * 3) {
+            guard->m_terminate = wake = true;
+            isolate->TerminateExecution();
+        }
+    } else if (full) {
+        guard->m_strikes = 0;
+    }
+
+    if (wake) uv_async_send(guard->m_async);
+}
+
+void HeapGuard::OnAsync(uv_async_t *handle)
+{
+    auto guard = reinterpret_cast<HeapGuard*>(handle->data);
+    node::Environment *env = guard->m_env;
+    Isolate *isolate = env->isolate();
+    const size_t used = guard->m_used;
+
+    if (guard->m_terminate) {
+        guard->m_report_near = guard->m_report_relieved = false;
+        guard->m_callback(kTerminated, used, guard->m_limit);
+        // Let the exit handlers run on the way out, then leave the way process.exit() does
+        isolate->CancelTerminateExecution();
+        uv_walk(env->event_loop(), [](uv_handle_t* h, void* arg) {
+            uv_unref(h);
+        }, nullptr);
+        uv_stop(env->event_loop());
+        return;
+    }
+
+    if (guard->m_report_relieved) {
+        guard->m_report_relieved = false;
+        guard->m_report_near = false;
+        guard->m_callback(kRelieved, used, guard->m_limit);
+        return;
+    }
+
+    if (guard->m_report_near) {
+        guard->m_report_near = false;
+        guard->m_callback(kNearLimit, used, guard->m_limit);
+
+        HandleScope handle_scope(isolate);
+        Local<Context> context = env->context();
+        Context::Scope context_scope(context);
+        Local<Object> info = Object::New(isolate);
+        info->Set(context, String::NewFromUtf8(isolate, "used"),
+                  Number::New(isolate, (double) used));
+        info->Set(context, String::NewFromUtf8(isolate, "limit"),
+                  Number::New(isolate, (double) guard->m_limit));
+        Local<Value> argv[] = { String::NewFromUtf8(isolate, "memorypressure"), info };
+        node::MakeCallback(isolate, env->process_object(), "emit", 2, argv, {0, 0});
+    }
+}
+
+} /* namespace nodedroid */
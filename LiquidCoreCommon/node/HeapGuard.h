@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_HEAPGUARD_H
+#define NODEDROID_HEAPGUARD_H
+
+#include <functional>
+#include "node.h"
+#include "env.h"
+
+namespace nodedroid {
+
+/*
+ * A soft heap limit for one instance, so that running out of heap ends that service instead
+ * of the whole app.  The isolate is created with |headroom| more than the service's limit,
+ * and after each collection the heap in use is checked against the limit:
+ *
+ *   - Past 90% of it, the host is told and the service gets
+ *     process.on('memorypressure', function({ used, limit }) { ... }) to drop its caches.
+ *     Falling back under 80% ends the episode (and is reported too).
+ *   - Still over the limit, and so into the headroom, after three full collections in a row,
+ *     or over three quarters of the way through the headroom at any point, JS is terminated
+ *     and the instance exits as if it had called process.exit().
+ *
+ * V82JSC has no hard limit; the same checks apply against JSC's heap statistics.
+ */
+class HeapGuard {
+public:
+    enum Event { kNearLimit = 0, kRelieved = 1, kTerminated = 2 };
+    // Called on the instance's thread, outside of JS
+    typedef std::function<void(Event event, size_t used, size_t limit)> Callback;
+
+    // Must be called on the instance's thread
+    HeapGuard(node::Environment *env, size_t limit, size_t headroom, Callback callback);
+    // Must be called on the instance's thread before its loop is run for the last time
+    ~HeapGuard();
+
+private:
+    static void OnGC(v8::Isolate *isolate, v8::GCType type, v8::GCCallbackFlags flags,
+                     void *data);
+    static void OnAsync(uv_async_t *handle);
+
+    node::Environment *m_env;
+    const size_t m_limit;
+    const size_t m_headroom;
+    Callback m_callback;
+    uv_async_t *m_async;
+
+    // Set in the GC callback, acted on by the loop
+    bool m_near = false;
+    int m_strikes = 0;
+    size_t m_used = 0;
+    bool m_report_near = false;
+    bool m_report_relieved = false;
+    bool m_terminate = false;
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_HEAPGUARD_H
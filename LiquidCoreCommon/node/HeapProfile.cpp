@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include "env-inl.h"
+#include "HeapProfile.h"
+#include "nodedroid_file.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+void FdStream::Write(const char *data, size_t length)
+{
+    if (!m_ok) return;
+    if (m_buffer.size() + length > kChunkSize && !Flush()) return;
+    if (length >= kChunkSize) {
+        while (m_ok && length > 0) {
+            ssize_t written = write(m_fd, data, length);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) {
+                m_ok = false;
+            } else {
+                data += written;
+                length -= written;
+            }
+        }
+    } else {
+        m_buffer.append(data, length);
+    }
+}
+
+void FdStream::WriteString(Local<String> string)
+{
+    String::Utf8Value utf8(string);
+    Write("\"", 1);
+    const char *start = *utf8;
+    const char *end = start + (*utf8 ? utf8.length() : 0);
+    for (const char *p = start; p < end; ++p) {
+        auto c = static_cast<unsigned char>(*p);
+        if (c != '"' && c != '\\' && c >= 0x20) continue;
+        Write(start, p - start);
+        char escape[8];
+        snprintf(escape, sizeof escape, "\\u%04x", c);
+        Write(escape);
+        start = p + 1;
+    }
+    Write(start, end - start);
+    Write("\"", 1);
+}
+
+bool FdStream::Flush()
+{
+    size_t offset = 0;
+    while (m_ok && offset < m_buffer.size()) {
+        ssize_t written = write(m_fd, m_buffer.data() + offset, m_buffer.size() - offset);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            m_ok = false;
+        } else {
+            offset += written;
+        }
+    }
+    m_buffer.clear();
+    return m_ok;
+}
+
+OutputStream::WriteResult FdStream::WriteAsciiChunk(char *data, int size)
+{
+    Write(data, (size_t) size);
+    return m_ok ? kContinue : kAbort;
+}
+
+#ifdef __ANDROID__
+
+namespace {
+
+// One call tree node as the DevTools .heapprofile has it, which counts lines from 0
+void WriteNode(FdStream& out, const AllocationProfile::Node *node)
+{
+    size_t self_size = 0;
+    for (const AllocationProfile::Allocation& allocation : node->allocations) {
+        self_size += allocation.size * allocation.count;
+    }
+    out.Write("{\"callFrame\":{\"functionName\":");
+    out.WriteString(node->name);
+    out.Write(",\"scriptId\":\"" + std::to_string(node->script_id) + "\",\"url\":");
+    out.WriteString(node->script_name);
+    out.Write(",\"lineNumber\":" + std::to_string(node->line_number - 1) +
+              ",\"columnNumber\":" + std::to_string(node->column_number - 1) +
+              "},\"selfSize\":" + std::to_string(self_size) + ",\"children\":[");
+    bool first = true;
+    for (const AllocationProfile::Node *child : node->children) {
+        if (!first) out.Write(",", 1);
+        first = false;
+        WriteNode(out, child);
+    }
+    out.Write("]}");
+}
+
+void Throw(Isolate *isolate, const char *message)
+{
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, message)));
+}
+
+// A writable sandbox path, opened for writing.  -1 if not allowed, with an exception thrown.
+int OpenForWriting(node::Environment *env, Local<Value> path)
+{
+    if (!path->IsString()) {
+        Throw(env->isolate(), "A path is required");
+        return -1;
+    }
+    TryCatch trycatch(env->isolate());
+    Local<Value> real = fs_(env, path, _FS_ACCESS_WR);
+    if (trycatch.HasCaught()) {
+        trycatch.ReThrow();
+        return -1;
+    }
+    node::Utf8Value file(env->isolate(), real);
+    int fd = open(*file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        env->isolate()->ThrowException(node::ErrnoException(env->isolate(), errno, "open",
+                                                            nullptr, *file));
+    }
+    return fd;
+}
+
+void TakeHeapSnapshot(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = node::Environment::GetCurrent(args);
+    int fd = OpenForWriting(env, args[0]);
+    if (fd < 0) return;
+    bool ok = HeapProfile::WriteSnapshot(env->isolate(), fd);
+    close(fd);
+    if (!ok) return Throw(env->isolate(), "Heap snapshot could not be written");
+}
+
+void StartSamplingHeapProfiler(const FunctionCallbackInfo<Value>& args)
+{
+    Local<Context> context = args.GetIsolate()->GetCurrentContext();
+    uint64_t interval = 512 * 1024;
+    int depth = 16;
+    if (args.Length() > 0 && args[0]->IsNumber()) {
+        interval = (uint64_t) args[0]->IntegerValue(context).FromMaybe((int64_t) interval);
+    }
+    if (args.Length() > 1 && args[1]->IsNumber()) {
+        depth = (int) args[1]->Int32Value(context).FromMaybe(depth);
+    }
+    args.GetReturnValue().Set(HeapProfile::StartSampling(args.GetIsolate(), interval, depth));
+}
+
+void StopSamplingHeapProfiler(const FunctionCallbackInfo<Value>& args)
+{
+    HeapProfile::StopSampling(args.GetIsolate());
+}
+
+void GetAllocationProfile(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = node::Environment::GetCurrent(args);
+    int fd = OpenForWriting(env, args[0]);
+    if (fd < 0) return;
+    bool ok = HeapProfile::WriteAllocationProfile(env->isolate(), fd);
+    close(fd);
+    if (!ok) return Throw(env->isolate(), "The sampling heap profiler is not running");
+}
+
+} /* namespace */
+
+bool HeapProfile::WriteSnapshot(Isolate *isolate, int fd)
+{
+    HandleScope handle_scope(isolate);
+    const HeapSnapshot *snapshot = isolate->GetHeapProfiler()->TakeHeapSnapshot();
+    if (!snapshot) return false;
+    FdStream stream(fd);
+    snapshot->Serialize(&stream, HeapSnapshot::kJSON);
+    const_cast<HeapSnapshot*>(snapshot)->Delete();
+    return stream.Flush();
+}
+
+bool HeapProfile::StartSampling(Isolate *isolate, uint64_t interval, int depth)
+{
+    return isolate->GetHeapProfiler()->StartSamplingHeapProfiler(
+        interval > 0 ? interval : 512 * 1024, depth > 0 ? depth : 16);
+}
+
+void HeapProfile::StopSampling(Isolate *isolate)
+{
+    isolate->GetHeapProfiler()->StopSamplingHeapProfiler();
+}
+
+bool HeapProfile::WriteAllocationProfile(Isolate *isolate, int fd)
+{
+    HandleScope handle_scope(isolate);
+    std::unique_ptr<AllocationProfile> profile(
+        isolate->GetHeapProfiler()->GetAllocationProfile());
+    if (!profile) return false;
+    FdStream stream(fd);
+    stream.Write("{\"head\":");
+    WriteNode(stream, profile->GetRootNode());
+    stream.Write("}");
+    return stream.Flush();
+}
+
+void HeapProfile::Install(node::Environment *env)
+{
+    Local<Object> process = env->process_object();
+    env->SetMethod(process, "takeHeapSnapshot", TakeHeapSnapshot);
+    env->SetMethod(process, "startSamplingHeapProfiler", StartSamplingHeapProfiler);
+    env->SetMethod(process, "stopSamplingHeapProfiler", StopSamplingHeapProfiler);
+    env->SetMethod(process, "getAllocationProfile", GetAllocationProfile);
+}
+
+#else
+
+void HeapProfile::Install(node::Environment *env) {}
+
+#endif
+
+} /* namespace nodedroid */
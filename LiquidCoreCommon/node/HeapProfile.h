@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_HEAPPROFILE_H
+#define NODEDROID_HEAPPROFILE_H
+
+#include <cstring>
+#include <string>
+#include "node.h"
+#include "env.h"
+#include "v8-profiler.h"
+
+namespace nodedroid {
+
+/*
+ * Buffered writes to a file descriptor, which it doesn't own.  Also the OutputStream a heap
+ * snapshot is serialized through, so that the snapshot's JSON goes out a chunk at a time and
+ * is never held in memory whole.  Once a write fails everything after it is dropped, and
+ * Ok() is false.
+ */
+class FdStream : public v8::OutputStream {
+public:
+    explicit FdStream(int fd) : m_fd(fd), m_ok(fd >= 0) { m_buffer.reserve(kChunkSize); }
+    ~FdStream() override { Flush(); }
+
+    void Write(const char *data, size_t length);
+    inline void Write(const char *text) { Write(text, strlen(text)); }
+    inline void Write(const std::string& text) { Write(text.data(), text.length()); }
+    // As a JSON string literal, quotes and all
+    void WriteString(v8::Local<v8::String> string);
+    bool Flush();
+    inline bool Ok() const { return m_ok; }
+
+    void EndOfStream() override { Flush(); }
+    int GetChunkSize() override { return kChunkSize; }
+    WriteResult WriteAsciiChunk(char *data, int size) override;
+
+    static const int kChunkSize = 64 * 1024;
+
+private:
+    int m_fd;
+    bool m_ok;
+    std::string m_buffer;
+};
+
+/*
+ * Heap snapshots and sampled allocation profiles, written out in the formats the Chrome
+ * DevTools memory panel loads (.heapsnapshot and .heapprofile).  For a service, in JS:
+ *
+ *   process.takeHeapSnapshot(path);
+ *   process.startSamplingHeapProfiler([interval bytes[, stack depth]]);
+ *   process.getAllocationProfile(path);
+ *   process.stopSamplingHeapProfiler();
+ *
+ * where the paths are in the sandbox and must be writable.  From Java the same is done on a
+ * ContextGroup, writing to a file descriptor.  Android only; the iOS engine has no heap
+ * profiler, and none of this is installed there.
+ */
+class HeapProfile {
+public:
+    // The isolate must be locked and entered
+    static bool WriteSnapshot(v8::Isolate *isolate, int fd);
+    static bool StartSampling(v8::Isolate *isolate, uint64_t interval, int depth);
+    static void StopSampling(v8::Isolate *isolate);
+    // False if the sampling profiler isn't running
+    static bool WriteAllocationProfile(v8::Isolate *isolate, int fd);
+
+    // Adds the process functions above.  Must be called on the instance's thread.
+    static void Install(node::Environment *env);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_HEAPPROFILE_H
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <thread>
+#include <vector>
+#ifdef __ANDROID__
+# include <android/log.h>
+#elif defined(__APPLE__)
+# include <os/log.h>
+#endif
+#include "env-inl.h"
+#include "LogSink.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+// How long a wake-up waits for the rest of a burst, so that it goes out as one batch
+const auto kBatchDelay = std::chrono::milliseconds(20);
+
+const struct {
+    const char *name;
+    LogLevel level;
+} kMethods[] = {
+    { "debug", kLogDebug },
+    { "log",   kLogInfo  },
+    { "info",  kLogInfo  },
+    { "warn",  kLogWarn  },
+    { "error", kLogError },
+};
+
+// The sinks the delivery thread empties.  Writers never take this; they only take the wake
+// mutex, and then only when the thread isn't already due to run.
+std::mutex s_mutex;
+std::vector<LogSink*> s_sinks;
+std::once_flag s_thread_once;
+std::mutex s_wake_mutex;
+std::condition_variable s_wake;
+std::atomic<bool> s_pending(false);
+
+void DeliveryThread()
+{
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(s_wake_mutex);
+            s_wake.wait(lock, []() { return s_pending.load(); });
+            s_pending = false;
+        }
+        std::this_thread::sleep_for(kBatchDelay);
+
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (LogSink *sink : s_sinks) {
+            sink->Drain();
+        }
+    }
+}
+
+void Wake()
+{
+    if (!s_pending.exchange(true)) {
+        std::lock_guard<std::mutex> lock(s_wake_mutex);
+        s_wake.notify_one();
+    }
+}
+
+#ifdef __ANDROID__
+void SystemLog(const LogRecord& record)
+{
+    static const int kPriorities[] = {
+        ANDROID_LOG_DEBUG, ANDROID_LOG_INFO, ANDROID_LOG_WARN, ANDROID_LOG_ERROR
+    };
+    __android_log_write(kPriorities[record.level], "LiquidCore", record.text.c_str());
+}
+#elif defined(__APPLE__)
+void SystemLog(const LogRecord& record)
+{
+    static os_log_t log = os_log_create("org.liquidplayer.LiquidCore", "console");
+    static const os_log_type_t kTypes[] = {
+        OS_LOG_TYPE_DEBUG, OS_LOG_TYPE_INFO, OS_LOG_TYPE_DEFAULT, OS_LOG_TYPE_ERROR
+    };
+    os_log_with_type(log, kTypes[record.level], "%{public}s", record.text.c_str());
+}
+#else
+void SystemLog(const LogRecord& record)
+{
+    fprintf(stderr, "%s\n", record.text.c_str());
+}
+#endif
+
+} /* namespace */
+
+LogSink::LogSink() : m_min_level(kLogOff), m_configured(false),
+    m_records(new LogRecord[kCapacity]), m_head(0), m_tail(0), m_dropped(0), m_env(nullptr)
+{
+    for (size_t i=0; i<sizeof kMethods / sizeof kMethods[0]; i++) {
+        m_methods[i].sink = this;
+        m_methods[i].level = kMethods[i].level;
+    }
+}
+
+LogSink::~LogSink()
+{
+    if (m_configured) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_sinks.erase(std::remove(s_sinks.begin(), s_sinks.end(), this), s_sinks.end());
+    }
+    Drain();
+}
+
+void LogSink::Configure(LogLevel min_level, Deliver deliver)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_deliver_mutex);
+        m_deliver = deliver;
+    }
+    m_min_level = min_level;
+
+    if (!m_configured.exchange(true)) {
+        std::call_once(s_thread_once, []() {
+            std::thread(DeliveryThread).detach();
+        });
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_sinks.push_back(this);
+    }
+}
+
+void LogSink::Write(LogLevel level, std::string&& text)
+{
+    const size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) >= kCapacity) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    LogRecord& record = m_records[tail % kCapacity];
+    record.level = level;
+    record.text = std::move(text);
+    m_tail.store(tail + 1, std::memory_order_release);
+    Wake();
+}
+
+void LogSink::Drain()
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    const size_t tail = m_tail.load(std::memory_order_acquire);
+    const size_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+    if (head == tail && dropped == 0) return;
+
+    std::vector<LogRecord> batch;
+    batch.reserve(tail - head + 1);
+    for (; head != tail; head++) {
+        LogRecord& record = m_records[head % kCapacity];
+        batch.push_back({ record.level, std::move(record.text) });
+        record.text.clear();
+    }
+    // Only now may the writer have the slots back
+    m_head.store(head, std::memory_order_release);
+
+    if (dropped) {
+        batch.push_back({ kLogWarn,
+                          "(" + std::to_string(dropped) + " console messages dropped)" });
+    }
+
+    std::lock_guard<std::mutex> lock(m_deliver_mutex);
+    if (m_deliver) {
+        m_deliver(batch.data(), batch.size());
+    } else {
+        for (auto& record : batch) {
+            SystemLog(record);
+        }
+    }
+}
+
+std::string LogSink::Format(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+
+    // Strings, numbers and the like are joined here.  Anything else (objects, or a format
+    // string) needs util.format(), when there is one.
+    bool simple = true;
+    for (int i=0; i<args.Length() && simple; i++) {
+        simple = args[i]->IsString() || args[i]->IsNumber() || args[i]->IsBoolean() ||
+            args[i]->IsNull() || args[i]->IsUndefined();
+    }
+    if (simple && args.Length() > 1 && args[0]->IsString()) {
+        String::Utf8Value first(args[0]);
+        simple = *first == nullptr || strchr(*first, '%') == nullptr;
+    }
+
+    if (!simple && !m_format.IsEmpty()) {
+        Local<Context> context = isolate->GetCurrentContext();
+        std::vector<Local<Value>> argv;
+        for (int i=0; i<args.Length(); i++) {
+            argv.push_back(args[i]);
+        }
+        TryCatch trycatch(isolate);
+        Local<Value> formatted;
+        if (m_format.Get(isolate)->Call(context, Undefined(isolate), (int) argv.size(),
+                                        argv.data()).ToLocal(&formatted)) {
+            String::Utf8Value text(formatted);
+            if (*text) return std::string(*text, (size_t) text.length());
+        }
+    }
+
+    std::string text;
+    for (int i=0; i<args.Length(); i++) {
+        TryCatch trycatch(isolate);
+        String::Utf8Value value(args[i]);
+        if (i > 0) text.push_back(' ');
+        if (*value) text.append(*value, (size_t) value.length());
+    }
+    return text;
+}
+
+void LogSink::ConsoleWrite(const FunctionCallbackInfo<Value>& args)
+{
+    auto method = reinterpret_cast<Method*>(args.Data().As<External>()->Value());
+    LogSink *sink = method->sink;
+    if (!sink->Enabled(method->level)) return;
+
+    sink->Write(method->level, sink->Format(args));
+}
+
+void LogSink::AttachLogSink(const FunctionCallbackInfo<Value>& args)
+{
+    auto sink = reinterpret_cast<LogSink*>(args.Data().As<External>()->Value());
+    sink->Attach(node::Environment::GetCurrent(args));
+}
+
+void LogSink::Install(node::Environment *env)
+{
+    Isolate *isolate = env->isolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = env->context();
+    env->process_object()->Set(context, String::NewFromUtf8(isolate, "_attachLogSink"),
+        Function::New(context, AttachLogSink, External::New(isolate, this)).ToLocalChecked());
+}
+
+void LogSink::Attach(node::Environment *env)
+{
+    if (!m_configured || m_env == env) return;
+
+    Isolate *isolate = env->isolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = env->context();
+    Context::Scope context_scope(context);
+    TryCatch trycatch(isolate);
+
+    Local<Value> console;
+    if (!context->Global()->Get(context, String::NewFromUtf8(isolate, "console"))
+            .ToLocal(&console) || !console->IsObject()) {
+        return;
+    }
+    m_env = env;
+
+    // util.format(), for whatever Format() can't do itself
+    Local<Value> require, util, format;
+    if (context->Global()->Get(context, String::NewFromUtf8(isolate, "require"))
+            .ToLocal(&require) && require->IsFunction()) {
+        Local<Value> name = String::NewFromUtf8(isolate, "util");
+        if (require.As<Function>()->Call(context, Undefined(isolate), 1, &name)
+                .ToLocal(&util) && util->IsObject() &&
+            util.As<Object>()->Get(context, String::NewFromUtf8(isolate, "format"))
+                .ToLocal(&format) && format->IsFunction()) {
+            m_format.Reset(isolate, format.As<Function>());
+        }
+    }
+
+    for (size_t i=0; i<sizeof kMethods / sizeof kMethods[0]; i++) {
+        console.As<Object>()->Set(context, String::NewFromUtf8(isolate, kMethods[i].name),
+            Function::New(context, ConsoleWrite, External::New(isolate, &m_methods[i]))
+                .ToLocalChecked());
+    }
+}
+
+void LogSink::Detach()
+{
+    m_format.Reset();
+    m_env = nullptr;
+}
+
+} /* namespace nodedroid */
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_LOGSINK_H
+#define NODEDROID_LOGSINK_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "node.h"
+#include "env.h"
+
+namespace nodedroid {
+
+enum LogLevel {
+    kLogDebug,
+    kLogInfo,       // console.log() and console.info()
+    kLogWarn,
+    kLogError,
+    kLogOff
+};
+
+struct LogRecord {
+    LogLevel level;
+    std::string text;
+};
+
+/*
+ * Takes a service's console.debug/log/info/warn/error output straight to the host, instead of
+ * through process.stdout.  A call below the minimum level returns before its arguments are
+ * even formatted.  The rest go into a ring buffer, which only the service's thread writes and
+ * which is emptied in batches on a thread shared by all sinks, to Logcat or os_log, or to a
+ * host callback.  If the buffer fills faster than it is emptied, the excess is dropped and a
+ * count of it sent instead.
+ *
+ * Nothing changes until the sink is configured.  After that console only writes here; the
+ * rest of process.stdout is left alone.
+ */
+class LogSink {
+public:
+    // Called on the delivery thread with each batch.  A null callback means the system log.
+    typedef std::function<void(const LogRecord *records, size_t count)> Deliver;
+
+    LogSink();
+    ~LogSink();
+
+    // May be called from any thread
+    void Configure(LogLevel min_level, Deliver deliver);
+    inline bool Configured() const { return m_configured; }
+    inline bool Enabled(LogLevel level) const
+    {
+        return level >= m_min_level.load(std::memory_order_relaxed);
+    }
+
+    // Only from the instance's thread
+    void Write(LogLevel level, std::string&& text);
+
+    // Installs process._attachLogSink(), which the instance calls once bootstrapped, before
+    // running anything
+    void Install(node::Environment *env);
+    // Takes over |env|'s console, if configured.  On the instance's thread.
+    void Attach(node::Environment *env);
+    // Before the environment goes.  console keeps writing here, formatting only what it can
+    // without util.format().
+    void Detach();
+
+    static const size_t kCapacity = 1024;
+
+    // Delivers what has been written so far.  Only from the delivery thread, or once the
+    // instance's thread is done writing.
+    void Drain();
+
+private:
+    struct Method {
+        LogSink *sink;
+        LogLevel level;
+    };
+    static void ConsoleWrite(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void AttachLogSink(const v8::FunctionCallbackInfo<v8::Value>& args);
+    std::string Format(const v8::FunctionCallbackInfo<v8::Value>& args);
+
+    std::atomic<int> m_min_level;
+    std::atomic<bool> m_configured;
+    std::mutex m_deliver_mutex;
+    Deliver m_deliver;
+
+    std::unique_ptr<LogRecord[]> m_records;
+    std::atomic<size_t> m_head;     // the next to deliver
+    std::atomic<size_t> m_tail;     // the next to write
+    std::atomic<size_t> m_dropped;
+
+    Method m_methods[5];
+    node::Environment *m_env;
+    v8::Persistent<v8::Function> m_format;
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_LOGSINK_H
@@ -0,0 +1,408 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "LoopDispatcher.h"
+#include "TraceSpan.h"
+
+using namespace nodedroid;
+
+namespace {
+
+struct FunctionTask : LoopDispatcher::Task {
+    FunctionTask(std::function<void()> runnable) : m_runnable(runnable) {}
+    void Run() override
+    {
+        m_runnable();
+        delete this;
+    }
+    std::function<void()> m_runnable;
+};
+
+// Lives on the stack of the thread waiting for it
+struct SyncTask : LoopDispatcher::Task {
+    SyncTask(std::function<void()>& runnable) : m_runnable(runnable) {}
+    void Run() override
+    {
+        m_runnable();
+        Signal(true);
+    }
+    void Discard() override
+    {
+        Signal(false);
+    }
+    void Signal(bool ran)
+    {
+        // The waiter may return, and take us with it, as soon as it sees m_signaled, so the
+        // notify has to happen before the lock is let go
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_ran = ran;
+        m_signaled = true;
+        m_cv.notify_one();
+    }
+    bool Wait()
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_cv.wait(lk, [this]{ return m_signaled; });
+        return m_ran;
+    }
+
+    std::function<void()>& m_runnable;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_signaled = false;
+    bool m_ran = false;
+};
+
+// Every open dispatcher, for KeepAlive()
+std::mutex s_open_mutex;
+std::vector<LoopDispatcher*> s_open;
+
+} /* namespace */
+
+LoopDispatcher::Ticket::Ticket(std::function<void()> runnable) : m_runnable(runnable)
+{
+    m_task.m_ticket = this;
+}
+
+void LoopDispatcher::Ticket::QueuedTask::Run()
+{
+    Ticket *ticket = m_ticket;
+    ticket->TryRun();
+    ticket->Release();
+}
+
+void LoopDispatcher::Ticket::QueuedTask::Discard()
+{
+    Ticket *ticket = m_ticket;
+    int expected = kQueued;
+    if (ticket->m_state.compare_exchange_strong(expected, kDead)) {
+        ticket->Finish(kDiscarded);
+    }
+    ticket->Release();
+}
+
+bool LoopDispatcher::Ticket::TryRun()
+{
+    int expected = kQueued;
+    if (!m_state.compare_exchange_strong(expected, kRunning)) return false;
+    m_runnable();
+    m_state = kFinished;
+    Finish(kRan);
+    return true;
+}
+
+bool LoopDispatcher::Ticket::Cancel()
+{
+    int expected = kQueued;
+    if (m_state.compare_exchange_strong(expected, kDead)) {
+        Finish(kCancelled);
+        return true;
+    }
+    return expected == kDead;
+}
+
+LoopDispatcher::Ticket::Status LoopDispatcher::Ticket::Wait(unsigned timeout_ms)
+{
+    std::unique_lock<std::mutex> lk(m_mutex);
+    auto done = [this]{ return m_finished; };
+    if (timeout_ms == 0) {
+        m_cv.wait(lk, done);
+    } else if (!m_cv.wait_for(lk, std::chrono::milliseconds(timeout_ms), done)) {
+        int expected = kQueued;
+        if (m_state.compare_exchange_strong(expected, kDead)) {
+            m_status = kTimedOut;
+            m_finished = true;
+            return m_status;
+        }
+        // Too late, it has started
+        m_cv.wait(lk, done);
+    }
+    return m_status;
+}
+
+void LoopDispatcher::Ticket::Finish(Status status)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_status = status;
+        m_finished = true;
+    }
+    m_cv.notify_all();
+}
+
+void LoopDispatcher::Ticket::Retain()
+{
+    m_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoopDispatcher::Ticket::Release()
+{
+    if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+LoopDispatcher::~LoopDispatcher()
+{
+    Close();
+}
+
+void LoopDispatcher::Open(uv_loop_t *loop, TurnCallback turn)
+{
+    {
+        std::unique_lock<std::mutex> lk(m_handle_mutex);
+        m_turn = turn;
+        m_closed = false;
+        m_loop = loop;
+        m_loop_thread = std::this_thread::get_id();
+        m_handle = new Handle();
+        m_handle->owner = this;
+        m_handle->async.data = m_handle;
+        uv_async_init(loop, &m_handle->async, LoopDispatcher::callback);
+        uv_unref((uv_handle_t*)&m_handle->async);
+
+        // Anything posted before we were open is waiting for a wake-up
+        if (Pending()) {
+            uv_ref((uv_handle_t*)&m_handle->async);
+            uv_async_send(&m_handle->async);
+        }
+    }
+
+    std::lock_guard<std::mutex> lk(s_open_mutex);
+    s_open.push_back(this);
+}
+
+void LoopDispatcher::Close()
+{
+    m_closed = true;
+    {
+        std::lock_guard<std::mutex> lk(s_open_mutex);
+        s_open.erase(std::remove(s_open.begin(), s_open.end(), this), s_open.end());
+    }
+
+    Handle *handle;
+    {
+        std::unique_lock<std::mutex> lk(m_handle_mutex);
+        handle = m_handle;
+        m_handle = nullptr;
+    }
+    if (handle) {
+        std::unique_lock<std::mutex> lk(handle->mutex);
+        handle->owner = nullptr;
+        if (std::this_thread::get_id() == m_loop_thread) {
+            lk.unlock();
+            uv_close((uv_handle_t*)&handle->async, [](uv_handle_t *h){
+                delete reinterpret_cast<Handle*>(h->data);
+            });
+        } else {
+            // Handles can only be closed on their own loop, so let the next turn do it.  We
+            // may be going away, so wait until the loop is done with us first.
+            handle->cv.wait(lk, [handle]{ return !handle->in_turn; });
+            uv_async_send(&handle->async);
+        }
+    }
+
+    for (int lane = 0; lane < kLaneCount; lane++) {
+        Task *task = Take((Lane)lane);
+        while (task) {
+            Task *next = task->next;
+            task->Discard();
+            task = next;
+        }
+    }
+}
+
+void LoopDispatcher::Post(Task *task, Lane lane)
+{
+    task->queued_at = uv_hrtime();
+    Task *head = m_lanes[lane].load(std::memory_order_relaxed);
+    do {
+        task->next = head;
+    } while (!m_lanes[lane].compare_exchange_weak(head, task,
+        std::memory_order_release, std::memory_order_relaxed));
+
+    if (m_closed) {
+        // We lost a race with Close(), so nobody is going to run this
+        task = m_lanes[lane].exchange(nullptr, std::memory_order_acquire);
+        while (task) {
+            Task *next = task->next;
+            task->Discard();
+            task = next;
+        }
+    } else if (head == nullptr) {
+        // Only the producer that made the lane non-empty needs to wake the loop
+        Wake();
+    }
+}
+
+void LoopDispatcher::Async(std::function<void()> runnable, Lane lane)
+{
+    Post(new FunctionTask(runnable), lane);
+}
+
+bool LoopDispatcher::Sync(std::function<void()> runnable)
+{
+    TRACE_SPAN("LoopDispatcher::Sync wait");
+    SyncTask task(runnable);
+    Post(&task, kHostSync);
+    return task.Wait();
+}
+
+LoopDispatcher::Ticket * LoopDispatcher::Submit(std::function<void()> runnable, Lane lane)
+{
+    Ticket *ticket = new Ticket(runnable);
+    Post(&ticket->m_task, lane);
+    return ticket;
+}
+
+LoopDispatcher::Ticket::Status LoopDispatcher::Sync(std::function<void()> runnable,
+                                                    unsigned timeout_ms)
+{
+    TRACE_SPAN("LoopDispatcher::Sync wait");
+    Ticket *ticket = Submit(runnable, kHostSync);
+    Ticket::Status status = ticket->Wait(timeout_ms);
+    ticket->Release();
+    return status;
+}
+
+void LoopDispatcher::Wake()
+{
+    std::unique_lock<std::mutex> lk(m_handle_mutex);
+    if (m_handle) {
+        uv_async_send(&m_handle->async);
+    }
+}
+
+bool LoopDispatcher::KeepAlive(uv_loop_t *loop)
+{
+    bool alive = false;
+    std::lock_guard<std::mutex> lk(s_open_mutex);
+    for (LoopDispatcher *dispatcher : s_open) {
+        if (dispatcher->m_loop != loop || !dispatcher->Pending()) continue;
+        // Posted after the last turn let go of the loop; the wake-up is already waiting
+        std::unique_lock<std::mutex> hlk(dispatcher->m_handle_mutex);
+        if (dispatcher->m_handle) {
+            uv_ref((uv_handle_t*)&dispatcher->m_handle->async);
+            uv_async_send(&dispatcher->m_handle->async);
+            alive = true;
+        }
+    }
+    return alive;
+}
+
+bool LoopDispatcher::Pending() const
+{
+    for (int lane = 0; lane < kLaneCount; lane++) {
+        if (m_lanes[lane].load(std::memory_order_relaxed) != nullptr) return true;
+    }
+    return false;
+}
+
+LoopDispatcher::Task * LoopDispatcher::Take(Lane lane)
+{
+    // Take everything at once and reverse it so that tasks run in submission order
+    Task *task = m_lanes[lane].exchange(nullptr, std::memory_order_acquire);
+    Task *fifo = nullptr;
+    while (task) {
+        Task *next = task->next;
+        task->next = fifo;
+        fifo = task;
+        task = next;
+    }
+    return fifo;
+}
+
+void LoopDispatcher::Run(Task *task, Lane lane)
+{
+    LaneStats& stats = m_stats[lane];
+    uint64_t latency = uv_hrtime() - task->queued_at;
+    stats.tasks.fetch_add(1, std::memory_order_relaxed);
+    stats.total_latency_ns.fetch_add(latency, std::memory_order_relaxed);
+    if (latency > stats.max_latency_ns.load(std::memory_order_relaxed)) {
+        stats.max_latency_ns.store(latency, std::memory_order_relaxed);
+    }
+    TRACE_SPAN(lane == kHostSync ? "LoopDispatcher host-sync task" : "LoopDispatcher event task");
+    task->Run();
+}
+
+void LoopDispatcher::RunAll(Task *task, Lane lane)
+{
+    while (task) {
+        Task *next = task->next;
+        Run(task, lane);
+        task = next;
+    }
+}
+
+bool LoopDispatcher::Drain()
+{
+    RunAll(Take(kHostSync), kHostSync);
+
+    Task *task = Take(kEvents);
+    while (task) {
+        Task *next = task->next;
+        Run(task, kEvents);
+        task = next;
+
+        // Don't make a blocked thread wait for the rest of the events
+        if (m_lanes[kHostSync].load(std::memory_order_relaxed) != nullptr) {
+            RunAll(Take(kHostSync), kHostSync);
+        }
+    }
+
+    return Pending();
+}
+
+void LoopDispatcher::FinishTurn(bool pending)
+{
+    std::unique_lock<std::mutex> lk(m_handle_mutex);
+    // Closed during the turn
+    if (!m_handle) return;
+
+    // Hold a reference on the loop until we get to whatever is left, otherwise let the loop
+    // exit if it wants to.  Anything posted after this is picked up by KeepAlive().
+    uv_handle_t *async = (uv_handle_t*)&m_handle->async;
+    if (pending) {
+        uv_ref(async);
+        uv_async_send(&m_handle->async);
+    } else {
+        uv_unref(async);
+    }
+}
+
+void LoopDispatcher::callback(uv_async_t *async)
+{
+    Handle *handle = reinterpret_cast<Handle*>(async->data);
+    LoopDispatcher *thiz;
+    {
+        std::lock_guard<std::mutex> lk(handle->mutex);
+        thiz = handle->owner;
+        handle->in_turn = thiz != nullptr;
+    }
+
+    if (!thiz) {
+        // Closed from another thread
+        if (!uv_is_closing((uv_handle_t*)async)) {
+            uv_close((uv_handle_t*)async, [](uv_handle_t *h){
+                delete reinterpret_cast<Handle*>(h->data);
+            });
+        }
+        return;
+    }
+
+    if (thiz->m_turn) {
+        thiz->m_turn(*thiz);
+    } else {
+        thiz->FinishTurn(thiz->Drain());
+    }
+
+    std::lock_guard<std::mutex> lk(handle->mutex);
+    handle->in_turn = false;
+    handle->cv.notify_all();
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_LOOPDISPATCHER_H
+#define NODEDROID_LOOPDISPATCHER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "uv.h"
+
+namespace nodedroid {
+
+/*
+ * Runs work from other threads on a uv loop.  Used by both the iOS and Android hosts.
+ *
+ * Each lane is a lock-free multi-producer/single-consumer stack: producers push with a CAS and
+ * the loop thread takes a whole lane at once, reversing it into the order the pushes landed in.
+ * Host-sync calls, which have a thread blocked on them, run before any event that hasn't
+ * started yet; there is no ordering between the two lanes beyond that.
+ *
+ * There is one async handle for the life of the dispatcher.  It is only referenced while work
+ * is pending, so it never keeps an idle loop alive on its own.  Only the loop thread can take
+ * that reference, so whoever runs the loop must ask KeepAlive() before letting it end; work
+ * posted to a loop that has already ended is discarded when the dispatcher closes.
+ */
+class LoopDispatcher {
+public:
+    enum Lane {
+        kHostSync = 0,
+        kEvents,
+        kLaneCount
+    };
+
+    struct Task {
+        virtual ~Task() {}
+        // Called on the loop thread.  The task owns itself from here on.
+        virtual void Run() = 0;
+        // Called instead of Run() if the dispatcher is closed before the task gets to run
+        virtual void Discard() { delete this; }
+
+        Task *next = nullptr;
+        uint64_t queued_at = 0;
+    };
+
+    // Queueing latency (time from Post() to Run()), in uv_hrtime() nanoseconds.  Written only on
+    // the loop thread; may be read from anywhere.
+    struct LaneStats {
+        std::atomic<uint64_t> tasks {0};
+        std::atomic<uint64_t> total_latency_ns {0};
+        std::atomic<uint64_t> max_latency_ns {0};
+    };
+
+    /*
+     * A posted runnable that the poster keeps a handle on.  It can be cancelled until it
+     * starts, waited for with a timeout, or run early from elsewhere on the loop thread (e.g.
+     * from an isolate interrupt).  Whichever of those claims it first wins; it runs at most
+     * once.  Reference counted between the queue and any holders.
+     */
+    class Ticket {
+    public:
+        enum Status {
+            kRan = 0,
+            kTimedOut,   // cancelled by Wait() before it started
+            kCancelled,
+            kDiscarded   // the dispatcher was closed first
+        };
+
+        // Runs it here and now unless it has already been claimed.  Must be on the loop thread.
+        bool TryRun();
+        // Returns true if it is now certain never to run
+        bool Cancel();
+        // Waits up to |timeout_ms| (0 is forever) for it to finish.  If it hasn't started by
+        // then it is cancelled.  Once started it is always waited for, since whatever it uses
+        // may live on the waiter's stack.
+        Status Wait(unsigned timeout_ms = 0);
+        void Retain();
+        void Release();
+    private:
+        friend class LoopDispatcher;
+        Ticket(std::function<void()> runnable);
+        struct QueuedTask : Task {
+            void Run() override;
+            void Discard() override;
+            Ticket *m_ticket;
+        };
+        // kDead means it was claimed without running
+        enum State { kQueued, kRunning, kFinished, kDead };
+        void Finish(Status status);
+
+        std::function<void()> m_runnable;
+        QueuedTask m_task;
+        std::atomic<int> m_state {kQueued};
+        std::atomic<int> m_refs {2};
+        Status m_status = kRan;
+        bool m_finished = false;
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+    };
+
+    // Called on the loop thread for each wake-up in place of Drain(), so that an owner can do
+    // its own per-turn work around the queue.  It must end the turn with FinishTurn().
+    typedef std::function<void(LoopDispatcher& dispatcher)> TurnCallback;
+
+    LoopDispatcher() {}
+    ~LoopDispatcher();
+
+    // Must be called on the loop thread
+    void Open(uv_loop_t *loop, TurnCallback turn = nullptr);
+    // Discards anything still queued.  Tasks posted after this are discarded immediately.  May
+    // be called from any thread; off the loop thread it waits out a turn in progress and
+    // leaves the handle for the loop to close.
+    void Close();
+
+    // For whoever runs |loop|, once it has nothing left to do.  Returns true if any dispatcher
+    // on it still has work queued, in which case that dispatcher references the loop again and
+    // it should be run for another turn.  Must be called on the loop thread.
+    static bool KeepAlive(uv_loop_t *loop);
+
+    // May be called from any thread
+    void Post(Task *task, Lane lane = kEvents);
+    void Async(std::function<void()> runnable, Lane lane = kEvents);
+    // Blocks until the runnable has run on the loop thread.  Returns false if it was discarded
+    // instead.  Must not be called on the loop thread.
+    bool Sync(std::function<void()> runnable);
+    // Posts a runnable that can be waited for or cancelled.  The caller owns one reference to
+    // the returned ticket and must Release() it.
+    Ticket * Submit(std::function<void()> runnable, Lane lane = kEvents);
+    // As Sync(), but gives up after |timeout_ms| if the runnable hasn't started yet
+    Ticket::Status Sync(std::function<void()> runnable, unsigned timeout_ms);
+    // Schedules a turn even if nothing is queued
+    void Wake();
+    bool Pending() const;
+    inline const LaneStats& Stats(Lane lane) const { return m_stats[lane]; }
+
+    // Runs everything that was queued when it was called, host-sync calls first.  Returns true
+    // if more work was queued in the meantime.  Must be called on the loop thread.
+    bool Drain();
+    // Holds the loop for another turn if there is more to do, otherwise lets it go
+    void FinishTurn(bool pending);
+
+private:
+    // Outlives the dispatcher if it is closed off the loop thread, until the loop closes it
+    struct Handle {
+        uv_async_t async;
+        std::mutex mutex;
+        std::condition_variable cv;
+        LoopDispatcher *owner;
+        bool in_turn = false;
+    };
+
+    static void callback(uv_async_t *handle);
+    Task * Take(Lane lane);
+    void RunAll(Task *task, Lane lane);
+    void Run(Task *task, Lane lane);
+
+    std::atomic<Task *> m_lanes[kLaneCount] {};
+    LaneStats m_stats[kLaneCount];
+    std::atomic<bool> m_closed {false};
+
+    // Only guards against the handle being closed underneath a producer
+    std::mutex m_handle_mutex;
+    Handle *m_handle = nullptr;
+    uv_loop_t *m_loop = nullptr;
+    std::thread::id m_loop_thread;
+    TurnCallback m_turn;
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_LOOPDISPATCHER_H
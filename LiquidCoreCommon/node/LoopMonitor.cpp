@@ -0,0 +1,243 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#ifdef __APPLE__
+# include <pthread.h>
+# include <pthread/qos.h>
+#endif
+#include "LoopMonitor.h"
+
+namespace nodedroid {
+
+// One thread for every watched loop.  It only runs while something is watched.
+class StallWatchdog {
+public:
+    static void Add(LoopMonitor *monitor)
+    {
+        std::lock_guard<std::mutex> lk(s_mutex);
+        s_watched.push_back(monitor);
+        if (!s_thread) {
+            s_thread = new std::thread(Run);
+            s_thread->detach();
+        }
+        s_cv.notify_all();
+    }
+
+    static void Remove(LoopMonitor *monitor)
+    {
+        std::lock_guard<std::mutex> lk(s_mutex);
+        s_watched.erase(std::remove(s_watched.begin(), s_watched.end(), monitor), s_watched.end());
+    }
+
+    static std::mutex s_mutex;
+
+private:
+    static void Run()
+    {
+#ifdef __APPLE__
+        pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#else
+        // On Linux this applies to the calling thread only
+        setpriority(PRIO_PROCESS, 0, 10);
+#endif
+        std::unique_lock<std::mutex> lk(s_mutex);
+        while (true) {
+            if (s_watched.empty()) {
+                delete s_thread;
+                s_thread = nullptr;
+                return;
+            }
+            // Check often enough to catch an iteration not long after it crosses the threshold
+            unsigned tick_ms = UINT32_MAX;
+            for (auto monitor : s_watched) {
+                tick_ms = std::min(tick_ms, monitor->m_threshold_ms / 4);
+            }
+            s_cv.wait_for(lk, std::chrono::milliseconds(std::max(tick_ms, 10u)));
+
+            const uint64_t now = uv_hrtime();
+            for (auto monitor : s_watched) {
+                const uint64_t start = monitor->m_iteration_start.load(std::memory_order_relaxed);
+                const uint64_t iteration = monitor->Iteration();
+                if (start && now - start > monitor->m_threshold_ns &&
+                        monitor->m_stalled_iteration != iteration) {
+                    monitor->m_stalled_iteration = iteration;
+                    monitor->m_on_stall(iteration);
+                }
+            }
+        }
+    }
+
+    static std::condition_variable s_cv;
+    static std::vector<LoopMonitor*> s_watched;
+    static std::thread *s_thread;
+};
+
+std::mutex StallWatchdog::s_mutex;
+std::condition_variable StallWatchdog::s_cv;
+std::vector<LoopMonitor*> StallWatchdog::s_watched;
+std::thread *StallWatchdog::s_thread = nullptr;
+
+} /* namespace nodedroid */
+
+using namespace nodedroid;
+
+LoopMonitor::~LoopMonitor()
+{
+    Close();
+}
+
+uint64_t LoopMonitor::ThreadCpuTime()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void LoopMonitor::Open(uv_loop_t *loop)
+{
+    m_prepare = new uv_prepare_t();
+    m_prepare->data = this;
+    uv_prepare_init(loop, m_prepare);
+    uv_prepare_start(m_prepare, OnPrepare);
+    uv_unref((uv_handle_t*)m_prepare);
+
+    m_check = new uv_check_t();
+    m_check->data = this;
+    uv_check_init(loop, m_check);
+    uv_check_start(m_check, OnCheck);
+    uv_unref((uv_handle_t*)m_check);
+}
+
+void LoopMonitor::Close()
+{
+    Watch(0, nullptr, nullptr);
+    if (m_prepare) {
+        uv_close((uv_handle_t*)m_prepare, [](uv_handle_t *h){
+            delete (uv_prepare_t*)h;
+        });
+        m_prepare = nullptr;
+    }
+    if (m_check) {
+        uv_close((uv_handle_t*)m_check, [](uv_handle_t *h){
+            delete (uv_check_t*)h;
+        });
+        m_check = nullptr;
+    }
+}
+
+void LoopMonitor::Watch(unsigned threshold_ms, StallCallback on_stall,
+                        LongIterationCallback on_long)
+{
+    if (m_threshold_ms) {
+        StallWatchdog::Remove(this);
+    }
+    {
+        std::lock_guard<std::mutex> lk(StallWatchdog::s_mutex);
+        m_threshold_ms = threshold_ms;
+        m_threshold_ns = threshold_ms * (uint64_t) 1000000;
+        m_on_stall = threshold_ms ? on_stall : nullptr;
+        m_stalled_iteration = UINT64_MAX;
+    }
+    m_on_long = threshold_ms ? on_long : nullptr;
+    if (threshold_ms) {
+        StallWatchdog::Add(this);
+    }
+}
+
+void LoopMonitor::BeginRun()
+{
+    m_run_cpu = ThreadCpuTime();
+    m_busy_since = uv_hrtime();
+}
+
+void LoopMonitor::EndRun()
+{
+    m_cpu_time_ns.fetch_add(ThreadCpuTime() - m_run_cpu, std::memory_order_relaxed);
+    // The rest of the iteration is carried into the next run's, so that the wait in between
+    // doesn't count
+    if (m_busy_since) {
+        m_busy_ns += uv_hrtime() - m_busy_since;
+        m_busy_since = 0;
+    }
+}
+
+void LoopMonitor::OnPrepare(uv_prepare_t *handle)
+{
+    LoopMonitor *thiz = reinterpret_cast<LoopMonitor*>(handle->data);
+    if (thiz->m_busy_since) {
+        thiz->m_busy_ns += uv_hrtime() - thiz->m_busy_since;
+        thiz->m_busy_since = 0;
+    }
+    const uint64_t iteration = thiz->Iteration();
+    const uint64_t busy_ns = thiz->m_busy_ns;
+    thiz->Sample(busy_ns);
+    thiz->m_busy_ns = 0;
+    thiz->m_iteration_start.store(uv_hrtime(), std::memory_order_relaxed);
+    if (thiz->m_on_long && busy_ns >= thiz->m_threshold_ns) {
+        thiz->m_on_long(iteration, busy_ns);
+    }
+    thiz->m_poll_cpu = ThreadCpuTime();
+}
+
+void LoopMonitor::OnCheck(uv_check_t *handle)
+{
+    LoopMonitor *thiz = reinterpret_cast<LoopMonitor*>(handle->data);
+    thiz->m_busy_ns += ThreadCpuTime() - thiz->m_poll_cpu;
+    thiz->m_busy_since = uv_hrtime();
+}
+
+void LoopMonitor::Sample(uint64_t busy_ns)
+{
+    uint64_t us = busy_ns / 1000;
+    int bucket = 0;
+    while (us > 1 && bucket < kBuckets - 1) {
+        us >>= 1;
+        bucket ++;
+    }
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_iterations.fetch_add(1, std::memory_order_relaxed);
+    if (busy_ns > m_max_ns.load(std::memory_order_relaxed)) {
+        m_max_ns.store(busy_ns, std::memory_order_relaxed);
+    }
+}
+
+void LoopMonitor::GetSnapshot(Snapshot *snapshot) const
+{
+    uint64_t counts[kBuckets];
+    uint64_t total = 0;
+    for (int i = 0; i < kBuckets; i++) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    snapshot->iterations = m_iterations.load(std::memory_order_relaxed);
+    snapshot->cpu_time_ns = m_cpu_time_ns.load(std::memory_order_relaxed);
+    snapshot->max_ns = m_max_ns.load(std::memory_order_relaxed);
+
+    // Report the top of the bucket each percentile falls in, but never more than the maximum
+    auto percentile = [&](unsigned pct) -> uint64_t {
+        if (total == 0) return 0;
+        const uint64_t rank = (total * pct + 99) / 100;
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                const uint64_t top = ((uint64_t) 2 << i) * 1000;
+                return top < snapshot->max_ns ? top : snapshot->max_ns;
+            }
+        }
+        return snapshot->max_ns;
+    };
+    snapshot->p50_ns = percentile(50);
+    snapshot->p90_ns = percentile(90);
+    snapshot->p99_ns = percentile(99);
+}
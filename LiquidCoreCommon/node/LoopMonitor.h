@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_LOOPMONITOR_H
+#define NODEDROID_LOOPMONITOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include "uv.h"
+
+namespace nodedroid {
+
+/*
+ * Measures how busy a uv loop is.  A prepare/check pair splits each iteration into the part
+ * spent in poll and the rest.  Wall time outside of poll is busy time; inside of poll only the
+ * thread's CPU time counts, since that is where the loop blocks.  The sum for an iteration is
+ * the longest an event arriving during it could have waited.
+ *
+ * Every uv_run() must be bracketed by BeginRun() and EndRun(), which also account CPU time to
+ * the loop rather than to the thread, so that loops sharing a thread are told apart.
+ *
+ * Long iterations can also be watched for.  A single low-priority thread checks on every
+ * watched loop and reports an iteration that has run past the threshold while it is still
+ * going, which is the moment to find out what it is doing.  It can't tell a loop that is busy
+ * in poll from one that is blocked there, so the busy time decides once the iteration is over.
+ */
+class LoopMonitor {
+public:
+    struct Snapshot {
+        uint64_t iterations;
+        uint64_t cpu_time_ns;
+        // Busy time per iteration.  Percentiles are bucketed to powers of two microseconds.
+        uint64_t p50_ns;
+        uint64_t p90_ns;
+        uint64_t p99_ns;
+        uint64_t max_ns;
+    };
+
+    LoopMonitor() {}
+    ~LoopMonitor();
+
+    // Must be called on the loop thread
+    void Open(uv_loop_t *loop);
+    void Close();
+    void BeginRun();
+    void EndRun();
+
+    // May be called from any thread
+    void GetSnapshot(Snapshot *snapshot) const;
+
+    // Counts iterations; it moves on at each prepare
+    inline uint64_t Iteration() const { return m_iterations.load(std::memory_order_relaxed); }
+
+    // Called on the watchdog thread, at most once per iteration, once it has gone on longer
+    // than the threshold
+    typedef std::function<void(uint64_t iteration)> StallCallback;
+    // Called on the loop thread when an iteration ends with at least the threshold busy
+    typedef std::function<void(uint64_t iteration, uint64_t busy_ns)> LongIterationCallback;
+    // A zero threshold stops watching.  Once this returns, the old callbacks are not called
+    // again.  Must be called on the loop thread.
+    void Watch(unsigned threshold_ms, StallCallback on_stall, LongIterationCallback on_long);
+
+    static uint64_t ThreadCpuTime();
+
+private:
+    friend class StallWatchdog;
+    enum { kBuckets = 32 };
+    static void OnPrepare(uv_prepare_t *handle);
+    static void OnCheck(uv_check_t *handle);
+    void Sample(uint64_t busy_ns);
+
+    uv_prepare_t *m_prepare = nullptr;
+    uv_check_t *m_check = nullptr;
+
+    // Loop thread only
+    uint64_t m_busy_since = 0;   // zero while in poll or outside of uv_run()
+    uint64_t m_busy_ns = 0;
+    uint64_t m_poll_cpu = 0;
+    uint64_t m_run_cpu = 0;
+
+    std::atomic<uint64_t> m_iterations {0};
+    std::atomic<uint64_t> m_cpu_time_ns {0};
+    std::atomic<uint64_t> m_max_ns {0};
+    std::atomic<uint64_t> m_buckets[kBuckets] {};
+
+    // Guarded by the watchdog's mutex
+    unsigned m_threshold_ms = 0;
+    StallCallback m_on_stall;
+    uint64_t m_stalled_iteration = UINT64_MAX;
+    // Loop thread only
+    LongIterationCallback m_on_long;
+    uint64_t m_threshold_ns = 0;
+    std::atomic<uint64_t> m_iteration_start {0};
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_LOOPMONITOR_H
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include "ModuleArchive.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include "env-inl.h"
+#include "nodedroid_file.h"
+
+namespace nodedroid {
+
+namespace {
+
+const char kMagic[4] = { 'L', 'C', 'A', 'R' };
+
+struct Header {
+    char magic[4];
+    uint32_t count;
+    uint64_t index_length;
+};
+
+struct Record {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t path_length;
+    uint32_t reserved;
+};
+
+struct Node {
+    bool directory;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t ino;
+    std::vector<std::string> children;
+};
+
+// One mapped archive, shared by its mount and whatever is open in it
+struct Image {
+    ~Image() { if (map) munmap(map, length); }
+
+    void *map = nullptr;
+    size_t length = 0;
+    const char *contents = nullptr;
+    uv_stat_t stat;
+    std::unordered_map<std::string, Node> nodes;
+};
+
+struct OpenFile {
+    std::shared_ptr<const Image> image;
+    const Node *node;
+    int64_t offset;
+};
+
+struct Archives {
+    std::vector<std::pair<std::string, std::shared_ptr<const Image>>> mounts;
+    std::map<int, OpenFile> files;
+    int next_fd;
+};
+
+std::mutex s_mutex;
+std::map<node::Environment*, Archives> s_archives;
+// How many environments have something mounted, so that the rest never take the lock
+std::atomic<int> s_mounted(0);
+
+// Adds |path|'s directories, and |path| itself to its parent
+Node* AddNode(Image *image, const std::string& path, bool directory)
+{
+    auto inserted = image->nodes.emplace(path, Node());
+    Node *node = &inserted.first->second;
+    if (!inserted.second) {
+        return directory && node->directory ? node : nullptr;
+    }
+    node->directory = directory;
+    node->offset = node->size = 0;
+    node->ino = image->nodes.size();
+    if (path.empty()) return node;
+
+    const size_t slash = path.rfind('/');
+    const std::string parent = slash == std::string::npos ? "" : path.substr(0, slash);
+    Node *dir = image->nodes.count(parent) ? &image->nodes[parent] :
+        AddNode(image, parent, true);
+    if (!dir || !dir->directory) return nullptr;
+    dir->children.push_back(slash == std::string::npos ? path : path.substr(slash + 1));
+    return node;
+}
+
+int Load(uv_loop_t *loop, const std::string& archive, Image *image)
+{
+    uv_fs_t req;
+    const int fd = uv_fs_open(loop, &req, archive.c_str(), O_RDONLY, 0, nullptr);
+    uv_fs_req_cleanup(&req);
+    if (fd < 0) return fd;
+
+    int err = uv_fs_fstat(loop, &req, fd, nullptr);
+    image->stat = req.statbuf;
+    uv_fs_req_cleanup(&req);
+    image->length = static_cast<size_t>(image->stat.st_size);
+    if (err == 0 && image->length < sizeof(Header)) err = UV_EINVAL;
+    if (err == 0) {
+        image->map = mmap(nullptr, image->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (image->map == MAP_FAILED) {
+            image->map = nullptr;
+            err = -errno;
+        }
+    }
+    uv_fs_close(loop, &req, fd, nullptr);
+    uv_fs_req_cleanup(&req);
+    if (err < 0) return err;
+
+    const char *bytes = static_cast<const char*>(image->map);
+    Header header;
+    memcpy(&header, bytes, sizeof header);
+    if (memcmp(header.magic, kMagic, sizeof kMagic) ||
+        header.index_length > image->length - sizeof header) {
+        return UV_EINVAL;
+    }
+    image->contents = bytes + sizeof header + header.index_length;
+    const uint64_t contents_length = image->length - sizeof header - header.index_length;
+
+    AddNode(image, "", true);
+    size_t offset = sizeof header;
+    const size_t end = sizeof header + header.index_length;
+    for (uint32_t i=0; i<header.count; i++) {
+        Record record;
+        if (end - offset < sizeof record) return UV_EINVAL;
+        memcpy(&record, bytes + offset, sizeof record);
+        offset += sizeof record;
+        // Bounded before it is padded, so that the rounding can't wrap
+        if (record.path_length > end - offset) return UV_EINVAL;
+        const size_t padded = (static_cast<size_t>(record.path_length) + 7) &
+            ~static_cast<size_t>(7);
+        if (end - offset < padded || record.offset > contents_length ||
+            record.size > contents_length - record.offset) {
+            return UV_EINVAL;
+        }
+        const std::string path = PathPolicy::Normalize(
+            "/" + std::string(bytes + offset, record.path_length)).substr(1);
+        offset += padded;
+        Node *node = path.empty() ? nullptr : AddNode(image, path, false);
+        if (!node) return UV_EINVAL;
+        node->offset = record.offset;
+        node->size = record.size;
+    }
+    return 0;
+}
+
+void Fill(const Image *image, const Node *node, ModuleArchive::Entry *entry)
+{
+    entry->node = node;
+    entry->directory = node->directory;
+    entry->data = node->directory ? nullptr : image->contents + node->offset;
+    entry->size = node->size;
+    entry->children = node->directory ? &node->children : nullptr;
+
+    uv_stat_t& st = entry->stat;
+    st = image->stat;
+    st.st_mode = node->directory ? (S_IFDIR | 0555) : (S_IFREG | 0444);
+    st.st_nlink = 1;
+    st.st_rdev = 0;
+    st.st_ino = node->ino;
+    st.st_size = node->size;
+    st.st_blksize = 4096;
+    st.st_blocks = (node->size + 511) / 512;
+}
+
+} /* namespace */
+
+int ModuleArchive::Mount(node::Environment *env, const std::string& archive,
+                         const std::string& mount_point)
+{
+    std::shared_ptr<Image> image = std::make_shared<Image>();
+    const int err = Load(env->event_loop(), archive, image.get());
+    if (err < 0) return err;
+
+    const std::string at = PathPolicy::Normalize(mount_point);
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto inserted = s_archives.emplace(env, Archives());
+    Archives& archives = inserted.first->second;
+    if (inserted.second) {
+        archives.next_fd = kFirstFd;
+        s_mounted ++;
+    }
+    for (auto& mount : archives.mounts) {
+        if (mount.first == at) {
+            mount.second = image;
+            return 0;
+        }
+    }
+    archives.mounts.emplace_back(at, image);
+    return 0;
+}
+
+int ModuleArchive::Unmount(node::Environment *env, const std::string& mount_point)
+{
+    const std::string at = PathPolicy::Normalize(mount_point);
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_archives.find(env);
+    if (found == s_archives.end()) return UV_EINVAL;
+    auto& mounts = found->second.mounts;
+    for (auto it = mounts.begin(); it != mounts.end(); ++it) {
+        if (it->first == at) {
+            // Whatever is open stays readable until it is closed
+            mounts.erase(it);
+            return 0;
+        }
+    }
+    return UV_EINVAL;
+}
+
+void ModuleArchive::Remove(node::Environment *env)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (s_archives.erase(env)) s_mounted --;
+}
+
+bool ModuleArchive::Mounted(node::Environment *env)
+{
+    if (!s_mounted) return false;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_archives.find(env);
+    return found != s_archives.end() && !found->second.mounts.empty();
+}
+
+bool ModuleArchive::Find(node::Environment *env, const std::string& path, Entry *entry,
+                         int *err)
+{
+    if (!s_mounted || path.empty() || path[0] != '/') return false;
+    const std::string normalized = PathPolicy::Normalize(path);
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_archives.find(env);
+    if (found == s_archives.end()) return false;
+    for (auto& mount : found->second.mounts) {
+        const std::string& at = mount.first;
+        if (normalized.compare(0, at.size(), at) ||
+            (normalized.size() > at.size() && normalized[at.size()] != '/' && at != "/")) {
+            continue;
+        }
+        const size_t skip = std::min(normalized.size(), at.size() + (at == "/" ? 0 : 1));
+        auto node = mount.second->nodes.find(normalized.substr(skip));
+        if (node == mount.second->nodes.end()) {
+            *err = UV_ENOENT;
+        } else {
+            *err = 0;
+            entry->image = mount.second;
+            Fill(mount.second.get(), &node->second, entry);
+        }
+        return true;
+    }
+    return false;
+}
+
+int ModuleArchive::Open(node::Environment *env, const Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_archives.find(env);
+    if (found == s_archives.end()) return UV_ENOENT;
+    if (entry.directory) return UV_EISDIR;
+    Archives& archives = found->second;
+    const int fd = archives.next_fd ++;
+    archives.files[fd] = OpenFile {
+        std::static_pointer_cast<const Image>(entry.image),
+        static_cast<const Node*>(entry.node), 0
+    };
+    return fd;
+}
+
+int ModuleArchive::Stat(node::Environment *env, int fd, uv_stat_t *stat)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_archives.find(env);
+    if (found == s_archives.end()) return UV_EBADF;
+    auto file = found->second.files.find(fd);
+    if (file == found->second.files.end()) return UV_EBADF;
+    Entry entry;
+    Fill(file->second.image.get(), file->second.node, &entry);
+    *stat = entry.stat;
+    return 0;
+}
+
+int64_t ModuleArchive::Read(node::Environment *env, int fd, char *buffer, size_t length,
+                            int64_t position)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_archives.find(env);
+    if (found == s_archives.end()) return UV_EBADF;
+    auto file = found->second.files.find(fd);
+    if (file == found->second.files.end()) return UV_EBADF;
+    OpenFile& open = file->second;
+    const int64_t at = position < 0 ? open.offset : position;
+    const uint64_t size = open.node->size;
+    const size_t count = static_cast<uint64_t>(at) >= size ? 0 :
+        static_cast<size_t>(std::min<uint64_t>(length, size - at));
+    memcpy(buffer, open.image->contents + open.node->offset + at, count);
+    if (position < 0) open.offset += count;
+    return static_cast<int64_t>(count);
+}
+
+int ModuleArchive::Close(node::Environment *env, int fd)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_archives.find(env);
+    if (found == s_archives.end() || !found->second.files.erase(fd)) return UV_EBADF;
+    return 0;
+}
+
+} /* namespace nodedroid */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_MODULEARCHIVE_H
+#define NODEDROID_MODULEARCHIVE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "node.h"
+#include "env.h"
+
+namespace nodedroid {
+
+/*
+ * Read-only, single-file archives of a service's files (node_modules, typically), mapped into
+ * memory and served at a path in the sandbox.  Once one is mounted, the fs binding's open,
+ * read, fstat, close, stat, lstat, access, readdir and realpath, and the module loader's
+ * internalModuleReadFile and internalModuleStat, answer for paths under the mount point from
+ * the archive's index without touching the file system.  Anything that would change a file
+ * there fails the way it would on any read-only file system, or finds nothing.
+ *
+ * An archive is a header, an index and the files' contents, all in host byte order:
+ *
+ *     "LCAR"  uint32 count  uint64 index_length
+ *     count x { uint64 offset  uint64 size  uint32 path_length  uint32 0  path }
+ *     contents
+ *
+ * Each path is relative to the archive's root, with '/' separators and padded with zeros to a
+ * multiple of 8 bytes.  Offsets are from the start of the contents.  Only files are listed;
+ * the directories are whatever their paths imply.
+ *
+ * Mounts belong to one environment and go away with it.  Paths are matched after the sandbox
+ * has resolved them, so a mount point is a real path, and access to it is checked as usual.
+ */
+class ModuleArchive {
+public:
+    // A file or directory in a mounted archive.  |data| stays valid for as long as |image|
+    // is held.
+    struct Entry {
+        std::shared_ptr<const void> image;
+        const void *node = nullptr;
+        bool directory = false;
+        const char *data = nullptr;
+        uint64_t size = 0;
+        uv_stat_t stat;
+        const std::vector<std::string> *children = nullptr;
+    };
+
+    // Both paths are real.  Returns 0 or a negative uv error, and replaces any archive
+    // already mounted at |mount_point|.  Must be called on the instance's thread.
+    static int Mount(node::Environment *env, const std::string& archive,
+                     const std::string& mount_point);
+    static int Unmount(node::Environment *env, const std::string& mount_point);
+    // Drops everything |env| has mounted or open.  Must be called on the instance's thread
+    // before the environment goes away.
+    static void Remove(node::Environment *env);
+    static bool Mounted(node::Environment *env);
+
+    // False if the real path |path| isn't under any of |env|'s mount points.  Otherwise
+    // true, with |err| 0 and |entry| filled in, or |err| UV_ENOENT.
+    static bool Find(node::Environment *env, const std::string& path, Entry *entry, int *err);
+
+    // Descriptors for archived files, numbered far above any the system hands out
+    static bool IsArchiveFd(int fd) { return fd >= kFirstFd; }
+    static int Open(node::Environment *env, const Entry& entry);
+    // Each returns a negative uv error for a descriptor that isn't open.  A |position| of -1
+    // reads from, and advances, the descriptor's own offset.
+    static int Stat(node::Environment *env, int fd, uv_stat_t *stat);
+    static int64_t Read(node::Environment *env, int fd, char *buffer, size_t length,
+                        int64_t position);
+    static int Close(node::Environment *env, int fd);
+
+private:
+    static const int kFirstFd = 0x40000000;
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_MODULEARCHIVE_H
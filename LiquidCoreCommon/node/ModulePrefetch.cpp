@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include "ModulePrefetch.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "env-inl.h"
+#include "nodedroid_file.h"
+#include "ThreadClass.h"
+
+namespace nodedroid {
+
+namespace {
+
+const char kManifestName[] = ".boot-manifest";
+const uint32_t kMagic = 0x4c434d31;    // 'LCM1'
+
+// Limits on what one boot notes and holds in memory ahead of the loader
+const size_t kMaxEntries = 4096;
+const size_t kMaxPathLength = 4096;
+const uint64_t kMaxBytes = 32 * 1024 * 1024;
+const size_t kWorkers = 4;
+
+// The manifest is a Header, then for each entry an EntryHeader followed by its path
+struct Header {
+    uint32_t magic;
+    uint32_t count;
+    uint64_t bundle;
+};
+
+struct EntryHeader {
+    uint64_t length;
+    uint64_t hash;
+    uint64_t path_length;
+};
+
+enum Status { kQueued, kReading, kReady, kGone };
+
+struct Entry {
+    std::string path;
+    uint64_t length;
+    uint64_t hash;
+    Status status = kGone;
+    std::vector<char> data;     // with a spare byte, as the loader reads a file
+    int64_t read_length = 0;
+    uint64_t read_hash = 0;
+};
+
+struct Read {
+    std::string path;
+    uint64_t length;
+    uint64_t hash;
+};
+
+// An environment's manifest, as loaded, and the reads of this boot.  The workers share it,
+// so it outlives the environment until the last of them is done.
+struct State {
+    std::string key;
+    bool started = false;
+    bool recording = true;
+    std::string dir;
+    std::string file;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    bool closed = false;
+    uint64_t bundle = 0;
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, size_t> index;
+
+    std::vector<Read> reads;
+    std::unordered_set<std::string> seen;
+};
+
+struct Work {
+    uv_work_t req;
+    std::shared_ptr<State> state;
+    size_t first;
+};
+
+struct Write {
+    uv_work_t req;
+    std::string dir;
+    std::string file;
+    std::vector<char> manifest;
+};
+
+std::mutex s_mutex;
+std::map<node::Environment*, std::shared_ptr<State>> s_states;
+
+std::shared_ptr<State> StateFor(node::Environment *env)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_states.find(env);
+    return found == s_states.end() ? nullptr : found->second;
+}
+
+uint64_t Hash(const void *bytes, size_t length, uint64_t seed)
+{
+    const uint8_t *p = static_cast<const uint8_t*>(bytes);
+    uint64_t hash = seed;
+    for (size_t i=0; i<length; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t Bundle(const std::vector<Read>& reads)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (const Read& read : reads) {
+        hash = Hash(read.path.data(), read.path.size(), hash);
+        hash = Hash(&read.length, sizeof read.length, hash);
+        hash = Hash(&read.hash, sizeof read.hash, hash);
+    }
+    return hash;
+}
+
+// Reads all of |path| the way the loader would, off the instance's thread
+bool ReadWhole(const std::string& path, std::vector<char> *data, int64_t *length)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    data->resize((fstat(fd, &st) == 0 ? static_cast<size_t>(st.st_size) : 0) + 1);
+    size_t offset = 0;
+    ssize_t numchars;
+    do {
+        if (offset == data->size()) data->resize(data->size() * 2);
+        numchars = pread(fd, &(*data)[offset], data->size() - offset, offset);
+        if (numchars > 0) offset += numchars;
+    } while (numchars > 0);
+    close(fd);
+    if (numchars < 0) return false;
+    // Keep the spare byte, so that an empty file still has somewhere to point
+    if (offset == data->size()) data->push_back(0);
+    *length = static_cast<int64_t>(offset);
+    return true;
+}
+
+void Prefetch(uv_work_t *req)
+{
+    ScopedLoopThreadClass thread_class(req->loop);
+    Work *work = static_cast<Work*>(req->data);
+    State *state = work->state.get();
+    for (size_t i = work->first; i < state->entries.size(); i += kWorkers) {
+        Entry& entry = state->entries[i];
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->closed) break;
+            if (entry.status != kQueued) continue;
+            entry.status = kReading;
+        }
+        std::vector<char> data;
+        int64_t length = 0;
+        const bool ok = ReadWhole(entry.path, &data, &length);
+        const uint64_t hash = ok ? Hash(data.data(), static_cast<size_t>(length),
+                                        14695981039346656037ULL) : 0;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (ok && !state->closed) {
+                entry.data.swap(data);
+                entry.read_length = length;
+                entry.read_hash = hash;
+                entry.status = kReady;
+            } else {
+                entry.status = kGone;
+            }
+        }
+        state->ready.notify_all();
+    }
+}
+
+bool LoadManifest(State *state)
+{
+    const int fd = open(state->file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    std::vector<char> data;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > static_cast<off_t>(sizeof(Header))) {
+        data.resize(static_cast<size_t>(st.st_size));
+        if (pread(fd, data.data(), data.size(), 0) != static_cast<ssize_t>(data.size())) {
+            data.clear();
+        }
+    }
+    close(fd);
+    if (data.empty()) return false;
+
+    Header header;
+    memcpy(&header, data.data(), sizeof header);
+    if (header.magic != kMagic || header.count > kMaxEntries) return false;
+
+    std::vector<Read> listed;
+    size_t offset = sizeof header;
+    for (uint32_t i=0; i<header.count; i++) {
+        EntryHeader entry;
+        if (data.size() - offset < sizeof entry) return false;
+        memcpy(&entry, &data[offset], sizeof entry);
+        offset += sizeof entry;
+        if (entry.path_length > kMaxPathLength || data.size() - offset < entry.path_length) {
+            return false;
+        }
+        listed.push_back({ std::string(&data[offset], entry.path_length), entry.length,
+                           entry.hash });
+        offset += entry.path_length;
+    }
+    // A manifest that doesn't add up to its own hash is as good as none
+    if (offset != data.size() || Bundle(listed) != header.bundle) return false;
+
+    state->bundle = header.bundle;
+    uint64_t bytes = 0;
+    state->entries.resize(listed.size());
+    for (size_t i=0; i<listed.size(); i++) {
+        Entry& entry = state->entries[i];
+        entry.path = std::move(listed[i].path);
+        entry.length = listed[i].length;
+        entry.hash = listed[i].hash;
+        bytes += entry.length;
+        if (bytes <= kMaxBytes && state->index.emplace(entry.path, i).second) {
+            entry.status = kQueued;
+        }
+    }
+    return true;
+}
+
+// On the first read, once the sandbox is there to say where the manifest is
+void Start(node::Environment *env, const std::shared_ptr<State>& state)
+{
+    state->started = true;
+    if (!CacheDir(env, kManifestName, &state->dir)) return;
+    char name[24];
+    snprintf(name, sizeof name, "/%016llx", static_cast<unsigned long long>(
+        Hash(state->key.data(), state->key.size(), 14695981039346656037ULL)));
+    state->file = state->dir + name;
+    if (!LoadManifest(state.get()) || state->index.empty()) return;
+
+    for (size_t i=0; i<std::min(kWorkers, state->entries.size()); i++) {
+        Work *work = new Work();
+        work->req.data = work;
+        work->state = state;
+        work->first = i;
+        uv_queue_work(env->event_loop(), &work->req, Prefetch, [](uv_work_t *req, int) {
+            delete static_cast<Work*>(req->data);
+        });
+    }
+}
+
+void Close(State *state)
+{
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->closed = true;
+    for (Entry& entry : state->entries) {
+        if (entry.status != kReading) {
+            entry.status = kGone;
+            std::vector<char>().swap(entry.data);
+        }
+    }
+}
+
+// Failure is silent; it only costs the next boot its head start
+void Store(uv_work_t *req)
+{
+    Write *write = static_cast<Write*>(req->data);
+    mkdir(write->dir.c_str(), 0700);
+    // Write to the side and rename, so that a reader never sees a partial manifest
+    const std::string temp = write->file + ".tmp";
+    const int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    const ssize_t written = ::write(fd, write->manifest.data(), write->manifest.size());
+    close(fd);
+    if (written == static_cast<ssize_t>(write->manifest.size())) {
+        rename(temp.c_str(), write->file.c_str());
+    } else {
+        unlink(temp.c_str());
+    }
+}
+
+} /* namespace */
+
+void ModulePrefetch::Install(node::Environment *env, const char *key)
+{
+    if (!key || !*key) return;
+    std::shared_ptr<State> state = std::make_shared<State>();
+    state->key = key;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_states[env] = state;
+}
+
+bool ModulePrefetch::Take(node::Environment *env, const char *path, std::vector<char> *chars,
+                          int64_t *length)
+{
+    std::shared_ptr<State> state = StateFor(env);
+    if (!state || !state->recording) return false;
+    if (!state->started) Start(env, state);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    auto found = state->index.find(path);
+    if (found == state->index.end()) return false;
+    Entry& entry = state->entries[found->second];
+    // Not started yet, so it is quicker to read it here than to wait
+    if (entry.status == kQueued) entry.status = kGone;
+    state->ready.wait(lock, [&entry]() { return entry.status != kReading; });
+    if (entry.status != kReady) return false;
+
+    chars->swap(entry.data);
+    *length = entry.read_length;
+    entry.status = kGone;
+    if (state->reads.size() < kMaxEntries && state->seen.insert(path).second) {
+        state->reads.push_back({ path, static_cast<uint64_t>(entry.read_length),
+                                 entry.read_hash });
+    }
+    return true;
+}
+
+void ModulePrefetch::Record(node::Environment *env, const char *path, const char *chars,
+                            int64_t length)
+{
+    std::shared_ptr<State> state = StateFor(env);
+    if (!state || !state->recording || strlen(path) > kMaxPathLength) return;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->reads.size() < kMaxEntries && state->seen.insert(path).second) {
+        state->reads.push_back({ path, static_cast<uint64_t>(length),
+                                 Hash(chars, static_cast<size_t>(length),
+                                      14695981039346656037ULL) });
+    }
+}
+
+void ModulePrefetch::BootDone(node::Environment *env)
+{
+    std::shared_ptr<State> state = StateFor(env);
+    if (!state || !state->recording) return;
+    state->recording = false;
+    Close(state.get());
+    if (state->file.empty() || state->reads.empty()) return;
+
+    const uint64_t bundle = Bundle(state->reads);
+    if (bundle == state->bundle) return;
+
+    Write *write = new Write();
+    write->req.data = write;
+    write->dir = state->dir;
+    write->file = state->file;
+    Header header = { kMagic, static_cast<uint32_t>(state->reads.size()), bundle };
+    const char *bytes = reinterpret_cast<const char*>(&header);
+    write->manifest.assign(bytes, bytes + sizeof header);
+    for (const Read& read : state->reads) {
+        EntryHeader entry = { read.length, read.hash, read.path.size() };
+        bytes = reinterpret_cast<const char*>(&entry);
+        write->manifest.insert(write->manifest.end(), bytes, bytes + sizeof entry);
+        write->manifest.insert(write->manifest.end(), read.path.begin(), read.path.end());
+    }
+    std::vector<Read>().swap(state->reads);
+    uv_queue_work(env->event_loop(), &write->req, Store, [](uv_work_t *req, int) {
+        delete static_cast<Write*>(req->data);
+    });
+}
+
+void ModulePrefetch::Remove(node::Environment *env)
+{
+    std::shared_ptr<State> state;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto found = s_states.find(env);
+        if (found == s_states.end()) return;
+        state = found->second;
+        s_states.erase(found);
+    }
+    Close(state.get());
+}
+
+} /* namespace nodedroid */
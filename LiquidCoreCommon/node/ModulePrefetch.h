@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_MODULEPREFETCH_H
+#define NODEDROID_MODULEPREFETCH_H
+
+#include <cstdint>
+#include <vector>
+#include "node.h"
+#include "env.h"
+
+namespace nodedroid {
+
+/*
+ * Reads a service's modules ahead of its loader.  Every file the module loader reads through
+ * InternalModuleReadFile() while the service boots is noted, in order, with its size and a
+ * hash of its contents, and at the end of the boot the list is kept as a manifest under the
+ * sandbox's /home/cache/.boot-manifest (or under the shared code cache directory, if one is
+ * set).  The next boot hands the files it lists to the threadpool as soon as the loader reads
+ * anything, so that by the time it asks for one it is usually already in memory.
+ *
+ * The loader still resolves and checks every path itself; a prefetched file is only handed
+ * back for the path the sandbox resolved it to, and it is what is on disk, not what was.  The
+ * manifest carries a hash over all of its entries, and when the files a boot reads no longer
+ * add up to it, that boot writes a new one.
+ */
+class ModulePrefetch {
+public:
+    // Starts noting reads for |env|, whose manifest is kept under |key| (the service's entry
+    // script).  Must be called on the instance's thread before the environment loads.
+    static void Install(node::Environment *env, const char *key);
+    // The boot is over.  Drops whatever the loader didn't ask for and, if the manifest no
+    // longer matches, writes a new one.  Must be called on the instance's thread.
+    static void BootDone(node::Environment *env);
+    // Stops prefetching for |env|.  Must be called on the instance's thread before the
+    // environment goes away.
+    static void Remove(node::Environment *env);
+
+    // For the module loader, with |path| as the sandbox resolved it.  If the file was
+    // prefetched, its contents (with a spare byte after them) go to |chars|, their length to
+    // |length|, and this returns true; otherwise the loader reads it and calls Record().
+    static bool Take(node::Environment *env, const char *path, std::vector<char> *chars,
+                     int64_t *length);
+    static void Record(node::Environment *env, const char *path, const char *chars,
+                       int64_t length);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_MODULEPREFETCH_H
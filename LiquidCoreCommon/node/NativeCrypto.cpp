@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <string>
+#include "env-inl.h"
+#include "node_buffer.h"
+#include "NativeCrypto.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+std::atomic<bool> s_enabled(false);
+
+// What a JS handle holds: a digest or a cipher, and where it is in its life
+struct Handle {
+    std::unique_ptr<NativeCrypto::Digest> digest;
+    std::unique_ptr<NativeCrypto::Cipher> cipher;
+    size_t length = 0;          // the digest's
+    bool hmac = false;
+    bool started = false;       // the cipher has been given data
+    bool finished = false;
+    Persistent<Object> object;
+};
+
+void Throw(Isolate *isolate, const char *message)
+{
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, message)));
+}
+
+void ThrowType(Isolate *isolate, const char *message)
+{
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, message)));
+}
+
+// An instance of |ctor|, with room for the handle, which is deleted along with it
+Local<Object> Wrap(Isolate *isolate, Local<Function> ctor, Handle *handle)
+{
+    Local<Object> object = ctor->NewInstance(isolate->GetCurrentContext()).ToLocalChecked();
+    object->SetAlignedPointerInInternalField(0, handle);
+    handle->object.Reset(isolate, object);
+    handle->object.SetWeak(handle, [](const WeakCallbackInfo<Handle>& info) {
+        Handle *handle = info.GetParameter();
+        handle->object.Reset();
+        delete handle;
+    }, WeakCallbackType::kParameter);
+    return object;
+}
+
+Handle *Unwrap(Local<Value> value)
+{
+    if (!value->IsObject() || value.As<Object>()->InternalFieldCount() < 1) return nullptr;
+    return static_cast<Handle*>(value.As<Object>()->GetAlignedPointerFromInternalField(0));
+}
+
+Local<Object> Copy(Isolate *isolate, const unsigned char *data, size_t length)
+{
+    return node::Buffer::Copy(isolate, reinterpret_cast<const char*>(data), length)
+        .ToLocalChecked();
+}
+
+inline const unsigned char *Data(Local<Value> buffer)
+{
+    return reinterpret_cast<const unsigned char*>(node::Buffer::Data(buffer));
+}
+
+std::string Lower(Local<Value> value)
+{
+    std::string name = *String::Utf8Value(value);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    return name;
+}
+
+bool ParseAlgorithm(Local<Value> value, NativeCrypto::Algorithm *algorithm)
+{
+    if (!value->IsString()) return false;
+    const std::string name = Lower(value);
+    if (name == "sha1") *algorithm = NativeCrypto::kSHA1;
+    else if (name == "sha256") *algorithm = NativeCrypto::kSHA256;
+    else if (name == "sha512") *algorithm = NativeCrypto::kSHA512;
+    else return false;
+    return true;
+}
+
+// "aes-<bits>-<mode>", or OpenSSL's "aes<bits>" for CBC
+bool ParseCipher(Local<Value> value, NativeCrypto::Mode *mode, size_t *key_length)
+{
+    if (!value->IsString()) return false;
+    const std::string name = Lower(value);
+    std::string bits, suffix;
+    if (name.compare(0, 4, "aes-") == 0 && name.size() == 11) {
+        bits = name.substr(4, 3);
+        suffix = name.substr(7);
+    } else if (name.compare(0, 3, "aes") == 0 && name.size() == 6) {
+        bits = name.substr(3);
+        suffix = "-cbc";
+    } else {
+        return false;
+    }
+    if (bits == "128") *key_length = 16;
+    else if (bits == "192") *key_length = 24;
+    else if (bits == "256") *key_length = 32;
+    else return false;
+    if (suffix == "-cbc") *mode = NativeCrypto::kCBC;
+    else if (suffix == "-ctr") *mode = NativeCrypto::kCTR;
+    else if (suffix == "-gcm") *mode = NativeCrypto::kGCM;
+    else return false;
+    return true;
+}
+
+// digestUpdate(handle, buffer)
+void DigestUpdate(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    Handle *handle = Unwrap(args[0]);
+    if (!handle || handle->finished) {
+        // As OpenSSL's: an HMAC quietly takes nothing more
+        if (handle && handle->hmac) return args.GetReturnValue().Set(false);
+        return Throw(isolate, "Not initialized");
+    }
+    if (!node::Buffer::HasInstance(args[1])) {
+        return ThrowType(isolate, "Data must be a string or a buffer");
+    }
+    args.GetReturnValue().Set(
+        handle->digest->Update(Data(args[1]), node::Buffer::Length(args[1])));
+}
+
+// digestFinal(handle) -> buffer
+void DigestFinal(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    Handle *handle = Unwrap(args[0]);
+    if (!handle || handle->finished) {
+        if (handle && handle->hmac) return args.GetReturnValue().Set(Copy(isolate, nullptr, 0));
+        return Throw(isolate, "Not initialized");
+    }
+    unsigned char out[NativeCrypto::kMaxDigestLength];
+    const bool ok = handle->digest->Final(out);
+    handle->finished = true;
+    handle->digest.reset();
+    if (!ok) return Throw(isolate, "Digest failed");
+    args.GetReturnValue().Set(Copy(isolate, out, handle->length));
+}
+
+Handle *UnwrapCipher(const FunctionCallbackInfo<Value>& args)
+{
+    Handle *handle = Unwrap(args[0]);
+    return handle && handle->cipher ? handle : nullptr;
+}
+
+// cipherUpdate(handle, buffer) -> buffer
+void CipherUpdate(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    Handle *handle = UnwrapCipher(args);
+    if (!handle || handle->finished) {
+        return Throw(isolate, "Trying to add data in unsupported state");
+    }
+    if (!node::Buffer::HasInstance(args[1])) {
+        return ThrowType(isolate, "Cipher data must be a string or a buffer");
+    }
+    handle->started = true;
+    std::vector<unsigned char> out;
+    if (!handle->cipher->Update(Data(args[1]), node::Buffer::Length(args[1]), out)) {
+        return Throw(isolate, "Trying to add data in unsupported state");
+    }
+    args.GetReturnValue().Set(Copy(isolate, out.data(), out.size()));
+}
+
+// cipherFinal(handle) -> buffer
+void CipherFinal(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    Handle *handle = UnwrapCipher(args);
+    if (!handle || handle->finished) {
+        return Throw(isolate, "Unsupported state");
+    }
+    handle->started = handle->finished = true;
+    std::vector<unsigned char> out;
+    if (!handle->cipher->Final(out)) {
+        // OpenSSL's wording, which callers have been known to match on
+        const NativeCrypto::Cipher::Params& params = handle->cipher->params;
+        if (params.mode == NativeCrypto::kGCM) {
+            return Throw(isolate, "Unsupported state or unable to authenticate data");
+        }
+        return Throw(isolate, params.encrypt ?
+            "error:0607F08A:digital envelope routines:EVP_EncryptFinal_ex:"
+                "data not multiple of block length" :
+            "error:06065064:digital envelope routines:EVP_DecryptFinal_ex:bad decrypt");
+    }
+    args.GetReturnValue().Set(Copy(isolate, out.data(), out.size()));
+}
+
+// setAutoPadding(handle, padding)
+void SetAutoPadding(const FunctionCallbackInfo<Value>& args)
+{
+    Handle *handle = UnwrapCipher(args);
+    if (!handle || handle->finished ||
+        (handle->started && handle->cipher->params.mode == NativeCrypto::kCBC)) {
+        return Throw(args.GetIsolate(), "Attempting to set auto padding in unsupported state");
+    }
+    handle->cipher->params.padding = args.Length() < 2 || args[1]->BooleanValue();
+}
+
+// setAAD(handle, buffer)
+void SetAAD(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    Handle *handle = UnwrapCipher(args);
+    if (!node::Buffer::HasInstance(args[1])) {
+        return ThrowType(isolate, "AAD must be a buffer");
+    }
+    if (!handle || handle->started || handle->cipher->params.mode != NativeCrypto::kGCM ||
+        !handle->cipher->SetAAD(Data(args[1]), node::Buffer::Length(args[1]))) {
+        return Throw(isolate, "Attempting to set AAD in unsupported state");
+    }
+}
+
+// setAuthTag(handle, buffer)
+void SetAuthTag(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    Handle *handle = UnwrapCipher(args);
+    if (!node::Buffer::HasInstance(args[1])) {
+        return ThrowType(isolate, "Auth tag must be a buffer");
+    }
+    if (!handle || handle->finished || handle->cipher->params.encrypt ||
+        handle->cipher->params.mode != NativeCrypto::kGCM) {
+        return Throw(isolate, "Attempting to set auth tag in unsupported state");
+    }
+    const unsigned char *tag = Data(args[1]);
+    handle->cipher->auth_tag.assign(tag, tag + node::Buffer::Length(args[1]));
+}
+
+// getAuthTag(handle) -> buffer
+void GetAuthTag(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    Handle *handle = UnwrapCipher(args);
+    if (!handle || !handle->finished || !handle->cipher->params.encrypt ||
+        handle->cipher->params.mode != NativeCrypto::kGCM) {
+        return Throw(isolate, "Attempting to get auth tag in unsupported state");
+    }
+    const std::vector<unsigned char>& tag = handle->cipher->auth_tag;
+    args.GetReturnValue().Set(Copy(isolate, tag.data(), tag.size()));
+}
+
+// The binding's Hash, Hmac and CipherBase, on the native handles when they'll have the
+// algorithm and on the originals when not; and randomBytes and randomFill, for sizes the
+// originals would have taken
+const char kWrapper[] =
+    "(function(process, native) {\n"
+    "  let binding;\n"
+    "  try {\n"
+    "    binding = process.binding('crypto');\n"
+    "  } catch (e) {\n"
+    "    return;\n"
+    "  }\n"
+    "  const OriginalHash = binding.Hash;\n"
+    "  const OriginalHmac = binding.Hmac;\n"
+    "  const OriginalCipherBase = binding.CipherBase;\n"
+    "  const originalRandomBytes = binding.randomBytes;\n"
+    "  const originalRandomFill = binding.randomFill;\n"
+    "  const kMaxLength = 0x7fffffff;\n"
+    "  function toBuffer(data, encoding) {\n"
+    "    if (typeof data !== 'string') return data;\n"
+    "    return Buffer.from(data, !encoding || encoding === 'buffer' ? 'utf8' : encoding);\n"
+    "  }\n"
+    "  function encode(buffer, encoding) {\n"
+    "    return !encoding || encoding === 'buffer' ? buffer : buffer.toString(encoding);\n"
+    "  }\n"
+    "\n"
+    "  function Hash(algorithm) {\n"
+    "    const handle = native.hash(algorithm);\n"
+    "    if (!handle) return new OriginalHash(algorithm);\n"
+    "    this._native = handle;\n"
+    "  }\n"
+    "  Hash.prototype.update = function(data, encoding) {\n"
+    "    return native.digestUpdate(this._native, toBuffer(data, encoding));\n"
+    "  };\n"
+    "  Hash.prototype.digest = function(encoding) {\n"
+    "    return encode(native.digestFinal(this._native), encoding);\n"
+    "  };\n"
+    "\n"
+    "  function Hmac() {\n"
+    "    this._native = null;\n"
+    "    this._original = null;\n"
+    "  }\n"
+    "  Hmac.prototype.init = function(algorithm, key) {\n"
+    "    this._native = Buffer.isBuffer(key) ? native.hmac(algorithm, key) : undefined;\n"
+    "    if (this._native) return;\n"
+    "    this._original = new OriginalHmac();\n"
+    "    return this._original.init(algorithm, key);\n"
+    "  };\n"
+    "  Hmac.prototype.update = function(data, encoding) {\n"
+    "    if (this._original) return this._original.update(data, encoding);\n"
+    "    return native.digestUpdate(this._native, toBuffer(data, encoding));\n"
+    "  };\n"
+    "  Hmac.prototype.digest = function(encoding) {\n"
+    "    if (this._original) return this._original.digest.apply(this._original, arguments);\n"
+    "    return encode(native.digestFinal(this._native), encoding);\n"
+    "  };\n"
+    "\n"
+    "  function CipherBase(encrypt) {\n"
+    "    this._encrypt = encrypt;\n"
+    "    this._native = null;\n"
+    "    this._original = null;\n"
+    "  }\n"
+    "  CipherBase.prototype.init = function(cipher, password) {\n"
+    "    this._original = new OriginalCipherBase(this._encrypt);\n"
+    "    return this._original.init(cipher, password);\n"
+    "  };\n"
+    "  CipherBase.prototype.initiv = function(cipher, key, iv) {\n"
+    "    this._native = Buffer.isBuffer(key) && Buffer.isBuffer(iv) ?\n"
+    "      native.cipher(cipher, !!this._encrypt, key, iv) : undefined;\n"
+    "    if (this._native) return;\n"
+    "    this._original = new OriginalCipherBase(this._encrypt);\n"
+    "    return this._original.initiv(cipher, key, iv);\n"
+    "  };\n"
+    "  const cipherMethods = {\n"
+    "    update: function(data, encoding) {\n"
+    "      return native.cipherUpdate(this._native, toBuffer(data, encoding));\n"
+    "    },\n"
+    "    final: function() { return native.cipherFinal(this._native); },\n"
+    "    setAutoPadding: function(padding) {\n"
+    "      native.setAutoPadding(this._native, padding === undefined ? true : !!padding);\n"
+    "    },\n"
+    "    getAuthTag: function() { return native.getAuthTag(this._native); },\n"
+    "    setAuthTag: function(tag) { native.setAuthTag(this._native, tag); },\n"
+    "    setAAD: function(aad) { native.setAAD(this._native, aad); }\n"
+    "  };\n"
+    "  Object.keys(cipherMethods).forEach(function(name) {\n"
+    "    CipherBase.prototype[name] = function() {\n"
+    "      if (this._original)\n"
+    "        return this._original[name].apply(this._original, arguments);\n"
+    "      return cipherMethods[name].apply(this, arguments);\n"
+    "    };\n"
+    "  });\n"
+    "\n"
+    "  function validSize(size) {\n"
+    "    return typeof size === 'number' && (size >>> 0) === size && size <= kMaxLength;\n"
+    "  }\n"
+    "  function randomBytes(size, callback) {\n"
+    "    if (!validSize(size)) return originalRandomBytes.apply(this, arguments);\n"
+    "    const buffer = Buffer.allocUnsafe(size);\n"
+    "    if (!native.randomFill(buffer, 0, size))\n"
+    "      return originalRandomBytes.apply(this, arguments);\n"
+    "    if (typeof callback !== 'function') return buffer;\n"
+    "    process.nextTick(callback, null, buffer);\n"
+    "  }\n"
+    "  function randomFill(buffer, offset, size, callback) {\n"
+    "    if (!(buffer instanceof Uint8Array) || !validSize(offset) || !validSize(size) ||\n"
+    "        !native.randomFill(buffer, offset, size))\n"
+    "      return originalRandomFill.apply(this, arguments);\n"
+    "    if (typeof callback !== 'function') return buffer;\n"
+    "    process.nextTick(callback, null, buffer);\n"
+    "  }\n"
+    "\n"
+    "  binding.Hash = Hash;\n"
+    "  binding.Hmac = Hmac;\n"
+    "  binding.CipherBase = CipherBase;\n"
+    "  binding.randomBytes = randomBytes;\n"
+    "  binding.randomFill = randomFill;\n"
+    "})";
+
+} /* namespace */
+
+size_t NativeCrypto::DigestLength(Algorithm algorithm)
+{
+    switch (algorithm) {
+        case kSHA1:   return 20;
+        case kSHA256: return 32;
+        case kSHA512: return 64;
+    }
+    return 0;
+}
+
+// hash(algorithm) -> handle, or undefined
+void NativeCrypto::CreateHash(const FunctionCallbackInfo<Value>& args)
+{
+    Algorithm algorithm;
+    if (!ParseAlgorithm(args[0], &algorithm)) return;
+    std::unique_ptr<Digest> digest = NewHash(algorithm);
+    if (!digest) return;
+
+    Handle *handle = new Handle();
+    handle->digest = std::move(digest);
+    handle->length = DigestLength(algorithm);
+    args.GetReturnValue().Set(Wrap(args.GetIsolate(), args.Data().As<Function>(), handle));
+}
+
+// hmac(algorithm, key) -> handle, or undefined
+void NativeCrypto::CreateHmac(const FunctionCallbackInfo<Value>& args)
+{
+    Algorithm algorithm;
+    if (!ParseAlgorithm(args[0], &algorithm) || !node::Buffer::HasInstance(args[1])) return;
+    std::unique_ptr<Digest> digest = NewHmac(algorithm, Data(args[1]),
+                                             node::Buffer::Length(args[1]));
+    if (!digest) return;
+
+    Handle *handle = new Handle();
+    handle->digest = std::move(digest);
+    handle->length = DigestLength(algorithm);
+    handle->hmac = true;
+    args.GetReturnValue().Set(Wrap(args.GetIsolate(), args.Data().As<Function>(), handle));
+}
+
+// cipher(name, encrypt, key, iv) -> handle, or undefined
+void NativeCrypto::CreateCipher(const FunctionCallbackInfo<Value>& args)
+{
+    Cipher::Params params;
+    size_t key_length;
+    if (!ParseCipher(args[0], &params.mode, &key_length) ||
+        !node::Buffer::HasInstance(args[2]) || !node::Buffer::HasInstance(args[3])) {
+        return;
+    }
+    // Lengths OpenSSL would turn down, it can turn down
+    const size_t iv_length = node::Buffer::Length(args[3]);
+    if (node::Buffer::Length(args[2]) != key_length ||
+        (params.mode == kGCM ? iv_length == 0 : iv_length != 16)) {
+        return;
+    }
+    params.encrypt = args[1]->BooleanValue();
+    params.padding = true;
+    params.key.assign(Data(args[2]), Data(args[2]) + key_length);
+    params.iv.assign(Data(args[3]), Data(args[3]) + iv_length);
+    std::unique_ptr<Cipher> cipher = NewCipher(params);
+    if (!cipher) return;
+
+    Handle *handle = new Handle();
+    handle->cipher = std::move(cipher);
+    args.GetReturnValue().Set(Wrap(args.GetIsolate(), args.Data().As<Function>(), handle));
+}
+
+// randomFill(buffer, offset, size) -> false if the platform couldn't
+void NativeCrypto::Random(const FunctionCallbackInfo<Value>& args)
+{
+    if (!node::Buffer::HasInstance(args[0]) || !args[1]->IsUint32() || !args[2]->IsUint32()) {
+        return args.GetReturnValue().Set(false);
+    }
+    const size_t length = node::Buffer::Length(args[0]);
+    const size_t offset = args[1].As<Uint32>()->Value();
+    const size_t size = args[2].As<Uint32>()->Value();
+    if (offset > length || size > length - offset) {
+        return args.GetReturnValue().Set(false);
+    }
+    args.GetReturnValue().Set(
+        RandomFill(reinterpret_cast<unsigned char*>(node::Buffer::Data(args[0])) + offset, size));
+}
+
+void NativeCrypto::SetEnabled(bool enabled)
+{
+    s_enabled = enabled;
+}
+
+void NativeCrypto::Install(node::Environment *env)
+{
+    if (!s_enabled) return;
+
+    Isolate *isolate = env->isolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = env->context();
+
+    Local<FunctionTemplate> handle_template = FunctionTemplate::New(isolate);
+    handle_template->InstanceTemplate()->SetInternalFieldCount(1);
+    Local<Function> ctor = handle_template->GetFunction(context).ToLocalChecked();
+
+    Local<Object> native = Object::New(isolate);
+    auto set = [&](const char *name, FunctionCallback callback) {
+        native->Set(context, String::NewFromUtf8(isolate, name),
+                    Function::New(context, callback, ctor).ToLocalChecked());
+    };
+    set("hash", CreateHash);
+    set("hmac", CreateHmac);
+    set("cipher", CreateCipher);
+    set("randomFill", Random);
+    set("digestUpdate", DigestUpdate);
+    set("digestFinal", DigestFinal);
+    set("cipherUpdate", CipherUpdate);
+    set("cipherFinal", CipherFinal);
+    set("setAutoPadding", SetAutoPadding);
+    set("setAAD", SetAAD);
+    set("setAuthTag", SetAuthTag);
+    set("getAuthTag", GetAuthTag);
+
+    TryCatch trycatch(isolate);
+    Local<Script> script;
+    Local<Value> wrapper;
+    if (Script::Compile(context, String::NewFromUtf8(isolate, kWrapper)).ToLocal(&script) &&
+        script->Run(context).ToLocal(&wrapper) && wrapper->IsFunction()) {
+        Local<Value> argv[] = { env->process_object(), native };
+        wrapper.As<Function>()->Call(context, Undefined(isolate), 2, argv);
+    }
+}
+
+} /* namespace nodedroid */
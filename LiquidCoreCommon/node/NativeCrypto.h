@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_NATIVECRYPTO_H
+#define NODEDROID_NATIVECRYPTO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "node.h"
+#include "env.h"
+
+namespace nodedroid {
+
+/*
+ * The hot paths of the crypto module on the OS's own libraries (CommonCrypto and the system
+ * random source on iOS, the java.security providers on Android, Conscrypt on every release in
+ * use), which are built with the platform's assembly and its hardware AES and SHA where the
+ * bundled OpenSSL may not be.  Covered are createHash() and createHmac() with sha1, sha256 and
+ * sha512, createCipheriv() and createDecipheriv() with AES in CBC and CTR mode (and GCM where
+ * the platform has it), and randomBytes() and randomFill().  Anything else, including
+ * parameters a backend won't take, goes to OpenSSL as before, errors and all.
+ *
+ * Off by default; when on, an instance swaps its crypto binding's Hash, Hmac, CipherBase,
+ * randomBytes and randomFill for these as it starts, so it is fixed for the instance's life.
+ */
+class NativeCrypto {
+public:
+    enum Algorithm { kSHA1, kSHA256, kSHA512 };
+    enum Mode { kCBC, kCTR, kGCM };
+    static const size_t kMaxDigestLength = 64;
+    static const size_t kGcmTagLength = 16;
+
+    // A hash or HMAC in progress
+    class Digest {
+    public:
+        virtual ~Digest() {}
+        virtual bool Update(const unsigned char *data, size_t length) = 0;
+        // Into |out|, which has room for kMaxDigestLength; false if it failed
+        virtual bool Final(unsigned char *out) = 0;
+    };
+
+    // An AES encryption or decryption in progress.  Each call appends whatever it produces to
+    // |out| and returns false if it failed.
+    class Cipher {
+    public:
+        struct Params {
+            Mode mode;
+            bool encrypt;
+            bool padding;   // CBC only; may change until the first call below
+            std::vector<unsigned char> key;
+            std::vector<unsigned char> iv;
+        };
+        explicit Cipher(const Params& params) : params(params) {}
+        virtual ~Cipher() {}
+        // GCM only, before any Update()
+        virtual bool SetAAD(const unsigned char *data, size_t length) = 0;
+        virtual bool Update(const unsigned char *data, size_t length,
+                            std::vector<unsigned char>& out) = 0;
+        // With GCM, checks |auth_tag| when decrypting and sets it when encrypting
+        virtual bool Final(std::vector<unsigned char>& out) = 0;
+
+        Params params;
+        std::vector<unsigned char> auth_tag;
+    };
+
+    static void SetEnabled(bool enabled);
+    // Swaps the crypto binding's entry points for these, if enabled.  Must be called on the
+    // instance's thread before it loads the crypto module.
+    static void Install(node::Environment *env);
+
+    static size_t DigestLength(Algorithm algorithm);
+
+private:
+    // Per platform.  Each returns null for what the platform can't do, which OpenSSL then does.
+    static std::unique_ptr<Digest> NewHash(Algorithm algorithm);
+    static std::unique_ptr<Digest> NewHmac(Algorithm algorithm, const unsigned char *key,
+                                           size_t key_length);
+    static std::unique_ptr<Cipher> NewCipher(const Cipher::Params& params);
+    static bool RandomFill(unsigned char *out, size_t length);
+
+    static void CreateHash(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void CreateHmac(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void CreateCipher(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void Random(const v8::FunctionCallbackInfo<v8::Value>& args);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_NATIVECRYPTO_H
@@ -0,0 +1,380 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include "env-inl.h"
+#include "node_buffer.h"
+#include "NativeHttp.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+std::atomic<bool> s_enabled(false);
+
+// In flight, by instance.  The JS side only ever refers to them by id.
+std::mutex s_mutex;
+std::multimap<node::Environment*, std::shared_ptr<NativeHttp::Request>> s_requests;
+unsigned s_next_id = 0;
+
+void Throw(Isolate *isolate, const char *message)
+{
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, message)));
+}
+
+// Promises over nativeRequest(), buffering the body
+const char kFetch[] =
+    "(function(process, request) {\n"
+    "  process.fetch = function(url, options) {\n"
+    "    options = options || {};\n"
+    "    return new Promise(function(resolve, reject) {\n"
+    "      const chunks = [];\n"
+    "      const waiting = [];\n"
+    "      let done = false;\n"
+    "      let error = null;\n"
+    "      function settle() { waiting.splice(0).forEach(function(fn) { fn(); }); }\n"
+    "      function buffer() {\n"
+    "        return new Promise(function(resolve, reject) {\n"
+    "          const fn = function() {\n"
+    "            if (error) reject(error); else resolve(Buffer.concat(chunks));\n"
+    "          };\n"
+    "          if (done) fn(); else waiting.push(fn);\n"
+    "        });\n"
+    "      }\n"
+    "      request({ url: String(url), method: options.method, headers: options.headers,\n"
+    "                body: options.body, timeout: options.timeout }, {\n"
+    "        onresponse: function(status, headers, url) {\n"
+    "          resolve({\n"
+    "            status: status,\n"
+    "            ok: status >= 200 && status < 300,\n"
+    "            headers: headers,\n"
+    "            url: url,\n"
+    "            buffer: buffer,\n"
+    "            text: function() { return buffer().then(function(b) { return b.toString(); }); },\n"
+    "            json: function() { return this.text().then(JSON.parse); }\n"
+    "          });\n"
+    "        },\n"
+    "        ondata: function(chunk) { chunks.push(chunk); },\n"
+    "        onend: function() { done = true; settle(); },\n"
+    "        onerror: function(message) {\n"
+    "          error = new Error(message);\n"
+    "          done = true;\n"
+    "          reject(error);\n"
+    "          settle();\n"
+    "        }\n"
+    "      });\n"
+    "    });\n"
+    "  };\n"
+    "})";
+
+} /* namespace */
+
+void NativeHttp::Request::Push(Event&& event)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_async || m_complete) return;
+    m_complete = event.kind == Event::kEnd || event.kind == Event::kError;
+    m_events.push_back(std::move(event));
+    uv_async_send(m_async);
+}
+
+void NativeHttp::Request::OnResponse(int status, Headers&& headers, const std::string& url)
+{
+    Event event(Event::kResponse);
+    event.status = status;
+    event.headers = std::move(headers);
+    event.text = url;
+    Push(std::move(event));
+}
+
+void NativeHttp::Request::OnData(const void *data, size_t length)
+{
+    if (!length) return;
+    Event event(Event::kData);
+    event.data = static_cast<char*>(malloc(length));
+    if (!event.data) {
+        return OnComplete("Out of memory");
+    }
+    memcpy(event.data, data, length);
+    event.length = length;
+    Push(std::move(event));
+}
+
+void NativeHttp::Request::OnComplete(const std::string& error)
+{
+    Event event(error.empty() ? Event::kEnd : Event::kError);
+    event.text = error;
+    Push(std::move(event));
+}
+
+void NativeHttp::Request::SetCanceller(std::function<void()> canceller)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_canceller = std::move(canceller);
+}
+
+void NativeHttp::Request::Cancel()
+{
+    m_cancelled = true;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_canceller) {
+        m_canceller();
+        m_canceller = nullptr;
+    }
+}
+
+std::shared_ptr<NativeHttp::Request> NativeHttp::Find(node::Environment *env, unsigned id)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (auto it = s_requests.find(env); it != s_requests.end() && it->first == env; ++it) {
+        if (it->second->m_id == id) return it->second;
+    }
+    return nullptr;
+}
+
+// Done with on the JS side: nothing more is delivered, and the stack's reference is the
+// only one left
+void NativeHttp::Finish(Request *request)
+{
+    uv_async_t *async;
+    {
+        std::lock_guard<std::mutex> lock(request->m_mutex);
+        async = request->m_async;
+        request->m_async = nullptr;
+        request->m_events.clear();
+    }
+    if (!async) return;
+    uv_close(reinterpret_cast<uv_handle_t*>(async), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_async_t*>(handle);
+    });
+    request->m_handlers.Reset();
+
+    std::lock_guard<std::mutex> lock(s_mutex);
+    for (auto it = s_requests.find(request->m_env);
+         it != s_requests.end() && it->first == request->m_env; ++it) {
+        if (it->second.get() == request) {
+            s_requests.erase(it);
+            break;
+        }
+    }
+}
+
+void NativeHttp::OnEvents(uv_async_t *handle)
+{
+    // Held for the duration, in case a handler aborts the request
+    std::shared_ptr<NativeHttp::Request> request = Find(
+        reinterpret_cast<NativeHttp::Request*>(handle->data)->m_env,
+        reinterpret_cast<NativeHttp::Request*>(handle->data)->m_id);
+    if (!request) return;
+
+    std::deque<NativeHttp::Request::Event> events;
+    {
+        std::lock_guard<std::mutex> lock(request->m_mutex);
+        events.swap(request->m_events);
+    }
+
+    node::Environment *env = request->m_env;
+    Isolate *isolate = env->isolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = env->context();
+    Context::Scope context_scope(context);
+
+    typedef NativeHttp::Request::Event Event;
+    for (Event& event : events) {
+        // An earlier handler may have aborted it
+        if (request->m_handlers.IsEmpty()) break;
+        Local<Object> handlers = request->m_handlers.Get(isolate);
+
+        const char *name = nullptr;
+        Local<Value> argv[3];
+        int argc = 0;
+        switch (event.kind) {
+            case Event::kResponse: {
+                name = "onresponse";
+                Local<Object> headers = Object::New(isolate);
+                for (auto& header : event.headers) {
+                    std::string key = header.first;
+                    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+                    Local<String> k = String::NewFromUtf8(isolate, key.c_str());
+                    Local<Value> value = String::NewFromUtf8(isolate, header.second.c_str());
+                    Local<Value> existing;
+                    if (headers->Get(context, k).ToLocal(&existing) && existing->IsString()) {
+                        value = String::Concat(existing.As<String>(), String::Concat(
+                            String::NewFromUtf8(isolate, ", "), value.As<String>()));
+                    }
+                    headers->Set(context, k, value);
+                }
+                argv[argc++] = Integer::New(isolate, event.status);
+                argv[argc++] = headers;
+                argv[argc++] = String::NewFromUtf8(isolate, event.text.c_str());
+                break;
+            }
+            case Event::kData: {
+                name = "ondata";
+                Local<Object> buffer;
+                if (!node::Buffer::New(isolate, event.data, event.length).ToLocal(&buffer)) {
+                    continue;
+                }
+                // The buffer owns it now
+                event.data = nullptr;
+                argv[argc++] = buffer;
+                break;
+            }
+            case Event::kEnd:
+                name = "onend";
+                break;
+            case Event::kError:
+                name = "onerror";
+                argv[argc++] = String::NewFromUtf8(isolate, event.text.c_str());
+                break;
+        }
+
+        const bool last = event.kind == Event::kEnd || event.kind == Event::kError;
+        if (last) {
+            Finish(request.get());
+        }
+        Local<Value> fn;
+        if (handlers->Get(context, String::NewFromUtf8(isolate, name)).ToLocal(&fn) &&
+            fn->IsFunction()) {
+            node::MakeCallback(isolate, handlers, fn.As<Function>(), argc, argv, {0, 0});
+        }
+        if (last) break;
+    }
+}
+
+void NativeHttp::Abort(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = node::Environment::GetCurrent(args);
+    std::shared_ptr<NativeHttp::Request> request =
+        Find(env, args.Data()->Uint32Value(env->context()).FromJust());
+    if (request) {
+        request->Cancel();
+        Finish(request.get());
+    }
+}
+
+// nativeRequest(options, handlers)
+void NativeHttp::NativeRequest(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = node::Environment::GetCurrent(args);
+    Isolate *isolate = args.GetIsolate();
+    Local<Context> context = isolate->GetCurrentContext();
+    if (args.Length() < 2 || !args[0]->IsObject() || !args[1]->IsObject()) {
+        return Throw(isolate, "nativeRequest(options, handlers)");
+    }
+    Local<Object> options = args[0].As<Object>();
+
+    auto request = std::make_shared<NativeHttp::Request>();
+    Local<Value> value;
+    if (!options->Get(context, String::NewFromUtf8(isolate, "url")).ToLocal(&value) ||
+        !value->IsString()) {
+        return Throw(isolate, "A url is required");
+    }
+    request->url = *String::Utf8Value(value);
+    request->method = "GET";
+    if (options->Get(context, String::NewFromUtf8(isolate, "method")).ToLocal(&value) &&
+        value->IsString()) {
+        request->method = *String::Utf8Value(value);
+        std::transform(request->method.begin(), request->method.end(),
+                       request->method.begin(), ::toupper);
+    }
+    if (options->Get(context, String::NewFromUtf8(isolate, "headers")).ToLocal(&value) &&
+        value->IsObject()) {
+        Local<Object> headers = value.As<Object>();
+        Local<Array> names;
+        if (headers->GetOwnPropertyNames(context).ToLocal(&names)) {
+            for (uint32_t i = 0; i < names->Length(); i++) {
+                Local<Value> name = names->Get(context, i).ToLocalChecked();
+                Local<Value> header;
+                if (!headers->Get(context, name).ToLocal(&header) || header->IsUndefined()) {
+                    continue;
+                }
+                request->headers.emplace_back(*String::Utf8Value(name),
+                                              *String::Utf8Value(header));
+            }
+        }
+    }
+    if (options->Get(context, String::NewFromUtf8(isolate, "body")).ToLocal(&value)) {
+        if (value->IsString()) {
+            String::Utf8Value body(value);
+            request->body.assign(*body, *body + body.length());
+        } else if (value->IsArrayBufferView()) {
+            Local<ArrayBufferView> view = value.As<ArrayBufferView>();
+            request->body.resize(view->ByteLength());
+            view->CopyContents(request->body.data(), request->body.size());
+        }
+    }
+    if (options->Get(context, String::NewFromUtf8(isolate, "timeout")).ToLocal(&value) &&
+        value->IsNumber()) {
+        request->timeout_ms = (unsigned) std::max(0.0, value->NumberValue(context).FromJust());
+    }
+
+    request->m_env = env;
+    request->m_handlers.Reset(isolate, args[1].As<Object>());
+    request->m_async = new uv_async_t();
+    request->m_async->data = request.get();
+    uv_async_init(env->event_loop(), request->m_async, OnEvents);
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        request->m_id = ++s_next_id;
+        s_requests.insert(std::make_pair(env, request));
+    }
+
+    Local<Object> handle = Object::New(isolate);
+    handle->Set(context, String::NewFromUtf8(isolate, "abort"),
+                Function::New(context, Abort, Integer::NewFromUnsigned(isolate, request->m_id))
+                    .ToLocalChecked());
+
+    NativeHttp::Start(request);
+    args.GetReturnValue().Set(handle);
+}
+
+void NativeHttp::SetEnabled(bool enabled)
+{
+    s_enabled = enabled;
+}
+
+void NativeHttp::Install(node::Environment *env)
+{
+    if (!s_enabled) return;
+
+    Isolate *isolate = env->isolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = env->context();
+    Local<Function> request = Function::New(context, NativeRequest).ToLocalChecked();
+    env->process_object()->Set(context, String::NewFromUtf8(isolate, "nativeRequest"), request);
+
+    TryCatch trycatch(isolate);
+    Local<Script> script;
+    Local<Value> wrapper;
+    if (Script::Compile(context, String::NewFromUtf8(isolate, kFetch)).ToLocal(&script) &&
+        script->Run(context).ToLocal(&wrapper) && wrapper->IsFunction()) {
+        Local<Value> argv[] = { env->process_object(), request };
+        wrapper.As<Function>()->Call(context, Undefined(isolate), 2, argv);
+    }
+}
+
+void NativeHttp::AbortAll(node::Environment *env)
+{
+    for (;;) {
+        std::shared_ptr<Request> request;
+        {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            auto found = s_requests.find(env);
+            if (found == s_requests.end()) break;
+            request = found->second;
+        }
+        request->Cancel();
+        Finish(request.get());
+    }
+}
+
+} /* namespace nodedroid */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_NATIVEHTTP_H
+#define NODEDROID_NATIVEHTTP_H
+
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "node.h"
+#include "env.h"
+
+namespace nodedroid {
+
+/*
+ * HTTP(S) through the platform's own stack (NSURLSession on iOS, HttpURLConnection on
+ * Android), so that a service gets the OS's connection pooling, HTTP/2, TLS session
+ * resumption and network selection instead of OpenSSL and the HTTP parser on its own thread.
+ * Off by default; once turned on, instances started from then on have, in JS:
+ *
+ *   const request = process.nativeRequest({ url, method, headers, body, timeout }, {
+ *     onresponse: function(status, headers, url) { ... },
+ *     ondata: function(buffer) { ... },
+ *     onend: function() { ... },
+ *     onerror: function(message) { ... }
+ *   });
+ *   request.abort();
+ *
+ *   process.fetch(url[, { method, headers, body, timeout }]).then(function(response) {
+ *     // response.status, .ok, .headers, .url; response.buffer(), .text(), .json()
+ *   });
+ *
+ * Headers are an object of lower-cased names, repeated headers joined with ", ".  The body
+ * may be a string or a Buffer, and timeout is in milliseconds.  Redirects are followed.  The
+ * exchange runs entirely off the JS thread; on it, each chunk of the response arrives as a
+ * Buffer through an async handle, one handler call per chunk.  A request in flight keeps its
+ * loop alive.
+ */
+class NativeHttp {
+public:
+    typedef std::vector<std::pair<std::string, std::string>> Headers;
+
+    // One exchange, shared by the instance and the platform's stack.  The stack calls the
+    // On*() methods from threads of its own, and they are delivered in order on the loop.
+    class Request {
+    public:
+        std::string method;
+        std::string url;
+        Headers headers;
+        std::vector<uint8_t> body;
+        unsigned timeout_ms = 0;
+
+        void OnResponse(int status, Headers&& headers, const std::string& url);
+        // |data| is copied
+        void OnData(const void *data, size_t length);
+        // With an empty |error| on success.  Nothing is delivered after this.
+        void OnComplete(const std::string& error);
+
+        inline bool Cancelled() const { return m_cancelled; }
+        // Set by the stack to interrupt it, and cleared once it no longer can be.  Called at
+        // most once, from the instance's thread.
+        void SetCanceller(std::function<void()> canceller);
+
+    private:
+        friend class NativeHttp;
+        struct Event {
+            enum Kind { kResponse, kData, kEnd, kError };
+            explicit Event(Kind kind) : kind(kind) {}
+            Event(Event&& other) : kind(other.kind), status(other.status),
+                headers(std::move(other.headers)), text(std::move(other.text)),
+                data(other.data), length(other.length) { other.data = nullptr; }
+            ~Event() { free(data); }
+
+            Kind kind;
+            int status = 0;
+            Headers headers;
+            std::string text;       // the final URL, or the error
+            char *data = nullptr;   // malloc()ed, for the Buffer to take over
+            size_t length = 0;
+        };
+        void Push(Event&& event);
+        void Cancel();
+
+        std::mutex m_mutex;
+        std::deque<Event> m_events;
+        uv_async_t *m_async = nullptr;     // null once the request is finished with
+        std::atomic<bool> m_cancelled {false};
+        bool m_complete = false;
+        std::function<void()> m_canceller;
+        node::Environment *m_env = nullptr;
+        unsigned m_id = 0;
+        v8::Persistent<v8::Object> m_handlers;
+    };
+
+    static void SetEnabled(bool enabled);
+    // Adds process.nativeRequest() and process.fetch(), if enabled.  Must be called on the
+    // instance's thread.
+    static void Install(node::Environment *env);
+    // Aborts whatever |env| still has in flight.  Must be called on the instance's thread
+    // before its loop is run for the last time.
+    static void AbortAll(node::Environment *env);
+
+private:
+    // Per platform.  Starts |request| off the calling thread; failures go to OnComplete().
+    static void Start(std::shared_ptr<Request> request);
+
+    static std::shared_ptr<Request> Find(node::Environment *env, unsigned id);
+    static void Finish(Request *request);
+    static void OnEvents(uv_async_t *handle);
+    static void NativeRequest(const v8::FunctionCallbackInfo<v8::Value>& args);
+    static void Abort(const v8::FunctionCallbackInfo<v8::Value>& args);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_NATIVEHTTP_H
@@ -27,10 +27,22 @@
 
 #ifdef __APPLE__
 # include <JavaScriptCore/JavaScript.h>
+# include <CoreFoundation/CoreFoundation.h>
 #endif
 #include "NodeInstance.h"
 #include "nodedroid_file.h"
 #include "os_dependent.h"
+#include "CpuProfile.h"
+#include "HeapGuard.h"
+#include "HeapProfile.h"
+#include "ServiceChannel.h"
+#include "ChildInstance.h"
+#include "ModuleArchive.h"
+#include "ModulePrefetch.h"
+#include "NativeCrypto.h"
+#include "NativeHttp.h"
+#include "WasmCache.h"
+#include "WorkerPool.h"
 
 #include "node_buffer.h"
 #include "node_constants.h"
@@ -63,6 +75,11 @@
 #endif
 
 #include <sys/resource.h>  // getrlimit, setrlimit
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <unordered_map>
 
 #include "node_perf.h"
 #include "v8-profiler.h"
@@ -73,13 +90,106 @@
 #endif
 
 #ifdef __ANDROID__
-NodeInstance::NodeInstance(JNIEnv* env, jobject thiz) {
+NodeInstance::NodeInstance(JNIEnv* env, jobject thiz, const Config& config) : m_config(config)
+{
     env->GetJavaVM(&m_jvm);
     m_JavaThis = env->NewGlobalRef(thiz);
 
     on_start = nullptr;
     callback_data = nullptr;
 }
+
+std::mutex NodeInstance::s_pool_mutex;
+std::deque<NodeInstance*> NodeInstance::s_pool;
+size_t NodeInstance::s_pool_size = 0;
+size_t NodeInstance::s_pool_starting = 0;
+
+NodeInstance::NodeInstance() : m_warm_state(kStarting)
+{
+    std::thread(warm_task, reinterpret_cast<void*>(this)).detach();
+}
+
+void NodeInstance::warm_task(void *inst)
+{
+    auto instance = reinterpret_cast<NodeInstance*>(inst);
+    instance->spawnedThread();
+
+    // Nobody ever took ownership of an evicted instance
+    if (instance->m_warm_state == kEvicted) {
+        delete instance;
+    }
+}
+
+void NodeInstance::FillWarmPool()
+{
+    std::unique_lock<std::mutex> lock(s_pool_mutex);
+    while (s_pool.size() + s_pool_starting < s_pool_size) {
+        s_pool_starting ++;
+        new NodeInstance();
+    }
+}
+
+void NodeInstance::SetWarmPoolSize(size_t size)
+{
+    std::vector<NodeInstance*> evicted;
+    {
+        std::unique_lock<std::mutex> lock(s_pool_mutex);
+        s_pool_size = size;
+        while (s_pool.size() > size) {
+            evicted.push_back(s_pool.back());
+            s_pool.pop_back();
+        }
+    }
+    for (auto instance : evicted) {
+        std::unique_lock<std::mutex> lock(instance->m_warm_mutex);
+        instance->m_warm_state = kEvicted;
+        instance->m_warm_cv.notify_one();
+    }
+    FillWarmPool();
+}
+
+NodeInstance* NodeInstance::ClaimWarmInstance(JNIEnv* env, jobject thiz)
+{
+    NodeInstance *instance = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(s_pool_mutex);
+        if (!s_pool.empty()) {
+            instance = s_pool.front();
+            s_pool.pop_front();
+        }
+    }
+    if (instance) {
+        std::unique_lock<std::mutex> lock(instance->m_warm_mutex);
+        env->GetJavaVM(&instance->m_jvm);
+        instance->m_JavaThis = env->NewGlobalRef(thiz);
+        instance->m_warm_state = kClaimed;
+        instance->m_warm_cv.notify_one();
+    }
+    FillWarmPool();
+    return instance;
+}
+
+bool NodeInstance::WaitForClaim()
+{
+    if (m_warm_state == kNotWarm) return true;
+
+    {
+        std::unique_lock<std::mutex> lock(s_pool_mutex);
+        s_pool_starting --;
+        if (s_pool.size() >= s_pool_size) {
+            // The pool shrank while we were booting
+            m_warm_state = kEvicted;
+            return false;
+        }
+        std::unique_lock<std::mutex> warm_lock(m_warm_mutex);
+        m_warm_state = kParked;
+        s_pool.push_back(this);
+    }
+
+    std::unique_lock<std::mutex> lock(m_warm_mutex);
+    m_warm_cv.wait(lock, [this]{ return m_warm_state != kParked; });
+    return m_warm_state == kClaimed;
+}
 #endif
 
 #ifdef __ANDROID__
@@ -92,87 +202,69 @@ NodeInstance::NodeInstance(JNIEnv* env, jobject thiz) {
 # define ERROR_LOG(m, f, ...) fprintf(stderr, "%s: " f "\n", m, __VA_ARGS__)
 #endif
 
-NodeInstance::NodeInstance(OnNodeStartedCallback onStart, OnNodeExitCallback onExit, void* data)
+#ifdef __APPLE__
+static void AddToSharedThread(NodeInstance *instance);
+#endif
+
+NodeInstance::NodeInstance(OnNodeStartedCallback onStart, OnNodeExitCallback onExit, void* data,
+                           const Config& config) : m_config(config)
 {
+    on_start = onStart;
+    on_exit = onExit;
+    callback_data = data;
 #ifdef __ANDROID__
     m_jvm = nullptr;
     m_JavaThis = nullptr;
 #else
-    node_main_thread = new std::thread(node_main_task,reinterpret_cast<void*>(this));
+    if (s_shared_thread) {
+        m_shared = true;
+        AddToSharedThread(this);
+    } else {
+        node_main_thread = new std::thread(node_main_task,reinterpret_cast<void*>(this));
+    }
 #endif
-    on_start = onStart;
-    on_exit = onExit;
-    callback_data = data;
 }
 
 NodeInstance::~NodeInstance() {
 #ifndef __ANDROID__
-    node_main_thread->join();
-    delete node_main_thread;
+    if (node_main_thread) {
+        node_main_thread->join();
+        delete node_main_thread;
+    } else {
+        std::unique_lock<std::mutex> lk(m_exit_mutex);
+        m_exit_cv.wait(lk, [this]{ return m_exited; });
+    }
 #endif
 }
 
-void NodeInstance::spawnedThread()
+void NodeInstance::NotifyExit(int ret)
 {
-    enum { kMaxArgs = 64 };
-    char cmd[60];
-
-    setenv("NODE_PATH", "/home/node_modules", true);
-    strcpy(cmd, "node -e global.__nodedroid_onLoad();");
-
-    int argc = 0;
-    char *argv[kMaxArgs];
-
-    char *p2 = strtok(cmd, " ");
-    while (p2 && argc < kMaxArgs-1)
-      {
-        argv[argc++] = p2;
-        p2 = strtok(0, " ");
-      }
-    argv[argc] = 0;
-
-    int ret = StartInstance(argc, argv);
-
 #ifdef __ANDROID__
     if (m_jvm) {
-        JNIEnv *env;
-        int getEnvStat = m_jvm->GetEnv((void**)&env, JNI_VERSION_1_6);
-        if (getEnvStat == JNI_EDETACHED) {
-            m_jvm->AttachCurrentThread(&env, NULL);
-        }
+        bool detach;
+        JNIEnv *env = threadEnv(m_jvm, detach);
 
-        jclass cls = env->GetObjectClass(m_JavaThis);
-        jmethodID mid;
-        do {
-            mid = env->GetMethodID(cls,"onNodeExit","(J)V");
-            if (!env->ExceptionCheck()) break;
-            env->ExceptionClear();
-            jclass super = env->GetSuperclass(cls);
-            env->DeleteLocalRef(cls);
-            if (super == NULL || env->ExceptionCheck()) {
-                if (super != NULL) env->DeleteLocalRef(super);
-                if (getEnvStat == JNI_EDETACHED) {
-                    m_jvm->DetachCurrentThread();
-                }
-                return;
+        jmethodID mid = findMethod(env, m_JavaThis, "onNodeExit", "(J)V");
+        if (mid == nullptr) {
+            if (detach) {
+                m_jvm->DetachCurrentThread();
             }
-            cls = super;
-        } while (true);
-        env->DeleteLocalRef(cls);
+            return;
+        }
 
         env->CallVoidMethod(m_JavaThis, mid, (jlong)ret);
 
         env->DeleteGlobalRef(m_JavaThis);
 
-        if (getEnvStat == JNI_EDETACHED) {
+        if (detach) {
             m_jvm->DetachCurrentThread();
         }
+        return;
     }
-#else
+#endif
     if (on_exit) {
         on_exit(callback_data, ret);
     }
-#endif
 }
 
 void NodeInstance::node_main_task(void *inst) {
@@ -540,34 +632,49 @@ void NodeInstance::StartInspector(Environment* env, const char* path,
 #endif  // HAVE_INSPECTOR
 }
 
+// Heap guard events (HeapGuard::Event), for the host.  Only Java hosts hear about them.
+void NodeInstance::NotifyMemoryPressure(int event, size_t used, size_t limit)
+{
+#ifdef __ANDROID__
+    if (m_jvm) {
+        bool detach;
+        JNIEnv *env = threadEnv(m_jvm, detach);
+        jmethodID mid = findMethod(env, m_JavaThis, "onMemoryPressure", "(IJJ)V");
+        if (mid != nullptr) {
+            env->CallVoidMethod(m_JavaThis, mid, (jint) event, (jlong) used, (jlong) limit);
+        }
+        if (detach) {
+            m_jvm->DetachCurrentThread();
+        }
+    }
+#endif
+}
+
 #define JSC "Lorg/liquidplayer/javascript/JNIJSContext;"
 
 #ifdef __ANDROID__
 void NodeInstance::NotifyStart(JSContextRef ctxRef, JSContextGroupRef groupRef) {
-    JNIEnv *jenv;
-    int getEnvStat = m_jvm->GetEnv((void**)&jenv, JNI_VERSION_1_6);
-    if (getEnvStat == JNI_EDETACHED) {
-        m_jvm->AttachCurrentThread(&jenv, NULL);
+    // Started natively (e.g. by a benchmark) rather than from Java
+    if (!m_jvm) {
+        if (on_start) {
+            on_start(callback_data, ctxRef, groupRef);
+        }
+        return;
     }
-    
-    jclass cls = jenv->GetObjectClass(m_JavaThis);
-    jmethodID mid;
-    do {
-        mid = jenv->GetMethodID(cls,"onNodeStarted","(JJJ)V");
-        if (!jenv->ExceptionCheck()) break;
-        jenv->ExceptionClear();
-        jclass super = jenv->GetSuperclass(cls);
-        jenv->DeleteLocalRef(cls);
-        if (super == NULL || jenv->ExceptionCheck()) {
-            if (super != NULL) jenv->DeleteLocalRef(super);
-            if (getEnvStat == JNI_EDETACHED) {
-                m_jvm->DetachCurrentThread();
-            }
-            CHECK_EQ(0,1); // This is bad
+
+    // Every callback into Java from here on comes from this thread; attach it once for all
+    // of them rather than once per call.  A thread Java started us on is already attached.
+    attachThread(m_jvm, "LiquidCore node");
+    bool detach;
+    JNIEnv *jenv = threadEnv(m_jvm, detach);
+
+    jmethodID mid = findMethod(jenv, m_JavaThis, "onNodeStarted", "(JJJ)V");
+    if (mid == nullptr) {
+        if (detach) {
+            m_jvm->DetachCurrentThread();
         }
-        cls = super;
-    } while (true);
-    jenv->DeleteLocalRef(cls);
+        CHECK_EQ(0,1); // This is bad
+    }
 
     auto group = const_cast<OpaqueJSContextGroup*>(groupRef);
 
@@ -577,7 +684,7 @@ void NodeInstance::NotifyStart(JSContextRef ctxRef, JSContextGroupRef groupRef)
                          reinterpret_cast<jlong>(ctxRef)
                          );
     
-    if (getEnvStat == JNI_EDETACHED) {
+    if (detach) {
         m_jvm->DetachCurrentThread();
     }
 }
@@ -595,6 +702,33 @@ namespace node {
     extern node_module *modlist_addon;
 }
 
+// Addons linked into the app, by module name.  Registration happens from static
+// constructors, so the table must be ready before anything else in this file is.
+static std::mutex& static_addons_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+static std::unordered_map<std::string, node_module*>& static_addons() {
+    static std::unordered_map<std::string, node_module*> addons;
+    return addons;
+}
+
+extern "C" void liquidcore_register_static_addon(node_module *mp) {
+    std::unique_lock<std::mutex> lock(static_addons_mutex());
+    static_addons()[mp->nm_modname] = mp;
+}
+
+static node_module* FindStaticAddon(const char *filename) {
+    const char *base = strrchr(filename, '/');
+    base = base ? base + 1 : filename;
+    const char *ext = strrchr(base, '.');
+    const std::string name(base, ext && !strcmp(ext, ".node") ? ext - base : strlen(base));
+
+    std::unique_lock<std::mutex> lock(static_addons_mutex());
+    auto it = static_addons().find(name);
+    return it == static_addons().end() ? nullptr : it->second;
+}
+
 void NodeInstance::DLOpen(const FunctionCallbackInfo<Value>& args) {
     Environment* env = Environment::GetCurrent(args);
 
@@ -606,11 +740,14 @@ void NodeInstance::DLOpen(const FunctionCallbackInfo<Value>& args) {
     Local<Object> module = args[0]->ToObject(env->isolate());  // Cast
     node::Utf8Value filename(env->isolate(), args[1]);  // Cast
 
+    // Addons linked into the app resolve by name, with no library to load
+    node_module* const static_mp = FindStaticAddon(*filename);
+
     // Objects containing v14 or later modules will have registered themselves
     // on the pending list.  Activate all of them now.  At present, only one
     // module per object is supported.
-    node_module* const mp = modpending;
-    modpending = nullptr;
+    node_module* const mp = static_mp ? static_mp : modpending;
+    if (!static_mp) modpending = nullptr;
 
     if (mp == nullptr) {
         env->ThrowError("Module did not self-register.");
@@ -643,9 +780,13 @@ void NodeInstance::DLOpen(const FunctionCallbackInfo<Value>& args) {
         return;
     }
 
-    mp->nm_dso_handle = 0; //lib.handle;
-    mp->nm_link = modlist_addon;
-    modlist_addon = mp;
+    // A static addon is shared by every instance in the process, so it can't be threaded
+    // onto the addon list more than once
+    if (!static_mp) {
+        mp->nm_dso_handle = 0; //lib.handle;
+        mp->nm_link = modlist_addon;
+        modlist_addon = mp;
+    }
 
     Local<String> exports_string = env->exports_string();
     Local<Object> exports = module->Get(exports_string)->ToObject(env->isolate());
@@ -663,24 +804,579 @@ void NodeInstance::DLOpen(const FunctionCallbackInfo<Value>& args) {
     // coverity[leaked_storage]
 }
 
-inline int NodeInstance::StartInstance(void* group_, IsolateData* isolate_data,
-                 int argc, const char* const* argv,
-                 int exec_argc, const char* const* exec_argv) {
+#ifdef __APPLE__
+// Lets the uv loop and the CF run loop share a single blocking wait.  uv's backend fd is
+// watched as a CFFileDescriptor and uv's next timeout is a CFRunLoopTimer; either one stops
+// the run loop so that uv gets to run.  Any other run loop source returns from Wait() on its
+// own after it has been handled.
+//
+// With an |on_ready| callback there is no wait: Arm() watches for the loop's next turn and the
+// callback is called from the run loop when it's due.  That's how the shared thread runs many
+// loops from one run loop.
+class UVRunLoopWaiter {
+public:
+  explicit UVRunLoopWaiter(uv_loop_t* loop, void (*on_ready)(void*) = nullptr,
+                           void *data = nullptr)
+      : m_loop(loop), m_on_ready(on_ready), m_data(data) {
+    CFFileDescriptorContext fd_ctx = {0, this, nullptr, nullptr, nullptr};
+    m_fd = CFFileDescriptorCreate(nullptr, uv_backend_fd(loop), false, OnReady, &fd_ctx);
+    m_source = CFFileDescriptorCreateRunLoopSource(nullptr, m_fd, 0);
+    CFRunLoopAddSource(CFRunLoopGetCurrent(), m_source, kCFRunLoopDefaultMode);
+
+    CFRunLoopTimerContext timer_ctx = {0, this, nullptr, nullptr, nullptr};
+    m_timer = CFRunLoopTimerCreate(nullptr, kFarFuture, kFarFuture, 0, 0, OnTimeout,
+                                   &timer_ctx);
+    CFRunLoopAddTimer(CFRunLoopGetCurrent(), m_timer, kCFRunLoopDefaultMode);
+  }
+
+  ~UVRunLoopWaiter() {
+    CFRunLoopTimerInvalidate(m_timer);
+    CFRelease(m_timer);
+    CFRunLoopSourceInvalidate(m_source);
+    CFRelease(m_source);
+    CFFileDescriptorInvalidate(m_fd);
+    CFRelease(m_fd);
+  }
+
+  // A non-zero |min_ms| holds off uv's own timers and immediates for at least that long
+  void Wait(unsigned min_ms = 0) {
+    if (Arm(min_ms) == 0) return;  // uv has work already, or nothing left to wait for
+    CFRunLoopRunInMode(kCFRunLoopDefaultMode, kFarFuture, true);
+  }
+
+  // Returns the timeout being waited for.  With no wait, a zero timeout is due at once.
+  int Arm(unsigned min_ms = 0) {
+    int timeout = uv_backend_timeout(m_loop);
+    if (min_ms && timeout >= 0 && timeout < (int) min_ms && uv_loop_alive(m_loop))
+      timeout = min_ms;
+    if (timeout == 0 && !m_on_ready) return 0;
+
+    CFFileDescriptorEnableCallBacks(m_fd, kCFFileDescriptorReadCallBack);
+    CFRunLoopTimerSetNextFireDate(m_timer, timeout < 0 ? kFarFuture :
+                                  CFAbsoluteTimeGetCurrent() + timeout / 1000.0);
+    return timeout;
+  }
+
+  // Stops watching, so that the callback won't be called again
+  void Disarm() {
+    CFFileDescriptorDisableCallBacks(m_fd, kCFFileDescriptorReadCallBack);
+    CFRunLoopTimerSetNextFireDate(m_timer, kFarFuture);
+    m_on_ready = nullptr;
+  }
+
+private:
+  static constexpr CFTimeInterval kFarFuture = 1.0e10;
+
+  static void OnReady(CFFileDescriptorRef, CFOptionFlags, void* info) {
+    reinterpret_cast<UVRunLoopWaiter*>(info)->Ready();
+  }
+  static void OnTimeout(CFRunLoopTimerRef, void* info) {
+    reinterpret_cast<UVRunLoopWaiter*>(info)->Ready();
+  }
+  void Ready() {
+    if (m_on_ready) {
+      m_on_ready(m_data);
+    } else {
+      CFRunLoopStop(CFRunLoopGetCurrent());
+    }
+  }
+
+  uv_loop_t* m_loop;
+  void (*m_on_ready)(void*);
+  void *m_data;
+  CFFileDescriptorRef m_fd;
+  CFRunLoopSourceRef m_source;
+  CFRunLoopTimerRef m_timer;
+};
+
+constexpr CFTimeInterval UVRunLoopWaiter::kFarFuture;
+#endif
+
+// Everything that lives from boot to exit.  Keeping it off the stack lets an instance run a
+// turn at a time, so that several can share a thread.
+struct NodeInstance::RunState {
+  enum { kMaxArgs = 64 };
+  std::string cmd;
+  char *arg_storage[kMaxArgs];
+  int argc = 0;
+  char **argv = arg_storage;
+  int exec_argc = 0;
+  const char** exec_argv = nullptr;
+  uv_loop_t loop;
+  ArrayBufferAllocator* allocator = nullptr;
+  Isolate* isolate = nullptr;
+  JSContextGroupRef group = nullptr;
+  JSGlobalContextRef ctxRef = nullptr;
+  IsolateData* isolate_data = nullptr;
+  Environment* env = nullptr;
+  std::unique_ptr<nodedroid::HeapGuard> heap_guard;
+  bool claimed = false;
+  bool running = false;   // the loop has been started
+  bool failed = false;
+  int exit_code = 0;
+#ifdef __APPLE__
+  bool shared_group = false;  // the isolate is in the shared context group
+#endif
+};
+
+// What a turn of the loop runs inside of
+struct NodeInstance::RunScope {
+  explicit RunScope(RunState *run) : locker(run->isolate), isolate_scope(run->isolate),
+      handle_scope(run->isolate), context_scope(run->env->context()) {}
+  Locker locker;
+  Isolate::Scope isolate_scope;
+  HandleScope handle_scope;
+  Context::Scope context_scope;
+};
+
+#ifdef __APPLE__
+// Hosts the instances created while NodeInstance::SetSharedThread() is on.  Each one boots and
+// shuts down on this thread like it would on its own, but in between, its loop gets a turn
+// only when its UVRunLoopWaiter says there is something to do.
+class SharedLoopThread {
+public:
+  // Boots |instance| on the shared thread, starting the thread if need be.  Any thread.
+  static void Add(NodeInstance *instance) {
+    SharedLoopThread *shared = Get();
+    {
+      std::lock_guard<std::mutex> lk(shared->m_mutex);
+      shared->m_pending.push_back(instance);
+    }
+    CFRunLoopSourceSignal(shared->m_wakeup);
+    CFRunLoopWakeUp(shared->m_runloop);
+  }
+
+  // The instance whose turn it is, if any.  Shared thread only.
+  static NodeInstance* Current() { return s_current; }
+
+private:
+  static SharedLoopThread* Get() {
+    static std::once_flag once;
+    std::call_once(once, [] () {
+      SharedLoopThread *shared = new SharedLoopThread();
+      std::unique_lock<std::mutex> lk(shared->m_mutex);
+      std::thread(&SharedLoopThread::Main, shared).detach();
+      shared->m_ready_cv.wait(lk, [shared]{ return shared->m_runloop != nullptr; });
+      s_shared = shared;
+    });
+    return s_shared;
+  }
+
+  void Main() {
+    CFRunLoopSourceContext ctx = {0, this, nullptr, nullptr, nullptr, nullptr, nullptr,
+                                  nullptr, nullptr, OnWakeup};
+    m_wakeup = CFRunLoopSourceCreate(nullptr, 0, &ctx);
+    CFRunLoopAddSource(CFRunLoopGetCurrent(), m_wakeup, kCFRunLoopDefaultMode);
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      m_thread_id = std::this_thread::get_id();
+      m_runloop = CFRunLoopGetCurrent();
+    }
+    m_ready_cv.notify_all();
+
+    // The wake-up source keeps the run loop going for good
+    CFRunLoopRun();
+  }
+
+  static void OnWakeup(void *info) {
+    SharedLoopThread *shared = reinterpret_cast<SharedLoopThread*>(info);
+    std::vector<NodeInstance*> pending;
+    std::vector<UVRunLoopWaiter*> retired;
+    {
+      std::lock_guard<std::mutex> lk(shared->m_mutex);
+      pending.swap(shared->m_pending);
+      retired.swap(shared->m_retired);
+    }
+    for (auto waiter : retired) {
+      delete waiter;
+    }
+    for (auto instance : pending) {
+      s_current = instance;
+      if (instance->Boot()) {
+        instance->m_waiter = new UVRunLoopWaiter(&instance->m_run->loop, OnTurn, instance);
+        OnTurn(instance);
+      } else {
+        Finish(instance);
+      }
+      s_current = nullptr;
+    }
+  }
+
+  static void OnTurn(void *data) {
+    NodeInstance *instance = reinterpret_cast<NodeInstance*>(data);
+    if (!instance->m_run) return;
+
+    s_current = instance;
+    nodedroid::SetFsStats(&instance->m_timeline.fs);
+    bool more;
+    {
+      NodeInstance::RunScope scope(instance->m_run);
+      more = instance->Turn();
+    }
+    if (more) {
+      instance->m_waiter->Arm(instance->m_throttle_ms);
+    } else {
+      Finish(instance);
+    }
+    s_current = nullptr;
+  }
+
+  static void Finish(NodeInstance *instance) {
+    // We may be inside one of the waiter's callbacks, so it is deleted on the next wake-up
+    UVRunLoopWaiter *waiter = instance->m_waiter;
+    instance->m_waiter = nullptr;
+    if (waiter) {
+      waiter->Disarm();
+      {
+        std::lock_guard<std::mutex> lk(s_shared->m_mutex);
+        s_shared->m_retired.push_back(waiter);
+      }
+      CFRunLoopSourceSignal(s_shared->m_wakeup);
+    }
+
+    instance->NotifyExit(instance->Shutdown());
+    {
+      std::lock_guard<std::mutex> lk(instance->m_exit_mutex);
+      instance->m_exited = true;
+    }
+    instance->m_exit_cv.notify_all();
+  }
+
+  std::mutex m_mutex;
+  std::condition_variable m_ready_cv;
+  std::thread::id m_thread_id;
+  CFRunLoopRef m_runloop = nullptr;
+  CFRunLoopSourceRef m_wakeup = nullptr;
+  std::vector<NodeInstance*> m_pending;
+  std::vector<UVRunLoopWaiter*> m_retired;
+
+  static SharedLoopThread *s_shared;
+  static NodeInstance *s_current;
+};
+
+SharedLoopThread *SharedLoopThread::s_shared = nullptr;
+NodeInstance *SharedLoopThread::s_current = nullptr;
+std::atomic<bool> NodeInstance::s_shared_thread(false);
+std::atomic<bool> NodeInstance::s_shared_context_group(false);
+
+static void AddToSharedThread(NodeInstance *instance) {
+  SharedLoopThread::Add(instance);
+}
+
+void NodeInstance::SetSharedThread(bool shared) {
+  s_shared_thread = shared;
+}
+
+void NodeInstance::SetSharedContextGroup(bool shared) {
+  s_shared_context_group = shared;
+}
+#endif
+
+bool NodeInstance::OnNodeThread() const {
+  // Android runs us on a thread that Java hands over, and Apple on our own thread or the
+  // shared one, so go by the thread that actually booted the instance
+  return std::this_thread::get_id() == m_node_thread.load();
+}
+
+void NodeInstance::RunHere(const std::function<void()>& fn) {
+#ifdef __APPLE__
+  // Another instance on the shared thread may have the floor, with its isolate entered
+  NodeInstance *current = m_shared ? SharedLoopThread::Current() : this;
+  if (current != this && m_run && m_run->env) {
+    RunScope scope(m_run);
+    fn();
+    return;
+  }
+#endif
+  fn();
+}
+
+void NodeInstance::SetThrottle(unsigned min_interval_ms) {
+  m_throttle_ms = min_interval_ms;
+  std::unique_lock<std::mutex> lock(m_power_mutex);
+  if (m_power_async) {
+    uv_async_send(m_power_async);
+  }
+}
+
+void NodeInstance::SetThreadClass(nodedroid::ThreadClass thread_class) {
+  m_dispatcher.Async([this, thread_class]() {
+    ApplyThreadClass(thread_class);
+  });
+}
+
+// Must be on the node thread
+void NodeInstance::ApplyThreadClass(nodedroid::ThreadClass thread_class) {
+  m_thread_class = thread_class;
+#ifdef __APPLE__
+  if (!m_shared)
+#endif
+  nodedroid::ApplyThreadClass(thread_class);
+  if (m_run && m_run->env) {
+    nodedroid::SetLoopThreadClass(m_run->env->event_loop(), thread_class);
+  }
+}
+
+void NodeInstance::SetLogSink(nodedroid::LogLevel min_level,
+                              nodedroid::LogSink::Deliver deliver) {
+  m_log_sink.Configure(min_level, deliver);
+  // Before the bootstrap is done, process._attachLogSink() takes care of it
+  m_dispatcher.Async([this]() {
+    if (m_run && m_run->env) {
+      m_log_sink.Attach(m_run->env);
+    }
+  });
+}
+
+void NodeInstance::OnPowerModeChange(uv_async_t *handle) {
+  NodeInstance *instance = reinterpret_cast<NodeInstance*>(handle->data);
+  instance->ApplyPowerMode();
+  // Drop out of uv_run() so that the main loop picks up the new mode
+  uv_stop(handle->loop);
+}
+
+// Keeps count of the bytes it has handed out, for GetResourceUsage()
+class CountingAllocator : public ArrayBufferAllocator {
+ public:
+  void* Allocate(size_t size) override {
+    return Count(ArrayBufferAllocator::Allocate(size), size);
+  }
+  void* AllocateUninitialized(size_t size) override {
+    return Count(ArrayBufferAllocator::AllocateUninitialized(size), size);
+  }
+  void Free(void* data, size_t size) override {
+    if (data) m_allocated.fetch_sub(size, std::memory_order_relaxed);
+    ArrayBufferAllocator::Free(data, size);
+  }
+  size_t Allocated() const { return m_allocated.load(std::memory_order_relaxed); }
+
+ private:
+  void* Count(void* data, size_t size) {
+    if (data) m_allocated.fetch_add(size, std::memory_order_relaxed);
+    return data;
+  }
+  std::atomic<size_t> m_allocated {0};
+};
+
+void NodeInstance::NotifyIdle(unsigned idle_ms) {
+  m_idle_deadline = uv_hrtime() + idle_ms * (uint64_t) 1000000;
+  if (m_idle_queued.exchange(true)) return;
+
+  m_dispatcher.Async([this]() {
+    m_idle_queued = false;
+    const uint64_t now = uv_hrtime();
+    const uint64_t deadline = m_idle_deadline;
+    if (!m_run || !m_run->isolate || now >= deadline) return;
+
+    // The engine wants the deadline in its platform's timebase
+#ifdef __ANDROID__
+    const double base = ContextGroup::Platform()->MonotonicallyIncreasingTime();
+#else
+    // V82JSC has no platform and measures against the steady clock
+    const double base = std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    m_run->isolate->IdleNotificationDeadline(base + (deadline - now) / 1e9);
+  });
+}
+
+bool NodeInstance::GetResourceUsage(ResourceUsage *usage) {
+  auto collect = [this, usage]() {
+    HeapStatistics heap;
+    m_run->isolate->GetHeapStatistics(&heap);
+    usage->heap_used = heap.used_heap_size();
+    usage->heap_limit = heap.heap_size_limit();
+    usage->external_memory = static_cast<CountingAllocator*>(m_run->allocator)->Allocated();
+
+    usage->open_handles = 0;
+    uv_walk(&m_run->loop, [](uv_handle_t* handle, void* arg) {
+      if (!uv_is_closing(handle)) ++ *reinterpret_cast<unsigned*>(arg);
+    }, &usage->open_handles);
+
+    nodedroid::LoopMonitor::Snapshot loop;
+    m_monitor.GetSnapshot(&loop);
+    usage->cpu_time_ns = loop.cpu_time_ns;
+    usage->loop_iterations = loop.iterations;
+    usage->lag_p50_ns = loop.p50_ns;
+    usage->lag_p90_ns = loop.p90_ns;
+    usage->lag_p99_ns = loop.p99_ns;
+    usage->lag_max_ns = loop.max_ns;
+  };
+
+  if (OnNodeThread()) {
+    if (!m_run || !m_run->running) return false;
+    RunHere(collect);
+    return true;
+  }
+  return m_dispatcher.Sync(collect);
+}
+
+struct NodeInstance::LongTaskState {
+  NodeInstance *instance;  // cleared when the instance lets go of its isolate
+  LongTaskCallback callback;
+  uint64_t stack_iteration = UINT64_MAX;
+  std::string stack;
+  // A CPU profile started by the interrupt, until its iteration ends
+  Isolate* profiled = nullptr;
+  uint64_t profile_iteration = UINT64_MAX;
+  std::string profile_dir;
+};
+
+struct NodeInstance::LongTaskInterrupt {
+  std::shared_ptr<LongTaskState> state;
+  uint64_t iteration;
+};
+
+void NodeInstance::SetLongTaskMonitor(unsigned threshold_ms, LongTaskCallback callback) {
+  m_dispatcher.Async([this, threshold_ms, callback]() {
+    DropLongTasks();
+    if (threshold_ms == 0 || !callback) {
+      m_monitor.Watch(0, nullptr, nullptr);
+      return;
+    }
+
+    auto state = std::make_shared<LongTaskState>();
+    state->instance = this;
+    state->callback = callback;
+    m_long_tasks = state;
+    m_monitor.Watch(threshold_ms,
+      [this, state](uint64_t iteration) {
+        // Still going; interrupt it to see what it's doing
+        auto interrupt = new LongTaskInterrupt { state, iteration };
+        if (!RequestInterrupt(OnLongTaskInterrupt, interrupt)) delete interrupt;
+      },
+      [state](uint64_t iteration, uint64_t busy_ns) {
+        std::string stack;
+        if (state->stack_iteration == iteration) stack.swap(state->stack);
+        state->stack_iteration = UINT64_MAX;
+        if (state->profiled && state->profile_iteration == iteration) {
+          char name[40];
+          snprintf(name, sizeof name, "/%llu.cpuprofile",
+                   static_cast<unsigned long long>(
+                     std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::system_clock::now().time_since_epoch()).count()));
+          const std::string path = state->profile_dir + name;
+          int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+          nodedroid::CpuProfile::Stop(state->profiled, fd);
+          if (fd >= 0) close(fd);
+          state->profiled = nullptr;
+          state->profile_iteration = UINT64_MAX;
+        }
+        state->callback(busy_ns, stack);
+      });
+  });
+}
+
+void NodeInstance::SetLongTaskProfiling(const std::string& dir, int interval_us) {
+  m_dispatcher.Async([this, dir, interval_us]() {
+    m_long_task_profile_dir = dir;
+    m_long_task_profile_interval = interval_us;
+  });
+}
+
+// Must be on the node thread
+void NodeInstance::DropLongTasks() {
+  if (!m_long_tasks) return;
+  if (m_long_tasks->profiled) {
+    nodedroid::CpuProfile::Stop(m_long_tasks->profiled, -1);
+  }
+  m_long_tasks->instance = nullptr;
+  m_long_tasks.reset();
+}
+
+void NodeInstance::OnLongTaskInterrupt(Isolate* isolate, void* data) {
+  LongTaskInterrupt *interrupt = reinterpret_cast<LongTaskInterrupt*>(data);
+  std::shared_ptr<LongTaskState> state = interrupt->state;
+  const uint64_t iteration = interrupt->iteration;
+  delete interrupt;
+
+  // An interrupt requested while the loop was only waiting runs whenever JS next does, by
+  // which time it is about something else
+  NodeInstance *instance = state->instance;
+  if (!instance || instance->m_monitor.Iteration() != iteration) return;
+
+  HandleScope handle_scope(isolate);
+  Local<StackTrace> trace = StackTrace::CurrentStackTrace(isolate, 16, StackTrace::kOverview);
+  std::string stack;
+  for (int i = 0; i < trace->GetFrameCount(); i++) {
+    Local<StackFrame> frame = trace->GetFrame(i);
+    node::Utf8Value function_name(isolate, frame->GetFunctionName());
+    node::Utf8Value script_name(isolate, frame->GetScriptName());
+    char line[64];
+    snprintf(line, sizeof line, ":%d:%d)\n", frame->GetLineNumber(), frame->GetColumn());
+    stack += "    at ";
+    stack += function_name.length() ? *function_name : "<anonymous>";
+    stack += " (";
+    stack += script_name.length() ? *script_name : "<unknown>";
+    stack += line;
+  }
+  state->stack = stack;
+  state->stack_iteration = iteration;
+
+  if (!instance->m_long_task_profile_dir.empty() && !state->profiled &&
+      nodedroid::CpuProfile::Start(isolate, instance->m_long_task_profile_interval)) {
+    state->profiled = isolate;
+    state->profile_iteration = iteration;
+    state->profile_dir = instance->m_long_task_profile_dir;
+  }
+}
+
+bool NodeInstance::RequestInterrupt(InterruptCallback callback, void *data) {
+  Mutex::ScopedLock scoped_lock(node_isolate_mutex);
+  if (node_isolate == nullptr) return false;
+  node_isolate->RequestInterrupt(callback, data);
+  return true;
+}
+
+void NodeInstance::ApplyPowerMode() {
+  const bool background = m_throttle_ms != 0;
+  if (background != m_in_background) {
+    if (background) {
+      node_isolate->IsolateInBackgroundNotification();
+    } else {
+      node_isolate->IsolateInForegroundNotification();
+    }
+    m_in_background = background;
+  }
+}
+
+void NodeInstance::RunThrottled(uv_loop_t *loop) {
+  while (m_throttle_ms && uv_loop_alive(loop)) {
+    const int min_ms = (int) m_throttle_ms;
+    int timeout = uv_backend_timeout(loop);
+    if (timeout >= 0 && timeout < min_ms)
+      timeout = min_ms;
+
+    // Wakes early for I/O, including a uv_async_send() from another thread
+    struct pollfd pfd = { uv_backend_fd(loop), POLLIN, 0 };
+    poll(&pfd, 1, timeout);
+
+    m_monitor.BeginRun();
+    uv_run(loop, UV_RUN_NOWAIT);
+    m_monitor.EndRun();
+  }
+}
+
+bool NodeInstance::BootEnvironment() {
+  RunState *run = m_run;
   /* ===Start */
   Isolate* isolate = node_isolate;
-  JSContextGroupRef group = (JSContextGroupRef)group_;
+  JSContextGroupRef group = run->group;
     
   HandleScope handle_scope(isolate);
-  JSGlobalContextRef ctxRef = nullptr;
 
-  Local<Context> context = os_newContext(isolate, group, &ctxRef);
+  Local<Context> context = os_newContext(isolate, group, &run->ctxRef);
+  JSGlobalContextRef ctxRef = run->ctxRef;
   /* ===End */
 
   Context::Scope context_scope(context);
-  Environment env(isolate_data, context);
+  run->env = new Environment(run->isolate_data, context);
+  Environment& env = *run->env;
   CHECK_EQ(0, uv_key_create(&thread_local_env));
   uv_key_set(&thread_local_env, &env);
-  env.Start(argc, argv, exec_argc, exec_argv, v8_is_profiling);
+  env.Start(run->argc, run->argv, run->exec_argc, run->exec_argv, v8_is_profiling);
+  m_timeline.environment_ready = uv_hrtime();
+  nodedroid::SetFsStats(&m_timeline.fs);
 
   /* ===Start */
   // Override default chdir and cwd methods
@@ -695,15 +1391,57 @@ inline int NodeInstance::StartInstance(void* group_, IsolateData* isolate_data,
   env.SetMethod(process, "reallyExit", Exit);
   env.SetMethod(process, "abort", Abort);
   env.SetMethod(process, "_kill", Kill);
+
+  nodedroid::ServiceChannel::Install(&env);
+  nodedroid::ChildInstance::Install(&env, m_config);
+  nodedroid::NativeHttp::Install(&env);
+  nodedroid::NativeCrypto::Install(&env);
+  {
+    nodedroid::WorkerPool::Limits limits;
+    limits.max_old_space_mb = m_config.max_old_space_mb;
+    limits.max_semi_space_mb = m_config.max_semi_space_mb;
+    limits.code_range_mb = m_config.code_range_mb;
+    limits.stack_limit_kb = m_config.stack_limit_kb;
+    nodedroid::WorkerPool::Install(&env, limits);
+  }
+  nodedroid::WasmCache::Install(&env);
+  nodedroid::ModulePrefetch::Install(&env, run->argc > 1 ? run->argv[1] : nullptr);
+  nodedroid::HeapProfile::Install(&env);
+  m_log_sink.Install(&env);
+  nodedroid::SetLoopThreadClass(env.event_loop(), m_thread_class);
+  if (m_config.max_old_space_mb > 0 && m_config.heap_headroom_mb > 0) {
+    run->heap_guard.reset(new nodedroid::HeapGuard(&env,
+      (size_t) m_config.max_old_space_mb * 1024 * 1024,
+      (size_t) m_config.heap_headroom_mb * 1024 * 1024,
+      [this](nodedroid::HeapGuard::Event event, size_t used, size_t limit) {
+        NotifyMemoryPressure(event, used, limit);
+      }));
+  }
+#ifdef __ANDROID__
+  // Warm instances stop here until someone wants them.  An evicted instance skips running
+  // the entry script and exits through the normal shutdown path.
+  bool claimed = WaitForClaim();
+  if (claimed) {
+    NotifyStart(ctxRef, group);
+    m_timeline.host_notified = uv_hrtime();
+  }
+#else
+  const bool claimed = true;
   NotifyStart(ctxRef, group);
+  m_timeline.host_notified = uv_hrtime();
+#endif
+  run->claimed = claimed;
 
   /* ===End */
 
-  const char* path = argc > 1 ? argv[1] : nullptr;
+  const char* path = run->argc > 1 ? run->argv[1] : nullptr;
   StartInspector(&env, path, debug_options);
 
-  if (debug_options.inspector_enabled() && !v8_platform.InspectorStarted(&env))
-    return 12;  // Signal internal error.
+  if (debug_options.inspector_enabled() && !v8_platform.InspectorStarted(&env)) {
+    run->failed = true;
+    run->exit_code = 12;  // Signal internal error.
+    return false;
+  }
 
   env.set_abort_on_uncaught_exception(abort_on_uncaught_exception);
 
@@ -711,61 +1449,121 @@ inline int NodeInstance::StartInstance(void* group_, IsolateData* isolate_data,
     env.async_hooks()->force_checks();
   }
 
-  {
+  if (claimed) {
     Environment::AsyncCallbackScope callback_scope(&env);
     env.async_hooks()->push_async_ids(1, 0);
     LoadEnvironment(&env);
+    m_timeline.bootstrap_done = uv_hrtime();
+    nodedroid::ModulePrefetch::BootDone(&env);
     env.async_hooks()->pop_async_id(1);
   }
 
   env.set_trace_sync_io(trace_sync_io);
-    
-#ifdef __APPLE__
-  // Set up a dummy runloop source to avoid spinning
-  CFRunLoopSourceContext noSpinCtx = {0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
-  CFRunLoopSourceRef noSpinSource = CFRunLoopSourceCreate(NULL, 0, &noSpinCtx);
-  CFRunLoopAddSource(CFRunLoopGetCurrent(), noSpinSource, kCFRunLoopDefaultMode);
-  CFRelease(noSpinSource);
-#endif
+
+  // Without the bootstrap there is no process.emit, so an unclaimed instance has nothing to
+  // run and nobody to tell about its exit
+  if (!claimed) return false;
 
   {
-    SealHandleScope seal(isolate);
+    std::unique_lock<std::mutex> lock(m_power_mutex);
+    m_power_async = new uv_async_t();
+    m_power_async->data = this;
+    uv_async_init(env.event_loop(), m_power_async, OnPowerModeChange);
+    uv_unref((uv_handle_t*)m_power_async);
+  }
+  ApplyPowerMode();
+  m_dispatcher.Open(env.event_loop());
+  m_monitor.Open(env.event_loop());
+
+  PERFORMANCE_MARK(&env, LOOP_START);
+  run->running = true;
+  return true;
+}
+
+// One turn of the loop, in the instance's RunScope.  Returns false once the loop is done.  On
+// Android the turn lasts until the loop stops; on Apple it never blocks.
+bool NodeInstance::Turn() {
+  Environment* env = m_run->env;
+  SealHandleScope seal(m_run->isolate);
 
-    bool more;
-    PERFORMANCE_MARK(&env, LOOP_START);
-    do {
 #ifdef __ANDROID__
-      uv_run(env.event_loop(), UV_RUN_DEFAULT);
+  if (m_throttle_ms) {
+    RunThrottled(env->event_loop());
+  } else {
+    m_monitor.BeginRun();
+    uv_run(env->event_loop(), UV_RUN_DEFAULT);
+    m_monitor.EndRun();
+  }
 #else
-      uv_run(env.event_loop(), UV_RUN_NOWAIT);
-      CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0, false);
+  m_monitor.BeginRun();
+  uv_run(env->event_loop(), UV_RUN_NOWAIT);
+  m_monitor.EndRun();
 #endif
 
-      v8_platform.DrainVMTasks();
+  v8_platform.DrainVMTasks();
 
-      more = uv_loop_alive(env.event_loop());
-      if (more)
-        continue;
+  // The host may have posted something after the loop last looked
+  if (uv_loop_alive(env->event_loop()) ||
+      nodedroid::LoopDispatcher::KeepAlive(env->event_loop()))
+    return true;
+
+  EmitBeforeExit(env);
 
-      EmitBeforeExit(&env);
+  // Emit `beforeExit` if the loop became alive either after emitting
+  // event, or after running some callbacks.
+  return uv_loop_alive(env->event_loop()) ||
+      nodedroid::LoopDispatcher::KeepAlive(env->event_loop());
+}
 
-      // Emit `beforeExit` if the loop became alive either after emitting
-      // event, or after running some callbacks.
-      more = uv_loop_alive(env.event_loop());
-    } while (more == true);
+void NodeInstance::ShutdownEnvironment() {
+  RunState *run = m_run;
+  Environment& env = *run->env;
+
+  if (run->running) {
     PERFORMANCE_MARK(&env, LOOP_EXIT);
+
+    {
+      std::unique_lock<std::mutex> lock(m_power_mutex);
+      uv_close((uv_handle_t*)m_power_async, [](uv_handle_t *h) {
+        delete (uv_async_t*)h;
+      });
+      m_power_async = nullptr;
+    }
+    // Let anything that got in before the end run, then turn everyone else away
+    m_dispatcher.Drain();
+    m_dispatcher.Close();
+    m_monitor.Close();
+    nodedroid::ServiceChannel::CloseAll(&env);
+    nodedroid::ChildInstance::CloseAll(&env);
+    nodedroid::NativeHttp::AbortAll(&env);
+    nodedroid::WorkerPool::TerminateAll(&env);
+    nodedroid::WasmCache::Remove(&env);
+    nodedroid::ModulePrefetch::Remove(&env);
+    nodedroid::ModuleArchive::Remove(&env);
+    DropLongTasks();
+    // Whoever else was profiling the isolate, it is too late to write out
+    nodedroid::CpuProfile::Stop(env.isolate(), -1);
+    run->heap_guard.reset();
+    nodedroid::SetLoopThreadClass(env.event_loop(), nodedroid::kThreadDefault);
+    uv_run(env.event_loop(), UV_RUN_NOWAIT);
   }
 
-  env.set_trace_sync_io(false);
+  if (!run->failed) {
+    env.set_trace_sync_io(false);
 
-  const int exit_code = EmitExit(&env);
-  RunAtExit(&env);
+    run->exit_code = run->claimed ? EmitExit(&env) : 0;
+    RunAtExit(&env);
+  }
+  m_log_sink.Detach();
 
   /* ===Start */
-  os_Dispose(group, ctxRef);
+  os_Dispose(run->group, run->ctxRef);
   /* ===End */
 
   uv_key_delete(&thread_local_env);
+  nodedroid::SetFsStats(nullptr);
+  nodedroid::ReleaseSandbox();
+  nodedroid::ReleaseMappedFiles(&env);
 
   v8_platform.DrainVMTasks();
   WaitForInspectorDisconnect(&env);
@@ -773,51 +1571,78 @@ inline int NodeInstance::StartInstance(void* group_, IsolateData* isolate_data,
   __lsan_do_leak_check();
 #endif
 
-  return exit_code;
+  delete run->env;
+  run->env = nullptr;
 }
 
 #ifdef __POSIX__
 static const unsigned kMaxSignal = 32;
 #endif
 
-inline int NodeInstance::StartInstance(uv_loop_t* event_loop,
-                 int argc, const char* const* argv,
-                 int exec_argc, const char* const* exec_argv) {
-  Isolate::CreateParams params;
-  ArrayBufferAllocator allocator;
-  params.array_buffer_allocator = &allocator;
-#ifdef NODE_ENABLE_VTUNE_PROFILING
-  params.code_event_handler = vTune::GetVtuneCodeEventHandler();
-#endif
+bool NodeInstance::BootIsolate() {
+  RunState *run = m_run;
+  m_loop = &run->loop;
 
-  m_loop = event_loop;
-  Isolate* const isolate = Isolate::New(params);
-  if (isolate == nullptr)
-    return 12;  // Signal internal error.
+  // The allocator must live exactly as long as the isolate, which may outlive us
+  ArrayBufferAllocator* allocator = nullptr;
+#ifdef __APPLE__
+  run->shared_group = s_shared_context_group;
+#endif
+  Isolate* isolate = ClaimRecycledIsolate(&allocator);
+  const bool recycled = isolate != nullptr;
+  if (!recycled) {
+    isolate = NewIsolate(&allocator);
+    if (isolate == nullptr) {
+      run->exit_code = 12;  // Signal internal error.
+      return false;
+    }
 
-  isolate->AddMessageListener(OnMessage);
-  isolate->SetAbortOnUncaughtExceptionCallback(ShouldAbortOnUncaughtException);
-  isolate->SetAutorunMicrotasks(false);
-  isolate->SetFatalErrorHandler(OnFatalError);
+    isolate->AddMessageListener(OnMessage);
+    isolate->SetAbortOnUncaughtExceptionCallback(ShouldAbortOnUncaughtException);
+    isolate->SetAutorunMicrotasks(false);
+    isolate->SetFatalErrorHandler(OnFatalError);
 
-  if (track_heap_objects) {
-    isolate->GetHeapProfiler()->StartTrackingHeapObjects(true);
+    if (track_heap_objects) {
+      isolate->GetHeapProfiler()->StartTrackingHeapObjects(true);
+    }
   }
+  run->isolate = isolate;
+  run->allocator = allocator;
 
   {
     Mutex::ScopedLock scoped_lock(node_isolate_mutex);
     node_isolate = isolate;
   }
+  m_timeline.isolate_ready = uv_hrtime();
+
+  run->group = os_groupFromIsolate(isolate, &run->loop);
+
+  Locker locker(isolate);
+  Isolate::Scope isolate_scope(isolate);
+  if (recycled && m_config.stack_limit_kb > 0) {
+    // The configured limit was measured against the thread that created the isolate
+    uintptr_t here = reinterpret_cast<uintptr_t>(&locker);
+    isolate->SetStackLimit(here - m_config.stack_limit_kb * 1024);
+  }
+  HandleScope handle_scope(isolate);
+  run->isolate_data = new IsolateData(isolate, &run->loop, allocator->zero_fill_field());
+  return BootEnvironment();
+}
 
-  JSContextGroupRef group = os_groupFromIsolate(isolate, event_loop);
+void NodeInstance::ShutdownIsolate() {
+  RunState *run = m_run;
+  Isolate* isolate = run->isolate;
 
-  int exit_code;
   {
     Locker locker(isolate);
     Isolate::Scope isolate_scope(isolate);
     HandleScope handle_scope(isolate);
-    IsolateData isolate_data(isolate, event_loop, allocator.zero_fill_field());
-    exit_code = StartInstance((void*)group, &isolate_data, argc, argv, exec_argc, exec_argv);
+    if (run->env) {
+      Context::Scope context_scope(run->env->context());
+      ShutdownEnvironment();
+    }
+    delete run->isolate_data;
+    run->isolate_data = nullptr;
   }
 
   {
@@ -826,9 +1651,125 @@ inline int NodeInstance::StartInstance(uv_loop_t* event_loop,
     node_isolate = nullptr;
   }
 
-  isolate->Dispose();
+  if (!RecycleIsolate(isolate, run->allocator)) {
+    isolate->Dispose();
+    delete run->allocator;
+  }
+  run->isolate = nullptr;
+  run->allocator = nullptr;
+}
 
-  return exit_code;
+Isolate* NodeInstance::NewIsolate(ArrayBufferAllocator** allocator) {
+  Isolate::CreateParams params;
+  *allocator = new CountingAllocator();
+  params.array_buffer_allocator = *allocator;
+  if (m_config.max_old_space_mb > 0)
+    params.constraints.set_max_old_space_size(m_config.max_old_space_mb +
+      (m_config.heap_headroom_mb > 0 ? m_config.heap_headroom_mb : 0));
+  if (m_config.max_semi_space_mb > 0)
+    params.constraints.set_max_semi_space_size(m_config.max_semi_space_mb);
+  if (m_config.code_range_mb > 0)
+    params.constraints.set_code_range_size(m_config.code_range_mb);
+  if (m_config.stack_limit_kb > 0) {
+    // The limit is an address, measured down from where this thread is now
+    uintptr_t here = reinterpret_cast<uintptr_t>(&params);
+    params.constraints.set_stack_limit(
+        reinterpret_cast<uint32_t*>(here - m_config.stack_limit_kb * 1024));
+  }
+#ifdef NODE_ENABLE_VTUNE_PROFILING
+  params.code_event_handler = vTune::GetVtuneCodeEventHandler();
+#endif
+
+  Isolate* const isolate = Isolate::New(params);
+  if (isolate == nullptr) {
+    delete *allocator;
+    *allocator = nullptr;
+  }
+  return isolate;
+}
+
+std::mutex NodeInstance::s_recycle_mutex;
+std::vector<NodeInstance::RecycledIsolate> NodeInstance::s_recycled;
+size_t NodeInstance::s_recycle_limit = 0;
+
+void NodeInstance::SetThreadPoolSize(unsigned size) {
+#ifdef __APPLE__
+  uv_threadpool_set_size(size);
+#else
+  // The prebuilt libnode.so has stock libuv, which reads this once, when the pool starts
+  if (size) {
+    setenv("UV_THREADPOOL_SIZE", std::to_string(size).c_str(), 1);
+  } else {
+    unsetenv("UV_THREADPOOL_SIZE");
+  }
+#endif
+}
+
+void NodeInstance::SetIsolateRecycling(size_t max_isolates) {
+  std::vector<RecycledIsolate> evicted;
+  {
+    std::unique_lock<std::mutex> lock(s_recycle_mutex);
+    s_recycle_limit = max_isolates;
+    while (s_recycled.size() > max_isolates) {
+      evicted.push_back(s_recycled.back());
+      s_recycled.pop_back();
+    }
+  }
+  for (auto& r : evicted) {
+    r.isolate->Dispose();
+    delete r.allocator;
+  }
+}
+
+Isolate* NodeInstance::ClaimRecycledIsolate(ArrayBufferAllocator** allocator) {
+  std::unique_lock<std::mutex> lock(s_recycle_mutex);
+  for (auto it = s_recycled.begin(); it != s_recycled.end(); ++it) {
+    // Heap limits are fixed at creation, so only an isolate built the same way will do
+    if (it->max_old_space_mb == m_config.max_old_space_mb &&
+        it->heap_headroom_mb == m_config.heap_headroom_mb &&
+        it->max_semi_space_mb == m_config.max_semi_space_mb &&
+        it->code_range_mb == m_config.code_range_mb
+#ifdef __APPLE__
+        && it->shared_group == m_run->shared_group
+#endif
+        ) {
+      Isolate* isolate = it->isolate;
+      *allocator = it->allocator;
+      s_recycled.erase(it);
+      return isolate;
+    }
+  }
+  return nullptr;
+}
+
+bool NodeInstance::RecycleIsolate(Isolate* isolate, ArrayBufferAllocator* allocator) {
+  {
+    std::unique_lock<std::mutex> lock(s_recycle_mutex);
+    if (s_recycled.size() >= s_recycle_limit) return false;
+  }
+
+  // The environment and all of its contexts are gone by now; collect what they left behind
+  // so the next instance starts with an empty heap
+  {
+    Locker locker(isolate);
+    Isolate::Scope isolate_scope(isolate);
+    isolate->LowMemoryNotification();
+  }
+
+  std::unique_lock<std::mutex> lock(s_recycle_mutex);
+  if (s_recycled.size() >= s_recycle_limit) return false;
+  RecycledIsolate r;
+  r.isolate = isolate;
+  r.allocator = allocator;
+  r.max_old_space_mb = m_config.max_old_space_mb;
+  r.heap_headroom_mb = m_config.heap_headroom_mb;
+  r.max_semi_space_mb = m_config.max_semi_space_mb;
+  r.code_range_mb = m_config.code_range_mb;
+#ifdef __APPLE__
+  r.shared_group = m_run->shared_group;
+#endif
+  s_recycled.push_back(r);
+  return true;
 }
 
 inline void NodeInstance::PlatformInit() {
@@ -914,41 +1855,113 @@ inline void NodeInstance::PlatformInit() {
 
 std::mutex init_mutex;
 
-int NodeInstance::StartInstance(int argc, char *argv[]) {
-  atexit([] () { uv_tty_reset_mode(); });
-  PlatformInit();
-  node::performance::performance_node_start = PERFORMANCE_NOW();
+// Process-wide set-up that only needs doing for the first instance
+static std::once_flag s_process_init;
 
-  CHECK_GT(argc, 0);
+// node::Init() only depends on the command line and the environment, so its result for the
+// default command line is kept and reused by every instance that doesn't add arguments
+static std::atomic<bool> s_default_init_done(false);
+static std::vector<std::string> s_default_argv;
+static std::vector<std::string> s_default_exec_argv;
 
-  // Hack around with the argv pointer. Used for process.title = "blah".
-  argv = uv_setup_args(argc, argv);
+bool NodeInstance::BootNode() {
+  RunState *run = m_run;
 
-  // This needs to run *before* V8::Initialize().  The const_cast is not
-  // optional, in case you're wondering.
-  int exec_argc;
-  const char** exec_argv;
-    
-  {
-    std::unique_lock<std::mutex> lk(init_mutex);
-    Init(&argc, const_cast<const char**>(argv), &exec_argc, &exec_argv);
+  setenv("NODE_PATH", "/home/node_modules", true);
+
+  std::vector<std::string> args { "node" };
+  args.insert(args.end(), m_config.args.begin(), m_config.args.end());
+  args.push_back("-e");
+  args.push_back("process._attachLogSink();process._attachFork();global.__nodedroid_onLoad();");
+
+  // uv_setup_args() expects the arguments to be laid out contiguously, as they would be
+  // coming from the OS
+  for (auto& arg : args) {
+    run->cmd.append(arg).push_back('\0');
   }
 
-#if HAVE_OPENSSL
+  int& argc = run->argc;
+  char**& argv = run->argv;
+  for (char *p2 = &run->cmd[0]; p2 < &run->cmd[0] + run->cmd.size() &&
+       argc < RunState::kMaxArgs-1; p2 += strlen(p2) + 1) {
+    argv[argc++] = p2;
+  }
+  argv[argc] = 0;
+
+  CHECK_GT(argc, 0);
+
+#if defined(__POSIX__) && HAVE_INSPECTOR
+  // Signal masks are per thread, so this part of PlatformInit() is needed on every node thread
   {
-    std::string extra_ca_certs;
-    if (SafeGetenv("NODE_EXTRA_CA_CERTS", &extra_ca_certs))
-      crypto::UseExtraCaCerts(extra_ca_certs);
+    sigset_t sigmask;
+    sigemptyset(&sigmask);
+    sigaddset(&sigmask, SIGUSR1);
+    CHECK_EQ(0, pthread_sigmask(SIG_SETMASK, &sigmask, nullptr));
   }
+#endif
+
+  std::call_once(s_process_init, [this, run, &argc, &argv] () {
+    atexit([] () { uv_tty_reset_mode(); });
+    PlatformInit();
+
+    // Hack around with the argv pointer. Used for process.title = "blah".  libuv keeps
+    // process.title pointing into the strings it is given for good, so it gets a copy of the
+    // command line that lives as long as the process rather than just this instance.
+    char *cmd = new char[run->cmd.size()];
+    memcpy(cmd, run->cmd.data(), run->cmd.size());
+    char **process_argv = new char*[argc + 1];
+    for (int i = 0; i < argc; i++) {
+      process_argv[i] = cmd + (argv[i] - &run->cmd[0]);
+    }
+    process_argv[argc] = nullptr;
+    argv = uv_setup_args(argc, process_argv);
+
+#if HAVE_OPENSSL
+    {
+      std::string extra_ca_certs;
+      if (SafeGetenv("NODE_EXTRA_CA_CERTS", &extra_ca_certs))
+        crypto::UseExtraCaCerts(extra_ca_certs);
+    }
 #ifdef NODE_FIPS_MODE
-  // In the case of FIPS builds we should make sure
-  // the random source is properly initialized first.
-  OPENSSL_init();
+    // In the case of FIPS builds we should make sure
+    // the random source is properly initialized first.
+    OPENSSL_init();
 #endif  // NODE_FIPS_MODE
-  // V8 on Windows doesn't have a good source of entropy. Seed it from
-  // OpenSSL's pool.
-  V8::SetEntropySource(crypto::EntropySource);
+    // V8 on Windows doesn't have a good source of entropy. Seed it from
+    // OpenSSL's pool.
+    V8::SetEntropySource(crypto::EntropySource);
 #endif  // HAVE_OPENSSL
+  });
+  node::performance::performance_node_start = PERFORMANCE_NOW();
+
+  // This needs to run *before* V8::Initialize().  The const_cast is not
+  // optional, in case you're wondering.
+  int& exec_argc = run->exec_argc;
+  const char**& exec_argv = run->exec_argv;
+
+  const bool is_default = m_config.args.empty();
+  if (is_default && s_default_init_done) {
+    argc = (int) s_default_argv.size();
+    for (int i = 0; i < argc; i++) {
+      argv[i] = const_cast<char*>(s_default_argv[i].c_str());
+    }
+    argv[argc] = nullptr;
+    exec_argc = (int) s_default_exec_argv.size();
+    exec_argv = new const char*[exec_argc + 1];
+    for (int i = 0; i < exec_argc; i++) {
+      exec_argv[i] = s_default_exec_argv[i].c_str();
+    }
+    exec_argv[exec_argc] = nullptr;
+  } else {
+    std::unique_lock<std::mutex> lk(init_mutex);
+    Init(&argc, const_cast<const char**>(argv), &exec_argc, &exec_argv);
+    if (is_default && !s_default_init_done) {
+      s_default_argv.assign(argv, argv + argc);
+      s_default_exec_argv.assign(exec_argv, exec_argv + exec_argc);
+      s_default_init_done = true;
+    }
+  }
+  m_timeline.node_init_done = uv_hrtime();
 
 #ifdef __ANDROID__
   ContextGroup::init_v8();
@@ -957,11 +1970,14 @@ int NodeInstance::StartInstance(int argc, char *argv[]) {
 #endif
 
   node::performance::performance_v8_start = PERFORMANCE_NOW();
+  m_timeline.v8_init_done = uv_hrtime();
   v8_initialized = true;
-  uv_loop_t uv_loop;
-  uv_loop_init(&uv_loop);
-  const int exit_code =
-      StartInstance(&uv_loop, argc, argv, exec_argc, exec_argv);
+  uv_loop_init(&run->loop);
+  return true;
+}
+
+void NodeInstance::ShutdownNode() {
+  RunState *run = m_run;
   if (trace_enabled) {
     v8_platform.StopTracingAgent();
   }
@@ -971,8 +1987,61 @@ int NodeInstance::StartInstance(int argc, char *argv[]) {
   //FIXME: why does uncommenting this lead to spurious death?
   //uv_loop_close(&uv_loop);
 
-  delete[] exec_argv;
-  exec_argv = nullptr;
+  delete[] run->exec_argv;
+  run->exec_argv = nullptr;
+}
+
+// Runs everything up to the start of the loop.  Returns false if there is no loop to run.
+// Either way, Shutdown() must follow on the same thread.
+bool NodeInstance::Boot() {
+  m_timeline.thread_start = uv_hrtime();
+  m_node_thread = std::this_thread::get_id();
+  m_run = new RunState();
+  return BootNode() && BootIsolate();
+}
 
+int NodeInstance::Shutdown() {
+  if (m_run->isolate) {
+    ShutdownIsolate();
+  }
+  ShutdownNode();
+  const int exit_code = m_run->exit_code;
+  delete m_run;
+  m_run = nullptr;
+  m_node_thread = std::thread::id();
   return exit_code;
 }
+
+void NodeInstance::spawnedThread()
+{
+    m_thread_class = m_config.thread_class;
+    if (m_thread_class != nodedroid::kThreadDefault) {
+        ApplyThreadClass(m_thread_class);
+    }
+    if (Boot()) {
+        RunScope scope(m_run);
+#ifdef __APPLE__
+        UVRunLoopWaiter waiter(&m_run->loop);
+        while (Turn()) {
+            if (m_run->shared_group) {
+                Unlocker unlocker(m_run->isolate);
+                waiter.Wait(m_throttle_ms);
+            } else {
+                waiter.Wait(m_throttle_ms);
+            }
+        }
+#else
+        while (Turn()) {}
+#endif
+    }
+#ifdef __ANDROID__
+    // Java may let go of this instance as soon as it hears of the exit
+    JavaVM *jvm = m_jvm;
+    NotifyExit(Shutdown());
+    if (jvm) {
+        detachThread(jvm);
+    }
+#else
+    NotifyExit(Shutdown());
+#endif
+}
@@ -16,10 +16,16 @@
 #endif
 #include <thread>
 #include <string>
+#include <memory>
+#include <functional>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <map>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 
 #include "node.h"
 #include "uv.h"
@@ -30,6 +36,11 @@
 #include "node_crypto.h"
 #endif
 #include "node_debug_options.h"
+#include "nodedroid_file.h"
+#include "LoopDispatcher.h"
+#include "LogSink.h"
+#include "LoopMonitor.h"
+#include "ThreadClass.h"
 
 #ifdef __ANDROID__
 # include "Common/Common.h"
@@ -42,28 +53,205 @@ using namespace v8;
 typedef void (*OnNodeStartedCallback)(void* data, JSContextRef ctx, JSContextGroupRef group);
 typedef void (*OnNodeExitCallback)(void* data, int code);
 
+#ifdef __APPLE__
+class UVRunLoopWaiter;
+class SharedLoopThread;
+#endif
+
 class NodeInstance {
 public:
+    // Per-instance start-up configuration.  Zero leaves the V8 default in place.  'args' are
+    // inserted into the command line ahead of the script, so they may be any mix of Node
+    // options and V8 flags.  Note that V8 flags are process-wide: they take effect when this
+    // instance's isolate is created, but remain set for instances created after it.
+    // A non-zero 'heap_headroom_mb' makes 'max_old_space_mb' a soft limit, with that much
+    // more behind it, so that the service is warned and then ended on its own (see
+    // HeapGuard) rather than V8 taking the whole app down when it runs out.  'thread_class'
+    // is the scheduling hint the instance starts with (see SetThreadClass()).
+    struct Config {
+        Config() : max_old_space_mb(0), max_semi_space_mb(0), code_range_mb(0),
+            stack_limit_kb(0), heap_headroom_mb(0), thread_class(nodedroid::kThreadDefault) {}
+        int max_old_space_mb;
+        int max_semi_space_mb;
+        size_t code_range_mb;
+        size_t stack_limit_kb;
+        int heap_headroom_mb;
+        nodedroid::ThreadClass thread_class;
+        std::vector<std::string> args;
+    };
+
 #ifdef __ANDROID__
-    NodeInstance(JNIEnv* env, jobject thiz);
+    NodeInstance(JNIEnv* env, jobject thiz, const Config& config = Config());
+
+    // Warm pool.  Pooled instances boot on their own thread as far as the point where the
+    // owner would be notified of the start, and wait there until they are claimed or evicted.
+    // A claimed instance continues exactly as if it had been started by the claimer, except
+    // that its thread is already running and must not be started again.
+    static void SetWarmPoolSize(size_t size);
+    static NodeInstance* ClaimWarmInstance(JNIEnv* env, jobject thiz);
+#endif
+    NodeInstance(OnNodeStartedCallback onStart, OnNodeExitCallback onExit, void* data,
+                 const Config& config = Config());
+
+    // Start-up phases, as uv_hrtime() nanoseconds.  A phase not yet reached reads zero.  The
+    // sandbox counters keep running for the life of the instance.
+    struct StartupTimeline {
+        std::atomic<uint64_t> thread_start {0};
+        std::atomic<uint64_t> node_init_done {0};
+        std::atomic<uint64_t> v8_init_done {0};
+        std::atomic<uint64_t> isolate_ready {0};
+        std::atomic<uint64_t> environment_ready {0};
+        std::atomic<uint64_t> host_notified {0};
+        std::atomic<uint64_t> bootstrap_done {0};
+        nodedroid::FsStats fs;
+    };
+    inline const StartupTimeline& Timeline() const { return m_timeline; }
+
+    // Power mode.  A non-zero interval puts the instance in background mode: each turn of its
+    // loop waits at least that many milliseconds unless there is I/O, which coalesces short
+    // timers and rate-limits setImmediate() chains, and V8 is told the isolate is in the
+    // background.  Zero restores normal scheduling.  May be called from any thread.
+    void SetThrottle(unsigned min_interval_ms);
+
+    // Scheduling hint for the instance's thread, and for the work it queues to libuv's pool
+    // (see SetLoopThreadClass()).  Ignored for the thread itself on the shared thread, which
+    // belongs to everyone.  May be called from any thread.
+    void SetThreadClass(nodedroid::ThreadClass thread_class);
+
+    // Tells the engine the host expects to be idle for the next |idle_ms|, so that garbage
+    // collection work can go there (e.g. the rest of a frame).  The time counts from the call,
+    // so any wait for the loop comes off it.  Calls made while one is queued just move its
+    // deadline.  May be called from any thread.
+    void NotifyIdle(unsigned idle_ms);
+
+    struct ResourceUsage {
+        uint64_t cpu_time_ns;       // spent running this instance's loop
+        size_t heap_used;
+        size_t heap_limit;
+        size_t external_memory;     // held by the ArrayBuffer allocator
+        unsigned open_handles;      // uv handles not yet closing
+        uint64_t loop_iterations;
+        // Busy time per loop iteration (see LoopMonitor)
+        uint64_t lag_p50_ns;
+        uint64_t lag_p90_ns;
+        uint64_t lag_p99_ns;
+        uint64_t lag_max_ns;
+    };
+    // Collected on the node thread, so this waits for the current turn to finish.  Returns
+    // false if the instance has already exited.
+    bool GetResourceUsage(ResourceUsage *usage);
+
+    // Long tasks.  With a non-zero threshold, each loop iteration that stays busy that long is
+    // reported to |callback| on the node thread with its busy time, and with the JS stack if
+    // it was caught while still running.  Keep the callback short; it runs between
+    // iterations.  Zero turns it off.  May be called from any thread.
+    typedef std::function<void(uint64_t busy_ns, const std::string& stack)> LongTaskCallback;
+    void SetLongTaskMonitor(unsigned threshold_ms, LongTaskCallback callback);
+    // With a directory, a long task caught while still running is also CPU profiled from then
+    // until its iteration ends, sampling every |interval_us| (0 for V8's default), and written
+    // there as <ms since the epoch>.cpuprofile.  Only while the long-task monitor is on, and
+    // not while the isolate is already being profiled.  An empty directory turns it off.  May
+    // be called from any thread.
+    void SetLongTaskProfiling(const std::string& dir, int interval_us);
+
+    // Console output.  Once set, console.debug/log/info/warn/error skip process.stdout and go
+    // to |deliver| in batches, on a thread of its own, or to the system log if it is null.
+    // Calls below |min_level| cost next to nothing.  May be called from any thread, and
+    // before the instance has started.
+    void SetLogSink(nodedroid::LogLevel min_level, nodedroid::LogSink::Deliver deliver);
+
+    // Isolate recycling.  With a non-zero limit, the isolate of an exited instance is kept
+    // (after its contexts are gone and a full GC) and handed to the next instance whose heap
+    // limits match, instead of being disposed.  Setting the limit lower disposes the excess.
+    static void SetIsolateRecycling(size_t max_isolates);
+    // The number of threads in libuv's pool, which all instances share (0 for libuv's
+    // default).  Only takes effect before any instance has queued work to it.
+    static void SetThreadPoolSize(unsigned size);
+#ifdef __APPLE__
+    // Shared thread.  When on, instances created from then on all run on one thread, each
+    // with its own loop, instead of getting a thread each.  Their loops are multiplexed through
+    // that thread's run loop, so an idle instance costs no thread and no wake-ups.  The catch
+    // is that a busy instance holds up the others.
+    static void SetSharedThread(bool shared);
+    // Shared context group.  Turn on together with the engine's own switch: an instance on its
+    // own thread then lets go of the isolate lock while its loop waits, since the lock is
+    // shared by every isolate in the group.  Recycled isolates are only reused in the mode
+    // they were built in.
+    static void SetSharedContextGroup(bool shared);
 #endif
-    NodeInstance(OnNodeStartedCallback onStart, OnNodeExitCallback onExit, void* data);
     void spawnedThread();
     virtual ~NodeInstance();
 
 private:
+#ifdef __ANDROID__
+    enum WarmState { kNotWarm, kStarting, kParked, kClaimed, kEvicted };
+
+    NodeInstance();
+    static void warm_task(void *inst);
+    static void FillWarmPool();
+    bool WaitForClaim();
+
+    WarmState m_warm_state = kNotWarm;
+    std::mutex m_warm_mutex;
+    std::condition_variable m_warm_cv;
+
+    static std::mutex s_pool_mutex;
+    static std::deque<NodeInstance*> s_pool;
+    static size_t s_pool_size;
+    static size_t s_pool_starting;
+#endif
+
+    struct RecycledIsolate {
+        Isolate* isolate;
+        ArrayBufferAllocator* allocator;
+        int max_old_space_mb;
+        int heap_headroom_mb;
+        int max_semi_space_mb;
+        size_t code_range_mb;
+#ifdef __APPLE__
+        bool shared_group;
+#endif
+    };
+
+    Isolate* NewIsolate(ArrayBufferAllocator** allocator);
+    Isolate* ClaimRecycledIsolate(ArrayBufferAllocator** allocator);
+    bool RecycleIsolate(Isolate* isolate, ArrayBufferAllocator* allocator);
+
+    // Shared with any stack captures still in flight
+    struct LongTaskState;
+    struct LongTaskInterrupt;
+    std::shared_ptr<LongTaskState> m_long_tasks;
+    std::string m_long_task_profile_dir;
+    int m_long_task_profile_interval = 0;
+    static void OnLongTaskInterrupt(Isolate* isolate, void* data);
+    void DropLongTasks();
+    void ApplyThreadClass(nodedroid::ThreadClass thread_class);
+    nodedroid::ThreadClass m_thread_class = nodedroid::kThreadDefault;
+    nodedroid::LogSink m_log_sink;
+
+    static std::mutex s_recycle_mutex;
+    static std::vector<RecycledIsolate> s_recycled;
+    static size_t s_recycle_limit;
+
     void StartInspector(Environment* env, const char* path,
                         DebugOptions debug_options);
 
-    inline int StartInstance(uv_loop_t* event_loop,
-                 int argc, const char* const* argv,
-                 int exec_argc, const char* const* exec_argv);
-    inline int StartInstance(void* group, IsolateData* isolate_data,
-                 int argc, const char* const* argv,
-                 int exec_argc, const char* const* exec_argv);
-    inline void PlatformInit();
+    struct RunState;
+    struct RunScope;
+    RunState *m_run = nullptr;
 
-    int StartInstance(int argc, char *argv[]);
+    bool Boot();
+    bool BootNode();
+    bool BootIsolate();
+    bool BootEnvironment();
+    bool Turn();
+    int Shutdown();
+    void ShutdownEnvironment();
+    void ShutdownIsolate();
+    void ShutdownNode();
+    void NotifyExit(int code);
+    void NotifyMemoryPressure(int event, size_t used, size_t limit);
+    inline void PlatformInit();
 
     static void WaitForInspectorDisconnect(Environment* env);
     static bool DomainHasErrorHandler(const Environment* env,
@@ -82,6 +270,19 @@ private:
     static void DLOpen(const FunctionCallbackInfo<Value>& args);
 
 private:
+    const Config m_config;
+    StartupTimeline m_timeline;
+
+    std::atomic<unsigned> m_throttle_ms {0};
+    std::atomic<uint64_t> m_idle_deadline {0};  // uv_hrtime()
+    std::atomic<bool> m_idle_queued {false};
+    bool m_in_background = false;
+    std::mutex m_power_mutex;
+    uv_async_t *m_power_async = nullptr;
+    static void OnPowerModeChange(uv_async_t *handle);
+    void ApplyPowerMode();
+    void RunThrottled(uv_loop_t *loop);
+
     Mutex node_isolate_mutex;
     v8::Isolate* node_isolate = nullptr;
 
@@ -104,8 +305,30 @@ private:
     void * callback_data = nullptr;
 protected:
     uv_loop_t *m_loop;
+    // Runs host calls on the loop.  Open from just before the loop starts until it has exited;
+    // anything posted before then waits, anything posted after is discarded.
+    nodedroid::LoopDispatcher m_dispatcher;
+    nodedroid::LoopMonitor m_monitor;
+    // Asks the isolate to call |callback| at its next interrupt check.  Returns false if there
+    // is no isolate (not yet started, or already exited).  May be called from any thread.
+    bool RequestInterrupt(InterruptCallback callback, void *data);
+    // True on the thread this instance runs on, from Boot() until Shutdown()
+    bool OnNodeThread() const;
+    std::atomic<std::thread::id> m_node_thread;
+    // Runs |fn| in this instance's scopes.  Must be on the node thread.
+    void RunHere(const std::function<void()>& fn);
 #ifdef __APPLE__
     std::thread* node_main_thread = nullptr;
+
+private:
+    friend class SharedLoopThread;
+    static std::atomic<bool> s_shared_thread;
+    static std::atomic<bool> s_shared_context_group;
+    bool m_shared = false;
+    UVRunLoopWaiter *m_waiter = nullptr;
+    std::mutex m_exit_mutex;
+    std::condition_variable m_exit_cv;
+    bool m_exited = false;
 #endif
 };
 
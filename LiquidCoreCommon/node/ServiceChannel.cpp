@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "env-inl.h"
+#include "ServiceChannel.h"
+#include "StructuredClone.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+struct Endpoint;
+
+// The two ends of a name.  Once either end closes the link is broken for good; the name is
+// free for a new pair and the other end's messages go nowhere.
+struct Link {
+    std::string name;
+    std::mutex mutex;
+    Endpoint *ends[2] = { nullptr, nullptr };
+    std::deque<std::unique_ptr<ClonedValue>> queued[2];
+    bool broken = false;
+};
+
+struct Endpoint {
+    node::Environment *env;
+    std::shared_ptr<Link> link;
+    int side;
+    uv_async_t *async = nullptr;  // null once closed
+    Persistent<Function> onmessage;
+    Persistent<Object> port;
+};
+
+std::mutex s_mutex;
+std::map<std::string, std::shared_ptr<Link>> s_links;
+std::multimap<node::Environment*, Endpoint*> s_endpoints;
+
+void Throw(Isolate *isolate, const char *message)
+{
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, message)));
+}
+
+void Close(Endpoint *endpoint)
+{
+    if (!endpoint->async) return;
+
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto found = s_links.find(endpoint->link->name);
+        if (found != s_links.end() && found->second == endpoint->link) {
+            s_links.erase(found);
+        }
+        for (auto it = s_endpoints.find(endpoint->env);
+             it != s_endpoints.end() && it->first == endpoint->env; ++it) {
+            if (it->second == endpoint) {
+                s_endpoints.erase(it);
+                break;
+            }
+        }
+        std::lock_guard<std::mutex> link_lock(endpoint->link->mutex);
+        endpoint->link->ends[endpoint->side] = nullptr;
+        endpoint->link->queued[endpoint->side].clear();
+        endpoint->link->broken = true;
+    }
+
+    uv_close(reinterpret_cast<uv_handle_t*>(endpoint->async), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_async_t*>(handle);
+    });
+    endpoint->async = nullptr;
+    endpoint->onmessage.Reset();
+
+    // The port's functions still point here, so it goes when they do
+    endpoint->port.SetWeak(endpoint, [](const WeakCallbackInfo<Endpoint>& info) {
+        Endpoint *endpoint = info.GetParameter();
+        endpoint->port.Reset();
+        delete endpoint;
+    }, WeakCallbackType::kParameter);
+}
+
+void OnMessages(uv_async_t *handle)
+{
+    auto endpoint = reinterpret_cast<Endpoint*>(handle->data);
+    std::deque<std::unique_ptr<ClonedValue>> inbox;
+    {
+        std::lock_guard<std::mutex> lock(endpoint->link->mutex);
+        inbox.swap(endpoint->link->queued[endpoint->side]);
+    }
+
+    Isolate *isolate = endpoint->env->isolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = endpoint->env->context();
+    Context::Scope context_scope(context);
+
+    for (auto& message : inbox) {
+        // An earlier handler may have closed the port
+        if (!endpoint->async) break;
+
+        Local<Value> value;
+        {
+            TryCatch trycatch(isolate);
+            StructuredClone::Revive(isolate, context, &* message).ToLocal(&value);
+        }
+        if (value.IsEmpty()) continue;
+
+        node::MakeCallback(isolate, endpoint->port.Get(isolate),
+                           endpoint->onmessage.Get(isolate), 1, &value, {0, 0});
+    }
+}
+
+void PostMessage(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    Local<Context> context = isolate->GetCurrentContext();
+    auto endpoint = reinterpret_cast<Endpoint*>(args.Data().As<External>()->Value());
+    if (!endpoint->async) {
+        return Throw(isolate, "Channel is closed");
+    }
+
+    std::unique_ptr<ClonedValue> message = StructuredClone::Clone(isolate, context, args[0],
+        args.Length() > 1 ? args[1] : Local<Value>());
+    if (!message) return;
+
+    Link *link = endpoint->link.get();
+    std::lock_guard<std::mutex> lock(link->mutex);
+    if (link->broken) {
+        args.GetReturnValue().Set(false);
+        return;
+    }
+    const int peer = 1 - endpoint->side;
+    link->queued[peer].push_back(std::move(message));
+    if (link->ends[peer]) {
+        uv_async_send(link->ends[peer]->async);
+    }
+    args.GetReturnValue().Set(true);
+}
+
+void ClosePort(const FunctionCallbackInfo<Value>& args)
+{
+    Close(reinterpret_cast<Endpoint*>(args.Data().As<External>()->Value()));
+}
+
+void OpenChannel(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = node::Environment::GetCurrent(args);
+    Isolate *isolate = args.GetIsolate();
+    Local<Context> context = isolate->GetCurrentContext();
+    if (args.Length() < 2 || !args[0]->IsString() || !args[1]->IsFunction()) {
+        return Throw(isolate, "openChannel(name, onmessage)");
+    }
+    String::Utf8Value name(args[0]);
+
+    auto endpoint = new Endpoint();
+    endpoint->env = env;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        std::shared_ptr<Link>& link = s_links[*name];
+        if (!link) {
+            link = std::make_shared<Link>();
+            link->name = *name;
+        }
+        std::lock_guard<std::mutex> link_lock(link->mutex);
+        if (link->ends[0] && link->ends[1]) {
+            delete endpoint;
+            return Throw(isolate, "Channel already has both of its ends");
+        }
+        endpoint->link = link;
+        endpoint->side = link->ends[0] ? 1 : 0;
+        endpoint->async = new uv_async_t();
+        endpoint->async->data = endpoint;
+        uv_async_init(env->event_loop(), endpoint->async, OnMessages);
+        link->ends[endpoint->side] = endpoint;
+        // Whatever the other end sent before this one opened
+        if (!link->queued[endpoint->side].empty()) {
+            uv_async_send(endpoint->async);
+        }
+        s_endpoints.insert(std::make_pair(env, endpoint));
+    }
+
+    Local<External> data = External::New(isolate, endpoint);
+    Local<Object> port = Object::New(isolate);
+    port->Set(context, String::NewFromUtf8(isolate, "postMessage"),
+              Function::New(context, PostMessage, data).ToLocalChecked());
+    port->Set(context, String::NewFromUtf8(isolate, "close"),
+              Function::New(context, ClosePort, data).ToLocalChecked());
+    endpoint->onmessage.Reset(isolate, args[1].As<Function>());
+    endpoint->port.Reset(isolate, port);
+
+    args.GetReturnValue().Set(port);
+}
+
+} /* namespace */
+
+void ServiceChannel::Install(node::Environment *env)
+{
+    env->SetMethod(env->process_object(), "openChannel", OpenChannel);
+}
+
+void ServiceChannel::CloseAll(node::Environment *env)
+{
+    for (;;) {
+        Endpoint *endpoint = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            auto found = s_endpoints.find(env);
+            if (found == s_endpoints.end()) break;
+            endpoint = found->second;
+        }
+        Close(endpoint);
+    }
+}
+
+} /* namespace nodedroid */
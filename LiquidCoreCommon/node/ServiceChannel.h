@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_SERVICECHANNEL_H
+#define NODEDROID_SERVICECHANNEL_H
+
+#include "node.h"
+#include "env.h"
+
+namespace nodedroid {
+
+/*
+ * Direct channels between node instances in the same process, for services that talk to each
+ * other without going through the host.  In JS:
+ *
+ *   const port = process.openChannel(name, function onmessage(value) { ... });
+ *   port.postMessage(value[, transferList]);
+ *   port.close();
+ *
+ * The first two instances to open a name are its two ends; messages posted before the other
+ * end opens wait for it.  Values are structured-clone serialized and handed straight to the
+ * peer's loop through an async handle of its own.  ArrayBuffers in the transfer list are
+ * moved rather than copied where the engine can detach them (not on iOS, where they are
+ * copied).  An open end keeps its loop alive, like a listening socket, until it is closed.
+ */
+class ServiceChannel {
+public:
+    // Adds process.openChannel().  Must be called on the instance's thread.
+    static void Install(node::Environment *env);
+    // Closes whatever ends |env| still has open.  Must be called on the instance's thread
+    // before its loop is run for the last time.
+    static void CloseAll(node::Environment *env);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_SERVICECHANNEL_H
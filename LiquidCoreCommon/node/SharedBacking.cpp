@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include "SharedBacking.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+// Every live store by its data, so that an externalized buffer can be traced back to its store
+std::mutex s_mutex;
+std::map<void*, SharedBacking*> s_stores;
+
+} /* namespace */
+
+SharedBacking::SharedBacking(void *data, size_t length) :
+    m_data(data), m_length(length), m_count(1)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_stores[data] = this;
+}
+
+SharedBacking::~SharedBacking()
+{
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_stores.erase(m_data);
+    }
+    free(m_data);
+}
+
+SharedBacking *SharedBacking::New(size_t length)
+{
+    void *data = calloc(length ? length : 1, 1);
+    return data ? new SharedBacking(data, length) : nullptr;
+}
+
+SharedBacking *SharedBacking::From(Isolate *isolate, Local<SharedArrayBuffer> buffer)
+{
+    if (buffer->IsExternal()) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        auto found = s_stores.find(buffer->GetContents().Data());
+        if (found == s_stores.end()) return nullptr;
+        // A store on its way out is not brought back
+        SharedBacking *store = found->second;
+        int count = store->m_count.load(std::memory_order_relaxed);
+        do {
+            if (count == 0) return nullptr;
+        } while (!store->m_count.compare_exchange_weak(count, count + 1));
+        return store;
+    }
+
+    SharedArrayBuffer::Contents contents = buffer->Externalize();
+    if (contents.Data() == nullptr && contents.ByteLength() > 0) return nullptr;
+    // A zero-length buffer may have no memory at all, but every store needs a distinct key
+    void *data = contents.Data() ? contents.Data() : calloc(1, 1);
+    // One reference for the caller and one for |buffer|, which no longer frees the memory
+    auto store = new SharedBacking(data, contents.ByteLength());
+    store->Hold(isolate, buffer);
+    return store;
+}
+
+Local<SharedArrayBuffer> SharedBacking::Wrap(Isolate *isolate)
+{
+    EscapableHandleScope scope(isolate);
+    Local<SharedArrayBuffer> buffer = SharedArrayBuffer::New(isolate, m_data, m_length,
+        ArrayBufferCreationMode::kExternalized);
+    Hold(isolate, buffer);
+    return scope.Escape(buffer);
+}
+
+// Adds a reference for |buffer|, let go once it is collected
+void SharedBacking::Hold(Isolate *isolate, Local<SharedArrayBuffer> buffer)
+{
+    Retain();
+    struct Holder {
+        UniquePersistent<SharedArrayBuffer> weak;
+        SharedBacking *store;
+    };
+    auto holder = new Holder();
+    holder->store = this;
+    holder->weak = UniquePersistent<SharedArrayBuffer>(isolate, buffer);
+    holder->weak.SetWeak<Holder>(holder, [](const WeakCallbackInfo<Holder>& info) {
+        Holder *holder = info.GetParameter();
+        holder->weak.Reset();
+        holder->store->Release();
+        delete holder;
+    }, WeakCallbackType::kParameter);
+}
+
+void SharedBacking::Retain()
+{
+    m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SharedBacking::Release()
+{
+    if (m_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+} /* namespace nodedroid */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_SHAREDBACKING_H
+#define NODEDROID_SHAREDBACKING_H
+
+#include <atomic>
+#include <cstddef>
+#include "v8.h"
+
+namespace nodedroid {
+
+/*
+ * Memory that any number of isolates see as a SharedArrayBuffer of their own.  The store is
+ * reference counted: each SharedArrayBuffer over it holds a reference until it is collected,
+ * as does anyone on the host side, and it is freed when the last one goes.  Atomics.wait() and
+ * notify() on it work across isolates and threads.
+ *
+ * Only V8 can externalize a SharedArrayBuffer, so From() always fails on iOS.
+ */
+class SharedBacking {
+public:
+    // |length| zeroed bytes, with one reference held by the caller
+    static SharedBacking *New(size_t length);
+    /*
+     * The store behind |buffer|, with a reference added for the caller.  A buffer that V8
+     * still owns is externalized and taken over.  Returns null for one that was externalized
+     * by someone else.
+     */
+    static SharedBacking *From(v8::Isolate *isolate, v8::Local<v8::SharedArrayBuffer> buffer);
+
+    // A new SharedArrayBuffer over the store in |isolate|
+    v8::Local<v8::SharedArrayBuffer> Wrap(v8::Isolate *isolate);
+
+    void Retain();
+    void Release();
+
+    inline void *Data() const { return m_data; }
+    inline size_t Length() const { return m_length; }
+
+private:
+    SharedBacking(void *data, size_t length);
+    ~SharedBacking();
+    void Hold(v8::Isolate *isolate, v8::Local<v8::SharedArrayBuffer> buffer);
+
+    void *m_data;
+    size_t m_length;
+    std::atomic<int> m_count;
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_SHAREDBACKING_H
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <cstdlib>
+#include "StructuredClone.h"
+#include "SharedBacking.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+class SerializerDelegate : public ValueSerializer::Delegate {
+public:
+    SerializerDelegate(Isolate *isolate, ClonedValue *clone) : m_isolate(isolate), m_clone(clone) {}
+    virtual void ThrowDataCloneError(Local<String> message)
+    {
+        m_isolate->ThrowException(Exception::Error(message));
+    }
+#ifdef __ANDROID__
+    virtual Maybe<uint32_t> GetSharedArrayBufferId(Isolate *isolate,
+                                                   Local<SharedArrayBuffer> buffer)
+    {
+        SharedBacking *store = SharedBacking::From(isolate, buffer);
+        if (!store) {
+            ThrowDataCloneError(String::NewFromUtf8(isolate,
+                "SharedArrayBuffer was externalized elsewhere and can't be shared"));
+            return Nothing<uint32_t>();
+        }
+        for (uint32_t i = 0; i < m_clone->shared.size(); i++) {
+            if (m_clone->shared[i] == store) {
+                store->Release();
+                return Just(i);
+            }
+        }
+        m_clone->shared.push_back(store);
+        return Just((uint32_t) m_clone->shared.size() - 1);
+    }
+#endif
+
+private:
+    Isolate *m_isolate;
+    ClonedValue *m_clone;
+};
+
+void Throw(Isolate *isolate, const char *message)
+{
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, message)));
+}
+
+// Wraps a backing store from another isolate, which is freed once the buffer is collected
+Local<ArrayBuffer> Adopt(Isolate *isolate, void *data, size_t length)
+{
+    struct Adopted {
+        UniquePersistent<ArrayBuffer> weak;
+        void *data;
+    };
+    Local<ArrayBuffer> buffer = ArrayBuffer::New(isolate, data, length,
+                                                 ArrayBufferCreationMode::kExternalized);
+    auto adopted = new Adopted();
+    adopted->data = data;
+    adopted->weak = UniquePersistent<ArrayBuffer>(isolate, buffer);
+    adopted->weak.SetWeak<Adopted>(adopted, [](const WeakCallbackInfo<Adopted>& info) {
+        Adopted *adopted = info.GetParameter();
+        adopted->weak.Reset();
+        free(adopted->data);
+        delete adopted;
+    }, WeakCallbackType::kParameter);
+    return buffer;
+}
+
+} /* namespace */
+
+ClonedValue::~ClonedValue()
+{
+    for (auto& buffer : buffers) free(buffer.first);
+    for (auto store : shared) store->Release();
+}
+
+std::unique_ptr<ClonedValue> StructuredClone::Clone(Isolate *isolate, Local<Context> context,
+                                                    Local<Value> value, Local<Value> transfer)
+{
+    std::vector<Local<ArrayBuffer>> moved;
+    std::unique_ptr<ClonedValue> clone(new ClonedValue());
+    SerializerDelegate delegate(isolate, &* clone);
+    ValueSerializer serializer(isolate, &delegate);
+
+    if (!transfer.IsEmpty() && !transfer->IsUndefined()) {
+        if (!transfer->IsArray()) {
+            Throw(isolate, "Transfer list must be an array");
+            return nullptr;
+        }
+        Local<Array> list = transfer.As<Array>();
+        for (uint32_t i = 0; i < list->Length(); i++) {
+            Local<Value> item;
+            if (!list->Get(context, i).ToLocal(&item)) return nullptr;
+            if (!item->IsArrayBuffer()) {
+                Throw(isolate, "Only ArrayBuffers can be transferred");
+                return nullptr;
+            }
+            Local<ArrayBuffer> buffer = item.As<ArrayBuffer>();
+            // Anything that can't be detached is written out (copied) like any other value
+            if (buffer->IsExternal() || !buffer->IsNeuterable()) continue;
+            serializer.TransferArrayBuffer((uint32_t) moved.size(), buffer);
+            moved.push_back(buffer);
+        }
+    }
+
+    serializer.WriteHeader();
+    if (!serializer.WriteValue(context, value).FromMaybe(false)) return nullptr;
+    std::pair<uint8_t*, size_t> data = serializer.Release();
+    clone->data.assign(data.first, data.first + data.second);
+    free(data.first);
+
+    // Only now that nothing can fail are the buffers taken from the sender.  Their bytes were
+    // counted against the sender's allocator and stay so.
+    for (auto& buffer : moved) {
+        ArrayBuffer::Contents contents = buffer->Externalize();
+        buffer->Neuter();
+        clone->buffers.push_back(std::make_pair(contents.Data(), contents.ByteLength()));
+    }
+    return clone;
+}
+
+MaybeLocal<Value> StructuredClone::Revive(Isolate *isolate, Local<Context> context,
+                                          ClonedValue *clone)
+{
+    ValueDeserializer deserializer(isolate, clone->data.data(), clone->data.size());
+    for (size_t i = 0; i < clone->buffers.size(); i++) {
+        deserializer.TransferArrayBuffer((uint32_t) i, Adopt(isolate,
+            clone->buffers[i].first, clone->buffers[i].second));
+        clone->buffers[i].first = nullptr;
+    }
+    for (size_t i = 0; i < clone->shared.size(); i++) {
+        deserializer.TransferSharedArrayBuffer((uint32_t) i, clone->shared[i]->Wrap(isolate));
+    }
+    if (!deserializer.ReadHeader(context).FromMaybe(false)) {
+        return MaybeLocal<Value>();
+    }
+    return deserializer.ReadValue(context);
+}
+
+} /* namespace nodedroid */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_STRUCTUREDCLONE_H
+#define NODEDROID_STRUCTUREDCLONE_H
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "v8.h"
+
+namespace nodedroid {
+
+/*
+ * A value structured-clone serialized in one isolate, to be revived in another.
+ */
+class SharedBacking;
+
+struct ClonedValue {
+    std::vector<uint8_t> data;
+    // Backing stores moved out of the sender, by transfer id.  Whatever the receiver hasn't
+    // taken is freed with the clone.
+    std::vector<std::pair<void*, size_t>> buffers;
+    // SharedArrayBuffers found in the value, by id, each with a reference held
+    std::vector<SharedBacking*> shared;
+    ~ClonedValue();
+};
+
+class StructuredClone {
+public:
+    /*
+     * Serializes |value|.  |transfer| is undefined or an array of ArrayBuffers, which are
+     * moved rather than copied where the engine can detach them (not on iOS, where they are
+     * copied).  SharedArrayBuffers are never copied: the receiver gets one over the same
+     * memory (Android only; on iOS they can't be cloned).  Returns null, with an exception
+     * thrown, if the value can't be cloned.
+     */
+    static std::unique_ptr<ClonedValue> Clone(v8::Isolate *isolate, v8::Local<v8::Context> context,
+                                              v8::Local<v8::Value> value,
+                                              v8::Local<v8::Value> transfer);
+    /*
+     * The value in |isolate|.  Moved buffers are taken over and freed once collected.  Empty,
+     * with an exception thrown, if the data is bad.
+     */
+    static v8::MaybeLocal<v8::Value> Revive(v8::Isolate *isolate, v8::Local<v8::Context> context,
+                                            ClonedValue *clone);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_STRUCTUREDCLONE_H
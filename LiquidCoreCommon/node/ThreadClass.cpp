@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include "ThreadClass.h"
+
+#ifdef __ANDROID__
+#include <cstdio>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#else
+#include <pthread.h>
+#include <pthread/qos.h>
+#endif
+
+namespace nodedroid {
+
+namespace {
+
+std::shared_timed_mutex s_loops_mutex;
+std::map<uv_loop_t*, ThreadClass> s_loops;
+
+#ifdef __ANDROID__
+
+const int kNice[] = { 0, -4, 5, 10 };
+
+struct CoreSets {
+    cpu_set_t all;
+    cpu_set_t little;
+    bool has_little;
+};
+
+// Little cores are the ones with the lowest top frequency.  A device whose cores are all the
+// same has none.
+const CoreSets& Cores()
+{
+    static CoreSets s_cores;
+    static std::once_flag s_once;
+    std::call_once(s_once, []() {
+        CPU_ZERO(&s_cores.all);
+        CPU_ZERO(&s_cores.little);
+        s_cores.has_little = false;
+        const long count = sysconf(_SC_NPROCESSORS_CONF);
+        std::map<int, long> max_freq;
+        long lowest = 0, highest = 0;
+        for (int cpu = 0; cpu < count && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &s_cores.all);
+            char path[80];
+            snprintf(path, sizeof path,
+                     "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+            FILE *file = fopen(path, "re");
+            if (!file) continue;
+            long freq = 0;
+            if (fscanf(file, "%ld", &freq) == 1 && freq > 0) {
+                max_freq[cpu] = freq;
+                if (!lowest || freq < lowest) lowest = freq;
+                if (freq > highest) highest = freq;
+            }
+            fclose(file);
+        }
+        if (lowest && lowest < highest) {
+            for (auto& cpu : max_freq) {
+                if (cpu.second == lowest) CPU_SET(cpu.first, &s_cores.little);
+            }
+            s_cores.has_little = true;
+        }
+    });
+    return s_cores;
+}
+
+#else
+
+const qos_class_t kQoS[] = {
+    QOS_CLASS_DEFAULT, QOS_CLASS_USER_INTERACTIVE, QOS_CLASS_UTILITY, QOS_CLASS_BACKGROUND
+};
+
+#endif
+
+} /* namespace */
+
+void ApplyThreadClass(ThreadClass thread_class)
+{
+    if (thread_class < kThreadDefault || thread_class > kThreadBackground) return;
+#ifdef __ANDROID__
+    const auto tid = (pid_t) syscall(SYS_gettid);
+    setpriority(PRIO_PROCESS, (id_t) tid, kNice[thread_class]);
+    const CoreSets& cores = Cores();
+    if (cores.has_little) {
+        const cpu_set_t& mask = thread_class == kThreadBackground ? cores.little : cores.all;
+        sched_setaffinity(tid, sizeof mask, &mask);
+    }
+#else
+    pthread_set_qos_class_self_np(kQoS[thread_class], 0);
+#endif
+}
+
+void SetLoopThreadClass(uv_loop_t *loop, ThreadClass thread_class)
+{
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(s_loops_mutex);
+        if (thread_class == kThreadDefault) {
+            s_loops.erase(loop);
+        } else {
+            s_loops[loop] = thread_class;
+        }
+    }
+#ifdef __APPLE__
+    // Only the libuv built with the framework has work priorities; Android's prebuilt
+    // libnode.so queues everything first come, first served
+    uv_loop_set_work_priority(loop, thread_class == kThreadInteractive ? 1 :
+                                    thread_class == kThreadBackground ? -1 : 0);
+#endif
+}
+
+ThreadClass LoopThreadClass(uv_loop_t *loop)
+{
+    std::shared_lock<std::shared_timed_mutex> lock(s_loops_mutex);
+    auto found = s_loops.find(loop);
+    return found == s_loops.end() ? kThreadDefault : found->second;
+}
+
+} /* namespace nodedroid */
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_THREADCLASS_H
+#define NODEDROID_THREADCLASS_H
+
+#include "uv.h"
+
+namespace nodedroid {
+
+/*
+ * Scheduling hints for the threads a service runs on.  On iOS each maps to a QoS class
+ * (user-interactive, utility, background).  On Android each is a nice value (-4, 5, 10),
+ * and kBackground also keeps the thread to the slowest cores on a big.LITTLE device; the
+ * others may run anywhere.  kDefault puts a thread back the way it started.
+ */
+enum ThreadClass {
+    kThreadDefault = 0,
+    kThreadInteractive = 1,
+    kThreadUtility = 2,
+    kThreadBackground = 3
+};
+
+// Applies |thread_class| to the calling thread.  Failure (say, to raise priority where the
+// app isn't allowed to) is ignored.
+void ApplyThreadClass(ThreadClass thread_class);
+
+// The class of the instance that owns |loop|, so that work queued from it to other threads
+// can be run the same way.  kThreadDefault for a loop nobody has set.  Also sets the loop's
+// priority in libuv's pool: an interactive instance's requests go ahead of the others', and
+// a background instance only ever has half of the pool's threads.
+void SetLoopThreadClass(uv_loop_t *loop, ThreadClass thread_class);
+ThreadClass LoopThreadClass(uv_loop_t *loop);
+
+// For work one instance queues to libuv's shared pool: runs the pool thread in the class of
+// |loop|'s instance for the life of the scope, and puts it back afterwards.
+class ScopedLoopThreadClass {
+public:
+    explicit ScopedLoopThreadClass(uv_loop_t *loop) : m_class(LoopThreadClass(loop))
+    {
+        if (m_class != kThreadDefault) ApplyThreadClass(m_class);
+    }
+    ~ScopedLoopThreadClass()
+    {
+        if (m_class != kThreadDefault) ApplyThreadClass(kThreadDefault);
+    }
+private:
+    const ThreadClass m_class;
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_THREADCLASS_H
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <mutex>
+#ifdef __ANDROID__
+# include <dlfcn.h>
+#elif defined(__APPLE__)
+# include <os/log.h>
+# include <os/signpost.h>
+#endif
+#include "TraceSpan.h"
+
+using namespace nodedroid;
+
+std::atomic<bool> TraceSpan::s_enabled(false);
+
+namespace {
+
+#ifdef __ANDROID__
+// The NDK only links these from API 23, and we support older devices, so find them at runtime
+typedef void (*ATraceBeginSection)(const char *name);
+typedef void (*ATraceEndSection)();
+ATraceBeginSection s_begin_section = nullptr;
+ATraceEndSection s_end_section = nullptr;
+#elif defined(__APPLE__)
+os_log_t s_log = nullptr;
+#endif
+
+bool LoadTracer()
+{
+    static std::once_flag once;
+    static bool loaded = false;
+    std::call_once(once, []() {
+#ifdef __ANDROID__
+        void *lib = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+        if (lib) {
+            s_begin_section = (ATraceBeginSection) dlsym(lib, "ATrace_beginSection");
+            s_end_section = (ATraceEndSection) dlsym(lib, "ATrace_endSection");
+        }
+        loaded = s_begin_section && s_end_section;
+#elif defined(__APPLE__)
+        if (__builtin_available(iOS 12.0, macOS 10.14, *)) {
+            s_log = os_log_create("org.liquidplayer.LiquidCore", "bridge");
+        }
+        loaded = s_log != nullptr;
+#endif
+    });
+    return loaded;
+}
+
+} /* namespace */
+
+void TraceSpan::SetEnabled(bool enabled)
+{
+    s_enabled = enabled && LoadTracer();
+}
+
+void TraceSpan::Begin(const char *name)
+{
+    m_name = name;
+#ifdef __ANDROID__
+    s_begin_section(name);
+#elif defined(__APPLE__)
+    if (__builtin_available(iOS 12.0, macOS 10.14, *)) {
+        os_signpost_id_t id = os_signpost_id_generate(s_log);
+        m_id = id;
+        os_signpost_interval_begin(s_log, id, "LiquidCore", "%{public}s", name);
+    }
+#endif
+}
+
+void TraceSpan::End()
+{
+#ifdef __ANDROID__
+    s_end_section();
+#elif defined(__APPLE__)
+    if (__builtin_available(iOS 12.0, macOS 10.14, *)) {
+        os_signpost_interval_end(s_log, (os_signpost_id_t) m_id, "LiquidCore", "%{public}s", m_name);
+    }
+#endif
+}
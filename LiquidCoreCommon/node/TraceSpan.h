@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_TRACESPAN_H
+#define NODEDROID_TRACESPAN_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace nodedroid {
+
+/*
+ * Marks a stretch of work for the platform's system tracer: ATrace sections on Android, which
+ * show up in Perfetto and systrace, and signpost intervals on Apple platforms, which show up in
+ * Instruments.  Spans nest and must begin and end on the same thread.
+ *
+ * Tracing is off unless turned on at runtime.  While it is off a span costs one relaxed load.
+ * Names must outlive the span; string literals are what is expected.
+ */
+class TraceSpan {
+public:
+    explicit inline TraceSpan(const char *name) : m_name(nullptr), m_id(0)
+    {
+        if (s_enabled.load(std::memory_order_relaxed)) Begin(name);
+    }
+    inline ~TraceSpan()
+    {
+        // A span that began while tracing was on always ends, or the tracer loses its nesting
+        if (m_name) End();
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    // Stays off if the platform has no tracer we can use
+    static void SetEnabled(bool enabled);
+    static inline bool Enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+private:
+    void Begin(const char *name);
+    void End();
+
+    const char *m_name;
+    uint64_t m_id;
+    static std::atomic<bool> s_enabled;
+};
+
+} /* namespace nodedroid */
+
+#define TRACE_SPAN_CONCAT_(a,b) a##b
+#define TRACE_SPAN_CONCAT(a,b) TRACE_SPAN_CONCAT_(a,b)
+#define TRACE_SPAN(name) nodedroid::TraceSpan TRACE_SPAN_CONCAT(trace_span_, __LINE__)(name)
+
+#endif //NODEDROID_TRACESPAN_H
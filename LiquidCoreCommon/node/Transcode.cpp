@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <cstring>
+#include "Transcode.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define TRANSCODE_NEON 1
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+# define TRANSCODE_SSE2 1
+#endif
+
+namespace nodedroid {
+
+namespace {
+
+const uint64_t kHighBits8  = 0x8080808080808080ULL;
+const uint64_t kHighBits16 = 0xff80ff80ff80ff80ULL;
+const uint32_t kReplacement = 0xFFFD;
+
+inline bool IsHighSurrogate(uint32_t c) { return (c & 0xFC00) == 0xD800; }
+inline bool IsLowSurrogate(uint32_t c)  { return (c & 0xFC00) == 0xDC00; }
+
+// ASCII bytes to units.  |utf8| is known to be ASCII throughout.
+void Widen(const char *utf8, size_t length, uint16_t *out)
+{
+    const uint8_t *in = reinterpret_cast<const uint8_t*>(utf8);
+    size_t i = 0;
+#if TRANSCODE_NEON
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t v = vld1q_u8(in + i);
+        vst1q_u16(out + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(out + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+#elif TRANSCODE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#endif
+    for (; i < length; i++) {
+        out[i] = in[i];
+    }
+}
+
+// And back.  |utf16| is known to be ASCII throughout.
+void Narrow(const uint16_t *utf16, size_t length, char *out)
+{
+    uint8_t *o = reinterpret_cast<uint8_t*>(out);
+    size_t i = 0;
+#if TRANSCODE_NEON
+    for (; i + 16 <= length; i += 16) {
+        vst1q_u8(o + i, vcombine_u8(vmovn_u16(vld1q_u16(utf16 + i)),
+                                    vmovn_u16(vld1q_u16(utf16 + i + 8))));
+    }
+#elif TRANSCODE_SSE2
+    for (; i + 16 <= length; i += 16) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16 + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16 + i + 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < length; i++) {
+        o[i] = static_cast<uint8_t>(utf16[i]);
+    }
+}
+
+// One character off the front of |s|, which isn't empty.  Returns the bytes it took; an
+// ill-formed sequence takes its maximal subpart and decodes as U+FFFD.
+size_t DecodeOne(const uint8_t *s, size_t length, uint32_t *cp)
+{
+    const uint8_t lead = s[0];
+    size_t trail;
+    uint32_t c;
+    uint8_t lo = 0x80, hi = 0xBF;
+    if (lead < 0x80) {
+        *cp = lead;
+        return 1;
+    } else if (lead >= 0xC2 && lead <= 0xDF) {
+        trail = 1;
+        c = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        trail = 2;
+        c = lead & 0x0F;
+        // No overlongs, and no surrogates
+        if (lead == 0xE0) lo = 0xA0;
+        else if (lead == 0xED) hi = 0x9F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        trail = 3;
+        c = lead & 0x07;
+        // No overlongs, and nothing past U+10FFFF
+        if (lead == 0xF0) lo = 0x90;
+        else if (lead == 0xF4) hi = 0x8F;
+    } else {
+        *cp = kReplacement;
+        return 1;
+    }
+
+    size_t i = 1;
+    for (; i <= trail; i++) {
+        if (i >= length || s[i] < lo || s[i] > hi) {
+            *cp = kReplacement;
+            return i;
+        }
+        c = (c << 6) | (s[i] & 0x3F);
+        lo = 0x80;
+        hi = 0xBF;
+    }
+    *cp = c;
+    return i;
+}
+
+// One character off the front of |s|, which isn't empty.  Returns the units it took.
+inline size_t NextCodePoint(const uint16_t *s, size_t length, uint32_t *cp)
+{
+    const uint32_t c = s[0];
+    if (IsHighSurrogate(c) && length > 1 && IsLowSurrogate(s[1])) {
+        *cp = 0x10000 + ((c - 0xD800) << 10) + (s[1] - 0xDC00);
+        return 2;
+    }
+    *cp = (IsHighSurrogate(c) || IsLowSurrogate(c)) ? kReplacement : c;
+    return 1;
+}
+
+inline size_t Utf8Bytes(uint32_t c)
+{
+    return c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+}
+
+} /* namespace */
+
+size_t Transcode::AsciiPrefix(const char *utf8, size_t length)
+{
+    const uint8_t *in = reinterpret_cast<const uint8_t*>(utf8);
+    size_t i = 0;
+#if TRANSCODE_NEON
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t v = vld1q_u8(in + i);
+        uint8x8_t folded = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+        if (vget_lane_u64(vreinterpret_u64_u8(folded), 0) & kHighBits8) break;
+    }
+#elif TRANSCODE_SSE2
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        if (_mm_movemask_epi8(v)) break;
+    }
+#endif
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, in + i, sizeof word);
+        if (word & kHighBits8) break;
+    }
+    for (; i < length && in[i] < 0x80; i++);
+    return i;
+}
+
+size_t Transcode::AsciiPrefix(const uint16_t *utf16, size_t length)
+{
+    size_t i = 0;
+#if TRANSCODE_NEON
+    for (; i + 8 <= length; i += 8) {
+        uint16x8_t v = vld1q_u16(utf16 + i);
+        uint16x4_t folded = vorr_u16(vget_low_u16(v), vget_high_u16(v));
+        if (vget_lane_u64(vreinterpret_u64_u16(folded), 0) & kHighBits16) break;
+    }
+#elif TRANSCODE_SSE2
+    const __m128i mask = _mm_set1_epi16(static_cast<short>(0xff80));
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= length; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(utf16 + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, mask), zero)) != 0xFFFF) break;
+    }
+#endif
+    for (; i + 4 <= length; i += 4) {
+        uint64_t word;
+        memcpy(&word, utf16 + i, sizeof word);
+        if (word & kHighBits16) break;
+    }
+    for (; i < length && utf16[i] < 0x80; i++);
+    return i;
+}
+
+size_t Transcode::Utf16Length(const char *utf8, size_t length)
+{
+    const uint8_t *in = reinterpret_cast<const uint8_t*>(utf8);
+    size_t i = 0, units = 0;
+    while (i < length) {
+        const size_t run = AsciiPrefix(utf8 + i, length - i);
+        i += run;
+        units += run;
+        if (i == length) break;
+
+        uint32_t c;
+        i += DecodeOne(in + i, length - i, &c);
+        units += c >= 0x10000 ? 2 : 1;
+    }
+    return units;
+}
+
+size_t Transcode::Utf8ToUtf16(const char *utf8, size_t length, uint16_t *out)
+{
+    const uint8_t *in = reinterpret_cast<const uint8_t*>(utf8);
+    size_t i = 0, o = 0;
+    while (i < length) {
+        const size_t run = AsciiPrefix(utf8 + i, length - i);
+        Widen(utf8 + i, run, out + o);
+        i += run;
+        o += run;
+        if (i == length) break;
+
+        uint32_t c;
+        i += DecodeOne(in + i, length - i, &c);
+        if (c >= 0x10000) {
+            c -= 0x10000;
+            out[o++] = static_cast<uint16_t>(0xD800 + (c >> 10));
+            out[o++] = static_cast<uint16_t>(0xDC00 + (c & 0x3FF));
+        } else {
+            out[o++] = static_cast<uint16_t>(c);
+        }
+    }
+    return o;
+}
+
+size_t Transcode::Utf8Length(const uint16_t *utf16, size_t length)
+{
+    size_t i = 0, bytes = 0;
+    while (i < length) {
+        const size_t run = AsciiPrefix(utf16 + i, length - i);
+        i += run;
+        bytes += run;
+        if (i == length) break;
+
+        uint32_t c;
+        i += NextCodePoint(utf16 + i, length - i, &c);
+        bytes += Utf8Bytes(c);
+    }
+    return bytes;
+}
+
+size_t Transcode::Utf16ToUtf8(const uint16_t *utf16, size_t length, char *out,
+                              size_t capacity, size_t *read)
+{
+    uint8_t *o8 = reinterpret_cast<uint8_t*>(out);
+    size_t i = 0, o = 0;
+    while (i < length && o < capacity) {
+        size_t run = AsciiPrefix(utf16 + i, length - i);
+        if (run > capacity - o) run = capacity - o;
+        Narrow(utf16 + i, run, out + o);
+        i += run;
+        o += run;
+        if (i == length || o == capacity) break;
+
+        uint32_t c;
+        const size_t units = NextCodePoint(utf16 + i, length - i, &c);
+        const size_t bytes = Utf8Bytes(c);
+        if (o + bytes > capacity) break;
+        switch (bytes) {
+            case 2:
+                o8[o++] = static_cast<uint8_t>(0xC0 | (c >> 6));
+                break;
+            case 3:
+                o8[o++] = static_cast<uint8_t>(0xE0 | (c >> 12));
+                o8[o++] = static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3F));
+                break;
+            default:
+                o8[o++] = static_cast<uint8_t>(0xF0 | (c >> 18));
+                o8[o++] = static_cast<uint8_t>(0x80 | ((c >> 12) & 0x3F));
+                o8[o++] = static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3F));
+                break;
+        }
+        o8[o++] = static_cast<uint8_t>(0x80 | (c & 0x3F));
+        i += units;
+    }
+    if (read) *read = i;
+    return o;
+}
+
+} /* namespace nodedroid */
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_TRANSCODE_H
+#define NODEDROID_TRANSCODE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nodedroid {
+
+/*
+ * UTF-8 to and from UTF-16, for the string bridges on both platforms.  Runs of ASCII, which
+ * is most of what crosses, are found and copied 16 bytes at a time with NEON (or SSE2 on the
+ * x86 emulator ABIs); everything else is decoded a character at a time.
+ *
+ * Decoding validates: an ill-formed sequence becomes one U+FFFD per maximal subpart, as
+ * Unicode (and V8) have it, instead of throwing or reading past the end.  Encoding likewise
+ * writes an unpaired surrogate as U+FFFD.  Latin-1 held in 16-bit units is just UTF-16 that
+ * happens to stay below 0x100, and needs nothing of its own.
+ */
+class Transcode {
+public:
+    // How many of the leading bytes / units are ASCII
+    static size_t AsciiPrefix(const char *utf8, size_t length);
+    static size_t AsciiPrefix(const uint16_t *utf16, size_t length);
+
+    // The UTF-16 units |utf8| decodes to.  Never more than |length|.
+    static size_t Utf16Length(const char *utf8, size_t length);
+    // Decodes into |out|, which must have room for Utf16Length() (or just |length|) units.
+    // Returns the units written.
+    static size_t Utf8ToUtf16(const char *utf8, size_t length, uint16_t *out);
+
+    // The UTF-8 bytes |utf16| encodes to
+    static size_t Utf8Length(const uint16_t *utf16, size_t length);
+    // Encodes as much as fits in |capacity| bytes, never splitting a character.  Returns the
+    // bytes written, and the units they came from in |read|.  No terminator is added.
+    static size_t Utf16ToUtf8(const uint16_t *utf16, size_t length, char *out,
+                              size_t capacity, size_t *read = nullptr);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_TRANSCODE_H
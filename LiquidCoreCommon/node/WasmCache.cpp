@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include "WasmCache.h"
+
+#ifdef __ANDROID__
+
+#include <fcntl.h>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "env-inl.h"
+#include "nodedroid_file.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+const char kCacheName[] = ".wasm-cache";
+
+// Entries begin with the wire bytes' length and a second hash of them, which must match
+struct Header {
+    uint64_t length;
+    uint64_t check;
+};
+
+// The environment each isolate's cache belongs to.  Isolates are recycled, so the module
+// callback stays set and simply finds nothing here once its environment is gone.
+std::mutex s_mutex;
+std::map<Isolate*, node::Environment*> s_envs;
+
+node::Environment* EnvFor(Isolate *isolate)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_envs.find(isolate);
+    return found == s_envs.end() ? nullptr : found->second;
+}
+
+uint64_t Hash(const uint8_t *bytes, size_t length, uint64_t seed, uint64_t prime)
+{
+    uint64_t hash = seed;
+    for (size_t i=0; i<length; i++) {
+        hash = (hash ^ bytes[i]) * prime;
+    }
+    return hash;
+}
+
+uint64_t Key(const uint8_t *bytes, size_t length)
+{
+    const char *version = V8::GetVersion();
+    uint64_t hash = Hash(reinterpret_cast<const uint8_t*>(version), strlen(version),
+                         14695981039346656037ULL, 1099511628211ULL);
+    return Hash(bytes, length, hash, 1099511628211ULL);
+}
+
+uint64_t Check(const uint8_t *bytes, size_t length)
+{
+    return Hash(bytes, length, 14695981039346656037ULL ^ length, 0x9e3779b97f4a7c15ULL);
+}
+
+// The bytes of an ArrayBuffer or view, as WebAssembly.Module() takes them
+bool WireBytes(Local<Value> source, const uint8_t **bytes, size_t *length)
+{
+    if (source->IsArrayBuffer()) {
+        ArrayBuffer::Contents contents = source.As<ArrayBuffer>()->GetContents();
+        *bytes = static_cast<const uint8_t*>(contents.Data());
+        *length = contents.ByteLength();
+        return true;
+    }
+    if (source->IsArrayBufferView()) {
+        Local<ArrayBufferView> view = source.As<ArrayBufferView>();
+        ArrayBuffer::Contents contents = view->Buffer()->GetContents();
+        *bytes = static_cast<const uint8_t*>(contents.Data()) + view->ByteOffset();
+        *length = view->ByteLength();
+        return true;
+    }
+    return false;
+}
+
+bool Entry(node::Environment *env, const uint8_t *bytes, size_t length, std::string *dir,
+           std::string *entry)
+{
+    if (!CacheDir(env, kCacheName, dir)) return false;
+    char name[24];
+    snprintf(name, sizeof name, "/%016llx",
+             static_cast<unsigned long long>(Key(bytes, length)));
+    entry->assign(*dir).append(name);
+    return true;
+}
+
+bool Read(uv_loop_t *loop, const std::string& entry, std::vector<uint8_t> *data)
+{
+    uv_fs_t req;
+    const int fd = uv_fs_open(loop, &req, entry.c_str(), O_RDONLY, 0, nullptr);
+    uv_fs_req_cleanup(&req);
+    if (fd < 0) return false;
+
+    const int err = uv_fs_fstat(loop, &req, fd, nullptr);
+    data->resize(err == 0 ? static_cast<size_t>(req.statbuf.st_size) : 0);
+    uv_fs_req_cleanup(&req);
+
+    size_t offset = 0;
+    while (offset < data->size()) {
+        uv_buf_t buf = uv_buf_init(reinterpret_cast<char*>(&(*data)[offset]),
+                                   static_cast<unsigned int>(data->size() - offset));
+        const ssize_t read = uv_fs_read(loop, &req, fd, &buf, 1, offset, nullptr);
+        uv_fs_req_cleanup(&req);
+        if (read <= 0) break;
+        offset += read;
+    }
+    uv_fs_close(loop, &req, fd, nullptr);
+    uv_fs_req_cleanup(&req);
+    return offset == data->size() && offset > sizeof(Header);
+}
+
+// Failure is silent; it only costs a recompile next time
+void Store(node::Environment *env, Local<WasmCompiledModule> module)
+{
+    uv_loop_t *loop = env->event_loop();
+    // The wire bytes come back as a one-byte string
+    Local<String> wire = module->GetWasmWireBytes();
+    std::vector<uint8_t> wire_bytes(static_cast<size_t>(wire->Length()));
+    wire->WriteOneByte(wire_bytes.data(), 0, wire->Length(), String::NO_NULL_TERMINATION);
+    const uint8_t *bytes = wire_bytes.data();
+    const size_t length = wire_bytes.size();
+
+    std::string dir, entry;
+    if (!Entry(env, bytes, length, &dir, &entry)) return;
+
+    WasmCompiledModule::SerializedModule serialized = module->Serialize();
+    if (!serialized.first || !serialized.second) return;
+    Header header = { length, Check(bytes, length) };
+
+    uv_fs_t req;
+    uv_fs_mkdir(loop, &req, dir.c_str(), 0700, nullptr);
+    uv_fs_req_cleanup(&req);
+
+    // Write to the side and rename, so that a reader never sees a partial entry
+    const std::string temp = entry + ".tmp";
+    const int fd = uv_fs_open(loop, &req, temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600,
+                              nullptr);
+    uv_fs_req_cleanup(&req);
+    if (fd < 0) return;
+
+    uv_buf_t bufs[2] = {
+        uv_buf_init(reinterpret_cast<char*>(&header), sizeof header),
+        uv_buf_init(const_cast<char*>(reinterpret_cast<const char*>(serialized.first.get())),
+                    static_cast<unsigned int>(serialized.second))
+    };
+    const ssize_t written = uv_fs_write(loop, &req, fd, bufs, 2, 0, nullptr);
+    uv_fs_req_cleanup(&req);
+    uv_fs_close(loop, &req, fd, nullptr);
+    uv_fs_req_cleanup(&req);
+
+    if (written == static_cast<ssize_t>(sizeof header + serialized.second)) {
+        uv_fs_rename(loop, &req, temp.c_str(), entry.c_str(), nullptr);
+    } else {
+        uv_fs_unlink(loop, &req, temp.c_str(), nullptr);
+    }
+    uv_fs_req_cleanup(&req);
+}
+
+// The module for |bytes|, from the cache if it has a usable entry and compiled (and stored)
+// otherwise.  With |compile| false a miss is left to the caller.
+MaybeLocal<WasmCompiledModule> Load(node::Environment *env, const uint8_t *bytes,
+                                    size_t length, bool compile)
+{
+    Isolate *isolate = env->isolate();
+    std::string dir, entry;
+    std::vector<uint8_t> data;
+    bool hit = Entry(env, bytes, length, &dir, &entry) &&
+        Read(env->event_loop(), entry, &data);
+    if (hit) {
+        Header header;
+        memcpy(&header, data.data(), sizeof header);
+        hit = header.length == length && header.check == Check(bytes, length);
+    }
+    if (!hit && !compile) return MaybeLocal<WasmCompiledModule>();
+
+    // V8 falls back to compiling the wire bytes if it won't take the entry
+    const WasmCompiledModule::CallerOwnedBuffer serialized = hit ?
+        WasmCompiledModule::CallerOwnedBuffer(data.data() + sizeof(Header),
+                                              data.size() - sizeof(Header)) :
+        WasmCompiledModule::CallerOwnedBuffer(nullptr, 0);
+    MaybeLocal<WasmCompiledModule> module = WasmCompiledModule::DeserializeOrCompile(isolate,
+        serialized, WasmCompiledModule::CallerOwnedBuffer(bytes, length));
+    if (!hit && !module.IsEmpty()) {
+        Store(env, module.ToLocalChecked());
+    }
+    return module;
+}
+
+// new WebAssembly.Module(bytes)
+bool ModuleCallback(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = EnvFor(args.GetIsolate());
+    const uint8_t *bytes;
+    size_t length;
+    if (!env || !args.IsConstructCall() || !WireBytes(args[0], &bytes, &length)) return false;
+
+    Local<WasmCompiledModule> module;
+    if (Load(env, bytes, length, true).ToLocal(&module)) {
+        args.GetReturnValue().Set(module);
+    }
+    // Compile errors are thrown just as V8 would have
+    return true;
+}
+
+// lookup(bytes): the cached module, or undefined to have the caller compile it
+void Lookup(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = EnvFor(args.GetIsolate());
+    const uint8_t *bytes;
+    size_t length;
+    if (!env || !WireBytes(args[0], &bytes, &length)) return;
+
+    Local<WasmCompiledModule> module;
+    if (Load(env, bytes, length, false).ToLocal(&module)) {
+        args.GetReturnValue().Set(module);
+    }
+}
+
+// store(module)
+void StoreModule(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = EnvFor(args.GetIsolate());
+    if (env && args[0]->IsWebAssemblyCompiledModule()) {
+        Store(env, args[0].As<WasmCompiledModule>());
+    }
+}
+
+// The async entry points have no hook of their own, so they are wrapped.  A hit resolves
+// without compiling; a miss compiles as before, off the thread, and stores the result.
+const char kWrapper[] =
+    "(function(WebAssembly, lookup, store) {\n"
+    "  const compile = WebAssembly.compile;\n"
+    "  const instantiate = WebAssembly.instantiate;\n"
+    "  const Module = WebAssembly.Module;\n"
+    "  WebAssembly.compile = function(bytes) {\n"
+    "    let module;\n"
+    "    try { module = lookup(bytes); } catch (e) { return Promise.reject(e); }\n"
+    "    if (module) return Promise.resolve(module);\n"
+    "    return compile.call(WebAssembly, bytes).then(function(module) {\n"
+    "      store(module);\n"
+    "      return module;\n"
+    "    });\n"
+    "  };\n"
+    "  WebAssembly.instantiate = function(source, imports) {\n"
+    "    if (source instanceof Module) {\n"
+    "      return instantiate.call(WebAssembly, source, imports);\n"
+    "    }\n"
+    "    return WebAssembly.compile(source).then(function(module) {\n"
+    "      return instantiate.call(WebAssembly, module, imports).then(function(instance) {\n"
+    "        return { module: module, instance: instance };\n"
+    "      });\n"
+    "    });\n"
+    "  };\n"
+    "})";
+
+} /* namespace */
+
+void WasmCache::Install(node::Environment *env)
+{
+    Isolate *isolate = env->isolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = env->context();
+
+    Local<Value> wasm;
+    if (!context->Global()->Get(context, String::NewFromUtf8(isolate, "WebAssembly"))
+            .ToLocal(&wasm) || !wasm->IsObject()) {
+        // Not exposed in this configuration
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_envs[isolate] = env;
+    }
+    isolate->SetWasmModuleCallback(ModuleCallback);
+
+    TryCatch trycatch(isolate);
+    Local<Script> script;
+    Local<Value> wrapper;
+    if (Script::Compile(context, String::NewFromUtf8(isolate, kWrapper)).ToLocal(&script) &&
+        script->Run(context).ToLocal(&wrapper) && wrapper->IsFunction()) {
+        Local<Value> argv[] = {
+            wasm,
+            Function::New(context, Lookup).ToLocalChecked(),
+            Function::New(context, StoreModule).ToLocalChecked()
+        };
+        wrapper.As<Function>()->Call(context, Undefined(isolate), 3, argv);
+    }
+}
+
+void WasmCache::Remove(node::Environment *env)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto found = s_envs.find(env->isolate());
+    if (found != s_envs.end() && found->second == env) {
+        s_envs.erase(found);
+    }
+}
+
+} /* namespace nodedroid */
+
+#else
+
+namespace nodedroid {
+
+void WasmCache::Install(node::Environment *env) {}
+void WasmCache::Remove(node::Environment *env) {}
+
+} /* namespace nodedroid */
+
+#endif
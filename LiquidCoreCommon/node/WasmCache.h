@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_WASMCACHE_H
+#define NODEDROID_WASMCACHE_H
+
+#include "node.h"
+#include "env.h"
+
+namespace nodedroid {
+
+/*
+ * Keeps compiled WebAssembly modules under the sandbox's /home/cache/.wasm-cache (or under the
+ * shared code cache directory, if one is set), so that a module is only compiled the first
+ * time a service loads it.  new WebAssembly.Module(), WebAssembly.compile() and
+ * WebAssembly.instantiate() from bytes all look there first, and store what they compile.
+ *
+ * Entries are keyed on a hash of the wire bytes and on the V8 version, and checked against a
+ * second hash when read, since V8 doesn't verify the bytes a serialized module came from.  An
+ * entry V8 won't take (other flags, say) just means compiling from the bytes as before.
+ * Android only; the iOS engine has no module serialization, and this does nothing there.
+ */
+class WasmCache {
+public:
+    // Wraps the WebAssembly entry points.  Must be called on the instance's thread.
+    static void Install(node::Environment *env);
+    // Stops using |env|'s cache.  Must be called on the instance's thread before the
+    // environment goes away.
+    static void Remove(node::Environment *env);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_WASMCACHE_H
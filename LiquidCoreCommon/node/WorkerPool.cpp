@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "env-inl.h"
+#include "WorkerPool.h"
+#include "StructuredClone.h"
+
+using namespace v8;
+
+namespace nodedroid {
+
+namespace {
+
+struct ParentEnd;
+
+// An error from the worker, or a message if |value| is set
+struct Posted {
+    std::unique_ptr<ClonedValue> value;
+    std::string error;
+};
+
+// Shared between the creator and the worker's thread.  Everything but the immutable start-up
+// data is guarded by |mutex|.
+struct Worker {
+    std::string source;
+    WorkerPool::Limits limits;
+
+    std::mutex mutex;
+    bool terminated = false;
+    std::deque<std::unique_ptr<ClonedValue>> to_worker;
+    std::deque<Posted> to_parent;
+    uv_async_t *parent_async = nullptr;  // null once the creator lets go
+    uv_async_t *worker_async = nullptr;  // set while the worker's loop runs
+    Isolate *isolate = nullptr;          // ditto
+};
+
+// The creator's side, only ever touched on the creator's thread
+struct ParentEnd {
+    node::Environment *env;
+    std::shared_ptr<Worker> worker;
+    Persistent<Object> object;
+    Persistent<Function> onmessage;
+    bool closed = false;
+};
+
+std::mutex s_mutex;
+std::multimap<node::Environment*, ParentEnd*> s_parents;
+std::map<node::Environment*, WorkerPool::Limits> s_limits;
+std::deque<std::shared_ptr<Worker>> s_pending;
+size_t s_running = 0;
+
+size_t PoolSize()
+{
+    return std::max(2u, std::thread::hardware_concurrency());
+}
+
+void Throw(Isolate *isolate, const char *message)
+{
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate, message)));
+}
+
+std::string Describe(const TryCatch& trycatch)
+{
+    if (trycatch.Exception().IsEmpty()) return "Worker terminated";
+    String::Utf8Value message(trycatch.Exception());
+    return *message ? *message : "Unknown error";
+}
+
+// To the parent's console, so that it goes wherever the instance's logging does
+void ReportUncaught(Isolate *isolate, Local<Context> context, const std::string& error)
+{
+    TryCatch trycatch(isolate);
+    Local<Value> console, method;
+    if (!context->Global()->Get(context, String::NewFromUtf8(isolate, "console"))
+            .ToLocal(&console) || !console->IsObject() ||
+        !console.As<Object>()->Get(context, String::NewFromUtf8(isolate, "error"))
+            .ToLocal(&method) || !method->IsFunction()) {
+        return;
+    }
+    Local<Value> args[] = {
+        String::NewFromUtf8(isolate, "Uncaught error in worker:"),
+        String::NewFromUtf8(isolate, error.c_str())
+    };
+    method.As<Function>()->Call(context, console, 2, args).IsEmpty();
+}
+
+void PostToParent(const std::shared_ptr<Worker>& worker, Posted&& posted)
+{
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (!worker->parent_async) return;
+    worker->to_parent.push_back(std::move(posted));
+    uv_async_send(worker->parent_async);
+}
+
+/*
+ * Worker side
+ */
+
+struct WorkerScope {
+    std::shared_ptr<Worker> worker;
+    Isolate *isolate;
+    Persistent<Context> context;
+};
+
+void WorkerPostMessage(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    auto scope = reinterpret_cast<WorkerScope*>(args.Data().As<External>()->Value());
+    std::unique_ptr<ClonedValue> clone = StructuredClone::Clone(isolate,
+        isolate->GetCurrentContext(), args[0], args.Length() > 1 ? args[1] : Local<Value>());
+    if (!clone) return;
+    Posted posted;
+    posted.value = std::move(clone);
+    PostToParent(scope->worker, std::move(posted));
+}
+
+void OnWorkerMessages(uv_async_t *handle)
+{
+    auto scope = reinterpret_cast<WorkerScope*>(handle->data);
+    std::deque<std::unique_ptr<ClonedValue>> inbox;
+    {
+        std::lock_guard<std::mutex> lock(scope->worker->mutex);
+        if (scope->worker->terminated) {
+            // Lets uv_run() return
+            scope->worker->worker_async = nullptr;
+            uv_close(reinterpret_cast<uv_handle_t*>(handle), nullptr);
+            return;
+        }
+        inbox.swap(scope->worker->to_worker);
+    }
+
+    Isolate *isolate = scope->isolate;
+    HandleScope handle_scope(isolate);
+    Local<Context> context = scope->context.Get(isolate);
+    Context::Scope context_scope(context);
+
+    for (auto& message : inbox) {
+        TryCatch trycatch(isolate);
+        Local<Value> value;
+        Local<Value> onmessage;
+        if (!StructuredClone::Revive(isolate, context, &* message).ToLocal(&value) ||
+            !context->Global()->Get(context, String::NewFromUtf8(isolate, "onmessage"))
+                .ToLocal(&onmessage)) {
+            Posted posted;
+            posted.error = Describe(trycatch);
+            PostToParent(scope->worker, std::move(posted));
+            continue;
+        }
+        if (!onmessage->IsFunction()) continue;
+        if (onmessage.As<Function>()->Call(context, context->Global(), 1, &value).IsEmpty()) {
+            if (isolate->IsExecutionTerminating()) return;
+            Posted posted;
+            posted.error = Describe(trycatch);
+            PostToParent(scope->worker, std::move(posted));
+        }
+    }
+}
+
+void RunWorker(const std::shared_ptr<Worker>& worker)
+{
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (worker->terminated) return;
+    }
+
+    uv_loop_t loop;
+    uv_loop_init(&loop);
+
+    ArrayBuffer::Allocator *allocator = ArrayBuffer::Allocator::NewDefaultAllocator();
+    Isolate::CreateParams params;
+    params.array_buffer_allocator = allocator;
+    const WorkerPool::Limits& limits = worker->limits;
+    if (limits.max_old_space_mb > 0)
+        params.constraints.set_max_old_space_size(limits.max_old_space_mb);
+    if (limits.max_semi_space_mb > 0)
+        params.constraints.set_max_semi_space_size(limits.max_semi_space_mb);
+    if (limits.code_range_mb > 0)
+        params.constraints.set_code_range_size(limits.code_range_mb);
+    if (limits.stack_limit_kb > 0) {
+        uintptr_t here = reinterpret_cast<uintptr_t>(&params);
+        params.constraints.set_stack_limit(
+            reinterpret_cast<uint32_t*>(here - limits.stack_limit_kb * 1024));
+    }
+    Isolate *isolate = Isolate::New(params);
+
+    if (isolate) {
+        Locker locker(isolate);
+        Isolate::Scope isolate_scope(isolate);
+        HandleScope handle_scope(isolate);
+        Local<Context> context = Context::New(isolate);
+        Context::Scope context_scope(context);
+
+        WorkerScope scope;
+        scope.worker = worker;
+        scope.isolate = isolate;
+        scope.context.Reset(isolate, context);
+        context->Global()->Set(context, String::NewFromUtf8(isolate, "postMessage"),
+            Function::New(context, WorkerPostMessage, External::New(isolate, &scope))
+                .ToLocalChecked());
+
+        uv_async_t async;
+        async.data = &scope;
+        uv_async_init(&loop, &async, OnWorkerMessages);
+        bool terminated;
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            terminated = worker->terminated;
+            worker->worker_async = &async;
+            worker->isolate = isolate;
+            // Whatever was posted before we got going, or a terminate we just missed
+            if (terminated || !worker->to_worker.empty()) uv_async_send(&async);
+        }
+
+        if (!terminated) {
+            TryCatch trycatch(isolate);
+            Local<String> source;
+            Local<Script> script;
+            if (!String::NewFromUtf8(isolate, worker->source.c_str(), NewStringType::kNormal)
+                    .ToLocal(&source) ||
+                !Script::Compile(context, source).ToLocal(&script) ||
+                script->Run(context).IsEmpty()) {
+                if (!isolate->IsExecutionTerminating()) {
+                    Posted posted;
+                    posted.error = Describe(trycatch);
+                    PostToParent(worker, std::move(posted));
+                }
+            }
+        }
+
+        // Runs until terminated; the async handle is only closed then
+        uv_run(&loop, UV_RUN_DEFAULT);
+
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->isolate = nullptr;
+            if (worker->worker_async) {
+                worker->worker_async = nullptr;
+                uv_close(reinterpret_cast<uv_handle_t*>(&async), nullptr);
+            }
+        }
+        uv_run(&loop, UV_RUN_NOWAIT);
+        scope.context.Reset();
+    }
+
+    if (isolate) isolate->Dispose();
+    delete allocator;
+    uv_loop_close(&loop);
+}
+
+// A pool thread runs workers until there are none waiting
+void PoolThread(std::shared_ptr<Worker> worker)
+{
+    while (worker) {
+        RunWorker(worker);
+        std::lock_guard<std::mutex> lock(s_mutex);
+        worker.reset();
+        if (s_pending.empty()) {
+            s_running --;
+        } else {
+            worker = s_pending.front();
+            s_pending.pop_front();
+        }
+    }
+}
+
+void Start(const std::shared_ptr<Worker>& worker)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    if (s_running < PoolSize()) {
+        s_running ++;
+        std::thread(PoolThread, worker).detach();
+    } else {
+        s_pending.push_back(worker);
+    }
+}
+
+/*
+ * Creator side
+ */
+
+void Terminate(ParentEnd *parent)
+{
+    if (parent->closed) return;
+    parent->closed = true;
+
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        for (auto it = s_parents.find(parent->env);
+             it != s_parents.end() && it->first == parent->env; ++it) {
+            if (it->second == parent) {
+                s_parents.erase(it);
+                break;
+            }
+        }
+        auto pending = std::find(s_pending.begin(), s_pending.end(), parent->worker);
+        if (pending != s_pending.end()) s_pending.erase(pending);
+    }
+
+    uv_async_t *async;
+    {
+        std::lock_guard<std::mutex> lock(parent->worker->mutex);
+        parent->worker->terminated = true;
+        parent->worker->to_worker.clear();
+        parent->worker->to_parent.clear();
+        if (parent->worker->isolate) parent->worker->isolate->TerminateExecution();
+        if (parent->worker->worker_async) uv_async_send(parent->worker->worker_async);
+        async = parent->worker->parent_async;
+        parent->worker->parent_async = nullptr;
+    }
+
+    uv_close(reinterpret_cast<uv_handle_t*>(async), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_async_t*>(handle);
+    });
+    parent->onmessage.Reset();
+
+    // The worker object's functions still point here, so it goes when they do
+    parent->object.SetWeak(parent, [](const WeakCallbackInfo<ParentEnd>& info) {
+        ParentEnd *parent = info.GetParameter();
+        parent->object.Reset();
+        delete parent;
+    }, WeakCallbackType::kParameter);
+}
+
+void OnParentMessages(uv_async_t *handle)
+{
+    auto parent = reinterpret_cast<ParentEnd*>(handle->data);
+    std::deque<Posted> inbox;
+    {
+        std::lock_guard<std::mutex> lock(parent->worker->mutex);
+        inbox.swap(parent->worker->to_parent);
+    }
+
+    Isolate *isolate = parent->env->isolate();
+    HandleScope handle_scope(isolate);
+    Local<Context> context = parent->env->context();
+    Context::Scope context_scope(context);
+
+    for (auto& posted : inbox) {
+        // An earlier handler may have terminated the worker
+        if (parent->closed) break;
+
+        Local<Object> object = parent->object.Get(isolate);
+        if (!posted.value) {
+            Local<Value> onerror;
+            if (object->Get(context, String::NewFromUtf8(isolate, "onerror")).ToLocal(&onerror) &&
+                onerror->IsFunction()) {
+                Local<Value> error = Exception::Error(
+                    String::NewFromUtf8(isolate, posted.error.c_str()));
+                node::MakeCallback(isolate, object, onerror.As<Function>(), 1, &error, {0, 0});
+            } else {
+                ReportUncaught(isolate, context, posted.error);
+            }
+            continue;
+        }
+
+        Local<Value> value;
+        {
+            TryCatch trycatch(isolate);
+            StructuredClone::Revive(isolate, context, &* posted.value).ToLocal(&value);
+        }
+        if (value.IsEmpty()) continue;
+
+        node::MakeCallback(isolate, object, parent->onmessage.Get(isolate), 1, &value, {0, 0});
+    }
+}
+
+void ParentPostMessage(const FunctionCallbackInfo<Value>& args)
+{
+    Isolate *isolate = args.GetIsolate();
+    auto parent = reinterpret_cast<ParentEnd*>(args.Data().As<External>()->Value());
+    if (parent->closed) {
+        return Throw(isolate, "Worker has been terminated");
+    }
+
+    std::unique_ptr<ClonedValue> clone = StructuredClone::Clone(isolate,
+        isolate->GetCurrentContext(), args[0], args.Length() > 1 ? args[1] : Local<Value>());
+    if (!clone) return;
+
+    std::lock_guard<std::mutex> lock(parent->worker->mutex);
+    parent->worker->to_worker.push_back(std::move(clone));
+    if (parent->worker->worker_async) {
+        uv_async_send(parent->worker->worker_async);
+    }
+}
+
+void ParentTerminate(const FunctionCallbackInfo<Value>& args)
+{
+    Terminate(reinterpret_cast<ParentEnd*>(args.Data().As<External>()->Value()));
+}
+
+void CreateWorker(const FunctionCallbackInfo<Value>& args)
+{
+    node::Environment *env = node::Environment::GetCurrent(args);
+    Isolate *isolate = args.GetIsolate();
+    Local<Context> context = isolate->GetCurrentContext();
+    if (args.Length() < 2 || !args[0]->IsString() || !args[1]->IsFunction()) {
+        return Throw(isolate, "createWorker(source, onmessage)");
+    }
+    String::Utf8Value source(args[0]);
+
+    auto worker = std::make_shared<Worker>();
+    worker->source = *source;
+    auto parent = new ParentEnd();
+    parent->env = env;
+    parent->worker = worker;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        worker->limits = s_limits[env];
+        s_parents.insert(std::make_pair(env, parent));
+    }
+
+    worker->parent_async = new uv_async_t();
+    worker->parent_async->data = parent;
+    uv_async_init(env->event_loop(), worker->parent_async, OnParentMessages);
+
+    Local<External> data = External::New(isolate, parent);
+    Local<Object> object = Object::New(isolate);
+    object->Set(context, String::NewFromUtf8(isolate, "postMessage"),
+                Function::New(context, ParentPostMessage, data).ToLocalChecked());
+    object->Set(context, String::NewFromUtf8(isolate, "terminate"),
+                Function::New(context, ParentTerminate, data).ToLocalChecked());
+    parent->onmessage.Reset(isolate, args[1].As<Function>());
+    parent->object.Reset(isolate, object);
+
+    Start(worker);
+    args.GetReturnValue().Set(object);
+}
+
+} /* namespace */
+
+void WorkerPool::Install(node::Environment *env, const Limits& limits)
+{
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_limits[env] = limits;
+    }
+    env->SetMethod(env->process_object(), "createWorker", CreateWorker);
+}
+
+void WorkerPool::TerminateAll(node::Environment *env)
+{
+    for (;;) {
+        ParentEnd *parent = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            auto found = s_parents.find(env);
+            if (found == s_parents.end()) {
+                s_limits.erase(env);
+                break;
+            }
+            parent = found->second;
+        }
+        Terminate(parent);
+    }
+}
+
+} /* namespace nodedroid */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef NODEDROID_WORKERPOOL_H
+#define NODEDROID_WORKERPOOL_H
+
+#include "node.h"
+#include "env.h"
+
+namespace nodedroid {
+
+/*
+ * Workers for CPU-bound JS, each a plain isolate of its own (no node environment) with its own
+ * loop, so that a service can use more than one core.  In JS:
+ *
+ *   const worker = process.createWorker(source, function onmessage(value) { ... });
+ *   worker.onerror = function(error) { ... };  // optional
+ *   worker.postMessage(value[, transferList]);
+ *   worker.terminate();
+ *
+ * and inside the worker, whose global object is all it has:
+ *
+ *   onmessage = function(value) { ... postMessage(result[, transferList]); };
+ *
+ * Values are structured-clone serialized; ArrayBuffers in a transfer list are moved where the
+ * engine can detach them, and on Android SharedArrayBuffers are shared with the worker, so the
+ * two sides can synchronize through Atomics.wait() and notify().  Workers run on a process-wide pool of threads, one per core; a
+ * worker created while they are all busy starts once one frees up, and messages posted to it
+ * wait until then.  Every worker isolate gets the same heap and stack limits as the instance
+ * that made it.  A live worker keeps its creator's loop alive until it is terminated.
+ */
+class WorkerPool {
+public:
+    struct Limits {
+        Limits() : max_old_space_mb(0), max_semi_space_mb(0), code_range_mb(0),
+            stack_limit_kb(0) {}
+        int max_old_space_mb;
+        int max_semi_space_mb;
+        size_t code_range_mb;
+        size_t stack_limit_kb;
+    };
+
+    // Adds process.createWorker().  Must be called on the instance's thread.
+    static void Install(node::Environment *env, const Limits& limits);
+    // Terminates whatever workers |env| still has.  Must be called on the instance's thread
+    // before its loop is run for the last time.
+    static void TerminateAll(node::Environment *env);
+};
+
+} /* namespace nodedroid */
+
+#endif //NODEDROID_WORKERPOOL_H
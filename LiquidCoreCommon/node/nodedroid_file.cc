@@ -32,6 +32,16 @@
 #include <string.h>
 #include <errno.h>
 #include <limits.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
 #include "addon.h"
 
 #if defined(__MINGW32__) || defined(_MSC_VER)
@@ -39,10 +49,51 @@
 #endif
 
 #include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <mutex>
 
 #include "nodedroid_file.h"
+#include "ThreadClass.h"
+#include "ModuleArchive.h"
+#include "ModulePrefetch.h"
+#include "ExternalRegistry.h"
 
 namespace nodedroid {
+
+static thread_local FsStats *s_fs_stats = nullptr;
+
+void SetFsStats(FsStats *stats)
+{
+    s_fs_stats = stats;
+}
+
+// InternalModuleStat() results, by requested absolute path.  Each node thread keeps its own;
+// bumping the generation from any thread throws them all away.  Paths are only meaningful to
+// one environment's sandbox, so a thread shared between instances starts over on each switch.
+static std::atomic<uint64_t> s_stat_generation(0);
+struct StatCache {
+    uint64_t generation = 0;
+    const void *env = nullptr;
+    std::unordered_map<std::string, int> results;
+};
+static thread_local StatCache s_stat_cache;
+
+void InvalidateModuleStatCache()
+{
+    s_stat_generation ++;
+}
+
+typedef std::function<int(uv_loop_t*, uv_fs_t*, const char*)> SandboxedCall;
+static bool StartSandboxedCall(node::Environment* env,
+                               const v8::FunctionCallbackInfo<v8::Value>& args,
+                               v8::Local<v8::Value> path, int req_access,
+                               v8::Local<v8::Value> request, const char* syscall,
+                               enum node::encoding encoding, SandboxedCall call);
+
 namespace {
 
 using v8::Array;
@@ -74,6 +125,7 @@ using node::BufferValue;
 using node::MaybeStackBuffer;
 using node::StatWatcher;
 using node::ClearWrap;
+using node::Unwrap;
 using node::AsyncWrap;
 
 using nodedroid::FillStatsArray;
@@ -186,6 +238,23 @@ void After(uv_fs_t *req) {
   HandleScope handle_scope(env->isolate());
   Context::Scope context_scope(env->context());
 
+  // A stat may have been cached while this was in flight
+  switch (req->fs_type) {
+    case UV_FS_OPEN:
+    case UV_FS_RENAME:
+    case UV_FS_UNLINK:
+    case UV_FS_RMDIR:
+    case UV_FS_MKDIR:
+    case UV_FS_MKDTEMP:
+    case UV_FS_LINK:
+    case UV_FS_SYMLINK:
+    case UV_FS_COPYFILE:
+      InvalidateModuleStatCache();
+      break;
+    default:
+      break;
+  }
+
   // there is always at least one argument. "error"
   int argc = 1;
 
@@ -419,6 +488,17 @@ class fs_req_wrap {
 #define ASYNC_CALL(func, req, encoding, ...)                                  \
   ASYNC_DEST_CALL(func, req, nullptr, encoding, __VA_ARGS__)                  \
 
+// Async calls on one sandboxed path.  With a native path policy, the realpath runs as a uv
+// request and the call proper is issued from its completion, so nothing blocks the loop.
+// Otherwise this does nothing and the caller carries on through fs_() and ASYNC_CALL.  The
+// extra arguments are captured by value, so they must not refer to |args|.
+#define ASYNC_SANDBOX_CALL(func, request, encoding, path, req_access, ...)    \
+  if (StartSandboxedCall(env, args, path, req_access, request, #func,         \
+        encoding, [=](uv_loop_t* loop, uv_fs_t* req, const char* resolved) {  \
+          return uv_fs_ ## func(loop, req, resolved, ##__VA_ARGS__, After);   \
+        }))                                                                   \
+    return;
+
 #define SYNC_DEST_CALL(func, path, dest, ...)                                 \
   fs_req_wrap req_wrap;                                                       \
   env->PrintSyncTrace();                                                      \
@@ -437,6 +517,49 @@ class fs_req_wrap {
 
 #define SYNC_RESULT err
 
+// Paths in a mounted ModuleArchive are answered from its index.  An async call on one
+// completes before returning, as ASYNC_DEST_CALL does with a call that can't be issued.
+bool InArchive(Environment* env, const char* path, ModuleArchive::Entry* entry, int* err) {
+  return path != nullptr && ModuleArchive::Find(env, path, entry, err);
+}
+
+void ArchiveResult(const FunctionCallbackInfo<Value>& args, Local<Value> request,
+                   const char* syscall, int err, const char* path,
+                   Local<Value> result = Local<Value>()) {
+  Environment* env = Environment::GetCurrent(args);
+  if (!request->IsObject()) {
+    if (err < 0)
+      return env->ThrowUVException(err, syscall, nullptr, path);
+    if (!result.IsEmpty())
+      args.GetReturnValue().Set(result);
+    return;
+  }
+
+  FSReqWrap* req_wrap = FSReqWrap::New(env, request.As<Object>(), syscall);
+  req_wrap->Dispatched();
+  int argc = 1;
+  Local<Value> argv[2];
+  if (err < 0) {
+    argv[0] = UVException(env->isolate(), err, syscall, nullptr, path, nullptr);
+  } else {
+    argv[0] = Null(env->isolate());
+    if (!result.IsEmpty()) {
+      argv[1] = result;
+      argc = 2;
+    }
+  }
+  req_wrap->MakeCallback(env->oncomplete_string(), argc, argv);
+  req_wrap->Dispose();
+}
+
+void ArchiveStat(const FunctionCallbackInfo<Value>& args, Local<Value> request,
+                 const char* syscall, int err, const uv_stat_t* stat, const char* path) {
+  if (err == 0) {
+    FillStatsArray(Environment::GetCurrent(args)->fs_stats_field_array(), stat);
+  }
+  ArchiveResult(args, request, syscall, err, path);
+}
+
 void Access(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args.GetIsolate());
   HandleScope scope(env->isolate());
@@ -450,10 +573,22 @@ void Access(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
-  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
 
   int mode = static_cast<int>(args[1]->Int32Value());
 
+  if (args[2]->IsObject()) {
+    ASYNC_SANDBOX_CALL(access, args[2], UTF8, args[0], _FS_ACCESS_RD, mode)
+  }
+  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
+
+  ModuleArchive::Entry entry;
+  int archive_err;
+  if (InArchive(env, *path, &entry, &archive_err)) {
+    if (archive_err == 0 && (mode & W_OK))
+      archive_err = UV_EROFS;
+    return ArchiveResult(args, args[2], "access", archive_err, *path);
+  }
+
   if (*path != nullptr) {
     if (args[2]->IsObject()) {
       ASYNC_CALL(access, args[2], UTF8, *path, mode);
@@ -474,6 +609,9 @@ void Close(const FunctionCallbackInfo<Value>& args) {
 
   int fd = args[0]->Int32Value();
 
+  if (ModuleArchive::IsArchiveFd(fd))
+    return ArchiveResult(args, args[1], "close", ModuleArchive::Close(env, fd), nullptr);
+
   if (args[1]->IsObject()) {
     ASYNC_CALL(close, args[1], UTF8, fd)
   } else {
@@ -483,107 +621,345 @@ void Close(const FunctionCallbackInfo<Value>& args) {
 
 }  // anonymous namespace
 
-v8::Local<v8::Value> fs_(node::Environment *env, v8::Local<v8::Value> path, int req_access)
+static Local<v8::Private> PolicyKey(v8::Isolate *isolate)
 {
-    EscapableHandleScope handle_scope(env->isolate());
-    Context::Scope context_scope(env->context());
+    return v8::Private::ForApi(isolate, String::NewFromUtf8(isolate, "__fs_policy"));
+}
 
-    BufferValue p(env->isolate(), path);
+void PathPolicy::Install(Local<Context> context, Local<Object> fsObj)
+{
+    v8::Isolate *isolate = context->GetIsolate();
+    HandleScope handle_scope(isolate);
+
+    Local<Value> aliases, access;
+    if (!fsObj->Get(context, String::NewFromUtf8(isolate, "aliases_")).ToLocal(&aliases) ||
+        !fsObj->Get(context, String::NewFromUtf8(isolate, "access_")).ToLocal(&access) ||
+        !aliases->IsObject() || !access->IsObject()) {
+        return;
+    }
 
-    int access = 0;
-    Local<v8::Private> privateKey = v8::Private::ForApi(env->isolate(),
-        String::NewFromUtf8(env->isolate(), "__fs"));
-    Local<Object> globalObj = env->context()->Global();
-    Maybe<bool> result = globalObj->HasPrivate(env->context(), privateKey);
-    if (result.IsJust() && result.FromJust()) {
-      Local<Value> fsVal;
-      if(globalObj->GetPrivate(env->context(), privateKey).ToLocal(&fsVal)) {
-        Local<Object> fsObj = fsVal->ToObject(env->context()).ToLocalChecked();
-
-        Local<Value> cwd = fsObj->Get(String::NewFromUtf8(env->isolate(), "cwd"));
-        BufferValue c(env->isolate(), cwd);
-        char fullp[strlen(*c) + strlen(*p) + 8];
-
-        const char *pth = *p;
-        while (*pth == ' ' || *pth == '\t') pth++;
-        if (*pth != '/') {
-            strcpy(fullp, *c);
-            strcpy(fullp + strlen(*c), "/");
-            strcpy(fullp + strlen(*c) + 1, pth);
-            pth = fullp;
+    auto policy = new PathPolicy();
+
+    Local<Array> names;
+    if (aliases.As<Object>()->GetOwnPropertyNames(context).ToLocal(&names)) {
+        for (uint32_t i = 0; i < names->Length(); i++) {
+            Local<Value> name = names->Get(context, i).ToLocalChecked();
+            Local<Value> target;
+            // An alias whose directory couldn't be resolved has no target
+            if (!aliases.As<Object>()->Get(context, name).ToLocal(&target) ||
+                !target->IsString()) continue;
+            const std::string key = *node::Utf8Value(isolate, name);
+            const std::string virt = Normalize(key);
+            const std::string real = Normalize(*node::Utf8Value(isolate, target));
+            Node *v = Insert(policy->m_virtual, virt);
+            v->has_target = true;
+            v->target = real;
+            // Two aliases of one directory: alias() stops at whichever key sorts last
+            Node *r = Insert(policy->m_real, real);
+            if (!r->has_target || key > r->key) {
+                r->has_target = true;
+                r->target = virt;
+                r->key = key;
+            }
         }
+    }
+    if (access.As<Object>()->GetOwnPropertyNames(context).ToLocal(&names)) {
+        for (uint32_t i = 0; i < names->Length(); i++) {
+            Local<Value> name = names->Get(context, i).ToLocalChecked();
+            Local<Value> mask;
+            if (!access.As<Object>()->Get(context, name).ToLocal(&mask)) continue;
+            Node *v = Insert(policy->m_virtual, Normalize(*node::Utf8Value(isolate, name)));
+            v->has_access = true;
+            v->access = mask->Int32Value(context).FromMaybe(0);
+        }
+    }
 
-        fs_req_wrap req_wrap;
-        env->PrintSyncTrace();
-        int err = uv_fs_realpath(env->event_loop(),
-                             &req_wrap.req, pth, nullptr);
-        const char* link_path;
-        if (err != 0) {
-            link_path = pth;
-        } else {
-            link_path = static_cast<const char*>(SYNC_REQ.ptr);
+    // The policy lives as long as the FileSystem object it was built from
+    fsObj->SetPrivate(context, PolicyKey(isolate), v8::External::New(isolate, policy));
+    policy->m_holder.Reset(isolate, fsObj);
+    policy->m_holder.SetWeak(policy, [](const v8::WeakCallbackInfo<PathPolicy>& info) {
+        delete info.GetParameter();
+    }, v8::WeakCallbackType::kParameter);
+}
+
+PathPolicy* PathPolicy::Get(Local<Context> context, Local<Object> fsObj)
+{
+    Local<Value> policy;
+    if (fsObj->GetPrivate(context, PolicyKey(context->GetIsolate())).ToLocal(&policy) &&
+        policy->IsExternal()) {
+        return reinterpret_cast<PathPolicy*>(policy.As<v8::External>()->Value());
+    }
+    return nullptr;
+}
+
+PathPolicy::Node* PathPolicy::Insert(Node& root, const std::string& path)
+{
+    Node *node = &root;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        if (path[pos] == '/') { pos++; continue; }
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos) end = path.size();
+        auto& child = node->children[path.substr(pos, end - pos)];
+        if (!child) child.reset(new Node());
+        node = child.get();
+        pos = end;
+    }
+    return node;
+}
+
+const PathPolicy::Node* PathPolicy::Match(const Node& root, const std::string& path,
+                                          bool Node::*flag, size_t *matched,
+                                          bool (*prefer)(const Node& a, const Node& b))
+{
+    const Node *best = nullptr;
+    const Node *node = &root;
+    size_t pos = 0;
+    *matched = 0;
+    while (pos < path.size()) {
+        if (path[pos] == '/') { pos++; continue; }
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos) end = path.size();
+        auto it = node->children.find(path.substr(pos, end - pos));
+        if (it == node->children.end()) break;
+        node = it->second.get();
+        if (node->*flag && (!best || !prefer || prefer(*node, *best))) {
+            best = node;
+            *matched = end;
         }
+        pos = end;
+    }
+    return best;
+}
 
-        Local<Value> error;
-        Local<Value> rc = StringBytes::Encode(env->isolate(),
-                                              link_path,
-                                              UTF8,
-                                              &error).ToLocalChecked();
-        if (rc.IsEmpty()) {
-          env->ThrowUVException(UV_EINVAL,
-                                "realpath",
-                                "Invalid character encoding for path",
-                                pth);
-          return rc;
+std::string PathPolicy::ToVirtual(const std::string& real) const
+{
+    size_t matched;
+    // alias() tries the keys in reverse order, so the last key wins, however little it matches
+    const Node *node = real.empty() || real[0] != '/' ? nullptr :
+        Match(m_real, real, &Node::has_target, &matched,
+              [](const Node& a, const Node& b) { return a.key > b.key; });
+    return node ? node->target + real.substr(matched) : real;
+}
+
+std::string PathPolicy::ToReal(const std::string& virt) const
+{
+    size_t matched;
+    const Node *node = Match(m_virtual, virt, &Node::has_target, &matched);
+    return node ? node->target + virt.substr(matched) : virt;
+}
+
+int PathPolicy::Access(const std::string& virt) const
+{
+    size_t matched;
+    const Node *node = Match(m_virtual, virt, &Node::has_access, &matched);
+    return node ? node->access : 0;
+}
+
+std::string PathPolicy::Normalize(const std::string& path)
+{
+    std::vector<std::string> parts;
+    size_t pos = 0;
+    while (pos < path.size()) {
+        size_t end = path.find('/', pos);
+        if (end == std::string::npos) end = path.size();
+        const std::string part = path.substr(pos, end - pos);
+        if (part == "..") {
+            if (!parts.empty()) parts.pop_back();
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
         }
-        Local<Object> test = fsObj->Get(env->context(), String::NewFromUtf8(env->isolate(), "fs"))
-            .ToLocalChecked()->ToObject(env->context()).ToLocalChecked();
-        MaybeLocal<Value> tuple = test->CallAsFunction(env->context(), fsObj, 1, &rc);
-        if (tuple.IsEmpty()) {
-            access = 0;
-        } else {
-          access = (int) tuple.ToLocalChecked()->ToObject(env->context()).ToLocalChecked()
-            ->Get(env->context(), 0).ToLocalChecked()
-            ->ToNumber(env->context()).ToLocalChecked()->Value();
-          rc = tuple.ToLocalChecked()->ToObject(env->context()).ToLocalChecked()
-            ->Get(env->context(), 1).ToLocalChecked();
+        pos = end + 1;
+    }
+    std::string normalized;
+    for (auto& part : parts) {
+        normalized.append("/").append(part);
+    }
+    return normalized.empty() ? "/" : normalized;
+}
+
+// The FileSystem object of the Environment running on this thread, with everything fs_() and
+// friends need from it resolved once.  Rebuilt when the thread moves on to another
+// Environment or a file system is installed.
+struct Sandbox {
+    Environment *env = nullptr;
+    uint64_t generation = 0;
+    v8::Global<Object> fs;
+    v8::Global<Function> fs_fn;
+    v8::Global<Function> alias_fn;
+    PathPolicy *policy = nullptr;
+    std::string cwd;
+};
+static std::atomic<uint64_t> s_fs_generation(1);
+static thread_local Sandbox *s_sandbox = nullptr;
+
+void InvalidateSandbox()
+{
+    s_fs_generation ++;
+}
+
+void ReleaseSandbox()
+{
+    delete s_sandbox;
+    s_sandbox = nullptr;
+}
+
+// Null until a FileSystem object has been set
+static Sandbox* GetSandbox(Environment *env)
+{
+    const uint64_t generation = s_fs_generation;
+    if (!s_sandbox || s_sandbox->env != env || s_sandbox->generation != generation) {
+        ReleaseSandbox();
+        s_sandbox = new Sandbox();
+        s_sandbox->env = env;
+        s_sandbox->generation = generation;
+
+        v8::Isolate *isolate = env->isolate();
+        HandleScope handle_scope(isolate);
+        Local<Context> context = env->context();
+        Local<v8::Private> privateKey = v8::Private::ForApi(isolate,
+            String::NewFromUtf8(isolate, "__fs"));
+        Local<Value> fsVal;
+        if (context->Global()->GetPrivate(context, privateKey).ToLocal(&fsVal) &&
+            fsVal->IsObject()) {
+            Local<Object> fsObj = fsVal.As<Object>();
+            s_sandbox->fs.Reset(isolate, fsObj);
+            s_sandbox->policy = PathPolicy::Get(context, fsObj);
+            Local<Value> fn;
+            if (fsObj->Get(context, String::NewFromUtf8(isolate, "fs")).ToLocal(&fn) &&
+                fn->IsFunction()) {
+                s_sandbox->fs_fn.Reset(isolate, fn.As<Function>());
+            }
+            if (fsObj->Get(context, String::NewFromUtf8(isolate, "alias")).ToLocal(&fn) &&
+                fn->IsFunction()) {
+                s_sandbox->alias_fn.Reset(isolate, fn.As<Function>());
+            }
+            Local<Value> cwd;
+            if (fsObj->Get(context, String::NewFromUtf8(isolate, "cwd")).ToLocal(&cwd)) {
+                s_sandbox->cwd = *node::Utf8Value(isolate, cwd);
+            }
         }
+    }
+    return s_sandbox->fs.IsEmpty() ? nullptr : s_sandbox;
+}
 
-        if ((req_access & access) != req_access) {
-            env->ThrowError("access denied (EACCES)");
-            return Local<Value>(Undefined(env->isolate()));
+// Counts one sandbox check, and the time spent in it, against the thread's FsStats
+struct CheckTimer {
+    CheckTimer() : start(s_fs_stats ? uv_hrtime() : 0) {}
+    ~CheckTimer() {
+        if (s_fs_stats) {
+            s_fs_stats->checks ++;
+            s_fs_stats->check_ns += uv_hrtime() - start;
         }
+    }
+    const uint64_t start;
+};
 
-        return handle_scope.Escape(rc);
+v8::Local<v8::Value> fs_(node::Environment *env, v8::Local<v8::Value> path, int req_access)
+{
+    CheckTimer timer;
+
+    Sandbox *sandbox = GetSandbox(env);
+    if (!sandbox) {
+        // FileSystem object not set up yet, so carry on as normal
+        return path;
+    }
+
+    EscapableHandleScope handle_scope(env->isolate());
+    Context::Scope context_scope(env->context());
+
+    BufferValue p(env->isolate(), path);
+
+    int access = 0;
+    const std::string& c = sandbox->cwd;
+    char fullp[c.size() + strlen(*p) + 8];
+
+    const char *pth = *p;
+    while (*pth == ' ' || *pth == '\t') pth++;
+    if (*pth != '/') {
+        strcpy(fullp, c.c_str());
+        strcpy(fullp + c.size(), "/");
+        strcpy(fullp + c.size() + 1, pth);
+        pth = fullp;
+    }
+
+    fs_req_wrap req_wrap;
+    env->PrintSyncTrace();
+    int err = uv_fs_realpath(env->event_loop(),
+                         &req_wrap.req, pth, nullptr);
+    const char* link_path;
+    if (err != 0) {
+        link_path = pth;
+    } else {
+        link_path = static_cast<const char*>(SYNC_REQ.ptr);
+    }
+
+    Local<Value> rc;
+    if (sandbox->policy) {
+      const std::string virt =
+          sandbox->policy->ToVirtual(PathPolicy::Normalize(link_path));
+      access = sandbox->policy->Access(virt);
+      rc = String::NewFromUtf8(env->isolate(), sandbox->policy->ToReal(virt).c_str());
+    } else {
+      Local<Value> error;
+      rc = StringBytes::Encode(env->isolate(),
+                               link_path,
+                               UTF8,
+                               &error).ToLocalChecked();
+      if (rc.IsEmpty()) {
+        env->ThrowUVException(UV_EINVAL,
+                              "realpath",
+                              "Invalid character encoding for path",
+                              pth);
+        return rc;
       }
+      MaybeLocal<Value> tuple = sandbox->fs_fn.IsEmpty() ? MaybeLocal<Value>() :
+          sandbox->fs_fn.Get(env->isolate())->Call(env->context(),
+              sandbox->fs.Get(env->isolate()), 1, &rc);
+      if (tuple.IsEmpty()) {
+          access = 0;
+      } else {
+        access = (int) tuple.ToLocalChecked()->ToObject(env->context()).ToLocalChecked()
+          ->Get(env->context(), 0).ToLocalChecked()
+          ->ToNumber(env->context()).ToLocalChecked()->Value();
+        rc = tuple.ToLocalChecked()->ToObject(env->context()).ToLocalChecked()
+          ->Get(env->context(), 1).ToLocalChecked();
+      }
+    }
+
+    if ((req_access & access) != req_access) {
+        env->ThrowError("access denied (EACCES)");
+        return Local<Value>(Undefined(env->isolate()));
     }
-    // FileSystem object not set up yet, so carry on as normal
-    return path;
+
+    return handle_scope.Escape(rc);
 }
 
 Local<Value> alias_(Environment *env, Local<Value> path)
 {
+    CheckTimer timer;
+    Sandbox *sandbox = GetSandbox(env);
+    if (!sandbox) {
+        // FileSystem object not set up yet, so carry on as normal
+        return path;
+    }
+
     EscapableHandleScope handle_scope(env->isolate());
     Context::Scope context_scope(env->context());
 
-    Local<v8::Private> privateKey = v8::Private::ForApi(env->isolate(),
-        String::NewFromUtf8(env->isolate(), "__fs"));
-    Local<Object> globalObj = env->context()->Global();
-    Maybe<bool> result = globalObj->HasPrivate(env->context(), privateKey);
-    if (result.IsJust() && result.FromJust()) {
-      Local<Value> fsVal;
-      if(globalObj->GetPrivate(env->context(), privateKey).ToLocal(&fsVal)) {
-        Local<Object> fsObj = fsVal->ToObject(env->context()).ToLocalChecked();
+    if (sandbox->policy) {
+        node::Utf8Value real(env->isolate(), path);
+        return handle_scope.Escape(String::NewFromUtf8(env->isolate(),
+            sandbox->policy->ToVirtual(*real).c_str()));
+    }
+    if (sandbox->alias_fn.IsEmpty()) {
+        return path;
+    }
 
-        Local<Object> alias = fsObj->Get(env->context(),String::NewFromUtf8(env->isolate(),"alias"))
-            .ToLocalChecked()->ToObject(env->context()).ToLocalChecked();
-        MaybeLocal<Value> aliased = alias->CallAsFunction(env->context(), fsObj, 1, &path);
+    MaybeLocal<Value> aliased = sandbox->alias_fn.Get(env->isolate())->Call(env->context(),
+        sandbox->fs.Get(env->isolate()), 1, &path);
 
-        return handle_scope.Escape(aliased.ToLocalChecked());
-      }
-    }
-    // FileSystem object not set up yet, so carry on as normal
-    return path;
+    return handle_scope.Escape(aliased.ToLocalChecked());
 }
 
 Local<Value> chdir_(Environment *env, Local<Value> path)
@@ -593,18 +969,11 @@ Local<Value> chdir_(Environment *env, Local<Value> path)
 
     path = fs_(env, path, _FS_ACCESS_RD);
     if (!path->IsUndefined()) {
-      String::Utf8Value str(path);
-
-      Local<v8::Private> privateKey = v8::Private::ForApi(env->isolate(),
-        String::NewFromUtf8(env->isolate(), "__fs"));
-      Local<Object> globalObj = env->context()->Global();
-      Maybe<bool> result = globalObj->HasPrivate(env->context(), privateKey);
-      if (result.IsJust() && result.FromJust()) {
-        Local<Value> fsVal;
-        if(globalObj->GetPrivate(env->context(), privateKey).ToLocal(&fsVal)) {
-          Local<Object> fsObj = fsVal->ToObject(env->context()).ToLocalChecked();
-          CHECK(fsObj->Set(env->context(), String::NewFromUtf8(env->isolate(), "cwd"), path).ToChecked());
-        }
+      Sandbox *sandbox = GetSandbox(env);
+      if (sandbox) {
+        Local<Object> fsObj = sandbox->fs.Get(env->isolate());
+        CHECK(fsObj->Set(env->context(), String::NewFromUtf8(env->isolate(), "cwd"), path).ToChecked());
+        sandbox->cwd = *node::Utf8Value(env->isolate(), path);
       }
     }
     return handle_scope.Escape(path);
@@ -615,21 +984,91 @@ Local<Value> cwd_(Environment *env)
     EscapableHandleScope handle_scope(env->isolate());
     Context::Scope context_scope(env->context());
 
-    Local<v8::Private> privateKey = v8::Private::ForApi(env->isolate(),
-        String::NewFromUtf8(env->isolate(), "__fs"));
-    Local<Object> globalObj = env->context()->Global();
-    Maybe<bool> result = globalObj->HasPrivate(env->context(), privateKey);
-    if (result.IsJust() && result.FromJust()) {
-      Local<Value> fsVal;
-      if(globalObj->GetPrivate(env->context(), privateKey).ToLocal(&fsVal)) {
-        Local<Object> fsObj = fsVal->ToObject(env->context()).ToLocalChecked();
-        return handle_scope.Escape(alias_(env, fsObj->Get(env->context(),
-            String::NewFromUtf8(env->isolate(), "cwd")).ToLocalChecked()));
-      }
+    Sandbox *sandbox = GetSandbox(env);
+    if (sandbox) {
+        return handle_scope.Escape(alias_(env,
+            String::NewFromUtf8(env->isolate(), sandbox->cwd.c_str())));
     }
     return Local<Value>(Undefined(env->isolate()));
 }
 
+struct SandboxResolve {
+  uv_fs_t req;
+  uv_work_t deferred;
+  Environment* env;
+  FSReqWrap* req_wrap;
+  int req_access;
+  std::string path;
+  SandboxedCall call;
+};
+
+static void AfterSandboxResolve(uv_fs_t* req) {
+  std::unique_ptr<SandboxResolve> resolve(static_cast<SandboxResolve*>(req->data));
+  const std::string resolved = req->result == 0 ?
+      static_cast<const char*>(req->ptr) : resolve->path;
+  uv_fs_req_cleanup(req);
+
+  FSReqWrap* req_wrap = resolve->req_wrap;
+  req_wrap->Dispatched();
+
+  int err = UV_EACCES;
+  Sandbox *sandbox = GetSandbox(resolve->env);
+  if (sandbox && sandbox->policy) {
+    if (s_fs_stats) s_fs_stats->checks ++;
+    const std::string virt = sandbox->policy->ToVirtual(PathPolicy::Normalize(resolved));
+    if ((resolve->req_access & sandbox->policy->Access(virt)) == resolve->req_access) {
+      err = resolve->call(resolve->env->event_loop(), req_wrap->req(),
+                          sandbox->policy->ToReal(virt).c_str());
+    }
+  }
+  if (err < 0) {
+    uv_fs_t* uv_req = req_wrap->req();
+    uv_req->result = err;
+    uv_req->path = nullptr;
+    After(uv_req);
+  }
+}
+
+static bool StartSandboxedCall(Environment* env, const FunctionCallbackInfo<Value>& args,
+                               Local<Value> path, int req_access, Local<Value> request,
+                               const char* syscall, enum encoding encoding,
+                               SandboxedCall call) {
+  // Archive paths are only known once resolved, so with one mounted, fs_() resolves up front
+  Sandbox *sandbox = GetSandbox(env);
+  if (!sandbox || !sandbox->policy || !request->IsObject() || ModuleArchive::Mounted(env))
+    return false;
+
+  BufferValue p(env->isolate(), path);
+  if (*p == nullptr)
+    return false;
+
+  const char *pth = *p;
+  while (*pth == ' ' || *pth == '\t') pth++;
+
+  SandboxResolve *resolve = new SandboxResolve();
+  resolve->env = env;
+  resolve->req_access = req_access;
+  resolve->path = *pth == '/' ? std::string(pth) : sandbox->cwd + "/" + pth;
+  resolve->call = call;
+  resolve->req_wrap = FSReqWrap::New(env, request.As<Object>(), syscall, nullptr, encoding);
+  resolve->req.data = resolve;
+
+  int err = uv_fs_realpath(env->event_loop(), &resolve->req, resolve->path.c_str(),
+                           AfterSandboxResolve);
+  args.GetReturnValue().Set(resolve->req_wrap->persistent());
+  if (err < 0) {
+    // Carry on with the path as given, as fs_() does, but not before this call has returned:
+    // the request's oncomplete must never run synchronously
+    resolve->req.result = err;
+    resolve->deferred.data = resolve;
+    uv_queue_work(env->event_loop(), &resolve->deferred, [](uv_work_t*) {},
+                  [](uv_work_t* work, int) {
+      AfterSandboxResolve(&static_cast<SandboxResolve*>(work->data)->req);
+    });
+  }
+  return true;
+}
+
 void FillStatsArray(double* fields, const uv_stat_t* s) {
   fields[0] = s->st_dev;
   fields[1] = s->st_mode;
@@ -664,6 +1103,35 @@ void FillStatsArray(double* fields, const uv_stat_t* s) {
 #undef X
 }
 
+// Reads all of |fd| into |chars|.  The file is stat'ed once so that, unless it grows
+// underneath us, the whole thing comes in with a single read.  Returns the number of bytes.
+static int64_t ReadWholeFile(uv_loop_t* loop, int fd, std::vector<char>* chars) {
+  uv_fs_t stat_req;
+  const int err = uv_fs_fstat(loop, &stat_req, fd, nullptr);
+  // One spare byte, so that a read that fills the buffer means there may be more
+  chars->resize((err == 0 ? static_cast<size_t>(stat_req.statbuf.st_size) : 0) + 1);
+  uv_fs_req_cleanup(&stat_req);
+
+  int64_t offset = 0;
+  ssize_t numchars;
+  size_t wanted;
+  do {
+    if (static_cast<size_t>(offset) == chars->size())
+      chars->resize(chars->size() * 2);
+    wanted = chars->size() - offset;
+
+    uv_buf_t buf = uv_buf_init(&(*chars)[offset], wanted);
+    uv_fs_t read_req;
+    numchars = uv_fs_read(loop, &read_req, fd, &buf, 1, offset, nullptr);
+    uv_fs_req_cleanup(&read_req);
+
+    CHECK_GE(numchars, 0);
+    offset += numchars;
+  } while (static_cast<size_t>(numchars) == wanted);
+
+  return offset;
+}
+
 // Used to speed up module loading.  Returns the contents of the file as
 // a string or undefined when the file cannot be opened.  The speedup
 // comes from not creating Error objects on failure.
@@ -677,37 +1145,46 @@ static void InternalModuleReadFile(const FunctionCallbackInfo<Value>& args) {
   if (strlen(*path) != path.length())
     return;  // Contains a nul byte.
 
-  uv_fs_t open_req;
-  const int fd = uv_fs_open(loop, &open_req, *path, O_RDONLY, 0, nullptr);
-  uv_fs_req_cleanup(&open_req);
-
-  if (fd < 0) {
+  ModuleArchive::Entry entry;
+  int archive_err;
+  if (InArchive(env, *path, &entry, &archive_err)) {
+    if (archive_err < 0 || entry.directory)
+      return;
+    if (s_fs_stats) {
+      s_fs_stats->module_reads ++;
+      s_fs_stats->module_bytes += entry.size;
+    }
+    const size_t skip = entry.size >= 3 && 0 == memcmp(entry.data, "\xEF\xBB\xBF", 3) ? 3 : 0;
+    Local<String> chars_string;
+    if (String::NewFromUtf8(env->isolate(), entry.data + skip, v8::NewStringType::kNormal,
+                            static_cast<int>(entry.size - skip)).ToLocal(&chars_string))
+      args.GetReturnValue().Set(chars_string);
     return;
   }
 
-  const size_t kBlockSize = 32 << 10;
   std::vector<char> chars;
-  int64_t offset = 0;
-  ssize_t numchars;
-  do {
-    const size_t start = chars.size();
-    chars.resize(start + kBlockSize);
+  int64_t offset;
+  if (!ModulePrefetch::Take(env, *path, &chars, &offset)) {
+    uv_fs_t open_req;
+    const int fd = uv_fs_open(loop, &open_req, *path, O_RDONLY, 0, nullptr);
+    uv_fs_req_cleanup(&open_req);
+
+    if (fd < 0) {
+      return;
+    }
 
-    uv_buf_t buf;
-    buf.base = &chars[start];
-    buf.len = kBlockSize;
+    offset = ReadWholeFile(loop, fd, &chars);
 
-    uv_fs_t read_req;
-    numchars = uv_fs_read(loop, &read_req, fd, &buf, 1, offset, nullptr);
-    uv_fs_req_cleanup(&read_req);
-
-    CHECK_GE(numchars, 0);
-    offset += numchars;
-  } while (static_cast<size_t>(numchars) == kBlockSize);
+    uv_fs_t close_req;
+    CHECK_EQ(0, uv_fs_close(loop, &close_req, fd, nullptr));
+    uv_fs_req_cleanup(&close_req);
+    ModulePrefetch::Record(env, *path, &chars[0], offset);
+  }
 
-  uv_fs_t close_req;
-  CHECK_EQ(0, uv_fs_close(loop, &close_req, fd, nullptr));
-  uv_fs_req_cleanup(&close_req);
+  if (s_fs_stats) {
+    s_fs_stats->module_reads ++;
+    s_fs_stats->module_bytes += offset;
+  }
 
   size_t start = 0;
   if (offset >= 3 && 0 == memcmp(&chars[0], "\xEF\xBB\xBF", 3)) {
@@ -722,6 +1199,252 @@ static void InternalModuleReadFile(const FunctionCallbackInfo<Value>& args) {
   args.GetReturnValue().Set(chars_string);
 }
 
+// Compiled code for modules is cached under the sandbox's /home/cache.  Entries are keyed on
+// the resolved path, size and mtime of the source and on the V8 version, so a stale entry is
+// simply never looked up again.  V8 still verifies the source hash when it consumes one.
+static const char kCodeCacheDir[] = "/home/cache/.module-cache";
+
+static std::mutex s_shared_code_cache_mutex;
+static std::string s_shared_code_cache_dir;
+
+void SetSharedCodeCacheDir(const char *dir)
+{
+    std::lock_guard<std::mutex> lock(s_shared_code_cache_mutex);
+    s_shared_code_cache_dir = dir ? dir : "";
+}
+
+bool CacheDir(Environment *env, const char *name, std::string *dir)
+{
+    {
+        std::lock_guard<std::mutex> lock(s_shared_code_cache_mutex);
+        if (!s_shared_code_cache_dir.empty()) {
+            dir->assign(s_shared_code_cache_dir).append("/").append(name);
+            return true;
+        }
+    }
+    v8::TryCatch try_catch(env->isolate());
+    const std::string path = std::string("/home/cache/") + name;
+    node::Utf8Value sandbox_dir(env->isolate(),
+        fs_(env, String::NewFromUtf8(env->isolate(), path.c_str()),
+            _FS_ACCESS_RD | _FS_ACCESS_WR));
+    if (try_catch.HasCaught())
+        return false;
+    dir->assign(*sandbox_dir);
+    return true;
+}
+
+static bool CodeCacheEntry(Environment* env, Local<Value> module, std::string* dir,
+                           std::string* entry) {
+  v8::TryCatch try_catch(env->isolate());
+
+  node::Utf8Value source(env->isolate(), fs_(env, module, _FS_ACCESS_RD));
+  if (try_catch.HasCaught() || strlen(*source) != source.length())
+    return false;
+
+  std::string shared_dir;
+  {
+    std::lock_guard<std::mutex> lock(s_shared_code_cache_mutex);
+    shared_dir = s_shared_code_cache_dir;
+  }
+  std::string cache_dir = shared_dir;
+  if (cache_dir.empty()) {
+    node::Utf8Value sandbox_dir(env->isolate(),
+        fs_(env, String::NewFromUtf8(env->isolate(), kCodeCacheDir),
+            _FS_ACCESS_RD | _FS_ACCESS_WR));
+    if (try_catch.HasCaught())
+      return false;
+    cache_dir = *sandbox_dir;
+  }
+
+  uv_fs_t stat_req;
+  const int err = uv_fs_stat(env->event_loop(), &stat_req, *source, nullptr);
+  const uv_stat_t st = stat_req.statbuf;
+  uv_fs_req_cleanup(&stat_req);
+  if (err < 0)
+    return false;
+
+  std::string key = shared_dir.empty() ? std::string(*source) :
+      std::to_string(st.st_dev) + "/" + std::to_string(st.st_ino);
+  key.append(":").append(std::to_string(st.st_size))
+     .append(":").append(std::to_string(st.st_mtim.tv_sec))
+     .append(".").append(std::to_string(st.st_mtim.tv_nsec))
+     .append(":").append(v8::V8::GetVersion());
+
+  char name[24];
+  snprintf(name, sizeof name, "/%016llx",
+           static_cast<unsigned long long>(std::hash<std::string>()(key)));
+  dir->assign(cache_dir);
+  entry->assign(cache_dir).append(name);
+  return true;
+}
+
+// Returns the cached code for a module source file as a Buffer, or undefined on a miss.
+// For use as cachedData when compiling the module wrapper.
+static void InternalModuleReadCodeCache(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args);
+  uv_loop_t* loop = env->event_loop();
+
+  CHECK(args[0]->IsString());
+  std::string dir, entry;
+  if (!CodeCacheEntry(env, args[0], &dir, &entry))
+    return;
+
+  uv_fs_t open_req;
+  const int fd = uv_fs_open(loop, &open_req, entry.c_str(), O_RDONLY, 0, nullptr);
+  uv_fs_req_cleanup(&open_req);
+  if (fd < 0)
+    return;
+
+  std::vector<char> chars;
+  const int64_t length = ReadWholeFile(loop, fd, &chars);
+
+  uv_fs_t close_req;
+  uv_fs_close(loop, &close_req, fd, nullptr);
+  uv_fs_req_cleanup(&close_req);
+
+  Local<Object> buffer;
+  if (length > 0 && node::Buffer::Copy(env, &chars[0], length).ToLocal(&buffer))
+    args.GetReturnValue().Set(buffer);
+}
+
+// Stores the code produced for a module source file (a Buffer, as from the compiled
+// script's cachedData).  Failure is silent; it only costs a recompile next time.
+static void InternalModuleWriteCodeCache(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args);
+  uv_loop_t* loop = env->event_loop();
+
+  CHECK(args[0]->IsString());
+  CHECK(node::Buffer::HasInstance(args[1]));
+  std::string dir, entry;
+  if (!CodeCacheEntry(env, args[0], &dir, &entry))
+    return;
+
+  uv_fs_t req;
+  uv_fs_mkdir(loop, &req, dir.c_str(), 0700, nullptr);
+  uv_fs_req_cleanup(&req);
+
+  // Write to the side and rename, so that a reader never sees a partial entry
+  const std::string temp = entry + ".tmp";
+  const int fd = uv_fs_open(loop, &req, temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600,
+                            nullptr);
+  uv_fs_req_cleanup(&req);
+  if (fd < 0)
+    return;
+
+  uv_buf_t buf = uv_buf_init(node::Buffer::Data(args[1]),
+                             static_cast<unsigned int>(node::Buffer::Length(args[1])));
+  const ssize_t written = uv_fs_write(loop, &req, fd, &buf, 1, 0, nullptr);
+  uv_fs_req_cleanup(&req);
+  uv_fs_close(loop, &req, fd, nullptr);
+  uv_fs_req_cleanup(&req);
+
+  if (written == static_cast<ssize_t>(buf.len)) {
+    uv_fs_rename(loop, &req, temp.c_str(), entry.c_str(), nullptr);
+  } else {
+    uv_fs_unlink(loop, &req, temp.c_str(), nullptr);
+  }
+  uv_fs_req_cleanup(&req);
+}
+
+struct MappedFile {
+  void* data;
+  size_t length;
+  v8::Global<ArrayBuffer> buffer;
+  std::shared_ptr<ExternalRegistry> mapped;
+};
+
+// What each environment has mapped, for ReleaseMappedFiles()
+static std::mutex s_mapped_mutex;
+static std::map<Environment*, std::shared_ptr<ExternalRegistry>> s_mapped;
+
+static std::shared_ptr<ExternalRegistry> MappedFiles(Environment *env)
+{
+  std::lock_guard<std::mutex> lock(s_mapped_mutex);
+  std::shared_ptr<ExternalRegistry>& mapped = s_mapped[env];
+  if (!mapped) mapped = std::make_shared<ExternalRegistry>();
+  return mapped;
+}
+
+static void Unmap(MappedFile* mapped)
+{
+  munmap(mapped->data, mapped->length);
+  mapped->buffer.Reset();
+  delete mapped;
+}
+
+void ReleaseMappedFiles(Environment *env)
+{
+  std::shared_ptr<ExternalRegistry> mapped;
+  {
+    std::lock_guard<std::mutex> lock(s_mapped_mutex);
+    auto found = s_mapped.find(env);
+    if (found == s_mapped.end()) return;
+    mapped = found->second;
+    s_mapped.erase(found);
+  }
+  mapped->ReleaseAll();
+}
+
+// Maps a whole file and returns it as an ArrayBuffer, unmapped once the buffer is collected.
+// Meant for large read-only assets: pages are read in on first touch and shared with the page
+// cache instead of being copied onto the heap.  The mapping is private, so a write to the
+// buffer only ever changes this process's copy.
+static void MMapReadOnly(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args);
+  uv_loop_t* loop = env->event_loop();
+
+  if (args.Length() < 1)
+    return TYPE_ERROR("path required");
+
+  {
+    BufferValue path(env->isolate(), args[0]);
+    ASSERT_PATH(path)
+  }
+  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
+  if (*path == nullptr)
+    return;
+
+  uv_fs_t req;
+  const int fd = uv_fs_open(loop, &req, *path, O_RDONLY, 0, nullptr);
+  uv_fs_req_cleanup(&req);
+  if (fd < 0)
+    return env->ThrowUVException(fd, "open", nullptr, *path);
+
+  int err = uv_fs_fstat(loop, &req, fd, nullptr);
+  const size_t length = static_cast<size_t>(req.statbuf.st_size);
+  uv_fs_req_cleanup(&req);
+
+  void* data = nullptr;
+  if (err == 0 && length > 0) {
+    data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      err = -errno;
+    }
+  }
+  uv_fs_close(loop, &req, fd, nullptr);
+  uv_fs_req_cleanup(&req);
+  if (err < 0)
+    return env->ThrowUVException(err, data == MAP_FAILED ? "mmap" : "fstat", nullptr, *path);
+
+  if (length == 0)
+    return args.GetReturnValue().Set(ArrayBuffer::New(env->isolate(), 0));
+
+  Local<ArrayBuffer> buffer = ArrayBuffer::New(env->isolate(), data, length,
+                                               v8::ArrayBufferCreationMode::kExternalized);
+  MappedFile* mapped = new MappedFile { data, length };
+  mapped->buffer.Reset(env->isolate(), buffer);
+  mapped->buffer.SetWeak(mapped, [](const v8::WeakCallbackInfo<MappedFile>& info) {
+    MappedFile* mapped = info.GetParameter();
+    mapped->mapped->Remove(mapped);
+    Unmap(mapped);
+  }, v8::WeakCallbackType::kParameter);
+  // If the isolate goes before the buffer is collected, the instance unmaps it on the way out
+  mapped->mapped = MappedFiles(env);
+  mapped->mapped->Add(mapped, [mapped]() { Unmap(mapped); });
+
+  args.GetReturnValue().Set(buffer);
+}
+
 // Used to speed up module loading.  Returns 0 if the path refers to
 // a file, 1 when it's a directory or < 0 on error (usually -ENOENT.)
 // The speedup comes from not creating thousands of Stat and Error objects.
@@ -729,19 +1452,52 @@ static void InternalModuleStat(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
 
   CHECK(args[0]->IsString());
+
+  // Relative paths depend on the cwd, so only absolute ones are worth remembering.  Either
+  // way, a hit skips the sandbox mapping as well as the stat.
+  node::Utf8Value requested(env->isolate(), args[0]);
+  const bool cacheable = requested.length() > 0 && (*requested)[0] == '/';
+  const uint64_t generation = s_stat_generation;
+  if (s_stat_cache.generation != generation || s_stat_cache.env != env) {
+    s_stat_cache.results.clear();
+    s_stat_cache.generation = generation;
+    s_stat_cache.env = env;
+  }
+  if (cacheable) {
+    auto hit = s_stat_cache.results.find(*requested);
+    if (hit != s_stat_cache.results.end()) {
+      return args.GetReturnValue().Set(hit->second);
+    }
+  }
+
   node::Utf8Value path(env->isolate(),  fs_(env, args[0], _FS_ACCESS_NONE));
 
-  uv_fs_t req;
-  int rc = uv_fs_stat(env->event_loop(), &req, *path, nullptr);
-  if (rc == 0) {
-    const uv_stat_t* const s = static_cast<const uv_stat_t*>(req.ptr);
-    rc = !!(s->st_mode & S_IFDIR);
+  int rc;
+  ModuleArchive::Entry entry;
+  if (InArchive(env, *path, &entry, &rc)) {
+    if (rc == 0)
+      rc = entry.directory;
+  } else {
+    uv_fs_t req;
+    rc = uv_fs_stat(env->event_loop(), &req, *path, nullptr);
+    if (rc == 0) {
+      const uv_stat_t* const s = static_cast<const uv_stat_t*>(req.ptr);
+      rc = !!(s->st_mode & S_IFDIR);
+    }
+    uv_fs_req_cleanup(&req);
+  }
+
+  if (cacheable && generation == s_stat_generation) {
+    s_stat_cache.results.emplace(*requested, rc);
   }
-  uv_fs_req_cleanup(&req);
 
   args.GetReturnValue().Set(rc);
 }
 
+static void InvalidateModuleStatCache(const FunctionCallbackInfo<Value>& args) {
+  InvalidateModuleStatCache();
+}
+
 static void Stat(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
 
@@ -752,8 +1508,17 @@ static void Stat(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
+
+  if (args[1]->IsObject()) {
+    ASYNC_SANDBOX_CALL(stat, args[1], UTF8, args[0], _FS_ACCESS_RD)
+  }
   BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
 
+  ModuleArchive::Entry entry;
+  int archive_err;
+  if (InArchive(env, *path, &entry, &archive_err))
+    return ArchiveStat(args, args[1], "stat", archive_err, &entry.stat, *path);
+
   if (*path != nullptr) {
       if (args[1]->IsObject()) {
         ASYNC_CALL(stat, args[1], UTF8, *path)
@@ -775,8 +1540,17 @@ static void LStat(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
+
+  if (args[1]->IsObject()) {
+    ASYNC_SANDBOX_CALL(lstat, args[1], UTF8, args[0], _FS_ACCESS_RD)
+  }
   BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
 
+  ModuleArchive::Entry entry;
+  int archive_err;
+  if (InArchive(env, *path, &entry, &archive_err))
+    return ArchiveStat(args, args[1], "lstat", archive_err, &entry.stat, *path);
+
   if (*path != nullptr) {
       if (args[1]->IsObject()) {
         ASYNC_CALL(lstat, args[1], UTF8, *path)
@@ -798,6 +1572,12 @@ static void FStat(const FunctionCallbackInfo<Value>& args) {
 
   int fd = args[0]->Int32Value();
 
+  if (ModuleArchive::IsArchiveFd(fd)) {
+    uv_stat_t stat;
+    const int archive_err = ModuleArchive::Stat(env, fd, &stat);
+    return ArchiveStat(args, args[1], "fstat", archive_err, &stat, nullptr);
+  }
+
   if (args[1]->IsObject()) {
     ASYNC_CALL(fstat, args[1], UTF8, fd)
   } else {
@@ -809,6 +1589,7 @@ static void FStat(const FunctionCallbackInfo<Value>& args) {
 
 static void Symlink(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
+  InvalidateModuleStatCache();
 
   int len = args.Length();
   if (len < 1)
@@ -849,6 +1630,7 @@ static void Symlink(const FunctionCallbackInfo<Value>& args) {
 
 static void Link(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
+  InvalidateModuleStatCache();
 
   int len = args.Length();
   if (len < 1)
@@ -886,7 +1668,6 @@ static void ReadLink(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
-  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
 
   const enum encoding encoding = ParseEncoding(env->isolate(), args[1], UTF8);
 
@@ -894,6 +1675,11 @@ static void ReadLink(const FunctionCallbackInfo<Value>& args) {
   if (argc == 3)
     callback = args[2];
 
+  if (callback->IsObject()) {
+    ASYNC_SANDBOX_CALL(readlink, callback, encoding, args[0], _FS_ACCESS_RD)
+  }
+  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
+
   if (*path != nullptr) {
       if (callback->IsObject()) {
         ASYNC_CALL(readlink, callback, encoding, *path)
@@ -921,6 +1707,7 @@ static void ReadLink(const FunctionCallbackInfo<Value>& args) {
 
 static void Rename(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
+  InvalidateModuleStatCache();
 
   int len = args.Length();
   if (len < 1)
@@ -1011,6 +1798,7 @@ static void Fsync(const FunctionCallbackInfo<Value>& args) {
 
 static void Unlink(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
+  InvalidateModuleStatCache();
 
   if (args.Length() < 1)
     return TYPE_ERROR("path required");
@@ -1019,6 +1807,10 @@ static void Unlink(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
+
+  if (args[1]->IsObject()) {
+    ASYNC_SANDBOX_CALL(unlink, args[1], UTF8, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR)
+  }
   BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR));
 
   if (*path != nullptr) {
@@ -1032,6 +1824,7 @@ static void Unlink(const FunctionCallbackInfo<Value>& args) {
 
 static void RMDir(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
+  InvalidateModuleStatCache();
 
   if (args.Length() < 1)
     return TYPE_ERROR("path required");
@@ -1040,6 +1833,10 @@ static void RMDir(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
+
+  if (args[1]->IsObject()) {
+    ASYNC_SANDBOX_CALL(rmdir, args[1], UTF8, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR)
+  }
   BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR));
 
   if (*path != nullptr) {
@@ -1053,6 +1850,7 @@ static void RMDir(const FunctionCallbackInfo<Value>& args) {
 
 static void MKDir(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
+  InvalidateModuleStatCache();
 
   if (args.Length() < 2)
     return TYPE_ERROR("path and mode are required");
@@ -1063,10 +1861,14 @@ static void MKDir(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
-  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR));
 
   int mode = static_cast<int>(args[1]->Int32Value());
 
+  if (args[2]->IsObject()) {
+    ASYNC_SANDBOX_CALL(mkdir, args[2], UTF8, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR, mode)
+  }
+  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR));
+
   if (*path != nullptr) {
       if (args[2]->IsObject()) {
         ASYNC_CALL(mkdir, args[2], UTF8, *path, mode)
@@ -1096,6 +1898,22 @@ static void RealPath(const FunctionCallbackInfo<Value>& args) {
   if (argc == 3)
     callback = args[2];
 
+  ModuleArchive::Entry entry;
+  int archive_err;
+  if (InArchive(env, *path, &entry, &archive_err)) {
+    Local<Value> resolved;
+    if (archive_err == 0) {
+      Local<Value> error;
+      MaybeLocal<Value> rc = StringBytes::Encode(env->isolate(),
+          PathPolicy::Normalize(*path).c_str(), encoding, &error);
+      if (rc.IsEmpty())
+        archive_err = UV_EINVAL;
+      else
+        resolved = alias_(env, rc.ToLocalChecked());
+    }
+    return ArchiveResult(args, callback, "realpath", archive_err, *path, resolved);
+  }
+
   if (*path != nullptr) {
       if (callback->IsObject()) {
         ASYNC_CALL(realpath, callback, encoding, *path);
@@ -1133,7 +1951,6 @@ static void ReadDir(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
-  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
 
   const enum encoding encoding = ParseEncoding(env->isolate(), args[1], UTF8);
 
@@ -1141,6 +1958,34 @@ static void ReadDir(const FunctionCallbackInfo<Value>& args) {
   if (argc == 3)
     callback = args[2];
 
+  if (callback->IsObject()) {
+    ASYNC_SANDBOX_CALL(scandir, callback, encoding, args[0], _FS_ACCESS_RD, 0 /*flags*/)
+  }
+  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
+
+  ModuleArchive::Entry entry;
+  int archive_err;
+  if (InArchive(env, *path, &entry, &archive_err)) {
+    Local<Array> names;
+    if (archive_err == 0 && !entry.directory)
+      archive_err = UV_ENOTDIR;
+    if (archive_err == 0) {
+      names = Array::New(env->isolate(), static_cast<int>(entry.children->size()));
+      for (size_t i = 0; i < entry.children->size() && archive_err == 0; i++) {
+        Local<Value> error;
+        MaybeLocal<Value> filename = StringBytes::Encode(env->isolate(),
+            (*entry.children)[i].c_str(), encoding, &error);
+        if (filename.IsEmpty())
+          archive_err = UV_EINVAL;
+        else
+          names->Set(env->context(), static_cast<uint32_t>(i),
+                     filename.ToLocalChecked()).FromJust();
+      }
+    }
+    return ArchiveResult(args, callback, "scandir", archive_err, *path,
+                         archive_err == 0 ? Local<Value>(names) : Local<Value>());
+  }
+
   if (*path != nullptr) {
       if (callback->IsObject()) {
         ASYNC_CALL(scandir, callback, encoding, *path, 0 /*flags*/)
@@ -1194,6 +2039,198 @@ static void ReadDir(const FunctionCallbackInfo<Value>& args) {
   }
 }
 
+// A directory listing with each entry stat'ed, taken in one pass off the loop thread.
+// Entries that can't be stat'ed (removed meanwhile, dangling links) are left out.
+static const size_t kStatFieldCount = 14;
+
+struct DirScan {
+  uv_work_t work;
+  Environment* env;
+  FSReqWrap* req_wrap;
+  enum encoding encoding;
+  std::string path;
+  int err;
+  std::vector<std::string> names;
+  std::vector<double> fields;
+};
+
+static void ToUVStat(const struct stat& s, uv_stat_t* st) {
+  st->st_dev = s.st_dev;
+  st->st_mode = s.st_mode;
+  st->st_nlink = s.st_nlink;
+  st->st_uid = s.st_uid;
+  st->st_gid = s.st_gid;
+  st->st_rdev = s.st_rdev;
+  st->st_ino = s.st_ino;
+  st->st_size = s.st_size;
+  st->st_blksize = s.st_blksize;
+  st->st_blocks = s.st_blocks;
+#if defined(__APPLE__)
+  st->st_atim.tv_sec = s.st_atimespec.tv_sec;
+  st->st_atim.tv_nsec = s.st_atimespec.tv_nsec;
+  st->st_mtim.tv_sec = s.st_mtimespec.tv_sec;
+  st->st_mtim.tv_nsec = s.st_mtimespec.tv_nsec;
+  st->st_ctim.tv_sec = s.st_ctimespec.tv_sec;
+  st->st_ctim.tv_nsec = s.st_ctimespec.tv_nsec;
+  st->st_birthtim.tv_sec = s.st_birthtimespec.tv_sec;
+  st->st_birthtim.tv_nsec = s.st_birthtimespec.tv_nsec;
+#else
+  st->st_atim.tv_sec = s.st_atim.tv_sec;
+  st->st_atim.tv_nsec = s.st_atim.tv_nsec;
+  st->st_mtim.tv_sec = s.st_mtim.tv_sec;
+  st->st_mtim.tv_nsec = s.st_mtim.tv_nsec;
+  st->st_ctim.tv_sec = s.st_ctim.tv_sec;
+  st->st_ctim.tv_nsec = s.st_ctim.tv_nsec;
+  st->st_birthtim.tv_sec = s.st_ctim.tv_sec;
+  st->st_birthtim.tv_nsec = s.st_ctim.tv_nsec;
+#endif
+}
+
+static void ScanDirectory(DirScan* scan) {
+  ModuleArchive::Entry entry;
+  if (ModuleArchive::Find(scan->env, scan->path, &entry, &scan->err)) {
+    if (scan->err == 0 && !entry.directory)
+      scan->err = UV_ENOTDIR;
+    for (size_t i = 0; scan->err == 0 && i < entry.children->size(); i++) {
+      const std::string& name = (*entry.children)[i];
+      ModuleArchive::Entry child;
+      int err;
+      if (!ModuleArchive::Find(scan->env, scan->path + "/" + name, &child, &err) || err < 0)
+        continue;
+      scan->names.push_back(name);
+      scan->fields.resize(scan->fields.size() + kStatFieldCount);
+      FillStatsArray(&scan->fields[scan->fields.size() - kStatFieldCount], &child.stat);
+    }
+    return;
+  }
+
+  DIR* dir = opendir(scan->path.c_str());
+  if (dir == nullptr) {
+    scan->err = -errno;
+    return;
+  }
+  scan->err = 0;
+  const int fd = dirfd(dir);
+  while (const struct dirent* ent = readdir(dir)) {
+    if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+      continue;
+    struct stat s;
+    if (fstatat(fd, ent->d_name, &s, 0) < 0)
+      continue;
+    uv_stat_t st;
+    ToUVStat(s, &st);
+    scan->names.emplace_back(ent->d_name);
+    scan->fields.resize(scan->fields.size() + kStatFieldCount);
+    FillStatsArray(&scan->fields[scan->fields.size() - kStatFieldCount], &st);
+  }
+  closedir(dir);
+}
+
+// [names, Float64Array of kStatFieldCount stat fields per name], or empty on a bad encoding
+static MaybeLocal<Value> DirScanResult(Environment* env, const DirScan* scan) {
+  EscapableHandleScope scope(env->isolate());
+
+  Local<Array> names = Array::New(env->isolate(), static_cast<int>(scan->names.size()));
+  for (size_t i = 0; i < scan->names.size(); i++) {
+    Local<Value> error;
+    MaybeLocal<Value> name = StringBytes::Encode(env->isolate(), scan->names[i].c_str(),
+                                                 scan->encoding, &error);
+    if (name.IsEmpty())
+      return MaybeLocal<Value>();
+    names->Set(env->context(), static_cast<uint32_t>(i), name.ToLocalChecked()).FromJust();
+  }
+
+  const size_t bytes = scan->fields.size() * sizeof(double);
+  Local<ArrayBuffer> ab = ArrayBuffer::New(env->isolate(), bytes);
+  if (bytes > 0)
+    memcpy(ab->GetContents().Data(), &scan->fields[0], bytes);
+
+  Local<Array> result = Array::New(env->isolate(), 2);
+  result->Set(env->context(), 0, names).FromJust();
+  result->Set(env->context(), 1, Float64Array::New(ab, 0, scan->fields.size())).FromJust();
+  return scope.Escape(result);
+}
+
+static void AfterScanDirectory(uv_work_t* work, int status) {
+  std::unique_ptr<DirScan> scan(static_cast<DirScan*>(work->data));
+  FSReqWrap* req_wrap = scan->req_wrap;
+  Environment* env = req_wrap->env();
+  HandleScope handle_scope(env->isolate());
+  Context::Scope context_scope(env->context());
+
+  if (status == UV_ECANCELED)
+    scan->err = UV_ECANCELED;
+
+  int argc = 1;
+  Local<Value> argv[2];
+  Local<Value> result;
+  if (scan->err < 0) {
+    argv[0] = UVException(env->isolate(), scan->err, "scandir", nullptr, scan->path.c_str());
+  } else if (!DirScanResult(env, scan.get()).ToLocal(&result)) {
+    argv[0] = UVException(env->isolate(), UV_EINVAL, "scandir",
+                          "Invalid character encoding for filename", scan->path.c_str());
+  } else {
+    argv[0] = Null(env->isolate());
+    argv[1] = result;
+    argc = 2;
+  }
+
+  req_wrap->MakeCallback(env->oncomplete_string(), argc, argv);
+  req_wrap->Dispose();
+}
+
+static void ReadDirStat(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args);
+
+  const int argc = args.Length();
+
+  if (argc < 1)
+    return TYPE_ERROR("path required");
+
+  {
+    BufferValue path(env->isolate(), args[0]);
+    ASSERT_PATH(path)
+  }
+
+  const enum encoding encoding = ParseEncoding(env->isolate(), args[1], UTF8);
+
+  Local<Value> callback = Null(env->isolate());
+  if (argc == 3)
+    callback = args[2];
+
+  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
+  if (*path == nullptr)
+    return;
+
+  std::unique_ptr<DirScan> scan(new DirScan());
+  scan->env = env;
+  scan->encoding = encoding;
+  scan->path = *path;
+
+  if (callback->IsObject()) {
+    scan->req_wrap = FSReqWrap::New(env, callback.As<Object>(), "scandir");
+    scan->req_wrap->Dispatched();
+    scan->work.data = scan.get();
+    uv_queue_work(env->event_loop(), &scan->work,
+                  [](uv_work_t* work) {
+                    nodedroid::ScopedLoopThreadClass thread_class(work->loop);
+                    ScanDirectory(static_cast<DirScan*>(work->data));
+                  },
+                  AfterScanDirectory);
+    args.GetReturnValue().Set(scan.release()->req_wrap->persistent());
+  } else {
+    ScanDirectory(scan.get());
+    if (scan->err < 0)
+      return env->ThrowUVException(scan->err, "scandir", nullptr, *path);
+    Local<Value> result;
+    if (!DirScanResult(env, scan.get()).ToLocal(&result)) {
+      return env->ThrowUVException(UV_EINVAL, "scandir",
+                                   "Invalid character encoding for filename", *path);
+    }
+    args.GetReturnValue().Set(result);
+  }
+}
+
 static void Open(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
 
@@ -1210,6 +2247,8 @@ static void Open(const FunctionCallbackInfo<Value>& args) {
     return TYPE_ERROR("mode must be an int");
 
   int flags = args[1]->Int32Value();
+  if (flags & O_CREAT)
+    InvalidateModuleStatCache();
 
   int req_access = (flags&O_ACCMODE) == O_RDWR   ? _FS_ACCESS_RD|_FS_ACCESS_WR :
                    (flags&O_ACCMODE) == O_WRONLY ? _FS_ACCESS_WR :
@@ -1219,10 +2258,29 @@ static void Open(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
-  BufferValue path(env->isolate(), fs_(env, args[0], req_access));
 
   int mode = static_cast<int>(args[2]->Int32Value());
 
+  if (args[3]->IsObject()) {
+    ASYNC_SANDBOX_CALL(open, args[3], UTF8, args[0], req_access, flags, mode)
+  }
+  BufferValue path(env->isolate(), fs_(env, args[0], req_access));
+
+  ModuleArchive::Entry entry;
+  int archive_err;
+  if (InArchive(env, *path, &entry, &archive_err)) {
+    if (archive_err == 0 && (flags & O_CREAT) && (flags & O_EXCL))
+      archive_err = UV_EEXIST;
+    else if ((archive_err == 0 || (flags & O_CREAT)) &&
+             ((flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC)))
+      archive_err = UV_EROFS;
+    if (archive_err == 0)
+      archive_err = ModuleArchive::Open(env, entry);
+    return ArchiveResult(args, args[3], "open", archive_err, *path,
+                         archive_err < 0 ? Local<Value>() :
+                             Local<Value>(Integer::New(env->isolate(), archive_err)));
+  }
+
   if (*path != nullptr) {
       if (args[3]->IsObject()) {
         ASYNC_CALL(open, args[3], UTF8, *path, flags, mode)
@@ -1234,8 +2292,168 @@ static void Open(const FunctionCallbackInfo<Value>& args) {
 }
 
 
+// Copies are done here rather than by uv_fs_copyfile, so that the kernel moves the bytes
+// wherever it can: clonefile(2) on APFS, copy_file_range(2) or sendfile(2) on Linux.  Only
+// when none of those apply do the bytes pass through user space.  Async copies report
+// progress to req.onprogress(copied, total), if there is one, about every kCopyChunk bytes.
+static const size_t kCopyChunk = 8 * 1024 * 1024;
+
+struct FileCopy {
+  uv_work_t work;
+  uv_async_t progress;
+  FSReqWrap* req_wrap;
+  std::string src;
+  std::string dest;
+  int flags;
+  int err;
+  std::atomic<int64_t> copied;
+  int64_t total;
+};
+
+// Copies up to |len| bytes at the current file offsets.  Returns the count, 0 at the end of
+// |in_fd| or -1 with errno set.
+static ssize_t CopyChunk(int in_fd, int out_fd, size_t len, std::vector<char>* buffer) {
+  ssize_t n;
+#if defined(__linux__)
+#if defined(__NR_copy_file_range)
+  static std::atomic<bool> no_copy_range(false);
+  if (!no_copy_range) {
+    do {
+      n = syscall(__NR_copy_file_range, in_fd, nullptr, out_fd, nullptr, len, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n >= 0 || (errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+                   errno != EOPNOTSUPP))
+      return n;
+    if (errno == ENOSYS)
+      no_copy_range = true;
+  }
+#endif
+  do {
+    n = sendfile(out_fd, in_fd, nullptr, len);
+  } while (n < 0 && errno == EINTR);
+  if (n >= 0 || (errno != EINVAL && errno != ENOSYS))
+    return n;
+#endif
+  buffer->resize(MIN(len, static_cast<size_t>(1024 * 1024)));
+  do {
+    n = read(in_fd, &(*buffer)[0], buffer->size());
+  } while (n < 0 && errno == EINTR);
+  for (ssize_t written = 0; written < n; ) {
+    const ssize_t w = write(out_fd, &(*buffer)[written], n - written);
+    if (w < 0 && errno != EINTR)
+      return -1;
+    if (w > 0)
+      written += w;
+  }
+  return n;
+}
+
+static void DoFileCopy(FileCopy* copy, bool report) {
+  copy->err = 0;
+#if defined(__APPLE__)
+  // A clone shares the blocks until either side is written, and fails with EXDEV across
+  // volumes.  It won't replace an existing file, so that case is left to the long way.
+  if (clonefile(copy->src.c_str(), copy->dest.c_str(), 0) == 0)
+    return;
+#endif
+
+  const int in_fd = open(copy->src.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in_fd < 0) {
+    copy->err = -errno;
+    return;
+  }
+  struct stat st;
+  if (fstat(in_fd, &st) < 0) {
+    copy->err = -errno;
+    close(in_fd);
+    return;
+  }
+  copy->total = st.st_size;
+
+  int dest_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  if (copy->flags & UV_FS_COPYFILE_EXCL)
+    dest_flags |= O_EXCL;
+  const int out_fd = open(copy->dest.c_str(), dest_flags, st.st_mode);
+  if (out_fd < 0 || fchmod(out_fd, st.st_mode) < 0) {
+    copy->err = -errno;
+    if (out_fd >= 0) close(out_fd);
+    close(in_fd);
+    return;
+  }
+
+  std::vector<char> buffer;
+  int64_t remaining = st.st_size;
+  while (remaining > 0) {
+    const ssize_t n = CopyChunk(in_fd, out_fd, MIN(static_cast<size_t>(remaining), kCopyChunk),
+                                &buffer);
+    if (n < 0) {
+      copy->err = -errno;
+      break;
+    }
+    if (n == 0)
+      break;
+    remaining -= n;
+    copy->copied += n;
+    if (report)
+      uv_async_send(&copy->progress);
+  }
+
+  if (close(out_fd) < 0 && copy->err == 0)
+    copy->err = -errno;
+  close(in_fd);
+  if (copy->err < 0)
+    unlink(copy->dest.c_str());
+}
+
+static void OnFileCopyProgress(uv_async_t* handle) {
+  FileCopy* copy = static_cast<FileCopy*>(handle->data);
+  Environment* env = copy->req_wrap->env();
+  HandleScope handle_scope(env->isolate());
+  Context::Scope context_scope(env->context());
+
+  Local<Value> onprogress;
+  if (copy->req_wrap->object()->Get(env->context(),
+          String::NewFromUtf8(env->isolate(), "onprogress")).ToLocal(&onprogress) &&
+      onprogress->IsFunction()) {
+    Local<Value> argv[] = {
+      Number::New(env->isolate(), static_cast<double>(copy->copied)),
+      Number::New(env->isolate(), static_cast<double>(copy->total))
+    };
+    copy->req_wrap->MakeCallback(onprogress.As<Function>(), arraysize(argv), argv);
+  }
+}
+
+static void AfterFileCopy(uv_work_t* work, int status) {
+  FileCopy* copy = static_cast<FileCopy*>(work->data);
+  FSReqWrap* req_wrap = copy->req_wrap;
+  Environment* env = req_wrap->env();
+  HandleScope handle_scope(env->isolate());
+  Context::Scope context_scope(env->context());
+  InvalidateModuleStatCache();
+
+  if (status == UV_ECANCELED)
+    copy->err = UV_ECANCELED;
+
+  Local<Value> argv[1];
+  if (copy->err < 0) {
+    argv[0] = UVException(env->isolate(), copy->err, "copyfile", nullptr,
+                          copy->src.c_str(), copy->dest.c_str());
+  } else {
+    argv[0] = Null(env->isolate());
+  }
+
+  // No progress is reported once the handle is closing
+  uv_close(reinterpret_cast<uv_handle_t*>(&copy->progress), [](uv_handle_t* handle) {
+    delete static_cast<FileCopy*>(handle->data);
+  });
+
+  req_wrap->MakeCallback(env->oncomplete_string(), arraysize(argv), argv);
+  req_wrap->Dispose();
+}
+
 static void CopyFile(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
+  InvalidateModuleStatCache();
 
   if (!args[0]->IsString())
     return TYPE_ERROR("src must be a string");
@@ -1244,16 +2462,41 @@ static void CopyFile(const FunctionCallbackInfo<Value>& args) {
   if (!args[2]->IsInt32())
     return TYPE_ERROR("flags must be an int");
 
-  BufferValue src(env->isolate(), args[0]);
-  ASSERT_PATH(src)
-  BufferValue dest(env->isolate(), args[1]);
-  ASSERT_PATH(dest)
-  int flags = args[2]->Int32Value();
+  {
+    BufferValue src(env->isolate(), args[0]);
+    ASSERT_PATH(src)
+    BufferValue dest(env->isolate(), args[1]);
+    ASSERT_PATH(dest)
+  }
+  BufferValue src(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
+  BufferValue dest(env->isolate(), fs_(env, args[1], _FS_ACCESS_RD|_FS_ACCESS_WR));
+  if (*src == nullptr || *dest == nullptr)
+    return;
+
+  std::unique_ptr<FileCopy> copy(new FileCopy());
+  copy->src = *src;
+  copy->dest = *dest;
+  copy->flags = args[2]->Int32Value();
+  copy->copied = 0;
+  copy->total = 0;
 
   if (args[3]->IsObject()) {
-    ASYNC_DEST_CALL(copyfile, args[3], *dest, UTF8, *src, *dest, flags)
+    copy->req_wrap = FSReqWrap::New(env, args[3].As<Object>(), "copyfile", *dest);
+    copy->req_wrap->Dispatched();
+    copy->work.data = copy.get();
+    copy->progress.data = copy.get();
+    uv_async_init(env->event_loop(), &copy->progress, OnFileCopyProgress);
+    uv_queue_work(env->event_loop(), &copy->work,
+                  [](uv_work_t* work) {
+                    nodedroid::ScopedLoopThreadClass thread_class(work->loop);
+                    DoFileCopy(static_cast<FileCopy*>(work->data), true);
+                  },
+                  AfterFileCopy);
+    args.GetReturnValue().Set(copy.release()->req_wrap->persistent());
   } else {
-    SYNC_DEST_CALL(copyfile, *src, *dest, *src, *dest, flags)
+    DoFileCopy(copy.get(), false);
+    if (copy->err < 0)
+      env->ThrowUVException(copy->err, "copyfile", nullptr, *src, *dest);
   }
 }
 
@@ -1418,6 +2661,161 @@ static void WriteString(const FunctionCallbackInfo<Value>& args) {
   return args.GetReturnValue().Set(req_wrap->persistent());
 }
 
+// A write-combining writer for append-heavy callers such as loggers.  Writes are gathered
+// natively and reach the file as one write(2) once |capacity| bytes are pending, |flush_ms|
+// after the first of them, or on flush(), fsync() or close().  The fd is opened, and so
+// sandbox-checked, as usual; the writer takes it over and appends at its current offset.
+// An error from a deferred flush is thrown by the next call.
+class BufferedWriter : public node::BaseObject {
+ public:
+  static void Initialize(Environment* env, Local<Object> target) {
+    Local<FunctionTemplate> t = env->NewFunctionTemplate(New);
+    t->InstanceTemplate()->SetInternalFieldCount(1);
+    Local<String> name = FIXED_ONE_BYTE_STRING(env->isolate(), "BufferedWriter");
+    t->SetClassName(name);
+
+    env->SetProtoMethod(t, "write", Write);
+    env->SetProtoMethod(t, "flush", Flush);
+    env->SetProtoMethod(t, "fsync", Fsync);
+    env->SetProtoMethod(t, "close", Close);
+
+    target->Set(name, t->GetFunction());
+  }
+
+  ~BufferedWriter() override {
+    Shutdown();
+  }
+
+ private:
+  BufferedWriter(Environment* env, Local<Object> wrap, int fd, size_t capacity,
+                 unsigned flush_ms)
+      : BaseObject(env, wrap), fd_(fd), capacity_(capacity), flush_ms_(flush_ms),
+        error_(0), timer_(new uv_timer_t) {
+    MakeWeak<BufferedWriter>(this);
+    pending_.reserve(capacity_);
+    uv_timer_init(env->event_loop(), timer_);
+    uv_unref(reinterpret_cast<uv_handle_t*>(timer_));
+    timer_->data = this;
+  }
+
+  // Writes out and closes.  Returns the first error seen, if any.
+  int Shutdown() {
+    if (fd_ < 0)
+      return error_;
+    int err = FlushPending();
+    if (close(fd_) < 0 && err == 0)
+      err = -errno;
+    fd_ = -1;
+    uv_close(reinterpret_cast<uv_handle_t*>(timer_), [](uv_handle_t* handle) {
+      delete reinterpret_cast<uv_timer_t*>(handle);
+    });
+    return err;
+  }
+
+  int FlushPending() {
+    uv_timer_stop(timer_);
+    size_t written = 0;
+    while (error_ == 0 && written < pending_.size()) {
+      const ssize_t n = write(fd_, &pending_[written], pending_.size() - written);
+      if (n < 0 && errno != EINTR)
+        error_ = -errno;
+      else if (n > 0)
+        written += n;
+    }
+    pending_.clear();
+    const int err = error_;
+    error_ = 0;
+    return err;
+  }
+
+  static void OnTimer(uv_timer_t* handle) {
+    BufferedWriter* writer = static_cast<BufferedWriter*>(handle->data);
+    // Kept for the next call to report
+    writer->error_ = writer->FlushPending();
+  }
+
+  // Throws and returns false on a pending error or a closed writer
+  bool Check(int err, const char* syscall) {
+    if (fd_ < 0 && err == 0)
+      err = UV_EBADF;
+    if (err < 0)
+      env()->ThrowUVException(err, syscall);
+    return err == 0;
+  }
+
+  static void New(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args);
+    CHECK(args.IsConstructCall());
+    if (!args[0]->IsInt32())
+      return env->ThrowTypeError("First argument must be file descriptor");
+    const size_t capacity = args[1]->IsUint32() && args[1]->Uint32Value() > 0 ?
+        args[1]->Uint32Value() : 64 * 1024;
+    const unsigned flush_ms = args[2]->IsUint32() ? args[2]->Uint32Value() : 1000;
+    new BufferedWriter(env, args.This(), args[0]->Int32Value(), capacity, flush_ms);
+  }
+
+  // write(string[, encoding]) or write(buffer)
+  static void Write(const FunctionCallbackInfo<Value>& args) {
+    Environment* env = Environment::GetCurrent(args);
+    BufferedWriter* writer;
+    ASSIGN_OR_RETURN_UNWRAP(&writer, args.Holder());
+    int err = writer->error_;
+    writer->error_ = 0;
+    if (!writer->Check(err, "write"))
+      return;
+
+    const size_t start = writer->pending_.size();
+    size_t len;
+    if (node::Buffer::HasInstance(args[0])) {
+      len = node::Buffer::Length(args[0]);
+      writer->pending_.insert(writer->pending_.end(), node::Buffer::Data(args[0]),
+                              node::Buffer::Data(args[0]) + len);
+    } else {
+      const enum encoding enc = ParseEncoding(env->isolate(), args[1], UTF8);
+      writer->pending_.resize(start + StringBytes::StorageSize(env->isolate(), args[0], enc));
+      len = StringBytes::Write(env->isolate(), &writer->pending_[start],
+                               writer->pending_.size() - start, args[0], enc);
+      writer->pending_.resize(start + len);
+    }
+
+    if (writer->pending_.size() >= writer->capacity_) {
+      err = writer->FlushPending();
+    } else if (start == 0 && len > 0) {
+      uv_timer_start(writer->timer_, OnTimer, writer->flush_ms_, 0);
+    }
+    if (writer->Check(err, "write"))
+      args.GetReturnValue().Set(static_cast<double>(len));
+  }
+
+  static void Flush(const FunctionCallbackInfo<Value>& args) {
+    BufferedWriter* writer;
+    ASSIGN_OR_RETURN_UNWRAP(&writer, args.Holder());
+    if (writer->Check(0, "write"))
+      writer->Check(writer->FlushPending(), "write");
+  }
+
+  static void Fsync(const FunctionCallbackInfo<Value>& args) {
+    BufferedWriter* writer;
+    ASSIGN_OR_RETURN_UNWRAP(&writer, args.Holder());
+    if (writer->Check(0, "fsync") && writer->Check(writer->FlushPending(), "write"))
+      writer->Check(fsync(writer->fd_) < 0 ? -errno : 0, "fsync");
+  }
+
+  static void Close(const FunctionCallbackInfo<Value>& args) {
+    BufferedWriter* writer;
+    ASSIGN_OR_RETURN_UNWRAP(&writer, args.Holder());
+    if (writer->Check(0, "close"))
+      writer->Check(writer->Shutdown(), "close");
+  }
+
+  int fd_;
+  const size_t capacity_;
+  const unsigned flush_ms_;
+  int error_;
+  uv_timer_t* timer_;
+  std::vector<char> pending_;
+};
+
 
 /*
  * Wrapper for read(2).
@@ -1471,6 +2869,14 @@ static void Read(const FunctionCallbackInfo<Value>& args) {
 
   req = args[5];
 
+  if (ModuleArchive::IsArchiveFd(fd)) {
+    const int64_t count = ModuleArchive::Read(env, fd, buf, len, pos);
+    return ArchiveResult(args, req, "read", count < 0 ? static_cast<int>(count) : 0, nullptr,
+                         count < 0 ? Local<Value>() :
+                             Local<Value>(Integer::New(env->isolate(),
+                                                       static_cast<int32_t>(count))));
+  }
+
   if (req->IsObject()) {
     ASYNC_CALL(read, req, UTF8, fd, &uvbuf, 1, pos);
   } else {
@@ -1495,10 +2901,14 @@ static void Chmod(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
-  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR));
 
   int mode = static_cast<int>(args[1]->Int32Value());
 
+  if (args[2]->IsObject()) {
+    ASYNC_SANDBOX_CALL(chmod, args[2], UTF8, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR, mode)
+  }
+  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR));
+
   if (*path != nullptr) {
       if (args[2]->IsObject()) {
         ASYNC_CALL(chmod, args[2], UTF8, *path, mode);
@@ -1621,11 +3031,15 @@ static void UTimes(const FunctionCallbackInfo<Value>& args) {
     BufferValue path(env->isolate(), args[0]);
     ASSERT_PATH(path)
   }
-  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR));
 
   const double atime = static_cast<double>(args[1]->NumberValue());
   const double mtime = static_cast<double>(args[2]->NumberValue());
 
+  if (args[3]->IsObject()) {
+    ASYNC_SANDBOX_CALL(utime, args[3], UTF8, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR, atime, mtime)
+  }
+  BufferValue path(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD|_FS_ACCESS_WR));
+
   if (*path != nullptr) {
       if (args[3]->IsObject()) {
         ASYNC_CALL(utime, args[3], UTF8, *path, atime, mtime);
@@ -1665,6 +3079,7 @@ static void FUTimes(const FunctionCallbackInfo<Value>& args) {
 
 static void Mkdtemp(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
+  InvalidateModuleStatCache();
 
   CHECK_GE(args.Length(), 2);
 
@@ -1711,18 +3126,129 @@ void GetStatValues(const FunctionCallbackInfo<Value>& args) {
   args.GetReturnValue().Set(fields_array);
 }
 
-void Resolve(const FunctionCallbackInfo<Value>& args) {
+// mountArchive(archive, mountPoint) serves a ModuleArchive at |mountPoint| for the rest of the
+// environment's life, or until unmountArchive(mountPoint).  Both are sync only.
+static void MountArchive(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args);
+
+  if (args.Length() < 2)
+    return TYPE_ERROR("archive and mount point required");
+  {
+    BufferValue archive(env->isolate(), args[0]);
+    ASSERT_PATH(archive)
+    BufferValue mount_point(env->isolate(), args[1]);
+    ASSERT_PATH(mount_point)
+  }
+  BufferValue archive(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
+  if (*archive == nullptr)
+    return;
+  BufferValue mount_point(env->isolate(), fs_(env, args[1], _FS_ACCESS_RD));
+  if (*mount_point == nullptr)
+    return;
+
+  const int err = ModuleArchive::Mount(env, *archive, *mount_point);
+  if (err < 0)
+    return env->ThrowUVException(err, "mount", nullptr, *archive);
+  InvalidateModuleStatCache();
+}
+
+static void UnmountArchive(const FunctionCallbackInfo<Value>& args) {
   Environment* env = Environment::GetCurrent(args);
 
   if (args.Length() < 1)
-    return TYPE_ERROR("path required");
+    return TYPE_ERROR("mount point required");
+  {
+    BufferValue mount_point(env->isolate(), args[0]);
+    ASSERT_PATH(mount_point)
+  }
+  BufferValue mount_point(env->isolate(), fs_(env, args[0], _FS_ACCESS_RD));
+  if (*mount_point == nullptr)
+    return;
+
+  const int err = ModuleArchive::Unmount(env, *mount_point);
+  if (err < 0)
+    return env->ThrowUVException(err, "umount", nullptr, *mount_point);
+  InvalidateModuleStatCache();
+}
+
+// Sandbox resolutions of absolute paths for LiquidCore::resolve() and the fs binding's
+// resolve().  Like the stat cache, each node thread keeps its own for one environment at a
+// time; a new file system, cwd or any change to the tree throws them all away.
+struct ResolveCache {
+  uint64_t fs_generation = 0;
+  uint64_t stat_generation = 0;
+  const void *env = nullptr;
+  std::string cwd;
+  std::unordered_map<std::string, std::string> results;
+};
+static thread_local ResolveCache s_resolve_cache;
 
+static MaybeLocal<Value> ResolvePath(Environment* env, Local<Value> path) {
+  v8::Isolate* isolate = env->isolate();
   {
-    BufferValue path(env->isolate(), args[0]);
-    ASSERT_PATH(path)
+    BufferValue p(isolate, path);
+    if (*p == nullptr) {
+      TYPE_ERROR("path must be a string or Buffer");
+      return MaybeLocal<Value>();
+    }
+  }
+
+  Sandbox *sandbox = GetSandbox(env);
+  if (!sandbox || !path->IsString()) {
+    v8::TryCatch try_catch(isolate);
+    Local<Value> resolved = fs_(env, path, _FS_ACCESS_RD);
+    if (try_catch.HasCaught()) {
+      try_catch.ReThrow();
+      return MaybeLocal<Value>();
+    }
+    return resolved;
+  }
+
+  const uint64_t fs_generation = s_fs_generation;
+  const uint64_t stat_generation = s_stat_generation;
+  if (s_resolve_cache.fs_generation != fs_generation ||
+      s_resolve_cache.stat_generation != stat_generation ||
+      s_resolve_cache.env != env || s_resolve_cache.cwd != sandbox->cwd) {
+    s_resolve_cache.results.clear();
+    s_resolve_cache.fs_generation = fs_generation;
+    s_resolve_cache.stat_generation = stat_generation;
+    s_resolve_cache.env = env;
+    s_resolve_cache.cwd = sandbox->cwd;
+  }
+
+  node::Utf8Value requested(isolate, path);
+  const bool cacheable = requested.length() > 0 && (*requested)[0] == '/';
+  if (cacheable) {
+    auto hit = s_resolve_cache.results.find(*requested);
+    if (hit != s_resolve_cache.results.end()) {
+      Local<String> cached;
+      if (String::NewFromUtf8(isolate, hit->second.c_str(), v8::NewStringType::kNormal,
+                              static_cast<int>(hit->second.size())).ToLocal(&cached))
+        return cached;
+    }
+  }
+
+  v8::TryCatch try_catch(isolate);
+  Local<Value> resolved = fs_(env, path, _FS_ACCESS_RD);
+  if (try_catch.HasCaught()) {
+    try_catch.ReThrow();
+    return MaybeLocal<Value>();
   }
-  Local<Value> resolved = fs_(env, args[0], _FS_ACCESS_RD);
-  args.GetReturnValue().Set(resolved);
+  if (cacheable && resolved->IsString() && stat_generation == s_stat_generation) {
+    s_resolve_cache.results.emplace(*requested, *node::Utf8Value(isolate, resolved));
+  }
+  return resolved;
+}
+
+void Resolve(const FunctionCallbackInfo<Value>& args) {
+  Environment* env = Environment::GetCurrent(args);
+
+  if (args.Length() < 1)
+    return TYPE_ERROR("path required");
+
+  Local<Value> resolved;
+  if (ResolvePath(env, args[0]).ToLocal(&resolved))
+    args.GetReturnValue().Set(resolved);
 }
 
 void InitFs(Local<Object> target,
@@ -1742,8 +3268,13 @@ void InitFs(Local<Object> target,
   env->SetMethod(target, "rmdir", RMDir);
   env->SetMethod(target, "mkdir", MKDir);
   env->SetMethod(target, "readdir", ReadDir);
+  env->SetMethod(target, "readdirStat", ReadDirStat);
   env->SetMethod(target, "internalModuleReadFile", InternalModuleReadFile);
   env->SetMethod(target, "internalModuleStat", InternalModuleStat);
+  env->SetMethod(target, "invalidateModuleStatCache", InvalidateModuleStatCache);
+  env->SetMethod(target, "internalModuleReadCodeCache", InternalModuleReadCodeCache);
+  env->SetMethod(target, "internalModuleWriteCodeCache", InternalModuleWriteCodeCache);
+  env->SetMethod(target, "mmapReadOnly", MMapReadOnly);
   env->SetMethod(target, "stat", Stat);
   env->SetMethod(target, "lstat", LStat);
   env->SetMethod(target, "fstat", FStat);
@@ -1773,8 +3304,11 @@ void InitFs(Local<Object> target,
   env->SetMethod(target, "getStatValues", GetStatValues);
 
   env->SetMethod(target, "resolve", Resolve);
+  env->SetMethod(target, "mountArchive", MountArchive);
+  env->SetMethod(target, "unmountArchive", UnmountArchive);
 
   StatWatcher::Initialize(env, target);
+  BufferedWriter::Initialize(env, target);
 
   // Create FunctionTemplate for FSReqWrap
   Local<FunctionTemplate> fst =
@@ -1789,6 +3323,17 @@ void InitFs(Local<Object> target,
 
 }  // end namespace nodedroid
 
+v8::MaybeLocal<v8::Value> LiquidCore::resolve(v8::Local<v8::Value> filename)
+{
+  v8::Isolate* isolate = v8::Isolate::GetCurrent();
+  v8::EscapableHandleScope handle_scope(isolate);
+  node::Environment* env = node::Environment::GetCurrent(isolate);
+  v8::Local<v8::Value> resolved;
+  if (!nodedroid::ResolvePath(env, filename).ToLocal(&resolved))
+    return v8::MaybeLocal<v8::Value>();
+  return handle_scope.Escape(resolved);
+}
+
 #ifdef __APPLE__
 namespace node {
 void FillStatsArray(double* fields, const uv_stat_t* s) {
@@ -11,6 +11,10 @@
 
 #include "node.h"
 #include "v8.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
 
 namespace nodedroid {
 
@@ -25,6 +29,86 @@ v8::Local<v8::Value> chdir_(node::Environment *env, v8::Local<v8::Value> path);
 v8::Local<v8::Value> cwd_(node::Environment *env);
 void FillStatsArray(double* fields, const uv_stat_t* s);
 
+// Sandbox counters.  Each node thread reports into the block set with SetFsStats(), if any.
+struct FsStats {
+    std::atomic<uint64_t> checks {0};       // calls to fs_() and alias_()
+    std::atomic<uint64_t> check_ns {0};
+    std::atomic<uint64_t> module_reads {0};
+    std::atomic<uint64_t> module_bytes {0};
+};
+void SetFsStats(FsStats *stats);
+
+// Native form of a FileSystem object's alias and access tables.  Both are tries on path
+// components, so each lookup is a prefix match with no sorting and no call into JS.  The
+// matches are the ones the JS fs() and alias() would find: for a sandbox path, the longest
+// alias or access entry that holds it; for a real path, of the aliases whose directory holds
+// it, the one whose own (sandbox) path sorts last.  Built by Install() when the file system is
+// set; FileSystem objects without the tables keep using their JS fs() function.
+class PathPolicy {
+public:
+    static void Install(v8::Local<v8::Context> context, v8::Local<v8::Object> fsObj);
+    static PathPolicy* Get(v8::Local<v8::Context> context, v8::Local<v8::Object> fsObj);
+
+    // Real path -> sandbox path, or the path itself when no alias covers it
+    std::string ToVirtual(const std::string& real) const;
+    // Sandbox path -> real path, or the path itself when no alias covers it
+    std::string ToReal(const std::string& virt) const;
+    // Access mask (_FS_ACCESS_*) for a sandbox path
+    int Access(const std::string& virt) const;
+
+    // Resolves '.' and '..' and redundant separators in an absolute path
+    static std::string Normalize(const std::string& path);
+
+private:
+    struct Node {
+        std::unordered_map<std::string, std::unique_ptr<Node>> children;
+        bool has_target = false;
+        std::string target;
+        // The alias's key as given, for choosing between aliases of overlapping directories
+        std::string key;
+        bool has_access = false;
+        int access = 0;
+    };
+
+    static Node* Insert(Node& root, const std::string& path);
+    // The deepest node with |flag| set on the way down |path|, or, given |prefer|, the one
+    // that it prefers over all the others
+    static const Node* Match(const Node& root, const std::string& path, bool Node::*flag,
+                             size_t *matched,
+                             bool (*prefer)(const Node& a, const Node& b) = nullptr);
+
+    Node m_virtual;
+    Node m_real;
+    v8::Global<v8::Object> m_holder;
+};
+
+// The sandbox state for each node thread is resolved once from the global's FileSystem
+// object.  InvalidateSandbox() (any thread) makes every thread look it up again; call it when
+// a FileSystem object is set.  ReleaseSandbox() frees this thread's copy, and must run
+// before the isolate goes away.
+void InvalidateSandbox();
+void ReleaseSandbox();
+
+// Unmaps whatever mmapReadOnly() mapped for |env| that JS still holds.  Those buffers are left
+// over memory that is gone, so this must be called once no more JS will run, before the
+// isolate goes away.
+void ReleaseMappedFiles(node::Environment *env);
+
+// Drops every cached InternalModuleStat() result, on all node threads.  Safe to call from
+// any thread; needed whenever the sandbox mapping changes.
+void InvalidateModuleStatCache();
+
+// Keeps compiled module code in |dir| (a real path, outside any sandbox) for every process,
+// instead of under each sandbox's /home/cache.  Entries are then keyed on the source file's
+// identity rather than its path, so services sharing one hard-linked copy of a bundle also
+// share its code cache.  Pass nullptr to go back to per-sandbox caches.
+void SetSharedCodeCacheDir(const char *dir);
+
+// The real directory for cache |name|: under the shared code cache directory if one is set,
+// otherwise /home/cache/|name| in |env|'s sandbox.  False if the sandbox doesn't allow it.
+// The directory itself may not exist yet.
+bool CacheDir(node::Environment *env, const char *name, std::string *dir);
+
 extern "C" node::node_module fs_module;
 
 }  // namespace nodedroid
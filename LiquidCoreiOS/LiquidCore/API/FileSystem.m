@@ -6,6 +6,8 @@
  */
 #import <Foundation/Foundation.h>
 #import <JavaScriptCore/JavaScriptCore.h>
+#include <limits.h>
+#include <stdlib.h>
 #import "FileSystem.h"
 
 @protocol FileSystemExports <JSExport>
@@ -23,13 +25,14 @@
 @property (nonatomic, copy) NSString *uniqueID;
 @property (nonatomic, copy) NSString *sessionID;
 
-@property (class, atomic, readonly) NSMutableArray* activeSessions;
+@property (class, atomic, readonly) NSMutableSet* activeSessions;
 
 - (id) initWithContext:(JSContext*)context
               uniqueID:(NSString*)uniqueID
        mediaAccessMask:(MediaAccessMask)mask;
 - (void) setUp:(JSContext*)context mediaAccessMask:(MediaAccessMask)mask;
 + (void) sessionWatchdog;
++ (NSString*) realHome;
 @end
 
 @implementation FileSystem
@@ -72,6 +75,20 @@
 
 - (void) realDir:(NSString*) ios
 {
+    // Everything is under the home directory, whose symlinks are already resolved.  What is
+    // left to do is fold the empty components, as realpath would.
+    NSString *home = NSHomeDirectory();
+    if ([ios hasPrefix:home]) {
+        NSString *rest = [ios substringFromIndex:home.length];
+        while ([rest rangeOfString:@"//"].location != NSNotFound) {
+            rest = [rest stringByReplacingOccurrencesOfString:@"//" withString:@"/"];
+        }
+        [self append:@"'"];
+        [self append:[FileSystemImpl realHome]];
+        [self append:rest];
+        [self append:@"'"];
+        return;
+    }
     [self append:@"(function(){try {return fs.realpathSync('"];
     [self append:ios];
     [self append:@"');}catch(e){}})()"];
@@ -140,9 +157,19 @@
 @end
 
 @implementation FileSystemImpl
-static NSMutableArray* _activeSessions = nil;
+static NSMutableSet* _activeSessions = nil;
 static NSDate* lastBark;
 
+// Sessions left behind by earlier runs, still to be deleted.  Known from the journal, which
+// records each session as it is created (+id) and deleted (-id), so that a sweep never has
+// to list the sessions directory.  Guarded by @synchronized on the class, as is the journal.
+static NSMutableArray* deadSessions = nil;
+static const NSUInteger kSweepBatch = 64;
+
+// Written into a service's Library/Caches directory once its own directories are made, and
+// taken with them by uninstallLocal.  Bump the version whenever setUp's layout changes.
+static NSString* const kLayoutVersion = @"1";
+
 static NSString* fs_code =
 @"((()=>{const path=require('path'); return function(file){"
 @"if (!file.startsWith('/')) { file = ''+this.cwd+'/'+file; }"
@@ -200,16 +227,20 @@ static NSString* alias_code =
     self = [super init];
     if (self) {
         
-        // clear any dead sessions
-        [FileSystemImpl sessionWatchdog];
-        
         _uniqueID = uniqueID;
         _sessionID = [[NSUUID UUID] UUIDString];
-        if (_activeSessions == nil) {
-            _activeSessions = [[NSMutableArray alloc] init];
-            lastBark = [NSDate dateWithTimeIntervalSince1970:0];
+        @synchronized ([FileSystemImpl class]) {
+            if (_activeSessions == nil) {
+                _activeSessions = [[NSMutableSet alloc] init];
+                lastBark = [NSDate dateWithTimeIntervalSince1970:0];
+                [FileSystemImpl loadJournal];
+            }
+            [_activeSessions addObject:_sessionID];
+            [FileSystemImpl journal:@"+" session:_sessionID];
         }
-        [FileSystemImpl.activeSessions addObject:_sessionID];
+
+        // clear any dead sessions
+        [FileSystemImpl sessionWatchdog];
         
         [self setUp:context mediaAccessMask:mask];
     }
@@ -228,44 +259,50 @@ static NSString* alias_code =
     NSString* public_data = [NSString stringWithFormat:@"%@/Documents/%@", homedir, suffix];
  
     JSBuilder* js = [[JSBuilder alloc] init];
-    
+
+    // The service's own directories outlive its sessions.  Once made, they are known from the
+    // stamp and left alone; only the session's part of the tree is made each time.
+    NSString *module = [NSString stringWithFormat:@"%@/module", localPath];
+    NSString *node_modules = [NSString stringWithFormat:@"%@/node_modules", localPath];
+    NSString *cache = [NSString stringWithFormat:@"%@/cache", path];
+    NSString *local = [NSString stringWithFormat:@"%@/local", localPath];
+    NSArray *persistent = @[ module, node_modules, cache, local, public_data ];
+    NSString *stampPath = [NSString stringWithFormat:@"%@/.layout", path];
+    NSString *layout = [NSString stringWithFormat:@"%@\n%@", kLayoutVersion,
+                        [persistent componentsJoinedByString:@"\n"]];
+    NSString *stamp = [NSString stringWithContentsOfFile:stampPath
+                                                encoding:NSUTF8StringEncoding
+                                                   error:nil];
+    if (![layout isEqualToString:stamp]) {
+        BOOL made = YES;
+        for (NSString *dir in persistent) {
+            NSError *error;
+            if (![[NSFileManager defaultManager] createDirectoryAtPath:dir
+                                           withIntermediateDirectories:YES
+                                                            attributes:nil
+                                                                 error:&error])
+            {
+                NSLog(@"Create directory error: %@", error);
+                made = NO;
+            }
+        }
+        if (made) {
+            [layout writeToFile:stampPath atomically:YES encoding:NSUTF8StringEncoding error:nil];
+        }
+    }
+
     // Set up /home (read-only)
     [js mkdir:@"/home" ios:[NSString stringWithFormat:@"%@/home", sessionPath] mask:PermissionsRead];
 
     // Set up /home/module (read-only)
-    NSError *error;
-    NSString *module = [NSString stringWithFormat:@"%@/module", localPath];
     self.modulePath = module;
-    if (![[NSFileManager defaultManager] createDirectoryAtPath:module
-                                   withIntermediateDirectories:YES
-                                                    attributes:nil
-                                                         error:&error])
-    {
-        NSLog(@"Create directory error: %@", error);
-    }
-    else
-    {
-        //NSLog(@"mkdir: Created directory %@", module);
-    }
     [js symlink:@"/home/module"
          target:module
        linkpath:[NSString stringWithFormat:@"%@/home/module", sessionPath]
            mask:PermissionsRead];
 
     // Set up /home/node_modules (read-only)
-    NSString *node_modules = [NSString stringWithFormat:@"%@/node_modules", localPath];
     self.node_modulesPath = node_modules;
-    if (![[NSFileManager defaultManager] createDirectoryAtPath:node_modules
-                                   withIntermediateDirectories:YES
-                                                    attributes:nil
-                                                         error:&error])
-    {
-        NSLog(@"Create directory error: %@", error);
-    }
-    else
-    {
-        //NSLog(@"mkdir: Created directory %@", module);
-    }
     [js symlink:@"/home/node_modules"
          target:node_modules
        linkpath:[NSString stringWithFormat:@"%@/home/node_modules", sessionPath]
@@ -277,28 +314,29 @@ static NSString* alias_code =
                linkpath:[NSString stringWithFormat:@"%@/home/temp", sessionPath]
                    mask:PermissionsRW];
     // Set up /home/cache (read/write)
-    [js mkdirAndSymlink:@"/home/cache"
-                 target:[NSString stringWithFormat:@"%@/cache", path]
-               linkpath:[NSString stringWithFormat:@"%@/home/cache", sessionPath]
-                   mask:PermissionsRW];
+    [js symlink:@"/home/cache"
+         target:cache
+       linkpath:[NSString stringWithFormat:@"%@/home/cache", sessionPath]
+           mask:PermissionsRW];
     // Set up /home/local (read/write)
-    [js mkdirAndSymlink:@"/home/local"
-                    target:[NSString stringWithFormat:@"%@/local", localPath]
-               linkpath:[NSString stringWithFormat:@"%@/home/local", sessionPath]
-                   mask:PermissionsRW];
+    [js symlink:@"/home/local"
+         target:local
+       linkpath:[NSString stringWithFormat:@"%@/home/local", sessionPath]
+           mask:PermissionsRW];
     
     // Set up /home/public (read-only)
     [js mkdir:@"/home/public" ios:[NSString stringWithFormat:@"%@/home/public", sessionPath] mask:PermissionsRead];
     
     // Set up /home/public/data
-    [js mkdirAndSymlink:@"/home/public/data"
-                 target:public_data
-               linkpath:[NSString stringWithFormat:@"%@/home/public/data", sessionPath]
-                   mask:mask];
+    [js symlink:@"/home/public/data"
+         target:public_data
+       linkpath:[NSString stringWithFormat:@"%@/home/public/data", sessionPath]
+           mask:mask];
 
     _cwd = @"/home";
-    _fs = [context evaluateScript:fs_code];
-    _alias = [context evaluateScript:alias_code];
+    JSValue *policy = [context evaluateScript:[FileSystemImpl policyCode]];
+    _fs = policy[0];
+    _alias = policy[1];
     
     context[@"fs_"] = self;
     [context evaluateScript:js.js];
@@ -306,11 +344,103 @@ static NSString* alias_code =
     [[context globalObject] deleteProperty:@"fs_"];
 }
 
-+ (NSMutableArray *)activeSessions
+// fs_code and alias_code as one script, so that a session parses and runs one, not two
++ (NSString *)policyCode
+{
+    static NSString *code;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        code = [NSString stringWithFormat:@"[%@,%@]", fs_code, alias_code];
+    });
+    return code;
+}
+
+// The home directory as fs.realpathSync() would have it, resolved once per run rather than
+// for each alias of each session
++ (NSString *)realHome
+{
+    static NSString *realHome;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        NSString *home = NSHomeDirectory();
+        char resolved[PATH_MAX];
+        if (realpath(home.fileSystemRepresentation, resolved)) {
+            realHome = [[NSFileManager defaultManager]
+                stringWithFileSystemRepresentation:resolved length:strlen(resolved)];
+        } else {
+            realHome = home;
+        }
+    });
+    return realHome;
+}
+
++ (NSMutableSet *)activeSessions
 {
     return _activeSessions;
 }
 
++ (NSString *)sessionsPath
+{
+    return [NSString stringWithFormat:@"%@/tmp/__org.liquidplayer.node__/sessions", NSHomeDirectory()];
+}
+
++ (NSString *)journalPath
+{
+    return [NSString stringWithFormat:@"%@/.journal", [FileSystemImpl sessionsPath]];
+}
+
++ (void)journal:(NSString *)op session:(NSString *)sessionId
+{
+    NSFileHandle *journal = [NSFileHandle fileHandleForWritingAtPath:[FileSystemImpl journalPath]];
+    [journal seekToEndOfFile];
+    [journal writeData:[[NSString stringWithFormat:@"%@%@\n", op, sessionId]
+                        dataUsingEncoding:NSUTF8StringEncoding]];
+    [journal closeFile];
+}
+
+// Called once per run, before any session of this run exists.  Every session the journal
+// has no deletion for is dead.  The journal is then rewritten to hold just those, so it
+// doesn't grow without bound.  Without a journal, the directory is listed this one time.
++ (void)loadJournal
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    NSString *journalPath = [FileSystemImpl journalPath];
+    NSMutableOrderedSet *dead = [[NSMutableOrderedSet alloc] init];
+
+    NSString *journal = [NSString stringWithContentsOfFile:journalPath
+                                                  encoding:NSUTF8StringEncoding
+                                                     error:nil];
+    if (journal != nil) {
+        for (NSString *line in [journal componentsSeparatedByString:@"\n"]) {
+            if (line.length < 2) continue;
+            NSString *sessionId = [line substringFromIndex:1];
+            if ([line hasPrefix:@"+"]) {
+                [dead addObject:sessionId];
+            } else {
+                [dead removeObject:sessionId];
+            }
+        }
+    } else {
+        for (NSString *path in [fileManager contentsOfDirectoryAtPath:[FileSystemImpl sessionsPath]
+                                                                error:nil]) {
+            if (![path hasPrefix:@"."]) {
+                [dead addObject:path];
+            }
+        }
+    }
+    deadSessions = [[NSMutableArray alloc] initWithArray:dead.array];
+
+    NSMutableString *rewritten = [[NSMutableString alloc] init];
+    for (NSString *sessionId in deadSessions) {
+        [rewritten appendFormat:@"+%@\n", sessionId];
+    }
+    [fileManager createDirectoryAtPath:[FileSystemImpl sessionsPath]
+           withIntermediateDirectories:YES
+                            attributes:nil
+                                 error:nil];
+    [rewritten writeToFile:journalPath atomically:YES encoding:NSUTF8StringEncoding error:nil];
+}
+
 + (void)uninstallSession:(NSString *)sessionId
 {
     NSError *error = nil;
@@ -324,28 +454,43 @@ static NSString* alias_code =
     }
 }
 
+// Deletes at most kSweepBatch dead sessions per run.  If more remain, the next batch follows
+// shortly, at background priority, rather than waiting for the next watchdog period.
++ (void)sweepDeadSessions
+{
+    NSArray *batch;
+    @synchronized ([FileSystemImpl class]) {
+        NSRange range = NSMakeRange(0, MIN(kSweepBatch, deadSessions.count));
+        batch = [deadSessions subarrayWithRange:range];
+        [deadSessions removeObjectsInRange:range];
+    }
+    for (NSString *sessionId in batch) {
+        [FileSystemImpl uninstallSession:sessionId];
+        @synchronized ([FileSystemImpl class]) {
+            [FileSystemImpl journal:@"-" session:sessionId];
+        }
+    }
+    @synchronized ([FileSystemImpl class]) {
+        if (deadSessions.count > 0) {
+            dispatch_after(dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC),
+                           dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+                [FileSystemImpl sweepDeadSessions];
+            });
+        }
+    }
+}
+
 + (void)sessionWatchdog
 {
-    if ([lastBark timeIntervalSinceNow] < -5 * 60) {
-        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-            NSString* homedir = NSHomeDirectory();
-            NSString* sessions = [NSString stringWithFormat:@"%@/tmp/__org.liquidplayer.node__/sessions", homedir];
-
-            NSFileManager *fileManager = [NSFileManager defaultManager];
-            
-            NSDirectoryEnumerator * enumerator = [fileManager enumeratorAtPath:sessions];
-            [enumerator skipDescendants];
-            NSString* path;
-            while (path = [enumerator nextObject])
-            {
-                if (![path containsString:@"/"] &&
-                    ![FileSystemImpl.activeSessions containsObject:path]) {
-                    [FileSystemImpl uninstallSession:path];
-                }
-            }
-            lastBark = [NSDate dateWithTimeIntervalSinceNow:0];
-        });
+    @synchronized ([FileSystemImpl class]) {
+        if ([lastBark timeIntervalSinceNow] >= -5 * 60 || deadSessions.count == 0) {
+            return;
+        }
+        lastBark = [NSDate dateWithTimeIntervalSinceNow:0];
     }
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        [FileSystemImpl sweepDeadSessions];
+    });
 }
 
 + (void)uninstallLocal:(NSString *)uniqueID
@@ -370,10 +515,19 @@ static NSString* alias_code =
 
 - (void)cleanUp
 {
-    bool needClean = [FileSystemImpl.activeSessions containsObject:self.sessionID];
+    NSString *sessionId = self.sessionID;
+    bool needClean;
+    @synchronized ([FileSystemImpl class]) {
+        needClean = [_activeSessions containsObject:sessionId];
+        [_activeSessions removeObject:sessionId];
+    }
     if (needClean) {
-        [FileSystemImpl.activeSessions removeObject:self.sessionID];
-        [FileSystemImpl uninstallSession:self.sessionID];
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [FileSystemImpl uninstallSession:sessionId];
+            @synchronized ([FileSystemImpl class]) {
+                [FileSystemImpl journal:@"-" session:sessionId];
+            }
+        });
     }
 }
 
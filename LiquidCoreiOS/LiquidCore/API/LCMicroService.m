@@ -9,6 +9,12 @@
 #import <LiquidCore/LiquidCore.h>
 #import "LCProcess.h"
 #import "LCAddOn.h"
+#import "LCChannel.h"
+#import <sys/xattr.h>
+#import <CommonCrypto/CommonDigest.h>
+#import <stdatomic.h>
+#import "NodeBridge.h"
+#import <JavaScriptCore/JSTypedArray.h>
 
 @interface LCAddOnFactory()
 @property (atomic, readonly, class) NSMutableDictionary *factories;
@@ -17,10 +23,649 @@
 @interface LCMicroService() <LCProcessDelegate>
 @property (atomic, assign, readonly, class) NSMutableDictionary *serviceMap;
 @property (nonatomic) JSValue *emitter;
+@property (nonatomic) JSValue *batchEmitter;
 @property (atomic, readwrite) LCProcess *process;
-@property (atomic, assign) bool fetched;
 @property (atomic) NSMutableArray* eventListeners;
-- (NSError*) fetchService;
+- (void) fetchService:(void (^)(NSError*))completion;
+- (void) emitData:(NSString*)event data:(NSData*)data;
+- (void) addDataEventListener:(NSString*)event
+                     listener:(id<LCMicroServiceEventListener>)listener;
+@end
+
+// An emit() waiting for the next flush.  'args' is a retained @[event] or @[event, payload].
+typedef struct LCQueuedEvent {
+    struct LCQueuedEvent *next;
+    CFTypeRef args;
+} LCQueuedEvent;
+
+typedef void (^LCDownloadCompletion)(NSError* error, NSInteger status, NSString* validator);
+
+// Streams a download straight to |localPath|.  The body goes to a ".partial" file beside it,
+// which is renamed into place once complete.  If a download is cut short, the partial file
+// keeps the response validator (ETag, or else Last-Modified) in an extended attribute, so
+// the next attempt asks for just the rest with Range/If-Range.  A delta (226 IM Used) is
+// downloaded the same way, but never resumed, since it only applies to the copy it was
+// made against.
+@interface LCServiceDownload : NSObject <NSURLSessionDataDelegate>
+- (id) initWithRequest:(NSMutableURLRequest*)request
+             localPath:(NSString*)localPath
+            completion:(LCDownloadCompletion)completion;
+- (void) start;
+@end
+
+// Service bundles, stored once per content digest and hard linked into each service's module
+// directory, so that services (and instances) using the same bundle share one copy and, with
+// the shared code cache, one set of compiled code.  The index maps each service URI to its
+// digest and validator.  When a URI already has a copy, the service starts on it at once and
+// the copy is revalidated alongside; an update is picked up by the next start.  Only one
+// revalidation per URI is ever in flight.
+//
+// A revalidation offers to take the update as a delta against the copy it has (RFC 3229, with
+// "A-IM: lcdiff" beside If-None-Match).  An lcdiff is
+//
+//     "LCDF"  base SHA-256 (32 bytes)  bundle SHA-256 (32 bytes)  bundle length (uint64)
+//
+// followed by ops, each 'C' offset length (copy that much of the base) or 'A' length bytes
+// (add those bytes), with every integer little endian.  It is applied off the main thread
+// and the result is only stored if it hashes to what the delta says it makes; otherwise the
+// bundle is downloaded whole.
+@interface LCBundleStore : NSObject
++ (void) fetch:(NSMutableURLRequest*)request
+          into:(NSString*)localPath
+    completion:(void (^)(NSError*))completion;
+@end
+
+static const char kValidatorAttr[] = "org.liquidplayer.validator";
+
+static NSString* getValidator(NSString* path)
+{
+    char value[1024];
+    ssize_t size = getxattr(path.fileSystemRepresentation, kValidatorAttr, value, sizeof value, 0, 0);
+    return size > 0 ?
+        [[NSString alloc] initWithBytes:value length:size encoding:NSUTF8StringEncoding] : nil;
+}
+
+static void setValidator(NSString* path, NSString* validator)
+{
+    if (validator) {
+        const char *value = validator.UTF8String;
+        setxattr(path.fileSystemRepresentation, kValidatorAttr, value, strlen(value), 0, 0);
+    } else {
+        removexattr(path.fileSystemRepresentation, kValidatorAttr, 0);
+    }
+}
+
+@implementation LCServiceDownload {
+    NSMutableURLRequest* request_;
+    NSString* localPath_;
+    NSString* partialPath_;
+    LCDownloadCompletion completion_;
+    NSFileHandle* file_;
+    NSInteger status_;
+    NSString* validator_;
+    unsigned long long resumeFrom_;
+}
+
+- (id) initWithRequest:(NSMutableURLRequest*)request
+             localPath:(NSString*)localPath
+            completion:(LCDownloadCompletion)completion
+{
+    self = [super init];
+    if (self) {
+        request_ = request;
+        localPath_ = localPath;
+        partialPath_ = [localPath stringByAppendingString:@".partial"];
+        completion_ = completion;
+        status_ = 0;
+        resumeFrom_ = 0;
+    }
+    return self;
+}
+
+- (void) start
+{
+    NSFileManager* fileManager = [NSFileManager defaultManager];
+    NSString* partialValidator = getValidator(partialPath_);
+    unsigned long long partialSize =
+        [[fileManager attributesOfItemAtPath:partialPath_ error:nil] fileSize];
+
+    if (partialValidator && partialSize > 0) {
+        // Resume.  Byte ranges are of the encoded body, so ask for it unencoded.
+        resumeFrom_ = partialSize;
+        [request_ setValue:[NSString stringWithFormat:@"bytes=%llu-", partialSize]
+        forHTTPHeaderField:@"Range"];
+        [request_ setValue:partialValidator forHTTPHeaderField:@"If-Range"];
+        [request_ setValue:@"identity" forHTTPHeaderField:@"Accept-Encoding"];
+        [request_ setValue:nil forHTTPHeaderField:@"If-Modified-Since"];
+        [request_ setValue:nil forHTTPHeaderField:@"If-None-Match"];
+    }
+
+    NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+    NSURLSession *session = [NSURLSession sessionWithConfiguration:configuration
+                                                          delegate:self
+                                                     delegateQueue:nil];
+    [[session dataTaskWithRequest:request_] resume];
+    [session finishTasksAndInvalidate];
+}
+
+- (void)URLSession:(NSURLSession *)session
+          dataTask:(NSURLSessionDataTask *)dataTask
+didReceiveResponse:(NSURLResponse *)response
+ completionHandler:(void (^)(NSURLSessionResponseDisposition))completionHandler
+{
+    NSHTTPURLResponse *http = (NSHTTPURLResponse*)response;
+    NSDictionary *headers = http.allHeaderFields;
+    status_ = http.statusCode;
+    validator_ = headers[@"ETag"] ? headers[@"ETag"] : headers[@"Last-Modified"];
+
+    if (status_ == 206 && resumeFrom_ > 0 &&
+        [headers[@"Content-Range"] hasPrefix:[NSString stringWithFormat:@"bytes %llu-", resumeFrom_]]) {
+        file_ = [NSFileHandle fileHandleForWritingAtPath:partialPath_];
+        [file_ seekToFileOffset:resumeFrom_];
+    } else if (status_ == 200 || status_ == 226) {
+        [[NSFileManager defaultManager] createFileAtPath:partialPath_ contents:nil attributes:nil];
+        file_ = [NSFileHandle fileHandleForWritingAtPath:partialPath_];
+        setValidator(partialPath_, status_ == 200 ? validator_ : nil);
+    } else {
+        // 304 (nothing changed), a range we can't use, or a failure: either way, no body
+        if (status_ == 206) {
+            [[NSFileManager defaultManager] removeItemAtPath:partialPath_ error:nil];
+        }
+        completionHandler(NSURLSessionResponseCancel);
+        return;
+    }
+    completionHandler(file_ ? NSURLSessionResponseAllow : NSURLSessionResponseCancel);
+}
+
+- (void)URLSession:(NSURLSession *)session
+          dataTask:(NSURLSessionDataTask *)dataTask
+    didReceiveData:(NSData *)data
+{
+    [file_ writeData:data];
+}
+
+- (void)URLSession:(NSURLSession *)session
+              task:(NSURLSessionTask *)task
+didCompleteWithError:(NSError *)error
+{
+    NSFileManager* fileManager = [NSFileManager defaultManager];
+    NSError* result = nil;
+
+    [file_ closeFile];
+    if (file_ && error == nil) {
+        [fileManager removeItemAtPath:localPath_ error:nil];
+        [fileManager moveItemAtPath:partialPath_ toPath:localPath_ error:&result];
+        removexattr(localPath_.fileSystemRepresentation, kValidatorAttr, 0);
+    } else if (file_) {
+        // Cut short; the partial file stays to be resumed
+        result = error;
+    } else if (status_ != 304) {
+        result = (error && error.code != NSURLErrorCancelled) ? error :
+            [NSError errorWithDomain:NSURLErrorDomain
+                                code:NSURLErrorBadServerResponse
+                            userInfo:@{NSLocalizedDescriptionKey:
+                                        [NSHTTPURLResponse localizedStringForStatusCode:status_]}];
+    }
+    file_ = nil;
+
+    LCDownloadCompletion completion = completion_;
+    completion_ = nil;
+    if (completion) completion(result, status_, validator_);
+}
+@end
+
+@implementation LCBundleStore
+
+static NSMutableDictionary* bundleIndex = nil;      // URI -> @{ digest, validator }
+static NSMutableDictionary* revalidating = nil;     // URI -> waiters, @[ localPath, completion ]
+
++ (NSString*) storePath
+{
+    return [NSString stringWithFormat:@"%@/Library/__org.liquidplayer.node__/bundles",
+            NSHomeDirectory()];
+}
+
++ (NSString*) indexPath
+{
+    return [[LCBundleStore storePath] stringByAppendingPathComponent:@"index.plist"];
+}
+
+// Called with the class lock held
++ (void) setUp
+{
+    if (bundleIndex != nil) return;
+    NSString* store = [LCBundleStore storePath];
+    NSString* codeCache = [store stringByAppendingPathComponent:@"code-cache"];
+    [[NSFileManager defaultManager] createDirectoryAtPath:codeCache
+                              withIntermediateDirectories:YES
+                                               attributes:nil
+                                                    error:nil];
+    process_set_shared_code_cache(codeCache.fileSystemRepresentation);
+
+    bundleIndex = [[NSMutableDictionary alloc] initWithContentsOfFile:[LCBundleStore indexPath]];
+    if (bundleIndex == nil) {
+        bundleIndex = [[NSMutableDictionary alloc] init];
+    }
+    revalidating = [[NSMutableDictionary alloc] init];
+}
+
+static NSString* hexDigest(const unsigned char *md)
+{
+    NSMutableString* digest = [[NSMutableString alloc] init];
+    for (int i = 0; i < CC_SHA256_DIGEST_LENGTH; i++) {
+        [digest appendFormat:@"%02x", md[i]];
+    }
+    return digest;
+}
+
+static uint64_t readLE64(const uint8_t *p)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
++ (NSString*) digestOfFile:(NSString*)path
+{
+    NSFileHandle* file = [NSFileHandle fileHandleForReadingAtPath:path];
+    if (file == nil) return nil;
+
+    CC_SHA256_CTX ctx;
+    CC_SHA256_Init(&ctx);
+    for (;;) {
+        @autoreleasepool {
+            NSData* chunk = [file readDataOfLength:1024 * 1024];
+            if (chunk.length == 0) break;
+            CC_SHA256_Update(&ctx, chunk.bytes, (CC_LONG)chunk.length);
+        }
+    }
+    [file closeFile];
+
+    unsigned char md[CC_SHA256_DIGEST_LENGTH];
+    CC_SHA256_Final(md, &ctx);
+    return hexDigest(md);
+}
+
+// Rebuilds a bundle into |output| from the stored copy |baseDigest| and the lcdiff at
+// |patchPath|.  Fails unless the delta was made against that copy and the result is the
+// bundle it says it makes.
++ (NSError*) applyPatch:(NSString*)patchPath base:(NSString*)baseDigest output:(NSString*)output
+{
+    NSError* corrupt = [NSError errorWithDomain:NSCocoaErrorDomain
+                                           code:NSFileReadCorruptFileError
+                                       userInfo:nil];
+    if (baseDigest == nil) return corrupt;
+    NSString* basePath = [[LCBundleStore storePath] stringByAppendingPathComponent:baseDigest];
+    NSData* base = [NSData dataWithContentsOfFile:basePath options:NSDataReadingMappedIfSafe
+                                            error:nil];
+    NSData* patch = [NSData dataWithContentsOfFile:patchPath options:NSDataReadingMappedIfSafe
+                                             error:nil];
+    const size_t header = 4 + 2 * CC_SHA256_DIGEST_LENGTH + 8;
+    if (base == nil || patch.length < header || memcmp(patch.bytes, "LCDF", 4)) return corrupt;
+
+    const uint8_t *p = patch.bytes;
+    const uint8_t *end = p + patch.length;
+    if (![hexDigest(p + 4) isEqualToString:baseDigest]) return corrupt;
+    NSString* target = hexDigest(p + 4 + CC_SHA256_DIGEST_LENGTH);
+    const uint64_t targetLength = readLE64(p + 4 + 2 * CC_SHA256_DIGEST_LENGTH);
+    p += header;
+
+    FILE* out = fopen(output.fileSystemRepresentation, "wb");
+    if (out == NULL) return [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+    const uint8_t *from = base.bytes;
+    uint64_t written = 0;
+    bool ok = true;
+    while (ok && p < end) {
+        const uint8_t op = *p++;
+        uint64_t length = 0;
+        if (op == 'C' && end - p >= 16) {
+            const uint64_t offset = readLE64(p);
+            length = readLE64(p + 8);
+            p += 16;
+            ok = offset <= base.length && length <= base.length - offset &&
+                fwrite(from + offset, 1, length, out) == length;
+        } else if (op == 'A' && end - p >= 8) {
+            length = readLE64(p);
+            p += 8;
+            ok = length <= (uint64_t)(end - p) && fwrite(p, 1, length, out) == length;
+            if (ok) p += length;
+        } else {
+            ok = false;
+        }
+        written += length;
+    }
+    ok = fclose(out) == 0 && ok && written == targetLength &&
+        [[LCBundleStore digestOfFile:output] isEqualToString:target];
+    if (!ok) {
+        [[NSFileManager defaultManager] removeItemAtPath:output error:nil];
+        return corrupt;
+    }
+    return nil;
+}
+
+// Replaces |localPath| with a link to the stored copy for |uri|
++ (NSError*) link:(NSString*)uri into:(NSString*)localPath
+{
+    NSString* digest;
+    @synchronized ([LCBundleStore class]) {
+        digest = bundleIndex[uri][@"digest"];
+    }
+    NSString* blob = digest ? [[LCBundleStore storePath] stringByAppendingPathComponent:digest] : nil;
+    if (blob == nil || ![[NSFileManager defaultManager] fileExistsAtPath:blob]) {
+        return [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileNoSuchFileError userInfo:nil];
+    }
+
+    NSError* error = nil;
+    NSString* temp = [localPath stringByAppendingString:@".link"];
+    [[NSFileManager defaultManager] removeItemAtPath:temp error:nil];
+    if ([[NSFileManager defaultManager] linkItemAtPath:blob toPath:temp error:&error] &&
+        rename(temp.fileSystemRepresentation, localPath.fileSystemRepresentation) != 0) {
+        error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+    }
+    return error;
+}
+
++ (void) fetch:(NSMutableURLRequest*)request
+          into:(NSString*)localPath
+    completion:(void (^)(NSError*))completion
+{
+    NSString* uri = request.URL.absoluteString;
+    bool start;
+    bool have;
+    NSString* validator;
+    NSString* base;
+    @synchronized ([LCBundleStore class]) {
+        [LCBundleStore setUp];
+        validator = bundleIndex[uri][@"validator"];
+        base = bundleIndex[uri][@"digest"];
+        have = [LCBundleStore link:uri into:localPath] == nil;
+        start = revalidating[uri] == nil;
+        if (start) {
+            revalidating[uri] = [[NSMutableArray alloc] init];
+        }
+        if (!have) {
+            [revalidating[uri] addObject:@[localPath, completion]];
+        }
+    }
+    if (have) {
+        completion(nil);
+    }
+    if (!start) return;
+
+    if (have && ([validator hasPrefix:@"\""] || [validator hasPrefix:@"W/"])) {
+        [request setValue:validator forHTTPHeaderField:@"If-None-Match"];
+        [request setValue:@"lcdiff" forHTTPHeaderField:@"A-IM"];
+    } else {
+        base = nil;
+    }
+    NSString* staging = [[LCBundleStore storePath] stringByAppendingPathComponent:
+                         [NSString stringWithFormat:@"%lx.download", (unsigned long)uri.hash]];
+    [LCBundleStore download:request uri:uri base:base staging:staging];
+}
+
+// Completes the revalidation of |uri|.  With |base| set, the request has offered to take a
+// delta against that copy.
++ (void) download:(NSMutableURLRequest*)request
+              uri:(NSString*)uri
+             base:(NSString*)base
+          staging:(NSString*)staging
+{
+    [[[LCServiceDownload alloc] initWithRequest:request
+                                      localPath:staging
+                                     completion:^(NSError* error, NSInteger status, NSString* newValidator)
+    {
+        NSFileManager* fileManager = [NSFileManager defaultManager];
+        if (error == nil && status == 226) {
+            // Still on the download's own queue, so the patch is applied in the background
+            NSString* patched = [staging stringByAppendingString:@".patched"];
+            error = [LCBundleStore applyPatch:staging base:base output:patched];
+            [fileManager removeItemAtPath:staging error:nil];
+            if (error == nil) {
+                [fileManager moveItemAtPath:patched toPath:staging error:&error];
+            }
+            if (error != nil && base != nil) {
+                // A delta that doesn't apply is no worse than none; fetch the whole bundle
+                [request setValue:nil forHTTPHeaderField:@"A-IM"];
+                [request setValue:nil forHTTPHeaderField:@"If-None-Match"];
+                [LCBundleStore download:request uri:uri base:nil staging:staging];
+                return;
+            }
+        }
+        if (error == nil && status != 304) {
+            NSString* digest = [LCBundleStore digestOfFile:staging];
+            NSString* blob = [[LCBundleStore storePath] stringByAppendingPathComponent:digest];
+            if (digest == nil) {
+                error = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadUnknownError userInfo:nil];
+            } else if ([fileManager fileExistsAtPath:blob]) {
+                [fileManager removeItemAtPath:staging error:nil];
+            } else {
+                [fileManager moveItemAtPath:staging toPath:blob error:&error];
+            }
+            if (error == nil) {
+                @synchronized ([LCBundleStore class]) {
+                    NSMutableDictionary* entry = [[NSMutableDictionary alloc] init];
+                    entry[@"digest"] = digest;
+                    if (newValidator) entry[@"validator"] = newValidator;
+                    bundleIndex[uri] = entry;
+                    [bundleIndex writeToFile:[LCBundleStore indexPath] atomically:YES];
+                }
+            }
+        }
+
+        NSArray* waiters;
+        @synchronized ([LCBundleStore class]) {
+            waiters = revalidating[uri];
+            [revalidating removeObjectForKey:uri];
+        }
+        // A copy from before the store (or an older one) still beats no service at all
+        for (NSArray* waiter in waiters) {
+            NSError* linked = [LCBundleStore link:uri into:waiter[0]];
+            void (^done)(NSError*) = waiter[1];
+            bool exists = [[NSFileManager defaultManager] fileExistsAtPath:waiter[0]];
+            done(exists ? nil : error ? error : linked);
+        }
+    }] start];
+}
+@end
+
+/*
+ * Shared layout: a header for each ring, then the host-to-service data, then the
+ * service-to-host data.  Indices are free-running and masked by the (power of two) capacity.
+ * Each frame is a 32-bit length and the payload, padded to 4 bytes.  A frame never wraps; if
+ * it won't fit before the end, a wrap marker sends the reader back to the start.  JS reads and
+ * writes the indices with Atomics, which order them against the frames the way the host's
+ * acquire loads and release stores do.
+ */
+typedef struct LCRing {
+    _Atomic uint32_t head;  // written by the producer
+    _Atomic uint32_t tail;  // written by the consumer
+    uint32_t capacity;
+    uint32_t reserved;
+} LCRing;
+
+static const uint32_t kRingHeaderSize = 2 * sizeof(LCRing);
+static const uint32_t kWrapMarker = 0xFFFFFFFF;
+
+static inline uint32_t frameSize(uint32_t length)
+{
+    return 4 + ((length + 3) & ~3u);
+}
+
+static uint8_t* ringReserve(LCRing *ring, uint8_t *data, uint32_t head, uint32_t length,
+                            uint32_t *newHead)
+{
+    uint32_t total = frameSize(length);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t pos = head & (ring->capacity - 1);
+    uint32_t skip = ring->capacity - pos < total ? ring->capacity - pos : 0;
+    if (total > ring->capacity || (head - tail) + skip + total > ring->capacity) {
+        return NULL;
+    }
+    if (skip) {
+        *(uint32_t*)(data + pos) = kWrapMarker;
+        head += skip;
+        pos = 0;
+    }
+    *(uint32_t*)(data + pos) = length;
+    *newHead = head + total;
+    return data + pos + 4;
+}
+
+// JS holds a reference to the channel through its ArrayBuffer
+static void releaseChannel(void* bytes, void* channel)
+{
+    CFBridgingRelease(channel);
+}
+
+static void releaseData(void* bytes, void* data)
+{
+    CFBridgingRelease(data);
+}
+
+@interface LCChannel()
+- (id) init:(LCMicroService*)service name:(NSString*)name capacity:(uint32_t)capacity;
+- (void) attach:(JSContext*)context;
+@end
+
+@implementation LCChannel {
+    __weak LCMicroService *service_;
+    uint8_t *memory_;
+    uint32_t capacity_;
+    uint32_t pendingHead_;
+    bool reserved_;
+    // Set while a drain is scheduled on the node thread, so that a burst of frames rings once
+    atomic_bool doorbell_;
+}
+
+- (id) init:(LCMicroService*)service name:(NSString*)name capacity:(uint32_t)capacity
+{
+    self = [super init];
+    if (self) {
+        uint32_t size = 64;
+        while (size < capacity && size < 0x40000000) size <<= 1;
+        service_ = service;
+        _name = name;
+        capacity_ = size;
+        memory_ = calloc(1, kRingHeaderSize + 2 * (size_t)size);
+        [self ring:0]->capacity = size;
+        [self ring:1]->capacity = size;
+        reserved_ = false;
+        atomic_init(&doorbell_, false);
+    }
+    return self;
+}
+
+- (void) dealloc
+{
+    free(memory_);
+}
+
+- (LCRing*) ring:(int)which
+{
+    return &((LCRing*)memory_)[which];
+}
+
+- (uint8_t*) data:(int)which
+{
+    return memory_ + kRingHeaderSize + which * capacity_;
+}
+
+- (BOOL) send:(const void*)bytes length:(uint32_t)length
+{
+    void *frame = [self reserve:length];
+    if (frame == NULL) return NO;
+    memcpy(frame, bytes, length);
+    [self commit];
+    return YES;
+}
+
+- (void*) reserve:(uint32_t)length
+{
+    LCRing *ring = [self ring:0];
+    uint32_t head = reserved_ ? pendingHead_ : atomic_load_explicit(&ring->head, memory_order_relaxed);
+    void *frame = ringReserve(ring, [self data:0], head, length, &pendingHead_);
+    if (frame) reserved_ = true;
+    return frame;
+}
+
+- (void) commit
+{
+    if (!reserved_) return;
+    reserved_ = false;
+    atomic_store_explicit(&[self ring:0]->head, pendingHead_, memory_order_release);
+    if (!atomic_exchange(&doorbell_, true)) {
+        [self ringDoorbell];
+    }
+}
+
+- (void) ringDoorbell
+{
+    LCMicroService *service = service_;
+    if (!service.process) {
+        atomic_store(&doorbell_, false);
+        return;
+    }
+    [service.process async:^(JSContext* context) {
+        atomic_store(&self->doorbell_, false);
+        [[self jsChannel] invokeMethod:@"_drain" withArguments:@[]];
+    }];
+}
+
+- (JSValue*) jsChannel
+{
+    JSValue *channels = service_.emitter[@"_channels"];
+    return channels.isObject ? channels[self.name] : nil;
+}
+
+- (NSUInteger) receive:(void (^)(const void *bytes, uint32_t length))handler
+{
+    LCRing *ring = [self ring:1];
+    uint8_t *data = [self data:1];
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    NSUInteger frames = 0;
+    while (tail != head) {
+        uint32_t pos = tail & (capacity_ - 1);
+        uint32_t length = *(uint32_t*)(data + pos);
+        if (length == kWrapMarker) {
+            tail += capacity_ - pos;
+            continue;
+        }
+        handler(data + pos + 4, length);
+        tail += frameSize(length);
+        frames ++;
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    return frames;
+}
+
+// Called on the node thread once the service has started
+- (void) attach:(JSContext*)context
+{
+    __weak LCChannel *weakSelf = self;
+    // JS stores its own indices; this only tells the host that there are frames to read
+    JSValue *commit = [JSValue valueWithObject:^{
+        LCChannel *channel = weakSelf;
+        if (!channel) return;
+        void (^onReadable)(LCChannel*) = channel.onReadable;
+        if (onReadable) onReadable(channel);
+    } inContext:context];
+
+    JSValueRef exception = NULL;
+    JSObjectRef buffer = JSObjectMakeArrayBufferWithBytesNoCopy(context.JSGlobalContextRef,
+        memory_, kRingHeaderSize + 2 * (size_t)capacity_, releaseChannel,
+        (void*)CFBridgingRetain(self), &exception);
+    if (exception) {
+        CFBridgingRelease((__bridge CFTypeRef)self);
+        context.exception = [JSValue valueWithJSValueRef:exception inContext:context];
+        return;
+    }
+    [service_.emitter invokeMethod:@"_openChannel" withArguments:@[
+        self.name, [JSValue valueWithJSValueRef:buffer inContext:context], commit
+    ]];
+}
 @end
 
 @implementation LCMicroService {
@@ -29,6 +674,8 @@
     bool started_;
     NSArray* argv_;
     NSString* module_;
+    // Lock-free stack of events emitted since the last flush, newest first
+    _Atomic(LCQueuedEvent *) queuedEvents_;
 }
 static NSMutableDictionary* _serviceMap = nil;
 + (NSMutableDictionary *)serviceMap { return _serviceMap; }
@@ -108,20 +755,21 @@ static NSMutableDictionary* _serviceMap = nil;
             _serviceMap = [[NSMutableDictionary alloc] init];
         }
         _emitter = nil;
+        _batchEmitter = nil;
+        atomic_init(&queuedEvents_, NULL);
         started_ = false;
         _process = nil;
-        _fetched = false;
         _eventListeners = [[NSMutableArray alloc] init];
         [LCMicroService.serviceMap setObject:self forKey:self.instanceId];
     }
     return self;
 }
 
-- (NSError*) fetchService
+- (void) fetchService:(void (^)(NSError*))completion
 {
     NSString *localPath = [NSString stringWithFormat:@"%@/%@", self.process.modulePath, module_];
     NSFileManager* fileManager = [NSFileManager defaultManager];
-    NSError __block *error = nil;
+    NSError *error = nil;
     
     if ([self.serviceURI isFileURL]) {
         // Symlink file for speed
@@ -131,7 +779,7 @@ static NSMutableDictionary* _serviceMap = nil;
         if (error == nil) {
             [fileManager createSymbolicLinkAtURL:[NSURL fileURLWithPath:localPath] withDestinationURL:self.serviceURI error:&error];
         }
-        self.fetched = true;
+        completion(error);
     } else {
         NSDate* lastModified = nil;
         if ([fileManager fileExistsAtPath:localPath]) {
@@ -160,35 +808,8 @@ static NSMutableDictionary* _serviceMap = nil;
         [request setValue:userAgent forHTTPHeaderField:@"User-Agent"];
         [request setHTTPMethod:@"GET"];
         
-        NSURLSessionConfiguration *configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
-        NSURLSession *session = [NSURLSession sessionWithConfiguration:configuration delegate:nil delegateQueue:nil];
-        NSURLSessionDownloadTask *downloadTask =
-        [session downloadTaskWithRequest:request
-                   completionHandler:^(NSURL *location, NSURLResponse *response, NSError *e)
-        {
-            NSHTTPURLResponse *http = (NSHTTPURLResponse*)response;
-            error = nil;
-            if (http.statusCode == 200) {
-                if ([[NSFileManager defaultManager] fileExistsAtPath:localPath]) {
-                    [[NSFileManager defaultManager] removeItemAtPath:localPath error:nil];
-                }
-                [[NSFileManager defaultManager] moveItemAtURL:location
-                                                        toURL:[NSURL fileURLWithPath:localPath]
-                                                        error:nil];
-            } else if (http.statusCode != 304) { // 304 just means the file has not changed
-                error = e;
-            }
-            self.fetched = true;
-        }];
-        [downloadTask resume];
-    }
-    
-    // This needs to be synchronous
-    volatile bool fetched = self.fetched;
-    while (!fetched) {
-        fetched = self.fetched;
+        [LCBundleStore fetch:request into:localPath completion:completion];
     }
-    return error;
 }
 
 - (JSValue*) bindings:(JSContext*)context
@@ -224,11 +845,98 @@ static NSMutableDictionary* _serviceMap = nil;
 
 - (void) onProcessStart:(LCProcess*)process context:(JSContext*)context
 {
+    // Nothing can be emitted without an emitter, so whatever is queued is left over from an
+    // earlier process.  Whoever created this one may not have stored it yet, and events can
+    // be queued as soon as the emitter is set, so store it here first.
+    [self takeQueuedEvents];
+    self.process = process;
+
     // Create LiquidCore EventEmitter
     [context evaluateScript:
      @"class LiquidCore_ extends require('events') {}\n"
      @"global.LiquidCore = new LiquidCore_();"];
     self.emitter = context[@"LiquidCore"];
+    // Re-dispatches a batch of queued events.  One listener throwing doesn't stop the rest.
+    self.batchEmitter = [context evaluateScript:
+     @"((emitter) => (batch) => {\n"
+     @"  let error;\n"
+     @"  for (let i = 0; i < batch.length; i++) {\n"
+     @"    try { emitter.emit.apply(emitter, batch[i]); }\n"
+     @"    catch (e) { if (error === undefined) error = e; }\n"
+     @"  }\n"
+     @"  if (error !== undefined) throw error;\n"
+     @"})(LiquidCore)"];
+    // Anything that got in without seeing a process would otherwise never be flushed
+    if (atomic_load(&queuedEvents_)) {
+        [self scheduleFlush:process];
+    }
+    // The JS end of an LCChannel.  See LCChannel for the memory layout.
+    [context evaluateScript:
+     @"(() => {\n"
+     @"  const HEADER = 32, WRAP = 0xFFFFFFFF;\n"
+     @"  class LiquidCoreChannel_ extends require('events') {\n"
+     @"    constructor(name, buffer, commit) {\n"
+     @"      super();\n"
+     @"      this.name = name;\n"
+     @"      this.bytes = new Uint8Array(buffer);\n"
+     @"      this._view = new DataView(buffer);\n"
+     @"      this._header = new Uint32Array(buffer, 0, 8);\n"
+     @"      this._capacity = this._header[2];\n"
+     @"      this._commit = commit;\n"
+     @"      this._head = -1;\n"
+     @"    }\n"
+     @"    _drain() {\n"
+     @"      const cap = this._capacity, mask = cap - 1, head = Atomics.load(this._header, 0);\n"
+     @"      let tail = Atomics.load(this._header, 1);\n"
+     @"      if (tail === head) return;\n"
+     @"      try {\n"
+     @"        while (tail !== head) {\n"
+     @"          const pos = tail & mask, length = this._view.getUint32(HEADER + pos, true);\n"
+     @"          if (length === WRAP) { tail = (tail + cap - pos) >>> 0; continue; }\n"
+     @"          tail = (tail + 4 + ((length + 3) & ~3)) >>> 0;\n"
+     @"          this.emit('frame', this.bytes, HEADER + pos + 4, length);\n"
+     @"        }\n"
+     @"      } finally {\n"
+     @"        Atomics.store(this._header, 1, tail);\n"
+     @"      }\n"
+     @"    }\n"
+     @"    reserve(length) {\n"
+     @"      const cap = this._capacity, mask = cap - 1, base = HEADER + cap;\n"
+     @"      const total = 4 + ((length + 3) & ~3);\n"
+     @"      let head = this._head >= 0 ? this._head : Atomics.load(this._header, 4);\n"
+     @"      const pos = head & mask, skip = cap - pos < total ? cap - pos : 0;\n"
+     @"      const used = (head - Atomics.load(this._header, 5)) >>> 0;\n"
+     @"      if (total > cap || used + skip + total > cap) return -1;\n"
+     @"      if (skip) { this._view.setUint32(base + pos, WRAP, true); head = (head + skip) >>> 0; }\n"
+     @"      const at = base + (head & mask);\n"
+     @"      this._view.setUint32(at, length, true);\n"
+     @"      this._head = (head + total) >>> 0;\n"
+     @"      return at + 4;\n"
+     @"    }\n"
+     @"    commit() {\n"
+     @"      if (this._head < 0) return;\n"
+     @"      Atomics.store(this._header, 4, this._head);\n"
+     @"      this._head = -1;\n"
+     @"      this._commit();\n"
+     @"    }\n"
+     @"    write(data) {\n"
+     @"      const src = ArrayBuffer.isView(data) ?\n"
+     @"        new Uint8Array(data.buffer, data.byteOffset, data.byteLength) : new Uint8Array(data);\n"
+     @"      const at = this.reserve(src.length);\n"
+     @"      if (at < 0) return false;\n"
+     @"      this.bytes.set(src, at);\n"
+     @"      this.commit();\n"
+     @"      return true;\n"
+     @"    }\n"
+     @"  }\n"
+     @"  LiquidCore._channels = {};\n"
+     @"  LiquidCore._openChannel = (name, buffer, commit) => {\n"
+     @"    const channel = new LiquidCoreChannel_(name, buffer, commit);\n"
+     @"    LiquidCore._channels[name] = channel;\n"
+     @"    LiquidCore.emit('channel', channel);\n"
+     @"    channel._drain();\n"
+     @"  };\n"
+     @"})()"];
     
     // Override require() function to handle module binding
     JSValue* require = context[@"require"];
@@ -241,9 +949,20 @@ static NSMutableDictionary* _serviceMap = nil;
                          [require JSValueRef]);
     context[@"require"] = bindings;
     
+    // Fetching is asynchronous; the loop is held open until the service is running
+    id<LoopPreserver> preserver = [process keepAlive];
+    [self fetchService:^(NSError* error) {
+        [process async:^(JSContext* ctx) {
+            [self runService:process context:ctx error:error];
+            [preserver letDie];
+        }];
+    }];
+}
+
+- (void) runService:(LCProcess*)process context:(JSContext*)context error:(NSError*)error
+{
     @try
     {
-        NSError* error = [self fetchService];
         if (error) @throw error;
         
         if( delegate_ && [delegate_ respondsToSelector:@selector(onStart:)]) {
@@ -282,6 +1001,8 @@ static NSMutableDictionary* _serviceMap = nil;
 {
     delegate_ = nil;
     self.emitter = nil;
+    self.batchEmitter = nil;
+    [self takeQueuedEvents];
     [LCMicroService.serviceMap removeObjectForKey:serviceId_];
     self.process = nil;
 }
@@ -312,11 +1033,32 @@ static NSMutableDictionary* _serviceMap = nil;
 
 - (void) addEventListener:(NSString*)event
                  listener:(id<LCMicroServiceEventListener>)listener
+{
+    [self addEventListener:event listener:listener binary:NO];
+}
+
+/*
+ * As addEventListener, except that an ArrayBuffer or typed array payload arrives as NSData over
+ * the JS buffer's own bytes, which stays alive and pinned for as long as the NSData does.
+ * Writes to the buffer from JS show through it.
+ */
+- (void) addDataEventListener:(NSString*)event
+                     listener:(id<LCMicroServiceEventListener>)listener
+{
+    [self addEventListener:event listener:listener binary:YES];
+}
+
+- (void) addEventListener:(NSString*)event
+                 listener:(id<LCMicroServiceEventListener>)listener
+                   binary:(BOOL)binary
 {
     if (self.emitter != nil) {
         [self.process sync:^(JSContext *context) {
             JSValue *jsListener = [JSValue valueWithObject:^(JSValue *value) {
-                if ([value isBoolean]) {
+                NSData *data = binary ? [LCMicroService dataFromValue:value] : nil;
+                if (data) {
+                    [listener onEvent:self event:event payload:data];
+                } else if ([value isBoolean]) {
                     [listener onEvent:self event:event payload:[NSNumber numberWithBool:[value toBool]]];
                 } else if ([value isNumber]) {
                     [listener onEvent:self event:event payload:[value toNumber]];
@@ -337,6 +1079,52 @@ static NSMutableDictionary* _serviceMap = nil;
     }
 }
 
+// The bytes behind an ArrayBuffer or a view of one, without copying them; nil for anything else
++ (NSData*) dataFromValue:(JSValue*)value
+{
+    if (![value isObject]) return nil;
+    JSContextRef ctx = value.context.JSGlobalContextRef;
+    JSObjectRef object = JSValueToObject(ctx, value.JSValueRef, NULL);
+    JSTypedArrayType type = JSValueGetTypedArrayType(ctx, value.JSValueRef, NULL);
+    uint8_t *bytes;
+    size_t length;
+    if (type == kJSTypedArrayTypeNone) {
+        return nil;
+    } else if (type == kJSTypedArrayTypeArrayBuffer) {
+        // Both of these pin the buffer
+        bytes = JSObjectGetArrayBufferBytesPtr(ctx, object, NULL);
+        length = JSObjectGetArrayBufferByteLength(ctx, object, NULL);
+    } else {
+        bytes = (uint8_t*) JSObjectGetTypedArrayBytesPtr(ctx, object, NULL) +
+            JSObjectGetTypedArrayByteOffset(ctx, object, NULL);
+        length = JSObjectGetTypedArrayByteLength(ctx, object, NULL);
+    }
+    if (!bytes) return [NSData data];
+    // The deallocator holds on to the JS value
+    return [[NSData alloc] initWithBytesNoCopy:bytes length:length
+                                   deallocator:^(void *bytes, NSUInteger length) {
+                                       (void) value;
+                                   }];
+}
+
+// An ArrayBuffer over |data|'s bytes, which holds |data| until JS lets go of it
++ (JSValue*) arrayBufferWithData:(NSData*)data context:(JSContext*)context
+{
+    static uint8_t empty;
+    // A mutable one could change under JS; an immutable one copies for free
+    data = [data copy];
+    JSValueRef exception = NULL;
+    JSObjectRef buffer = JSObjectMakeArrayBufferWithBytesNoCopy(context.JSGlobalContextRef,
+        data.length ? (void*) data.bytes : &empty, data.length, releaseData,
+        (void*) CFBridgingRetain(data), &exception);
+    if (exception) {
+        CFBridgingRelease((__bridge CFTypeRef) data);
+        context.exception = [JSValue valueWithJSValueRef:exception inContext:context];
+        return [JSValue valueWithUndefinedInContext:context];
+    }
+    return [JSValue valueWithJSValueRef:buffer inContext:context];
+}
+
 - (void) removeEventListener:(NSString*)event
                     listener:(id<LCMicroServiceEventListener>)listener
 {
@@ -352,49 +1140,123 @@ static NSMutableDictionary* _serviceMap = nil;
     }
 }
 
+/*
+ * Events are queued here and handed to JS in one call per loop turn, so that high-frequency
+ * events cost one loop hop and one marshaling pass per batch
+ */
+- (void) queueEvent:(NSArray*)args
+{
+    LCQueuedEvent *e = malloc(sizeof(LCQueuedEvent));
+    e->args = CFBridgingRetain(args);
+    LCQueuedEvent *head = atomic_load_explicit(&queuedEvents_, memory_order_relaxed);
+    do {
+        e->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&queuedEvents_, &head, e,
+                                                    memory_order_release, memory_order_relaxed));
+
+    // Only the event that started the batch needs to schedule a flush.  If there is no
+    // process to schedule it on, onProcessStart: does it once there is.
+    if (head == NULL) {
+        [self scheduleFlush:self.process];
+    }
+}
+
+- (void) scheduleFlush:(LCProcess*)process
+{
+    [process async:^(JSContext* context) {
+        NSArray *batch = [self takeQueuedEvents];
+        if (self.batchEmitter && batch.count) {
+            [self.batchEmitter callWithArguments:@[[self bridgeData:batch context:context]]];
+        }
+    }];
+}
+
+// |batch|, with each NSData payload swapped for an ArrayBuffer over it
+- (NSArray*) bridgeData:(NSArray*)batch context:(JSContext*)context
+{
+    NSMutableArray *bridged = nil;
+    for (NSUInteger i = 0; i < batch.count; i++) {
+        NSArray *args = batch[i];
+        if (args.count < 2 || ![args[1] isKindOfClass:[NSData class]]) continue;
+        if (!bridged) bridged = [batch mutableCopy];
+        bridged[i] = @[args[0], [LCMicroService arrayBufferWithData:args[1] context:context]];
+    }
+    return bridged ? bridged : batch;
+}
+
+// Empties the queue, returning what was in it in the order it was emitted
+- (NSArray*) takeQueuedEvents
+{
+    LCQueuedEvent *e = atomic_exchange_explicit(&queuedEvents_, NULL, memory_order_acquire);
+    NSMutableArray *newestFirst = [[NSMutableArray alloc] init];
+    while (e) {
+        LCQueuedEvent *next = e->next;
+        [newestFirst addObject:CFBridgingRelease(e->args)];
+        free(e);
+        e = next;
+    }
+    return [[newestFirst reverseObjectEnumerator] allObjects];
+}
+
+- (void) dealloc
+{
+    [self takeQueuedEvents];
+}
+
+- (LCChannel*) openChannel:(NSString*)name capacity:(uint32_t)capacity
+{
+    if (!self.process) return nil;
+    LCChannel *channel = [[LCChannel alloc] init:self name:name capacity:capacity];
+    [self.process async:^(JSContext* context) {
+        if (self.emitter) [channel attach:context];
+    }];
+    return channel;
+}
+
 - (void) emit:(NSString*)event
 {
     if (self.emitter) {
-        [self.process async:^(JSContext* context) {
-            [self.emitter invokeMethod:@"emit" withArguments:@[event]];
-        }];
+        [self queueEvent:@[event]];
     }
 }
 
 - (void) emitObject:(NSString*)event object:(id)object
 {
     if (self.emitter) {
-        [self.process async:^(JSContext* context) {
-            [self.emitter invokeMethod:@"emit" withArguments:@[event, object]];
-        }];
+        [self queueEvent:@[event, object]];
     }
 }
 
 - (void) emitNumber:(NSString*)event number:(NSNumber*)number
 {
     if (self.emitter) {
-        [self.process async:^(JSContext* context) {
-            [self.emitter invokeMethod:@"emit" withArguments:@[event, number]];
-        }];
+        [self queueEvent:@[event, number]];
     }
 }
 
 - (void) emitString:(NSString*)event string:(NSString*)string
 {
     if (self.emitter) {
-        [self.process async:^(JSContext* context) {
-            [self.emitter invokeMethod:@"emit" withArguments:@[event, string]];
-        }];
+        [self queueEvent:@[event, string]];
+    }
+}
+
+/*
+ * The service's listener gets an ArrayBuffer over |data|'s own bytes, which are not copied and
+ * must be treated as read-only
+ */
+- (void) emitData:(NSString*)event data:(NSData*)data
+{
+    if (self.emitter) {
+        [self queueEvent:@[event, data]];
     }
 }
 
 - (void) emitBoolean:(NSString*)event boolean:(BOOL)boolean
 {
     if (self.emitter) {
-        [self.process async:^(JSContext* context) {
-            [self.emitter invokeMethod:@"emit" withArguments:@[event, [JSValue valueWithBool:boolean
-                                                                                   inContext:context]]];
-        }];
+        // Boolean NSNumbers are converted to JS booleans
+        [self queueEvent:@[event, [NSNumber numberWithBool:boolean]]];
     }
 }
 
@@ -288,6 +288,27 @@ static void callback_(void *data)
     process_async(processRef_, callback_, (__bridge_retained void*)wrap);
 }
 
+- (void) setThrottle:(unsigned)minIntervalMs
+{
+    if ([self active]) {
+        process_set_throttle(processRef_, minIntervalMs);
+    }
+}
+
+- (void) setThreadClass:(int)threadClass
+{
+    if ([self active]) {
+        process_set_thread_class(processRef_, threadClass);
+    }
+}
+
+- (void) notifyIdle:(unsigned)deadlineMs
+{
+    if ([self active]) {
+        process_notify_idle(processRef_, deadlineMs);
+    }
+}
+
 - (void) exit:(int)code
 {
     if ([self active]) {
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#include <JavaScriptCore/JavaScript.h>
+#include <CommonCrypto/CommonCryptor.h>
+#include <CommonCrypto/CommonDigest.h>
+#include <CommonCrypto/CommonHMAC.h>
+#include <Security/SecRandom.h>
+#include <algorithm>
+#include <limits>
+#include "NativeCrypto.h"
+
+/*
+ * NativeCrypto over CommonCrypto and the system random source.  CommonCrypto has no public
+ * GCM, so AES-GCM stays with OpenSSL.
+ */
+
+namespace nodedroid {
+
+namespace {
+
+// CommonCrypto's digests take their lengths as 32 bits
+const size_t kMaxUpdate = std::numeric_limits<CC_LONG>::max();
+
+template <typename Context,
+          int (*InitFn)(Context*),
+          int (*UpdateFn)(Context*, const void*, CC_LONG),
+          int (*FinalFn)(unsigned char*, Context*)>
+class CommonDigest : public NativeCrypto::Digest {
+public:
+    CommonDigest() { InitFn(&m_context); }
+    bool Update(const unsigned char *data, size_t length) override
+    {
+        while (length) {
+            const size_t chunk = std::min(length, kMaxUpdate);
+            UpdateFn(&m_context, data, (CC_LONG) chunk);
+            data += chunk;
+            length -= chunk;
+        }
+        return true;
+    }
+    bool Final(unsigned char *out) override
+    {
+        return FinalFn(out, &m_context) == 1;
+    }
+private:
+    Context m_context;
+};
+
+class CommonHmac : public NativeCrypto::Digest {
+public:
+    CommonHmac(CCHmacAlgorithm algorithm, const unsigned char *key, size_t key_length)
+    {
+        CCHmacInit(&m_context, algorithm, key, key_length);
+    }
+    bool Update(const unsigned char *data, size_t length) override
+    {
+        CCHmacUpdate(&m_context, data, length);
+        return true;
+    }
+    bool Final(unsigned char *out) override
+    {
+        CCHmacFinal(&m_context, out);
+        return true;
+    }
+private:
+    CCHmacContext m_context;
+};
+
+// Made on first use, once the padding is settled
+class CommonCipher : public NativeCrypto::Cipher {
+public:
+    explicit CommonCipher(const Params& params) : Cipher(params) {}
+    ~CommonCipher() override
+    {
+        if (m_cryptor) CCCryptorRelease(m_cryptor);
+    }
+    bool SetAAD(const unsigned char *data, size_t length) override
+    {
+        return false;
+    }
+    bool Update(const unsigned char *data, size_t length,
+                std::vector<unsigned char>& out) override
+    {
+        if (!Create()) return false;
+        const size_t start = out.size();
+        out.resize(start + CCCryptorGetOutputLength(m_cryptor, length, false));
+        size_t moved = 0;
+        if (CCCryptorUpdate(m_cryptor, data, length, out.data() + start, out.size() - start,
+                            &moved) != kCCSuccess) {
+            return false;
+        }
+        out.resize(start + moved);
+        return true;
+    }
+    bool Final(std::vector<unsigned char>& out) override
+    {
+        if (!Create()) return false;
+        const size_t start = out.size();
+        out.resize(start + CCCryptorGetOutputLength(m_cryptor, 0, true));
+        size_t moved = 0;
+        if (CCCryptorFinal(m_cryptor, out.data() + start, out.size() - start,
+                           &moved) != kCCSuccess) {
+            return false;
+        }
+        out.resize(start + moved);
+        return true;
+    }
+
+private:
+    bool Create()
+    {
+        if (m_cryptor) return true;
+        const bool cbc = params.mode == NativeCrypto::kCBC;
+        return CCCryptorCreateWithMode(
+            params.encrypt ? kCCEncrypt : kCCDecrypt,
+            cbc ? kCCModeCBC : kCCModeCTR,
+            kCCAlgorithmAES,
+            cbc && params.padding ? ccPKCS7Padding : ccNoPadding,
+            params.iv.data(), params.key.data(), params.key.size(),
+            nullptr, 0, 0,
+            cbc ? 0 : kCCModeOptionCTR_BE,
+            &m_cryptor) == kCCSuccess;
+    }
+
+    CCCryptorRef m_cryptor = nullptr;
+};
+
+} /* namespace */
+
+std::unique_ptr<NativeCrypto::Digest> NativeCrypto::NewHash(Algorithm algorithm)
+{
+    switch (algorithm) {
+        case kSHA1:
+            return std::unique_ptr<Digest>(new CommonDigest<CC_SHA1_CTX,
+                CC_SHA1_Init, CC_SHA1_Update, CC_SHA1_Final>());
+        case kSHA256:
+            return std::unique_ptr<Digest>(new CommonDigest<CC_SHA256_CTX,
+                CC_SHA256_Init, CC_SHA256_Update, CC_SHA256_Final>());
+        case kSHA512:
+            return std::unique_ptr<Digest>(new CommonDigest<CC_SHA512_CTX,
+                CC_SHA512_Init, CC_SHA512_Update, CC_SHA512_Final>());
+    }
+    return nullptr;
+}
+
+std::unique_ptr<NativeCrypto::Digest> NativeCrypto::NewHmac(Algorithm algorithm,
+    const unsigned char *key, size_t key_length)
+{
+    CCHmacAlgorithm cc_algorithm;
+    switch (algorithm) {
+        case kSHA1:   cc_algorithm = kCCHmacAlgSHA1; break;
+        case kSHA256: cc_algorithm = kCCHmacAlgSHA256; break;
+        case kSHA512: cc_algorithm = kCCHmacAlgSHA512; break;
+        default: return nullptr;
+    }
+    return std::unique_ptr<Digest>(new CommonHmac(cc_algorithm, key, key_length));
+}
+
+std::unique_ptr<NativeCrypto::Cipher> NativeCrypto::NewCipher(const Cipher::Params& params)
+{
+    if (params.mode == kGCM) return nullptr;
+    return std::unique_ptr<Cipher>(new CommonCipher(params));
+}
+
+bool NativeCrypto::RandomFill(unsigned char *out, size_t length)
+{
+    return !length || SecRandomCopyBytes(kSecRandomDefault, length, out) == errSecSuccess;
+}
+
+} /* namespace nodedroid */
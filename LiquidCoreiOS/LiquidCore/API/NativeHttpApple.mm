@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#import <Foundation/Foundation.h>
+#include <JavaScriptCore/JavaScript.h>
+#include <map>
+#include "NativeHttp.h"
+
+/*
+ * NativeHttp over one NSURLSession shared by every instance, so that they share its
+ * connections too.  The delegate hands each task's events straight to its request.
+ */
+
+using nodedroid::NativeHttp;
+
+namespace {
+std::mutex s_tasks_mutex;
+std::map<NSUInteger, std::shared_ptr<NativeHttp::Request>> s_tasks;
+
+std::shared_ptr<NativeHttp::Request> TaskRequest(NSURLSessionTask *task, bool remove)
+{
+    std::lock_guard<std::mutex> lock(s_tasks_mutex);
+    auto found = s_tasks.find(task.taskIdentifier);
+    if (found == s_tasks.end()) return nullptr;
+    std::shared_ptr<NativeHttp::Request> request = found->second;
+    if (remove) s_tasks.erase(found);
+    return request;
+}
+} /* namespace */
+
+@interface LCNativeHttpDelegate : NSObject <NSURLSessionDataDelegate>
+@end
+
+@implementation LCNativeHttpDelegate
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask
+didReceiveResponse:(NSURLResponse *)response
+ completionHandler:(void (^)(NSURLSessionResponseDisposition))completionHandler
+{
+    std::shared_ptr<NativeHttp::Request> request = TaskRequest(dataTask, false);
+    if (request) {
+        int status = 0;
+        NativeHttp::Headers headers;
+        if ([response isKindOfClass:[NSHTTPURLResponse class]]) {
+            NSHTTPURLResponse *http = (NSHTTPURLResponse *) response;
+            status = (int) http.statusCode;
+            [http.allHeaderFields enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+                headers.emplace_back([[key description] UTF8String],
+                                     [[value description] UTF8String]);
+            }];
+        }
+        NSString *url = response.URL.absoluteString ?: @"";
+        request->OnResponse(status, std::move(headers), url.UTF8String);
+    }
+    completionHandler(request ? NSURLSessionResponseAllow : NSURLSessionResponseCancel);
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask
+    didReceiveData:(NSData *)data
+{
+    std::shared_ptr<NativeHttp::Request> request = TaskRequest(dataTask, false);
+    if (!request) return;
+    // Delivered as one or more contiguous regions
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange range, BOOL *stop) {
+        request->OnData(bytes, range.length);
+    }];
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task
+didCompleteWithError:(NSError *)error
+{
+    std::shared_ptr<NativeHttp::Request> request = TaskRequest(task, true);
+    if (!request) return;
+    request->SetCanceller(nullptr);
+    if (request->Cancelled()) {
+        request->OnComplete("Aborted");
+    } else {
+        request->OnComplete(error ? error.localizedDescription.UTF8String : "");
+    }
+}
+
+@end
+
+namespace {
+NSURLSession *Session()
+{
+    static NSURLSession *session;
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        NSOperationQueue *queue = [[NSOperationQueue alloc] init];
+        queue.maxConcurrentOperationCount = 1;
+        queue.name = @"LiquidCore http";
+        session = [NSURLSession
+            sessionWithConfiguration:[NSURLSessionConfiguration defaultSessionConfiguration]
+                            delegate:[[LCNativeHttpDelegate alloc] init]
+                       delegateQueue:queue];
+    });
+    return session;
+}
+} /* namespace */
+
+namespace nodedroid {
+
+void NativeHttp::Start(std::shared_ptr<Request> request)
+{
+    @autoreleasepool {
+        NSURL *url = [NSURL URLWithString:@(request->url.c_str())];
+        if (!url || !url.scheme) {
+            return request->OnComplete("Invalid URL: " + request->url);
+        }
+        NSMutableURLRequest *urlRequest = [NSMutableURLRequest requestWithURL:url];
+        urlRequest.HTTPMethod = @(request->method.c_str());
+        if (request->timeout_ms) {
+            urlRequest.timeoutInterval = request->timeout_ms / 1000.0;
+        }
+        for (auto& header : request->headers) {
+            [urlRequest addValue:@(header.second.c_str())
+              forHTTPHeaderField:@(header.first.c_str())];
+        }
+        if (!request->body.empty()) {
+            urlRequest.HTTPBody = [NSData dataWithBytes:request->body.data()
+                                                 length:request->body.size()];
+        }
+
+        NSURLSessionDataTask *task = [Session() dataTaskWithRequest:urlRequest];
+        {
+            std::lock_guard<std::mutex> lock(s_tasks_mutex);
+            s_tasks[task.taskIdentifier] = request;
+        }
+        request->SetCanceller([task]() { [task cancel]; });
+        [task resume];
+    }
+}
+
+} /* namespace nodedroid */
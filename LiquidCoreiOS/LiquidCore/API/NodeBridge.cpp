@@ -7,6 +7,10 @@
 #include <JavaScriptCore/JavaScript.h>
 #include "NodeInstance.h"
 #include "NodeBridge.h"
+#include "BridgeProfiler.h"
+#include "NativeCrypto.h"
+#include "NativeHttp.h"
+#include "TraceSpan.h"
 #include "v8.h"
 #include "libplatform/libplatform.h"
 #undef UNREACHABLE
@@ -28,60 +32,105 @@ public:
     iOSInstance(OnNodeStartedCallback onStart, OnNodeExitCallback onExit, void* data) :
         NodeInstance(onStart, onExit, data)
     {
-        m_async_handle = nullptr;
+    }
+
+    const StartupTimeline& timeline() { return Timeline(); }
+    void throttle(unsigned min_interval_ms) { SetThrottle(min_interval_ms); }
+    void thread_class(nodedroid::ThreadClass thread_class) { SetThreadClass(thread_class); }
+    void notify_idle(unsigned deadline_ms) { NotifyIdle(deadline_ms); }
+    bool resource_usage(ResourceUsage *usage) { return GetResourceUsage(usage); }
+    void long_task_monitor(unsigned threshold_ms, ProcessLongTaskCallback callback, void *data)
+    {
+        if (threshold_ms == 0 || callback == nullptr) {
+            SetLongTaskMonitor(0, nullptr);
+            return;
+        }
+        SetLongTaskMonitor(threshold_ms, [callback, data](uint64_t busy_ns, const std::string& stack) {
+            callback(data, busy_ns, stack.c_str());
+        });
+    }
+
+    void log_sink(int min_level, ProcessLogCallback callback, void *data)
+    {
+        if (callback == nullptr) {
+            SetLogSink((nodedroid::LogLevel) min_level, nullptr);
+            return;
+        }
+        SetLogSink((nodedroid::LogLevel) min_level,
+            [callback, data](const nodedroid::LogRecord *records, size_t count) {
+                std::vector<int> levels(count);
+                std::vector<const char*> messages(count);
+                for (size_t i=0; i<count; i++) {
+                    levels[i] = records[i].level;
+                    messages[i] = records[i].text.c_str();
+                }
+                callback(data, count, levels.data(), messages.data());
+            });
     }
 
     void sync(ProcessThreadCallback callback, void *data)
     {
-        if (std::this_thread::get_id() == node_main_thread->get_id()) {
-            callback(data);
+        TRACE_SPAN("process_sync");
+        auto runnable = Profiled("process_sync", callback, data);
+        if (OnNodeThread()) {
+            RunHere(runnable);
             return;
         }
         
-        struct Runnable *r = new struct Runnable;
-        r->signaled = false;
-        r->data = data;
-        r->isSync = true;
-        r->callback = callback;
-     
-        std::unique_lock<std::mutex> lk(m_async_mutex);
-        m_runnables.push_back(r);
-
-        if (!m_async_handle) {
-            m_async_handle = new uv_async_t();
-            m_async_handle->data = this;
-            uv_async_init(m_loop, m_async_handle, iOSInstance::callback);
-            uv_async_send(m_async_handle);
+        // Host-sync calls have a thread blocked on them, so they go ahead of queued events
+        m_dispatcher.Sync(runnable);
+    }
+
+    ProcessSyncStatus sync(ProcessThreadCallback callback, void *data, unsigned timeout_ms)
+    {
+        TRACE_SPAN("process_sync");
+        auto runnable = Profiled("process_sync_timeout", callback, data);
+        if (OnNodeThread()) {
+            RunHere(runnable);
+            return PROCESS_SYNC_OK;
         }
 
-        r->cv.wait(lk, [r]() {
-            return r->signaled;
-        });
-        delete r;
+        return (ProcessSyncStatus) m_dispatcher.Sync(runnable, timeout_ms);
+    }
+
+    ProcessSyncStatus interrupt(ProcessThreadCallback callback, void *data, unsigned timeout_ms)
+    {
+        TRACE_SPAN("process_interrupt");
+        auto runnable = Profiled("process_interrupt", callback, data);
+        if (OnNodeThread()) {
+            RunHere(runnable);
+            return PROCESS_SYNC_OK;
+        }
+
+        // Race an isolate interrupt against the loop.  While JS is idle the loop gets there
+        // first; while it is busy, the interrupt does.
+        Ticket *ticket = m_dispatcher.Submit(runnable, nodedroid::LoopDispatcher::kHostSync);
+        ticket->Retain();
+        bool requested = RequestInterrupt([](Isolate*, void *t) {
+            Ticket *ticket = reinterpret_cast<Ticket*>(t);
+            ticket->TryRun();
+            ticket->Release();
+        }, ticket);
+        if (!requested) ticket->Release();
+
+        ProcessSyncStatus status = (ProcessSyncStatus) ticket->Wait(timeout_ms);
+        ticket->Release();
+        return status;
+    }
+
+    void * async_cancellable(ProcessThreadCallback callback, void *data)
+    {
+        return m_dispatcher.Submit(Profiled("process_async_cancellable", callback, data));
     }
 
     void async(ProcessThreadCallback callback, void *data)
     {
-        if (std::this_thread::get_id() == node_main_thread->get_id()) {
-            callback(data);
+        if (OnNodeThread()) {
+            RunHere(Profiled("process_async", callback, data));
             return;
         }
 
-        struct Runnable *r = new struct Runnable;
-        r->signaled = false;
-        r->data = data;
-        r->isSync = false;
-        r->callback = callback;
-        
-        std::unique_lock<std::mutex> lk(m_async_mutex);
-        m_runnables.push_back(r);
-        
-        if (!m_async_handle) {
-            m_async_handle = new uv_async_t();
-            m_async_handle->data = this;
-            uv_async_init(m_loop, m_async_handle, iOSInstance::callback);
-            uv_async_send(m_async_handle);
-        }
+        m_dispatcher.Post(new Runnable(callback, data));
     }
     
     uv_async_t * keep_alive()
@@ -103,49 +152,35 @@ public:
     }
 
 private:
-    struct Runnable {
-        std::condition_variable cv;
-        bool signaled;
-        ProcessThreadCallback callback;
-        bool isSync;
-        void * data;
-    };
-    
-    static void callback(uv_async_t* handle)
+    typedef nodedroid::LoopDispatcher::Ticket Ticket;
+
+    // The host's callback, counted under |name| by the bridge profiler from the moment it is
+    // handed over
+    static std::function<void()> Profiled(const char *name, ProcessThreadCallback callback,
+                                          void *data)
     {
-        iOSInstance* thiz = reinterpret_cast<iOSInstance*>(handle->data);
-        
-        thiz->m_async_mutex.lock();
-        struct Runnable * r = thiz->m_runnables.empty() ? nullptr : thiz->m_runnables.front();
-        while (r) {
-            thiz->m_async_mutex.unlock();
-            r->callback(r->data);
-            thiz->m_async_mutex.lock();
-            if (r->isSync) {
-                r->signaled = true;
-                thiz->m_async_mutex.unlock();
-                r->cv.notify_one();
-                thiz->m_async_mutex.lock();
-            }
-            thiz->m_runnables.erase(thiz->m_runnables.begin());
-            if (!r->isSync) {
-                delete r;
+        uint64_t entered = nodedroid::BridgeProfiler::Enter();
+        return [name, callback, data, entered]() {
+            nodedroid::BridgeProfiler::Call call(name, entered);
+            callback(data);
+        };
+    }
+
+    struct Runnable : nodedroid::LoopDispatcher::Task {
+        Runnable(ProcessThreadCallback callback, void *data) : callback(callback), data(data),
+            entered(nodedroid::BridgeProfiler::Enter()) {}
+        void Run() override
+        {
+            {
+                nodedroid::BridgeProfiler::Call call("process_async", entered);
+                callback(data);
             }
-            r = thiz->m_runnables.empty() ? nullptr : thiz->m_runnables.front();
+            delete this;
         }
-        // Close the handle.  We will create a new one if we
-        // need another.  This keeps the node process from staying alive
-        // indefinitely
-        uv_close((uv_handle_t*)handle, [](uv_handle_t *h){
-            delete (uv_async_t*)h;
-        });
-        thiz->m_async_handle = nullptr;
-        thiz->m_async_mutex.unlock();
-    }
-    
-    std::mutex m_async_mutex;
-    std::vector<Runnable*> m_runnables;
-    uv_async_t *m_async_handle;
+        ProcessThreadCallback callback;
+        void * data;
+        uint64_t entered;
+    };
 };
 
 static v8::Platform *s_platform = nullptr;
@@ -183,6 +218,144 @@ extern "C" void process_dispose(void *token)
     process_static_dispose();
 }
 
+extern "C" void process_set_throttle(void *token, unsigned min_interval_ms)
+{
+    reinterpret_cast<iOSInstance*>(token)->throttle(min_interval_ms);
+}
+
+extern "C" void process_set_thread_class(void *token, int thread_class)
+{
+    if (thread_class < nodedroid::kThreadDefault || thread_class > nodedroid::kThreadBackground) {
+        thread_class = nodedroid::kThreadDefault;
+    }
+    reinterpret_cast<iOSInstance*>(token)->thread_class(
+        static_cast<nodedroid::ThreadClass>(thread_class));
+}
+
+extern "C" void process_notify_idle(void *token, unsigned deadline_ms)
+{
+    if (deadline_ms > 0) {
+        reinterpret_cast<iOSInstance*>(token)->notify_idle(deadline_ms);
+    }
+}
+
+extern "C" int process_get_resource_usage(void *token, ProcessResourceUsage *usage)
+{
+    NodeInstance::ResourceUsage u;
+    if (!reinterpret_cast<iOSInstance*>(token)->resource_usage(&u)) {
+        return 0;
+    }
+    usage->cpu_time = u.cpu_time_ns;
+    usage->heap_used = u.heap_used;
+    usage->heap_limit = u.heap_limit;
+    usage->external_memory = u.external_memory;
+    usage->open_handles = u.open_handles;
+    usage->loop_iterations = u.loop_iterations;
+    usage->lag_p50 = u.lag_p50_ns;
+    usage->lag_p90 = u.lag_p90_ns;
+    usage->lag_p99 = u.lag_p99_ns;
+    usage->lag_max = u.lag_max_ns;
+    return 1;
+}
+
+extern "C" void process_set_long_task_monitor(void *token, unsigned threshold_ms,
+                                              ProcessLongTaskCallback callback, void *data)
+{
+    reinterpret_cast<iOSInstance*>(token)->long_task_monitor(threshold_ms, callback, data);
+}
+
+extern "C" void process_set_log_sink(void *token, int min_level, ProcessLogCallback callback,
+                                     void *data)
+{
+    if (min_level < nodedroid::kLogDebug || min_level > nodedroid::kLogOff) {
+        min_level = nodedroid::kLogOff;
+    }
+    reinterpret_cast<iOSInstance*>(token)->log_sink(min_level, callback, data);
+}
+
+extern "C" void process_get_startup_timeline(void *token, ProcessStartupTimeline *timeline)
+{
+    const NodeInstance::StartupTimeline& t =
+        reinterpret_cast<iOSInstance*>(token)->timeline();
+    timeline->thread_start = t.thread_start;
+    timeline->node_init_done = t.node_init_done;
+    timeline->v8_init_done = t.v8_init_done;
+    timeline->isolate_ready = t.isolate_ready;
+    timeline->environment_ready = t.environment_ready;
+    timeline->host_notified = t.host_notified;
+    timeline->bootstrap_done = t.bootstrap_done;
+    timeline->fs_checks = t.fs.checks;
+    timeline->fs_check_ns = t.fs.check_ns;
+    timeline->module_reads = t.fs.module_reads;
+    timeline->module_bytes = t.fs.module_bytes;
+}
+
+extern "C" void process_set_isolate_recycling(size_t max_isolates)
+{
+    NodeInstance::SetIsolateRecycling(max_isolates);
+}
+
+extern "C" void process_set_threadpool_size(unsigned size)
+{
+    NodeInstance::SetThreadPoolSize(size);
+}
+
+extern "C" void process_set_shared_thread(int shared)
+{
+    NodeInstance::SetSharedThread(shared != 0);
+}
+
+extern "C" void process_set_shared_context_group(int shared)
+{
+    IsolateImpl::ShareContextGroups(shared != 0);
+    NodeInstance::SetSharedContextGroup(shared != 0);
+}
+
+extern "C" void process_set_trusted_mode(int trusted)
+{
+    IsolateImpl::SetTrustedMode(trusted != 0);
+}
+
+extern "C" void process_set_bridge_profiling(int enabled)
+{
+    nodedroid::BridgeProfiler::SetEnabled(enabled != 0);
+}
+
+extern "C" char * process_dump_bridge_profile(int reset)
+{
+    return strdup(nodedroid::BridgeProfiler::Dump(reset != 0).c_str());
+}
+
+extern "C" void process_set_native_http(int enabled)
+{
+    nodedroid::NativeHttp::SetEnabled(enabled != 0);
+}
+
+extern "C" void process_set_native_crypto(int enabled)
+{
+    nodedroid::NativeCrypto::SetEnabled(enabled != 0);
+}
+
+extern "C" void process_set_tracing(int enabled)
+{
+    nodedroid::TraceSpan::SetEnabled(enabled != 0);
+}
+
+extern "C" void process_set_shared_code_cache(const char *dir)
+{
+    nodedroid::SetSharedCodeCacheDir(dir);
+}
+
+extern "C" void process_set_gc_slice_budget(unsigned microseconds)
+{
+    V82JSC::HeapAllocator::SetSweepBudget(microseconds);
+}
+
+extern "C" void process_set_gc_growth_factor(double factor)
+{
+    V82JSC::HeapAllocator::SetGrowthFactor(factor);
+}
+
 extern "C" void process_set_filesystem(JSContextRef ctx, JSObjectRef fs)
 {
     Isolate *isolate = V82JSC::ToIsolate(IsolateImpl::s_context_to_isolate_map[JSContextGetGlobalContext(ctx)]);
@@ -197,6 +370,28 @@ extern "C" void process_set_filesystem(JSContextRef ctx, JSObjectRef fs)
     Local<Private> privateKey = v8::Private::ForApi(isolate,
                                                     String::NewFromUtf8(isolate, "__fs"));
     globalObj->SetPrivate(context, privateKey, fsObj);
+    nodedroid::PathPolicy::Install(context, fsObj);
+    nodedroid::InvalidateSandbox();
+    nodedroid::InvalidateModuleStatCache();
+}
+
+extern "C" size_t process_get_heap_object_statistics(JSContextRef ctx,
+                                                     ProcessHeapObjectStatistics *statistics,
+                                                     size_t max)
+{
+    IsolateImpl *iso = IsolateImpl::s_context_to_isolate_map[JSContextGetGlobalContext(ctx)];
+    Isolate *isolate = V82JSC::ToIsolate(iso);
+    size_t types = isolate->NumberOfTrackedHeapObjectTypes();
+    for (size_t i=0; i<types && i<max; i++) {
+        v8::HeapObjectStatistics live;
+        isolate->GetHeapObjectStatisticsAtLastGC(&live, i);
+        statistics[i].type = live.object_type();
+        statistics[i].live_count = live.object_count();
+        statistics[i].live_bytes = live.object_size();
+        iso->GetHeapObjectAllocations(i, &statistics[i].allocations,
+                                      &statistics[i].allocated_bytes);
+    }
+    return types;
 }
 
 extern "C" void process_sync(void* token, ProcessThreadCallback runnable, void* data)
@@ -205,6 +400,39 @@ extern "C" void process_sync(void* token, ProcessThreadCallback runnable, void*
     instance->sync(runnable, data);
 }
 
+extern "C" ProcessSyncStatus process_sync_timeout(void* token, ProcessThreadCallback runnable,
+                                                  void* data, unsigned timeout_ms)
+{
+    iOSInstance *instance = reinterpret_cast<iOSInstance*>(token);
+    return instance->sync(runnable, data, timeout_ms);
+}
+
+extern "C" ProcessSyncStatus process_interrupt(void* token, ProcessThreadCallback runnable,
+                                               void* data, unsigned timeout_ms)
+{
+    iOSInstance *instance = reinterpret_cast<iOSInstance*>(token);
+    return instance->interrupt(runnable, data, timeout_ms);
+}
+
+extern "C" void * process_async_cancellable(void* token, ProcessThreadCallback runnable, void* data)
+{
+    iOSInstance *instance = reinterpret_cast<iOSInstance*>(token);
+    return instance->async_cancellable(runnable, data);
+}
+
+extern "C" int process_cancel(void* ticket)
+{
+    nodedroid::LoopDispatcher::Ticket *t = reinterpret_cast<nodedroid::LoopDispatcher::Ticket*>(ticket);
+    bool cancelled = t->Cancel();
+    t->Release();
+    return cancelled;
+}
+
+extern "C" void process_release_ticket(void* ticket)
+{
+    reinterpret_cast<nodedroid::LoopDispatcher::Ticket*>(ticket)->Release();
+}
+
 extern "C" void process_async(void * token, ProcessThreadCallback runnable, void* data)
 {
     iOSInstance *instance = reinterpret_cast<iOSInstance*>(token);
@@ -19,8 +19,127 @@ typedef void (*ProcessThreadCallback)(void *);
 
 EXTERNC void * process_start(OnNodeStartedCallback, OnNodeExitCallback, void*);
 EXTERNC void process_dispose(void *token);
+
+/* Start-up phases in monotonic nanoseconds (zero until reached), then sandbox counters */
+typedef struct ProcessStartupTimeline {
+    uint64_t thread_start;
+    uint64_t node_init_done;
+    uint64_t v8_init_done;
+    uint64_t isolate_ready;
+    uint64_t environment_ready;
+    uint64_t host_notified;
+    uint64_t bootstrap_done;
+    uint64_t fs_checks;
+    uint64_t fs_check_ns;
+    uint64_t module_reads;
+    uint64_t module_bytes;
+} ProcessStartupTimeline;
+
+/* Per-process resource usage; times in nanoseconds, sizes in bytes */
+typedef struct ProcessResourceUsage {
+    uint64_t cpu_time;
+    uint64_t heap_used;
+    uint64_t heap_limit;
+    uint64_t external_memory;
+    uint64_t open_handles;
+    uint64_t loop_iterations;
+    uint64_t lag_p50;
+    uint64_t lag_p90;
+    uint64_t lag_p99;
+    uint64_t lag_max;
+} ProcessResourceUsage;
+
+EXTERNC void process_set_throttle(void *token, unsigned min_interval_ms);
+/* QoS for the process's thread and its file system work: 0 = default, 1 = user-interactive,
+   2 = utility, 3 = background */
+EXTERNC void process_set_thread_class(void *token, int thread_class);
+/* Waits for the process's current turn.  Returns 0 if it has exited. */
+EXTERNC int process_get_resource_usage(void *token, ProcessResourceUsage *usage);
+/* Called on the process's thread after each loop iteration busy for at least the threshold.
+   stack is the JS stack if the iteration was caught while running, otherwise empty. */
+typedef void (*ProcessLongTaskCallback)(void *data, uint64_t busy_ns, const char *stack);
+/* A threshold of 0 turns it off */
+EXTERNC void process_set_long_task_monitor(void *token, unsigned threshold_ms,
+                                           ProcessLongTaskCallback callback, void *data);
+/* Console output, in batches on a thread of the sink's own.  Levels are 0 = debug, 1 = log/info,
+   2 = warn, 3 = error; 4 drops everything.  A null callback sends it to os_log. */
+typedef void (*ProcessLogCallback)(void *data, size_t count, const int *levels,
+                                   const char *const *messages);
+EXTERNC void process_set_log_sink(void *token, int min_level, ProcessLogCallback callback,
+                                  void *data);
+/* The host expects to be idle for the next deadline_ms; lets garbage collection run then */
+EXTERNC void process_notify_idle(void *token, unsigned deadline_ms);
+EXTERNC void process_get_startup_timeline(void *token, ProcessStartupTimeline *timeline);
+EXTERNC void process_set_isolate_recycling(size_t max_isolates);
+/* Only takes effect before any process has queued work to the pool */
+EXTERNC void process_set_threadpool_size(unsigned size);
+/* Processes started after this is turned on all run on one thread, multiplexing their loops */
+EXTERNC void process_set_shared_thread(int shared);
+/* Processes started after this is turned on share one JS VM and heap, each with its own
+   global context and loop.  Only for services that trust each other. */
+EXTERNC void process_set_shared_context_group(int shared);
+/* Processes started after this is turned on skip the proxies that keep contexts from reaching
+   into each other.  Safe when a process's contexts all trust each other, as node's do. */
+EXTERNC void process_set_trusted_mode(int trusted);
+/* Emits os_signpost intervals around bridge calls, loop tasks and garbage collection, for
+   Instruments' Points of Interest.  Needs iOS 12; ignored before that. */
+EXTERNC void process_set_tracing(int enabled);
+/* Counts and times the calls made through process_sync() and friends, by entry point, split
+   into the wait for the process's thread and the callback itself */
+EXTERNC void process_set_bridge_profiling(int enabled);
+/* The calls counted since the last reset, as JSON, which the caller must free() */
+EXTERNC char * process_dump_bridge_profile(int reset);
+/* Processes started after this is turned on have process.nativeRequest() and process.fetch(),
+   which go through NSURLSession rather than node's own http stack */
+EXTERNC void process_set_native_http(int enabled);
+/* Processes started after this is turned on hash, HMAC, AES-CBC/CTR and random bytes through
+   CommonCrypto and the system random source; everything else stays with OpenSSL */
+EXTERNC void process_set_native_crypto(int enabled);
+EXTERNC void process_set_shared_code_cache(const char *dir);
+EXTERNC void process_set_gc_slice_budget(unsigned microseconds);
+/* How far a process's heap may grow past what survived its last collection before the next is
+   scheduled.  2 by default; at least 1.1. */
+EXTERNC void process_set_gc_growth_factor(double factor);
 EXTERNC void process_set_filesystem(JSContextRef ctx, JSObjectRef fs);
+
+/* Objects of one V8 API type in the V82JSC heap: those alive now, and all ever allocated */
+typedef struct ProcessHeapObjectStatistics {
+    const char *type;
+    uint64_t live_count;
+    uint64_t live_bytes;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+} ProcessHeapObjectStatistics;
+/* Fills in up to max entries, one per type, and returns how many types there are.  Like
+   process_set_filesystem(), must be called on the process's thread, e.g. from process_sync(). */
+EXTERNC size_t process_get_heap_object_statistics(JSContextRef ctx,
+                                                  ProcessHeapObjectStatistics *statistics,
+                                                  size_t max);
 EXTERNC void process_sync(void* token, ProcessThreadCallback runnable, void* data);
+
+/* Matches nodedroid::LoopDispatcher::Ticket::Status */
+typedef enum ProcessSyncStatus {
+    PROCESS_SYNC_OK = 0,
+    PROCESS_SYNC_TIMED_OUT,     /* had not started in time, and never will */
+    PROCESS_SYNC_CANCELLED,
+    PROCESS_SYNC_DISCARDED      /* the process exited first */
+} ProcessSyncStatus;
+
+/* As process_sync(), but gives up if the runnable hasn't started within timeout_ms (0 waits
+ * forever).  A runnable that has started is always waited for. */
+EXTERNC ProcessSyncStatus process_sync_timeout(void* token, ProcessThreadCallback runnable,
+                                               void* data, unsigned timeout_ms);
+/* As process_sync_timeout(), but the runnable may also run at the next interrupt check of
+ * executing JS, rather than waiting for the current macrotask to finish.  It runs at most once,
+ * must be short, and must not call into JS. */
+EXTERNC ProcessSyncStatus process_interrupt(void* token, ProcessThreadCallback runnable,
+                                            void* data, unsigned timeout_ms);
+/* As process_async(), but returns a ticket that can cancel the runnable until it starts.  Each
+ * ticket must be passed to exactly one of process_cancel() or process_release_ticket(). */
+EXTERNC void * process_async_cancellable(void* token, ProcessThreadCallback runnable, void* data);
+/* Returns non-zero if the runnable will never run */
+EXTERNC int process_cancel(void* ticket);
+EXTERNC void process_release_ticket(void* ticket);
 EXTERNC void process_async(void * token, ProcessThreadCallback runnable, void* data);
 EXTERNC void * process_keep_alive(void *token);
 EXTERNC void process_let_die(void *token, void* preserver);
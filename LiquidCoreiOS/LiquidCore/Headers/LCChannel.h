@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef LCChannel_h
+#define LCChannel_h
+
+#import <Foundation/Foundation.h>
+#import <LiquidCore/LCMicroService.h>
+
+/**
+ A binary channel between the host and a micro service.  Frames go through two single-producer/
+ single-consumer rings in one block of memory, which JS sees as an external ArrayBuffer, so
+ nothing is copied through the object bridge and nothing is allocated per frame.  In JS the
+ channel is an EventEmitter handed out by LiquidCore's 'channel' event:
+
+     LiquidCore.on('channel', (ch) => {
+       ch.on('frame', (bytes, offset, length) => { ... });  // only valid during the listener
+       ch.write(uint8array);                                // or reserve(length)/commit()
+     });
+
+ There may be one writer thread and one reader thread on each side at a time.
+ */
+@interface LCChannel : NSObject
+
+/** The name the channel was opened with, and its key in JS. */
+@property (nonatomic, readonly) NSString *name;
+
+/** Called on the node thread each time the service commits frames. */
+@property (atomic, copy) void (^onReadable)(LCChannel *channel);
+
+/** Copies a frame into the ring.
+ @param bytes The frame
+ @param length Its length in bytes
+ @return NO if there isn't room for it
+ */
+- (BOOL) send:(const void*)bytes length:(uint32_t)length;
+
+/** Makes room for a frame to be written in place.  Nothing is visible to the service until
+ commit.
+ @param length The frame's length in bytes
+ @return |length| bytes to write the frame into, or NULL if there isn't room
+ */
+- (void*) reserve:(uint32_t)length;
+
+/** Hands the frame from the last reserve: to the service. */
+- (void) commit;
+
+/** Hands each frame the service has committed to |handler|, then frees them.
+ @param handler Called once per frame.  The bytes are only valid during the call.
+ @return The number of frames
+ */
+- (NSUInteger) receive:(void (^)(const void *bytes, uint32_t length))handler;
+
+@end
+
+@interface LCMicroService (LCChannel)
+
+/** Opens a binary channel to the service, which gets it through LiquidCore's 'channel' event.
+ The host may start sending at once; frames wait in the ring until the service is listening.
+ @param name The channel's name
+ @param capacity Ring size in bytes, per direction, rounded up to a power of two
+ @return The channel, or nil if the service isn't running
+ */
+- (LCChannel*) openChannel:(NSString*)name capacity:(uint32_t)capacity;
+
+@end
+
+#endif /* LCChannel_h */
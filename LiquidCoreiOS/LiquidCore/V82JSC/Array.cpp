@@ -10,12 +10,18 @@ using namespace V82JSC;
 using v8::Array;
 using v8::Local;
 
+static JSStringRef LengthString()
+{
+    static JSStringRef s_length = JSStringCreateWithUTF8CString("length");
+    return s_length;
+}
+
 uint32_t Array::Length() const
 {
     Local<Context> context = ToCurrentContext(this);
     JSContextRef ctx = ToContextRef(context);
     JSValueRef obj = ToJSValueRef(this, context);
-    JSValueRef length = exec(ctx, "return _1.length", 1, &obj);
+    JSValueRef length = JSObjectGetProperty(ctx, (JSObjectRef)obj, LengthString(), 0);
     uint32_t len = 0;
     if (length) {
         JSValueRef excp = 0;
@@ -33,12 +39,11 @@ Local<Array> Array::New(Isolate* isolate, int length)
 {
     Local<Context> context = OperatingContext(isolate);
     JSContextRef ctx = ToContextRef(context);
-    length = length<0 ? 0 : length;
-    JSValueRef args[length];
-    for (int ndx=0; ndx < length; ndx++) {
-        args[ndx] = JSValueMakeUndefined(ctx);
+    JSObjectRef array = JSObjectMakeArray(ctx, 0, nullptr, 0);
+    if (length > 0) {
+        // Holes, as in V8, and no per-element values to pass in
+        JSObjectSetProperty(ctx, array, LengthString(), JSValueMakeNumber(ctx, length), 0, 0);
     }
-    Local<Value> o = V82JSC::Value::New(ToContextImpl(context),
-                                        JSObjectMakeArray(ctx, length, args, 0));
+    Local<Value> o = V82JSC::Value::New(ToContextImpl(context), array);
     return o.As<Array>();
 }
@@ -114,40 +114,43 @@ size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception
 void V82JSC::proxyArrayBuffer(GlobalContext *ctx)
 {
     JSObjectRef handler = JSObjectMake(ctx->m_ctxRef, nullptr, nullptr);
-    auto handler_func = [ctx, handler](const char *name, JSObjectCallAsFunctionCallback callback) -> void {
+    auto handler_func = [ctx, handler](const char *name, JSClassRef claz) -> void {
         JSValueRef excp = 0;
         JSStringRef sname = JSStringCreateWithUTF8CString(name);
-        JSClassDefinition def = kJSClassDefinitionEmpty;
-        def.attributes = kJSClassAttributeNoAutomaticPrototype;
-        def.callAsFunction = callback;
-        def.className = name;
-        JSClassRef claz = JSClassCreate(&def);
         JSObjectRef f = JSObjectMake(ctx->m_ctxRef, claz, (void*)ToIsolateImpl(ctx));
         JSObjectSetProperty(ctx->m_ctxRef, handler, sname, f, 0, &excp);
         JSStringRelease(sname);
         assert(excp==0);
     };
     
-    handler_func("construct", [](CALLBACK_PARAMS) -> JSValueRef
-    {
-        Isolate* isolate = (Isolate*) JSObjectGetPrivate(function);
-        assert(argumentCount>1);
-        size_t byte_length = 0;
-        if (JSValueIsArray(ctx, arguments[1])) {
-            JSValueRef excp=0;
-            JSValueRef length = JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)arguments[1], 0, &excp);
-            assert(excp==0);
-            if (JSValueIsNumber(ctx, length)) {
-                byte_length = JSValueToNumber(ctx, length, &excp);
+    // The handler class is the same for every context, so only create it once
+    static JSClassRef construct_class = []() {
+        JSClassDefinition def = kJSClassDefinitionEmpty;
+        def.attributes = kJSClassAttributeNoAutomaticPrototype;
+        def.className = "construct";
+        def.callAsFunction = [](CALLBACK_PARAMS) -> JSValueRef
+        {
+            Isolate* isolate = (Isolate*) JSObjectGetPrivate(function);
+            assert(argumentCount>1);
+            size_t byte_length = 0;
+            if (JSValueIsArray(ctx, arguments[1])) {
+                JSValueRef excp=0;
+                JSValueRef length = JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)arguments[1], 0, &excp);
                 assert(excp==0);
+                if (JSValueIsNumber(ctx, length)) {
+                    byte_length = JSValueToNumber(ctx, length, &excp);
+                    assert(excp==0);
+                }
             }
-        }
-        if (!exception || !*exception) {
-            Local<ArrayBuffer> array_buffer = ArrayBuffer::New(isolate, byte_length);
-            return ToJSValueRef(array_buffer, isolate);
-        }
-        return NULL;
-    });
+            if (!exception || !*exception) {
+                Local<ArrayBuffer> array_buffer = ArrayBuffer::New(isolate, byte_length);
+                return ToJSValueRef(array_buffer, isolate);
+            }
+            return NULL;
+        };
+        return JSClassCreate(&def);
+    }();
+    handler_func("construct", construct_class);
     JSValueRef args[] = {
         JSContextGetGlobalObject(ctx->m_ctxRef),
         handler
@@ -174,6 +177,7 @@ Local<ArrayBuffer> ArrayBuffer::New(Isolate* isolate, size_t byte_length)
 
     wrap->ArrayBufferInfo.buffer = isolateimpl->m_params.array_buffer_allocator->Allocate(byte_length);
     wrap->ArrayBufferInfo.byte_length = byte_length;
+    isolateimpl->m_array_buffer_bytes += byte_length;
     wrap->ArrayBufferInfo.isExternal = false;
     wrap->ArrayBufferInfo.iso = isolateimpl;
     wrap->ArrayBufferInfo.m_self.Reset(ToIsolate(isolateimpl), local);
@@ -185,6 +189,7 @@ Local<ArrayBuffer> ArrayBuffer::New(Isolate* isolate, size_t byte_length)
         if (!impl->ArrayBufferInfo.isExternal) {
             impl->ArrayBufferInfo.iso->m_params.array_buffer_allocator->Free(impl->ArrayBufferInfo.buffer,
                                                                              impl->ArrayBufferInfo.byte_length);
+            impl->ArrayBufferInfo.iso->m_array_buffer_bytes -= impl->ArrayBufferInfo.byte_length;
             impl->ArrayBufferInfo.buffer = nullptr;
         }
         impl->ArrayBufferInfo.m_self.Reset();
@@ -192,15 +197,8 @@ Local<ArrayBuffer> ArrayBuffer::New(Isolate* isolate, size_t byte_length)
     
     V82JSC::TrackedObject::setPrivateInstance(isolateimpl, ctx, wrap, array_buffer);
 
-    JSValueRef excp = 0;
-    wrap->m_internal_fields_array = JSObjectMakeArray(ctx, 0, nullptr, &excp);
-    assert(excp==0);
-    JSValueProtect(ctx, wrap->m_internal_fields_array);
+    // The internal fields array is only created if someone uses it (see TrackedObject::InternalFields)
     wrap->m_num_internal_fields = ArrayBuffer::kInternalFieldCount;
-    JSValueRef zero = ToJSValueRef(External::New(isolate, nullptr), context);
-    for (int i=0; i<ArrayBuffer::kInternalFieldCount; i++) {
-        JSObjectSetPropertyAtIndex(ctx, wrap->m_internal_fields_array, i, zero, 0);
-    }
     
     Local<ArrayBuffer> buffer = V82JSC::Value::New(ToContextImpl(context),
                                                array_buffer,
@@ -236,6 +234,7 @@ Local<ArrayBuffer> ArrayBuffer::New(
     wrap->ArrayBufferInfo.buffer = data;
     wrap->ArrayBufferInfo.byte_length = byte_length;
     wrap->ArrayBufferInfo.isExternal = mode==ArrayBufferCreationMode::kExternalized;
+    if (!wrap->ArrayBufferInfo.isExternal) isolateimpl->m_array_buffer_bytes += byte_length;
     wrap->ArrayBufferInfo.iso = isolateimpl;
     wrap->ArrayBufferInfo.m_self.Reset(ToIsolate(isolateimpl), local);
 
@@ -246,21 +245,15 @@ Local<ArrayBuffer> ArrayBuffer::New(
         if (!impl->ArrayBufferInfo.isExternal) {
             impl->ArrayBufferInfo.iso->m_params.array_buffer_allocator->Free(impl->ArrayBufferInfo.buffer,
                                                                            impl->ArrayBufferInfo.byte_length);
+            impl->ArrayBufferInfo.iso->m_array_buffer_bytes -= impl->ArrayBufferInfo.byte_length;
             impl->ArrayBufferInfo.buffer = nullptr;
         }
     }, (void*) wrap, &exception);
     
     V82JSC::TrackedObject::setPrivateInstance(isolateimpl, ctx, wrap, array_buffer);
     
-    JSValueRef excp = 0;
-    wrap->m_internal_fields_array = JSObjectMakeArray(ctx, 0, nullptr, &excp);
-    assert(excp==0);
-    JSValueProtect(ctx, wrap->m_internal_fields_array);
+    // The internal fields array is only created if someone uses it (see TrackedObject::InternalFields)
     wrap->m_num_internal_fields = ArrayBuffer::kInternalFieldCount;
-    JSValueRef zero = ToJSValueRef(External::New(isolate, nullptr), context);
-    for (int i=0; i<ArrayBuffer::kInternalFieldCount; i++) {
-        JSObjectSetPropertyAtIndex(ctx, wrap->m_internal_fields_array, i, zero, 0);
-    }
 
     Local<ArrayBuffer> buffer = V82JSC::Value::New(ToContextImpl(context),
                                                array_buffer,
@@ -327,6 +320,9 @@ ArrayBuffer::Contents ArrayBuffer::Externalize()
     ArrayBuffer::Contents contents;
     contents.data_ = wrap->ArrayBufferInfo.buffer;
     contents.byte_length_ = wrap->ArrayBufferInfo.byte_length;
+    if (!wrap->ArrayBufferInfo.isExternal) {
+        wrap->ArrayBufferInfo.iso->m_array_buffer_bytes -= wrap->ArrayBufferInfo.byte_length;
+    }
     wrap->ArrayBufferInfo.isExternal = true;
     return contents;
 }
@@ -434,19 +430,41 @@ SharedArrayBuffer::Contents SharedArrayBuffer::GetContents()
     return SharedArrayBuffer::Contents();
 }
 
+// A DataView (or a view behind a proxy) isn't a typed array to the C API, and has to be asked
+// in JS
+static JSValueRef ViewProperty(JSContextRef ctx, JSObjectRef view, const char *name)
+{
+    JSStringRef sname = JSStringCreateWithUTF8CString(name);
+    JSValueRef excp = 0;
+    JSValueRef value = JSObjectGetProperty(ctx, view, sname, &excp);
+    assert(excp==0);
+    JSStringRelease(sname);
+    return value;
+}
+
+static bool IsNativeView(JSContextRef ctx, JSObjectRef view)
+{
+    JSTypedArrayType type = JSValueGetTypedArrayType(ctx, view, nullptr);
+    return type != kJSTypedArrayTypeNone && type != kJSTypedArrayTypeArrayBuffer;
+}
+
 /**
  * Returns underlying ArrayBuffer.
  */
 Local<ArrayBuffer> ArrayBufferView::Buffer()
 {
     Local<Context> context = ToCurrentContext(this);
-    JSValueRef value = ToJSValueRef(this, context);
+    JSContextRef ctx = ToContextRef(context);
+    JSObjectRef view = (JSObjectRef) ToJSValueRef(this, context);
     
-    JSStringRef sbuffer = JSStringCreateWithUTF8CString("buffer");
-    JSValueRef excp = 0;
-    JSValueRef buffer = JSObjectGetProperty(ToContextRef(context), (JSObjectRef)value, sbuffer, &excp);
-    assert(excp==0);
-    JSStringRelease(sbuffer);
+    JSValueRef buffer;
+    if (IsNativeView(ctx, view)) {
+        JSValueRef excp = 0;
+        buffer = JSObjectGetTypedArrayBuffer(ctx, view, &excp);
+        assert(excp==0);
+    } else {
+        buffer = ViewProperty(ctx, view, "buffer");
+    }
     return V82JSC::Value::New(ToContextImpl(context), buffer).As<ArrayBuffer>();
 }
 /**
@@ -455,14 +473,16 @@ Local<ArrayBuffer> ArrayBufferView::Buffer()
 size_t ArrayBufferView::ByteOffset()
 {
     Local<Context> context = ToCurrentContext(this);
-    JSValueRef value = ToJSValueRef(this, context);
+    JSContextRef ctx = ToContextRef(context);
+    JSObjectRef view = (JSObjectRef) ToJSValueRef(this, context);
     
-    JSStringRef soffset = JSStringCreateWithUTF8CString("byteOffset");
     JSValueRef excp = 0;
-    JSValueRef offset = JSObjectGetProperty(ToContextRef(context), (JSObjectRef)value, soffset, &excp);
-    assert(excp==0);
-    JSStringRelease(soffset);
-    size_t byte_offset = JSValueToNumber(ToContextRef(context), offset, &excp);
+    if (IsNativeView(ctx, view)) {
+        size_t byte_offset = JSObjectGetTypedArrayByteOffset(ctx, view, &excp);
+        assert(excp==0);
+        return byte_offset;
+    }
+    size_t byte_offset = JSValueToNumber(ctx, ViewProperty(ctx, view, "byteOffset"), &excp);
     assert(excp==0);
     return byte_offset;
 }
@@ -472,14 +492,16 @@ size_t ArrayBufferView::ByteOffset()
 size_t ArrayBufferView::ByteLength()
 {
     Local<Context> context = ToCurrentContext(this);
-    JSValueRef value = ToJSValueRef(this, context);
+    JSContextRef ctx = ToContextRef(context);
+    JSObjectRef view = (JSObjectRef) ToJSValueRef(this, context);
 
-    JSStringRef slength = JSStringCreateWithUTF8CString("byteLength");
     JSValueRef excp = 0;
-    JSValueRef length = JSObjectGetProperty(ToContextRef(context), (JSObjectRef)value, slength, &excp);
-    assert(excp==0);
-    JSStringRelease(slength);
-    size_t byte_length = JSValueToNumber(ToContextRef(context), length, &excp);
+    if (IsNativeView(ctx, view)) {
+        size_t byte_length = JSObjectGetTypedArrayByteLength(ctx, view, &excp);
+        assert(excp==0);
+        return byte_length;
+    }
+    size_t byte_length = JSValueToNumber(ctx, ViewProperty(ctx, view, "byteLength"), &excp);
     assert(excp==0);
     return byte_length;
 }
@@ -495,8 +517,26 @@ size_t ArrayBufferView::ByteLength()
  */
 size_t ArrayBufferView::CopyContents(void* dest, size_t byte_length)
 {
-    assert(0);
-    return 0;
+    Local<Context> context = ToCurrentContext(this);
+    JSContextRef ctx = ToContextRef(context);
+    JSObjectRef view = (JSObjectRef) ToJSValueRef(this, context);
+
+    size_t length = std::min(byte_length, ByteLength());
+    if (!length) return 0;
+    JSValueRef excp = 0;
+    const uint8_t *bytes;
+    if (IsNativeView(ctx, view)) {
+        // Already offset into the buffer
+        bytes = static_cast<const uint8_t*>(JSObjectGetTypedArrayBytesPtr(ctx, view, &excp));
+    } else {
+        JSObjectRef buffer = (JSObjectRef) ViewProperty(ctx, view, "buffer");
+        bytes = static_cast<const uint8_t*>(JSObjectGetArrayBufferBytesPtr(ctx, buffer, &excp));
+        if (bytes) bytes += ByteOffset();
+    }
+    assert(excp==0);
+    if (!bytes) return 0;
+    memcpy(dest, bytes, length);
+    return length;
 }
 
 /**
@@ -505,8 +545,8 @@ size_t ArrayBufferView::CopyContents(void* dest, size_t byte_length)
  */
 bool ArrayBufferView::HasBuffer() const
 {
-    assert(0);
-    return false;
+    // JSC allocates it along with the view
+    return true;
 }
 
 Local<DataView> DataView::New(Local<ArrayBuffer> array_buffer,
@@ -96,12 +96,19 @@ Local<v8::Context> LocalContext::New(Isolate *isolate, JSContextRef ctx)
 {
     EscapableHandleScope scope(isolate);
     IsolateImpl * i = ToIsolateImpl(isolate);
+    JSGlobalContextRef gctx = JSContextGetGlobalContext(ctx);
+    Local<v8::Context> global_context = i->m_global_contexts[gctx].Get(isolate);
+    // Callbacks mostly come in on the global context itself (always, on newer systems), which
+    // needs no wrapper of its own
+    if ((JSContextRef)gctx == ctx && !global_context.IsEmpty()) {
+        return scope.Escape(global_context);
+    }
+
     auto context = static_cast<Context *>(HeapAllocator::Alloc(i, i->m_context_map));
     context->m_ctxRef = ctx;
 
     // Copy the embedder data pointer from the global context.  This has a vulnerability if the embedder data
     // is moved (expanded) on the global context.  Unlikely scenario, though.
-    Local<v8::Context> global_context = i->m_global_contexts[JSContextGetGlobalContext(context->m_ctxRef)].Get(isolate);
     if (!global_context.IsEmpty()) {
         auto ed = get_embedder_data(*global_context);
         int embedder_data_offset = v8::internal::Internals::kContextHeaderSize +
@@ -118,6 +125,7 @@ void GlobalContext::RemoveContextFromIsolate(IsolateImpl *iso, JSGlobalContextRe
 {
     iso->m_global_contexts.erase(ctx);
     iso->m_exec_maps.erase(ctx);
+    IsolateImpl::s_exec_epoch ++;
     // Don't do this.  Sometimes stray callbacks come in from JSC and we will need this after the context
     // is gone.
     //IsolateImpl::s_context_to_isolate_map.erase(ctx);
@@ -241,11 +249,11 @@ Local<v8::Context> v8::Context::New(Isolate* isolate, ExtensionConfiguration* ex
             std::unique_lock<std::mutex> lk(IsolateImpl::s_isolate_mutex);
             IsolateImpl::s_context_to_isolate_map[(JSGlobalContextRef)context->m_ctxRef] = i;
         }
-        i->m_exec_maps[(JSGlobalContextRef)context->m_ctxRef] = std::map<const char*, JSObjectRef>();
+        i->m_exec_maps[(JSGlobalContextRef)context->m_ctxRef] = IsolateImpl::ExecFunctions();
 
         def = kJSClassDefinitionEmpty;
         def.className = "GlobalObject";
-        MaybeLocal<Object> thiz = impl->NewInstance(ctx, 0, false, &def, 0);
+        MaybeLocal<Object> thiz = impl->NewInstance(ctx, 0, false, &def, 0, true);
         JSObjectRef instance = (JSObjectRef) ToJSValueRef(thiz.ToLocalChecked(), ctx);
         auto wrap = V82JSC::TrackedObject::getPrivateInstance(context->m_ctxRef, instance);
         wrap->m_isGlobalObject = true;
@@ -306,9 +314,11 @@ Local<v8::Context> v8::Context::New(Isolate* isolate, ExtensionConfiguration* ex
 
     // Set a reference back to our context so we can find our way back to the creation context
     if (i->m_creation_contexts) {
-        JSClassDefinition def = kJSClassDefinitionEmpty;
-        JSClassRef claz = JSClassCreate(&def);
-        context->m_creation_context = JSObjectMake(context->m_ctxRef, claz, (void*)context->m_ctxRef);
+        static JSClassRef creation_context_class = []() {
+            JSClassDefinition def = kJSClassDefinitionEmpty;
+            return JSClassCreate(&def);
+        }();
+        context->m_creation_context = JSObjectMake(context->m_ctxRef, creation_context_class, (void*)context->m_ctxRef);
         JSValueProtect(context->m_ctxRef, context->m_creation_context);
         JSValueRef args[] = {
             i->m_creation_contexts,
@@ -316,7 +326,6 @@ Local<v8::Context> v8::Context::New(Isolate* isolate, ExtensionConfiguration* ex
             context->m_creation_context
         };
         exec(context->m_ctxRef, "_1.set(_2, _3)", 3, args);
-        JSClassRelease(claz);
     }
 
     if (!global_object.IsEmpty()) {
@@ -343,207 +352,207 @@ Local<v8::Context> v8::Context::New(Isolate* isolate, ExtensionConfiguration* ex
     
     // Don't do anything fancy if we are setting up the default context
     if (!i->m_nullContext.IsEmpty()) {
-        // Capture all proxy targets in a WeakMap
-        // The irony of proxying Proxy is not lost on me
-        exec(context->m_ctxRef,
-             "const handler = { " \
-             "  construct(t,a,n) { " \
-             "    let proxy = Reflect.construct(t,a,n); " \
-             "    _1.set(proxy,t); " \
-             "    return proxy; " \
-             "  } " \
-             "}; " \
-             "Proxy = new Proxy(Proxy, handler)",
-             1, &context->m_proxy_targets);
-        
-        proxyArrayBuffer(context);
-        
-        // Proxy Object.getPrototypeOf and Object.setPrototypeOf
-        Local<FunctionTemplate> setPrototypeOf = FunctionTemplate::New(
-            isolate,
-            [](const FunctionCallbackInfo<Value>& info) {
-                Local<Object> obj = info[0].As<Object>();
-                Local<Value> proto = info[1];
-                JSContextRef ctx = ToContextRef(info.GetIsolate());
-                Local<Context> context = info.GetIsolate()->GetCurrentContext();
-                JSValueRef o = ToJSValueRef(info[0], context);
-
-                if (JSValueIsObject(ctx, o)) {
-                    JSValueRef args[] = {
-                        ToIsolateImpl(info.GetIsolate())->m_creation_contexts,
-                        o
-                    };
-                    JSValueRef cc = exec(ctx, "return _1.get(_2)", 2, args);
-                    JSGlobalContextRef gctx = 0;
-                    if (JSValueIsObject(ctx, cc)) gctx = (JSGlobalContextRef)JSObjectGetPrivate((JSObjectRef)cc);
+        // The helper templates are the same for every context, so only create them once per isolate.
+        // Each context still gets its own function instances from them.
+        if (i->m_set_prototype_of_template.IsEmpty()) {
+            i->m_set_prototype_of_template.Reset(isolate, FunctionTemplate::New(
+                isolate,
+                [](const FunctionCallbackInfo<Value>& info) {
+                    Local<Object> obj = info[0].As<Object>();
+                    Local<Value> proto = info[1];
+                    JSContextRef ctx = ToContextRef(info.GetIsolate());
+                    Local<Context> context = info.GetIsolate()->GetCurrentContext();
+                    JSValueRef o = ToJSValueRef(info[0], context);
+
+                    if (JSValueIsObject(ctx, o)) {
+                        JSValueRef args[] = {
+                            ToIsolateImpl(info.GetIsolate())->m_creation_contexts,
+                            o
+                        };
+                        JSValueRef cc = exec(ctx, "return _1.get(_2)", 2, args);
+                        JSGlobalContextRef gctx = 0;
+                        if (JSValueIsObject(ctx, cc)) gctx = (JSGlobalContextRef)JSObjectGetPrivate((JSObjectRef)cc);
                     
-                    if (gctx && ToIsolateImpl(info.GetIsolate())->m_global_contexts.count(gctx)) {
-                        Local<Context> other = ToIsolateImpl(info.GetIsolate())->
-                            m_global_contexts[gctx].Get(info.GetIsolate());
-                        bool isGlobal = other->Global()->StrictEquals(info[0]);
-                        if (isGlobal && !context->Global()->StrictEquals(info[0])) {
-                            info.GetReturnValue().Set(False(info.GetIsolate()));
-                            return;
-                        } else if (isGlobal) {
-                            obj = obj->GetPrototype().As<Object>();
+                        if (gctx && ToIsolateImpl(info.GetIsolate())->m_global_contexts.count(gctx)) {
+                            Local<Context> other = ToIsolateImpl(info.GetIsolate())->
+                                m_global_contexts[gctx].Get(info.GetIsolate());
+                            bool isGlobal = other->Global()->StrictEquals(info[0]);
+                            if (isGlobal && !context->Global()->StrictEquals(info[0])) {
+                                info.GetReturnValue().Set(False(info.GetIsolate()));
+                                return;
+                            } else if (isGlobal) {
+                                obj = obj->GetPrototype().As<Object>();
+                            }
                         }
                     }
-                }
                 
-                bool in_global_prototype_chain = false;
-                JSObjectRef global = JSContextGetGlobalObject(ctx);
-                while (JSValueIsObject(ctx, global) && !in_global_prototype_chain) {
-                    in_global_prototype_chain = JSValueIsStrictEqual(ctx, global, o);
-                    global = (JSObjectRef) JSObjectGetPrototype(ctx, global);
-                }
-                if (in_global_prototype_chain) {
-                    // We can't have proxies in the global prototype chain.  If this is proxied,
-                    // remove the ES6 proxy.  We will rely on the legacy proxy instead.
-                    JSObjectRef maybe_proxy = (JSObjectRef) ToJSValueRef(proto, context);
-                    auto wrap = V82JSC::TrackedObject::getPrivateInstance(ctx, maybe_proxy);
-                    if (wrap) {
-                        proto = V82JSC::Value::New(ToContextImpl(context), wrap->m_security);
+                    bool in_global_prototype_chain = false;
+                    JSObjectRef global = JSContextGetGlobalObject(ctx);
+                    while (JSValueIsObject(ctx, global) && !in_global_prototype_chain) {
+                        in_global_prototype_chain = JSValueIsStrictEqual(ctx, global, o);
+                        global = (JSObjectRef) JSObjectGetPrototype(ctx, global);
+                    }
+                    if (in_global_prototype_chain) {
+                        // We can't have proxies in the global prototype chain.  If this is proxied,
+                        // remove the ES6 proxy.  We will rely on the legacy proxy instead.
+                        JSObjectRef maybe_proxy = (JSObjectRef) ToJSValueRef(proto, context);
+                        auto wrap = V82JSC::TrackedObject::getPrivateInstance(ctx, maybe_proxy);
+                        if (wrap) {
+                            proto = V82JSC::Value::New(ToContextImpl(context), wrap->m_security);
+                        }
                     }
-                }
 
-                if (SetPrototypeSkipHidden(info.GetIsolate()->GetCurrentContext(), obj, proto)) {
-                    info.GetReturnValue().Set(True(info.GetIsolate()));
-                } else {
-                    info.GetReturnValue().Set(False(info.GetIsolate()));
-                }
-            });
-        Local<FunctionTemplate> getPrototypeOf = FunctionTemplate::New(
-            isolate,
-            [](const FunctionCallbackInfo<Value>& info) {
-                JSContextRef ctx = ToContextRef(info.GetIsolate());
-                Local<Context> context = info.GetIsolate()->GetCurrentContext();
-                JSValueRef o = ToJSValueRef(info[0], context);
+                    if (SetPrototypeSkipHidden(info.GetIsolate()->GetCurrentContext(), obj, proto)) {
+                        info.GetReturnValue().Set(True(info.GetIsolate()));
+                    } else {
+                        info.GetReturnValue().Set(False(info.GetIsolate()));
+                    }
+                }));
+            i->m_get_prototype_of_template.Reset(isolate, FunctionTemplate::New(
+                isolate,
+                [](const FunctionCallbackInfo<Value>& info) {
+                    JSContextRef ctx = ToContextRef(info.GetIsolate());
+                    Local<Context> context = info.GetIsolate()->GetCurrentContext();
+                    JSValueRef o = ToJSValueRef(info[0], context);
                 
-                if (JSValueIsObject(ctx, o)) {
-                    JSValueRef args[] = {
-                        ToIsolateImpl(info.GetIsolate())->m_creation_contexts,
-                        o
-                    };
-                    JSValueRef cc = exec(ctx, "return _1.get(_2)", 2, args);
-                    JSGlobalContextRef gctx = 0;
-                    if (JSValueIsObject(ctx, cc)) gctx = (JSGlobalContextRef)JSObjectGetPrivate((JSObjectRef)cc);
-
-                    if (gctx && ToIsolateImpl(info.GetIsolate())->m_global_contexts.count(gctx)) {
-                        Local<Context> other = ToIsolateImpl(info.GetIsolate())->m_global_contexts[gctx].Get(info.GetIsolate());
-                        bool isGlobal = other->Global()->StrictEquals(info[0]);
-                        if (isGlobal && !context->Global()->StrictEquals(info[0])) {
-                            info.GetReturnValue().Set(Null(info.GetIsolate()));
-                            return;
+                    if (JSValueIsObject(ctx, o)) {
+                        JSValueRef args[] = {
+                            ToIsolateImpl(info.GetIsolate())->m_creation_contexts,
+                            o
+                        };
+                        JSValueRef cc = exec(ctx, "return _1.get(_2)", 2, args);
+                        JSGlobalContextRef gctx = 0;
+                        if (JSValueIsObject(ctx, cc)) gctx = (JSGlobalContextRef)JSObjectGetPrivate((JSObjectRef)cc);
+
+                        if (gctx && ToIsolateImpl(info.GetIsolate())->m_global_contexts.count(gctx)) {
+                            Local<Context> other = ToIsolateImpl(info.GetIsolate())->m_global_contexts[gctx].Get(info.GetIsolate());
+                            bool isGlobal = other->Global()->StrictEquals(info[0]);
+                            if (isGlobal && !context->Global()->StrictEquals(info[0])) {
+                                info.GetReturnValue().Set(Null(info.GetIsolate()));
+                                return;
+                            }
                         }
                     }
-                }
 
-                Local<Object> obj = info[0].As<Object>();
-                info.GetReturnValue().Set(GetPrototypeSkipHidden(info.GetIsolate()->GetCurrentContext(), obj));
-            });
-        // Don't use ctx->Global() here because it may return a proxy, which we can't use in setting up the global object
-        Local<Object> global = V82JSC::Value::New(reinterpret_cast<V82JSC::Context*>(context),
-                                              JSContextGetGlobalObject(context->m_ctxRef)).As<Object>();
-        Local<Object> object = global->Get(ctx,
-            String::NewFromUtf8(isolate, "Object", NewStringType::kNormal).ToLocalChecked()).ToLocalChecked().As<Object>();
-        Local<String> SsetPrototypeOf = String::NewFromUtf8(isolate, "setPrototypeOf", NewStringType::kNormal).ToLocalChecked();
-        Local<String> SgetPrototypeOf = String::NewFromUtf8(isolate, "getPrototypeOf", NewStringType::kNormal).ToLocalChecked();
-
-        context->ObjectSetPrototypeOf.Reset(isolate, object->Get(ctx, SsetPrototypeOf).ToLocalChecked().As<Function>());
-        context->ObjectGetPrototypeOf.Reset(isolate, object->Get(ctx, SgetPrototypeOf).ToLocalChecked().As<Function>());
-        CHECK(object->Set(ctx,
-                          SsetPrototypeOf,
-                          setPrototypeOf->GetFunction(ctx).ToLocalChecked()).ToChecked());
-        CHECK(object->Set(ctx,
-                          SgetPrototypeOf,
-                          getPrototypeOf->GetFunction(ctx).ToLocalChecked()).ToChecked());
-        
-        // ... and capture all attempts to set the prototype through __proto__
-        exec(context->m_ctxRef,
-                     "Object.defineProperty( Object.prototype, '__proto__',"
-                     "{"
-                     "  get() { return Object.getPrototypeOf(this); },"
-                     "  set(p) { return Object.setPrototypeOf(this, p); },"
-                     "  enumerable: false,"
-                     "  configurable: false"
-                     "});", 0, nullptr);
+                    Local<Object> obj = info[0].As<Object>();
+                    info.GetReturnValue().Set(GetPrototypeSkipHidden(info.GetIsolate()->GetCurrentContext(), obj));
+                }));
+            // All we are doing intercepting calls to bind and then calling the original bind and returning the
+            // value.  But we need to ensure that the creation context of the bound object is the same as the
+            // creation context of the function.
+            i->m_bind_template.Reset(isolate, FunctionTemplate::New(isolate, [](const FunctionCallbackInfo<Value>& info) {
+                Local<Context> context = info.This()->CreationContext();
+                Context::Scope context_scope(context);
+                Local<Value> args[info.Length()];
+                for (int i=0; i<info.Length(); i++) {
+                    args[i] = info[i];
+                }
+                MaybeLocal<Value> bound = ToGlobalContextImpl(context)->FunctionPrototypeBind.Get(info.GetIsolate())
+                    ->Call(context, info.This(), info.Length(), args);
+                if (!bound.IsEmpty()) {
+                    JSObjectRef bf = (JSObjectRef) ToJSValueRef(bound.ToLocalChecked(), context);
+                    JSObjectRef bound_function = (JSObjectRef) ToJSValueRef(info.This(), context);
+                    auto wrap = V82JSC::TrackedObject::makePrivateInstance(ToIsolateImpl(info.GetIsolate()),
+                                                                  ToContextRef(context), bf);
+                    wrap->m_bound_function = bound_function;
+                    JSValueProtect(ToContextRef(context), wrap->m_bound_function);
+                
+                    info.GetReturnValue().Set(bound.ToLocalChecked());
+                }
+            }));
+        }
+        Local<FunctionTemplate> setPrototypeOf = Local<FunctionTemplate>::New(isolate, i->m_set_prototype_of_template);
+        Local<FunctionTemplate> getPrototypeOf = Local<FunctionTemplate>::New(isolate, i->m_get_prototype_of_template);
+        Local<FunctionTemplate> bind_template = Local<FunctionTemplate>::New(isolate, i->m_bind_template);
+
+        // Capture all proxy targets in a WeakMap (the irony of proxying Proxy is not lost on me),
+        // proxy Object.getPrototypeOf and Object.setPrototypeOf and capture all attempts to set the
+        // prototype through __proto__, filter out our private symbol (nobody needs to see that),
+        // and override Function.prototype.bind().  This is all done in one pass to keep
+        // Context::New() cheap for things like vm.runInNewContext().
+        JSValueRef setup_args[] = {
+            context->m_proxy_targets,
+            i->m_private_symbol,
+            ToJSValueRef(setPrototypeOf->GetFunction(ctx).ToLocalChecked(), ctx),
+            ToJSValueRef(getPrototypeOf->GetFunction(ctx).ToLocalChecked(), ctx),
+            ToJSValueRef(bind_template->GetFunction(ctx).ToLocalChecked(), ctx)
+        };
+        JSObjectRef originals = (JSObjectRef) exec(context->m_ctxRef,
+             "const handler = { "
+             "  construct(t,a,n) { "
+             "    let proxy = Reflect.construct(t,a,n); "
+             "    _1.set(proxy,t); "
+             "    return proxy; "
+             "  } "
+             "}; "
+             "Proxy = new Proxy(Proxy, handler); "
+             "const originals = [ Object.setPrototypeOf, Object.getPrototypeOf, "
+             "    Object.prototype.toString, Function.prototype.bind, eval ]; "
+             "Object.setPrototypeOf = _3; "
+             "Object.getPrototypeOf = _4; "
+             "Object.defineProperty( Object.prototype, '__proto__',"
+             "{"
+             "  get() { return Object.getPrototypeOf(this); },"
+             "  set(p) { return Object.setPrototypeOf(this, p); },"
+             "  enumerable: false,"
+             "  configurable: false"
+             "}); "
+             "var old = Object.getOwnPropertySymbols; "
+             "Object.getOwnPropertySymbols = "
+             "    (o) => old(o).filter( (s)=> s!= _2 ); "
+             "Function.prototype.bind = _5; "
+             "return originals;",
+             5, setup_args);
         
-        // Filter out our private symbol.  Nobody needs to see that.
-        exec(context->m_ctxRef,
-                     "var old = Object.getOwnPropertySymbols; "
-                     "Object.getOwnPropertySymbols = "
-                     "    (o) => old(o).filter( (s)=> s!= _1 )",
-                     1, &i->m_private_symbol);
+        proxyArrayBuffer(context);
         
         auto ctximpl = reinterpret_cast<V82JSC::Context*>(context);
+        auto original = [&](unsigned index) -> Local<Function> {
+            JSValueRef excp = 0;
+            JSValueRef f = JSObjectGetPropertyAtIndex(context->m_ctxRef, originals, index, &excp);
+            assert(excp == 0);
+            return V82JSC::Value::New(ctximpl, f).As<Function>();
+        };
+        context->ObjectSetPrototypeOf.Reset(isolate, original(0));
+        context->ObjectGetPrototypeOf.Reset(isolate, original(1));
         // Save a reference to original Object.prototype.toString()
-        JSValueRef toString = exec(context->m_ctxRef, "return Object.prototype.toString", 0, nullptr);
-        context->ObjectPrototypeToString.Reset(isolate, V82JSC::Value::New(ctximpl, toString).As<Function>());
-        
-        // Override Function.prototype.bind()
-        // All we are doing intercepting calls to bind and then calling the original bind and returning the
-        // value.  But we need to ensure that the creation context of the bound object is the same as the
-        // creation context of the function.
-        JSValueRef bind = exec(context->m_ctxRef, "return Function.prototype.bind", 0, nullptr);
-        context->FunctionPrototypeBind.Reset(isolate, V82JSC::Value::New(ctximpl, bind).As<Function>());
-        Local<FunctionTemplate> bind_template = FunctionTemplate::New(isolate, [](const FunctionCallbackInfo<Value>& info) {
-            Local<Context> context = info.This()->CreationContext();
-            Context::Scope context_scope(context);
-            Local<Value> args[info.Length()];
-            for (int i=0; i<info.Length(); i++) {
-                args[i] = info[i];
-            }
-            MaybeLocal<Value> bound = ToGlobalContextImpl(context)->FunctionPrototypeBind.Get(info.GetIsolate())
-                ->Call(context, info.This(), info.Length(), args);
-            if (!bound.IsEmpty()) {
-                JSObjectRef bf = (JSObjectRef) ToJSValueRef(bound.ToLocalChecked(), context);
-                JSObjectRef bound_function = (JSObjectRef) ToJSValueRef(info.This(), context);
-                auto wrap = V82JSC::TrackedObject::makePrivateInstance(ToIsolateImpl(info.GetIsolate()),
-                                                              ToContextRef(context), bf);
-                wrap->m_bound_function = bound_function;
-                JSValueProtect(ToContextRef(context), wrap->m_bound_function);
-                
-                info.GetReturnValue().Set(bound.ToLocalChecked());
-            }
-        });
-        JSValueRef new_bind = ToJSValueRef(bind_template->GetFunction(ctx).ToLocalChecked(), ctx);
-        exec(context->m_ctxRef, "Function.prototype.bind = _1", 1, &new_bind);
-        
-        JSValueRef eval = exec(context->m_ctxRef, "return eval", 0, nullptr);
-        context->Eval.Reset(isolate, V82JSC::Value::New(reinterpret_cast<V82JSC::Context*>(context), eval).As<v8::Function>());
+        context->ObjectPrototypeToString.Reset(isolate, original(2));
+        context->FunctionPrototypeBind.Reset(isolate, original(3));
+        context->Eval.Reset(isolate, original(4));
         
-        JSStringRef e = JSStringCreateWithUTF8CString("Function");
-        JSClassDefinition def = kJSClassDefinitionEmpty;
-        def.attributes |= kJSClassAttributeNoAutomaticPrototype;
-        def.callAsFunction = [](JSContextRef ctx, JSObjectRef proxy_function, JSObjectRef thisObject,
-                                size_t argumentCount, const JSValueRef *arguments, JSValueRef *exception) ->JSValueRef
-        {
-            IsolateImpl* iso =IsolateFromCtx(ctx);
-            Isolate *isolate = ToIsolate(ToIsolate(iso));
+        static JSClassRef function_ctor_class = []() {
+            JSClassDefinition def = kJSClassDefinitionEmpty;
+            def.attributes |= kJSClassAttributeNoAutomaticPrototype;
+            def.callAsFunction = [](JSContextRef ctx, JSObjectRef proxy_function, JSObjectRef thisObject,
+                                    size_t argumentCount, const JSValueRef *arguments, JSValueRef *exception) ->JSValueRef
+            {
+                IsolateImpl* iso =IsolateFromCtx(ctx);
+                Isolate *isolate = ToIsolate(ToIsolate(iso));
             
-            HandleScope scope(isolate);
+                HandleScope scope(isolate);
             
-            Local<Context> global_context = iso->m_global_contexts[JSContextGetGlobalContext(ctx)].Get(isolate);
-            auto context = ToImpl<V82JSC::GlobalContext>(global_context);
-            bool allow;
-            if (iso->m_allow_code_gen_callback) {
-                Local<String> source = V82JSC::Value::New(reinterpret_cast<V82JSC::Context*>(context),
-                                                      arguments[0]).As<String>();
-                allow = iso->m_allow_code_gen_callback(global_context, source);
-            } else {
-                allow = !context->m_code_eval_from_strings_disallowed;
-            }
+                Local<Context> global_context = iso->m_global_contexts[JSContextGetGlobalContext(ctx)].Get(isolate);
+                auto context = ToImpl<V82JSC::GlobalContext>(global_context);
+                bool allow;
+                if (iso->m_allow_code_gen_callback) {
+                    Local<String> source = V82JSC::Value::New(reinterpret_cast<V82JSC::Context*>(context),
+                                                          arguments[0]).As<String>();
+                    allow = iso->m_allow_code_gen_callback(global_context, source);
+                } else {
+                    allow = !context->m_code_eval_from_strings_disallowed;
+                }
             
-            if (!allow) {
-                return DisallowCodeGenFromStrings(ctx, proxy_function, thisObject, argumentCount, arguments, exception);
-            } else {
-                return exec(ctx, "return Reflect.construct(_1, _2, _3)",
-                                    (int)argumentCount, arguments, exception);
-            }
-        };
-        JSClassRef klass = JSClassCreate(&def);
-        JSValueRef FunctionCtor = JSObjectMake(context->m_ctxRef, klass, 0);
-        JSStringRelease(e);
+                if (!allow) {
+                    return DisallowCodeGenFromStrings(ctx, proxy_function, thisObject, argumentCount, arguments, exception);
+                } else {
+                    return exec(ctx, "return Reflect.construct(_1, _2, _3)",
+                                        (int)argumentCount, arguments, exception);
+                }
+            };
+            return JSClassCreate(&def);
+        }();
+        JSValueRef FunctionCtor = JSObjectMake(context->m_ctxRef, function_ctor_class, 0);
+        /* FIXME: This is some esoteric functionality in V8.  The solution breaks React Native
         /* FIXME: This is some esoteric functionality in V8.  The solution breaks React Native
          * because (class A {}).constructor !== Function, which it should be.  We should only
          * do this if the isolate explicity requires it.
@@ -557,20 +566,17 @@ Local<v8::Context> v8::Context::New(Isolate* isolate, ExtensionConfiguration* ex
         
         JSStringRef zGlobal = JSStringCreateWithUTF8CString("global");
         JSStringRef zSetTimeout = JSStringCreateWithUTF8CString("setTimeout");
-        JSStringRef zPromise = JSStringCreateWithUTF8CString("Promise");
-        JSStringRef zPromisePolyfill = JSStringCreateWithUTF8CString((const char*)promise_polyfill_js);
 
         JSObjectRef setTimeout = JSObjectMakeFunctionWithCallback
         (context->m_ctxRef, zSetTimeout,
          [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
             size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) ->JSValueRef {
              
-             IsolateImpl* iso = IsolateFromCtx(ctx);
-             Isolate *isolate = ToIsolate(ToIsolate(iso));
-             HandleScope scope(isolate);
-             Local<Context> ctxt = LocalContext::New(isolate, ctx);
-             
-             isolate->EnqueueMicrotask(V82JSC::Value::New(ToContextImpl(ctxt), arguments[0]).As<Function>());
+             // Run JSC-side jobs directly instead of wrapping them in a v8::Function
+             if (argumentCount > 0 && JSValueIsObject(ctx, arguments[0])) {
+                 IsolateImpl* iso = IsolateFromCtx(ctx);
+                 iso->m_microtask_queue.push_back(IsolateImpl::EnqueuedMicrotask(ctx, (JSObjectRef)arguments[0], false));
+             }
              return JSValueMakeUndefined(ctx);
          });
         JSValueRef excp = 0;
@@ -579,27 +585,28 @@ Local<v8::Context> v8::Context::New(Isolate* isolate, ExtensionConfiguration* ex
         JSObjectSetProperty(context->m_ctxRef, global_o, zGlobal, global_o, 0, &excp);
         assert(excp == 0);
 /*
+        JSStringRef zPromise = JSStringCreateWithUTF8CString("Promise");
+        JSStringRef zPromisePolyfill = JSStringCreateWithUTF8CString((const char*)promise_polyfill_js);
         JSObjectDeleteProperty(context->m_ctxRef, global_o, zPromise, &excp);
         assert(excp == 0);
         JSEvaluateScript(context->m_ctxRef, zPromisePolyfill, global_o, 0, 0, &excp);
         assert(excp == 0);
+        JSStringRelease(zPromise);
+        JSStringRelease(zPromisePolyfill);
 */
 
-        JSStringRef zTypedArrayPolyfill = JSStringCreateWithUTF8CString((const char*)typedarray_js);
+        // The polyfill sources are large; only convert them once
+        static JSStringRef zTypedArrayPolyfill = JSStringCreateWithUTF8CString((const char*)typedarray_js);
+        static JSStringRef zErrorPolyfill = JSStringCreateWithUTF8CString((const char*)error_polyfill_js);
         JSEvaluateScript(context->m_ctxRef, zTypedArrayPolyfill, global_o, 0, 0, &excp);
         assert(excp == 0);
 
-        JSStringRef zErrorPolyfill = JSStringCreateWithUTF8CString((const char*)error_polyfill_js);
         JSEvaluateScript(context->m_ctxRef, zErrorPolyfill, global_o, 0, 0, &excp);
         assert(excp == 0);
 
         JSObjectDeleteProperty(context->m_ctxRef, global_o, zSetTimeout, &excp);
         assert(excp == 0);
 
-        JSStringRelease(zPromise);
-        JSStringRelease(zPromisePolyfill);
-        JSStringRelease(zTypedArrayPolyfill);
-        JSStringRelease(zErrorPolyfill);
         JSStringRelease(zSetTimeout);
         JSStringRelease(zGlobal);
         
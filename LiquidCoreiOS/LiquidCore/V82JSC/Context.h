@@ -70,6 +70,13 @@ struct GlobalContext : Context {
         
         if (obj->m_creation_context) JSValueUnprotect(obj->GetNullContext(), obj->m_creation_context);
         if (obj->m_proxy_targets) JSValueUnprotect(obj->GetNullContext(), obj->m_proxy_targets);
+        for (auto i=iso->m_template_functions.begin(); i!=iso->m_template_functions.end(); ++i) {
+            auto function = i->second.find((JSGlobalContextRef)obj->m_ctxRef);
+            if (function != i->second.end()) {
+                JSValueUnprotect(obj->GetNullContext(), function->second);
+                i->second.erase(function);
+            }
+        }
         if (obj->m_ctxRef) JSGlobalContextRelease((JSGlobalContextRef)obj->m_ctxRef);
         int freed=0;
         freed +=SmartReset<v8::Function>(context, obj->ObjectSetPrototypeOf);
@@ -5,10 +5,184 @@
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
 #include "V82JSC.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <chrono>
 
-using namespace V82JSC;
-using v8::CpuProfiler;
-using v8::CpuProfile;
+using v8::Isolate;
+using v8::Local;
+using v8::HandleScope;
+using v8::internal::IsolateImpl;
+using V82JSC::ToIsolate;
+using V82JSC::ToIsolateImpl;
+using V82JSC::ToContextRef;
+using V82JSC::OperatingContext;
+
+static int64_t Now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string ToStdString(Local<v8::Value> value)
+{
+    if (value.IsEmpty()) return std::string();
+    v8::String::Utf8Value str(value);
+    return *str ? std::string(*str, str.length()) : std::string();
+}
+
+static bool ToNumber(const std::string& digits, int *number)
+{
+    if (digits.empty() || digits.size() > 9) return false;
+    for (char c : digits) {
+        if (c < '0' || c > '9') return false;
+    }
+    *number = atoi(digits.c_str());
+    return true;
+}
+
+// Parses one line of a JSC backtrace.  JSContextCreateBacktrace produces
+// "#<index> <function>() at <url>[:<line>]" and Error.stack produces "<function>@<url>:<line>:<column>".
+// Returns false for frames we don't report (native code).
+static bool ParseFrame(const std::string& line, V82JSC::ProfileFrame *frame)
+{
+    std::string location;
+    if (!line.empty() && line[0] == '#') {
+        size_t space = line.find(' ');
+        size_t at = space == std::string::npos ? space : line.find("() at ", space);
+        if (at == std::string::npos) return false;
+        frame->m_function_name = line.substr(space + 1, at - space - 1);
+        location = line.substr(at + 6);
+    } else {
+        size_t at = line.find('@');
+        frame->m_function_name = at == std::string::npos ? std::string() : line.substr(0, at);
+        location = at == std::string::npos ? line : line.substr(at + 1);
+    }
+
+    int numbers[2];
+    int count = 0;
+    while (count < 2) {
+        size_t colon = location.rfind(':');
+        if (colon == std::string::npos || !ToNumber(location.substr(colon + 1), &numbers[count])) break;
+        location.resize(colon);
+        count++;
+    }
+    frame->m_line_number = count == 0 ? v8::CpuProfileNode::kNoLineNumberInfo : numbers[count - 1];
+    frame->m_column_number = count == 2 ? numbers[0] : v8::CpuProfileNode::kNoColumnNumberInfo;
+    frame->m_script_name = location;
+
+    if (frame->m_function_name == "[native code]" || frame->m_script_name == "[native code]") {
+        return false;
+    }
+    if (frame->m_function_name == "global code") {
+        frame->m_function_name.clear();
+    }
+    return true;
+}
+
+static const V82JSC::ProfileFrame s_root_frame = {
+    "(root)", "", v8::CpuProfileNode::kNoLineNumberInfo, v8::CpuProfileNode::kNoColumnNumberInfo
+};
+static const V82JSC::ProfileFrame s_program_frame = {
+    "(program)", "", v8::CpuProfileNode::kNoLineNumberInfo, v8::CpuProfileNode::kNoColumnNumberInfo
+};
+
+V82JSC::CpuProfile::CpuProfile(CpuProfiler *profiler, const std::string& title, bool record_samples,
+                               int64_t start_time) :
+    m_profiler(profiler), m_title(title), m_record_samples(record_samples), m_next_node_id(2),
+    m_root(s_root_frame, v8::UnboundScript::kNoScriptId, 1), m_start_time(start_time), m_end_time(start_time)
+{
+}
+
+void V82JSC::CpuProfile::AddPath(const std::vector<ProfileFrame>& frames, const std::vector<int>& script_ids,
+                                 int64_t timestamp, bool update_stats)
+{
+    CpuProfileNode *node = &m_root;
+    for (size_t i=0; i<frames.size(); i++) {
+        auto found = std::find_if(node->m_children.begin(), node->m_children.end(), [&](CpuProfileNode *child) {
+            return child->m_function_name == frames[i].m_function_name &&
+                child->m_script_name == frames[i].m_script_name;
+        });
+        if (found == node->m_children.end()) {
+            node->m_children.push_back(new CpuProfileNode(frames[i], script_ids[i], m_next_node_id++));
+            node = node->m_children.back();
+        } else {
+            node = *found;
+        }
+    }
+    if (update_stats) {
+        node->m_hit_count ++;
+        if (!frames.empty() && frames.back().m_line_number > 0) {
+            node->m_line_ticks[frames.back().m_line_number] ++;
+        }
+    }
+    if (m_record_samples) {
+        m_samples.push_back(node);
+        m_timestamps.push_back(timestamp);
+    }
+}
+
+void V82JSC::CpuProfiler::Sample(IsolateImpl *iso, JSContextRef ctx)
+{
+    iso->m_cpu_profiler->CollectSample(ctx, true);
+}
+
+void V82JSC::CpuProfiler::CollectSample(JSContextRef ctx, bool update_stats)
+{
+    if (m_recording.empty()) return;
+    int64_t timestamp = Now();
+    Isolate *isolate = ToIsolate(m_isolate);
+    HandleScope scope(isolate);
+
+    // The only way to learn a script's id by name is to catch it running
+    auto thread = IsolateImpl::PerThreadData::Get(m_isolate);
+    if (!thread->m_running_scripts.empty()) {
+        Local<v8::UnboundScript> script = thread->m_running_scripts.top()->GetUnboundScript();
+        int id = script->GetId();
+        if (m_seen_script_ids.insert(id).second) {
+            m_script_ids[ToStdString(script->GetScriptName())] = id;
+        }
+    }
+
+    JSStringRef trace = JSCPrivate::JSContextCreateBacktrace(ctx, v8::TickSample::kMaxFramesCount);
+    std::string backtrace(JSStringGetMaximumUTF8CStringSize(trace), '\0');
+    backtrace.resize(JSStringGetUTF8CString(trace, &backtrace[0], backtrace.size()) - 1);
+    JSStringRelease(trace);
+
+    // Backtraces list the innermost frame first; the tree wants the outermost first
+    std::vector<ProfileFrame> frames;
+    size_t start = 0;
+    while (start < backtrace.size()) {
+        size_t end = backtrace.find('\n', start);
+        if (end == std::string::npos) end = backtrace.size();
+        ProfileFrame frame;
+        if (ParseFrame(backtrace.substr(start, end - start), &frame)) {
+            frames.push_back(frame);
+        }
+        start = end + 1;
+    }
+    std::reverse(frames.begin(), frames.end());
+    if (frames.empty()) {
+        frames.push_back(s_program_frame);
+    }
+
+    std::vector<int> script_ids;
+    for (auto& frame : frames) {
+        auto found = m_script_ids.find(frame.m_script_name);
+        script_ids.push_back(found == m_script_ids.end() ? v8::UnboundScript::kNoScriptId : found->second);
+    }
+
+    for (auto profile : m_recording) {
+        profile->AddPath(frames, script_ids, timestamp, update_stats);
+    }
+}
+
+static void ArmWatchdog(IsolateImpl *iso, V82JSC::CpuProfiler *profiler)
+{
+    iso->m_cpu_profiler = profiler;
+    iso->m_watchdog_interval = profiler ? profiler->m_sampling_interval / 1000000.0 : 0;
+    iso->ResetWatchdog();
+}
 
 /**
  * Interface for controlling CPU profiling. Instance of the
@@ -20,18 +194,23 @@ using v8::CpuProfile;
  * initialized. The profiler object must be disposed after use by calling
  * |Dispose| method.
  */
-CpuProfiler* CpuProfiler::New(Isolate* isolate)
+v8::CpuProfiler* v8::CpuProfiler::New(Isolate* isolate)
 {
-    assert(0);
-    return nullptr;
+    return reinterpret_cast<v8::CpuProfiler*>(new V82JSC::CpuProfiler(ToIsolateImpl(isolate)));
 }
-    
+
 /**
  * Disposes the CPU profiler object.
  */
-void CpuProfiler::Dispose()
+void v8::CpuProfiler::Dispose()
 {
-    assert(0);
+    auto impl = reinterpret_cast<V82JSC::CpuProfiler*>(this);
+    if (impl->m_isolate->m_cpu_profiler == impl) {
+        ArmWatchdog(impl->m_isolate, nullptr);
+    }
+    for (auto profile : impl->m_recording) delete profile;
+    for (auto profile : impl->m_finished) delete profile;
+    delete impl;
 }
 
 /**
@@ -39,9 +218,10 @@ void CpuProfiler::Dispose()
  * of microseconds. Default interval is 1000us. This method must be called
  * when there are no profiles being recorded.
  */
-void CpuProfiler::SetSamplingInterval(int us)
+void v8::CpuProfiler::SetSamplingInterval(int us)
 {
-    assert(0);
+    auto impl = reinterpret_cast<V82JSC::CpuProfiler*>(this);
+    impl->m_sampling_interval = std::max(us, 1);
 }
 
 /**
@@ -55,19 +235,38 @@ void CpuProfiler::SetSamplingInterval(int us)
  * |record_samples| parameter controls whether individual samples should
  * be recorded in addition to the aggregated tree.
  */
-void CpuProfiler::StartProfiling(Local<String> title, bool record_samples)
+void v8::CpuProfiler::StartProfiling(Local<String> title, bool record_samples)
 {
-    assert(0);
+    auto impl = reinterpret_cast<V82JSC::CpuProfiler*>(this);
+    std::string name = ToStdString(title);
+    for (auto profile : impl->m_recording) {
+        if (profile->m_title == name) return;
+    }
+    impl->m_recording.push_back(new V82JSC::CpuProfile(impl, name, record_samples, Now()));
+    ArmWatchdog(impl->m_isolate, impl);
 }
 
 /**
  * Stops collecting CPU profile with a given title and returns it.
  * If the title given is empty, finishes the last profile started.
  */
-CpuProfile* CpuProfiler::StopProfiling(Local<String> title)
+v8::CpuProfile* v8::CpuProfiler::StopProfiling(Local<String> title)
 {
-    assert(0);
-    return nullptr;
+    auto impl = reinterpret_cast<V82JSC::CpuProfiler*>(this);
+    std::string name = ToStdString(title);
+    auto found = name.empty() ? impl->m_recording.end() - (impl->m_recording.empty() ? 0 : 1) :
+        std::find_if(impl->m_recording.begin(), impl->m_recording.end(),
+                     [&name](V82JSC::CpuProfile* profile) { return profile->m_title == name; });
+    if (found == impl->m_recording.end()) return nullptr;
+
+    V82JSC::CpuProfile *profile = *found;
+    impl->m_recording.erase(found);
+    profile->m_end_time = Now();
+    impl->m_finished.push_back(profile);
+    if (impl->m_recording.empty() && impl->m_isolate->m_cpu_profiler == impl) {
+        ArmWatchdog(impl->m_isolate, nullptr);
+    }
+    return reinterpret_cast<v8::CpuProfile*>(profile);
 }
 
 /**
@@ -75,15 +274,239 @@ CpuProfile* CpuProfiler::StopProfiling(Local<String> title)
  * Recording the forced sample does not contribute to the aggregated
  * profile statistics.
  */
-void CpuProfiler::CollectSample()
+void v8::CpuProfiler::CollectSample()
 {
-    assert(0);
+    auto impl = reinterpret_cast<V82JSC::CpuProfiler*>(this);
+    Isolate *isolate = ToIsolate(impl->m_isolate);
+    HandleScope scope(isolate);
+    impl->CollectSample(ToContextRef(OperatingContext(isolate)), false);
 }
 
 /**
  * Tells the profiler whether the embedder is idle.
  */
-void CpuProfiler::SetIdle(bool is_idle)
+void v8::CpuProfiler::SetIdle(bool is_idle)
+{
+    // JSC only lets us sample while JS is running, so idle time is never attributed
+    auto impl = reinterpret_cast<V82JSC::CpuProfiler*>(this);
+    impl->m_is_idle = is_idle;
+}
+
+/**
+ * CpuProfile contains a CPU profile in a form of top-down call tree
+ * (from main() down to functions that do all the work).
+ */
+
+/** Returns CPU profile title. */
+Local<v8::String> v8::CpuProfile::GetTitle() const
+{
+    auto impl = reinterpret_cast<const V82JSC::CpuProfile*>(this);
+    Isolate *isolate = ToIsolate(impl->m_profiler->m_isolate);
+    return String::NewFromUtf8(isolate, impl->m_title.c_str(), NewStringType::kNormal,
+                               (int)impl->m_title.size()).ToLocalChecked();
+}
+
+/** Returns the root node of the top down call tree. */
+const v8::CpuProfileNode* v8::CpuProfile::GetTopDownRoot() const
+{
+    auto impl = reinterpret_cast<const V82JSC::CpuProfile*>(this);
+    return reinterpret_cast<const v8::CpuProfileNode*>(&impl->m_root);
+}
+
+/**
+ * Returns number of samples recorded. The samples are not recorded unless
+ * |record_samples| parameter of CpuProfiler::StartCpuProfiling is true.
+ */
+int v8::CpuProfile::GetSamplesCount() const
+{
+    return (int) reinterpret_cast<const V82JSC::CpuProfile*>(this)->m_samples.size();
+}
+
+/**
+ * Returns profile node corresponding to the top frame the sample at
+ * the given index.
+ */
+const v8::CpuProfileNode* v8::CpuProfile::GetSample(int index) const
+{
+    auto impl = reinterpret_cast<const V82JSC::CpuProfile*>(this);
+    return reinterpret_cast<const v8::CpuProfileNode*>(impl->m_samples.at(index));
+}
+
+/**
+ * Returns the timestamp of the sample. The timestamp is the number of
+ * microseconds since some unspecified starting point.
+ * The point is equal to the starting point used by GetStartTime.
+ */
+int64_t v8::CpuProfile::GetSampleTimestamp(int index) const
+{
+    return reinterpret_cast<const V82JSC::CpuProfile*>(this)->m_timestamps.at(index);
+}
+
+/**
+ * Returns time when the profile recording was started (in microseconds)
+ * since some unspecified starting point.
+ */
+int64_t v8::CpuProfile::GetStartTime() const
+{
+    return reinterpret_cast<const V82JSC::CpuProfile*>(this)->m_start_time;
+}
+
+/**
+ * Returns time when the profile recording was stopped (in microseconds)
+ * since some unspecified starting point.
+ * The point is equal to the starting point used by GetStartTime.
+ */
+int64_t v8::CpuProfile::GetEndTime() const
+{
+    return reinterpret_cast<const V82JSC::CpuProfile*>(this)->m_end_time;
+}
+
+/**
+ * Deletes the profile and removes it from CpuProfiler's list.
+ * All pointers to nodes previously returned become invalid.
+ */
+void v8::CpuProfile::Delete()
+{
+    auto impl = reinterpret_cast<V82JSC::CpuProfile*>(this);
+    auto& finished = impl->m_profiler->m_finished;
+    finished.erase(std::remove(finished.begin(), finished.end(), impl), finished.end());
+    delete impl;
+}
+
+/**
+ * CpuProfileNode represents a node in a call graph.
+ */
+
+/** Returns function name (empty string for anonymous functions.) */
+Local<v8::String> v8::CpuProfileNode::GetFunctionName() const
+{
+    auto impl = reinterpret_cast<const V82JSC::CpuProfileNode*>(this);
+    return String::NewFromUtf8(Isolate::GetCurrent(), impl->m_function_name.c_str(), NewStringType::kNormal,
+                               (int)impl->m_function_name.size()).ToLocalChecked();
+}
+
+/**
+ * Returns function name (empty string for anonymous functions.)
+ * The string ownership is *not* passed to the caller. It stays valid until
+ * profile is deleted. The function is thread safe.
+ */
+const char* v8::CpuProfileNode::GetFunctionNameStr() const
+{
+    return reinterpret_cast<const V82JSC::CpuProfileNode*>(this)->m_function_name.c_str();
+}
+
+/** Returns id of the script where function is located. */
+int v8::CpuProfileNode::GetScriptId() const
+{
+    return reinterpret_cast<const V82JSC::CpuProfileNode*>(this)->m_script_id;
+}
+
+/** Returns resource name for script from where the function originates. */
+Local<v8::String> v8::CpuProfileNode::GetScriptResourceName() const
+{
+    auto impl = reinterpret_cast<const V82JSC::CpuProfileNode*>(this);
+    return String::NewFromUtf8(Isolate::GetCurrent(), impl->m_script_name.c_str(), NewStringType::kNormal,
+                               (int)impl->m_script_name.size()).ToLocalChecked();
+}
+
+/**
+ * Returns resource name for script from where the function originates.
+ * The string ownership is *not* passed to the caller. It stays valid until
+ * profile is deleted. The function is thread safe.
+ */
+const char* v8::CpuProfileNode::GetScriptResourceNameStr() const
+{
+    return reinterpret_cast<const V82JSC::CpuProfileNode*>(this)->m_script_name.c_str();
+}
+
+/**
+ * Returns the number, 1-based, of the line where the function originates.
+ * kNoLineNumberInfo if no line number information is available.
+ */
+int v8::CpuProfileNode::GetLineNumber() const
+{
+    return reinterpret_cast<const V82JSC::CpuProfileNode*>(this)->m_line_number;
+}
+
+/**
+ * Returns 1-based number of the column where the function originates.
+ * kNoColumnNumberInfo if no column number information is available.
+ */
+int v8::CpuProfileNode::GetColumnNumber() const
+{
+    return reinterpret_cast<const V82JSC::CpuProfileNode*>(this)->m_column_number;
+}
+
+/**
+ * Returns the number of the function's source lines that collect the samples.
+ */
+unsigned int v8::CpuProfileNode::GetHitLineCount() const
+{
+    return (unsigned) reinterpret_cast<const V82JSC::CpuProfileNode*>(this)->m_line_ticks.size();
+}
+
+/** Returns the set of source lines that collect the samples.
+ *  The caller allocates buffer and responsible for releasing it.
+ *  True if all available entries are copied, otherwise false.
+ *  The function copies nothing if buffer is not large enough.
+ */
+bool v8::CpuProfileNode::GetLineTicks(LineTick* entries, unsigned int length) const
+{
+    auto impl = reinterpret_cast<const V82JSC::CpuProfileNode*>(this);
+    if (entries == nullptr || length < impl->m_line_ticks.size()) return false;
+    for (auto& tick : impl->m_line_ticks) {
+        entries->line = tick.first;
+        entries->hit_count = tick.second;
+        entries++;
+    }
+    return true;
+}
+
+/** Returns bailout reason for the function
+ * if the optimization was disabled for it.
+ */
+const char* v8::CpuProfileNode::GetBailoutReason() const
+{
+    return "";
+}
+
+/**
+ * Returns the count of samples where the function was currently executing.
+ */
+unsigned v8::CpuProfileNode::GetHitCount() const
+{
+    return reinterpret_cast<const V82JSC::CpuProfileNode*>(this)->m_hit_count;
+}
+
+/** Returns function entry UID. */
+unsigned v8::CpuProfileNode::GetCallUid() const
+{
+    return reinterpret_cast<const V82JSC::CpuProfileNode*>(this)->m_node_id;
+}
+
+/** Returns id of the node. The id is unique within the tree */
+unsigned v8::CpuProfileNode::GetNodeId() const
+{
+    return reinterpret_cast<const V82JSC::CpuProfileNode*>(this)->m_node_id;
+}
+
+/** Returns child nodes count of the node. */
+int v8::CpuProfileNode::GetChildrenCount() const
+{
+    return (int) reinterpret_cast<const V82JSC::CpuProfileNode*>(this)->m_children.size();
+}
+
+/** Retrieves a child node by index. */
+const v8::CpuProfileNode* v8::CpuProfileNode::GetChild(int index) const
+{
+    auto impl = reinterpret_cast<const V82JSC::CpuProfileNode*>(this);
+    return reinterpret_cast<const v8::CpuProfileNode*>(impl->m_children.at(index));
+}
+
+/** Retrieves deopt infos for the node. */
+const std::vector<v8::CpuProfileDeoptInfo>& v8::CpuProfileNode::GetDeoptInfos() const
 {
-    assert(0);
+    // JSC does not report deoptimizations
+    static const std::vector<v8::CpuProfileDeoptInfo> s_no_deopt_infos;
+    return s_no_deopt_infos;
 }
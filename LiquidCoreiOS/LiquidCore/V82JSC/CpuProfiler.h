@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+#ifndef V82JSC_CpuProfiler_h
+#define V82JSC_CpuProfiler_h
+
+#include "Isolate.h"
+#include "v8-profiler.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace V82JSC {
+
+struct CpuProfiler;
+
+// One frame of a sampled JS stack
+struct ProfileFrame {
+    std::string m_function_name;
+    std::string m_script_name;
+    int m_line_number;
+    int m_column_number;
+};
+
+struct CpuProfileNode {
+    CpuProfileNode(const ProfileFrame& frame, int script_id, unsigned node_id) :
+        m_function_name(frame.m_function_name), m_script_name(frame.m_script_name),
+        m_script_id(script_id), m_line_number(frame.m_line_number),
+        m_column_number(frame.m_column_number), m_hit_count(0), m_node_id(node_id) {}
+    ~CpuProfileNode()
+    {
+        for (auto child : m_children) delete child;
+    }
+
+    std::string m_function_name;
+    std::string m_script_name;
+    int m_script_id;
+    // JSC does not tell us where a function starts, so this is the first line sampled in it
+    int m_line_number;
+    int m_column_number;
+    unsigned m_hit_count;
+    unsigned m_node_id;
+    std::vector<CpuProfileNode*> m_children;
+    std::map<int, unsigned> m_line_ticks;
+};
+
+struct CpuProfile {
+    CpuProfile(CpuProfiler *profiler, const std::string& title, bool record_samples, int64_t start_time);
+
+    // Adds a sampled stack, outermost frame first, to the call tree
+    void AddPath(const std::vector<ProfileFrame>& frames, const std::vector<int>& script_ids,
+                 int64_t timestamp, bool update_stats);
+
+    CpuProfiler *m_profiler;
+    std::string m_title;
+    bool m_record_samples;
+    unsigned m_next_node_id;
+    CpuProfileNode m_root;
+    std::vector<CpuProfileNode*> m_samples;
+    std::vector<int64_t> m_timestamps;
+    int64_t m_start_time;
+    int64_t m_end_time;
+};
+
+// Samples are taken from the isolate's watchdog, which JSC only runs while JS is executing, so
+// idle time and native code outside of JS are not represented.
+struct CpuProfiler {
+    CpuProfiler(v8::internal::IsolateImpl *iso) :
+        m_isolate(iso), m_sampling_interval(1000), m_is_idle(false) {}
+
+    // Called on the VM thread, with JS on the stack, each time the watchdog fires
+    static void Sample(v8::internal::IsolateImpl *iso, JSContextRef ctx);
+    void CollectSample(JSContextRef ctx, bool update_stats);
+
+    v8::internal::IsolateImpl *m_isolate;
+    int m_sampling_interval; // microseconds
+    bool m_is_idle;
+    std::vector<CpuProfile*> m_recording;
+    std::vector<CpuProfile*> m_finished;
+    std::map<std::string, int> m_script_ids;
+    std::set<int> m_seen_script_ids;
+};
+
+} /* namespace V82JSC */
+
+#endif /* V82JSC_CpuProfiler_h */
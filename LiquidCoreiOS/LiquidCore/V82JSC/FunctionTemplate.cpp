@@ -61,7 +61,6 @@ Local<v8::FunctionTemplate> v8::FunctionTemplate::New(Isolate* isolate, Function
 {
     EscapableHandleScope scope(isolate);
     
-    Local<Context> context = OperatingContext(isolate);
     auto templ = static_cast<V82JSC::FunctionTemplate*>
     (HeapAllocator::Alloc(ToIsolateImpl(isolate),
                              ToIsolateImpl(isolate)->m_function_template_map));
@@ -76,10 +75,7 @@ Local<v8::FunctionTemplate> v8::FunctionTemplate::New(Isolate* isolate, Function
     if (data.IsEmpty()) {
         data = Undefined(isolate);
     }
-    templ->m_data = ToJSValueRef<Value>(data, isolate);
-    JSValueProtect(ToContextRef(context), templ->m_data);
-    templ->m_functions_map = exec(ToContextRef(context), "return new Map()", 0, 0);
-    JSValueProtect(ToContextRef(context), templ->m_functions_map);
+    templ->m_data.Reset(isolate, data);
     
     return scope.Escape(CreateLocal<FunctionTemplate>(isolate, templ));
 }
@@ -130,130 +126,89 @@ MaybeLocal<Function> V82JSC::FunctionTemplate::GetFunction(v8::FunctionTemplate
     
     Local<v8::FunctionTemplate> thiz = CreateLocal<v8::FunctionTemplate>(isolate, impl);
 
-    assert(impl->m_functions_map);
     auto gCtx = ToGlobalContextImpl(FindGlobalContext(context));
     assert(gCtx);
-    JSObjectRef function = nullptr;
-    if (gCtx->m_creation_context) {
-        JSValueRef args_get[] = {
-            impl->m_functions_map,
-            gCtx->m_creation_context
-        };
-        function = (JSObjectRef) exec(ctx, "return _1.get(_2)", 2, args_get);
-    }
-
-    if (function && JSValueIsObject(gCtx->m_ctxRef, function)) {
-        return scope.Escape(Value::New(ctximpl, function).As<Function>());
+    JSGlobalContextRef gctx = (JSGlobalContextRef) gCtx->m_ctxRef;
+    {
+        auto& functions = iso->m_template_functions[impl];
+        auto cached = functions.find(gctx);
+        if (cached != functions.end()) {
+            return scope.Escape(Value::New(ctximpl, cached->second).As<Function>());
+        }
     }
 
-    JSStringRef generic_function_name = JSStringCreateWithUTF8CString("generic_function");
-    JSStringRef empty_body = JSStringCreateWithUTF8CString("");
+    // The proxy classes are the same for every function, so only create them once
+    static JSClassRef function_class = []() {
+        JSClassDefinition function_def = kJSClassDefinitionEmpty;
+        function_def.callAsFunction = Template::callAsFunctionCallback;
+        function_def.className = "function_proxy";
+        function_def.finalize = [](JSObjectRef object) {
+            void * data = JSObjectGetPrivate(object);
+            ReleasePersistentData<v8::Template>(data);
+        };
+        return JSClassCreate(&function_def);
+    }();
+    static JSClassRef constructor_class = []() {
+        JSClassDefinition constructor_def = kJSClassDefinitionEmpty;
+        constructor_def.callAsFunction = FunctionTemplate::callAsConstructorCallback;
+        constructor_def.className = "constructor_proxy";
+        constructor_def.finalize = [](JSObjectRef object) {
+            void * data = JSObjectGetPrivate(object);
+            ReleasePersistentData<v8::Template>(data);
+        };
+        return JSClassCreate(&constructor_def);
+    }();
 
-    JSValueRef excp = nullptr;
-    JSObjectRef generic_function = JSObjectMakeFunction(ToContextRef(context),
-                                    generic_function_name, 0, 0, empty_body, 0, 0, &excp);
-    assert(excp == nullptr);
-    JSStringRelease(generic_function_name);
-    JSStringRelease(empty_body);
-    JSValueRef generic_function_prototype = exec(ToContextRef(context),
-                                                         "return Object.getPrototypeOf(_1)", 1,
-                                                         &generic_function);
+    JSValueRef generic_function_prototype = exec(ctx, "return Function.prototype", 0, nullptr);
 
     void * data = PersistentData<v8::Template>(isolate, thiz);
-    
-    JSClassDefinition function_def = kJSClassDefinitionEmpty;
-    function_def.callAsFunction = Template::callAsFunctionCallback;
-    function_def.className = "function_proxy";
-    function_def.finalize = [](JSObjectRef object) {
-        void * data = JSObjectGetPrivate(object);
-        ReleasePersistentData<v8::Template>(data);
-    };
-    JSClassRef function_class = JSClassCreate(&function_def);
     JSObjectRef function_proxy = JSObjectMake(ctx, function_class, data);
     SetRealPrototype(context, function_proxy, generic_function_prototype);
-    JSClassRelease(function_class);
 
     void * data2 = PersistentData<v8::Template>(isolate, thiz);
-
-    JSClassDefinition constructor_def = kJSClassDefinitionEmpty;
-    constructor_def.callAsFunction = FunctionTemplate::callAsConstructorCallback;
-    constructor_def.className = "constructor_proxy";
-    constructor_def.finalize = [](JSObjectRef object) {
-        void * data = JSObjectGetPrivate(object);
-        ReleasePersistentData<v8::Template>(data);
-    };
-    JSClassRef constructor_class = JSClassCreate(&constructor_def);
     JSObjectRef constructor_proxy = JSObjectMake(ctx, constructor_class, data2);
     SetRealPrototype(context, constructor_proxy, generic_function_prototype);
-    JSClassRelease(constructor_class);
     
-    static const char *proxy_function_template =
-    "function name () { "
+    // _1: function proxy, _2: constructor proxy, _3: length, _4: name
+    static const char *proxy_function_factory =
+    "var f = function () { "
     "    if (new.target) { "
-    "        return name_ctor.call(this, new.target == name, new.target, ...arguments); "
+    "        return _2.call(this, new.target == f, new.target, ...arguments); "
     "    } else { "
-    "        return name_func.call(this, ...arguments); "
+    "        return _1.call(this, ...arguments); "
     "    } "
     "}; "
-    "if (name_length) { "
-    "    Object.defineProperty(name, 'length', {value: name_length}); "
+    "Object.defineProperty(f, 'name', {value: _4}); "
+    "if (_3) { "
+    "    Object.defineProperty(f, 'length', {value: _3}); "
     "} "
-    "return name; ";
-
-    static const char *proxy_noconstructor_template =
-    "var name = () => name_func.call(this, ...arguments);"
-    "if (name_length) { "
-    "    Object.defineProperty(name, 'length', {value: name_length}); "
+    "return f; ";
+
+    // Method definitions are not constructors and have no 'prototype'
+    static const char *proxy_noconstructor_factory =
+    "var f = ({ f() { return _1.call(this, ...arguments); } }).f; "
+    "Object.defineProperty(f, 'name', {value: _4}); "
+    "if (_3) { "
+    "    Object.defineProperty(f, 'length', {value: _3}); "
     "} "
-    "return name; ";
-
-    auto ReplaceStringInPlace = [](std::string& subject, const std::string& search,
-                              const std::string& replace) {
-        size_t pos = 0;
-        while((pos = subject.find(search, pos)) != std::string::npos) {
-            subject.replace(pos, search.length(), replace);
-            pos += replace.length();
-        }
-    };
-    
-    std::string proxy_function_body = impl->m_removePrototype ? proxy_noconstructor_template : proxy_function_template;
+    "return f; ";
+
     Local<v8::String> name_ = impl->m_name.Get(isolate);
     if (name_.IsEmpty() && !inferred_name.IsEmpty() && inferred_name->IsString()) {
         name_ = inferred_name.As<v8::String>();
     } else if (name_.IsEmpty()) {
         name_ = v8::String::NewFromUtf8(isolate, "Function", v8::NewStringType::kNormal).ToLocalChecked();
     }
-    v8::String::Utf8Value str(name_);
-    const char *sname = !name_.IsEmpty() ? *str : "Function";
-    ReplaceStringInPlace(proxy_function_body, "name", sname);
-    
-    JSStringRef name = JSStringCreateWithUTF8CString("proxy_function");
-    JSStringRef body = JSStringCreateWithUTF8CString(proxy_function_body.c_str());
-    JSStringRef paramNames[] = {
-        JSStringCreateWithUTF8CString(std::string(std::string(sname) + "_func").c_str()),
-        JSStringCreateWithUTF8CString(std::string(std::string(sname) + "_ctor").c_str()),
-        JSStringCreateWithUTF8CString(std::string(std::string(sname) + "_length").c_str()),
-    };
-    JSValueRef exp = nullptr;
-    JSObjectRef get_proxy = JSObjectMakeFunction(ToContextRef(context),
-                                                 name,
-                                                 sizeof paramNames / sizeof (JSStringRef),
-                                                 paramNames,
-                                                 body, 0, 0, &exp);
-    assert(exp==nullptr);
-    JSStringRelease(name);
-    JSStringRelease(body);
-    for (int i=0; i < sizeof paramNames / sizeof (JSStringRef); i++) {
-        JSStringRelease(paramNames[i]);
-    }
+
     JSValueRef params[] = {
         function_proxy,
         constructor_proxy,
-        JSValueMakeNumber(ctx, impl->m_length)
+        JSValueMakeNumber(ctx, impl->m_length),
+        ToJSValueRef(name_, context)
     };
-    function = (JSObjectRef) JSObjectCallAsFunction(ToContextRef(context),
-                                                    get_proxy, 0, sizeof params / sizeof (JSValueRef), params, &exp);
-    assert(exp==nullptr);
+    JSObjectRef function = (JSObjectRef) exec(ctx, impl->m_removePrototype ?
+                                              proxy_noconstructor_factory : proxy_function_factory,
+                                              4, params);
     
     TrackedObject::makePrivateInstance(iso, ctx, function);
     
@@ -305,10 +260,8 @@ MaybeLocal<Function> V82JSC::FunctionTemplate::GetFunction(v8::FunctionTemplate
         JSStringRelease(sprototype);
     }
 
-    if (gCtx->m_creation_context) {
-        JSValueRef args_set[] = { impl->m_functions_map, gCtx->m_creation_context, function };
-        exec(ctx, "_1.set(_2, _3)", 3, args_set);
-    }
+    JSValueProtect(ctx, function);
+    iso->m_template_functions[impl][gctx] = function;
 
     return scope.Escape(Value::New(ctximpl, function).As<Function>());
 }
@@ -336,18 +289,13 @@ void v8::FunctionTemplate::SetCallHandler(FunctionCallback callback,
 {
     auto impl =  ToImpl<V82JSC::FunctionTemplate>(this);
     IsolateImpl* iso = ToIsolateImpl(impl);
-    auto ctx = ToContextRef(ToIsolate(iso));
     HandleScope scope(ToIsolate(iso));
     
     impl->m_callback = callback;
     if (!*data) {
         data = Undefined(ToIsolate(iso));
     }
-    if (impl->m_data) {
-        JSValueUnprotect(ctx, impl->m_data);
-    }
-    impl->m_data = ToJSValueRef(data, ToIsolate(iso));
-    JSValueProtect(ctx, impl->m_data);
+    impl->m_data.Reset(ToIsolate(iso), data);
 }
 
 /** Set the predefined length property for the FunctionTemplate. */
@@ -546,11 +494,13 @@ JSValueRef FunctionTemplate::callAsConstructorCallback(JSContextRef ctx,
 
     JSClassDefinition def = kJSClassDefinitionEmpty;
     void* data_ = nullptr;
+    // Outlives the class definition that points to it
+    std::string name;
     if (create_object) {
         def.attributes = kJSClassAttributeNoAutomaticPrototype;
         v8::String::Utf8Value str(ftempl->m_name.Get(isolate));
         if (*str) {
-            const std::string& name = *str;
+            name = *str;
             def.className = name.length() ? name.c_str() : nullptr;
         }
         if (otempl->m_callback) {
@@ -602,7 +552,7 @@ JSValueRef FunctionTemplate::callAsConstructorCallback(JSContextRef ctx,
 
     thread->m_callback_depth ++;
 
-    Local<v8::Value> data = Value::New(ToContextImpl(context), ftempl->m_data);
+    Local<v8::Value> data = ftempl->m_data.Get(ToIsolate(isolateimpl));
     typedef v8::internal::Heap::RootListIndex R;
     v8::internal::Object *the_hole = isolateimpl->ii.heap()->root(R::kTheHoleValueRootIndex);
 
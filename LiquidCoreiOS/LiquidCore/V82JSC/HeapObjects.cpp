@@ -7,15 +7,55 @@
 #include "HeapObjects.h"
 #include "Isolate.h"
 #include "Context.h"
+#include "TraceSpan.h"
+#include <atomic>
+#include <chrono>
+#include <sys/mman.h>
+#include <unistd.h>
 
 using namespace V82JSC;
 using namespace v8;
 
+// Per-slice sweep time in microseconds, or 0 to sweep everything in one pause
+static std::atomic<unsigned> s_sweep_budget_us(0);
+// The heap controller's growth factor (see UpdateAllocationLimit())
+static std::atomic<double> s_growth_factor(2.0);
+
+// Chunks are mapped directly, so that their free pages can be handed back
+static void* MapChunk(size_t length = HEAP_ALIGNMENT)
+{
+    // Map an extra chunk's worth, and trim it down to an aligned |length|
+    void *ptr = mmap(nullptr, length + HEAP_ALIGNMENT, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    assert(ptr != MAP_FAILED);
+    uintptr_t base = reinterpret_cast<uintptr_t>(ptr);
+    uintptr_t aligned = (base + HEAP_ALIGNMENT - 1) & ~(uintptr_t)(HEAP_ALIGNMENT - 1);
+    if (aligned > base) munmap(ptr, aligned - base);
+    munmap(reinterpret_cast<void*>(aligned + length), base + HEAP_ALIGNMENT - aligned);
+    return reinterpret_cast<void*>(aligned);
+}
+
+static inline size_t PageSize()
+{
+    static const size_t page_size = (size_t) getpagesize();
+    return page_size;
+}
+
+static inline int ObjectSize(IsolateImpl *iso, HeapObject *obj)
+{
+    BaseMap* map = (BaseMap*) FromHeapPointer(obj->m_map);
+    if ((void*)map == (void*)obj) {
+        return sizeof(BaseMap);
+    } else if (map == iso->m_fixed_array_map) {
+        FixedArray *fa = static_cast<FixedArray*>(obj);
+        return sizeof(FixedArray) + fa->m_size * sizeof(internal::Object*);
+    }
+    return map->size;
+}
+
 HeapObject * HeapAllocator::Alloc(IsolateImpl *isolate, const BaseMap *map, uint32_t size)
 {
     internal::Heap *heap = reinterpret_cast<internal::Isolate*>(isolate)->heap();
     HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
-    HeapAllocator *chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top);
     void *alloc = nullptr;
     int index = 0;
     int pos = 0;
@@ -28,11 +68,27 @@ HeapObject * HeapAllocator::Alloc(IsolateImpl *isolate, const BaseMap *map, uint
     uint32_t slots = (size <= (HEAP_SLOT_SIZE>>1)) ? 1 : 1 << (LogReserveSize(size) - HEAP_SLOT_SIZE_LOG);
     assert(slots > 0);
     uint32_t actual_used_slots = ((size - 1) / HEAP_SLOT_SIZE) + 1;
+    const int used_slots = actual_used_slots;
+    int log = LogReserveSize(size) - HEAP_SLOT_SIZE_LOG;
+    int size_class = (log < HEAP_SMALL_SPACE_LOG) ? log : HEAP_SMALL_SPACE_LOG;
+
+    // Start with the chunk that last satisfied this size class and go around the chunk list
+    // once, skipping chunks that are too full or already known to have no room for this class
+    HeapAllocator *start = isolate->m_alloc_chunk[size_class];
+    if (!start) start = static_cast<HeapAllocator*>(heapimpl->m_heap_top);
+    HeapAllocator *chunk = start;
+
+    if (size > HEAP_LARGE_OBJECT_SIZE) {
+        chunk = NewLargeChunk(isolate, size);
+        alloc = LargeObject(chunk);
+    }
 
     while (!alloc) {
-        if (chunk) {
+        if (chunk && (chunk->info.m_free_slots < used_slots ||
+                      (chunk->info.m_exhausted & (1 << size_class)))) {
+            // Don't bother
+        } else if (chunk) {
             pos = 0;
-            int log = LogReserveSize(size) - HEAP_SLOT_SIZE_LOG;
             if (log < HEAP_SMALL_SPACE_LOG) {
                 Transform xform = transform(slots);
                 for (index=chunk->info.m_small_indicies[log];
@@ -91,23 +147,28 @@ HeapObject * HeapAllocator::Alloc(IsolateImpl *isolate, const BaseMap *map, uint
                     chunk->info.m_large_index = index;
                 }
             }
-            if (!alloc)
-                chunk = static_cast<HeapAllocator*>(chunk->next_chunk());
+            if (!alloc && log < HEAP_SMALL_SPACE_LOG)
+                chunk->info.m_exhausted |= 1 << size_class;
+        }
+        if (!alloc && chunk) {
+            chunk = static_cast<HeapAllocator*>(chunk->next_chunk());
+            if (!chunk) chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top);
+            if (chunk == start) chunk = nullptr;
         }
         
         if (!alloc && !chunk) {
-            void *ptr;
-            posix_memalign(&ptr, kAlignment, kAlignment);
-            
-            chunk = (HeapAllocator *)ptr;
+            chunk = (HeapAllocator *)MapChunk();
             // Reserve first HEAP_RESERVED_SLOTS slots
             memset(chunk->alloc_map, 0xff, HEAP_RESERVED_SLOTS / 8);
-            // Clear the rest of reserved space
+            // Clear the rest of the allocation map and the mark bitmaps
             memset(reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(chunk->alloc_map) + (HEAP_RESERVED_SLOTS / 8)),
-                   0, HEAP_ALLOC_MAP_SIZE * 2 - (HEAP_RESERVED_SLOTS / 8));
+                   0, HEAP_ALLOC_MAP_SIZE * 3 - (HEAP_RESERVED_SLOTS / 8));
             for (int i=0; i<HEAP_SMALL_SPACE_LOG; i++)
                 chunk->info.m_small_indicies[i] = HEAP_BLOCKS-1;
             chunk->info.m_large_index = 0;
+            chunk->info.m_free_slots = HEAP_SLOTS - HEAP_RESERVED_SLOTS;
+            chunk->info.m_exhausted = 0;
+            memset(chunk->info.m_released, 0, sizeof(chunk->info.m_released));
 
             chunk->Initialize(heap, reinterpret_cast<internal::Address>(chunk),
                               kAlignment, reinterpret_cast<internal::Address>(chunk), reinterpret_cast<internal::Address>(chunk) - 1,
@@ -124,30 +185,127 @@ HeapObject * HeapAllocator::Alloc(IsolateImpl *isolate, const BaseMap *map, uint
         assert(alloc || chunk);
     }
     
-    memset(alloc, 0, size);
+    if (!chunk->info.m_large_size) {
+        chunk->info.m_free_slots -= used_slots;
+        isolate->m_alloc_chunk[size_class] = chunk;
+        ReclaimPages(chunk, alloc, size);
+        // A fresh mapping is already zeroed
+        memset(alloc, 0, size);
+    }
+
+    if (isolate->m_collecting_garbage) {
+        // Objects created by callbacks during a sweep must survive it
+        int slot = (int) (reinterpret_cast<intptr_t>(alloc) - reinterpret_cast<intptr_t>(chunk)) / HEAP_SLOT_SIZE;
+        chunk->mark_map[slot / 64] |= (uint64_t)1 << (slot % 64);
+    }
 
     HeapObject * o = reinterpret_cast<HeapObject*>(alloc);
 
     if (!map) {
         // We are a map.  Point to ourselves
         map = reinterpret_cast<BaseMap*>(o);
+    } else {
+        const_cast<BaseMap*>(map)->count ++;
+        const_cast<BaseMap*>(map)->bytes += used_slots * HEAP_SLOT_SIZE;
+        const_cast<BaseMap*>(map)->allocations ++;
+        const_cast<BaseMap*>(map)->allocated_bytes += used_slots * HEAP_SLOT_SIZE;
     }
     o->m_map = reinterpret_cast<internal::Map*>(reinterpret_cast<intptr_t>(map) + internal::kHeapObjectTag);
-    heapimpl->m_allocated += actual_used_slots * HEAP_SLOT_SIZE;
+    heapimpl->m_allocated += used_slots * HEAP_SLOT_SIZE;
+    isolate->m_gc_allocated_since += used_slots * HEAP_SLOT_SIZE;
+
+    // Grown far enough past what survived the last collection.  Not collected here, as the
+    // caller has yet to put what it allocated in a handle.
+    if (heapimpl->m_allocated >= isolate->m_gc_limit && !isolate->m_sweep_context &&
+        !isolate->m_in_gc && !isolate->m_pending_collection) {
+        isolate->m_gc_scheduled ++;
+        isolate->ScheduleGarbageCollection();
+    }
 
     return o;
 }
 
+// A large object lives alone, straight after the chunk header, in a mapping of its own.  It
+// is found, marked and counted just as any other object, but isn't in the chunk list; it is
+// swept separately and its mapping goes with it.
+HeapAllocator* HeapAllocator::NewLargeChunk(IsolateImpl *isolate, uint32_t size)
+{
+    internal::Heap *heap = reinterpret_cast<internal::Isolate*>(isolate)->heap();
+    HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
+    const size_t page = PageSize() - 1;
+    const size_t length = (HEAP_RESERVED_SLOTS * HEAP_SLOT_SIZE + size + page) & ~page;
+    HeapAllocator *chunk = (HeapAllocator *)MapChunk(length);
+    memset(chunk->alloc_map, 0xff, HEAP_RESERVED_SLOTS / 8);
+    chunk->alloc_map[HEAP_RESERVED_SLOTS / 64] = 1;
+    chunk->info.m_large_size = length;
+    chunk->Initialize(heap, reinterpret_cast<internal::Address>(chunk),
+                      length, reinterpret_cast<internal::Address>(chunk), reinterpret_cast<internal::Address>(chunk) - 1,
+                      internal::Executability::NOT_EXECUTABLE, nullptr, nullptr);
+
+    // Initialize() put it at the top of the chunk list; it goes at the top of its own
+    heapimpl->m_heap_top = chunk->next_chunk();
+    if (chunk->next_chunk()) chunk->next_chunk()->set_prev_chunk(nullptr);
+    chunk->set_next_chunk(isolate->m_large_objects);
+    if (isolate->m_large_objects) isolate->m_large_objects->set_prev_chunk(chunk);
+    isolate->m_large_objects = chunk;
+    return chunk;
+}
+
+void HeapAllocator::Retain(HeapContext& context, internal::Object *obj)
+{
+    intptr_t addr = reinterpret_cast<intptr_t>(obj) - internal::kHeapObjectTag;
+    HeapAllocator *chunk = reinterpret_cast<HeapAllocator*>(addr & ~(HEAP_ALIGNMENT - 1));
+    int slot = (int) (addr - reinterpret_cast<intptr_t>(chunk)) / HEAP_SLOT_SIZE;
+    int index = slot / 64;
+    uint64_t mask = (uint64_t)1 << (slot % 64);
+
+    if ((chunk->mark_map[index] & mask) == 0) {
+        chunk->mark_map[index] |= mask;
+    } else if ((chunk->shared_map[index] & mask) == 0) {
+        chunk->shared_map[index] |= mask;
+        context.shared_[obj] = 2;
+    } else {
+        context.shared_[obj] ++;
+    }
+}
+
+bool HeapAllocator::Release(HeapContext& context, internal::Object *obj)
+{
+    intptr_t addr = reinterpret_cast<intptr_t>(obj) - internal::kHeapObjectTag;
+    HeapAllocator *chunk = reinterpret_cast<HeapAllocator*>(addr & ~(HEAP_ALIGNMENT - 1));
+    int slot = (int) (addr - reinterpret_cast<intptr_t>(chunk)) / HEAP_SLOT_SIZE;
+    int index = slot / 64;
+    uint64_t mask = (uint64_t)1 << (slot % 64);
+
+    assert(chunk->mark_map[index] & mask);
+    if (chunk->shared_map[index] & mask) {
+        auto it = context.shared_.find(obj);
+        assert(it != context.shared_.end());
+        if (-- it->second == 1) {
+            context.shared_.erase(it);
+            chunk->shared_map[index] &= ~mask;
+        }
+        return false;
+    }
+    chunk->mark_map[index] &= ~mask;
+    return true;
+}
+
 int HeapAllocator::Deallocate(HeapContext& context, HeapObject *obj)
 {
-    if (context.deallocated_.count(obj)) {
+    intptr_t addr = reinterpret_cast<intptr_t>(obj);
+    intptr_t chunk_addr = addr & ~(HEAP_ALIGNMENT - 1);
+    HeapAllocator *chunk = reinterpret_cast<HeapAllocator*>(chunk_addr);
+    int slot = (int) (addr - chunk_addr) / HEAP_SLOT_SIZE;
+    int index = slot / 64;
+    int pos = slot % 64;
+
+    if ((chunk->alloc_map[index] & ((uint64_t)1 << pos)) == 0) {
+        // SmartReset may cause objects to get deallocated before the sweep gets to them.
         // This has already been deallocated in this GC session, don't do it again
         return 0;
     }
     
-    intptr_t addr = reinterpret_cast<intptr_t>(obj);
-    intptr_t chunk_addr = addr & ~(HEAP_ALIGNMENT - 1);
-    HeapAllocator *chunk = reinterpret_cast<HeapAllocator*>(chunk_addr);
     IsolateImpl* iso = obj->GetIsolate();
     internal::Heap *heap = reinterpret_cast<internal::Isolate*>(iso)->heap();
     HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
@@ -160,23 +318,26 @@ int HeapAllocator::Deallocate(HeapContext& context, HeapObject *obj)
         }
     }
     
-    int freed = ((BaseMap*)FromHeapPointer(obj->m_map))->dtor(context, obj);
-    int slot = (int) (addr - chunk_addr) / HEAP_SLOT_SIZE;
-    int index = slot / 64;
-    int pos = slot % 64;
-    int size = 0;
-    BaseMap* map = (BaseMap*) FromHeapPointer(obj->m_map);
-    if (map == iso->m_fixed_array_map) {
-        FixedArray *fa = static_cast<FixedArray*>(obj);
-        size = sizeof(FixedArray) + fa->m_size * sizeof(internal::Object*);
-    } else {
-        size = map->size;
-    }
-    assert((void*)map != (void*)obj);
+    assert((void*)FromHeapPointer(obj->m_map) != (void*)obj);
+    BaseMap *map = (BaseMap*)FromHeapPointer(obj->m_map);
+    int freed = map->dtor(context, obj);
+    int size = ObjectSize(iso, obj);
     uint32_t actual_used_slots = ((size - 1) / HEAP_SLOT_SIZE) + 1;
+    // Anything the destructor released has already been taken off the books
+    const size_t own = actual_used_slots * HEAP_SLOT_SIZE;
 
-    freed += actual_used_slots * HEAP_SLOT_SIZE;
+    freed += own;
+    map->count --;
+    map->bytes -= own;
+    heapimpl->m_allocated -= own;
+    if (chunk->info.m_large_size) {
+        // The sweep unmaps it
+        chunk->alloc_map[index] = 0;
+        return freed;
+    }
     memset(obj,0xee,actual_used_slots*HEAP_SLOT_SIZE);
+    chunk->info.m_free_slots += actual_used_slots;
+    chunk->info.m_exhausted = 0;
 
     while(actual_used_slots >= 64) {
         assert(pos == 0);
@@ -187,19 +348,15 @@ int HeapAllocator::Deallocate(HeapContext& context, HeapObject *obj)
     assert((chunk->alloc_map[index] & mask) == mask);
     chunk->alloc_map[index] &= ~mask;
 
-    // SmartReset may cause objects to get deallocated before the collector gets to them.
-    // Keep track of deallocated objects to ensure we don't deallocate them again.
-    // Ideally, we would just remove this object from the context.allocated_ set, but
-    // C++ iterators make this tough.  So we will keep a separate list.
-    context.deallocated_.insert(obj);
-    
-    heapimpl->m_allocated -= freed;
-    
     return freed;
 }
 
-bool HeapAllocator::CollectGarbage(v8::internal::IsolateImpl *iso)
+bool HeapAllocator::CollectGarbage(v8::internal::IsolateImpl *iso, bool incremental)
 {
+    TRACE_SPAN("V82JSC CollectGarbage");
+    // Finish any sweep still in progress from the last collection before marking again
+    Sweep(iso, false);
+
     HandleScope scope(reinterpret_cast<Isolate*>(iso));
     // References to heap objects are stored in the following places:
     // 1. The current HandleScope
@@ -207,115 +364,464 @@ bool HeapAllocator::CollectGarbage(v8::internal::IsolateImpl *iso)
     // 3. Elements in a FixedArray
     //
     // The first pointer in each HeapObject is the map, which is also a heap object pointer.  However,
-    // maps are forever, so they will be skipped by the garbage collector.  We need to keep track of this
-    // if we happen to decide to implement HeapObject relocation.
+    // maps are forever, so they will be skipped by the garbage collector, and are never relocated
+    // by Evacuate().
     //
     // There shouldn't be any other non-transient references.
     iso->m_pending_garbage_collection = false;
+    iso->m_gc_allocated_since = 0;
     
-    HeapContext context;
+    internal::Heap *heap = reinterpret_cast<internal::Isolate*>(iso)->heap();
+    HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
+    HeapAllocator *chunk;
+
+    // Reference counts live in the mark bitmaps of each chunk, so start from a clean slate
+    for (chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top); chunk;
+         chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
+        memset(chunk->mark_map, 0, sizeof(chunk->mark_map));
+        memset(chunk->shared_map, 0, sizeof(chunk->shared_map));
+    }
+    for (chunk = iso->m_large_objects; chunk; chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
+        chunk->mark_map[HEAP_RESERVED_SLOTS / 64] = 0;
+        chunk->shared_map[HEAP_RESERVED_SLOTS / 64] = 0;
+    }
+
+    HeapContext *context = new HeapContext();
     
-    // 1. Walk through local handles and add to our canonical list
-    iso->GetActiveLocalHandles(context);
+    // 1. Walk through local handles and mark them
+    iso->GetActiveLocalHandles(*context);
     
     // 2. Walk through global handles (separating out weak references)
-    iso->getGlobalHandles(context);
+    iso->getGlobalHandles(*context);
     
-    // 3. Walk through the heap and capture all non-map references.  If we happen along a FixedArray, also
-    //    add its elements to the canonical handle list
+    // 3. Walk through the heap and mark the elements of every FixedArray.  Dead arrays release
+    //    their elements in their destructors, so all of them must be counted, not just live ones.
+    for (chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top); chunk;
+         chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
+        int slot = HEAP_RESERVED_SLOTS;
+        while (slot < HEAP_SLOTS) {
+            int index = slot / 64;
+            int pos = slot % 64;
+            if ((chunk->alloc_map[index] >> pos) == 0) {
+                slot = (index + 1) * 64;
+                continue;
+            }
+            if (chunk->alloc_map[index] & ((uint64_t)1 << pos)) {
+                HeapObject *obj = reinterpret_cast<HeapObject*>(reinterpret_cast<intptr_t>(chunk) +
+                                                                slot * HEAP_SLOT_SIZE);
+                if ((BaseMap*) FromHeapPointer(obj->m_map) == iso->m_fixed_array_map) {
+                    FixedArray *fa = static_cast<FixedArray*>(obj);
+                    for (int j=0; j<fa->m_size; j++) {
+                        if (fa->m_elements[j]->IsHeapObject()) {
+                            Retain(*context, fa->m_elements[j]);
+                        }
+                    }
+                }
+                slot += ((ObjectSize(iso, obj) - 1) / HEAP_SLOT_SIZE) + 1;
+            } else {
+                slot++;
+            }
+        }
+    }
+    for (chunk = iso->m_large_objects; chunk; chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
+        HeapObject *obj = LargeObject(chunk);
+        if (chunk->alloc_map[HEAP_RESERVED_SLOTS / 64] &&
+            (BaseMap*) FromHeapPointer(obj->m_map) == iso->m_fixed_array_map) {
+            FixedArray *fa = static_cast<FixedArray*>(obj);
+            for (int j=0; j<fa->m_size; j++) {
+                if (fa->m_elements[j]->IsHeapObject()) {
+                    Retain(*context, fa->m_elements[j]);
+                }
+            }
+        }
+    }
+
+    // 4. Sweep.  An incremental sweep lets the mutator run between slices, and the only way it can
+    //    reach an unmarked object is through a weak handle.  So finish off unmarked weak objects now
+    //    and pin marked ones until the next collection so that a destructor cascade can't free them
+    //    out from under a handle recovered in the meantime.
+    iso->m_collecting_garbage = true;
+    if (incremental && s_sweep_budget_us) {
+        for (auto it = context->weak_.begin(); it != context->weak_.end(); ++it) {
+            if (IsMarked(it->first)) Retain(*context, it->first);
+        }
+        for (auto it = context->weak_.begin(); it != context->weak_.end(); ++it) {
+            HeapObject *obj = FromHeapPointer(it->first);
+            if (obj->m_map != it->first && !IsMarked(it->first)) {
+                Deallocate(*context, obj);
+            }
+        }
+    }
+    iso->m_sweep_context = context;
+    iso->m_sweep_chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top);
+    iso->m_sweep_slot = HEAP_RESERVED_SLOTS;
+
+    return Sweep(iso, incremental);
+}
+
+bool HeapAllocator::IsMarked(internal::Object *obj)
+{
+    intptr_t addr = reinterpret_cast<intptr_t>(obj) - internal::kHeapObjectTag;
+    HeapAllocator *chunk = reinterpret_cast<HeapAllocator*>(addr & ~(HEAP_ALIGNMENT - 1));
+    int slot = (int) (addr - reinterpret_cast<intptr_t>(chunk)) / HEAP_SLOT_SIZE;
+    return chunk->mark_map[slot / 64] & ((uint64_t)1 << (slot % 64));
+}
+
+void HeapAllocator::VisitJSValues(IsolateImpl *iso, RootVisitor visit, void *data)
+{
     internal::Heap *heap = reinterpret_cast<internal::Isolate*>(iso)->heap();
     HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
-    HeapAllocator *chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top);
 
-    while (chunk) {
+    // Dead objects not yet swept are visited too; their JS values are let go when they are
+    for (auto chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top); chunk;
+         chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
         int slot = HEAP_RESERVED_SLOTS;
         while (slot < HEAP_SLOTS) {
             int index = slot / 64;
             int pos = slot % 64;
-            uint64_t mask = (uint64_t)1 << pos;
-            if (chunk->alloc_map[index] & mask) {
-                intptr_t addr = reinterpret_cast<intptr_t>(chunk) + (index*64 + pos)*HEAP_SLOT_SIZE;
-                HeapObject *obj = reinterpret_cast<HeapObject*>(addr);
-                // Ignore maps
-                int size = 0;
+            if ((chunk->alloc_map[index] >> pos) == 0) {
+                slot = (index + 1) * 64;
+                continue;
+            }
+            if (chunk->alloc_map[index] & ((uint64_t)1 << pos)) {
+                HeapObject *obj = reinterpret_cast<HeapObject*>(reinterpret_cast<intptr_t>(chunk) +
+                                                                slot * HEAP_SLOT_SIZE);
                 if (obj->m_map != ToHeapPointer(obj)) {
-                    BaseMap* map = (BaseMap*) FromHeapPointer(obj->m_map);
-                    if (map == iso->m_fixed_array_map) {
-                        FixedArray *fa = static_cast<FixedArray*>(obj);
-                        size = sizeof(FixedArray) + fa->m_size * sizeof(internal::Object*);
-                        for (int j=0; j<fa->m_size; j++) {
-                            if (fa->m_elements[j]->IsHeapObject()) {
-                                int count = context.handles_.count(fa->m_elements[j]) ?
-                                    context.handles_[fa->m_elements[j]] + 1 : 1;
-                                context.handles_[fa->m_elements[j]] = count;
-                            }
-                        }
-                    } else {
-                        size = map->size;
-                    }
-                    context.allocated_.insert(obj);
-                } else {
-                    size = sizeof(BaseMap);
+                    reinterpret_cast<BaseMap*>(FromHeapPointer(obj->m_map))->visit(obj, visit, data);
                 }
-                uint32_t actual_used_slots = ((size - 1) / HEAP_SLOT_SIZE) + 1;
-                slot += actual_used_slots;
+                slot += ((ObjectSize(iso, obj) - 1) / HEAP_SLOT_SIZE) + 1;
             } else {
                 slot++;
             }
         }
-        chunk = static_cast<HeapAllocator*>(chunk->next_chunk());
     }
-    // Now we have a list of all the allocated memory locations ('context.allocated_') and a map
-    // of those locations that are actually in use ('context.handles_').
-    // We will walk through the 'context.allocated_' list, and if it is not referenced in 'context.handles_',
-    // we will call its destructor and deallocate its memory.
-    // The destructors may then trigger further deallocations.  We keep track of those deallocations
-    // in 'context.deallocated_' to ensure they aren't deallocated twice.
-    int freed = 0;
-    int freed_chunks = 0;
-    int used_chunks = 0;
-
-    for (auto it = context.allocated_.begin(); it != context.allocated_.end(); ++it) {
-        if (context.handles_.count(ToHeapPointer(*it)) == 0) {
-            freed += Deallocate(context, *it);
+    for (auto chunk = iso->m_large_objects; chunk; chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
+        if (chunk->alloc_map[HEAP_RESERVED_SLOTS / 64]) {
+            HeapObject *obj = LargeObject(chunk);
+            reinterpret_cast<BaseMap*>(FromHeapPointer(obj->m_map))->visit(obj, visit, data);
         }
     }
-    
-    // Finally, deallocate any chunks that are completely free and reset the indicies
-    if (freed > 0) {
-        chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top);
-        assert(chunk);
-        while (chunk) {
-            bool used = false;
-            for (int i=HEAP_RESERVED_SLOTS/64; i< HEAP_SLOTS/64; i++) {
-                if (chunk->alloc_map[i] != 0) {
-                    used = true;
-                    break;
+}
+
+void HeapAllocator::SetSweepBudget(unsigned microseconds)
+{
+    s_sweep_budget_us = microseconds;
+}
+
+void HeapAllocator::SetGrowthFactor(double factor)
+{
+    s_growth_factor = std::max(factor, HEAP_MIN_GROWTH_FACTOR);
+}
+
+// As V8 does it: the next collection comes once the heap is some factor of its live size,
+// within the isolate's ResourceConstraints.  Past those, it is never let grow less than
+// HEAP_MIN_GROWTH, or it would collect on every allocation.
+void HeapAllocator::UpdateAllocationLimit(IsolateImpl *iso)
+{
+    internal::Heap *heap = reinterpret_cast<internal::Isolate*>(iso)->heap();
+    HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
+    const size_t live = heapimpl->m_allocated;
+    const double factor = iso->m_should_optimize_for_memory_usage ?
+        HEAP_MIN_GROWTH_FACTOR : s_growth_factor.load();
+
+    size_t limit = std::max(static_cast<size_t>(live * factor), live + HEAP_MIN_GROWTH);
+    limit = std::max(limit, static_cast<size_t>(HEAP_INITIAL_LIMIT));
+    const size_t max = heap->MaxOldGenerationSize();
+    if (max) {
+        limit = std::min(limit, std::max(max, live + HEAP_MIN_GROWTH));
+    }
+    iso->m_gc_live_bytes = live;
+    iso->m_gc_limit = limit;
+}
+
+bool HeapAllocator::Sweep(IsolateImpl *iso, bool incremental)
+{
+    return SweepFor(iso, incremental ? s_sweep_budget_us.load() : 0);
+}
+
+bool HeapAllocator::SweepFor(IsolateImpl *iso, unsigned budget)
+{
+    if (!iso->m_sweep_context) return true;
+    TRACE_SPAN("V82JSC sweep");
+
+    HandleScope scope(reinterpret_cast<Isolate*>(iso));
+    internal::Heap *heap = reinterpret_cast<internal::Isolate*>(iso)->heap();
+    HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
+    HeapContext& context = *iso->m_sweep_context;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget);
+    HeapAllocator *chunk = iso->m_sweep_chunk;
+    int slot = iso->m_sweep_slot;
+    int work = 0;
+
+    // Walk each chunk linearly, and deallocate anything that is neither a map nor marked.
+    // The destructors may then trigger further deallocations, which clear the allocation bits
+    // ahead of the sweep.  Anything allocated while sweeping is marked in Alloc().
+    while (chunk) {
+        while (slot < HEAP_SLOTS) {
+            if (budget && ++work % 32 == 0 && std::chrono::steady_clock::now() > deadline) {
+                iso->m_sweep_chunk = chunk;
+                iso->m_sweep_slot = slot;
+                RunSecondPassCallbacks(iso, context);
+                return false;
+            }
+            int index = slot / 64;
+            int pos = slot % 64;
+            if ((chunk->alloc_map[index] >> pos) == 0) {
+                slot = (index + 1) * 64;
+                continue;
+            }
+            uint64_t mask = (uint64_t)1 << pos;
+            if (chunk->alloc_map[index] & mask) {
+                HeapObject *obj = reinterpret_cast<HeapObject*>(reinterpret_cast<intptr_t>(chunk) +
+                                                                slot * HEAP_SLOT_SIZE);
+                int size = ObjectSize(iso, obj);
+                if (obj->m_map != ToHeapPointer(obj) && (chunk->mark_map[index] & mask) == 0) {
+                    Deallocate(context, obj);
                 }
+                slot += ((size - 1) / HEAP_SLOT_SIZE) + 1;
+            } else {
+                slot++;
             }
-            HeapAllocator *next = static_cast<HeapAllocator*>(chunk->next_chunk());
-            if (used) {
-                // Reset all indicies
-                for (int i=0; i<HEAP_SMALL_SPACE_LOG; i++)
-                    chunk->info.m_small_indicies[i] = HEAP_BLOCKS-1;
-                chunk->info.m_large_index = 0;
-                used_chunks ++;
+        }
+
+        // Release the chunk if it is now completely free, otherwise reset its indicies
+        bool used = false;
+        for (int i=HEAP_RESERVED_SLOTS/64; i< HEAP_SLOTS/64; i++) {
+            if (chunk->alloc_map[i] != 0) {
+                used = true;
+                break;
+            }
+        }
+        HeapAllocator *next = static_cast<HeapAllocator*>(chunk->next_chunk());
+        if (used) {
+            for (int i=0; i<HEAP_SMALL_SPACE_LOG; i++)
+                chunk->info.m_small_indicies[i] = HEAP_BLOCKS-1;
+            chunk->info.m_large_index = 0;
+            ReleaseFreePages(chunk);
+        } else {
+            FreeChunk(iso, chunk);
+        }
+        chunk = next;
+        slot = HEAP_RESERVED_SLOTS;
+    }
+
+    // Then the large objects, in one go.  One freed by another's destructor after its turn is
+    // unmapped by the next sweep.
+    for (chunk = iso->m_large_objects; chunk; ) {
+        HeapAllocator *next = static_cast<HeapAllocator*>(chunk->next_chunk());
+        const int index = HEAP_RESERVED_SLOTS / 64;
+        if (chunk->alloc_map[index] && (chunk->mark_map[index] & 1) == 0) {
+            Deallocate(context, LargeObject(chunk));
+        }
+        if (!chunk->alloc_map[index]) {
+            FreeChunk(iso, chunk);
+        }
+        chunk = next;
+    }
+    iso->m_collecting_garbage = false;
+
+    RunSecondPassCallbacks(iso, context);
+    assert(context.callbacks_.empty());
+
+    Evacuate(iso, context);
+
+    iso->m_sweep_context = nullptr;
+    delete &context;
+    UpdateAllocationLimit(iso);
+
+    return true;
+}
+
+void HeapAllocator::FreeChunk(IsolateImpl *iso, HeapAllocator *chunk)
+{
+    internal::Heap *heap = reinterpret_cast<internal::Isolate*>(iso)->heap();
+    HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
+    if (chunk->prev_chunk()) {
+        chunk->prev_chunk()->set_next_chunk(chunk->next_chunk());
+    } else if (chunk->info.m_large_size) {
+        iso->m_large_objects = static_cast<HeapAllocator*>(chunk->next_chunk());
+    } else {
+        heapimpl->m_heap_top = chunk->next_chunk();
+    }
+    if (chunk->next_chunk()) {
+        chunk->next_chunk()->set_prev_chunk(chunk->prev_chunk());
+    }
+    if (chunk->info.m_large_size) {
+        munmap(chunk, chunk->info.m_large_size);
+        return;
+    }
+    munmap(chunk, HEAP_ALIGNMENT);
+    memset(iso->m_alloc_chunk, 0, sizeof(iso->m_alloc_chunk));
+}
+
+// Hands back each page of a chunk whose blocks are all free.  The pages stay mapped, and the
+// system either drops them or, if it hasn't needed to, leaves them be.  On Darwin they stop
+// counting against the footprint only if marked reusable, and must be marked back first.
+void HeapAllocator::ReleaseFreePages(HeapAllocator *chunk)
+{
+    const int blocks_per_page = (int) (PageSize() / HEAP_BLOCK_SIZE);
+    const int pages = HEAP_ALIGNMENT / (int) PageSize();
+    int run = -1;
+    for (int page = 0; page <= pages; page++) {
+        bool empty = page < pages && (chunk->info.m_released[page / 64] & ((uint64_t)1 << (page % 64))) == 0;
+        for (int index = page * blocks_per_page; empty && index < (page + 1) * blocks_per_page; index++) {
+            empty = chunk->alloc_map[index] == 0;
+        }
+        if (empty && run < 0) {
+            run = page;
+        } else if (!empty && run >= 0) {
+            void *start = reinterpret_cast<void*>(reinterpret_cast<intptr_t>(chunk) + run * PageSize());
+#ifdef MADV_FREE_REUSABLE
+            madvise(start, (page - run) * PageSize(), MADV_FREE_REUSABLE);
+#else
+            madvise(start, (page - run) * PageSize(), MADV_FREE);
+#endif
+            for (int i = run; i < page; i++) {
+                chunk->info.m_released[i / 64] |= (uint64_t)1 << (i % 64);
+            }
+            run = -1;
+        }
+    }
+}
+
+void HeapAllocator::ReclaimPages(HeapAllocator *chunk, void *alloc, uint32_t size)
+{
+    intptr_t offset = reinterpret_cast<intptr_t>(alloc) - reinterpret_cast<intptr_t>(chunk);
+    int last = (int) ((offset + size - 1) / PageSize());
+    for (int page = (int) (offset / PageSize()); page <= last; page++) {
+        uint64_t mask = (uint64_t)1 << (page % 64);
+        if (chunk->info.m_released[page / 64] & mask) {
+            chunk->info.m_released[page / 64] &= ~mask;
+#ifdef MADV_FREE_REUSE
+            madvise(reinterpret_cast<void*>(reinterpret_cast<intptr_t>(chunk) + page * PageSize()),
+                    PageSize(), MADV_FREE_REUSE);
+#endif
+        }
+    }
+}
+
+// Only handles and FixedArray elements refer to these, so they can be moved by rewriting those
+static bool IsMovable(IsolateImpl *iso, BaseMap *map)
+{
+    return map == iso->m_fixed_array_map || map == iso->m_number_map ||
+        map == iso->m_string_map || map == iso->m_one_byte_string_map ||
+        map == iso->m_internalized_string_map || map == iso->m_external_string_map ||
+        map == iso->m_external_one_byte_string_map;
+}
+
+// A chunk stays for as long as anything in it is alive, so a few long-lived objects can hold
+// on to a heap that has long since shrunk.  Once a sweep is done, chunks nearly empty of
+// anything but movable objects have them moved out into the rest of the heap, and are freed.
+// An object with a weak handle stays put; its callback bookkeeping goes by address.
+void HeapAllocator::Evacuate(IsolateImpl *iso, HeapContext& context)
+{
+    TRACE_SPAN("V82JSC evacuate");
+    internal::Heap *heap = reinterpret_cast<internal::Isolate*>(iso)->heap();
+    HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
+
+    // Calls |visit| with each object in |chunk| and its size, for as long as it returns true
+    auto each = [iso](HeapAllocator *chunk, auto visit) -> bool {
+        int slot = HEAP_RESERVED_SLOTS;
+        while (slot < HEAP_SLOTS) {
+            int index = slot / 64;
+            int pos = slot % 64;
+            if ((chunk->alloc_map[index] >> pos) == 0) {
+                slot = (index + 1) * 64;
+                continue;
+            }
+            if (chunk->alloc_map[index] & ((uint64_t)1 << pos)) {
+                HeapObject *obj = reinterpret_cast<HeapObject*>(reinterpret_cast<intptr_t>(chunk) +
+                                                                slot * HEAP_SLOT_SIZE);
+                int size = ObjectSize(iso, obj);
+                if (!visit(obj, size)) return false;
+                slot += ((size - 1) / HEAP_SLOT_SIZE) + 1;
             } else {
-                if (chunk->prev_chunk()) {
-                    chunk->prev_chunk()->set_next_chunk(chunk->next_chunk());
-                } else {
-                    heapimpl->m_heap_top = chunk->next_chunk();
-                }
-                if (chunk->next_chunk()) {
-                    chunk->next_chunk()->set_prev_chunk(chunk->prev_chunk());
+                slot++;
+            }
+        }
+        return true;
+    };
+
+    std::vector<HeapAllocator*> sparse;
+    int needed = 0;
+    int room = 0;
+    for (auto chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top); chunk;
+         chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
+        int used = HEAP_SLOTS - HEAP_RESERVED_SLOTS - chunk->info.m_free_slots;
+        int slots = 0;
+        bool movable = used < HEAP_EVACUATE_SLOTS && each(chunk, [&](HeapObject *obj, int size) {
+            BaseMap *map = (BaseMap*) FromHeapPointer(obj->m_map);
+            slots += ((size - 1) / HEAP_SLOT_SIZE) + 1;
+            return (void*)map != (void*)obj && IsMovable(iso, map) &&
+                context.weak_.count(ToHeapPointer(obj)) == 0;
+        });
+        if (movable) {
+            sparse.push_back(chunk);
+            needed += slots;
+        } else {
+            room += chunk->info.m_free_slots;
+        }
+    }
+    // Not all free slots suit every size, so only if there is plenty of room for them elsewhere
+    if (sparse.empty() || needed > room / 2) return;
+
+    // Put the sparse chunks out of Alloc()'s reach while they are emptied
+    for (auto chunk : sparse) {
+        chunk->info.m_free_slots = 0;
+    }
+    Forwarding forwarding;
+    for (auto chunk : sparse) {
+        each(chunk, [&](HeapObject *obj, int size) {
+            BaseMap *map = (BaseMap*) FromHeapPointer(obj->m_map);
+            HeapObject *copy = Alloc(iso, map, size);
+            memcpy(copy, obj, size);
+            // Alloc() counted it as a new object
+            const size_t own = (((size - 1) / HEAP_SLOT_SIZE) + 1) * HEAP_SLOT_SIZE;
+            map->count --;
+            map->bytes -= own;
+            map->allocations --;
+            map->allocated_bytes -= own;
+            heapimpl->m_allocated -= own;
+            forwarding[ToHeapPointer(obj)] = ToHeapPointer(copy);
+            return true;
+        });
+    }
+
+    // Then rewrite every reference: locals, globals and FixedArray elements
+    iso->ForwardLocalHandles(forwarding);
+    iso->forwardGlobalHandles(forwarding);
+    for (auto chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top); chunk;
+         chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
+        each(chunk, [&](HeapObject *obj, int size) {
+            if ((BaseMap*) FromHeapPointer(obj->m_map) == iso->m_fixed_array_map) {
+                FixedArray *fa = static_cast<FixedArray*>(obj);
+                for (int j=0; j<fa->m_size; j++) {
+                    auto moved = forwarding.find(fa->m_elements[j]);
+                    if (moved != forwarding.end()) fa->m_elements[j] = moved->second;
                 }
-                free(chunk);
-                freed_chunks ++;
             }
-            chunk = next;
+            return true;
+        });
+    }
+    for (auto chunk = iso->m_large_objects; chunk; chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
+        HeapObject *obj = LargeObject(chunk);
+        if (chunk->alloc_map[HEAP_RESERVED_SLOTS / 64] &&
+            (BaseMap*) FromHeapPointer(obj->m_map) == iso->m_fixed_array_map) {
+            FixedArray *fa = static_cast<FixedArray*>(obj);
+            for (int j=0; j<fa->m_size; j++) {
+                auto moved = forwarding.find(fa->m_elements[j]);
+                if (moved != forwarding.end()) fa->m_elements[j] = moved->second;
+            }
         }
     }
-    
+
+    for (auto chunk : sparse) {
+        FreeChunk(iso, chunk);
+    }
+}
+
+void HeapAllocator::RunSecondPassCallbacks(IsolateImpl *iso, HeapContext& context)
+{
     // Make any second pass phantom callbacks for primtive values
     for (auto i=context.callbacks_.begin(); i!= context.callbacks_.end(); ) {
         iso->weakHeapObjectFinalized(reinterpret_cast<v8::Isolate*>(iso), *i);
@@ -330,29 +836,46 @@ bool HeapAllocator::CollectGarbage(v8::internal::IsolateImpl *iso)
             ++i;
         }
     }
+}
 
-    assert(context.callbacks_.empty());
-
-    /*
-    if (freed > 0) {
-        printf ("V82JSC Garbage Collector: Freed %d bytes; Deallocated %d / %d kB chunks; %d kB in use\n",
-                freed, freed_chunks * 512, (freed_chunks+used_chunks) * 512, used_chunks * 512);
+void HeapAllocator::GetStats(IsolateImpl *isolate, Stats *stats)
+{
+    internal::Heap *heap = reinterpret_cast<internal::Isolate*>(isolate)->heap();
+    HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
+    memset(stats, 0, sizeof(Stats));
+    for (auto chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top); chunk;
+         chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
+        stats->chunks ++;
+        stats->free_slots += chunk->info.m_free_slots;
+        for (int index = HEAP_RESERVED_SLOTS / 64; index < HEAP_BLOCKS; index++) {
+            if (chunk->alloc_map[index] == 0) stats->free_blocks ++;
+        }
+    }
+    for (auto chunk = isolate->m_large_objects; chunk; chunk = static_cast<HeapAllocator*>(chunk->next_chunk())) {
+        stats->large_objects ++;
+        stats->large_bytes += chunk->info.m_large_size;
     }
-    */
-    
-    return true;
 }
 
 void HeapAllocator::TearDown(IsolateImpl *isolate)
 {
+    delete isolate->m_sweep_context;
+    isolate->m_sweep_context = nullptr;
     internal::Heap *heap = reinterpret_cast<internal::Isolate*>(isolate)->heap();
     HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
     HeapAllocator *chunk = static_cast<HeapAllocator*>(heapimpl->m_heap_top);
     while (chunk) {
         auto done = chunk;
         chunk = static_cast<HeapAllocator*>(chunk->next_chunk());
-        free(done);
+        munmap(done, HEAP_ALIGNMENT);
+    }
+    chunk = isolate->m_large_objects;
+    while (chunk) {
+        auto done = chunk;
+        chunk = static_cast<HeapAllocator*>(chunk->next_chunk());
+        munmap(done, done->info.m_large_size);
     }
+    isolate->m_large_objects = nullptr;
 }
 
 internal::MemoryChunk* internal::MemoryChunk::Initialize(internal::Heap* heap, internal::Address base, size_t size,
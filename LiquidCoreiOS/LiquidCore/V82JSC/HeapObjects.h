@@ -27,6 +27,7 @@
 #include "src/vm-state.h"
 #include "src/heap/heap.h"
 #include <map>
+#include <unordered_map>
 #include <string>
 
 /* V82JSC Heap Objects are designed to mirror V8 heap objects as much as possible.  Some rules:
@@ -45,12 +46,19 @@
 #define HEAP_SLOT_SIZE_LOG (5)
 #define HEAP_SLOT_SIZE (1<<HEAP_SLOT_SIZE_LOG) // 0x20 bytes
 #define HEAP_ALLOC_MAP_SIZE (HEAP_ALIGNMENT / (HEAP_SLOT_SIZE * 8)) // 0x800 bytes
-#define HEAP_RESERVED_SLOTS ((HEAP_ALLOC_MAP_SIZE * 2) / HEAP_SLOT_SIZE) // 0x40 (64) slots
+#define HEAP_RESERVED_SLOTS ((HEAP_ALLOC_MAP_SIZE * 4) / HEAP_SLOT_SIZE) // 0x100 (256) slots
 #define HEAP_SLOTS (HEAP_ALIGNMENT / HEAP_SLOT_SIZE) // 0x4000 (16384)
 #define HEAP_SMALL_SPACE_LOG (8) // Up to 64 slots (2K bytes)
 #define HEAP_SLOTS_PER_BLOCK (64) // bits in a uint64_t
 #define HEAP_BLOCK_SIZE (HEAP_SLOTS_PER_BLOCK * HEAP_SLOT_SIZE) // (2k bytes)
 #define HEAP_BLOCKS (HEAP_ALIGNMENT / HEAP_BLOCK_SIZE) // 256
+#define HEAP_EVACUATE_SLOTS (HEAP_SLOTS / 8) // Chunks using fewer slots than this are emptied
+#define HEAP_LARGE_OBJECT_SIZE (HEAP_ALIGNMENT / 8) // Objects larger than this get a chunk to themselves
+// Heap controller: where the first collection is scheduled, the least the heap may grow between
+// collections, and the growth factor used under memory pressure
+#define HEAP_INITIAL_LIMIT (HEAP_ALIGNMENT * 8)
+#define HEAP_MIN_GROWTH (HEAP_ALIGNMENT * 2)
+#define HEAP_MIN_GROWTH_FACTOR 1.1
 
 namespace v8 { namespace internal { class IsolateImpl; class SecondPassCallback; } }
 
@@ -62,18 +70,23 @@ struct HeapObject;
 struct BaseMap;
 struct FixedArray;
 
-typedef std::map<v8::internal::Object *, int> CanonicalHandles;
-typedef std::map<v8::internal::Object *, std::vector<v8::internal::Object**>> WeakHandles;
+// Reference counts are kept in each chunk's mark bitmaps.  Only objects referenced more than
+// once spill their count into this table.
+typedef std::unordered_map<v8::internal::Object *, int> SharedHandles;
+typedef std::unordered_map<v8::internal::Object *, std::vector<v8::internal::Object**>> WeakHandles;
 struct HeapContext {
-    CanonicalHandles handles_;
+    SharedHandles shared_;
     WeakHandles weak_;
     std::vector<v8::internal::SecondPassCallback> callbacks_;
-    std::set<HeapObject*> allocated_;
-    std::set<HeapObject*> deallocated_;
 };
+// Where each object moved by an evacuation went
+typedef std::unordered_map<v8::internal::Object *, v8::internal::Object *> Forwarding;
 
 typedef void (*Constructor)(HeapObject *);
 typedef int (*Destructor)(HeapContext&, HeapObject *);
+// Called with each JS value a heap object holds on to
+typedef void (*RootVisitor)(JSValueRef, void *data);
+typedef void (*Visitor)(HeapObject *, RootVisitor, void *data);
 
 typedef uint8_t (*Transform)(uint64_t);
 Transform transform (uint32_t size);
@@ -92,14 +105,65 @@ class HeapAllocator : public v8::internal::MemoryChunk
     struct _info {
         int m_small_indicies[HEAP_SMALL_SPACE_LOG];
         int m_large_index;
+        // Unallocated slots remaining in this chunk
+        int m_free_slots;
+        // Size classes which found no room here since the last deallocation
+        uint32_t m_exhausted;
+        // Pages handed back to the system, which need reclaiming before they are used again
+        uint64_t m_released[HEAP_ALIGNMENT / 4096 / 64];
+        // For a large object's chunk, the length mapped; 0 for any other
+        size_t m_large_size;
         // Anything else we need to store, put here
     } info;
     uint8_t reserved_[HEAP_ALLOC_MAP_SIZE - sizeof(struct _info) - sizeof(v8::internal::MemoryChunk)];
     uint64_t alloc_map[HEAP_ALLOC_MAP_SIZE / 8];
+    // Set for each object referenced at least once during a collection
+    uint64_t mark_map[HEAP_ALLOC_MAP_SIZE / 8];
+    // Set for each object whose reference count lives in HeapContext::shared_
+    uint64_t shared_map[HEAP_ALLOC_MAP_SIZE / 8];
 public:
     static HeapObject* Alloc(IsolateImpl *isolate, const BaseMap* map, uint32_t size=0);
-    static bool CollectGarbage(IsolateImpl *isolate);
+    static bool CollectGarbage(IsolateImpl *isolate, bool incremental=false);
+    static bool Sweep(IsolateImpl *isolate, bool incremental);
+    // Sweeps for up to |budget_us| (0 is until done).  Returns true once the sweep is done.
+    static bool SweepFor(IsolateImpl *isolate, unsigned budget_us);
+    static void SetSweepBudget(unsigned microseconds);
+    // How far the heap may grow past what survived the last collection before the next one is
+    // scheduled.  At least HEAP_MIN_GROWTH_FACTOR.
+    static void SetGrowthFactor(double factor);
+    // Sets the heap size at which Alloc() schedules a collection, from what survived the last
+    static void UpdateAllocationLimit(IsolateImpl *isolate);
     static int Deallocate(HeapContext&, HeapObject*);
+    static void Retain(HeapContext&, v8::internal::Object *obj);
+    static bool Release(HeapContext&, v8::internal::Object *obj);
+    static bool IsMarked(v8::internal::Object *obj);
+    // Visits the JS values held by every object on the heap, maps excepted
+    static void VisitJSValues(IsolateImpl *isolate, RootVisitor visit, void *data);
+
+    // Occupancy of the chunk list.  Free slots in wholly free blocks can take objects of any
+    // size; the rest can only take small ones, so their share of the free slots is a measure
+    // of fragmentation.  Large objects are counted apart.
+    struct Stats {
+        size_t chunks;
+        size_t free_slots;
+        size_t free_blocks;
+        size_t large_objects;
+        size_t large_bytes;
+    };
+    static void GetStats(IsolateImpl *isolate, Stats *stats);
+private:
+    static void RunSecondPassCallbacks(IsolateImpl *isolate, HeapContext&);
+    static void Evacuate(IsolateImpl *isolate, HeapContext&);
+    static void FreeChunk(IsolateImpl *isolate, HeapAllocator *chunk);
+    static HeapAllocator* NewLargeChunk(IsolateImpl *isolate, uint32_t size);
+    static inline HeapObject* LargeObject(HeapAllocator *chunk)
+    {
+        return reinterpret_cast<HeapObject*>(reinterpret_cast<intptr_t>(chunk) +
+                                             HEAP_RESERVED_SLOTS * HEAP_SLOT_SIZE);
+    }
+    static void ReleaseFreePages(HeapAllocator *chunk);
+    static void ReclaimPages(HeapAllocator *chunk, void *alloc, uint32_t size);
+public:
     static void TearDown(IsolateImpl *isolate);
 };
 
@@ -124,22 +188,19 @@ struct HeapObject {
     
     JSContextGroupRef GetContextGroup();
     
+    static void VisitJSValues(HeapObject *obj, RootVisitor visit, void *data) {}
+    
     static int DecrementCount(HeapContext& context, v8::internal::Object *obj)
     {
         assert(obj->IsHeapObject());
         HeapObject *o = reinterpret_cast<HeapObject*>(reinterpret_cast<intptr_t>(obj) - v8::internal::kHeapObjectTag);
-        int count = context.handles_[obj];
-        assert(count);
-        if (-- count == 0) {
-            context.handles_.erase(obj);
+        if (HeapAllocator::Release(context, obj)) {
             if (o->m_map != obj) {
                 return HeapAllocator::Deallocate(context, o);
             } else {
                 // Don't deallocate maps!
                 return 0;
             }
-        } else {
-            context.handles_[obj] = count;
         }
         return 0;
     }
@@ -167,6 +228,13 @@ struct BaseMap /* : HeapObject -- This is implicit */ {
     uint32_t size;
     Constructor ctor;
     Destructor  dtor;
+    Visitor     visit;
+    // Live objects of this type and the heap bytes they occupy
+    uint32_t count;
+    size_t bytes;
+    // Every object of this type ever allocated, and the bytes, dead or alive
+    uint64_t allocations;
+    uint64_t allocated_bytes;
 };
 
 template <typename T>
@@ -200,6 +268,10 @@ template<typename T> Map<T> * Map<T>::New(IsolateImpl *iso, v8::internal::Instan
         return T::Destructor(context, static_cast<T*>(o));
         
     };
+    map->visit = [](HeapObject* o, RootVisitor visit, void *data)
+    {
+        T::VisitJSValues(static_cast<T*>(o), visit, data);
+    };
     map->size = sizeof(T);
     if (kind != 0xff) {
         v8::internal::Oddball* oddball_handle = reinterpret_cast<v8::internal::Oddball*>(map->object.m_map);
@@ -23,15 +23,23 @@ HeapStatistics::HeapStatistics()
 
 HeapSpaceStatistics::HeapSpaceStatistics()
 {
-    assert(0);
+    space_name_ = nullptr;
+    space_size_ = 0;
+    space_used_size_ = 0;
+    space_available_size_ = 0;
+    physical_space_size_ = 0;
 }
 
 HeapObjectStatistics::HeapObjectStatistics()
 {
-    assert(0);
+    object_type_ = nullptr;
+    object_sub_type_ = nullptr;
+    object_count_ = 0;
+    object_size_ = 0;
 }
 
 HeapCodeStatistics::HeapCodeStatistics()
 {
-    assert(0);
+    code_and_metadata_size_ = 0;
+    bytecode_and_metadata_size_ = 0;
 }
@@ -12,7 +12,10 @@
 #include "Object.h"
 #include "Script.h"
 #include "Message.h"
+#include "CpuProfiler.h"
 #include "JSCPrivate.h"
+#include <algorithm>
+#include <chrono>
 
 using namespace V82JSC;
 using v8::Isolate;
@@ -34,6 +37,8 @@ ISOLATE_INIT_LIST(DECLARE_FIELDS);
 
 std::mutex IsolateImpl::s_isolate_mutex;
 std::map<JSGlobalContextRef, IsolateImpl*> IsolateImpl::s_context_to_isolate_map;
+thread_local IsolateImpl::ExecCache IsolateImpl::t_exec_cache;
+std::atomic<int> IsolateImpl::s_exec_epoch(0);
 
 static void triggerGarbageCollection(IsolateImpl* iso)
 {
@@ -41,15 +46,43 @@ static void triggerGarbageCollection(IsolateImpl* iso)
     if (!iso->m_pending_collection) {
         iso->m_pending_collection = true;
         isolate->EnqueueMicrotask([](void *data){
-            reinterpret_cast<IsolateImpl*>(data)->CollectGarbage();
-            reinterpret_cast<IsolateImpl*>(data)->m_pending_collection = false;
+            IsolateImpl *iso = reinterpret_cast<IsolateImpl*>(data);
+            // Idle time may have got to it first
+            if (iso->m_pending_collection) {
+                iso->CollectGarbage();
+                iso->m_pending_collection = false;
+            }
         }, iso);
     }
 }
 
+void IsolateImpl::ScheduleGarbageCollection()
+{
+    triggerGarbageCollection(this);
+}
+
+// Only cells can be marked.  On 64-bit, anything else is a number or one of the immediates,
+// which are tagged; on 32-bit the C API boxes those too.
+static inline bool IsCell(JSValueRef value)
+{
+#ifdef __LP64__
+    return value && (reinterpret_cast<uint64_t>(value) & 0xffff000000000002ULL) == 0;
+#else
+    return value != nullptr;
+#endif
+}
+
 static void MarkingConstraintCallback(JSCPrivate::JSMarkerRef marker, void *userData)
 {
     IsolateImpl *impl = (IsolateImpl*)userData;
+    // Everything the heap's values hold on to is a root (see V82JSC::Value::Root())
+    H::HeapAllocator::VisitJSValues(impl, [](JSValueRef value, void *data)
+    {
+        if (IsCell(value)) {
+            auto marker = reinterpret_cast<JSCPrivate::JSMarkerRef>(data);
+            marker->Mark(marker, (JSObjectRef)value);
+        }
+    }, marker);
     impl->performIncrementalMarking(marker, impl->m_near_death);
     impl->m_pending_prologue = true;
     triggerGarbageCollection(impl);
@@ -64,6 +97,144 @@ static void HeapFinalizerCallback(JSContextGroupRef grp, void *userData)
 
 std::atomic<bool> IsolateImpl::s_isLockerActive(false);
 
+// JSC takes one execution time limit per group and has no way to remove a marking constraint,
+// so a shared group gets one of each for good and they fan out to its isolates.  Heap
+// finalizers can be removed and stay per isolate.
+struct IsolateImpl::SharedGroup {
+    JSContextGroupRef m_group;
+    std::recursive_mutex m_locker;
+    std::mutex m_mutex;
+    std::vector<IsolateImpl*> m_isolates;
+};
+std::atomic<bool> IsolateImpl::s_share_context_groups(false);
+std::atomic<bool> IsolateImpl::s_trusted_mode(false);
+static std::mutex s_shared_group_mutex;
+static IsolateImpl::SharedGroup *s_shared_group = nullptr;
+
+static void SharedMarkingConstraintCallback(JSCPrivate::JSMarkerRef marker, void *userData)
+{
+    IsolateImpl::SharedGroup *shared = (IsolateImpl::SharedGroup*)userData;
+    std::unique_lock<std::mutex> lk(shared->m_mutex);
+    for (auto iso : shared->m_isolates) {
+        MarkingConstraintCallback(marker, iso);
+    }
+}
+
+static bool SharedWatchdog(JSContextRef ctx, void *userData)
+{
+    IsolateImpl::SharedGroup *shared = (IsolateImpl::SharedGroup*)userData;
+    IsolateImpl *iso = nullptr;
+    {
+        std::unique_lock<std::mutex> lk(IsolateImpl::s_isolate_mutex);
+        auto i = IsolateImpl::s_context_to_isolate_map.find(JSContextGetGlobalContext(ctx));
+        if (i != IsolateImpl::s_context_to_isolate_map.end()) iso = i->second;
+    }
+    if (iso) {
+        return IsolateImpl::OnWatchdog(ctx, iso);
+    }
+    {
+        std::unique_lock<std::mutex> lk(shared->m_mutex);
+        if (!shared->m_isolates.empty()) iso = shared->m_isolates.front();
+    }
+    if (iso) iso->ResetWatchdog();
+    return false;
+}
+
+void IsolateImpl::ShareContextGroups(bool share)
+{
+    s_share_context_groups = share;
+}
+
+void IsolateImpl::SetTrustedMode(bool trusted)
+{
+    s_trusted_mode = trusted;
+}
+
+static void JoinSharedGroup(IsolateImpl *impl)
+{
+    std::unique_lock<std::mutex> lk(s_shared_group_mutex);
+    if (!s_shared_group) {
+        s_shared_group = new IsolateImpl::SharedGroup();
+        s_shared_group->m_group = JSContextGroupCreate();
+        JSCPrivate::JSContextGroupAddMarkingConstraint(s_shared_group->m_group,
+                                                       SharedMarkingConstraintCallback,
+                                                       s_shared_group);
+    }
+    impl->m_shared_group = s_shared_group;
+    impl->m_group = JSContextGroupRetain(s_shared_group->m_group);
+    // Every isolate in the group takes the same lock, and a second thread may turn up at any
+    // time, so there is no eliding it
+    impl->m_locker = &s_shared_group->m_locker;
+    impl->m_multithreaded = true;
+    std::unique_lock<std::mutex> glk(s_shared_group->m_mutex);
+    s_shared_group->m_isolates.push_back(impl);
+}
+
+static void LeaveSharedGroup(IsolateImpl *impl)
+{
+    std::unique_lock<std::mutex> lk(s_shared_group_mutex);
+    IsolateImpl::SharedGroup *shared = impl->m_shared_group;
+    bool last;
+    {
+        std::unique_lock<std::mutex> glk(shared->m_mutex);
+        auto i = std::find(shared->m_isolates.begin(), shared->m_isolates.end(), impl);
+        if (i != shared->m_isolates.end()) shared->m_isolates.erase(i);
+        last = shared->m_isolates.empty();
+    }
+    if (last) {
+        // Nothing is left to run JS in the group, so it goes when its last reference does
+        JSCPrivate::JSContextGroupClearExecutionTimeLimit(shared->m_group);
+        JSContextGroupRelease(shared->m_group);
+        if (s_shared_group == shared) s_shared_group = nullptr;
+        delete shared;
+    }
+}
+
+void IsolateImpl::SetWatchdog(double limit)
+{
+    if (m_shared_group) {
+        JSCPrivate::JSContextGroupSetExecutionTimeLimit(m_group, limit, SharedWatchdog, m_shared_group);
+    } else {
+        JSCPrivate::JSContextGroupSetExecutionTimeLimit(m_group, limit, IsolateImpl::OnWatchdog, this);
+    }
+}
+
+// Fires at once while an interrupt or termination is waiting, at the sampling interval while
+// profiling, and not at all otherwise.  A shared group polls as often as its most demanding
+// isolate wants.
+void IsolateImpl::ResetWatchdog()
+{
+    double interval = 0;
+    bool pending = false;
+    auto needs = [&interval, &pending](IsolateImpl *iso) {
+        {
+            std::unique_lock<std::mutex> lk(iso->m_pending_interrupt_mutex);
+            pending = pending || !iso->m_pending_interrupts.empty();
+        }
+        pending = pending || iso->m_terminate_execution;
+        if (iso->m_watchdog_interval > 0 && (interval <= 0 || iso->m_watchdog_interval < interval)) {
+            interval = iso->m_watchdog_interval;
+        }
+    };
+    // Deciding and arming happen under the one lock, so that an interrupt queued meanwhile is
+    // never disarmed by a poll that didn't see it
+    std::unique_lock<std::mutex> lk(m_shared_group ? m_shared_group->m_mutex : m_watchdog_mutex);
+    if (m_shared_group) {
+        for (auto iso : m_shared_group->m_isolates) {
+            needs(iso);
+        }
+    } else {
+        needs(this);
+    }
+    if (pending) {
+        SetWatchdog(0);
+    } else if (interval > 0) {
+        SetWatchdog(interval);
+    } else {
+        JSCPrivate::JSContextGroupClearExecutionTimeLimit(m_group);
+    }
+}
+
 /**
  * Creates a new isolate.  Does not change the currently entered
  * isolate.
@@ -84,19 +255,24 @@ Isolate * Isolate::New(Isolate::CreateParams const&params)
     HeapImpl* heap = static_cast<HeapImpl*>(impl->ii.heap());
     heap->m_heap_top = nullptr;
     heap->m_allocated = 0;
+    impl->m_gc_limit = HEAP_INITIAL_LIMIT;
     heap->SetUp();
     
     impl->m_global_symbols = std::map<std::string, JSValueRef>();
     impl->m_private_symbols = std::map<std::string, JSValueRef>();
     impl->m_global_contexts = std::map<JSGlobalContextRef, v8::Persistent<v8::Context>>();
-    impl->m_exec_maps = std::map<JSGlobalContextRef, std::map<const char *, JSObjectRef>>();
+    impl->m_exec_maps = std::map<JSGlobalContextRef, IsolateImpl::ExecFunctions>();
     impl->m_message_listeners = std::vector<internal::MessageListener>();
     impl->m_gc_prologue_callbacks = std::vector<IsolateImpl::GCCallbackStruct>();
     impl->m_gc_epilogue_callbacks = std::vector<IsolateImpl::GCCallbackStruct>();
     impl->m_near_death = std::map<void*, JSObjectRef>();
     impl->m_second_pass_callbacks = std::vector<internal::SecondPassCallback>();
-    impl->m_external_strings = std::map<JSValueRef, v8::Persistent<v8::WeakExternalString>>();
-    impl->m_internalized_strings = std::map<JSStringRef, v8::Persistent<v8::String>*>();
+    new (&impl->m_external_strings) std::unordered_map<JSValueRef, V82JSC::ExternalString>();
+    new (&impl->m_tracked_objects) std::unordered_map<JSObjectRef, V82JSC::TrackedObjectAlias>();
+    new (&impl->m_released_external_strings) std::vector<V82JSC::ExternalStringFinalizer*>();
+    new (&impl->m_internalized_strings) V82JSC::InternalizedStrings();
+    new (&impl->m_template_functions)
+        std::unordered_map<V82JSC::FunctionTemplate*, std::unordered_map<JSGlobalContextRef, JSObjectRef>>();
     impl->m_microtask_queue = std::vector<IsolateImpl::EnqueuedMicrotask>();
     impl->m_microtasks_completed_callback = std::vector<v8::MicrotasksCompletedCallback>();
     impl->m_microtasks_policy = v8::MicrotasksPolicy::kAuto;
@@ -105,25 +281,40 @@ Isolate * Isolate::New(Isolate::CreateParams const&params)
     impl->m_call_completed_callbacks = std::vector<CallCompletedCallback>();
     impl->m_eternal_handles = std::vector<v8::Persistent<v8::Value> *>();
 
-    impl->m_locker = nullptr;
+    impl->m_locks = 0;
+    impl->m_exclusive_thread = std::thread::id();
+    impl->m_elided_locks = 0;
+    // Collections started from the other isolates call into this one as soon as it has joined,
+    // so hold them off until it is built
+    std::unique_lock<std::recursive_mutex> shared_lock;
+    // The group's watchdog reads these from the moment it joins
+    new (&impl->m_pending_interrupt_mutex) std::mutex();
+    new (&impl->m_watchdog_mutex) std::mutex();
+    impl->m_pending_interrupts = std::vector<IsolateImpl::PendingInterrupt>();
+    impl->m_trusted = IsolateImpl::s_trusted_mode;
+    if (IsolateImpl::s_share_context_groups) {
+        JoinSharedGroup(impl);
+        shared_lock = std::unique_lock<std::recursive_mutex>(*impl->m_locker);
+    } else {
+        impl->m_locker = new std::recursive_mutex();
+        impl->m_multithreaded = false;
+        impl->m_group = JSContextGroupCreate();
+    }
     impl->m_entered_count = 0;
     
     new (&impl->m_isolate_lock) std::mutex();
-    new (&impl->m_pending_interrupt_mutex) std::mutex();
     new (&impl->m_handlewalk_lock) std::mutex();
-    impl->m_pending_interrupts = std::vector<IsolateImpl::PendingInterrupt>();
 
     HandleScope scope(isolate);
     
     impl->m_params = params;
     
-    impl->m_group = JSContextGroupCreate();
-    
-    // Poll every second during script execution to see if there are any interrupts
-    // pending
-    JSCPrivate::JSContextGroupSetExecutionTimeLimit(impl->m_group, 1, IsolateImpl::PollForInterrupts, impl);
+    // Nothing is pending yet, so this leaves the watchdog disarmed
+    impl->ResetWatchdog();
     
-    JSCPrivate::JSContextGroupAddMarkingConstraint(impl->m_group, MarkingConstraintCallback, impl);
+    if (!impl->m_shared_group) {
+        JSCPrivate::JSContextGroupAddMarkingConstraint(impl->m_group, MarkingConstraintCallback, impl);
+    }
     JSCPrivate::JSContextGroupAddHeapFinalizer(impl->m_group, HeapFinalizerCallback, impl);
     
     Roots* roots = reinterpret_cast<Roots *>(impl->ii.heap()->roots_array_start());
@@ -144,13 +335,11 @@ Isolate * Isolate::New(Isolate::CreateParams const&params)
     impl->m_string_map = H::Map<H::String>::New(impl, internal::INTERNALIZED_STRING_TYPE);
     impl->m_external_one_byte_string_map = H::Map<H::String>::New(impl, internal::EXTERNAL_ONE_BYTE_STRING_TYPE);
     impl->m_external_string_map = H::Map<H::String>::New(impl, internal::EXTERNAL_STRING_TYPE);
-    impl->m_weak_external_one_byte_string_map = H::Map<H::WeakExternalString>::New(impl, internal::EXTERNAL_ONE_BYTE_STRING_TYPE);
-    impl->m_weak_external_string_map = H::Map<H::WeakExternalString>::New(impl, internal::EXTERNAL_STRING_TYPE);
     impl->m_internalized_string_map = H::Map<H::String>::New(impl, internal::INTERNALIZED_STRING_TYPE);
     impl->m_value_map = H::Map<H::Value>::New(impl, internal::JS_VALUE_TYPE);
     impl->m_number_map = H::Map<H::Value>::New(impl, internal::HEAP_NUMBER_TYPE);
     impl->m_symbol_map = H::Map<H::Value>::New(impl, internal::SYMBOL_TYPE);
-    impl->m_promise_resolver_map = H::Map<H::Value>::New(impl, internal::JS_PROMISE_TYPE);
+    impl->m_promise_resolver_map = H::Map<H::PromiseResolver>::New(impl, internal::JS_PROMISE_TYPE);
     impl->m_signature_map = H::Map<H::Signature>::New(impl, internal::JS_SPECIAL_API_OBJECT_TYPE);
     impl->m_function_template_map = H::Map<H::FunctionTemplate>::New(impl, internal::FUNCTION_TEMPLATE_INFO_TYPE);
     impl->m_object_template_map = H::Map<H::ObjectTemplate>::New(impl, internal::OBJECT_TEMPLATE_INFO_TYPE);
@@ -201,6 +390,22 @@ Isolate * Isolate::New(Isolate::CreateParams const&params)
     impl->m_creation_contexts = (JSObjectRef) exec(ToContextRef(nullContext), newWeakMap, 0, 0);
     JSValueProtect(ToContextRef(nullContext), impl->m_creation_contexts);
 
+    JSObjectRef methods = (JSObjectRef) exec(ToContextRef(nullContext),
+        "return [Map.prototype.get, Map.prototype.set, Map.prototype.has, Map.prototype.delete,"
+        "        Map.prototype.clear, Map.prototype.forEach, Set.prototype.add, Set.prototype.has,"
+        "        Set.prototype.delete, Set.prototype.clear, Set.prototype.forEach,"
+        "        Promise.prototype.then, Promise.prototype.catch]", 0, 0);
+    JSObjectRef *method_slots[] = {
+        &impl->m_map_get, &impl->m_map_set, &impl->m_map_has, &impl->m_map_delete,
+        &impl->m_map_clear, &impl->m_map_for_each, &impl->m_set_add, &impl->m_set_has,
+        &impl->m_set_delete, &impl->m_set_clear, &impl->m_set_for_each,
+        &impl->m_promise_then, &impl->m_promise_catch
+    };
+    for (unsigned i=0; i<sizeof(method_slots)/sizeof(JSObjectRef*); i++) {
+        *method_slots[i] = (JSObjectRef) JSObjectGetPropertyAtIndex(ToContextRef(nullContext), methods, i, 0);
+        JSValueProtect(ToContextRef(nullContext), *method_slots[i]);
+    }
+
     impl->ii.thread_local_top_.isolate_ = &impl->ii;
     impl->ii.thread_local_top_.scheduled_exception_ = reinterpret_cast<internal::Object*>(roots->the_hole_value);
     impl->ii.thread_local_top_.pending_exception_ = reinterpret_cast<internal::Object*>(roots->the_hole_value);
@@ -221,6 +426,7 @@ bool v8::internal::Heap::SetUp()
     void *memptr;
     posix_memalign(&memptr, EXTERNAL_MEMORY_SIZE, EXTERNAL_MEMORY_SIZE);
     external_memory_ = reinterpret_cast<uint64_t>(memptr);
+    iso->m_external_memory_base = external_memory_;
     external_memory_limit_ = external_memory_ + EXTERNAL_MEMORY_SIZE;
     
     return true;
@@ -229,8 +435,6 @@ bool v8::internal::Heap::SetUp()
 bool IsolateImpl::PollForInterrupts(JSContextRef ctx, void* context)
 {
     IsolateImpl* iso = (IsolateImpl*)context;
-    // Reset poll to one-second
-    JSCPrivate::JSContextGroupSetExecutionTimeLimit(iso->m_group, 1, IsolateImpl::PollForInterrupts, iso);
     bool empty = false;
     bool terminate = iso->m_terminate_execution;
     
@@ -249,9 +453,20 @@ bool IsolateImpl::PollForInterrupts(JSContextRef ctx, void* context)
         empty = iso->m_pending_interrupts.empty();
     }
     iso->m_pending_interrupt_mutex.unlock();
+    // Only once the queue is empty, or it would fire again straight away
+    iso->ResetWatchdog();
     return false;
 }
 
+bool IsolateImpl::OnWatchdog(JSContextRef ctx, void* context)
+{
+    IsolateImpl* iso = (IsolateImpl*)context;
+    if (iso->m_cpu_profiler && !iso->m_terminate_execution) {
+        V82JSC::CpuProfiler::Sample(iso, ctx);
+    }
+    return PollForInterrupts(ctx, context);
+}
+
 void IsolateImpl::TriggerGCPrologue()
 {
     if (!m_pending_prologue) return;
@@ -289,20 +504,6 @@ void IsolateImpl::TriggerGCEpilogue()
     }
 }
 
-void IsolateImpl::CollectExternalStrings()
-{
-    v8::HandleScope scope(ToIsolate(this));
-    
-    for (auto i=m_external_strings.begin(); i!=m_external_strings.end(); ) {
-        auto ext = ToImpl<V82JSC::WeakExternalString>(i->second.Get(ToIsolate(this)));
-        if (JSCPrivate::JSWeakGetObject(ext->m_weakRef) == 0) {
-            m_external_strings.erase(i++);
-        } else {
-            ++i;
-        }
-    }
-}
-
 JSGlobalContextRef H::HeapObject::GetNullContext()
 {
     IsolateImpl* iso = GetIsolate();
@@ -331,23 +532,22 @@ bool v8::internal::Isolate::Init(v8::internal::Deserializer *des)
 
 std::mutex IsolateImpl::s_thread_data_mutex;
 std::map<size_t, IsolateImpl::PerThreadData*> IsolateImpl::s_thread_data;
-IsolateImpl::PerThreadData* IsolateImpl::PerThreadData::Get()
+thread_local IsolateImpl::PerThreadData* IsolateImpl::PerThreadData::t_current = nullptr;
+IsolateImpl::PerThreadData* IsolateImpl::PerThreadData::Register()
 {
     std::unique_lock<std::mutex> lock(s_thread_data_mutex);
     size_t hash = std::hash<std::thread::id>()(std::this_thread::get_id());
-    size_t has = s_thread_data.count(hash);
-    if (has == 0) {
-        PerThreadData *data = new PerThreadData();
-        s_thread_data[hash] = data;
-        return data;
-    } else {
-        return s_thread_data[hash];
+    if (s_thread_data.count(hash) == 0) {
+        s_thread_data[hash] = new PerThreadData();
     }
+    t_current = s_thread_data[hash];
+    t_current->m_thread_hash = hash;
+    return t_current;
 }
 void IsolateImpl::PerThreadData::EnterThreadContext(v8::Isolate *isolate)
 {
     IsolateImpl *iso = ToIsolateImpl(isolate);
-    size_t hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+    size_t hash = Get()->m_thread_hash;
     if (hash != iso->m_current_thread_hash) {
         auto thread = Get(iso);
         if (iso->m_current_thread_context != thread) {
@@ -473,21 +673,16 @@ void Isolate::Exit()
 void IsolateImpl::EnterContext(Local<v8::Context> ctx)
 {
     auto thread = IsolateImpl::PerThreadData::Get(this);
-    v8::Persistent<v8::Context, v8::CopyablePersistentTraits<v8::Context>> persist(ToIsolate(this), ctx);
-    thread->m_context_stack.push(persist);
-    persist.Reset();
+    thread->m_context_stack.push_back(ToImpl<V82JSC::Context>(ctx));
 }
 
 void IsolateImpl::ExitContext(Local<v8::Context> ctx)
 {
     auto thread = IsolateImpl::PerThreadData::Get(this);
     assert(thread->m_context_stack.size());
-    JSContextRef top = ToContextRef(thread->m_context_stack.top().Get(ToIsolate(this)));
-    JSContextRef newctx = ToContextRef(ctx);
-    assert(top == newctx);
+    assert(thread->m_context_stack.back()->m_ctxRef == ToContextRef(ctx));
 
-    thread->m_context_stack.top().Reset();
-    thread->m_context_stack.pop();
+    thread->m_context_stack.pop_back();
 }
 
 /**
@@ -515,23 +710,26 @@ void Isolate::Dispose()
         return;
     }
 
-    JSCPrivate::JSContextGroupClearExecutionTimeLimit(isolate->m_group);
+    if (isolate->m_shared_group) {
+        // The rest of the group still needs the watchdog
+        std::unique_lock<std::mutex> lk(isolate->m_shared_group->m_mutex);
+        auto& isolates = isolate->m_shared_group->m_isolates;
+        isolates.erase(std::remove(isolates.begin(), isolates.end(), isolate), isolates.end());
+    } else {
+        JSCPrivate::JSContextGroupClearExecutionTimeLimit(isolate->m_group);
+    }
 
     // Hmm.  There is no JSContextGroupRemoveMarkingConstraint() equivalent
     JSCPrivate::JSContextGroupRemoveHeapFinalizer(isolate->m_group, HeapFinalizerCallback, isolate);
-    {
-        HandleScope scope(ToIsolate(isolate));
-        auto deleted = std::map<String::ExternalStringResourceBase*, bool>();
-        while (!isolate->m_external_strings.empty()) {
-            Local<WeakExternalString> wes = isolate->m_external_strings.begin()->second.Get(ToIsolate(isolate));
-            auto impl = ToImpl<V82JSC::WeakExternalString>(wes);
-            impl->FinalizeExternalString();
-            isolate->m_external_strings.erase(isolate->m_external_strings.begin());
-        }
+    V82JSC::ExternalString::Dispose(isolate);
+    for (auto i=isolate->m_tracked_objects.begin(); i!=isolate->m_tracked_objects.end(); ++i) {
+        JSCPrivate::JSWeakRelease(isolate->m_group, i->second.m_weakRef);
     }
+    isolate->m_tracked_objects.clear();
     for (auto i=isolate->m_internalized_strings.begin(); i!=isolate->m_internalized_strings.end(); ++i) {
         i->second->Reset();
         delete i->second;
+        JSStringRelease(i->first);
     }
     isolate->m_internalized_strings.clear();
 
@@ -544,6 +742,11 @@ void Isolate::Dispose()
     }
     isolate->m_global_contexts.clear();
     isolate->m_exec_maps.clear();
+    IsolateImpl::s_exec_epoch ++;
+    isolate->m_template_functions.clear();
+    isolate->m_set_prototype_of_template.Reset();
+    isolate->m_get_prototype_of_template.Reset();
+    isolate->m_bind_template.Reset();
     isolate->m_nullContext.Reset();
     isolate->m_microtask_queue.clear();
     isolate->m_microtasks_completed_callback.clear();
@@ -565,9 +768,15 @@ void Isolate::Dispose()
     isolate->m_eternal_handles.clear();
 
     auto thread = IsolateImpl::PerThreadData::Get(isolate);
-    for (auto i=IsolateImpl::s_thread_data.begin(); i!=IsolateImpl::s_thread_data.end(); i++) {
-        if (i->second->m_isolate_data.count(isolate) != 0) {
-            i->second->m_isolate_data.erase(isolate);
+    {
+        std::unique_lock<std::mutex> lk(IsolateImpl::s_thread_data_mutex);
+        for (auto i=IsolateImpl::s_thread_data.begin(); i!=IsolateImpl::s_thread_data.end(); i++) {
+            std::unique_lock<std::mutex> lock(i->second->m_mutex);
+            if (i->second->m_isolate_data.count(isolate) != 0) {
+                i->second->m_isolate_data.erase(isolate);
+            }
+            IsolateImpl* expected = isolate;
+            i->second->m_last_isolate.compare_exchange_strong(expected, nullptr);
         }
     }
     delete thread;
@@ -584,13 +793,18 @@ void Isolate::Dispose()
     }
     
     // Finally, blitz the global handles and the heap
-    void *memptr = reinterpret_cast<void*>(isolate->ii.heap()->external_memory());
+    // external_memory_ moves with AdjustAmountOfExternalAllocatedMemory, so free from the base
+    void *memptr = reinterpret_cast<void*>(isolate->m_external_memory_base);
     free(memptr);
 
     isolate->ii.global_handles()->TearDown();
     HeapAllocator::TearDown(isolate);
     
-    if (isolate->m_locker) delete isolate->m_locker;
+    if (isolate->m_shared_group) {
+        LeaveSharedGroup(isolate);
+    } else if (isolate->m_locker) {
+        delete isolate->m_locker;
+    }
     
     // And now the isolate is done
     free(isolate);
@@ -602,10 +816,10 @@ void IsolateImpl::CollectGarbage()
     IsolateImpl *iso = reinterpret_cast<IsolateImpl*>(this);
     if (iso->m_in_gc++) return;
     
-    H::HeapAllocator::CollectGarbage(this);
+    H::HeapAllocator::CollectGarbage(this, true);
 
     iso->TriggerGCPrologue();
-    iso->CollectExternalStrings();
+    H::ExternalString::Collect(iso);
     
     iso->TriggerGCEpilogue();
     
@@ -636,18 +850,113 @@ void Isolate::DiscardThreadSpecificMetadata()
 /**
  * Get statistics about the heap memory usage.
  */
-void Isolate::GetHeapStatistics(HeapStatistics* heap_statistics)
+// The V82JSC heap object types reported by GetHeapObjectStatisticsAtLastGC
+#define TRACKED_HEAP_OBJECT_TYPES(V) \
+    V(TrackedObject, m_tracked_object_map) \
+    V(ArrayBuffer, m_array_buffer_map) \
+    V(Context, m_context_map) \
+    V(GlobalContext, m_global_context_map) \
+    V(FixedArray, m_fixed_array_map) \
+    V(OneByteString, m_one_byte_string_map) \
+    V(String, m_string_map) \
+    V(ExternalString, m_external_string_map) \
+    V(ExternalOneByteString, m_external_one_byte_string_map) \
+    V(InternalizedString, m_internalized_string_map) \
+    V(Value, m_value_map) \
+    V(Number, m_number_map) \
+    V(Symbol, m_symbol_map) \
+    V(PromiseResolver, m_promise_resolver_map) \
+    V(Signature, m_signature_map) \
+    V(FunctionTemplate, m_function_template_map) \
+    V(ObjectTemplate, m_object_template_map) \
+    V(Prop, m_property_map) \
+    V(PropAccessor, m_property_accessor_map) \
+    V(IntrinsicProp, m_intrinsic_property_map) \
+    V(Accessor, m_accessor_map) \
+    V(ObjAccessor, m_object_accessor_map) \
+    V(UnboundScript, m_unbound_script_map) \
+    V(Script, m_script_map) \
+    V(WeakValue, m_weak_value_map) \
+    V(StackFrame, m_stack_frame_map) \
+    V(StackTrace, m_stack_trace_map) \
+    V(Message, m_message_map)
+
+#define DECLARE_NAME(N,M) #N,
+static const char * const s_tracked_heap_object_types[] = {
+    TRACKED_HEAP_OBJECT_TYPES(DECLARE_NAME)
+};
+#undef DECLARE_NAME
+
+static BaseMap * TrackedHeapObjectMap(IsolateImpl *iso, size_t type_index)
 {
-    internal::Heap *heap = reinterpret_cast<internal::Isolate*>(this)->heap();
-    HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(heap);
-    H::HeapAllocator *chunk = static_cast<H::HeapAllocator*>(heapimpl->m_heap_top);
+    size_t index = 0;
+#define RETURN_MAP(N,M) if (type_index == index++) return iso->M;
+    TRACKED_HEAP_OBJECT_TYPES(RETURN_MAP)
+#undef RETURN_MAP
+    return nullptr;
+}
+
+// Logical spaces reported by GetHeapSpaceStatistics
+enum HeapSpace {
+    kV82JSCSpace,     // V82JSC's own heap of API objects
+    kJSCSpace,        // JSC's garbage-collected heap
+    kArrayBufferSpace,// backing stores owned by ArrayBuffers
+    kExternalSpace,   // memory reported through AdjustAmountOfExternalAllocatedMemory
+    kNumberOfHeapSpaces
+};
+static const char * const s_heap_space_names[] = {
+    "v82jsc_space", "jsc_space", "array_buffer_space", "external_space"
+};
+
+static void GetHeapSpace(IsolateImpl *iso, size_t index, size_t *size, size_t *used)
+{
+    switch (index) {
+        case kV82JSCSpace: {
+            HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(iso->ii.heap());
+            *size = 0;
+            for (auto chunk = heapimpl->m_heap_top; chunk != nullptr; chunk = chunk->next_chunk()) {
+                *size += HEAP_ALIGNMENT;
+            }
+            *used = heapimpl->m_allocated;
+            break;
+        }
+        case kJSCSpace: {
+            JSCPrivate::JSHeapStatistics statistics;
+            JSCPrivate::JSContextGroupGetHeapStatistics(iso->m_group, &statistics);
+            *size = statistics.capacity;
+            *used = statistics.size;
+            break;
+        }
+        case kArrayBufferSpace:
+            *size = *used = iso->m_array_buffer_bytes;
+            break;
+        case kExternalSpace: {
+            int64_t external = iso->ii.heap()->external_memory() - iso->m_external_memory_base;
+            *size = *used = external > 0 ? (size_t) external : 0;
+            break;
+        }
+    }
+}
 
-    heap_statistics->total_heap_size_ = 0;
-    for ( ; chunk != nullptr; chunk=static_cast<H::HeapAllocator*>(chunk->next_chunk())) {
-        heap_statistics->total_heap_size_ += HEAP_ALIGNMENT;
+void Isolate::GetHeapStatistics(HeapStatistics* heap_statistics)
+{
+    IsolateImpl *iso = reinterpret_cast<IsolateImpl*>(this);
+    size_t size[kNumberOfHeapSpaces], used[kNumberOfHeapSpaces];
+    for (size_t i=0; i<kNumberOfHeapSpaces; i++) {
+        GetHeapSpace(iso, i, &size[i], &used[i]);
     }
-    
-    heap_statistics->used_heap_size_ = heapimpl->m_allocated;
+
+    heap_statistics->total_heap_size_ = size[kV82JSCSpace] + size[kJSCSpace];
+    heap_statistics->total_physical_size_ = heap_statistics->total_heap_size_;
+    heap_statistics->used_heap_size_ = used[kV82JSCSpace] + used[kJSCSpace];
+    heap_statistics->total_available_size_ = heap_statistics->total_heap_size_ - heap_statistics->used_heap_size_;
+    // The ResourceConstraints limit if there is one, and otherwise the size at which the heap
+    // controller will next collect
+    size_t limit = iso->ii.heap()->MaxOldGenerationSize();
+    heap_statistics->heap_size_limit_ = limit ? limit : iso->m_gc_limit + size[kJSCSpace];
+    heap_statistics->malloced_memory_ = used[kArrayBufferSpace] + used[kExternalSpace];
+    iso->m_peak_malloced_memory = std::max(iso->m_peak_malloced_memory, heap_statistics->malloced_memory_);
+    heap_statistics->peak_malloced_memory_ = iso->m_peak_malloced_memory;
 }
 
 size_t v8::internal::Heap::SizeOfObjects()
@@ -661,8 +970,7 @@ size_t v8::internal::Heap::SizeOfObjects()
  */
 size_t Isolate::NumberOfHeapSpaces()
 {
-    assert(0);
-    return 0;
+    return kNumberOfHeapSpaces;
 }
 
 /**
@@ -677,8 +985,16 @@ size_t Isolate::NumberOfHeapSpaces()
 bool Isolate::GetHeapSpaceStatistics(HeapSpaceStatistics* space_statistics,
                             size_t index)
 {
-    assert(0);
-    return false;
+    if (index >= kNumberOfHeapSpaces) return false;
+    IsolateImpl *iso = reinterpret_cast<IsolateImpl*>(this);
+    size_t size, used;
+    GetHeapSpace(iso, index, &size, &used);
+    space_statistics->space_name_ = s_heap_space_names[index];
+    space_statistics->space_size_ = size;
+    space_statistics->space_used_size_ = used;
+    space_statistics->space_available_size_ = size - used;
+    space_statistics->physical_space_size_ = size;
+    return true;
 }
 
 /**
@@ -686,8 +1002,7 @@ bool Isolate::GetHeapSpaceStatistics(HeapSpaceStatistics* space_statistics,
  */
 size_t Isolate::NumberOfTrackedHeapObjectTypes()
 {
-    assert(0);
-    return 0;
+    return sizeof(s_tracked_heap_object_types) / sizeof(s_tracked_heap_object_types[0]);
 }
 
 /**
@@ -702,8 +1017,27 @@ size_t Isolate::NumberOfTrackedHeapObjectTypes()
 bool Isolate::GetHeapObjectStatisticsAtLastGC(HeapObjectStatistics* object_statistics,
                                      size_t type_index)
 {
-    assert(0);
-    return false;
+    // V82JSC keeps live counts, so these are current rather than as of the last GC
+    if (type_index >= NumberOfTrackedHeapObjectTypes()) return false;
+    IsolateImpl *iso = reinterpret_cast<IsolateImpl*>(this);
+    BaseMap *map = TrackedHeapObjectMap(iso, type_index);
+    object_statistics->object_type_ = s_tracked_heap_object_types[type_index];
+    object_statistics->object_sub_type_ = "";
+    object_statistics->object_count_ = map ? map->count : 0;
+    object_statistics->object_size_ = map ? map->bytes : 0;
+    return true;
+}
+
+bool IsolateImpl::GetHeapObjectAllocations(size_t type_index, uint64_t *allocations,
+                                           uint64_t *bytes)
+{
+    if (type_index >= sizeof(s_tracked_heap_object_types) / sizeof(s_tracked_heap_object_types[0])) {
+        return false;
+    }
+    BaseMap *map = TrackedHeapObjectMap(this, type_index);
+    *allocations = map ? map->allocations : 0;
+    *bytes = map ? map->allocated_bytes : 0;
+    return true;
 }
 
 /**
@@ -715,8 +1049,10 @@ bool Isolate::GetHeapObjectStatisticsAtLastGC(HeapObjectStatistics* object_stati
  */
 bool Isolate::GetHeapCodeAndMetadataStatistics(HeapCodeStatistics* object_statistics)
 {
-    assert(0);
-    return false;
+    // JSC does not report the size of its code
+    object_statistics->code_and_metadata_size_ = 0;
+    object_statistics->bytecode_and_metadata_size_ = 0;
+    return true;
 }
 
 /**
@@ -777,7 +1113,7 @@ Local<v8::Context> Isolate::GetCurrentContext()
         return Local<Context>();
     }
     
-    return Local<Context>::New(this, thread->m_context_stack.top());
+    return CreateLocal<Context>(this, thread->m_context_stack.back());
 }
 
 /** Returns the last context entered through V8's C++ API. */
@@ -975,7 +1311,7 @@ void Isolate::TerminateExecution()
 {
     IsolateImpl *iso = reinterpret_cast<IsolateImpl*>(this);
     iso->m_terminate_execution = true;
-    JSCPrivate::JSContextGroupSetExecutionTimeLimit(iso->m_group, 0, IsolateImpl::PollForInterrupts, iso);
+    iso->ResetWatchdog();
 }
 
 /**
@@ -1025,11 +1361,9 @@ void Isolate::RequestInterrupt(InterruptCallback callback, void* data)
     iso->m_pending_interrupt_mutex.lock();
     iso->m_pending_interrupts.push_back(IsolateImpl::PendingInterrupt(callback,data));
     iso->m_pending_interrupt_mutex.unlock();
-    // If we haven't started the script yet, this will force an interrupt immediately
-    // The interval will get set back to 1 second after the first interrupt
-    /*
-    JSContextGroupSetExecutionTimeLimit(iso->m_group, 0, IsolateImpl::PollForInterrupts, iso);
-    */
+    // Fires as soon as script is running, and is disarmed again once the queue is drained.  If
+    // none is, the next call in polls first anyway.
+    iso->ResetWatchdog();
 }
 
 /**
@@ -1065,7 +1399,7 @@ void Isolate::RequestGarbageCollectionForTesting(GarbageCollectionType type)
     }
     
     iso->TriggerGCFirstPassPhantomCallbacks();
-    iso->CollectExternalStrings();
+    H::ExternalString::Collect(iso);
     H::HeapAllocator::CollectGarbage(iso);
 
     for (auto i=iso->m_global_contexts.begin(); i != iso->m_global_contexts.end(); ++i) {
@@ -1167,21 +1501,43 @@ void Isolate::RunMicrotasks()
     IsolateImpl* iso = ToIsolateImpl(this);
     if (iso->m_suppress_microtasks) return;
     
+    if (iso->m_sweep_context && !iso->m_in_gc) {
+        // Resume an incremental sweep at each checkpoint until it is done
+        iso->m_in_gc++;
+        H::HeapAllocator::Sweep(iso, true);
+        iso->m_in_gc = 0;
+    }
+
     if (!iso->m_microtask_queue.empty()) {
         HandleScope scope(this);
         TryCatch try_catch(this);
         bool running = iso->m_running_microtasks;
         iso->m_running_microtasks = true;
+        // Drain in batches.  Anything enqueued while a batch runs lands in the (now empty) queue
+        // and is picked up by the next batch, which preserves FIFO order.
+        std::vector<IsolateImpl::EnqueuedMicrotask> batch;
         while (!iso->m_microtask_queue.empty()) {
-            auto i = iso->m_microtask_queue.begin();
-            IsolateImpl::EnqueuedMicrotask& microtask = *i;
-            if (!microtask.m_callback.IsEmpty()) {
-                Local<Function> task = microtask.m_callback.Get(this);
-                task->Call(OperatingContext(this), Local<Value>(), 0, nullptr).FromMaybe(Local<Value>());
-            } else {
-                microtask.m_native_callback(microtask.m_data);
+            batch.swap(iso->m_microtask_queue);
+            for (auto i = batch.begin(); i != batch.end(); ++i) {
+                IsolateImpl::EnqueuedMicrotask& microtask = *i;
+                if (microtask.m_native_callback) {
+                    microtask.m_native_callback(microtask.m_data);
+                } else if (microtask.m_is_v8) {
+                    HandleScope task_scope(this);
+                    Local<Context> ctxt = LocalContext::New(this, microtask.m_ctx);
+                    Local<Function> task = V82JSC::Value::New(ToContextImpl(ctxt), microtask.m_function).As<Function>();
+                    task->Call(OperatingContext(this), Local<Value>(), 0, nullptr).FromMaybe(Local<Value>());
+                    JSValueUnprotect(microtask.m_ctx, microtask.m_function);
+                } else {
+                    JSObjectCallAsFunction(microtask.m_ctx, microtask.m_function, 0, 0, nullptr, nullptr);
+                    JSValueUnprotect(microtask.m_ctx, microtask.m_function);
+                }
+            }
+            batch.clear();
+            if (iso->m_microtask_queue.empty()) {
+                // Hand the storage back so the next burst doesn't have to grow it again
+                batch.swap(iso->m_microtask_queue);
             }
-            iso->m_microtask_queue.erase(iso->m_microtask_queue.begin());
         }
         iso->m_running_microtasks = running;
         if (!running) {
@@ -1199,7 +1555,9 @@ void Isolate::RunMicrotasks()
 void Isolate::EnqueueMicrotask(Local<Function> microtask)
 {
     IsolateImpl* iso = ToIsolateImpl(this);
-    iso->m_microtask_queue.push_back(IsolateImpl::EnqueuedMicrotask(this, microtask));
+    Local<Context> context = OperatingContext(this);
+    iso->m_microtask_queue.push_back(IsolateImpl::EnqueuedMicrotask(ToContextRef(context),
+        (JSObjectRef) ToJSValueRef(microtask, context), true));
 }
 
 /**
@@ -1353,8 +1711,45 @@ void Isolate::SetAddHistogramSampleFunction(AddHistogramSampleCallback that)
  */
 bool Isolate::IdleNotificationDeadline(double deadline_in_seconds)
 {
-    RequestGarbageCollectionForTesting(GarbageCollectionType::kFullGarbageCollection);
+    // Without a platform, the deadline is on the steady clock
+    IsolateImpl *iso = reinterpret_cast<IsolateImpl*>(this);
+    if (iso->m_in_gc) return false;
+    auto deadline = std::chrono::steady_clock::time_point(
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(deadline_in_seconds)));
+    auto remaining_us = [deadline]() -> unsigned {
+        auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        return left > 0 ? (unsigned) left : 0;
+    };
 
+    // First whatever JSC's last collection left us: the rest of a sweep, then a collection
+    // its callbacks asked for
+    if (iso->m_sweep_context && remaining_us()) {
+        iso->m_in_gc++;
+        H::HeapAllocator::SweepFor(iso, remaining_us());
+        iso->m_in_gc = 0;
+    }
+    if (iso->m_pending_collection && !iso->m_sweep_context && remaining_us()) {
+        iso->CollectGarbage();
+        iso->m_pending_collection = false;
+        if (iso->m_sweep_context && remaining_us()) {
+            iso->m_in_gc++;
+            H::HeapAllocator::SweepFor(iso, remaining_us());
+            iso->m_in_gc = 0;
+        }
+    }
+    if (iso->m_sweep_context || iso->m_pending_collection) return false;
+
+    // Then let JSC know that now is a good time.  Only if we have allocated since the last
+    // time, or every idle frame would ask again.
+    HeapImpl *heapimpl = reinterpret_cast<HeapImpl*>(iso->ii.heap());
+    if (heapimpl->m_allocated != iso->m_idle_allocated && remaining_us() &&
+        !iso->m_global_contexts.empty()) {
+        iso->m_idle_allocated = heapimpl->m_allocated;
+        JSGarbageCollect(iso->m_global_contexts.begin()->first);
+        return false;
+    }
     return true;
 }
 
@@ -1364,7 +1759,7 @@ bool Isolate::IdleNotificationDeadline(double deadline_in_seconds)
  */
 void Isolate::LowMemoryNotification()
 {
-    assert(0);
+    RequestGarbageCollectionForTesting(GarbageCollectionType::kFullGarbageCollection);
 }
 
 /**
@@ -1654,11 +2049,11 @@ void Isolate::VisitExternalResources(ExternalResourceVisitor* visitor)
     HandleScope scope(this);
     
     IsolateImpl *iso = ToIsolateImpl(this);
+    auto context = ToContextImpl(iso->m_nullContext.Get(this));
     for(auto i=iso->m_external_strings.begin(); i!=iso->m_external_strings.end(); ++i) {
-        auto s = i->second.Get(this);
-        auto wes = static_cast<V82JSC::WeakExternalString*>(FromHeapPointer(*(internal::Object**)*s));
-        visitor->VisitExternalString(V82JSC::Value::New(ToContextImpl(iso->m_nullContext.Get(this)),
-                                                    wes->m_value).As<String>());
+        if (JSCPrivate::JSWeakGetObject(i->second.m_weakRef) == (JSObjectRef)i->first) {
+            visitor->VisitExternalString(V82JSC::Value::New(context, i->first).As<String>());
+        }
     }
 }
 
@@ -10,6 +10,7 @@
 #include "HeapObjects.h"
 #include "JSCPrivate.h"
 #include <thread>
+#include <unordered_map>
 
 namespace V82JSC {
     struct Context;
@@ -18,8 +19,9 @@ namespace V82JSC {
     struct Script;
     struct Value;
     struct WeakValue;
+    struct PromiseResolver;
     struct String;
-    struct WeakExternalString;
+    struct ExternalStringFinalizer;
     struct Message;
     struct FixedArray;
     struct Template;
@@ -34,13 +36,56 @@ namespace V82JSC {
     struct StackTrace;
     struct TrackedObject;
     struct Accessor;
-}
+    struct CpuProfiler;
 
-// These aren't really V8 values, but we want to use V8 handles to manage their
-// lifecycle, so we pretend.
-namespace v8 {
-    struct WeakExternalString : v8::Value {};
-};
+    // Hashes a JSString by its full UTF-16 content (FNV-1a)
+    struct JSStringHash {
+        size_t operator()(JSStringRef str) const
+        {
+            const JSChar *chars = JSStringGetCharactersPtr(str);
+            size_t length = JSStringGetLength(str);
+            size_t hash = 2166136261u;
+            for (size_t i=0; i<length; i++) {
+                hash = (hash ^ chars[i]) * 16777619u;
+            }
+            return hash ^ length;
+        }
+    };
+    struct JSStringEqual {
+        bool operator()(JSStringRef a, JSStringRef b) const { return JSStringIsEqual(a, b); }
+    };
+    typedef std::unordered_map<JSStringRef, v8::Persistent<v8::String>*, JSStringHash, JSStringEqual>
+        InternalizedStrings;
+
+    // Tracks a JSC string whose characters come from an external resource.  When JSC supports
+    // external strings it uses the resource in place and tells us through m_finalizer when it is
+    // done with it.  Otherwise the string is a copy and m_weakRef is polled after JSC collects.
+    struct ExternalString {
+        JSCPrivate::JSWeakRef m_weakRef;
+        v8::String::ExternalStringResourceBase *m_resource;
+        BaseMap *m_map;
+        ExternalStringFinalizer *m_finalizer;
+
+        static JSStringRef Create(v8::internal::IsolateImpl* iso,
+                                  v8::String::ExternalStringResourceBase *resource,
+                                  const void *data, size_t length, bool one_byte,
+                                  ExternalStringFinalizer **finalizer);
+        static void Track(v8::internal::IsolateImpl* iso, JSValueRef value,
+                          v8::String::ExternalStringResourceBase *resource, BaseMap *map,
+                          ExternalStringFinalizer *finalizer = nullptr);
+        static bool Lookup(v8::internal::IsolateImpl* iso, JSValueRef value,
+                           BaseMap **map = nullptr, void **resource = nullptr);
+        static void Collect(v8::internal::IsolateImpl* iso);
+        static void Dispose(v8::internal::IsolateImpl* iso);
+    };
+
+    // Maps a tracked object, or one of the proxies that stand in for it, to its TrackedObject
+    // without going through JS.  m_weakRef guards against JSC reusing a collected object's address.
+    struct TrackedObjectAlias {
+        JSCPrivate::JSWeakRef m_weakRef;
+        TrackedObject *m_tracked;
+    };
+}
 
 namespace v8 {
 namespace internal {
@@ -84,6 +129,7 @@ struct IsolateImpl;
 // differently and GlobalHandle struct is locked down as private.  This allows us to call
 // back into GlobalHandle with a custom function.
 typedef std::function<void(H::HeapContext&)> GetGlobalHandles;
+typedef std::function<void(const H::Forwarding&)> ForwardGlobalHandles;
 typedef std::function<void(v8::internal::Object**, std::vector<v8::internal::SecondPassCallback>&,
                            JSObjectRef)> WeakObjectNearDeath;
 typedef std::function<void(v8::Isolate*, v8::internal::SecondPassCallback&)> WeakHeapObjectFinalized;
@@ -95,6 +141,13 @@ struct IsolateImpl {
     v8::internal::Isolate ii;
     
     JSContextGroupRef m_group;
+    // Set if m_group is the process-wide group shared with other isolates
+    struct SharedGroup;
+    SharedGroup *m_shared_group;
+    static std::atomic<bool> s_share_context_groups;
+    // Set if created in trusted mode (see SetTrustedMode())
+    bool m_trusted;
+    static std::atomic<bool> s_trusted_mode;
     v8::Persistent<v8::Context> m_nullContext;
     JSValueRef m_negative_zero;
     JSValueRef m_empty_string;
@@ -102,6 +155,29 @@ struct IsolateImpl {
     JSObjectRef m_proxy_revocables;
     
     JSObjectRef m_creation_contexts;
+
+    // Map.prototype and Set.prototype methods from the null context, so that v8::Map and v8::Set
+    // can call them directly.  They work on collections from any context in the group.
+    JSObjectRef m_map_get;
+    JSObjectRef m_map_set;
+    JSObjectRef m_map_has;
+    JSObjectRef m_map_delete;
+    JSObjectRef m_map_clear;
+    JSObjectRef m_map_for_each;
+    JSObjectRef m_set_add;
+    JSObjectRef m_set_has;
+    JSObjectRef m_set_delete;
+    JSObjectRef m_set_clear;
+    JSObjectRef m_set_for_each;
+    // Likewise Promise.prototype.then and catch, for v8::Promise
+    JSObjectRef m_promise_then;
+    JSObjectRef m_promise_catch;
+
+    // Templates for the Object.setPrototypeOf/getPrototypeOf and Function.prototype.bind overrides
+    // installed in every context.  Created with the first non-null context.
+    v8::Persistent<v8::FunctionTemplate> m_set_prototype_of_template;
+    v8::Persistent<v8::FunctionTemplate> m_get_prototype_of_template;
+    v8::Persistent<v8::FunctionTemplate> m_bind_template;
     
     // Maps
     H::Map<H::TrackedObject> *m_tracked_object_map;
@@ -116,12 +192,10 @@ struct IsolateImpl {
     H::Map<H::String> *m_internalized_string_map;
     H::Map<H::String> *m_external_internalized_string_map;
     H::Map<H::String> *m_external_internalized_one_bye_string_map;
-    H::Map<H::WeakExternalString> *m_weak_external_string_map;
-    H::Map<H::WeakExternalString> *m_weak_external_one_byte_string_map;
     H::Map<H::Value> *m_value_map;
     H::Map<H::Value> *m_number_map;
     H::Map<H::Value> *m_symbol_map;
-    H::Map<H::Value> *m_promise_resolver_map;
+    H::Map<H::PromiseResolver> *m_promise_resolver_map;
     H::Map<H::Signature> *m_signature_map;
     H::Map<H::FunctionTemplate> *m_function_template_map;
     H::Map<H::ObjectTemplate> *m_object_template_map;
@@ -148,9 +222,41 @@ struct IsolateImpl {
     static std::mutex s_isolate_mutex;
     static std::map<JSGlobalContextRef, IsolateImpl*> s_context_to_isolate_map;
     
-    std::map<JSGlobalContextRef, std::map<const char *, JSObjectRef>> m_exec_maps;
+    // exec() helpers, compiled once per global context and keyed by the address of their source
+    typedef std::unordered_map<const char *, JSObjectRef> ExecFunctions;
+    std::map<JSGlobalContextRef, ExecFunctions> m_exec_maps;
+    // Functions materialized from each FunctionTemplate, per global context
+    std::unordered_map<V82JSC::FunctionTemplate*, std::unordered_map<JSGlobalContextRef, JSObjectRef>>
+        m_template_functions;
+    // Each thread remembers the helper table of the last global context it executed in.  The
+    // epoch is bumped whenever a table is discarded, which invalidates every thread's cache.
+    struct ExecCache {
+        JSGlobalContextRef m_gctx;
+        ExecFunctions *m_functions;
+        int m_epoch;
+    };
+    static thread_local ExecCache t_exec_cache;
+    static std::atomic<int> s_exec_epoch;
 
     bool m_pending_garbage_collection;
+    bool m_collecting_garbage;
+    // Chunk that last satisfied an allocation, per size class
+    H::HeapAllocator *m_alloc_chunk[HEAP_SMALL_SPACE_LOG + 1];
+    // Objects too large to share a chunk, each mapped on its own (see HeapAllocator::Alloc)
+    H::HeapAllocator *m_large_objects;
+    // Incremental sweep in progress, if any
+    H::HeapContext *m_sweep_context;
+    H::HeapAllocator *m_sweep_chunk;
+    int m_sweep_slot;
+    // Heap size when idle time last asked JSC to collect
+    size_t m_idle_allocated;
+    // Heap controller (see HeapAllocator::UpdateAllocationLimit()): what survived the last
+    // collection, what has been allocated since, the heap size at which Alloc() schedules the
+    // next one, and how many it has scheduled
+    size_t m_gc_live_bytes;
+    size_t m_gc_allocated_since;
+    size_t m_gc_limit;
+    int m_gc_scheduled;
 
     v8::FatalErrorCallback m_fatal_error_callback;
     v8::CounterLookupCallback m_counter_lookup_callback;
@@ -179,13 +285,21 @@ struct IsolateImpl {
     bool m_pending_epilogue;
     int m_in_gc;
     std::vector<SecondPassCallback> m_second_pass_callbacks;
-    std::map<JSValueRef, v8::Persistent<v8::WeakExternalString>> m_external_strings;
-    std::map<JSStringRef, v8::Persistent<v8::String>*> m_internalized_strings;
+    std::unordered_map<JSValueRef, V82JSC::ExternalString> m_external_strings;
+    std::unordered_map<JSObjectRef, V82JSC::TrackedObjectAlias> m_tracked_objects;
+    std::vector<V82JSC::ExternalStringFinalizer*> m_released_external_strings;
+    int m_polled_external_strings;
+    V82JSC::InternalizedStrings m_internalized_strings;
     
     std::recursive_mutex *m_locker;
     static std::atomic<bool> s_isLockerActive;
     std::atomic<int> m_locks;
     std::thread::id m_owner;
+    // Until a second thread locks the isolate, the first thread to lock it skips the mutex.
+    // m_elided_locks counts the (outermost) locks that first thread holds without it.
+    std::atomic<std::thread::id> m_exclusive_thread;
+    std::atomic<bool> m_multithreaded;
+    std::atomic<int> m_elided_locks;
     
     std::mutex m_isolate_lock;
     std::mutex m_handlewalk_lock;
@@ -199,7 +313,9 @@ struct IsolateImpl {
         
         v8::TryCatch *m_handlers;
         std::stack<v8::Local<v8::Script>> m_running_scripts;
-        std::stack<v8::Persistent<v8::Context, v8::CopyablePersistentTraits<v8::Context>>> m_context_stack;
+        // Entered contexts, innermost last.  Marked (and forwarded) along with the local handles,
+        // so that entering one costs no global handle.
+        std::vector<H::Context*> m_context_stack;
         int m_callback_depth;
         v8::internal::Object *m_scheduled_exception;
         JSValueRef m_verbose_exception;
@@ -209,17 +325,32 @@ struct IsolateImpl {
         ~PerIsolateThreadData();
     };
     
+    // Each thread's data is registered in s_thread_data once, for the GC and Dispose() to
+    // walk, and is otherwise reached through a thread_local pointer.  The last isolate's data
+    // is cached as well, so that the common case takes no lock at all.  Dispose() clears the
+    // cache on every thread before the isolate's data goes away.
     struct PerThreadData
     {
-        PerThreadData() {}
+        PerThreadData() : m_last_isolate(nullptr), m_last_data(nullptr) {}
         std::vector<v8::Isolate*> m_entered_isolates;
         std::map<IsolateImpl*, PerIsolateThreadData*> m_isolate_data;
         std::mutex m_mutex;
+        std::atomic<IsolateImpl*> m_last_isolate;
+        PerIsolateThreadData* m_last_data;
+        size_t m_thread_hash;
 
-        static PerThreadData* Get();
+        static thread_local PerThreadData* t_current;
+
+        static PerThreadData* Get()
+        {
+            return t_current ? t_current : Register();
+        }
         static PerIsolateThreadData* Get(IsolateImpl* iso)
         {
             PerThreadData* data = Get();
+            if (data->m_last_isolate.load(std::memory_order_acquire) == iso) {
+                return data->m_last_data;
+            }
             std::unique_lock<std::mutex> lock(data->m_mutex);
             if (data->m_isolate_data.count(iso) == 0) {
                 auto periso = new PerIsolateThreadData();
@@ -228,9 +359,13 @@ struct IsolateImpl {
                 data->m_isolate_data[iso] = periso;
             }
             auto periso = data->m_isolate_data[iso];
+            data->m_last_data = periso;
+            data->m_last_isolate.store(iso, std::memory_order_release);
             return periso;
         }
         static void EnterThreadContext(v8::Isolate *isolate);
+    private:
+        static PerThreadData* Register();
     };
     std::atomic<size_t> m_current_thread_hash;
     PerIsolateThreadData *m_current_thread_context;
@@ -246,23 +381,46 @@ struct IsolateImpl {
     std::mutex m_pending_interrupt_mutex;
     std::vector<PendingInterrupt> m_pending_interrupts;
     std::atomic<bool> m_terminate_execution;
+    // Serializes ResetWatchdog() for an isolate with a group of its own
+    std::mutex m_watchdog_mutex;
+    
+    // The CPU profiler that is recording, if any.  While it is, the watchdog fires at
+    // m_watchdog_interval (seconds) and samples the stack; otherwise it only fires for interrupts.
+    V82JSC::CpuProfiler *m_cpu_profiler;
+    double m_watchdog_interval;
+
+    // Backing stores owned by ArrayBuffers (not externalized), and the start of the block
+    // Heap::external_memory_ counts from (see Heap::SetUp)
+    std::atomic<size_t> m_array_buffer_bytes;
+    uint64_t m_external_memory_base;
+    size_t m_peak_malloced_memory;
     
     bool m_should_optimize_for_memory_usage;
     
+    // Microtasks hold no handles, so the queue can be moved around freely.  A JS function is
+    // protected until it has run; 'm_is_v8' says whether to call it through the V8 API or straight
+    // through JSC.
     struct EnqueuedMicrotask {
-        EnqueuedMicrotask(v8::Isolate* isolate, Local<Function> callback) {
-            m_callback.Reset(isolate, callback);
+        EnqueuedMicrotask(JSContextRef ctx, JSObjectRef function, bool is_v8) {
             m_native_callback = nullptr;
             m_data = nullptr;
+            m_ctx = JSContextGetGlobalContext(ctx);
+            m_function = function;
+            m_is_v8 = is_v8;
+            JSValueProtect(m_ctx, m_function);
         }
         EnqueuedMicrotask(MicrotaskCallback callback, void* data) {
-            m_callback.Reset();
             m_native_callback = callback;
             m_data = data;
+            m_ctx = nullptr;
+            m_function = nullptr;
+            m_is_v8 = false;
         }
         v8::MicrotaskCallback m_native_callback;
         void *m_data;
-        v8::Persistent<v8::Function, v8::CopyablePersistentTraits<v8::Function>> m_callback;
+        JSGlobalContextRef m_ctx;
+        JSObjectRef m_function;
+        bool m_is_v8;
     };
     std::vector<EnqueuedMicrotask> m_microtask_queue;
     bool m_running_microtasks;
@@ -284,16 +442,49 @@ struct IsolateImpl {
     void EnterContext(v8::Local<v8::Context> ctx);
     void ExitContext(v8::Local<v8::Context> ctx);
     void GetActiveLocalHandles(H::HeapContext&);
+    void ForwardLocalHandles(const H::Forwarding&);
     void CollectGarbage();
+    // Collects at the next microtask checkpoint, or in idle time if that comes first
+    void ScheduleGarbageCollection();
     void TriggerGCPrologue();
     void TriggerGCFirstPassPhantomCallbacks();
     void TriggerGCEpilogue();
-    void CollectExternalStrings();
     static bool PollForInterrupts(JSContextRef ctx, void* context);
+    static bool OnWatchdog(JSContextRef ctx, void* context);
+    // The group's execution time limit is the watchdog.  Always set it through these, since
+    // a shared group has one watchdog for all of its isolates.
+    void SetWatchdog(double limit);
+    void ResetWatchdog();
+
+    /*
+     * Shared context groups.  While on, isolates created from then on all live in one JSC
+     * context group, and so one VM and one heap, instead of each getting its own.  They keep
+     * their own contexts but are serialized on one lock.  Saves a VM per isolate, at the cost
+     * of isolation: a collection started by one isolate pauses all of them, and the heap
+     * limits of one are the limits of all.
+     */
+    static void ShareContextGroups(bool share);
+
+    /*
+     * Trusted mode.  Isolates created while on never put objects behind the proxies that
+     * enforce security tokens and access checks between contexts: SecureValue() hands values
+     * through as they are.  For isolates whose contexts all trust each other, which is the
+     * usual one node context per isolate, it takes the proxy checks off every cross-context
+     * access and off the global object.  Access check callbacks are then never called.
+     */
+    static void SetTrustedMode(bool trusted);
+
+    /*
+     * Allocation counters for each of the types reported by GetHeapObjectStatisticsAtLastGC,
+     * indexed the same way.  Unlike the live counts there, these only ever go up, so sampling
+     * them twice shows what was allocated in between, even if it has since been collected.
+     */
+    bool GetHeapObjectAllocations(size_t type_index, uint64_t *allocations, uint64_t *bytes);
     
     internal::IncrementalMarking incremental_marking_;
     
     v8::internal::GetGlobalHandles getGlobalHandles;
+    v8::internal::ForwardGlobalHandles forwardGlobalHandles;
     v8::internal::WeakObjectNearDeath weakObjectNearDeath;
     v8::internal::WeakHeapObjectFinalized weakHeapObjectFinalized;
     v8::internal::WeakJSObjectFinalized weakJSObjectFinalized;
@@ -31,6 +31,8 @@
 #include <JavaScriptCore/JavaScriptCore.h>
 #include <JavaScriptCore/runtime/JSLock.h>
 #include <JavaScriptCore/runtime/VM.h>
+#include <JavaScriptCore/API/OpaqueJSString.h>
+#include <wtf/text/ExternalStringImpl.h>
 
 #else
 #include "V82JSC.h"
@@ -133,17 +135,59 @@ void JSCPrivate::PrintCurrentThread()
     printf ("Current: %x\n", thread->machThread());
 }
 
+JSStringRef JSCPrivate::JSStringCreateExternal(const void *chars, size_t length, bool is_one_byte,
+                                               JSStringFinalizer finalizer, void *userData)
+{
+    auto release = [finalizer, userData](WTF::ExternalStringImpl*, void*, unsigned) {
+        finalizer(userData);
+    };
+    if (is_one_byte) {
+        return OpaqueJSString::tryCreate(String(WTF::ExternalStringImpl::create(
+            static_cast<const LChar*>(chars), static_cast<unsigned>(length), WTFMove(release)))).leakRef();
+    }
+    return OpaqueJSString::tryCreate(String(WTF::ExternalStringImpl::create(
+        static_cast<const UChar*>(chars), static_cast<unsigned>(length), WTFMove(release)))).leakRef();
+}
+
+bool JSCPrivate::JSContextGroupGetHeapStatistics(JSContextGroupRef g, JSHeapStatistics *statistics)
+{
+    JSC::VM* vm = toJS(g);
+    JSC::JSLockHolder lock(vm);
+    statistics->size = vm->heap.size();
+    statistics->capacity = vm->heap.capacity();
+    statistics->extra_memory_size = vm->heap.extraMemorySize();
+    statistics->object_count = vm->heap.objectCount();
+    return true;
+}
+
 #else // USE_JAVASCRIPTCORE_INTERNALS
 
 void * JSCPrivate::LockJSC(IsolateImpl* iso, JSContextGroupRef g)
 {
-    if (iso->m_locker == nullptr) {
-        iso->m_locker = new std::recursive_mutex();
-        iso->m_locks = 0;
+    std::thread::id self = std::this_thread::get_id();
+    if (!iso->m_multithreaded) {
+        std::thread::id none;
+        if (iso->m_exclusive_thread == self || iso->m_exclusive_thread.compare_exchange_strong(none, self)) {
+            ++ iso->m_elided_locks;
+            if (!iso->m_multithreaded) {
+                iso->m_locks ++;
+                iso->m_owner = self;
+                return iso;
+            }
+            // Lost a race with a second thread.  Take the real lock instead.
+            -- iso->m_elided_locks;
+        } else {
+            // A second thread is here, so from now on everyone takes the real lock.  Wait for the
+            // first thread to release any locks it holds without the mutex.
+            iso->m_multithreaded = true;
+            while (iso->m_elided_locks != 0) {
+                std::this_thread::yield();
+            }
+        }
     }
     iso->m_locker->lock();
     iso->m_locks ++;
-    iso->m_owner = std::this_thread::get_id();
+    iso->m_owner = self;
     return iso;
 }
 
@@ -152,7 +196,12 @@ IsolateImpl* JSCPrivate::UnlockJSC(void* token)
     IsolateImpl* iso = (IsolateImpl*) token;
     int locks = -- iso->m_locks;
     if (locks == 0) iso->m_owner = std::thread::id();
-    iso->m_locker->unlock();
+    if (locks < iso->m_elided_locks) {
+        // Elided locks are always the outermost ones
+        -- iso->m_elided_locks;
+    } else {
+        iso->m_locker->unlock();
+    }
     return iso;
 }
 
@@ -170,11 +219,8 @@ void * JSCPrivate::UnlockAllJSCLocks(IsolateImpl* iso, JSContextGroupRef g)
         drop->depth_ = 0;
     } else {
         drop->depth_ = iso->m_locks;
-        iso->m_owner = std::thread::id();
-        int locks = iso->m_locks;
-        for (int i=0; i<locks; i++) {
-            iso->m_locks --;
-            iso->m_locker->unlock();
+        for (int i=0; i<drop->depth_; i++) {
+            UnlockJSC(iso);
         }
     }
     return drop;
@@ -184,22 +230,21 @@ IsolateImpl* JSCPrivate::ReinstateAllJSCLocks(void *token)
 {
     DropLocks *drop = (DropLocks*)token;
     
+    IsolateImpl* iso = drop->iso_;
     for (int i=0; i<drop->depth_; i++) {
-        drop->iso_->m_locker->lock();
-        drop->iso_->m_locks ++;
+        LockJSC(iso, iso->m_group);
     }
-    IsolateImpl* iso = drop->iso_;
-    iso->m_owner = std::this_thread::get_id();
     delete drop;
     return iso;
 }
 
 bool JSCPrivate::HasLock(IsolateImpl* iso, JSContextGroupRef g)
 {
+    if (iso->m_elided_locks != 0 && iso->m_exclusive_thread == std::this_thread::get_id()) return true;
     if (iso->m_locker==nullptr) return false;
     bool have_locked = iso->m_locker->try_lock();
     if (have_locked) {
-        bool locked_by_this_thread = (iso->m_locks != 0);
+        bool locked_by_this_thread = (iso->m_locks > iso->m_elided_locks);
         iso->m_locker->unlock();
         return locked_by_this_thread;
     }
@@ -224,6 +269,20 @@ void JSCPrivate::PrintCurrentThread()
     printf ("Current: %x\n", (unsigned)hash);
 }
 
+JSStringRef JSCPrivate::JSStringCreateExternal(const void *chars, size_t length, bool is_one_byte,
+                                               JSStringFinalizer finalizer, void *userData)
+{
+    // The public API has no way to tell us when JSC lets go of the characters
+    return nullptr;
+}
+
+bool JSCPrivate::JSContextGroupGetHeapStatistics(JSContextGroupRef g, JSHeapStatistics *statistics)
+{
+    // JSC's heap is opaque without internals
+    memset(statistics, 0, sizeof(JSHeapStatistics));
+    return false;
+}
+
 #endif
 
 #ifdef USE_JAVASCRIPTCORE_PRIVATE_API
@@ -36,7 +36,14 @@ namespace JSCPrivate {
     typedef void (*JSMarkingConstraint)(JSMarkerRef, void *userData);
     typedef void (*JSHeapFinalizer)(JSContextGroupRef, void *userData);
     typedef bool (*JSShouldTerminateCallback) (JSContextRef ctx, void* context);
+    typedef void (*JSStringFinalizer)(void *userData);
 
+    struct JSHeapStatistics {
+        size_t size;
+        size_t capacity;
+        size_t extra_memory_size;
+        size_t object_count;
+    };
     typedef const void* JSWeakRef;
     typedef void* JSScriptRef;
 
@@ -56,6 +63,11 @@ namespace JSCPrivate {
     void JSContextGroupAddHeapFinalizer(JSContextGroupRef, JSHeapFinalizer, v8::internal::IsolateImpl *userData);
     void JSContextGroupRemoveHeapFinalizer(JSContextGroupRef, JSHeapFinalizer, v8::internal::IsolateImpl *userData);
     void JSSynchronousGarbageCollectForDebugging(JSContextRef);
+    // Returns nullptr if JSC cannot use the characters in place
+    JSStringRef JSStringCreateExternal(const void *chars, size_t length, bool is_one_byte,
+                                       JSStringFinalizer finalizer, void *userData);
+    // Returns false if JSC's heap cannot be inspected; the statistics are zeroed
+    bool JSContextGroupGetHeapStatistics(JSContextGroupRef group, JSHeapStatistics *statistics);
 };
 
 
@@ -11,6 +11,25 @@ using v8::MaybeLocal;
 using v8::Local;
 using v8::JSON;
 
+// JSValueCreateJSONString() only takes a number of spaces, so anything else must go through JS
+static bool GapAsIndent(JSContextRef ctx, JSValueRef gap, unsigned *indent)
+{
+    *indent = 0;
+    if (!JSValueIsString(ctx, gap)) {
+        return JSValueIsUndefined(ctx, gap);
+    }
+    JSStringRef s = JSValueToStringCopy(ctx, gap, nullptr);
+    size_t length = JSStringGetLength(s);
+    const JSChar *chars = JSStringGetCharactersPtr(s);
+    bool spaces = length <= 10;
+    for (size_t i=0; spaces && i<length; i++) {
+        spaces = chars[i] == ' ';
+    }
+    JSStringRelease(s);
+    if (spaces) *indent = (unsigned) length;
+    return spaces;
+}
+
 /**
  * Tries to parse the string |json_string| and returns it as value if
  * successful.
@@ -24,7 +43,13 @@ MaybeLocal<v8::Value> JSON::Parse(Local<Context> context, Local<String> json_str
     JSValueRef string = ToJSValueRef(json_string, context);
     
     LocalException exception(ToIsolateImpl(ToContextImpl(context)));
-    JSValueRef value = exec(ctx, "return JSON.parse(_1)", 1, &string, &exception);
+    JSStringRef s = JSValueToStringCopy(ctx, string, &exception);
+    JSValueRef value = s ? JSValueMakeFromJSONString(ctx, s) : nullptr;
+    if (s) JSStringRelease(s);
+    if (!value && !exception.ShouldThrow()) {
+        // JSC doesn't tell us why it failed, so let JSON.parse() throw the SyntaxError
+        value = exec(ctx, "return JSON.parse(_1)", 1, &string, &exception);
+    }
     if (exception.ShouldThrow()) {
         return MaybeLocal<Value>();
     }
@@ -45,11 +70,23 @@ MaybeLocal<v8::String> JSON::Stringify(Local<Context> context, Local<Object> jso
     
     JSValueRef args[] = {
         ToJSValueRef(json_object, context),
-        ToJSValueRef(gap, context)
+        gap.IsEmpty() ? JSValueMakeUndefined(ctx) : ToJSValueRef(gap, context)
     };
     
     LocalException exception(ToIsolateImpl(ToContextImpl(context)));
-    JSValueRef value = exec(ctx, "return JSON.stringify(_1, null, _2)", 2, args, &exception);
+    JSValueRef value;
+    unsigned indent;
+    if (GapAsIndent(ctx, args[1], &indent)) {
+        JSStringRef s = JSValueCreateJSONString(ctx, args[0], indent, &exception);
+        if (s) {
+            value = JSValueMakeString(ctx, s);
+            JSStringRelease(s);
+        } else {
+            value = JSValueMakeUndefined(ctx);
+        }
+    } else {
+        value = exec(ctx, "return JSON.stringify(_1, null, _2)", 2, args, &exception);
+    }
     if (exception.ShouldThrow()) {
         return MaybeLocal<String>();
     }
@@ -86,7 +86,7 @@ void v8::Map::Clear()
     Local<Context> context = ToCurrentContext(this);
     JSContextRef ctx = ToContextRef(context);
     JSValueRef obj = ToJSValueRef(this, context);
-    exec(ctx, "_1.clear()", 1, &obj);
+    JSObjectCallAsFunction(ctx, ToIsolateImpl(this)->m_map_clear, (JSObjectRef)obj, 0, nullptr, 0);
 }
 
 MaybeLocal<v8::Value> v8::Map::Get(Local<Context> context, Local<Value> key)
@@ -95,11 +95,8 @@ MaybeLocal<v8::Value> v8::Map::Get(Local<Context> context, Local<Value> key)
     JSContextRef ctx = ToContextRef(context);
     JSValueRef obj = ToJSValueRef(this, context);
     LocalException exception(iso);
-    JSValueRef args[] = {
-        obj,
-        ToJSValueRef(key, context)
-    };
-    JSValueRef r = exec(ctx, "return _1.get(_2)", 2, args, &exception);
+    JSValueRef k = ToJSValueRef(key, context);
+    JSValueRef r = JSObjectCallAsFunction(ctx, iso->m_map_get, (JSObjectRef)obj, 1, &k, &exception);
     if (exception.ShouldThrow()) return MaybeLocal<Value>();
     return V82JSC::Value::New(ToContextImpl(context), r);
 }
@@ -114,11 +111,10 @@ MaybeLocal<v8::Map> v8::Map::Set(Local<v8::Context> context,
     LocalException exception(iso);
     auto impl = ToImpl<V82JSC::Value, Map>(this);
     JSValueRef args[] = {
-        obj,
         ToJSValueRef(key, context),
         ToJSValueRef(value, context)
     };
-    exec(ctx, "_1.set(_2, _3)", 3, args, &exception);
+    JSObjectCallAsFunction(ctx, iso->m_map_set, (JSObjectRef)obj, 2, args, &exception);
     if (exception.ShouldThrow()) return MaybeLocal<Map>();
     return CreateLocal<v8::Map>(ToIsolate(iso), impl);
 }
@@ -129,11 +125,8 @@ Maybe<bool> v8::Map::Has(Local<v8::Context> context, Local<v8::Value> key)
     JSContextRef ctx = ToContextRef(context);
     JSValueRef obj = ToJSValueRef(this, context);
     LocalException exception(iso);
-    JSValueRef args[] = {
-        obj,
-        ToJSValueRef(key, context)
-    };
-    JSValueRef r = exec(ctx, "return _1.has(_2)", 2, args, &exception);
+    JSValueRef k = ToJSValueRef(key, context);
+    JSValueRef r = JSObjectCallAsFunction(ctx, iso->m_map_has, (JSObjectRef)obj, 1, &k, &exception);
     if (exception.ShouldThrow()) return Nothing<bool>();
     return _maybe<bool>(JSValueToBoolean(ctx, r)).toMaybe();
 }
@@ -145,15 +138,44 @@ Maybe<bool> v8::Map::Delete(Local<v8::Context> context,
     JSContextRef ctx = ToContextRef(context);
     JSValueRef obj = ToJSValueRef(this, context);
     LocalException exception(iso);
-    JSValueRef args[] = {
-        obj,
-        ToJSValueRef(key, context)
-    };
-    JSValueRef r = exec(ctx, "return _1.delete(_2)", 2, args, &exception);
+    JSValueRef k = ToJSValueRef(key, context);
+    JSValueRef r = JSObjectCallAsFunction(ctx, iso->m_map_delete, (JSObjectRef)obj, 1, &k, &exception);
     if (exception.ShouldThrow()) return Nothing<bool>();
     return _maybe<bool>(JSValueToBoolean(ctx, r)).toMaybe();
 }
 
+struct CollectionAsArrayState {
+    JSObjectRef m_array;
+    unsigned m_index;
+    bool m_pairs;
+};
+
+JSObjectRef V82JSC::CollectionAsArray(JSContextRef ctx, JSObjectRef collection, JSObjectRef forEach, bool pairs)
+{
+    static JSClassRef collector_class = [] {
+        JSClassDefinition def = kJSClassDefinitionEmpty;
+        def.attributes = kJSClassAttributeNoAutomaticPrototype;
+        def.className = "CollectionAsArray";
+        // forEach calls us back with (value, key, collection)
+        def.callAsFunction = [](JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                                size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception) -> JSValueRef
+        {
+            auto state = reinterpret_cast<CollectionAsArrayState*>(JSObjectGetPrivate(function));
+            if (state->m_pairs) {
+                JSObjectSetPropertyAtIndex(ctx, state->m_array, state->m_index++, arguments[1], 0);
+            }
+            JSObjectSetPropertyAtIndex(ctx, state->m_array, state->m_index++, arguments[0], 0);
+            return JSValueMakeUndefined(ctx);
+        };
+        return JSClassCreate(&def);
+    }();
+
+    CollectionAsArrayState state = { JSObjectMakeArray(ctx, 0, nullptr, 0), 0, pairs };
+    JSValueRef collector = JSObjectMake(ctx, collector_class, &state);
+    JSObjectCallAsFunction(ctx, forEach, collection, 1, &collector, 0);
+    return state.m_array;
+}
+
 /**
  * Returns an array of length Size() * 2, where index N is the Nth key and
  * index N + 1 is the Nth value.
@@ -163,9 +185,8 @@ Local<v8::Array> v8::Map::AsArray() const
     Local<Context> context = ToCurrentContext(this);
     JSContextRef ctx = ToContextRef(context);
     JSValueRef obj = ToJSValueRef(this, context);
-    return V82JSC::Value::New(ToContextImpl(context), exec(ctx,
-            "var r = []; _1.forEach((v,k,m)=>r.push(k,v)); return r",
-            1, &obj)).As<Array>();
+    return V82JSC::Value::New(ToContextImpl(context),
+        CollectionAsArray(ctx, (JSObjectRef)obj, ToIsolateImpl(this)->m_map_for_each, true)).As<Array>();
 }
 
 /**
@@ -28,11 +28,23 @@ Message* Message::New(IsolateImpl* iso,
     Local<v8::Context> context = OperatingContext(ToIsolate(iso));
     auto msgi = static_cast<Message*>(HeapAllocator::Alloc(iso, iso->m_message_map));
     msgi->m_value = exception;
-    JSValueProtect(ToContextRef(context), msgi->m_value);
+    Root(ToContextRef(context), msgi->m_value);
     msgi->m_script.Reset(ToIsolate(iso), script);
     return msgi;
 }
 
+Local<v8::StackTrace> Message::Trace()
+{
+    IsolateImpl * iso = GetIsolate();
+    EscapableHandleScope scope(ToIsolate(iso));
+    
+    if (m_stack_trace.IsEmpty()) {
+        m_stack_trace.Reset(ToIsolate(iso), V82JSC::StackTrace::New(iso, CreateLocal<v8::Value>(&iso->ii, this),
+                                                                    m_script.Get(ToIsolate(iso))));
+    }
+    return scope.Escape(m_stack_trace.Get(ToIsolate(iso)));
+}
+
 void Message::CallHandlers()
 {
     IsolateImpl * iso = GetIsolate();
@@ -137,8 +149,7 @@ Local<v8::Value> v8::Message::GetScriptResourceName() const
     
     auto thread = IsolateImpl::PerThreadData::Get(iso);
 
-    Local<v8::StackTrace> trace = V82JSC::StackTrace::New(iso, CreateLocal<Value>(&iso->ii,impl),
-                                                  impl->m_script.Get(ToIsolate(iso)));
+    Local<v8::StackTrace> trace = impl->Trace();
     if (trace->GetFrameCount()) {
         Local<String> name = trace->GetFrame(0)->GetScriptName();
         if (!name.IsEmpty() && name->Equals(OperatingContext(isolate),
@@ -173,8 +184,7 @@ Local<v8::StackTrace> v8::Message::GetStackTrace() const
     EscapableHandleScope scope(ToIsolate(iso));
 
     if (iso->m_capture_stack_trace_for_uncaught_exceptions) {
-        return scope.Escape(V82JSC::StackTrace::New(iso, CreateLocal<Value>(&iso->ii, message),
-                                   message->m_script.Get(ToIsolate(iso))));
+        return scope.Escape(message->Trace());
     } else {
         return Local<StackTrace>();
     }
@@ -189,8 +199,7 @@ Maybe<int> v8::Message::GetLineNumber(Local<Context> context) const
     auto iso = impl->GetIsolate();
     HandleScope scope(ToIsolate(iso));
     
-    Local<StackTrace> trace = V82JSC::StackTrace::New(iso, CreateLocal<Value>(&iso->ii, impl),
-                                                  impl->m_script.Get(ToIsolate(iso)));
+    Local<StackTrace> trace = impl->Trace();
     if (trace->GetFrameCount()) {
         return _maybe<int>(trace->GetFrame(0)->GetLineNumber()).toMaybe();
     }
@@ -238,8 +247,7 @@ Maybe<int> v8::Message::GetStartColumn(Local<v8::Context> context) const
     auto iso = impl->GetIsolate();
     HandleScope scope(ToIsolate(iso));
     
-    Local<StackTrace> trace = V82JSC::StackTrace::New(iso, CreateLocal<Value>(&iso->ii, impl),
-                                                  impl->m_script.Get(ToIsolate(iso)));
+    Local<StackTrace> trace = impl->Trace();
     if (trace->GetFrameCount()) {
         return _maybe<int>(trace->GetFrame(0)->GetColumn()).toMaybe();
     }
@@ -256,8 +264,7 @@ Maybe<int> v8::Message::GetEndColumn(Local<v8::Context> context) const
     auto iso = impl->GetIsolate();
     HandleScope scope(ToIsolate(iso));
     
-    Local<StackTrace> trace = V82JSC::StackTrace::New(iso, CreateLocal<Value>(&iso->ii, impl),
-                                                  impl->m_script.Get(ToIsolate(iso)));
+    Local<StackTrace> trace = impl->Trace();
     if (trace->GetFrameCount()) {
         return _maybe<int>(trace->GetFrame(0)->GetColumn()).toMaybe();
     }
@@ -406,6 +413,36 @@ v8::Local<v8::StackTrace> StackTrace::New(IsolateImpl* iso, Local<v8::Value> val
     Local<v8::Context> context = OperatingContext(ToIsolate(iso));
     JSValueRef v = ToJSValueRef(value, context);
 
+    auto stack_trace = static_cast<StackTrace*>(
+               HeapAllocator::Alloc(iso, iso->m_stack_trace_map));
+    stack_trace->m_error = (JSObjectRef) v;
+    JSValueProtect(ctx, stack_trace->m_error);
+    stack_trace->m_script.Reset(ToIsolate(iso), script);
+    Local<v8::StackTrace> local = CreateLocal<v8::StackTrace>(&iso->ii, stack_trace);
+
+    // Only grab the raw stack string here.  It is not parsed until someone asks for frames.
+    if (v && value->IsNativeError()) {
+        JSStringRef stack_ = JSStringCreateWithUTF8CString("stack");
+        stack_trace->m_stack = JSObjectGetProperty(ctx, stack_trace->m_error, stack_, 0);
+        JSStringRelease(stack_);
+    } else {
+        JSStringRef s = JSStringCreateWithUTF8CString("");
+        stack_trace->m_stack = JSValueMakeString(ctx, s);
+        JSStringRelease(s);
+    }
+    JSValueProtect(ctx, stack_trace->m_stack);
+
+    return scope.Escape(local);
+}
+
+JSObjectRef StackTrace::Frames()
+{
+    if (m_stack_frame_array) return m_stack_frame_array;
+    
+    IsolateImpl *iso = GetIsolate();
+    HandleScope scope(ToIsolate(iso));
+    JSContextRef ctx = ToContextRef(ToIsolate(iso));
+
     const char *parse_error_frames =
     "var frames = _1.split('\\n'); "
     "var frame_array = []; "
@@ -427,47 +464,12 @@ v8::Local<v8::StackTrace> StackTrace::New(IsolateImpl* iso, Local<v8::Value> val
     "} "
     "return frame_array;";
     
-    auto stack_trace = static_cast<StackTrace*>(
-               HeapAllocator::Alloc(iso, iso->m_stack_trace_map));
-    stack_trace->m_error = (JSObjectRef) v;
-    JSValueProtect(ctx, stack_trace->m_error);
-    stack_trace->m_script.Reset(ToIsolate(iso), script);
-    Local<v8::StackTrace> local = CreateLocal<v8::StackTrace>(&iso->ii, stack_trace);
+    m_stack_frame_array = (JSObjectRef) exec(ctx, parse_error_frames, 1, &m_stack);
+    JSValueProtect(ctx, m_stack_frame_array);
+    JSValueUnprotect(ctx, m_stack);
+    m_stack = 0;
 
-    JSValueRef stack;
-    if (v && value->IsNativeError()) {
-        JSStringRef stack_ = JSStringCreateWithUTF8CString("stack");
-        stack = JSObjectGetProperty(ctx, stack_trace->m_error, stack_, 0);
-        JSStringRelease(stack_);
-    } else {
-        JSStringRef s = JSStringCreateWithUTF8CString("");
-        stack = JSValueMakeString(ctx, s);
-        JSStringRelease(s);
-    }
-    
-    stack_trace->m_stack_frame_array = (JSObjectRef) exec(ctx, parse_error_frames, 1, &stack);
-    JSValueProtect(ctx, stack_trace->m_stack_frame_array);
-
-    /*
-    JSValueRef s = exec(ctx, "return JSON.stringify(_1)", 1, &stack_trace->m_stack_frame_array);
-    JSStringRef ss = JSValueToStringCopy(ctx, s, 0);
-    char foo[JSStringGetMaximumUTF8CStringSize(ss)];
-    JSStringGetUTF8CString(ss, foo, JSStringGetMaximumUTF8CStringSize(ss));
-    printf ("Captured stack = %s\n", foo);
-
-    JSStringRef stacks = JSValueToStringCopy(ctx, stack, 0);
-    char bar[JSStringGetMaximumUTF8CStringSize(stacks)];
-    JSStringGetUTF8CString(stacks, bar, JSStringGetMaximumUTF8CStringSize(stacks));
-    printf (".stack = %s\n", bar);
-
-    if (back_trace) {
-        char mutt[JSStringGetMaximumUTF8CStringSize(back_trace)];
-        JSStringGetUTF8CString(back_trace, mutt, JSStringGetMaximumUTF8CStringSize(back_trace));
-        printf ("back_trace = %s\n", mutt);
-    }
-    */
-
-    return scope.Escape(local);
+    return m_stack_frame_array;
 }
 
 Local<v8::StackFrame> v8::StackTrace::GetFrame(uint32_t index) const
@@ -479,8 +481,8 @@ Local<v8::StackFrame> v8::StackTrace::GetFrame(uint32_t index) const
     Local<Context> context = OperatingContext(ToIsolate(iso));
     JSContextRef ctx = ToContextRef(context);
     
-    if (impl->m_stack_frame_array) {
-        Local<Array> stack_frames = V82JSC::Value::New(ToContextImpl(context), impl->m_stack_frame_array).As<Array>();
+    if (impl->Frames()) {
+        Local<Array> stack_frames = V82JSC::Value::New(ToContextImpl(context), impl->Frames()).As<Array>();
         if (index < stack_frames->Length()) {
             Local<Value> frame = stack_frames->Get(context, index).ToLocalChecked();
             JSObjectRef array = (JSObjectRef) ToJSValueRef(frame, context);
@@ -522,8 +524,8 @@ int v8::StackTrace::GetFrameCount() const
     HandleScope scope(ToIsolate(impl->GetIsolate()));
     Local<Context> context = OperatingContext(ToIsolate(impl->GetIsolate()));
 
-    if (impl->m_stack_frame_array) {
-        Local<Array> stack_frames = V82JSC::Value::New(ToContextImpl(context), impl->m_stack_frame_array).As<Array>();
+    if (impl->Frames()) {
+        Local<Array> stack_frames = V82JSC::Value::New(ToContextImpl(context), impl->Frames()).As<Array>();
         return stack_frames->Length();
     }
     
@@ -13,29 +13,35 @@ namespace V82JSC {
 
 struct Message : Value {
     v8::Persistent<v8::Script> m_script;
+    v8::Persistent<v8::StackTrace> m_stack_trace;
     
     static void Constructor(Message *obj) {}
     static int Destructor(HeapContext& context, Message *obj)
     {
         int freed=0;
         freed += SmartReset<v8::Script>(context, obj->m_script);
+        freed += SmartReset<v8::StackTrace>(context, obj->m_stack_trace);
         return freed + Value::Destructor(context, obj);
     }
     
     static Message* New(IsolateImpl* iso, JSValueRef exception,
                         v8::Local<v8::Script> script);
     void CallHandlers();
+    // The trace is created the first time any location info is requested and then shared
+    v8::Local<v8::StackTrace> Trace();
 };
     
 struct StackTrace : HeapObject {
     v8::Persistent<v8::Script> m_script;
     JSObjectRef m_error;
+    JSValueRef m_stack;
     JSObjectRef m_stack_frame_array;
     
     static void Constructor(StackTrace *obj) {}
     static int Destructor(HeapContext& context, StackTrace *obj)
     {
         if (obj->m_error) JSValueUnprotect(obj->GetNullContext(), obj->m_error);
+        if (obj->m_stack) JSValueUnprotect(obj->GetNullContext(), obj->m_stack);
         if (obj->m_stack_frame_array) JSValueUnprotect(obj->GetNullContext(), obj->m_stack_frame_array);
         int freed=0;
         freed += SmartReset<v8::Script>(context, obj->m_script);
@@ -45,6 +51,8 @@ struct StackTrace : HeapObject {
     static v8::Local<v8::StackTrace> New(IsolateImpl* iso,
                                          v8::Local<v8::Value> error,
                                          v8::Local<v8::Script> script);
+    // Parses the raw stack string into frames on first use
+    JSObjectRef Frames();
 };
 
 struct StackFrame : HeapObject {
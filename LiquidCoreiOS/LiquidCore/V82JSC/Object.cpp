@@ -19,6 +19,25 @@ using v8::Isolate;
 using v8::Object;
 using v8::TryCatch;
 
+// Almost all property keys are strings or array indices, which the JSC C API handles directly without
+// the cost of calling a JS helper through exec().  Anything else (symbols, mostly) falls back to exec().
+enum SimpleKey { kNotSimple, kNamedKey, kIndexedKey };
+static SimpleKey ToSimpleKey(JSContextRef ctx, JSValueRef key, JSStringRef& name, unsigned& index)
+{
+    if (JSValueIsString(ctx, key)) {
+        name = JSValueToStringCopy(ctx, key, nullptr);
+        return kNamedKey;
+    }
+    if (JSValueIsNumber(ctx, key)) {
+        double d = JSValueToNumber(ctx, key, nullptr);
+        if (d >= 0 && d < 4294967295.0 && d == (double)(unsigned) d) {
+            index = (unsigned) d;
+            return kIndexedKey;
+        }
+    }
+    return kNotSimple;
+}
+
 Maybe<bool> Object::Set(Local<Context> context, Local<Value> key, Local<Value> value)
 {
     JSContextRef ctx = ToContextRef(context);
@@ -37,11 +56,25 @@ Maybe<bool> Object::Set(Local<Context> context, Local<Value> key, Local<Value> v
         ToJSValueRef(value, context)
     };
     
-    JSValueRef ret = exec(ctx, "return _3 == (_1[_2] = _3)", 3, args, &exception);
-    
     _maybe<bool> out;
-    if (!exception.ShouldThrow()) {
-        out.value_ = JSValueToBoolean(ctx, ret);
+    JSStringRef name;
+    unsigned index;
+    switch (ToSimpleKey(ctx, args[1], name, index)) {
+        case kNamedKey:
+            JSObjectSetProperty(ctx, (JSObjectRef)args[0], name, args[2], kJSPropertyAttributeNone, &exception);
+            JSStringRelease(name);
+            out.value_ = true;
+            break;
+        case kIndexedKey:
+            JSObjectSetPropertyAtIndex(ctx, (JSObjectRef)args[0], index, args[2], &exception);
+            out.value_ = true;
+            break;
+        default: {
+            JSValueRef ret = exec(ctx, "return _3 == (_1[_2] = _3)", 3, args, &exception);
+            if (!exception.ShouldThrow()) {
+                out.value_ = JSValueToBoolean(ctx, ret);
+            }
+        }
     }
     out.has_value_ = !exception.ShouldThrow();
     
@@ -262,7 +295,20 @@ MaybeLocal<v8::Value> Object::Get(Local<Context> context, Local<Value> key)
         ToJSValueRef(key, context)
     };
     
-    JSValueRef ret = exec(ctx, "return Reflect.get(_1,_2)", 2, args, &exception);
+    JSValueRef ret;
+    JSStringRef name;
+    unsigned index;
+    switch (ToSimpleKey(ctx, args[1], name, index)) {
+        case kNamedKey:
+            ret = JSObjectGetProperty(ctx, (JSObjectRef)args[0], name, &exception);
+            JSStringRelease(name);
+            break;
+        case kIndexedKey:
+            ret = JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)args[0], index, &exception);
+            break;
+        default:
+            ret = exec(ctx, "return Reflect.get(_1,_2)", 2, args, &exception);
+    }
     
     if (!exception.ShouldThrow()) {
         return scope.Escape(V82JSC::Value::New(ToContextImpl(context), ret));
@@ -391,11 +437,17 @@ Maybe<bool> Object::Has(Local<Context> context, Local<Value> key)
         ToJSValueRef(key, context)
     };
     
-    JSValueRef ret = exec(ctx, "return (_2 in _1)", 2, args, &exception);
-    
     _maybe<bool> out;
-    if (!exception.ShouldThrow()) {
-        out.value_ = JSValueToBoolean(ctx, ret);
+    JSStringRef name;
+    unsigned index;
+    if (ToSimpleKey(ctx, args[1], name, index) == kNamedKey) {
+        out.value_ = JSObjectHasProperty(ctx, (JSObjectRef)args[0], name);
+        JSStringRelease(name);
+    } else {
+        JSValueRef ret = exec(ctx, "return (_2 in _1)", 2, args, &exception);
+        if (!exception.ShouldThrow()) {
+            out.value_ = JSValueToBoolean(ctx, ret);
+        }
     }
     out.has_value_ = !exception.ShouldThrow();
     
@@ -418,11 +470,17 @@ Maybe<bool> Object::Delete(Local<Context> context, Local<Value> key)
         ToJSValueRef(key, context)
     };
 
-    JSValueRef ret = exec(ctx, "return delete _1[_2]", 2, args, &exception);
-
     _maybe<bool> out;
-    if (!exception.ShouldThrow()) {
-        out.value_ = JSValueToBoolean(ctx, ret);
+    JSStringRef name;
+    unsigned index;
+    if (ToSimpleKey(ctx, args[1], name, index) == kNamedKey) {
+        out.value_ = JSObjectDeleteProperty(ctx, (JSObjectRef)args[0], name, &exception);
+        JSStringRelease(name);
+    } else {
+        JSValueRef ret = exec(ctx, "return delete _1[_2]", 2, args, &exception);
+        if (!exception.ShouldThrow()) {
+            out.value_ = JSValueToBoolean(ctx, ret);
+        }
     }
     out.has_value_ = !exception.ShouldThrow();
     
@@ -1246,8 +1304,6 @@ int Object::InternalFieldCount()
         // ArrayBufferViews have internal fields by default.  This was created in JS.
         wrap = V82JSC::TrackedObject::makePrivateInstance(ToIsolateImpl(this), ToContextRef(context), obj);
         wrap->m_num_internal_fields = ArrayBufferView::kInternalFieldCount;
-        wrap->m_internal_fields_array = JSObjectMakeArray(ToContextRef(context), 0, nullptr, 0);
-        JSValueProtect(ToContextRef(context), wrap->m_internal_fields_array);
     }
     return wrap ? wrap->m_num_internal_fields : 0;
 }
@@ -1266,11 +1322,9 @@ void Object::SetInternalField(int index, Local<Value> value)
         // ArrayBuffers have internal fields by default.  This was created in JS.
         wrap = V82JSC::TrackedObject::makePrivateInstance(ToIsolateImpl(this), ctx, obj);
         wrap->m_num_internal_fields = ArrayBufferView::kInternalFieldCount;
-        wrap->m_internal_fields_array = JSObjectMakeArray(ToContextRef(context), 0, nullptr, 0);
-        JSValueProtect(ctx, wrap->m_internal_fields_array);
     }
     if (wrap && index < wrap->m_num_internal_fields) {
-        JSObjectSetPropertyAtIndex(ctx, wrap->m_internal_fields_array, index, ToJSValueRef(value, context), 0);
+        wrap->InternalFields()->m_elements[index] = *reinterpret_cast<v8::internal::Object**>(*value);
     }
 }
 
@@ -1287,13 +1341,14 @@ void Object::SetAlignedPointerInInternalField(int index, void* value)
     JSContextRef ctx = ToContextRef(context);
     JSObjectRef obj = (JSObjectRef) ToJSValueRef(this, context);
     
+    auto wrap = V82JSC::TrackedObject::getPrivateInstance(ctx, obj);
+    if (!wrap) return;
     if (index < 2) {
-        auto wrap = V82JSC::TrackedObject::getPrivateInstance(ctx, obj);
-        if (wrap) {
-            wrap->m_embedder_data[index] = value;
-        }
-    } else {
-        SetInternalField(index, External::New(context->GetIsolate(), value));
+        // Where weak callbacks find them
+        wrap->m_embedder_data[index] = value;
+    } else if (index < wrap->m_num_internal_fields) {
+        assert((reinterpret_cast<intptr_t>(value) & v8::internal::kHeapObjectTagMask) == 0);
+        wrap->InternalFields()->m_elements[index] = reinterpret_cast<v8::internal::Object*>(value);
     }
 }
 void Object::SetAlignedPointerInInternalFields(int argc, int indices[],
@@ -1367,6 +1422,7 @@ Maybe<bool> Object::HasRealNamedProperty(Local<Context> context, Local<Name> key
     if (wrap && wrap->m_proxy_security) {
         raw_object = (JSObjectRef) wrap->m_security;
     }
+    V82JSC::SuspendNativeInterceptorsScope interceptors_scope(wrap);
 
     Local<Value> thiz = V82JSC::TrackedObject::SecureValue
     (V82JSC::Value::New(ToContextImpl(context), raw_object));
@@ -1453,6 +1509,7 @@ MaybeLocal<v8::Value> Object::GetRealNamedProperty(Local<Context> context, Local
     if (wrap && wrap->m_proxy_security) {
         raw_object = (JSObjectRef) wrap->m_security;
     }
+    V82JSC::SuspendNativeInterceptorsScope interceptors_scope(wrap);
 
     JSValueRef args[] = {
         raw_object,
@@ -1502,6 +1559,7 @@ Maybe<v8::PropertyAttribute> Object::GetRealNamedPropertyAttributes(Local<Contex
         if (wrap && wrap->m_proxy_security) {
             raw_object = (JSObjectRef) wrap->m_security;
         }
+        V82JSC::SuspendNativeInterceptorsScope interceptors_scope(wrap);
         
         Local<Value> thiz = V82JSC::TrackedObject::SecureValue
         (V82JSC::Value::New(ToContextImpl(context), raw_object));
@@ -1731,9 +1789,13 @@ void* Object::SlowGetAlignedPointerFromInternalField(int index)
     if (wrap && index < wrap->m_num_internal_fields) {
         if (index < 2) {
             return wrap->m_embedder_data[index];
-        } else {
-            Local<Value> external = V82JSC::Value::New(ToContextImpl(context),
-                    JSObjectGetPropertyAtIndex(ctx, wrap->m_internal_fields_array, index, 0));
+        } else if (!wrap->m_internal_fields.IsEmpty()) {
+            v8::internal::Object *field = wrap->InternalFields()->m_elements[index];
+            if (!field->IsHeapObject()) {
+                return reinterpret_cast<void*>(field);
+            }
+            // Set with SetInternalField()
+            Local<Value> external = CreateLocal<Value>(isolate, FromHeapPointer(field));
             if (external->IsExternal()) {
                 return external.As<External>()->Value();
             }
@@ -1759,8 +1821,11 @@ Local<v8::Value> Object::SlowGetInternalField(int index)
         wrap = V82JSC::TrackedObject::getPrivateInstance(ctx, obj);
     }
     if (wrap && index < wrap->m_num_internal_fields) {
-        Local<Value> r = V82JSC::Value::New(ToContextImpl(context),
-                                        JSObjectGetPropertyAtIndex(ctx, wrap->m_internal_fields_array, index, 0));
+        v8::internal::Object *field = wrap->InternalFields()->m_elements[index];
+        Local<Value> r = field->IsHeapObject() ?
+            CreateLocal<Value>(isolate, FromHeapPointer(field)) :
+            CreateLocalSmi<Value>(reinterpret_cast<v8::internal::Isolate*>(isolate),
+                                  reinterpret_cast<v8::internal::Smi*>(field));
         return scope.Escape(r);
     }
     return Local<Value>();
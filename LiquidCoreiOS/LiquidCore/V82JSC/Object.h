@@ -8,6 +8,7 @@
 #define V82JSC_Object_h
 
 #include "HeapObjects.h"
+#include "Context.h"
 
 // These aren't really V8 values, but we want to use V8 handles to manage their
 // lifecycle, so we pretend.
@@ -25,11 +26,14 @@ struct TrackedObject : HeapObject {
     JSValueRef m_private_properties;
     JSObjectRef m_hidden_children_array;
     int m_num_internal_fields;
-    JSObjectRef m_internal_fields_array;
+    v8::Persistent<v8::EmbeddedFixedArray> m_internal_fields;
     v8::Persistent<v8::ObjectTemplate> m_object_template;
     int m_hash;
     bool m_isHiddenPrototype;
     bool m_isGlobalObject;
+    bool m_native_interceptors;
+    // The object's class has its template's accessors as static values
+    bool m_native_accessors;
     void *m_embedder_data[2];
     JSObjectRef m_access_control;
     JSObjectRef m_access_proxies;
@@ -52,12 +56,12 @@ struct TrackedObject : HeapObject {
     {
         int freed=0;
         freed += SmartReset<v8::ObjectTemplate>(context, obj->m_object_template);
+        freed += SmartReset<v8::EmbeddedFixedArray>(context, obj->m_internal_fields);
         // obj->m_security is a weak reference to avoid circular referencing
         if (obj->m_proxy_security) JSValueUnprotect(obj->GetNullContext(), obj->m_proxy_security);
         if (obj->m_hidden_proxy_security) JSValueUnprotect(obj->GetNullContext(), obj->m_hidden_proxy_security);
         if (obj->m_private_properties) JSValueUnprotect(obj->GetNullContext(), obj->m_private_properties);
         if (obj->m_hidden_children_array) JSValueUnprotect(obj->GetNullContext(), obj->m_hidden_children_array);
-        if (obj->m_internal_fields_array) JSValueUnprotect(obj->GetNullContext(), obj->m_internal_fields_array);
         if (obj->m_access_control) JSValueUnprotect(obj->GetNullContext(), obj->m_access_control);
         if (obj->m_access_proxies) JSValueUnprotect(obj->GetNullContext(), obj->m_access_proxies);
         if (obj->m_global_object_access_proxies) JSValueUnprotect(obj->GetNullContext(), obj->m_global_object_access_proxies);
@@ -73,6 +77,32 @@ struct TrackedObject : HeapObject {
     static TrackedObject* makePrivateInstance(IsolateImpl* iso, JSContextRef ctx);
     static void setPrivateInstance(IsolateImpl* iso, JSContextRef ctx,
                                    TrackedObject* impl, JSObjectRef object);
+    // The class of the object that ties a TrackedObject's lifetime to its JS object's
+    static JSClassRef LifecycleClass();
+    // The m_num_internal_fields fields, created the first time one is used.  Each holds a value's
+    // heap pointer or, as in V8, an aligned pointer as is, which the collector takes for a Smi.
+    FixedArray* InternalFields();
+    // Makes getPrivateInstance() resolve 'alias' (the object itself or a proxy for it) to this
+    void AddAlias(JSValueRef alias);
+    static TrackedObject* lookupAlias(IsolateImpl* iso, JSObjectRef object);
+    static void removeAlias(IsolateImpl* iso, TrackedObject* impl, JSValueRef alias);
+};
+
+// Suspends an object's class callback interceptors while its real properties are inspected
+class SuspendNativeInterceptorsScope {
+public:
+    SuspendNativeInterceptorsScope(TrackedObject *wrap) :
+    wrap_(wrap), suspended_(wrap && wrap->m_native_interceptors)
+    {
+        if (suspended_) wrap_->m_native_interceptors = false;
+    }
+    ~SuspendNativeInterceptorsScope()
+    {
+        if (suspended_) wrap_->m_native_interceptors = true;
+    }
+private:
+    TrackedObject *wrap_;
+    bool suspended_;
 };
 
 struct Accessor : HeapObject {
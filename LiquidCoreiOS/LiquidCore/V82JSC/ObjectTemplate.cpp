@@ -9,6 +9,8 @@
 #include "Object.h"
 #include "JSCPrivate.h"
 #include <string.h>
+#include <set>
+#include <string>
 
 using namespace V82JSC;
 using namespace v8;
@@ -157,18 +159,35 @@ MaybeLocal<Object> v8::ObjectTemplate::NewInstance(Local<Context> context)
         }
     } else if (impl->m_callback) {
         JSClassDefinition def = kJSClassDefinitionEmpty;
-        if (impl->m_callback) {
-            def.callAsFunction = V82JSC::Template::callAsFunctionCallback;
-            def.callAsConstructor = V82JSC::Template::callAsConstructorCallback;
-        }
-        JSClassRef claz = JSClassCreate(&def);
-        void * data = PersistentData<ObjectTemplate>(isolate, thiz);
+        def.callAsFunction = V82JSC::Template::callAsFunctionCallback;
+        def.callAsConstructor = V82JSC::Template::callAsConstructorCallback;
         def.finalize = [](JSObjectRef obj) {
             void *data = JSObjectGetPrivate(obj);
             ReleasePersistentData<ObjectTemplate>(data);
         };
+        if (!impl->m_need_proxy) {
+            def.staticValues = impl->StaticValues();
+        }
+        void * data = PersistentData<ObjectTemplate>(isolate, thiz);
 
-        instance = JSObjectMake(ctx->m_ctxRef, claz, data);
+        instance = JSObjectMake(ctx->m_ctxRef, impl->InstanceClass(def), data);
+    } else if (impl->m_need_proxy) {
+        // Let the instance be created from a class so that interceptors can be implemented natively
+        JSClassDefinition def = kJSClassDefinitionEmpty;
+        MaybeLocal<Object> o = impl->NewInstance(context, 0, false, &def);
+        if (o.IsEmpty()) {
+            return MaybeLocal<Object>();
+        }
+        return scope.Escape(o.ToLocalChecked());
+    } else if (impl->StaticValues()) {
+        // A class only so that the accessors can be got natively
+        JSClassDefinition def = kJSClassDefinitionEmpty;
+        def.attributes = kJSClassAttributeNoAutomaticPrototype;
+        MaybeLocal<Object> o = impl->NewInstance(context, 0, false, &def);
+        if (o.IsEmpty()) {
+            return MaybeLocal<Object>();
+        }
+        return scope.Escape(o.ToLocalChecked());
     } else {
         instance = JSObjectMake(ctx->m_ctxRef, 0, 0);
     }
@@ -192,7 +211,8 @@ class InterceptorOther {};
 template <typename V, typename I>
 JSValueRef PropertyHandler(CALLBACK_PARAMS,
                            void (*named_handler)(const V82JSC::ObjectTemplate*, Local<Name>, Local<v8::Value>, PropertyCallbackInfo<V>&, const NamedPropertyHandlerConfiguration&),
-                           void (*indexed_handler)(const V82JSC::ObjectTemplate*, uint32_t, Local<v8::Value>, PropertyCallbackInfo<V>&, const IndexedPropertyHandlerConfiguration&))
+                           void (*indexed_handler)(const V82JSC::ObjectTemplate*, uint32_t, Local<v8::Value>, PropertyCallbackInfo<V>&, const IndexedPropertyHandlerConfiguration&),
+                           bool native = false)
 {
     // Arguments:
     //  get            - target, property, receiver        -> Value
@@ -254,12 +274,16 @@ JSValueRef PropertyHandler(CALLBACK_PARAMS,
         value = JSValueMakeUndefined(ctx);
     }
     auto wrap = V82JSC::TrackedObject::getPrivateInstance(ctx, target);
+    // Class callbacks fire while the instance is still being set up; those are not interceptable
+    if (native && (!wrap || !wrap->m_native_interceptors)) {
+        return NULL;
+    }
     
     auto templ = ToImpl<V82JSC::ObjectTemplate>(wrap->m_object_template.Get(isolate));
     Local<v8::Context> context = LocalContext::New(ToIsolate(isolateimpl), ctx);
     v8::Context::Scope context_scope(context);
     auto ctximpl = ToContextImpl(context);
-    Local<v8::Value> holder = V82JSC::Value::New(ctximpl, wrap->m_proxy_security);
+    Local<v8::Value> holder = V82JSC::Value::New(ctximpl, wrap->m_proxy_security ? wrap->m_proxy_security : target);
 
 #ifdef USE_JAVASCRIPTCORE_PRIVATE_API
     JSGlobalContextRef creation_context = JSCPrivate::JSObjectGetGlobalContext(target);
@@ -389,10 +413,10 @@ static JSValueRef proxy_get(CALLBACK_PARAMS)
     return ret;
 }
 
-static JSValueRef legacy_proxy_get(JSContextRef ctx, JSObjectRef object,
-                                   JSStringRef propertyName, JSValueRef* exception)
+static JSValueRef interceptor_get(JSContextRef ctx, JSObjectRef object,
+                             JSStringRef propertyName, JSValueRef* exception, bool native)
 {
-    if (JSStringGetLength(propertyName) == 0 || !inGlobalPrototypeChain(ctx, object)) return NULL;
+    if (JSStringGetLength(propertyName) == 0) return NULL;
     JSValueRef args[] = {
         object, JSValueMakeString(ctx, propertyName), object
     };
@@ -400,11 +424,19 @@ static JSValueRef legacy_proxy_get(JSContextRef ctx, JSObjectRef object,
     (
      ctx, object, object, 3, args, exception,
      [](NAMED_PARAMS(v8::Value)) { config.getter(property, info); },
-     [](INDEXED_PARAMS(v8::Value)) { config.getter(index, info); }
+     [](INDEXED_PARAMS(v8::Value)) { config.getter(index, info); },
+     native
      );
     return ret;
 }
 
+static JSValueRef legacy_proxy_get(JSContextRef ctx, JSObjectRef object,
+                                   JSStringRef propertyName, JSValueRef* exception)
+{
+    if (!inGlobalPrototypeChain(ctx, object)) return NULL;
+    return interceptor_get(ctx, object, propertyName, exception, false);
+}
+
 static JSValueRef proxy_set(CALLBACK_PARAMS)
 {
     JSValueRef ret = PropertyHandler<v8::Value,InterceptorSetter>
@@ -437,17 +469,18 @@ static JSValueRef proxy_set(CALLBACK_PARAMS)
     return JSValueMakeBoolean(ctx, true);
 }
 
-static bool legacy_proxy_set(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
-                             JSValueRef value, JSValueRef* exception)
+static bool interceptor_set(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                       JSValueRef value, JSValueRef* exception, bool native)
 {
-    if (JSStringGetLength(propertyName) == 0 || !inGlobalPrototypeChain(ctx, object)) return NULL;
+    if (JSStringGetLength(propertyName) == 0) return false;
     JSValueRef args[] = {
         object, JSValueMakeString(ctx, propertyName), value, object
     };
     JSValueRef ret = PropertyHandler<v8::Value,InterceptorSetter>
     (ctx, object, object, 4, args, exception,
      [](NAMED_PARAMS(v8::Value)) { config.setter(property, value, info); },
-     [](INDEXED_PARAMS(v8::Value)) { config.setter(index, value, info); }
+     [](INDEXED_PARAMS(v8::Value)) { config.setter(index, value, info); },
+     native
      );
     if (*exception || ret == NULL) {
         return false;
@@ -456,6 +489,13 @@ static bool legacy_proxy_set(JSContextRef ctx, JSObjectRef object, JSStringRef p
     return true;
 }
 
+static bool legacy_proxy_set(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                             JSValueRef value, JSValueRef* exception)
+{
+    if (!inGlobalPrototypeChain(ctx, object)) return false;
+    return interceptor_set(ctx, object, propertyName, value, exception, false);
+}
+
 static JSValueRef proxy_has(CALLBACK_PARAMS)
 {
     JSValueRef ret = PropertyHandler<Integer,InterceptorOther>
@@ -479,9 +519,9 @@ static JSValueRef proxy_has(CALLBACK_PARAMS)
     return JSValueMakeBoolean(ctx, !JSValueIsUndefined(ctx, ret));
 }
 
-static bool legacy_proxy_has(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName)
+static bool interceptor_has(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName, bool native)
 {
-    if (JSStringGetLength(propertyName) == 0 || !inGlobalPrototypeChain(ctx, object)) return NULL;
+    if (JSStringGetLength(propertyName) == 0) return false;
     JSValueRef args[] = {
         object, JSValueMakeString(ctx, propertyName)
     };
@@ -495,7 +535,8 @@ static bool legacy_proxy_has(JSContextRef ctx, JSObjectRef object, JSStringRef p
      [](INDEXED_PARAMS(Integer)) {
          if (config.query != NullIndexedQuery) config.query(index, info);
          else if(config.getter != NullIndexedGetter) config.getter(index, reinterpret_cast<PropertyCallbackInfo<v8::Value>&>(info));
-     }
+     },
+     native
      );
     if (exception || ret == NULL) {
         return false;
@@ -503,6 +544,12 @@ static bool legacy_proxy_has(JSContextRef ctx, JSObjectRef object, JSStringRef p
     return true;
 }
 
+static bool legacy_proxy_has(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName)
+{
+    if (!inGlobalPrototypeChain(ctx, object)) return false;
+    return interceptor_has(ctx, object, propertyName, false);
+}
+
 static JSValueRef proxy_deleteProperty(CALLBACK_PARAMS)
 {
     JSValueRef ret = PropertyHandler<v8::Boolean,InterceptorOther>
@@ -515,23 +562,31 @@ static JSValueRef proxy_deleteProperty(CALLBACK_PARAMS)
     return ret;
 }
 
-static bool legacy_proxy_deleteProperty(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
-                                        JSValueRef* exception)
+static bool interceptor_deleteProperty(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                  JSValueRef* exception, bool native)
 {
-    if (JSStringGetLength(propertyName) == 0 || !inGlobalPrototypeChain(ctx, object)) return NULL;
+    if (JSStringGetLength(propertyName) == 0) return false;
     JSValueRef args[] = {
         object, JSValueMakeString(ctx, propertyName)
     };
     JSValueRef ret = PropertyHandler<v8::Boolean,InterceptorOther>
     (ctx, object, object, 2, args, exception,
      [](NAMED_PARAMS(v8::Boolean)) { config.deleter(property, info); },
-     [](INDEXED_PARAMS(v8::Boolean)) { config.deleter(index, info); });
+     [](INDEXED_PARAMS(v8::Boolean)) { config.deleter(index, info); },
+     native);
     if (ret==NULL || *exception) {
         return false;
     }
     return true;
 }
 
+static bool legacy_proxy_deleteProperty(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                        JSValueRef* exception)
+{
+    if (!inGlobalPrototypeChain(ctx, object)) return false;
+    return interceptor_deleteProperty(ctx, object, propertyName, exception, false);
+}
+
 static JSValueRef proxy_ownKeys(CALLBACK_PARAMS)
 {
     JSValueRef ret = PropertyHandler<v8::Array,InterceptorOther>
@@ -554,15 +609,15 @@ static JSValueRef proxy_ownKeys(CALLBACK_PARAMS)
     return ret;
 }
 
-static void legacy_proxy_ownKeys(JSContextRef ctx, JSObjectRef object,
-                                 JSPropertyNameAccumulatorRef acc)
+static void interceptor_ownKeys(JSContextRef ctx, JSObjectRef object,
+                           JSPropertyNameAccumulatorRef acc, bool native)
 {
-    if (!inGlobalPrototypeChain(ctx, object)) return;
     JSValueRef exception = 0;
     JSValueRef ret = PropertyHandler<v8::Array,InterceptorOther>
     (ctx, object, object, 1, &object, &exception,
      [](NAMED_PARAMS(v8::Array)) { config.enumerator(info); },
-     [](INDEXED_PARAMS(v8::Array)) { config.enumerator(info); });
+     [](INDEXED_PARAMS(v8::Array)) { config.enumerator(info); },
+     native);
     if (!exception && ret) {
         int length = static_cast<int>(JSValueToNumber(ctx, exec(ctx, "_1.length", 1, &ret), 0));
         for (int i=0; !exception && i<length; i++) {
@@ -571,10 +626,30 @@ static void legacy_proxy_ownKeys(JSContextRef ctx, JSObjectRef object,
             if (JSStringGetLength(s)) {
                 JSPropertyNameAccumulatorAddName(acc, s);
             }
+            JSStringRelease(s);
         }
     }
 }
 
+static void legacy_proxy_ownKeys(JSContextRef ctx, JSObjectRef object,
+                                 JSPropertyNameAccumulatorRef acc)
+{
+    if (!inGlobalPrototypeChain(ctx, object)) return;
+    interceptor_ownKeys(ctx, object, acc, false);
+}
+
+// JSC classes can intercept string-keyed gets, sets, queries, deletes and enumeration, which is
+// all most interceptors need.  Definers, descriptors and access checks still require an ES6 Proxy.
+// Note that symbol-keyed properties are not seen by class callbacks.
+static bool canInterceptNatively(const V82JSC::ObjectTemplate *templ)
+{
+    return !templ->m_access_check_data &&
+        templ->m_named_handler.definer == NullNamedDefiner &&
+        templ->m_named_handler.descriptor == NullNamedDescriptor &&
+        templ->m_indexed_handler.definer == NullIndexedDefiner &&
+        templ->m_indexed_handler.descriptor == NullIndexedDescriptor;
+}
+
 static JSValueRef proxy_defineProperty(CALLBACK_PARAMS)
 {
     assert(argumentCount>2);
@@ -689,10 +764,217 @@ static JSValueRef proxy_getOwnPropertyDescriptor(CALLBACK_PARAMS)
     return JSValueMakeUndefined(ctx);
 }
 
+JSClassRef V82JSC::ObjectTemplate::InstanceClass(const JSClassDefinition& definition)
+{
+    // Everything but the name is a flag or a function pointer, so compares as plain memory
+    JSClassDefinition def = definition;
+    def.className = nullptr;
+    bool same = m_class && memcmp(&def, &m_class_definition, sizeof def) == 0 &&
+        (definition.className ?
+         m_class_name && JSStringIsEqualToUTF8CString(m_class_name, definition.className) :
+         !m_class_name);
+    if (!same) {
+        if (m_class) JSClassRelease(m_class);
+        if (m_class_name) JSStringRelease(m_class_name);
+        m_class = JSClassCreate(&definition);
+        m_class_definition = def;
+        m_class_name = definition.className ? JSStringCreateWithUTF8CString(definition.className) : nullptr;
+    }
+    return m_class;
+}
+
+// A get (|value| null) or set of a static value.  Does what the function an accessor is defined
+// with would (see ObjectImpl::SetAccessor), but its own object is always the holder and there is
+// no signature to check.  Null if it isn't one of the template's.
+static JSValueRef StaticValueCallback(JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                      const JSValueRef *value, JSValueRef *exception)
+{
+    IsolateImpl *iso = IsolateFromCtx(ctx);
+    Isolate* isolate = ToIsolate(iso);
+    v8::Locker lock(isolate);
+    
+    HandleScope scope (isolate);
+    auto wrap = V82JSC::TrackedObject::getPrivateInstance(ctx, object);
+    if (!wrap || wrap->m_object_template.IsEmpty()) return NULL;
+    auto otempl = ToImpl<V82JSC::ObjectTemplate>(wrap->m_object_template.Get(isolate));
+    V82JSC::ObjAccessor *accessor = otempl->StaticAccessor(propertyName);
+    if (!accessor) return NULL;
+    auto thread = IsolateImpl::PerThreadData::Get(iso);
+    
+    Local<v8::Context> context = LocalContext::New(isolate, ctx);
+    v8::Context::Scope context_scope(context);
+    auto ctximpl = ToContextImpl(context);
+    
+    Local<v8::Value> thiz = V82JSC::Value::New(ctximpl, object);
+    Local<v8::Value> data = accessor->data.Get(isolate);
+    if (data.IsEmpty()) data = Undefined(isolate);
+    Local<Name> name = accessor->name.Get(isolate);
+    
+    typedef v8::internal::Heap::RootListIndex R;
+    v8::internal::Object *the_hole = iso->ii.heap()->root(R::kTheHoleValueRootIndex);
+    v8::internal::Object *shouldThrow = v8::internal::Smi::FromInt(0);
+    
+    thread->m_callback_depth ++;
+    
+    v8::internal::Object * implicit[] = {
+        shouldThrow,                                             // kShouldThrowOnErrorIndex = 0;
+        * reinterpret_cast<v8::internal::Object**>(*thiz),       // kHolderIndex = 1;
+        O(iso),                                                  // kIsolateIndex = 2;
+        the_hole,                                                // kReturnValueDefaultValueIndex = 3;
+        the_hole,                                                // kReturnValueIndex = 4;
+        * reinterpret_cast<v8::internal::Object**>(*data),       // kDataIndex = 5;
+        * reinterpret_cast<v8::internal::Object**>(*thiz),       // kThisIndex = 6;
+    };
+    
+    thread->m_scheduled_exception = the_hole;
+    TryCatch try_catch(isolate);
+    
+    Local<v8::Value> ret = Undefined(isolate);
+    if (!value) {
+        PropertyCallback<v8::Value> info(implicit);
+        accessor->getter(name, info);
+        ret = info.GetReturnValue().Get();
+    } else {
+        PropertyCallback<void> info(implicit);
+        {
+            v8::Unlocker unlock(isolate);
+            accessor->setter(name, V82JSC::Value::New(ctximpl, *value), info);
+        }
+    }
+    
+    if (try_catch.HasCaught()) {
+        *exception = ToJSValueRef(try_catch.Exception(), context);
+    } else if (thread->m_scheduled_exception != the_hole) {
+        v8::internal::Object * excep = thread->m_scheduled_exception;
+        *exception = ToJSValueRef_<v8::Value>(excep, context);
+        thread->m_scheduled_exception = the_hole;
+    }
+    
+    -- thread->m_callback_depth;
+    
+    return ToJSValueRef<v8::Value>(ret, context);
+}
+
+const JSStaticValue* V82JSC::ObjectTemplate::StaticValues()
+{
+    if (m_static_revision == m_revision + 1) return m_static_values;
+    
+    ReleaseStaticValues(this);
+    // The class may be pointing at the old ones, and a new list can land at the same address
+    if (m_class) {
+        JSClassRelease(m_class);
+        m_class = nullptr;
+    }
+    m_static_revision = m_revision + 1;
+    
+    Isolate *isolate = ToIsolate(ToIsolateImpl(this));
+    HandleScope scope(isolate);
+    
+    auto string_name = [](Local<Name> name, std::string& out) -> bool {
+        if (name.IsEmpty() || !name->IsString()) return false;
+        v8::String::Utf8Value str(name);
+        if (!*str || strlen(*str) != (size_t) str.length()) return false;
+        out = *str;
+        return true;
+    };
+    
+    // A static value comes before anything defined on the object, so none may share a name with
+    // something else the template defines
+    std::set<std::string> taken;
+    std::string name;
+    for (auto i=m_properties.Get(isolate); !i.IsEmpty(); ) {
+        auto prop = ToImpl<V82JSC::Prop>(i);
+        if (string_name(prop->name.Get(isolate), name)) taken.insert(name);
+        i = prop->next_.Get(isolate);
+    }
+    for (auto i=m_property_accessors.Get(isolate); !i.IsEmpty(); ) {
+        auto accessor = ToImpl<V82JSC::PropAccessor>(i);
+        if (string_name(accessor->name.Get(isolate), name)) taken.insert(name);
+        i = accessor->next_.Get(isolate);
+    }
+    for (auto i=m_intrinsics.Get(isolate); !i.IsEmpty(); ) {
+        auto intrinsic = ToImpl<V82JSC::IntrinsicProp>(i);
+        if (string_name(intrinsic->name.Get(isolate), name)) taken.insert(name);
+        i = intrinsic->next_.Get(isolate);
+    }
+    
+    // Newest first, as the last one set is the one that counts.  JSC can't delete a static value,
+    // so only those that can't be deleted anyway qualify.  Those with a signature or access
+    // controls stay as they were.
+    std::vector<ObjAccessor*> statics;
+    std::vector<std::string> names;
+    for (auto i=m_accessors.Get(isolate); !i.IsEmpty(); ) {
+        auto accessor = ToImpl<V82JSC::ObjAccessor>(i);
+        i = accessor->next_.Get(isolate);
+        if (!string_name(accessor->name.Get(isolate), name) || !taken.insert(name).second) continue;
+        if (accessor->getter && accessor->signature.IsEmpty() &&
+            accessor->settings == AccessControl::DEFAULT &&
+            (accessor->attribute & PropertyAttribute::DontDelete)) {
+            statics.push_back(accessor);
+            names.push_back(name);
+        }
+    }
+    if (statics.empty()) return nullptr;
+    
+    // The accessors themselves are held by the template's list, and templates never move
+    m_static_values = new JSStaticValue[statics.size() + 1];
+    m_static_accessors = new ObjAccessor*[statics.size()];
+    for (size_t i=0; i<statics.size(); i++) {
+        auto attribute = statics[i]->attribute;
+        m_static_accessors[i] = statics[i];
+        m_static_values[i].name = strdup(names[i].c_str());
+        m_static_values[i].getProperty = [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                            JSValueRef* exception) -> JSValueRef
+        {
+            return StaticValueCallback(ctx, object, propertyName, nullptr, exception);
+        };
+        m_static_values[i].setProperty = [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                            JSValueRef value, JSValueRef* exception) -> bool
+        {
+            return StaticValueCallback(ctx, object, propertyName, &value, exception) != NULL;
+        };
+        m_static_values[i].attributes = kJSPropertyAttributeDontDelete |
+            ((attribute & PropertyAttribute::ReadOnly) ? kJSPropertyAttributeReadOnly : 0) |
+            ((attribute & PropertyAttribute::DontEnum) ? kJSPropertyAttributeDontEnum : 0);
+    }
+    m_static_values[statics.size()] = { 0, 0, 0, 0 };
+    return m_static_values;
+}
+
+V82JSC::ObjAccessor* V82JSC::ObjectTemplate::StaticAccessor(JSStringRef name)
+{
+    for (int i=0; m_static_values && m_static_values[i].name; i++) {
+        if (JSStringIsEqualToUTF8CString(name, m_static_values[i].name)) {
+            return m_static_accessors[i];
+        }
+    }
+    return nullptr;
+}
+
+bool V82JSC::ObjectTemplate::IsStatic(ObjAccessor *accessor)
+{
+    for (int i=0; m_static_values && m_static_values[i].name; i++) {
+        if (m_static_accessors[i] == accessor) return true;
+    }
+    return false;
+}
+
+void V82JSC::ObjectTemplate::ReleaseStaticValues(ObjectTemplate *obj)
+{
+    if (!obj->m_static_values) return;
+    for (int i=0; obj->m_static_values[i].name; i++) {
+        free(const_cast<char*>(obj->m_static_values[i].name));
+    }
+    delete [] obj->m_static_values;
+    delete [] obj->m_static_accessors;
+    obj->m_static_values = nullptr;
+    obj->m_static_accessors = nullptr;
+}
+
 v8::MaybeLocal<v8::Object> V82JSC::ObjectTemplate::NewInstance(v8::Local<v8::Context> context,
                                                            JSObjectRef root, bool isHiddenPrototype,
                                                            JSClassDefinition* definition,
-                                                           void *data)
+                                                           void *data, bool isGlobalObject)
 {
     auto ctx = ToContextImpl(context);
     IsolateImpl* iso = ToIsolateImpl(ctx);
@@ -705,17 +987,47 @@ v8::MaybeLocal<v8::Object> V82JSC::ObjectTemplate::NewInstance(v8::Local<v8::Con
     
     TrackedObject *wrap;
     
+    // Interceptors can only be implemented as class callbacks if we are creating the root object
+    bool native_interceptors = m_need_proxy && definition && !isGlobalObject && canInterceptNatively(this);
+    
     if (definition) {
-        if (m_need_proxy) {
+        // Interceptors would have to come first, and the hidden prototype and global object
+        // proxies expect real properties
+        if (!m_need_proxy && !isHiddenPrototype && !isGlobalObject) {
+            definition->staticValues = StaticValues();
+        }
+        if (native_interceptors) {
+            definition->getProperty = [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                         JSValueRef* exception) -> JSValueRef
+            {
+                return interceptor_get(ctx, object, propertyName, exception, true);
+            };
+            definition->setProperty = [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                         JSValueRef value, JSValueRef* exception) -> bool
+            {
+                return interceptor_set(ctx, object, propertyName, value, exception, true);
+            };
+            definition->hasProperty = [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName) -> bool
+            {
+                return interceptor_has(ctx, object, propertyName, true);
+            };
+            definition->deleteProperty = [](JSContextRef ctx, JSObjectRef object, JSStringRef propertyName,
+                                            JSValueRef* exception) -> bool
+            {
+                return interceptor_deleteProperty(ctx, object, propertyName, exception, true);
+            };
+            definition->getPropertyNames = [](JSContextRef ctx, JSObjectRef object, JSPropertyNameAccumulatorRef acc)
+            {
+                interceptor_ownKeys(ctx, object, acc, true);
+            };
+        } else if (m_need_proxy) {
             definition->getProperty = legacy_proxy_get;
             definition->setProperty = legacy_proxy_set;
             definition->hasProperty = legacy_proxy_has;
             definition->deleteProperty = legacy_proxy_deleteProperty;
             definition->getPropertyNames = legacy_proxy_ownKeys;
         }
-        JSClassRef klass = JSClassCreate(definition);
-        root = JSObjectMake(ctx->m_ctxRef, klass, data);
-        JSClassRelease(klass);
+        root = JSObjectMake(ctx->m_ctxRef, InstanceClass(*definition), data);
     }
     assert(root);
     wrap = V82JSC::TrackedObject::makePrivateInstance(iso, ctx->m_ctxRef, root);
@@ -726,18 +1038,16 @@ v8::MaybeLocal<v8::Object> V82JSC::ObjectTemplate::NewInstance(v8::Local<v8::Con
     
     // Create lifecycle object
     wrap->m_object_template.Reset(isolate, thiz);
+    // The fields themselves are made the first time one is used (see TrackedObject::InternalFields)
     wrap->m_num_internal_fields = m_internal_fields;
-    JSValueRef *initarray = new JSValueRef[m_internal_fields];
-    for (int i=0; i<m_internal_fields; i++) {
-        initarray[i] = JSValueMakeUndefined(ctx->m_ctxRef);
-    }
-    wrap->m_internal_fields_array = JSObjectMakeArray(ctx->m_ctxRef, m_internal_fields, initarray, 0);
-    JSValueProtect(ctx->m_ctxRef, wrap->m_internal_fields_array);
     wrap->m_isHiddenPrototype = isHiddenPrototype;
+    wrap->m_native_accessors = m_class && m_static_values &&
+        m_class_definition.staticValues == m_static_values &&
+        JSValueIsObjectOfClass(ctx->m_ctxRef, root, m_class);
 
     // Create proxy
     JSObjectRef handler = 0;
-    if (m_need_proxy && !wrap->m_isGlobalObject) {
+    if (m_need_proxy && !native_interceptors && !wrap->m_isGlobalObject) {
         handler = JSObjectMake(ctx->m_ctxRef, nullptr, nullptr);
         auto handler_func = [ctx, handler](const char *name, JSObjectCallAsFunctionCallback callback) -> void {
             JSValueRef excp = 0;
@@ -769,13 +1079,15 @@ v8::MaybeLocal<v8::Object> V82JSC::ObjectTemplate::NewInstance(v8::Local<v8::Con
     if (instance.IsEmpty()) {
         return instance;
     }
+    wrap->m_native_interceptors = native_interceptors;
 
-    if (m_need_proxy) {
+    if (m_need_proxy && !native_interceptors) {
         JSValueRef args[] = {root, handler};
         JSValueRef proxy_object = exec(ctx->m_ctxRef, "return new Proxy(_1, _2)", 2, args);
         // Important!  Set the security proxy before calling ValueImpl::New().  We don't want the proxy object
         // to have its own wrap
         wrap->m_proxy_security = proxy_object;
+        wrap->AddAlias(proxy_object);
         Local<Object> proxy = V82JSC::Value::New(ctx, proxy_object).As<Object>();
         instance = proxy;
     }
@@ -848,6 +1160,7 @@ v8::MaybeLocal<v8::Object> V82JSC::ObjectTemplate::NewInstance(v8::Local<v8::Con
         JSValueRef hidden_proxy_object = exec(ctx->m_ctxRef, proxy_code, 3, args);
         // Same here.  Set the hidden proxy reference before calling ValueImpl::New()
         wrap->m_hidden_proxy_security = hidden_proxy_object;
+        wrap->AddAlias(hidden_proxy_object);
         Local<Object> hidden_proxy = V82JSC::Value::New(ctx, hidden_proxy_object).As<Object>();
         instance = hidden_proxy;
     }
@@ -926,6 +1239,7 @@ void v8::ObjectTemplate::SetAccessor(
     Local<v8::ObjAccessor> local = CreateLocal<v8::ObjAccessor>(isolate, accessor);
     accessor->next_.Reset(isolate, this_->m_accessors.Get(isolate));
     this_->m_accessors.Reset(isolate, local);
+    this_->m_revision ++;
 }
 
 /**
@@ -1050,14 +1364,12 @@ void v8::ObjectTemplate::SetCallAsFunctionHandler(FunctionCallback callback,
     Isolate* isolate = ToIsolate(this);
     HandleScope scope(isolate);
     
-    Local<Context> context = ToCurrentContext(this);
     auto templ = ToImpl<V82JSC::ObjectTemplate,ObjectTemplate>(this);
     templ->m_callback = callback;
     if (data.IsEmpty()) {
         data = Undefined(isolate);
     }
-    templ->m_data = ToJSValueRef<Value>(data, isolate);
-    JSValueProtect(ToContextRef(context), templ->m_data);
+    templ->m_data.Reset(isolate, data);
 }
 
 /**
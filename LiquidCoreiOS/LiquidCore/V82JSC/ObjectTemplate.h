@@ -26,6 +26,16 @@ struct ObjectTemplate : Template {
     bool m_need_proxy;
     int m_internal_fields;
     bool m_is_immutable_proto;
+    // The class instances were last made from, and what it was made from.  Made again only if
+    // that changes.
+    JSClassRef m_class;
+    JSClassDefinition m_class_definition;
+    JSStringRef m_class_name;
+    // The accessors the class has as static values, rather than being defined on each instance,
+    // and the revision of the template they were picked from (plus one, so that zero is never)
+    JSStaticValue *m_static_values;
+    ObjAccessor **m_static_accessors;
+    int m_static_revision;
     
     static void Constructor(ObjectTemplate *obj) { Template::Constructor(obj); }
     static int Destructor(HeapContext& context, ObjectTemplate *obj)
@@ -37,12 +47,24 @@ struct ObjectTemplate : Template {
         if (obj->m_access_check_data) JSValueUnprotect(obj->GetNullContext(), obj->m_access_check_data);
         if (obj->m_failed_named_data) JSValueUnprotect(obj->GetNullContext(), obj->m_failed_named_data);
         if (obj->m_failed_indexed_data) JSValueUnprotect(obj->GetNullContext(), obj->m_failed_indexed_data);
+        if (obj->m_class) JSClassRelease(obj->m_class);
+        if (obj->m_class_name) JSStringRelease(obj->m_class_name);
+        ReleaseStaticValues(obj);
         return freed + Template::Destructor(context, obj);
     }
 
+    // A class for |definition|, which the template keeps
+    JSClassRef InstanceClass(const JSClassDefinition& definition);
+    // The accessors instances can get natively, as a null-terminated list for the class.  Null if
+    // there are none.
+    const JSStaticValue* StaticValues();
+    ObjAccessor* StaticAccessor(JSStringRef name);
+    bool IsStatic(ObjAccessor *accessor);
+    static void ReleaseStaticValues(ObjectTemplate *obj);
+
     v8::MaybeLocal<v8::Object> NewInstance(v8::Local<v8::Context> context, JSObjectRef root,
                                            bool isHiddenPrototype, JSClassDefinition* definition=nullptr,
-                                           void* data=nullptr);
+                                           void* data=nullptr, bool isGlobalObject=false);
 };
 
 class DisableAccessChecksScope {
@@ -5,12 +5,18 @@
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
 #include "V82JSC.h"
+#include <cmath>
 
 using namespace V82JSC;
 using namespace v8;
 
 double Number::Value() const
 {
+    internal::Object *obj = * reinterpret_cast<internal::Object**>(const_cast<Number*>(this));
+    if (obj->IsSmi()) {
+        return internal::Smi::ToInt(obj);
+    }
+
     Local<Context> context = ToCurrentContext(this);
     JSContextRef ctx = ToContextRef(context);
     JSValueRef value = ToJSValueRef(this, context);
@@ -18,8 +24,21 @@ double Number::Value() const
     return JSValueToNumber(ctx, value, 0);
 }
 
+// Small integers don't need a heap object or a JSC value; they are handed out as Smis and only
+// turned into a JSValueRef if and when ToJSValueRef() is called on them
+template <class T>
+static inline Local<T> NewSmi(Isolate* isolate, int value)
+{
+    return CreateLocalSmi<T>(reinterpret_cast<internal::Isolate*>(isolate), internal::Smi::FromInt(value));
+}
+
 Local<Number> Number::New(Isolate* isolate, double value)
 {
+    if (value >= internal::Smi::kMinValue && value <= internal::Smi::kMaxValue &&
+        value == (double)(int)value && !(value == 0 && std::signbit(value))) {
+        return NewSmi<Number>(isolate, (int)value);
+    }
+
     EscapableHandleScope scope(isolate);
     JSContextRef ctx;
     Local<Context> context = OperatingContext(isolate);
@@ -30,10 +49,16 @@ Local<Number> Number::New(Isolate* isolate, double value)
 
 Local<Integer> Integer::New(Isolate* isolate, int32_t value)
 {
+    if (internal::Smi::IsValid(value)) {
+        return NewSmi<Integer>(isolate, value);
+    }
     return Number::New(isolate, value).As<Integer>();
 }
 Local<Integer> Integer::NewFromUnsigned(Isolate* isolate, uint32_t value)
 {
+    if (value <= (uint32_t) internal::Smi::kMaxValue) {
+        return NewSmi<Integer>(isolate, (int) value);
+    }
     return Number::New(isolate, value).As<Integer>();
 }
 int64_t Integer::Value() const
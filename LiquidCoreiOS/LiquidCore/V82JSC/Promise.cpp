@@ -24,20 +24,30 @@ MaybeLocal<Promise::Resolver> Promise::Resolver::New(Local<Context> context)
     JSContextRef ctx = ToContextRef(context);
     LocalException exception(iso);
     
-    JSValueRef resolver = exec(ctx,
-                                       "var pr = { }; pr.promise = new Promise((resolve,reject) => { pr.resolve = resolve; pr.reject = reject; }); return pr;",
-                                       0, &exception);
+    JSObjectRef promise, resolve, reject;
+    if (__builtin_available(iOS 13.0, macOS 10.15, *)) {
+        promise = JSObjectMakeDeferredPromise(ctx, &resolve, &reject, &exception);
+    } else {
+        JSObjectRef deferred = (JSObjectRef) exec(ctx,
+            "var d = [ ]; d[0] = new Promise((resolve,reject) => { d[1] = resolve; d[2] = reject; }); return d;",
+            0, &exception);
+        if (!exception.ShouldThrow()) {
+            promise = (JSObjectRef) JSObjectGetPropertyAtIndex(ctx, deferred, 0, 0);
+            resolve = (JSObjectRef) JSObjectGetPropertyAtIndex(ctx, deferred, 1, 0);
+            reject = (JSObjectRef) JSObjectGetPropertyAtIndex(ctx, deferred, 2, 0);
+        }
+    }
     if (exception.ShouldThrow()) {
         return MaybeLocal<Promise::Resolver>();
     }
 
-    JSValueRef promise = exec(ctx, "return _1.promise", 1, &resolver);
-
     Local<Promise::Resolver> local = V82JSC::Value::New(ToContextImpl(context),
                                                     promise, iso->m_promise_resolver_map).As<Promise::Resolver>();
-    auto impl = ToImpl<V82JSC::Value>(local);
-    impl->m_secondary_value = resolver;
-    JSValueProtect(ctx, impl->m_secondary_value);
+    auto impl = ToImpl<V82JSC::PromiseResolver>(local);
+    impl->m_resolve = resolve;
+    V82JSC::Value::Root(ctx, impl->m_resolve);
+    impl->m_reject = reject;
+    V82JSC::Value::Root(ctx, impl->m_reject);
     
     return scope.Escape(local);
 }
@@ -49,13 +59,23 @@ Local<Promise> Promise::Resolver::GetPromise()
 {
     Isolate* isolate = ToIsolate(this);
     EscapableHandleScope scope(isolate);
-    auto impl = ToImpl<V82JSC::Value>(this);
+    auto impl = ToImpl<V82JSC::PromiseResolver>(this);
 
     Local<Context> context = ToCurrentContext(this);
+    return scope.Escape(V82JSC::Value::New(ToContextImpl(context), impl->m_value).As<Promise>());
+}
+
+static Maybe<bool> Settle(Local<v8::Context> context, JSObjectRef settle, Local<v8::Value> value)
+{
+    IsolateImpl* iso = ToIsolateImpl(ToContextImpl(context));
     JSContextRef ctx = ToContextRef(context);
-    JSValueRef resolver = impl->m_secondary_value;
-    return scope.Escape(V82JSC::Value::New(ToContextImpl(context),
-                                           exec(ctx, "return _1.promise", 1, &resolver)).As<Promise>());
+    LocalException exception(iso);
+    JSValueRef arg = ToJSValueRef(value, context);
+    JSObjectCallAsFunction(ctx, settle, 0, 1, &arg, &exception);
+    if (!exception.ShouldThrow()) {
+        return _maybe<bool>(true).toMaybe();
+    }
+    return v8::Nothing<bool>();
 }
 
 /**
@@ -64,42 +84,31 @@ Local<Promise> Promise::Resolver::GetPromise()
  */
 Maybe<bool> Promise::Resolver::Resolve(Local<Context> context,Local<Value> value)
 {
-    Isolate* isolate = ToIsolate(ToContextImpl(context));
-    IsolateImpl* iso = ToIsolateImpl(isolate);
-    HandleScope scope(isolate);
-    auto impl = ToImpl<V82JSC::Value>(this);
-
-    LocalException exception(iso);
-    JSContextRef ctx = ToContextRef(context);
-    JSValueRef args[] = {
-        impl->m_secondary_value,
-        ToJSValueRef(value, context)
-    };
-    JSValueRef success = exec(ctx, "return _1.resolve(_2)", 2, args, &exception);
-    if (!exception.ShouldThrow()) {
-        return _maybe<bool>(JSValueToBoolean(ctx, success)).toMaybe();
-    }
-    return Nothing<bool>();
+    HandleScope scope(ToIsolate(ToContextImpl(context)));
+    return Settle(context, ToImpl<V82JSC::PromiseResolver>(this)->m_resolve, value);
 }
 
 Maybe<bool> Promise::Resolver::Reject(Local<Context> context, Local<Value> value)
+{
+    HandleScope scope(ToIsolate(ToContextImpl(context)));
+    return Settle(context, ToImpl<V82JSC::PromiseResolver>(this)->m_reject, value);
+}
+
+static MaybeLocal<Promise> Chain(Local<v8::Context> context, JSObjectRef method,
+                                 JSValueRef promise, Local<v8::Function> handler)
 {
     Isolate* isolate = ToIsolate(ToContextImpl(context));
     IsolateImpl* iso = ToIsolateImpl(isolate);
-    HandleScope scope(isolate);
-    auto impl = ToImpl<V82JSC::Value>(this);
+    EscapableHandleScope scope(isolate);
 
     LocalException exception(iso);
     JSContextRef ctx = ToContextRef(context);
-    JSValueRef args[] = {
-        impl->m_secondary_value,
-        ToJSValueRef(value, context)
-    };
-    JSValueRef success = exec(ctx, "return _1.reject(_2)", 2, args, &exception);
+    JSValueRef arg = ToJSValueRef(handler, context);
+    JSValueRef derived = JSObjectCallAsFunction(ctx, method, (JSObjectRef) promise, 1, &arg, &exception);
     if (!exception.ShouldThrow()) {
-        return _maybe<bool>(JSValueToBoolean(ctx, success)).toMaybe();
+        return scope.Escape(V82JSC::Value::New(ToContextImpl(context), derived).As<Promise>());
     }
-    return Nothing<bool>();
+    return MaybeLocal<Promise>();
 }
 
 /**
@@ -110,40 +119,14 @@ Maybe<bool> Promise::Resolver::Reject(Local<Context> context, Local<Value> value
  */
 MaybeLocal<Promise> Promise::Catch(Local<Context> context,Local<Function> handler)
 {
-    Isolate* isolate = ToIsolate(ToContextImpl(context));
-    IsolateImpl* iso = ToIsolateImpl(isolate);
-    EscapableHandleScope scope(isolate);
-
-    LocalException exception(iso);
-    JSContextRef ctx = ToContextRef(context);
-    JSValueRef args[] = {
-        ToJSValueRef(this, context),
-        ToJSValueRef(handler, context)
-    };
-    JSValueRef promise = exec(ctx, "return _1.catch(_2)", 2, args, &exception);
-    if (!exception.ShouldThrow()) {
-        return scope.Escape(V82JSC::Value::New(ToContextImpl(context), promise).As<Promise>());
-    }
-    return MaybeLocal<Promise>();
+    return Chain(context, ToIsolateImpl(ToContextImpl(context))->m_promise_catch,
+                 ToJSValueRef(this, context), handler);
 }
 
 MaybeLocal<Promise> Promise::Then(Local<Context> context, Local<Function> handler)
 {
-    Isolate* isolate = ToIsolate(ToContextImpl(context));
-    IsolateImpl* iso = ToIsolateImpl(isolate);
-    EscapableHandleScope scope(isolate);
-
-    LocalException exception(iso);
-    JSContextRef ctx = ToContextRef(context);
-    JSValueRef args[] = {
-        ToJSValueRef(this, context),
-        ToJSValueRef(handler, context)
-    };
-    JSValueRef promise = exec(ctx, "return _1.then(_2)", 2, args, &exception);
-    if (!exception.ShouldThrow()) {
-        return scope.Escape(V82JSC::Value::New(ToContextImpl(context), promise).As<Promise>());
-    }
-    return MaybeLocal<Promise>();
+    return Chain(context, ToIsolateImpl(ToContextImpl(context))->m_promise_then,
+                 ToJSValueRef(this, context), handler);
 }
 
 /**
@@ -8,8 +8,9 @@
 
 using namespace v8;
 
-ResourceConstraints::ResourceConstraints()
+// Zero is no limit
+ResourceConstraints::ResourceConstraints() :
+    max_semi_space_size_(0), max_old_space_size_(0), max_executable_size_(0),
+    stack_limit_(nullptr), code_range_size_(0), max_zone_pool_size_(0)
 {
-    // FIXME
-    //assert(0);
 }
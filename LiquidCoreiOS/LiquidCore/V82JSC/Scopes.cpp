@@ -45,10 +45,46 @@ void HandleScope::Initialize(Isolate* isolate)
 }
 
 
-void delBlock(HandleBlock *block)
+// Each thread keeps a few retired HandleBlocks around so that opening and closing scopes in a tight
+// loop (as native callbacks do) doesn't constantly go back to the allocator
+#define HANDLEBLOCK_POOL_SIZE 8
+struct HandleBlockPool {
+    HandleBlock *blocks_[HANDLEBLOCK_POOL_SIZE];
+    int count_ = 0;
+    
+    ~HandleBlockPool()
+    {
+        while (count_ > 0) free(blocks_[--count_]);
+    }
+};
+static thread_local HandleBlockPool s_handle_block_pool;
+
+static HandleBlock * newBlock()
+{
+    if (s_handle_block_pool.count_ > 0) {
+        return s_handle_block_pool.blocks_[--s_handle_block_pool.count_];
+    }
+    HandleBlock *block;
+    posix_memalign((void**)&block, HANDLEBLOCK_SIZE, sizeof(HandleBlock));
+    return block;
+}
+
+static void retireBlock(HandleBlock *block)
+{
+    if (s_handle_block_pool.count_ < HANDLEBLOCK_POOL_SIZE) {
+        s_handle_block_pool.blocks_[s_handle_block_pool.count_++] = block;
+    } else {
+        free(block);
+    }
+}
+
+static void delBlock(HandleBlock *block)
 {
-    if (block && block->next_) delBlock(block->next_);
-    free (block);
+    while (block) {
+        HandleBlock *next = block->next_;
+        retireBlock(block);
+        block = next;
+    }
 }
 
 HandleScope::~HandleScope()
@@ -69,7 +105,7 @@ HandleScope::~HandleScope()
         thisBlock->next_ = nullptr;
         if (impl->m_scope_stack->size() == 1) {
             CHECK_EQ(data->next, data->limit);
-            free (thisBlock);
+            retireBlock(thisBlock);
             data->next = nullptr;
             data->limit = nullptr;
         }
@@ -118,8 +154,7 @@ internal::Object** internal::HandleScope::Extend(Isolate* isolate)
     IsolateImpl* isolateimpl = reinterpret_cast<IsolateImpl*>(isolate);
     DCHECK(!isolateimpl->m_scope_stack->empty());
     
-    HandleBlock *ptr;
-    posix_memalign((void**)&ptr, HANDLEBLOCK_SIZE, sizeof(HandleBlock));
+    HandleBlock *ptr = newBlock();
     
     internal::Object **handles = &ptr->handles_[0];
     HandleScopeData *data = isolateimpl->ii.handle_scope_data();
@@ -140,17 +175,24 @@ internal::Object** internal::HandleScope::Extend(Isolate* isolate)
     return handles;
 }
 
-void IsolateImpl::GetActiveLocalHandles(HeapContext& context)
+// Calls |visit| with every local handle of |iso| on every thread
+template <typename F>
+static void EachLocalHandle(IsolateImpl *iso, F visit)
 {
     // Seal off current thread's handle scopes
-    auto thread = PerThreadData::Get(this);
-    memcpy(&thread->m_handle_scope_data, ii.handle_scope_data(), sizeof(HandleScopeData));
+    auto thread = IsolateImpl::PerThreadData::Get(iso);
+    memcpy(&thread->m_handle_scope_data, iso->ii.handle_scope_data(), sizeof(internal::HandleScopeData));
     
-    std::unique_lock<std::mutex> lock(s_thread_data_mutex);
-    for (auto it=s_thread_data.begin(); it!=s_thread_data.end(); it++) {
+    std::unique_lock<std::mutex> lock(IsolateImpl::s_thread_data_mutex);
+    for (auto it=IsolateImpl::s_thread_data.begin(); it!=IsolateImpl::s_thread_data.end(); it++) {
         for (auto it2=it->second->m_isolate_data.begin(); it2!=it->second->m_isolate_data.end(); it2++) {
-            if (it2->first == this) {
-                HandleScopeData *data = &it2->second->m_handle_scope_data;
+            if (it2->first == iso) {
+                for (auto& entered : it2->second->m_context_stack) {
+                    internal::Object *handle = ToHeapPointer(entered);
+                    visit(&handle);
+                    entered = static_cast<V82JSC::Context*>(FromHeapPointer(handle));
+                }
+                internal::HandleScopeData *data = &it2->second->m_handle_scope_data;
                 if (data->limit) {
                     intptr_t addr = reinterpret_cast<intptr_t>(data->limit - 1);
                     addr &= ~(HANDLEBLOCK_SIZE -1);
@@ -159,8 +201,7 @@ void IsolateImpl::GetActiveLocalHandles(HeapContext& context)
                     while (block) {
                         for (internal::Object ** handle = &block->handles_[0]; handle < limit; handle++ ) {
                             if ((*handle)->IsHeapObject()) {
-                                int count = context.handles_.count(*handle) ? context.handles_[*handle] + 1: 1;
-                                context.handles_[*handle] = count;
+                                visit(handle);
                             }
                         }
                         block = block->next_;
@@ -172,6 +213,21 @@ void IsolateImpl::GetActiveLocalHandles(HeapContext& context)
     }
 }
 
+void IsolateImpl::GetActiveLocalHandles(HeapContext& context)
+{
+    EachLocalHandle(this, [&context](internal::Object **handle) {
+        HeapAllocator::Retain(context, *handle);
+    });
+}
+
+void IsolateImpl::ForwardLocalHandles(const Forwarding& forwarding)
+{
+    EachLocalHandle(this, [&forwarding](internal::Object **handle) {
+        auto moved = forwarding.find(*handle);
+        if (moved != forwarding.end()) *handle = moved->second;
+    });
+}
+
 internal::Object** internal::CanonicalHandleScope::Lookup(Object* object)
 {
     assert(0);
@@ -236,6 +292,43 @@ public:
     WeakCallbackInfo<void>::Callback weak_callback_;
     WeakCallbackInfo<void>::Callback second_pass_callback_;
     void *param_;
+    // Weak (and near death) nodes are also kept on a list headed by GlobalHandles::first_free_,
+    // which V8 uses for its free list and we otherwise have no use for.  This lets the GC visit
+    // weak handles without walking every node.
+    Node *next_weak_;
+    Node *prev_weak_;
+
+    bool IsWeakState() const
+    {
+        int state = flags_ & internal::Internals::kNodeStateMask;
+        return state == internal::Internals::kNodeStateIsWeakValue ||
+            state == internal::Internals::kNodeStateIsNearDeathValue;
+    }
+    bool InWeakList(GlobalHandles *global_handles) const
+    {
+        return next_weak_ || prev_weak_ || global_handles->first_free_ == this;
+    }
+    void LinkWeak(GlobalHandles *global_handles)
+    {
+        IsolateImpl* iso = reinterpret_cast<IsolateImpl*>(global_handles->isolate());
+        std::lock_guard<std::mutex> lock(iso->m_handlewalk_lock);
+        if (InWeakList(global_handles)) return;
+        next_weak_ = global_handles->first_free_;
+        prev_weak_ = nullptr;
+        if (next_weak_) next_weak_->prev_weak_ = this;
+        global_handles->first_free_ = this;
+    }
+    void UnlinkWeak(GlobalHandles *global_handles)
+    {
+        IsolateImpl* iso = reinterpret_cast<IsolateImpl*>(global_handles->isolate());
+        std::lock_guard<std::mutex> lock(iso->m_handlewalk_lock);
+        if (!InWeakList(global_handles)) return;
+        if (global_handles->first_free_ == this) global_handles->first_free_ = next_weak_;
+        if (next_weak_) next_weak_->prev_weak_ = prev_weak_;
+        if (prev_weak_) prev_weak_->next_weak_ = next_weak_;
+        next_weak_ = nullptr;
+        prev_weak_ = nullptr;
+    }
 };
 
 class internal::GlobalHandles::NodeBlock {
@@ -359,6 +452,7 @@ public:
 
         int64_t index = (reinterpret_cast<intptr_t>(handle) - reinterpret_cast<intptr_t>(&handles_[0])) / sizeof(Node);
         assert(index >= 0 && index < 64);
+        handles_[index].UnlinkWeak(global_handles_);
         bool wasFull = IsFull();
         uint64_t mask = (uint64_t)1 << index;
         assert((bitmap_ & mask) == 0);
@@ -373,6 +467,8 @@ public:
             push_available();
         }
     }
+    // Retains everything held by a strong handle.  Weak handles are visited separately (see
+    // CollectWeakHandles), so returns the number of handles in use, strong or weak.
     int CollectHandles(HeapContext& context) {
         assert((InAvailableList() && !InUsedList()) || (InUsedList() && !InAvailableList()));
         int handles_processed = 0;
@@ -381,26 +477,8 @@ public:
             if (~(bitmap_) & mask) {
                 Node& node = handles_[i];
                 internal::Object *h = node.handle_;
-                IsolateImpl* iso = reinterpret_cast<IsolateImpl*>(global_handles_->isolate());
-                if (h->IsHeapObject()) {
-                    if ((node.flags_ & kActiveWeakMask) == internal::Internals::kNodeStateIsNearDeathValue ||
-                        (node.flags_ & kActiveWeakMask) == internal::Internals::kNodeStateIsWeakValue) {
-                        
-                        auto obj = FromHeapPointer(h);
-                        BaseMap *map =
-                        reinterpret_cast<BaseMap*>(FromHeapPointer(obj->m_map));
-                        if (h->IsPrimitive() || (map != iso->m_value_map && map != iso->m_array_buffer_map)) {
-                            if (context.weak_.count(h)) context.weak_[h].push_back(&node.handle_);
-                            else {
-                                auto vector = std::vector<internal::Object**>();
-                                vector.push_back(&node.handle_);
-                                context.weak_[h] = std::move(vector);
-                            }
-                        }
-                    } else {
-                        int count = context.handles_.count(h) ? context.handles_[h] + 1: 1;
-                        context.handles_[h] = count;
-                    }
+                if (h->IsHeapObject() && !node.IsWeakState()) {
+                    HeapAllocator::Retain(context, h);
                 }
                 handles_processed ++;
             }
@@ -408,22 +486,12 @@ public:
         }
         return handles_processed;
     }
-    void PerformIncrementalMarking(JSCPrivate::JSMarkerRef marker, std::map<void*, JSObjectRef>& ready_to_die)
-    {
+    void ForwardHandles(const Forwarding& forwarding) {
         uint64_t mask = 1;
         for (int i=0; i<64; i++) {
             if (~(bitmap_) & mask) {
-                Node& node = handles_[i];
-                internal::Object *h = node.handle_;
-                if (h->IsHeapObject()) {
-                    if ((node.flags_ & kActiveWeakMask) == kActiveWeak) {
-                        auto vi = ToImpl<V82JSC::Value>(&node.handle_);
-                        if (!marker->IsMarked(marker, (JSObjectRef)vi->m_value)) {
-                            node.flags_ = (node.flags_ & ~kActiveWeakMask) | kActiveNearDeath;
-                            ready_to_die[&node] = (JSObjectRef) vi->m_value;
-                        }
-                    }
-                }
+                auto moved = forwarding.find(handles_[i].handle_);
+                if (moved != forwarding.end()) handles_[i].handle_ = moved->second;
             }
             mask <<= 1;
         }
@@ -469,8 +537,38 @@ internal::GlobalHandles::GlobalHandles(internal::Isolate *isolate)
             total_processed += processed;
         }
         assert(total_processed == number_of_global_handles_);
+
+        // Weak handles to JS objects keep their WeakValue alive; JSC decides when the object itself
+        // goes.  Weak handles to anything else are only noted, so that they can be called back if the
+        // value dies.
+        for (Node *node = first_free_; node; node = node->next_weak_) {
+            assert(node->IsWeakState());
+            internal::Object *h = node->handle_;
+            if (!h->IsHeapObject()) continue;
+            if (node->flags_ & (1 << internal::Internals::kNodeIsActiveShift)) {
+                HeapAllocator::Retain(context, h);
+                continue;
+            }
+            auto obj = FromHeapPointer(h);
+            BaseMap *map = reinterpret_cast<BaseMap*>(FromHeapPointer(obj->m_map));
+            if (h->IsPrimitive() || (map != iso->m_value_map && map != iso->m_array_buffer_map)) {
+                context.weak_[h].push_back(&node->handle_);
+            }
+        }
     };
     
+    // Points every handle, strong or weak, at the new home of an object that has moved
+    iso->forwardGlobalHandles = [iso, this](const Forwarding& forwarding)
+    {
+        std::lock_guard<std::mutex> lock(iso->m_handlewalk_lock);
+        for (NodeBlock *block = first_used_block_; block; block = block->next_used_block_) {
+            block->ForwardHandles(forwarding);
+        }
+        for (NodeBlock *block = first_block_; block; block = block->next_block_) {
+            block->ForwardHandles(forwarding);
+        }
+    };
+
     // For all active, weak values that have not previously been marked for death but are currently
     // ready to die, save them from collection one last time so that the client has a chance to resurrect
     // them in callbacks before we make this final
@@ -478,11 +576,14 @@ internal::GlobalHandles::GlobalHandles(internal::Isolate *isolate)
     {
         std::lock_guard<std::mutex> lock(iso->m_handlewalk_lock);
 
-        for (NodeBlock *block = first_used_block_; block; block = block->next_used_block_) {
-            block->PerformIncrementalMarking(marker, ready_to_die);
-        }
-        for (NodeBlock *block = first_block_; block; block = block->next_block_) {
-            block->PerformIncrementalMarking(marker, ready_to_die);
+        for (Node *node = first_free_; node; node = node->next_weak_) {
+            if ((node->flags_ & kActiveWeakMask) == kActiveWeak && node->handle_->IsHeapObject()) {
+                auto vi = ToImpl<V82JSC::Value>(&node->handle_);
+                if (!marker->IsMarked(marker, (JSObjectRef)vi->m_value)) {
+                    node->flags_ = (node->flags_ & ~kActiveWeakMask) | kActiveNearDeath;
+                    ready_to_die[node] = (JSObjectRef) vi->m_value;
+                }
+            }
         }
         
         for (auto i=ready_to_die.begin(); i!=ready_to_die.end(); ++i) {
@@ -601,6 +702,7 @@ internal::Handle<internal::Object> internal::GlobalHandles::CopyGlobal(v8::inter
     new_handle_loc->weak_callback_ = handle_loc->weak_callback_;
     new_handle_loc->second_pass_callback_ = handle_loc->second_pass_callback_;
     new_handle_loc->param_   = handle_loc->param_;
+    if (new_handle_loc->IsWeakState()) new_handle_loc->LinkWeak(block->global_handles_);
 
     return new_handle;
 }
@@ -643,6 +745,7 @@ void internal::GlobalHandles::MakeWeak(internal::Object **location, void *parame
     handle_loc->type_ = type;
     handle_loc->weak_callback_ = weak_callback;
     handle_loc->second_pass_callback_ = nullptr;
+    handle_loc->LinkWeak(block->global_handles_);
 }
 void internal::GlobalHandles::MakeWeak(v8::internal::Object ***location_addr)
 {
@@ -670,12 +773,13 @@ void * internal::GlobalHandles::ClearWeakness(v8::internal::Object **location)
             WeakValue *value = static_cast<WeakValue*>(obj);
             auto strong = static_cast<V82JSC::Value*>(HeapAllocator::Alloc(iso, iso->m_value_map));
             strong->m_value = value->m_value;
-            JSValueProtect(ctx, strong->m_value);
+            V82JSC::Value::Root(ctx, strong->m_value);
             handle_loc->handle_ = ToHeapPointer(strong);
         }
     }
 
     handle_loc->flags_ &= ~kActiveWeakMask;
+    handle_loc->UnlinkWeak(block->global_handles_);
     void *param = handle_loc->param_;
     handle_loc->param_ = nullptr;
     handle_loc->weak_callback_ = nullptr;
@@ -696,6 +800,7 @@ void internal::GlobalHandles::TearDown()
         delete block;
         block = next;
     }
+    first_free_ = nullptr;
 }
 
 void V8::MakeWeak(internal::Object** location, void* data,
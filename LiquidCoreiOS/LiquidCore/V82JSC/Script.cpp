@@ -5,6 +5,7 @@
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
 #include <thread>
+#include <vector>
 #include "V82JSC.h"
 #include "StringImpl.h"
 #include "Script.h"
@@ -203,7 +204,7 @@ ScriptCompiler::CachedData::CachedData(const uint8_t* data, int length,
 
 ScriptCompiler::CachedData::~CachedData()
 {
-//    if (data && buffer_policy == BufferPolicy::BufferNotOwned) delete data;
+    if (data && buffer_policy == BufferPolicy::BufferOwned) delete[] data;
 }
 
 bool ScriptCompiler::ExternalSourceStream::SetBookmark()
@@ -222,8 +223,49 @@ struct internal::StreamedSource
     ScriptCompiler::ExternalSourceStream* source_stream_;
     ScriptCompiler::StreamedSource::Encoding encoding_;
     ScriptCompiler::CachedData *cached_data_;
+    // Filled in by the streaming task
+    JSStringRef source_;
+    JSStringRef syntax_error_;
+    int syntax_error_line_;
 };
 
+// Finds the value of the last '//# name=value' (or '//@') comment in a script, the same way
+// V8 does for sourceURL and sourceMappingURL.  Returns 0 if there is none.
+static JSStringRef FindMagicComment(JSStringRef source, const char *name)
+{
+    const JSChar *chars = JSStringGetCharactersPtr(source);
+    size_t length = JSStringGetLength(source);
+    size_t name_length = strlen(name);
+    auto is_space = [](JSChar c) { return c==' ' || c=='\t' || c=='\n' || c=='\r' || c=='\f' || c=='\v'; };
+    auto is_value = [](JSChar c) {
+        return (c>='A' && c<='Z') || (c>='a' && c<='z') || (c>='0' && c<='9') || c=='_' || c=='.';
+    };
+    JSStringRef found = 0;
+    for (size_t i=0; i+3+name_length < length; i++) {
+        if (chars[i] != '/' || chars[i+1] != '/' || (chars[i+2] != '#' && chars[i+2] != '@') || chars[i+3] != ' ') {
+            continue;
+        }
+        size_t p = i + 4;
+        size_t n = 0;
+        while (n < name_length && p+n < length && chars[p+n] == name[n]) n++;
+        if (n < name_length || p+n >= length || chars[p+n] != '=') continue;
+        p += n + 1;
+        while (p < length && is_space(chars[p])) p++;
+        size_t value_start = p;
+        while (p < length && is_value(chars[p])) p++;
+        size_t value_end = p;
+        bool terminated = p == length;
+        while (p < length && is_space(chars[p]) && !terminated) {
+            terminated = chars[p++] == '\n' || p == length;
+        }
+        if (terminated) {
+            if (found) JSStringRelease(found);
+            found = JSStringCreateWithCharacters(&chars[value_start], value_end - value_start);
+        }
+    }
+    return found;
+}
+
 class V82JSCStreamingTask : public ScriptCompiler::ScriptStreamingTask
 {
 public:
@@ -249,10 +291,43 @@ public:
             if (src == nullptr) src = (uint8_t *) malloc(size+1);
             else src = (uint8_t*) realloc(src, total_size + size+1);
             memcpy(&src[total_size], buffer, size);
+            delete[] buffer;
             total_size += size;
         }
-        if (src) src[total_size--] = 0;
-        this_->streamed_source_->cached_data_ = new ScriptCompiler::CachedData(src, int(total_size));
+        if (!src) return;
+        src[total_size] = 0;
+
+        // Decode the source here rather than on the JS thread
+        JSStringRef source;
+        if (this_->encoding_ == ScriptCompiler::StreamedSource::UTF8) {
+            source = JSStringCreateWithUTF8CString((const char*)src);
+        } else if (this_->encoding_ == ScriptCompiler::StreamedSource::TWO_BYTE) {
+            source = JSStringCreateWithCharacters((const JSChar*)src, total_size / sizeof(JSChar));
+        } else {
+            std::vector<JSChar> chars(src, src + total_size);
+            source = JSStringCreateWithCharacters(chars.data(), chars.size());
+        }
+        free(src);
+        this_->streamed_source_->source_ = source;
+
+        // Parse it in a throwaway context group so that the JS thread is not locked out while we do.
+        // JSC can't move a parsed script between groups, so this only catches syntax errors early.
+        JSContextGroupRef group = JSContextGroupCreate();
+        JSGlobalContextRef ctx = JSGlobalContextCreateInGroup(group, nullptr);
+        JSStringRef url = JSStringCreateWithUTF8CString("[undefined]");
+        JSStringRef error = 0;
+        int error_line = 0;
+        JSCPrivate::JSScriptRef script = JSCPrivate::JSScriptCreateFromString(group, ctx, url, 1, source,
+                                                                              &error, &error_line);
+        if (script) {
+            JSCPrivate::JSScriptRelease(script);
+        } else {
+            this_->streamed_source_->syntax_error_ = error;
+            this_->streamed_source_->syntax_error_line_ = error_line;
+        }
+        JSStringRelease(url);
+        JSGlobalContextRelease(ctx);
+        JSContextGroupRelease(group);
     }
     ScriptCompiler::ExternalSourceStream* source_stream_;
     ScriptCompiler::StreamedSource::Encoding encoding_;
@@ -270,9 +345,15 @@ ScriptCompiler::StreamedSource::StreamedSource(ExternalSourceStream* source_stre
     impl_ = new internal::StreamedSource();
     impl_->source_stream_ = source_stream;
     impl_->encoding_ = encoding;
+    impl_->cached_data_ = nullptr;
+    impl_->source_ = 0;
+    impl_->syntax_error_ = 0;
+    impl_->syntax_error_line_ = 0;
 }
 ScriptCompiler::StreamedSource::~StreamedSource()
 {
+    if (impl_->source_) JSStringRelease(impl_->source_);
+    if (impl_->syntax_error_) JSStringRelease(impl_->syntax_error_);
     delete impl_;
 }
 
@@ -284,6 +365,14 @@ const ScriptCompiler::CachedData* ScriptCompiler::StreamedSource::GetCachedData(
     return impl()->cached_data_;
 }
 
+static MaybeLocal<v8::UnboundScript> CompileUnboundSource(Isolate* isolate, Local<v8::String> source_string,
+                                                          Local<v8::Value> resource_name,
+                                                          Local<Integer> resource_line_offset,
+                                                          Local<Integer> resource_column_offset,
+                                                          Local<v8::Value> source_map_url,
+                                                          ScriptOriginOptions resource_options,
+                                                          JSStringRef streamed);
+
 /**
  * Compiles the specified script (context-independent).
  * Cached data as part of the source object can be optionally produced to be
@@ -299,67 +388,67 @@ const ScriptCompiler::CachedData* ScriptCompiler::StreamedSource::GetCachedData(
  */
 MaybeLocal<v8::UnboundScript> ScriptCompiler::CompileUnboundScript(Isolate* isolate, Source* source,
                                                                CompileOptions options)
+{
+    return CompileUnboundSource(isolate, source->source_string, source->resource_name,
+                                source->resource_line_offset, source->resource_column_offset,
+                                source->source_map_url, source->GetResourceOptions(), 0);
+}
+
+// Compiles 'source_string', or 'streamed' in its place if we already have the source as a JSString
+static MaybeLocal<v8::UnboundScript> CompileUnboundSource(Isolate* isolate, Local<v8::String> source_string,
+                                                          Local<v8::Value> resource_name,
+                                                          Local<Integer> resource_line_offset,
+                                                          Local<Integer> resource_column_offset,
+                                                          Local<v8::Value> source_map_url,
+                                                          ScriptOriginOptions resource_options,
+                                                          JSStringRef streamed)
 {
     IsolateImpl* iso = ToIsolateImpl(isolate);
     EscapableHandleScope scope(isolate);
     
-    Local<Context> context = iso->m_nullContext.Get(isolate);
+    Local<v8::Context> context = iso->m_nullContext.Get(isolate);
     JSContextRef ctx = ToContextRef(context);
     
     auto impl = static_cast<V82JSC::UnboundScript*>(HeapAllocator::Alloc(iso, iso->m_unbound_script_map));
     
     JSStringRef url = 0;
     JSStringRef src = 0;
-    if (!source->source_string.IsEmpty()) {
-        JSValueRef s = ToJSValueRef(source->source_string, context);
-        // FIXME: Would be nice to figure out how to do this without a copy
-        src = JSValueToStringCopy(ctx, s, 0);
+    if (streamed || !source_string.IsEmpty()) {
+        if (streamed) {
+            src = JSStringRetain(streamed);
+        } else {
+            JSValueRef s = ToJSValueRef(source_string, context);
+            // FIXME: Would be nice to figure out how to do this without a copy
+            src = JSValueToStringCopy(ctx, s, 0);
+        }
         
-        JSValueRef surl = exec(ctx,
-                                       "var re = /\\/\\/[#@] sourceURL=[\\s]*([A-Za-z0-9_\\.]*)\\s*\(\\n|$)/g;"
-                                       "var match = re.exec(_1);"
-                                       "var out = null;"
-                                       "while (match != null) {"
-                                       "    out = match[1];"
-                                       "    match = re.exec(_1);"
-                                       "}"
-                                       "return out;",
-                                       1, &s);
-        if (!JSValueIsNull(ctx, surl)) {
-            url = JSValueToStringCopy(ctx, surl, 0);
-            JSStringRetain(url);
-            impl->m_sourceURL.Reset(isolate, V82JSC::Value::New(ToContextImpl(context), surl));
+        JSStringRef surl = FindMagicComment(src, "sourceURL");
+        if (surl) {
+            url = surl;
+            impl->m_sourceURL.Reset(isolate, V82JSC::String::New(isolate, surl));
         } else {
             impl->m_sourceURL.Reset(isolate, Undefined(isolate));
         }
-        JSValueRef smurl = exec(ctx,
-                                        "var re = /\\/\\/[#@] sourceMappingURL=[\\s]*([A-Za-z0-9_\\.]*)\\s*(\\n|$)/g;"
-                                        "var match = re.exec(_1);"
-                                        "var out = null;"
-                                        "while (match != null) {"
-                                        "    out = match[1];"
-                                        "    match = re.exec(_1);"
-                                        "}"
-                                        "return out;",
-                                        1, &s);
-        if (!JSValueIsNull(ctx, smurl)) {
-            impl->m_sourceMappingURL.Reset(isolate, V82JSC::Value::New(ToContextImpl(context), smurl));
-        } else if (!source->source_map_url.IsEmpty()) {
-            impl->m_sourceMappingURL.Reset(isolate, source->source_map_url);
+        JSStringRef smurl = FindMagicComment(src, "sourceMappingURL");
+        if (smurl) {
+            impl->m_sourceMappingURL.Reset(isolate, V82JSC::String::New(isolate, smurl));
+            JSStringRelease(smurl);
+        } else if (!source_map_url.IsEmpty()) {
+            impl->m_sourceMappingURL.Reset(isolate, source_map_url);
         } else {
             impl->m_sourceMappingURL.Reset(isolate, Undefined(isolate));
         }
     }
-    if (!source->resource_name.IsEmpty()) {
-        impl->m_resource_name.Reset(isolate, source->resource_name);
+    if (!resource_name.IsEmpty()) {
+        impl->m_resource_name.Reset(isolate, resource_name);
         if (!url) {
-            JSValueRef s = ToJSValueRef(source->resource_name, context);
+            JSValueRef s = ToJSValueRef(resource_name, context);
             url = JSValueToStringCopy(ctx, s, 0);
         }
     }
     int startingLineNumber = 1;
-    if (!source->resource_line_offset.IsEmpty()) {
-        JSValueRef l = ToJSValueRef(source->resource_line_offset, context);
+    if (!resource_line_offset.IsEmpty()) {
+        JSValueRef l = ToJSValueRef(resource_line_offset, context);
         startingLineNumber = static_cast<int>(JSValueToNumber(ctx, l, 0));
     }
     if (!url) {
@@ -382,12 +471,12 @@ MaybeLocal<v8::UnboundScript> ScriptCompiler::CompileUnboundScript(Isolate* isol
     if (impl->m_script) {
         impl->m_script_string = JSStringRetain(src);
         impl->m_id.Reset(isolate, Integer::New(isolate, (int)reinterpret_cast<intptr_t>(impl->m_script)));
-        impl->m_resource_line_offset.Reset(isolate, source->resource_line_offset);
-        impl->m_resource_column_offset.Reset(isolate, source->resource_column_offset);
-        impl->m_resource_is_shared_cross_origin = source->GetResourceOptions().IsSharedCrossOrigin();
-        impl->m_resource_is_opaque = source->GetResourceOptions().IsOpaque();
-        impl->m_is_wasm = source->GetResourceOptions().IsWasm();
-        impl->m_is_module = source->GetResourceOptions().IsModule();
+        impl->m_resource_line_offset.Reset(isolate, resource_line_offset);
+        impl->m_resource_column_offset.Reset(isolate, resource_column_offset);
+        impl->m_resource_is_shared_cross_origin = resource_options.IsSharedCrossOrigin();
+        impl->m_resource_is_opaque = resource_options.IsOpaque();
+        impl->m_is_wasm = resource_options.IsWasm();
+        impl->m_is_module = resource_options.IsModule();
         JSStringRelease(defaultError);
         
         return scope.Escape(CreateLocal<v8::UnboundScript>(&iso->ii, impl));
@@ -396,17 +485,45 @@ MaybeLocal<v8::UnboundScript> ScriptCompiler::CompileUnboundScript(Isolate* isol
     Local<v8::String> error = V82JSC::String::New(isolate, errorMessage);
     char buffer[64];
     sprintf (buffer, " (at line %d)", errorLine);
-    error = String::Concat(error, String::NewFromUtf8(isolate, buffer, NewStringType::kNormal).ToLocalChecked());
+    error = v8::String::Concat(error, v8::String::NewFromUtf8(isolate, buffer, NewStringType::kNormal).ToLocalChecked());
     JSStringRelease(defaultError);
     
-    String::Utf8Value str(error);
+    v8::String::Utf8Value str(error);
     printf ("Script error: %s\n", *str);
     
     LocalException exception(iso);
     JSValueRef *x = &exception;
     *x = ToJSValueRef(Exception::SyntaxError(error), context);
     
-    return MaybeLocal<UnboundScript>();
+    return MaybeLocal<v8::UnboundScript>();
+}
+
+// What we hand out as cached data.  JSC does not expose its bytecode through the C API, so the
+// cache only identifies the source it was produced from.  A consumer can then tell whether
+// its cache is still good without us ever running stale code out of it.
+struct CodeCacheHeader {
+    uint32_t magic;
+    uint32_t version_tag;
+    uint32_t source_length;
+    uint32_t source_hash;
+};
+static const uint32_t kCodeCacheMagic = 0x4A534343; // 'JSCC'
+
+static bool HashSource(Local<v8::Context> context, Local<v8::String> source, uint32_t& length, uint32_t& hash)
+{
+    if (source.IsEmpty()) return false;
+    JSContextRef ctx = ToContextRef(context);
+    JSStringRef s = JSValueToStringCopy(ctx, ToJSValueRef(source, context), 0);
+    const JSChar *chars = JSStringGetCharactersPtr(s);
+    length = static_cast<uint32_t>(JSStringGetLength(s));
+    // FNV-1a
+    hash = 2166136261u;
+    for (uint32_t i=0; i<length; i++) {
+        hash = (hash ^ (chars[i] & 0xff)) * 16777619u;
+        hash = (hash ^ (chars[i] >> 8)) * 16777619u;
+    }
+    JSStringRelease(s);
+    return true;
 }
 
 /**
@@ -426,30 +543,28 @@ MaybeLocal<v8::Script> ScriptCompiler::Compile(Local<Context> context, Source* s
     Isolate *isolate = ToIsolate(ToContextImpl(context));
     Context::Scope context_scope(context);
 
-    Local<String> backup;
-    if (options == kConsumeParserCache || options == kConsumeCodeCache) {
-        backup = source->source_string;
-        Local<String> code = String::NewFromOneByte(isolate, source->GetCachedData()->data, NewStringType::kNormal).ToLocalChecked();
-        source->source_string = code;
-        if (options == kConsumeParserCache && !backup.IsEmpty() && !backup->Equals(context,code).FromJust()) {
-            source->cached_data->rejected = true;
-            source->source_string = backup;
-        }
+    uint32_t length = 0, hash = 0;
+    bool hashed = false;
+    if ((options == kConsumeParserCache || options == kConsumeCodeCache) && source->GetCachedData()) {
+        const CachedData *cache = source->GetCachedData();
+        const CodeCacheHeader *header = reinterpret_cast<const CodeCacheHeader*>(cache->data);
+        hashed = HashSource(context, source->source_string, length, hash);
+        source->cached_data->rejected = !hashed ||
+            cache->length != sizeof(CodeCacheHeader) ||
+            header->magic != kCodeCacheMagic ||
+            header->version_tag != CachedDataVersionTag() ||
+            header->source_length != length ||
+            header->source_hash != hash;
     }
-    
+
     MaybeLocal<UnboundScript> unbound = ScriptCompiler::CompileUnboundScript(isolate, source);
-    if (unbound.IsEmpty() && !backup.IsEmpty()) {
-        source->source_string = backup;
-        unbound = ScriptCompiler::CompileUnboundScript(isolate, source);
-        source->cached_data->rejected = true;
-    }
     if (!unbound.IsEmpty()) {
-        if (options == kProduceParserCache || options == kProduceCodeCache) {
-            if (!source->cached_data) {
-                String::Utf8Value str(source->source_string);
-                char *data = new char[strlen(*str) + 1];
-                strcpy (data, *str);
-                source->cached_data = new CachedData((uint8_t*)data, (int)strlen(*str));
+        if ((options == kProduceParserCache || options == kProduceCodeCache) && !source->cached_data) {
+            if (hashed || HashSource(context, source->source_string, length, hash)) {
+                CodeCacheHeader header = { kCodeCacheMagic, CachedDataVersionTag(), length, hash };
+                uint8_t *data = new uint8_t[sizeof(CodeCacheHeader)];
+                memcpy(data, &header, sizeof(CodeCacheHeader));
+                source->cached_data = new CachedData(data, sizeof(CodeCacheHeader), CachedData::BufferOwned);
             }
         }
         return unbound.ToLocalChecked()->BindToCurrentContext();
@@ -489,9 +604,36 @@ MaybeLocal<v8::Script> ScriptCompiler::Compile(
                                            Local<Context> context, StreamedSource* source,
                                            Local<String> full_source_string, const ScriptOrigin& origin)
 {
-    ScriptCompiler::Source src(full_source_string, origin, const_cast<ScriptCompiler::CachedData*>(source->GetCachedData()));
-    
-    return Compile(context, &src);
+    Isolate *isolate = ToIsolate(ToContextImpl(context));
+    IsolateImpl* iso = ToIsolateImpl(isolate);
+    Context::Scope context_scope(context);
+    internal::StreamedSource *streamed = source->impl();
+
+    // The streaming task already found any syntax errors off of the main thread
+    if (streamed->syntax_error_) {
+        int line = streamed->syntax_error_line_;
+        if (!origin.ResourceLineOffset().IsEmpty()) {
+            // The task parsed from line 1; CompileUnboundSource starts numbering at the offset
+            line += static_cast<int>(origin.ResourceLineOffset()->Value()) - 1;
+        }
+        Local<v8::String> error = V82JSC::String::New(isolate, streamed->syntax_error_);
+        char buffer[64];
+        sprintf (buffer, " (at line %d)", line);
+        error = String::Concat(error, String::NewFromUtf8(isolate, buffer, NewStringType::kNormal).ToLocalChecked());
+
+        LocalException exception(iso);
+        JSValueRef *x = &exception;
+        *x = ToJSValueRef(Exception::SyntaxError(error), context);
+        return MaybeLocal<Script>();
+    }
+
+    MaybeLocal<UnboundScript> unbound = CompileUnboundSource(isolate, full_source_string, origin.ResourceName(),
+                                                             origin.ResourceLineOffset(),
+                                                             origin.ResourceColumnOffset(),
+                                                             origin.SourceMapUrl(), origin.Options(),
+                                                             streamed->source_);
+    if (unbound.IsEmpty()) return MaybeLocal<Script>();
+    return unbound.ToLocalChecked()->BindToCurrentContext();
 }
 
 /**
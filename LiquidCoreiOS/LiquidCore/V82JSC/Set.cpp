@@ -23,7 +23,10 @@ size_t Set::Size() const
 }
 void Set::Clear()
 {
-    reinterpret_cast<Map*>(this)->Clear();
+    Local<Context> context = ToCurrentContext(this);
+    JSContextRef ctx = ToContextRef(context);
+    JSValueRef obj = ToJSValueRef(this, context);
+    JSObjectCallAsFunction(ctx, ToIsolateImpl(this)->m_set_clear, (JSObjectRef)obj, 0, nullptr, 0);
 }
 MaybeLocal<Set> Set::Add(Local<Context> context, Local<Value> key)
 {
@@ -33,21 +36,34 @@ MaybeLocal<Set> Set::Add(Local<Context> context, Local<Value> key)
 
     LocalException exception(iso);
     auto impl = ToImpl<V82JSC::Value, Set>(this);
-    JSValueRef args[] = {
-        obj,
-        ToJSValueRef(key, context),
-    };
-    exec(ctx, "_1.add(_2)", 2, args, &exception);
+    JSValueRef k = ToJSValueRef(key, context);
+    JSObjectCallAsFunction(ctx, iso->m_set_add, (JSObjectRef)obj, 1, &k, &exception);
     if (exception.ShouldThrow()) return MaybeLocal<Set>();
     return CreateLocal<Set>(ToIsolate(iso), impl);
 }
 Maybe<bool> Set::Has(Local<Context> context, Local<Value> key)
 {
-    return reinterpret_cast<Map*>(this)->Has(context, key);
+    JSContextRef ctx = ToContextRef(context);
+    JSValueRef obj = ToJSValueRef(this, context);
+    IsolateImpl* iso = ToIsolateImpl(this);
+
+    LocalException exception(iso);
+    JSValueRef k = ToJSValueRef(key, context);
+    JSValueRef r = JSObjectCallAsFunction(ctx, iso->m_set_has, (JSObjectRef)obj, 1, &k, &exception);
+    if (exception.ShouldThrow()) return Nothing<bool>();
+    return _maybe<bool>(JSValueToBoolean(ctx, r)).toMaybe();
 }
 Maybe<bool> Set::Delete(Local<Context> context, Local<Value> key)
 {
-    return reinterpret_cast<Map*>(this)->Delete(context, key);
+    JSContextRef ctx = ToContextRef(context);
+    JSValueRef obj = ToJSValueRef(this, context);
+    IsolateImpl* iso = ToIsolateImpl(this);
+
+    LocalException exception(iso);
+    JSValueRef k = ToJSValueRef(key, context);
+    JSValueRef r = JSObjectCallAsFunction(ctx, iso->m_set_delete, (JSObjectRef)obj, 1, &k, &exception);
+    if (exception.ShouldThrow()) return Nothing<bool>();
+    return _maybe<bool>(JSValueToBoolean(ctx, r)).toMaybe();
 }
 
 /**
@@ -59,7 +75,7 @@ Local<Array> Set::AsArray() const
     JSContextRef ctx = ToContextRef(context);
     JSValueRef obj = ToJSValueRef(this, context);
     return V82JSC::Value::New(ToContextImpl(context),
-                          exec(ctx, "var r = []; _1.forEach((v)=>r.push(v)); return r", 1, &obj)).As<Array>();
+        CollectionAsArray(ctx, (JSObjectRef)obj, ToIsolateImpl(this)->m_set_for_each, false)).As<Array>();
 }
 
 /**
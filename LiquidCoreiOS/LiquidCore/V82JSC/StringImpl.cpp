@@ -7,11 +7,12 @@
 #include "V82JSC.h"
 #include "JSCPrivate.h"
 #include <codecvt>
-#include "utf8.h"
 #include "StringImpl.h"
+#include "Transcode.h"
 
 using namespace V82JSC;
 using namespace v8;
+using nodedroid::Transcode;
 
 Local<v8::String> V82JSC::String::New(Isolate *isolate, JSStringRef str, BaseMap* type,
                                   void *resource, v8::NewStringType stringtype)
@@ -22,11 +23,23 @@ Local<v8::String> V82JSC::String::New(Isolate *isolate, JSStringRef str, BaseMap
     JSContextRef ctx = ToContextRef(context);
     v8::Context::Scope context_scope(context);
 
+    if (stringtype == NewStringType::kInternalized) {
+        auto it = i->m_internalized_strings.find(str);
+        if (it != i->m_internalized_strings.end()) {
+            JSStringRelease(str);
+            return scope.Escape(it->second->Get(isolate));
+        }
+    }
+
     auto string = static_cast<V82JSC::String *>(HeapAllocator::Alloc(ToIsolateImpl(isolate),
                                                                              type ? type : i->m_string_map));
     Local<v8::String> local = CreateLocal<v8::String>(isolate, string);
     string->m_value = JSValueMakeString(ctx, str);
-    JSValueProtect(ctx, string->m_value);
+    V82JSC::Value::Root(ctx, string->m_value);
+    string->m_string = JSStringRetain(str);
+    if (type == i->m_one_byte_string_map) {
+        string->m_one_byte = 1;
+    }
 
     if (type == nullptr) {
         if (local->ContainsOnlyOneByte()) {
@@ -38,38 +51,22 @@ Local<v8::String> V82JSC::String::New(Isolate *isolate, JSStringRef str, BaseMap
     }
     
     if (stringtype == NewStringType::kInternalized) {
-        for (auto it=i->m_internalized_strings.begin(); it!=i->m_internalized_strings.end(); ++it) {
-            if (JSStringIsEqual(str, it->first)) {
-                JSStringRelease(str);
-                return scope.Escape(it->second->Get(ToIsolate(i)));
-            }
-        }
+        // The table owns 'str' from here on; it is the key used to find the entry again
         auto weak = new v8::Persistent<v8::String>(ToIsolate(i), local);
-        weak->SetWeak<v8::Persistent<v8::String>>(weak, [](const WeakCallbackInfo<v8::Persistent<v8::String>>& data) {
+        weak->SetWeak<OpaqueJSString>(str, [](const WeakCallbackInfo<OpaqueJSString>& data) {
             IsolateImpl* iso = ToIsolateImpl(data.GetIsolate());
-            auto weak = data.GetParameter();
-            for (auto i=iso->m_internalized_strings.begin(); i!=iso->m_internalized_strings.end(); ) {
-                if (i->second == weak) {
-                    iso->m_internalized_strings.erase(i);
-                    break;
-                }
-                i++;
-            }
+            JSStringRef key = data.GetParameter();
+            auto it = iso->m_internalized_strings.find(key);
+            assert(it != iso->m_internalized_strings.end());
+            auto weak = it->second;
+            iso->m_internalized_strings.erase(it);
             weak->Reset();
             delete weak;
+            JSStringRelease(key);
         }, v8::WeakCallbackType::kParameter);
         i->m_internalized_strings[str] = weak;
     }
     
-    if ((type == i->m_external_string_map ||
-         type == i->m_external_one_byte_string_map) &&
-        resource != nullptr) {
-        
-        type = i->m_external_string_map ? i->m_weak_external_string_map : i->m_weak_external_one_byte_string_map;
-        
-        WeakExternalString::Init(i, string->m_value, (v8::String::ExternalStringResourceBase*) resource, type);
-    }
-    
     * reinterpret_cast<void**>(reinterpret_cast<intptr_t>(string) +
                                internal::Internals::kStringResourceOffset) = resource;
 
@@ -80,24 +77,182 @@ Local<v8::String> V82JSC::String::New(Isolate *isolate, JSStringRef str, BaseMap
     return scope.Escape(local);
 }
 
-void V82JSC::WeakExternalString::FinalizeExternalString()
+JSStringRef V82JSC::String::GetJSString()
+{
+    if (!m_string) {
+        Isolate *isolate = ToIsolate(ToIsolateImpl(this));
+        HandleScope scope(isolate);
+        m_string = JSValueToStringCopy(ToContextRef(isolate), m_value, nullptr);
+    }
+    return m_string;
+}
+
+bool V82JSC::String::IsOneByte()
 {
-    v8::internal::Isolate *ii = reinterpret_cast<v8::internal::Isolate*>(GetIsolate());
-    if (m_resource) {
-        v8::String::ExternalStringResourceBase *rsrc = m_resource;
-        int count = 0;
-        std::map<JSValueRef, v8::Persistent<v8::WeakExternalString>>::iterator todelete;
-        for(auto i=GetIsolate()->m_external_strings.begin(); i!=GetIsolate()->m_external_strings.end(); ++i) {
-            auto s = i->second.Get(reinterpret_cast<v8::Isolate*>(GetIsolate()));
-            WeakExternalString* wes = static_cast<WeakExternalString*>(FromHeapPointer(*(internal::Object**)*s));
-            if (wes->m_resource == rsrc && wes != this) count++;
+    if (!m_one_byte) {
+        JSStringRef s = GetJSString();
+        size_t len = JSStringGetLength(s);
+        const JSChar *chars = JSStringGetCharactersPtr(s);
+        m_one_byte = 1;
+        for (size_t i = 0; i < len; i++) {
+            if (chars[i] > 255) {
+                m_one_byte = -1;
+                break;
+            }
         }
-        if (count == 0) {
-            intptr_t addr = reinterpret_cast<intptr_t>(this) + v8::internal::ExternalString::kResourceOffset;
-            * reinterpret_cast<v8::String::ExternalStringResourceBase**>(addr) = rsrc;
-            ii->heap()->FinalizeExternalString(reinterpret_cast<v8::internal::String*>(ToHeapPointer(this)));
+    }
+    return m_one_byte > 0;
+}
+
+// Returns the characters of 'obj' as a JSStringRef that the caller must release.  Strings hand
+// back their cached copy; anything else is converted with toString().
+static JSStringRef ToJSString(Local<v8::Value> obj, JSValueRef *exception)
+{
+    if (obj->IsString()) {
+        auto impl = ToImpl<V82JSC::String>(obj);
+        return JSStringRetain(impl->GetJSString());
+    }
+    Local<v8::Context> context = OperatingContext(Isolate::GetCurrent());
+    return JSValueToStringCopy(ToContextRef(context), ToJSValueRef(obj, context), exception);
+}
+
+static std::mutex s_external_string_mutex;
+
+// The resource keeps Dispose() protected from everyone but v8::internal::Heap, so hand it over
+// the same way V8 does when an external string dies
+static void DisposeResource(IsolateImpl *iso, v8::String::ExternalStringResourceBase *resource)
+{
+    void *fake[v8::internal::ExternalString::kResourceOffset / sizeof(void*) + 1];
+    * reinterpret_cast<v8::String::ExternalStringResourceBase**>(reinterpret_cast<intptr_t>(fake) +
+            v8::internal::ExternalString::kResourceOffset) = resource;
+    iso->ii.heap()->FinalizeExternalString(reinterpret_cast<v8::internal::String*>(
+            reinterpret_cast<intptr_t>(fake) + v8::internal::kHeapObjectTag));
+}
+
+// Called by JSC, possibly from inside its collector, once nothing references the characters
+static void ReleaseExternalString(void *userData)
+{
+    auto finalizer = reinterpret_cast<ExternalStringFinalizer*>(userData);
+    std::unique_lock<std::mutex> lock(s_external_string_mutex);
+    if (finalizer->m_isolate) {
+        finalizer->m_isolate->m_released_external_strings.push_back(finalizer);
+    } else {
+        delete finalizer;
+    }
+}
+
+static void ForgetExternalString(IsolateImpl *iso,
+                                 std::unordered_map<JSValueRef, V82JSC::ExternalString>::iterator it)
+{
+    JSCPrivate::JSWeakRelease(iso->m_group, it->second.m_weakRef);
+    if (!it->second.m_finalizer) {
+        DisposeResource(iso, it->second.m_resource);
+        iso->m_polled_external_strings --;
+    }
+    iso->m_external_strings.erase(it);
+}
+
+JSStringRef V82JSC::ExternalString::Create(IsolateImpl* iso,
+                                           v8::String::ExternalStringResourceBase *resource,
+                                           const void *data, size_t length, bool one_byte,
+                                           ExternalStringFinalizer **finalizer)
+{
+    auto f = new ExternalStringFinalizer { iso, 0, resource };
+    JSStringRef str = JSCPrivate::JSStringCreateExternal(data, length, one_byte, ReleaseExternalString, f);
+    if (str) {
+        *finalizer = f;
+        return str;
+    }
+    delete f;
+    *finalizer = nullptr;
+
+    if (!one_byte) {
+        return JSStringCreateWithCharacters(reinterpret_cast<const JSChar*>(data), length);
+    }
+    // One-byte resources are Latin-1, widen without sign-extending
+    auto bytes = reinterpret_cast<const uint8_t*>(data);
+    std::vector<JSChar> chars(bytes, bytes + length);
+    return JSStringCreateWithCharacters(chars.data(), length);
+}
+
+void V82JSC::ExternalString::Track(IsolateImpl* iso, JSValueRef value,
+                                   v8::String::ExternalStringResourceBase *resource, BaseMap *map,
+                                   ExternalStringFinalizer *finalizer)
+{
+    auto it = iso->m_external_strings.find(value);
+    if (it != iso->m_external_strings.end()) {
+        // A dead string at the same address that JSC has not released yet
+        ForgetExternalString(iso, it);
+    }
+    ExternalString& ext = iso->m_external_strings[value];
+    ext.m_weakRef = JSCPrivate::JSWeakCreate(iso->m_group, (JSObjectRef)value);
+    ext.m_resource = resource;
+    ext.m_map = map;
+    ext.m_finalizer = finalizer;
+    if (finalizer) {
+        finalizer->m_value = value;
+    } else {
+        iso->m_polled_external_strings ++;
+    }
+}
+
+bool V82JSC::ExternalString::Lookup(IsolateImpl* iso, JSValueRef value, BaseMap **map, void **resource)
+{
+    auto it = iso->m_external_strings.find(value);
+    if (it == iso->m_external_strings.end() ||
+        JSCPrivate::JSWeakGetObject(it->second.m_weakRef) != (JSObjectRef)value) {
+        return false;
+    }
+    if (map) *map = it->second.m_map;
+    if (resource) *resource = it->second.m_resource;
+    return true;
+}
+
+void V82JSC::ExternalString::Collect(IsolateImpl* iso)
+{
+    std::vector<ExternalStringFinalizer*> released;
+    {
+        std::unique_lock<std::mutex> lock(s_external_string_mutex);
+        released.swap(iso->m_released_external_strings);
+    }
+    for (auto f : released) {
+        auto it = iso->m_external_strings.find(f->m_value);
+        if (it != iso->m_external_strings.end() && it->second.m_finalizer == f) {
+            JSCPrivate::JSWeakRelease(iso->m_group, it->second.m_weakRef);
+            iso->m_external_strings.erase(it);
         }
+        DisposeResource(iso, f->m_resource);
+        delete f;
     }
+
+    // Copied strings get no word from JSC, so look for them only after it has finalized something
+    if (!iso->m_polled_external_strings || !iso->m_pending_epilogue) return;
+    for (auto i=iso->m_external_strings.begin(); i!=iso->m_external_strings.end(); ) {
+        auto it = i++;
+        if (!it->second.m_finalizer && JSCPrivate::JSWeakGetObject(it->second.m_weakRef) == 0) {
+            ForgetExternalString(iso, it);
+        }
+    }
+}
+
+void V82JSC::ExternalString::Dispose(IsolateImpl* iso)
+{
+    std::unique_lock<std::mutex> lock(s_external_string_mutex);
+    for (auto f : iso->m_released_external_strings) {
+        DisposeResource(iso, f->m_resource);
+        delete f;
+    }
+    iso->m_released_external_strings.clear();
+    for (auto i=iso->m_external_strings.begin(); i!=iso->m_external_strings.end(); ++i) {
+        JSCPrivate::JSWeakRelease(iso->m_group, i->second.m_weakRef);
+        DisposeResource(iso, i->second.m_resource);
+        if (i->second.m_finalizer) {
+            // No script runs again, so JSC may keep the characters until it tears down
+            i->second.m_finalizer->m_isolate = nullptr;
+        }
+    }
+    iso->m_external_strings.clear();
+    iso->m_polled_external_strings = 0;
 }
 
 static std::map<void*,JSStringRef> s_string_map;
@@ -115,12 +270,16 @@ MaybeLocal<v8::String> v8::String::NewFromUtf8(Isolate* isolate, const char* dat
         length = strlen(data);
     }
     
-    std::vector<unsigned short> backstore;
-    utf8::unchecked::utf8to16(data, data + length, std::back_inserter(backstore));
+    // Decoding never yields more units than there are bytes.  All-ASCII input is known to be
+    // one-byte without the string having to be scanned again.
+    std::vector<JSChar> backstore((size_t) length);
+    bool ascii = Transcode::AsciiPrefix(data, length) == (size_t) length;
+    size_t units = Transcode::Utf8ToUtf16(data, length, backstore.data());
 
     // FIXME: Would be nice to use JSStringCreateWithCharactersNoCopy
-    JSStringRef s = JSStringCreateWithCharacters(&backstore [0], backstore.size());
-    Local<String> out = V82JSC::String::New(isolate, s, nullptr, nullptr, type);
+    JSStringRef s = JSStringCreateWithCharacters(backstore.data(), units);
+    Local<String> out = V82JSC::String::New(isolate, s,
+        ascii ? ToIsolateImpl(isolate)->m_one_byte_string_map : nullptr, nullptr, type);
     
     return scope.Escape(out);
 }
@@ -141,17 +300,20 @@ v8::String::Utf8Value::Utf8Value(Local<v8::Value> obj)
         length_ = 0;
     } else {
         HandleScope scope(Isolate::GetCurrent());
-        Local<Context> context = OperatingContext(Isolate::GetCurrent());
-        JSValueRef value = ToJSValueRef(obj, context);
 
         JSValueRef exception = nullptr;
-        auto str = JSValueToStringCopy(ToContextRef(context), value, &exception);
-        if (exception) {
+        auto str = ToJSString(obj, &exception);
+        if (exception || !str) {
             str_ = nullptr;
+            length_ = 0;
         } else {
-            length_ = (int) JSStringGetMaximumUTF8CStringSize(str);
-            str_ = (char *) malloc(length_);
-            JSStringGetUTF8CString(str, str_, length_);
+            const JSChar *chars = JSStringGetCharactersPtr(str);
+            size_t len = JSStringGetLength(str);
+            // Sized exactly, rather than at JSC's worst case of three bytes a character
+            size_t size = Transcode::Utf8Length(chars, len);
+            str_ = (char *) malloc(size + 1);
+            length_ = (int) Transcode::Utf16ToUtf8(chars, len, str_, size);
+            str_[length_] = 0;
             JSStringRelease(str);
         }
     }
@@ -160,12 +322,10 @@ v8::String::Utf8Value::Utf8Value(Local<v8::Value> obj)
 v8::String::Value::Value(Local<v8::Value> obj)
 {
     HandleScope scope(Isolate::GetCurrent());
-    Local<Context> context = ToCurrentContext(*obj);
-    JSValueRef value = ToJSValueRef(obj, context);
     
     JSValueRef exception = nullptr;
-    JSStringRef s = JSValueToStringCopy(ToContextRef(context), value, &exception);
-    if (exception) {
+    JSStringRef s = ToJSString(obj, &exception);
+    if (exception || !s) {
         s = JSStringCreateWithUTF8CString("undefined");
     }
     length_ = (int) JSStringGetLength(s);
@@ -183,14 +343,7 @@ v8::String::Value::~Value()
  */
 int v8::String::Length() const
 {
-    HandleScope scope(Isolate::GetCurrent());
-    Local<Context> context = ToCurrentContext(this);
-    JSValueRef value = ToJSValueRef(this, context);
-
-    JSStringRef s = JSValueToStringCopy(ToContextRef(context), value, 0);
-    int r = (int) JSStringGetLength(s);
-    JSStringRelease(s);
-    return r;
+    return (int) JSStringGetLength(ToImpl<V82JSC::String>(this)->GetJSString());
 }
 
 /**
@@ -199,23 +352,9 @@ int v8::String::Length() const
  */
 int v8::String::Utf8Length() const
 {
-    HandleScope scope(Isolate::GetCurrent());
-
-    Local<Context> context = ToCurrentContext(this);
-    JSValueRef value = ToJSValueRef(this, context);
-    JSStringRef s = JSValueToStringCopy(ToContextRef(context), value, 0);
-    const JSChar * chars = JSStringGetCharactersPtr(s);
-    int len = (int)JSStringGetLength(s);
-    
-    int c = 0;
-    int i;
-    for (i=0; i<len; ) {
-        uint32_t unicode = (chars[i] >= 0xd800) ? (chars[i] - 0xd800) * 0x400 + (chars[i+1] - 0xdc00) : chars[i];
-        i += (chars[i] >= 0xd800) ? 2 : 1;
-        c += unicode >= 0x10000 ? 4 : unicode >= 0x800 ? 3 : unicode >= 0x80 ? 2 : 1;
-    }
-    JSStringRelease(s);
-    return c - (i-len);
+    auto impl = ToImpl<V82JSC::String>(this);
+    JSStringRef s = impl->GetJSString();
+    return (int) Transcode::Utf8Length(JSStringGetCharactersPtr(s), JSStringGetLength(s));
 }
 
 /**
@@ -236,21 +375,7 @@ bool v8::String::IsOneByte() const
  */
 bool v8::String::ContainsOnlyOneByte() const
 {
-    HandleScope scope(Isolate::GetCurrent());
-
-    Local<Context> context = ToCurrentContext(this);
-    JSValueRef value = ToJSValueRef(this, context);
-    JSStringRef s = JSValueToStringCopy(ToContextRef(context), value, 0);
-    if (!s) return false;
-
-    size_t len = JSStringGetLength(s);
-    const uint16_t *buffer = JSStringGetCharactersPtr(s);
-    for (size_t i = 0; i < len; i++ ) {
-        if (buffer[i] > 255) return false;
-    }
-    JSStringRelease(s);
-    
-    return true;
+    return ToImpl<V82JSC::String>(this)->IsOneByte();
 }
 
 /**
@@ -283,11 +408,7 @@ int v8::String::Write(uint16_t* buffer,
           int length,
           int options) const
 {
-    HandleScope scope(Isolate::GetCurrent());
-
-    Local<Context> context = ToCurrentContext(this);
-    JSValueRef value = ToJSValueRef(this, context);
-    JSStringRef s = JSValueToStringCopy(ToContextRef(context), value, 0);
+    JSStringRef s = ToImpl<V82JSC::String>(this)->GetJSString();
 
     const JSChar *str = JSStringGetCharactersPtr(s);
     size_t len = JSStringGetLength(s);
@@ -296,7 +417,6 @@ int v8::String::Write(uint16_t* buffer,
     len = length < len ? length : len;
     memcpy(buffer, str, sizeof(uint16_t) * len);
     
-    JSStringRelease(s);
     return (int) len;
 }
 // One byte characters.
@@ -305,20 +425,18 @@ int v8::String::WriteOneByte(uint8_t* buffer,
                  int length,
                  int options) const
 {
-    HandleScope scope(Isolate::GetCurrent());
+    JSStringRef s = ToImpl<V82JSC::String>(this)->GetJSString();
 
-    Local<Context> context = ToCurrentContext(this);
-    JSValueRef value = ToJSValueRef(this, context);
-    JSStringRef s = JSValueToStringCopy(ToContextRef(context), value, 0);
-
-    size_t len = JSStringGetMaximumUTF8CStringSize(s);
-    char str[len];
-    JSStringGetUTF8CString(s, str, len);
+    // One-byte characters are just the low byte of each UTF-16 code unit
+    const JSChar *str = JSStringGetCharactersPtr(s);
+    size_t len = JSStringGetLength(s);
+    str = &str[start];
     len -= start;
     len = length < len ? length : len;
-    memcpy(buffer, &str[start], sizeof(uint8_t) * len);
+    for (size_t i = 0; i < len; i++) {
+        buffer[i] = (uint8_t) str[i];
+    }
     
-    JSStringRelease(s);
     return (int) len;
 }
 // UTF-8 encoded characters.
@@ -327,26 +445,23 @@ int v8::String::WriteUtf8(char* buffer,
               int* nchars_ref,
               int options) const
 {
-    HandleScope scope(Isolate::GetCurrent());
-
-    Local<Context> context = ToCurrentContext(this);
-    JSValueRef value = ToJSValueRef(this, context);
-    JSStringRef s = JSValueToStringCopy(ToContextRef(context), value, 0);
+    auto impl = ToImpl<V82JSC::String>(this);
+    JSStringRef s = impl->GetJSString();
 
-    if (length < 0) {
-        length = (int) JSStringGetMaximumUTF8CStringSize(s);
-    }
-    // FIXME: This is an annoying inefficiency.  JSC needs the null-terminator to be
-    // part of buffer length, but V8 does not.  So we allocate one additional byte and
-    // then copy back the correct number.
-    char temp[length + 1];
-    size_t chars = JSStringGetUTF8CString(s, temp, length+1);
-    memcpy(buffer, temp, length);
+    // Encoded straight into the buffer.  JSC's own encoder wants room for a terminator that
+    // V8 doesn't, and can't say how many characters made it when the buffer is short.
+    const JSChar *chars = JSStringGetCharactersPtr(s);
+    size_t len = JSStringGetLength(s);
+    size_t capacity = length < 0 ? Transcode::Utf8Length(chars, len) + 1 : length;
+    size_t nchars;
+    size_t written = Transcode::Utf16ToUtf8(chars, len, buffer, capacity, &nchars);
+    if (written < capacity && !(options & NO_NULL_TERMINATION)) {
+        buffer[written] = 0;
+    }
     if (nchars_ref) {
-        *nchars_ref = (int) JSStringGetLength(s);
+        *nchars_ref = (int) nchars;
     }
-    JSStringRelease(s);
-    return (int) chars - 1;
+    return (int) written;
 }
 
 /**
@@ -431,29 +546,20 @@ Local<v8::String> v8::String::Concat(Local<String> left, Local<String> right)
 {
     EscapableHandleScope scope(Isolate::GetCurrent());
 
-    if (left->Length() + right->Length() > v8::String::kMaxLength) {
+    // Let JSC do the concatenation.  It builds a rope and only flattens it if someone actually
+    // reads the characters, so repeated concatenation is linear and nothing is copied here.
+    // JSC throws if the result would be too long, which gives the same empty result as V8.
+    Local<Context> context = ToCurrentContext(*left);
+    JSValueRef args[] = {
+        ToJSValueRef(left, context),
+        ToJSValueRef(right, context)
+    };
+    JSValueRef exception = 0;
+    JSValueRef concatted = exec(ToContextRef(context), "return _1 + _2", 2, args, &exception);
+    if (exception) {
         return Local<String>();
     }
-    Local<Context> context = ToCurrentContext(*left);
-    IsolateImpl* iso = ToIsolateImpl(ToContextImpl(context));
-    JSValueRef left_ = ToJSValueRef(left, context);
-    JSValueRef right_ = ToJSValueRef(right, context);
-
-    JSStringRef sleft = JSValueToStringCopy(ToContextRef(context), left_, 0);
-    JSStringRef sright = JSValueToStringCopy(ToContextRef(context), right_, 0);
-
-    size_t length_left = JSStringGetLength(sleft);
-    size_t length_right = JSStringGetLength(sright);
-    uint16_t concat[length_left + length_right];
-    memcpy(concat, JSStringGetCharactersPtr(sleft), sizeof(uint16_t) * length_left);
-    memcpy(&concat[length_left], JSStringGetCharactersPtr(sright), sizeof(uint16_t) * length_right);
-    Isolate *isolate = ToIsolate(iso);
-    JSStringRef concatted = JSStringCreateWithCharacters(concat,length_left+length_right);
-    Local<String> ret = V82JSC::String::New(isolate, concatted);
-    JSStringRelease(sleft);
-    JSStringRelease(sright);
-    JSStringRelease(concatted);
-    return scope.Escape(ret);
+    return scope.Escape(V82JSC::Value::New(ToContextImpl(context), concatted).As<String>());
 }
 
 /**
@@ -471,9 +577,14 @@ MaybeLocal<v8::String> v8::String::NewExternalTwoByte(Isolate* isolate, String::
     if (resource->length() > v8::String::kMaxLength) {
         return MaybeLocal<String>();
     }
-    return scope.Escape(V82JSC::String::New(isolate,
-            JSStringCreateWithCharacters(resource->data(), resource->length()),
-            ToIsolateImpl(isolate)->m_external_string_map, resource));
+    IsolateImpl *iso = ToIsolateImpl(isolate);
+    ExternalStringFinalizer *finalizer;
+    JSStringRef str = V82JSC::ExternalString::Create(iso, resource, resource->data(), resource->length(),
+                                                     false, &finalizer);
+    Local<String> s = V82JSC::String::New(isolate, str, iso->m_external_string_map, resource);
+    V82JSC::ExternalString::Track(iso, ToImpl<V82JSC::String>(s)->m_value, resource,
+                                  iso->m_external_string_map, finalizer);
+    return scope.Escape(s);
 }
 
 /**
@@ -495,9 +606,12 @@ bool v8::String::MakeExternal(v8::String::ExternalStringResource* resource)
     }
     auto impl = ToImpl<V82JSC::Value,String>(this);
     auto iso = ToIsolateImpl(impl);
+    if (V82JSC::ExternalString::Lookup(iso, impl->m_value)) {
+        return false;
+    }
     impl->m_map = ToV8Map(iso->m_external_string_map);
 
-    V82JSC::WeakExternalString::Init(iso, impl->m_value, resource, iso->m_weak_external_string_map);
+    V82JSC::ExternalString::Track(iso, impl->m_value, resource, iso->m_external_string_map);
 
     * reinterpret_cast<ExternalStringResource**>(reinterpret_cast<intptr_t>(impl) +
                                internal::Internals::kStringResourceOffset) = resource;
@@ -520,12 +634,13 @@ MaybeLocal<v8::String> v8::String::NewExternalOneByte(Isolate* isolate, External
     if (resource->length() > v8::String::kMaxLength) {
         return MaybeLocal<String>();
     }
-    uint16_t *str = (uint16_t*) calloc(sizeof (uint16_t), resource->length());
-    for (int i=0; i<resource->length(); i++) str[i] = resource->data()[i];
-
-    Local<String> s = V82JSC::String::New(isolate, JSStringCreateWithCharacters(str, resource->length()),
-                                      ToIsolateImpl(isolate)->m_external_one_byte_string_map, resource);
-    delete str;
+    IsolateImpl *iso = ToIsolateImpl(isolate);
+    ExternalStringFinalizer *finalizer;
+    JSStringRef str = V82JSC::ExternalString::Create(iso, resource, resource->data(), resource->length(),
+                                                     true, &finalizer);
+    Local<String> s = V82JSC::String::New(isolate, str, iso->m_external_one_byte_string_map, resource);
+    V82JSC::ExternalString::Track(iso, ToImpl<V82JSC::String>(s)->m_value, resource,
+                                  iso->m_external_one_byte_string_map, finalizer);
     return scope.Escape(s);
 }
 
@@ -548,9 +663,12 @@ bool v8::String::MakeExternal(ExternalOneByteStringResource* resource)
     }
     auto impl = ToImpl<V82JSC::String>(this);
     auto iso = ToIsolateImpl(impl);
+    if (V82JSC::ExternalString::Lookup(iso, impl->m_value)) {
+        return false;
+    }
     impl->m_map = ToV8Map(iso->m_external_one_byte_string_map);
 
-    V82JSC::WeakExternalString::Init(iso, impl->m_value, resource, iso->m_weak_external_one_byte_string_map);
+    V82JSC::ExternalString::Track(iso, impl->m_value, resource, iso->m_external_one_byte_string_map);
     
     * reinterpret_cast<ExternalOneByteStringResource**>(reinterpret_cast<intptr_t>(impl) +
                                                  internal::Internals::kStringResourceOffset) = resource;
@@ -569,19 +687,3 @@ bool v8::String::CanMakeExternal()
     return false;
 #endif
 }
-
-void V82JSC::WeakExternalString::Init(IsolateImpl* iso,
-                                      JSValueRef value,
-                                      v8::String::ExternalStringResourceBase *resource,
-                                      BaseMap *map)
-{
-    HandleScope scope(ToIsolate(iso));
-    auto ext = static_cast<WeakExternalString*>(HeapAllocator::Alloc(iso, map));
-    ext->m_value = value;
-    ext->m_weakRef = JSCPrivate::JSWeakCreate(iso->m_group, (JSObjectRef)value);
-    ext->m_resource = resource;
-    assert(JSCPrivate::JSWeakGetObject(ext->m_weakRef) == (JSObjectRef)value);
-    Local<v8::WeakExternalString> wes = CreateLocal<v8::WeakExternalString>(&iso->ii, ext);
-    iso->m_external_strings[ext->m_value].Reset(ToIsolate(iso), wes);
-}
-
@@ -13,15 +13,23 @@
 namespace V82JSC {
 
 struct String : Value {
+    JSStringRef m_string; // The characters of m_value, copied out the first time they are needed
+    int m_one_byte;       // 1 if m_string is all Latin-1, -1 if it isn't, 0 if we haven't looked yet
+
     static void Constructor(String *obj)
     {
         Value::Constructor(obj);
     }
     static int Destructor(HeapContext& context, String *obj)
     {
+        if (obj->m_string) JSStringRelease(obj->m_string);
         return Value::Destructor(context, obj);
     }
 
+    // Strings are immutable, so these are only worked out once per string
+    JSStringRef GetJSString();
+    bool IsOneByte();
+
     static v8::Local<v8::String> New(
       v8::Isolate *isolate,
       JSStringRef string,
@@ -31,26 +39,10 @@ struct String : Value {
     );
 };
 
-struct WeakExternalString : WeakValue {
-    JSCPrivate::JSWeakRef m_weakRef;
+struct ExternalStringFinalizer {
+    IsolateImpl *m_isolate;
+    JSValueRef m_value;
     v8::String::ExternalStringResourceBase *m_resource;
-    
-    static void Constructor(WeakExternalString *obj)
-    {
-        Value::Constructor(obj);
-    }
-    static int Destructor(HeapContext& context, WeakExternalString *obj)
-    {
-        if (obj->m_weakRef) JSCPrivate::JSWeakRelease(obj->GetContextGroup(), obj->m_weakRef);
-        obj->FinalizeExternalString();
-        return WeakValue::Destructor(context, obj);
-    }
-    void FinalizeExternalString();
-
-    static void Init(IsolateImpl* iso,
-                     JSValueRef value,
-                     v8::String::ExternalStringResourceBase *resource,
-                     V82JSC::BaseMap* map);
 };
     
 } /* namespace V82JSC */
@@ -33,6 +33,7 @@ void v8::Template::Set(Local<Name> name, Local<Data> value, PropertyAttribute at
     prop->next_.Reset(isolate, this_->m_properties.Get(isolate));
     Local<v8::Prop> local = CreateLocal<v8::Prop>(isolate, prop);
     this_->m_properties.Reset(isolate, local);
+    this_->m_revision ++;
 }
 void v8::Template::SetPrivate(Local<Private> name, Local<Data> value, PropertyAttribute attributes)
 {
@@ -61,6 +62,7 @@ void v8::Template::SetAccessorProperty(
     accessor->next_.Reset(isolate, this_->m_property_accessors.Get(isolate));
     Local<v8::PropAccessor> local = CreateLocal<v8::PropAccessor>(isolate, accessor);
     this_->m_property_accessors.Reset(isolate, local);
+    this_->m_revision ++;
 }
 
 /**
@@ -143,6 +145,7 @@ void v8::Template::SetIntrinsicDataProperty(Local<Name> name, Intrinsic intrinsi
     prop->next_.Reset(isolate, templ->m_intrinsics.Get(isolate));
     Local<v8::IntrinsicProp> local = CreateLocal<v8::IntrinsicProp>(isolate, prop);
     templ->m_intrinsics.Reset(isolate, local);
+    templ->m_revision ++;
 
     prop->name.Reset(isolate, name);
     prop->value = intrinsic;
@@ -213,7 +216,7 @@ static T callAsCallback(JSContextRef ctx,
     
     ++ thread->m_callback_depth;
 
-    Local<v8::Value> data = V82JSC::Value::New(ctximpl, templ->m_data);
+    Local<v8::Value> data = templ->m_data.Get(isolate);
     typedef v8::internal::Heap::RootListIndex R;
     internal::Object *the_hole = iso->ii.heap()->root(R::kTheHoleValueRootIndex);
     internal::Object *target = iso->ii.heap()->root(R::kUndefinedValueRootIndex);
@@ -412,10 +415,18 @@ MaybeLocal<Object> V82JSC::Template::InitInstance(Local<v8::Context> context, JS
                                   accessor->settings);
     }
     
+    // Those the instance's class already has as static values are left out
+    V82JSC::ObjectTemplate *statics = nullptr;
+    if (wrap && wrap->m_native_accessors && !wrap->m_object_template.IsEmpty()) {
+        auto otempl = ToImpl<V82JSC::ObjectTemplate>(wrap->m_object_template.Get(isolate));
+        if (static_cast<Template*>(otempl) == this) statics = otempl;
+    }
     std::vector<ObjAccessor*> accessors;
     for (auto i=m_accessors.Get(isolate); !i.IsEmpty(); ) {
         auto accessor = ToImpl<V82JSC::ObjAccessor>(i);
-        accessors.push_back(accessor);
+        if (!statics || !statics->IsStatic(accessor)) {
+            accessors.push_back(accessor);
+        }
         i = accessor->next_.Get(isolate);
     }
     for (auto i=accessors.rbegin(); i!=accessors.rend(); ++i) {
@@ -107,7 +107,8 @@ struct Signature : HeapObject {
 };
 
 struct Template : HeapObject {
-    JSValueRef m_data;
+    // Held as a handle so that each callback can pass it on as is
+    v8::Persistent<v8::Value> m_data;
     v8::Persistent<v8::Prop> m_properties;
     v8::Persistent<v8::PropAccessor> m_property_accessors;
     v8::Persistent<v8::ObjAccessor> m_accessors;
@@ -116,11 +117,14 @@ struct Template : HeapObject {
     v8::Persistent<v8::ObjectTemplate> m_prototype_template;
     v8::Persistent<v8::FunctionTemplate> m_parent;
     v8::FunctionCallback m_callback;
+    // Bumped whenever something is added to the lists above
+    int m_revision;
     
     static void Constructor(Template *obj) {}
     static int Destructor(HeapContext& context, Template *obj)
     {
         int freed=0;
+        freed +=SmartReset<v8::Value>(context, obj->m_data);
         freed +=SmartReset<v8::Prop>(context, obj->m_properties);
         freed +=SmartReset<v8::PropAccessor>(context, obj->m_property_accessors);
         freed +=SmartReset<v8::ObjAccessor>(context, obj->m_accessors);
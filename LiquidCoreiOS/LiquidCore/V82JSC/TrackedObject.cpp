@@ -8,6 +8,7 @@
 #include "JSCPrivate.h"
 #include "ObjectTemplate.h"
 #include "Object.h"
+#include <mutex>
 
 using namespace V82JSC;
 using namespace v8;
@@ -20,37 +21,79 @@ V82JSC::TrackedObject* V82JSC::TrackedObject::makePrivateInstance(IsolateImpl* i
     return impl;
 }
 
+FixedArray* V82JSC::TrackedObject::InternalFields()
+{
+    if (m_internal_fields.IsEmpty()) {
+        IsolateImpl *iso = GetIsolate();
+        Isolate *isolate = ToIsolate(iso);
+        HandleScope scope(isolate);
+        // Fields of API-created ArrayBuffers start out as a null External, like they do in V8
+        Local<v8::Value> init = ArrayBufferInfo.iso ?
+            Local<v8::Value>(External::New(isolate, nullptr)) : Local<v8::Value>(Undefined(isolate));
+        auto fields = reinterpret_cast<FixedArray*>
+            (HeapAllocator::Alloc(iso, iso->m_fixed_array_map,
+                                  sizeof(FixedArray) + m_num_internal_fields * sizeof(v8::internal::Object*)));
+        fields->m_size = m_num_internal_fields;
+        for (int i=0; i<m_num_internal_fields; i++) {
+            fields->m_elements[i] = *reinterpret_cast<v8::internal::Object**>(*init);
+        }
+        m_internal_fields.Reset(isolate, CreateLocal<v8::EmbeddedFixedArray>(isolate, fields));
+    }
+    v8::internal::Object **persistent = *reinterpret_cast<v8::internal::Object***>(&m_internal_fields);
+    return static_cast<FixedArray*>(FromHeapPointer(*persistent));
+}
+
+void V82JSC::TrackedObject::AddAlias(JSValueRef alias)
+{
+    IsolateImpl *iso = GetIsolate();
+    auto& entry = iso->m_tracked_objects[(JSObjectRef)alias];
+    if (entry.m_weakRef) {
+        JSCPrivate::JSWeakRelease(iso->m_group, entry.m_weakRef);
+    }
+    entry.m_weakRef = JSCPrivate::JSWeakCreate(iso->m_group, (JSObjectRef)alias);
+    entry.m_tracked = this;
+}
+
+V82JSC::TrackedObject* V82JSC::TrackedObject::lookupAlias(IsolateImpl* iso, JSObjectRef object)
+{
+    auto it = iso->m_tracked_objects.find(object);
+    if (it == iso->m_tracked_objects.end()) return nullptr;
+    if (JSCPrivate::JSWeakGetObject(it->second.m_weakRef) != object) {
+        // The alias was collected and this is a new object at the same address
+        JSCPrivate::JSWeakRelease(iso->m_group, it->second.m_weakRef);
+        iso->m_tracked_objects.erase(it);
+        return nullptr;
+    }
+    return it->second.m_tracked;
+}
+
+void V82JSC::TrackedObject::removeAlias(IsolateImpl* iso, TrackedObject* impl, JSValueRef alias)
+{
+    auto it = iso->m_tracked_objects.find((JSObjectRef)alias);
+    if (alias && it != iso->m_tracked_objects.end() && it->second.m_tracked == impl) {
+        JSCPrivate::JSWeakRelease(iso->m_group, it->second.m_weakRef);
+        iso->m_tracked_objects.erase(it);
+    }
+}
+
 void V82JSC::TrackedObject::setPrivateInstance(IsolateImpl* iso, JSContextRef ctx, TrackedObject* impl, JSObjectRef object)
 {
     HandleScope scope(ToIsolate(iso));
     // Keep only a weak reference to m_security to avoid cyclical references
     impl->m_security = object;
+    impl->AddAlias(object);
     
     Local<TrackedObject> to = CreateLocal<TrackedObject>(&iso->ii, impl);
     void * data = PersistentData<TrackedObject>(ToIsolate(iso), to);
     
-    JSClassDefinition def = kJSClassDefinitionEmpty;
-    def.attributes = kJSClassAttributeNoAutomaticPrototype;
-    def.finalize = [](JSObjectRef object) {
-        void * persistent = JSObjectGetPrivate(object);
-        assert(persistent);
-        auto location = (v8::internal::Object **)persistent;
-        IsolateImpl *iso = IsolateImpl::getIsolateFromGlobalHandle(location);
-        if (!iso) return;
-
-        HandleScope scope(ToIsolate(iso));
-        Local<TrackedObject> local = FromPersistentData<TrackedObject>(ToIsolate(iso), persistent);
-        assert(!local.IsEmpty());
-        TrackedObject *impl = ToImpl<TrackedObject>(local);
-        JSGlobalContextRef gctx = JSContextGetGlobalContext(ToContextRef(iso->m_nullContext.Get(ToIsolate(iso))));
-        iso->weakJSObjectFinalized(gctx, (JSObjectRef) impl->m_security);
-        
-        ReleasePersistentData<TrackedObject>(persistent);
-    };
-    JSClassRef klass = JSClassCreate(&def);
-    JSObjectRef private_object = JSObjectMake(ctx, klass, data);
-    JSClassRelease(klass);
+    JSObjectRef private_object = JSObjectMake(ctx, LifecycleClass(), data);
 
+    if (__builtin_available(macOS 10.15, iOS 13.0, *)) {
+        JSValueRef excp = 0;
+        JSObjectSetPropertyForKey(ctx, object, iso->m_private_symbol, private_object,
+                                  kJSPropertyAttributeDontEnum, &excp);
+        if (!excp) return;
+    }
     JSValueRef args[] = {
         object, private_object, iso->m_private_symbol
     };
@@ -60,6 +103,40 @@ void V82JSC::TrackedObject::setPrivateInstance(IsolateImpl* iso, JSContextRef ct
                  3, args);
 }
 
+// The same for every object, so made only once
+JSClassRef V82JSC::TrackedObject::LifecycleClass()
+{
+    static JSClassRef s_class = nullptr;
+    static std::once_flag s_once;
+    std::call_once(s_once, []() {
+        JSClassDefinition def = kJSClassDefinitionEmpty;
+        def.attributes = kJSClassAttributeNoAutomaticPrototype;
+        def.finalize = [](JSObjectRef object) {
+            void * persistent = JSObjectGetPrivate(object);
+            assert(persistent);
+            auto location = (v8::internal::Object **)persistent;
+            IsolateImpl *iso = IsolateImpl::getIsolateFromGlobalHandle(location);
+            if (!iso) return;
+
+            HandleScope scope(ToIsolate(iso));
+            Local<TrackedObject> local = FromPersistentData<TrackedObject>(ToIsolate(iso), persistent);
+            assert(!local.IsEmpty());
+            TrackedObject *impl = ToImpl<TrackedObject>(local);
+            JSGlobalContextRef gctx = JSContextGetGlobalContext(ToContextRef(iso->m_nullContext.Get(ToIsolate(iso))));
+            iso->weakJSObjectFinalized(gctx, (JSObjectRef) impl->m_security);
+            // Anything proxying the object is gone too.  Stale access proxy entries are caught by their
+            // weak references.
+            removeAlias(iso, impl, impl->m_security);
+            removeAlias(iso, impl, impl->m_proxy_security);
+            removeAlias(iso, impl, impl->m_hidden_proxy_security);
+        
+            ReleasePersistentData<TrackedObject>(persistent);
+        };
+        s_class = JSClassCreate(&def);
+    });
+    return s_class;
+}
+
 
 V82JSC::TrackedObject* V82JSC::TrackedObject::makePrivateInstance(IsolateImpl* iso, JSContextRef ctx, JSObjectRef object)
 {
@@ -73,43 +150,19 @@ V82JSC::TrackedObject* V82JSC::TrackedObject::makePrivateInstance(IsolateImpl* i
 
 V82JSC::TrackedObject* V82JSC::TrackedObject::getPrivateInstance(JSContextRef ctx, JSObjectRef object)
 {
+    if (!object || !JSValueIsObject(ctx, object)) return nullptr;
     IsolateImpl *iso = IsolateFromCtx(ctx);
-    HandleScope scope(ToIsolate(iso));
-    //JSObjectRef maybe_proxy_object = JSObjectGetProxyTarget(object);
-    JSValueRef args[] = {
-        /*maybe_proxy_object ? maybe_proxy_object :*/ object,
-        iso->m_private_symbol
-    };
-    JSObjectRef private_object = (JSObjectRef) exec(ctx, "return _1[_2]", 2, args);
-    if (JSValueIsObject(ctx, private_object)) {
-        void * persistent = JSObjectGetPrivate(private_object);
-        if (!persistent) return nullptr;
-
-        Local<TrackedObject> local = FromPersistentData<TrackedObject>(ToIsolate(iso), persistent);
-        assert(!local.IsEmpty());
-        TrackedObject *impl = ToImpl<TrackedObject>(local);
-
-        JSValueRef hasargs[] = {
-            impl->m_access_proxies,
-            impl->m_global_object_access_proxies,
-            object
-        };
-        
-        if ((JSValueIsStrictEqual(ctx, object, impl->m_security) ||
-             (impl->m_proxy_security && JSValueIsStrictEqual(ctx, object, impl->m_proxy_security)) ||
-             (impl->m_hidden_proxy_security && JSValueIsStrictEqual(ctx, object, impl->m_hidden_proxy_security)) ||
-             (impl->m_access_proxies && exec(ctx, "return _1.includes(_3)", 3, hasargs)) ||
-             (impl->m_global_object_access_proxies && exec(ctx, "return _2.includes(_3)", 3, hasargs)) )) {
-        
-            return impl;
-        } else if (impl->m_isGlobalObject) {
-            JSObjectRef proto = object;
-            while (JSValueIsObject(ctx, proto)) {
-                if (JSValueIsStrictEqual(ctx, proto, impl->m_security) || JSValueIsStrictEqual(ctx, proto, impl->m_proxy_security)) {
-                    return impl;
-                }
-                proto = (JSObjectRef) JSObjectGetPrototype(ctx, proto);
+    
+    // Global objects also claim the objects that inherit from them
+    for (JSObjectRef proto = object; JSValueIsObject(ctx, proto);
+         proto = (JSObjectRef) JSObjectGetPrototype(ctx, proto)) {
+        TrackedObject *impl = lookupAlias(iso, proto);
+        if (impl) {
+            if (proto == object ||
+                (impl->m_isGlobalObject && (proto == impl->m_security || proto == impl->m_proxy_security))) {
+                return impl;
             }
+            return nullptr;
         }
     }
     return nullptr;
@@ -118,6 +171,7 @@ V82JSC::TrackedObject* V82JSC::TrackedObject::getPrivateInstance(JSContextRef ct
 Local<v8::Value> V82JSC::TrackedObject::SecureValue(Local<v8::Value> in, Local<v8::Context> toContext)
 {
     Isolate* isolate = Isolate::GetCurrent();
+    if (ToIsolateImpl(isolate)->m_trusted) return in;
     EscapableHandleScope scope(isolate);
 
 #if USE_JAVASCRIPTCORE_PRIVATE_API
@@ -434,6 +488,7 @@ Local<v8::Value> V82JSC::TrackedObject::SecureValue(Local<v8::Value> in, Local<v
         };
         JSValueRef out_value = exec(ctx, security_proxy, 2, args);
         wrap = makePrivateInstance(ToIsolateImpl(isolate), ctx, (JSObjectRef)in_value);
+        wrap->AddAlias(out_value);
         
         if (isActualGlobalObject) {
             if (!wrap->m_global_object_access_proxies) {
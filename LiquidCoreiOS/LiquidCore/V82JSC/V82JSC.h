@@ -11,6 +11,7 @@
 #include "Context.h"
 #include "Value.h"
 #include "JSCPrivate.h"
+#include "TraceSpan.h"
 
 using v8::internal::IsolateImpl;
 
@@ -240,18 +241,30 @@ inline v8::Local<v8::Context> ToCurrentContext(const T* thiz)
 
 JSObjectRef make_exec_function(JSGlobalContextRef ctx, const char *body, int argc);
 
+// Collects a Map's (key, value) pairs, or a Set's values, into a new array using 'forEach'
+JSObjectRef CollectionAsArray(JSContextRef ctx, JSObjectRef collection, JSObjectRef forEach, bool pairs);
+
 inline JSValueRef exec(JSContextRef ctx, const char *body, int argc,
                               const JSValueRef *argv, JSValueRef *pexcp=nullptr)
 {
+    TRACE_SPAN("V82JSC exec");
     JSGlobalContextRef gctx = JSContextGetGlobalContext(ctx);
-    IsolateImpl* iso;
-    {
-        std::unique_lock<std::mutex> lk(IsolateImpl::s_isolate_mutex);
-        iso = IsolateImpl::s_context_to_isolate_map[gctx];
+    IsolateImpl::ExecCache& cache = IsolateImpl::t_exec_cache;
+    int epoch = IsolateImpl::s_exec_epoch.load(std::memory_order_acquire);
+    if (cache.m_gctx != gctx || cache.m_epoch != epoch) {
+        IsolateImpl* iso;
+        {
+            std::unique_lock<std::mutex> lk(IsolateImpl::s_isolate_mutex);
+            iso = IsolateImpl::s_context_to_isolate_map[gctx];
+        }
+        cache.m_gctx = gctx;
+        cache.m_functions = &iso->m_exec_maps[gctx];
+        cache.m_epoch = epoch;
     }
-    JSObjectRef function = iso->m_exec_maps[gctx].count(body) == 0 ?
+    auto it = cache.m_functions->find(body);
+    JSObjectRef function = it == cache.m_functions->end() ?
         make_exec_function(gctx, body, argc) :
-        iso->m_exec_maps[gctx][body];
+        it->second;
 
     JSValueRef exception = 0;
     JSValueRef result = JSObjectCallAsFunction(ctx, function, 0, argc, argv, &exception);
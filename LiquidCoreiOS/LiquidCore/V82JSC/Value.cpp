@@ -30,6 +30,85 @@ inline bool is__(const v8::Value* thiz, const char *code_)
 }
 #define IS(name_,code_) bool v8::Value::name_() const { return is__(this, code_); }
 
+// The TypeInfo bits the C API can tell us about 'value'
+static uint32_t BasicTypeInfo(JSContextRef ctx, JSValueRef value)
+{
+    uint32_t info = Value::kTypeInfoBasic;
+    if (!JSValueIsObject(ctx, value)) return info;
+    if (JSObjectIsFunction(ctx, (JSObjectRef)value)) info |= Value::kTypeFunction;
+    JSTypedArrayType type = JSValueGetTypedArrayType(ctx, value, nullptr);
+    if (type == kJSTypedArrayTypeArrayBuffer) {
+        info |= Value::kTypeArrayBuffer;
+    } else if (type != kJSTypedArrayTypeNone) {
+        info |= Value::kTypeTypedArray | (static_cast<uint32_t>(type) << Value::kTypedArrayTypeShift);
+    }
+    return info;
+}
+
+// Returns the TypeInfo bits for an object or symbol (or 0 for anything else), working out and
+// caching the requested class of bits on first use.  V8 answers these from an object's instance
+// type, which can't change, so neither do ours.
+static uint32_t GetTypeInfo(const v8::Value* thiz, uint32_t needed)
+{
+    v8::internal::Object *obj = * reinterpret_cast<v8::internal::Object**>(const_cast<v8::Value*>(thiz));
+    if (obj->IsSmi()) return 0;
+    auto impl = reinterpret_cast<Value*>(reinterpret_cast<intptr_t>(obj) - v8::internal::kHeapObjectTag);
+    if (impl->m_map == obj) return 0; // oddball
+    IsolateImpl *iso = ToIsolateImpl(impl);
+    if (impl->m_map == ToV8Map(iso->m_symbol_map)) {
+        return Value::kTypeInfoBasic | Value::kTypeInfoExtended | Value::kTypeSymbol;
+    }
+    if (impl->m_map != ToV8Map(iso->m_value_map) && impl->m_map != ToV8Map(iso->m_array_buffer_map) &&
+        impl->m_map != ToV8Map(iso->m_promise_resolver_map) && impl->m_map != ToV8Map(iso->m_weak_value_map)) {
+        return 0;
+    }
+    if ((impl->m_type_info & needed) == needed) return impl->m_type_info;
+
+    v8::HandleScope scope(ToIsolate(iso));
+    v8::Local<v8::Context> context = ToCurrentContext(thiz);
+    JSContextRef ctx = ToContextRef(context);
+    if (!(impl->m_type_info & Value::kTypeInfoBasic)) {
+        impl->m_type_info |= BasicTypeInfo(ctx, impl->m_value);
+    }
+    if ((needed & Value::kTypeInfoExtended) && !(impl->m_type_info & Value::kTypeInfoExtended)) {
+        JSValueRef exception = 0;
+        JSValueRef bits = exec(ctx,
+                               "var t = Object.prototype.toString.call(_1);"
+                               "return (t === '[object DataView]'         ? 1 : 0) |"
+                               "       (_1 instanceof Map                 ? 2 : 0) |"
+                               "       (_1 instanceof Set                 ? 4 : 0) |"
+                               "       (_1 instanceof WeakMap             ? 8 : 0) |"
+                               "       (_1 instanceof WeakSet             ? 16 : 0) |"
+                               "       (Promise.resolve(_1) === _1        ? 32 : 0) |"
+                               "       (t === '[object RegExp]'           ? 64 : 0) |"
+                               "       (_1 instanceof Error               ? 128 : 0)",
+                               1, &impl->m_value, &exception);
+        if (exception) return impl->m_type_info;
+        uint32_t b = static_cast<uint32_t>(JSValueToNumber(ctx, bits, 0));
+        static const uint32_t flags[] = {
+            Value::kTypeDataView, Value::kTypeMap, Value::kTypeSet, Value::kTypeWeakMap,
+            Value::kTypeWeakSet, Value::kTypePromise, Value::kTypeRegExp, Value::kTypeNativeError
+        };
+        uint32_t info = Value::kTypeInfoExtended;
+        for (unsigned i=0; i<sizeof(flags)/sizeof(uint32_t); i++) {
+            if (b & (1 << i)) info |= flags[i];
+        }
+        impl->m_type_info |= info;
+    }
+    return impl->m_type_info;
+}
+#define IS_TYPE(name_,class_,flag_) \
+    bool v8::Value::name_() const { return GetTypeInfo(this, V82JSC::Value::class_) & V82JSC::Value::flag_; }
+
+static bool IsTypedArrayOfType(const v8::Value* thiz, JSTypedArrayType type)
+{
+    uint32_t info = GetTypeInfo(thiz, Value::kTypeInfoBasic);
+    return (info & Value::kTypeTypedArray) &&
+        ((info >> Value::kTypedArrayTypeShift) & 0xff) == static_cast<uint32_t>(type);
+}
+#define IS_TYPED_ARRAY(name_,type_) \
+    bool v8::Value::name_() const { return IsTypedArrayOfType(this, type_); }
+
 Local<v8::Value> Value::New(const Context *ctx, JSValueRef value, BaseMap *map)
 {
     JSType t = JSValueGetType(ctx->m_ctxRef, value);
@@ -42,6 +121,7 @@ Local<v8::Value> Value::New(const Context *ctx, JSValueRef value, BaseMap *map)
     Local<v8::Context> context = CreateLocal<v8::Context>(isolate, const_cast<Context*>(ctx));
     
     double num = 0.0;
+    uint32_t type_info = 0;
     if (!map) {
         switch (t) {
             case kJSTypeUndefined: {
@@ -60,12 +140,7 @@ Local<v8::Value> Value::New(const Context *ctx, JSValueRef value, BaseMap *map)
                 return scope.Escape(CreateLocal<v8::Value>(isolate, FromHeapPointer(io)));
             }
             case kJSTypeString: {
-                if (isolateimpl->m_external_strings.count(value) == 1) {
-                    Local<v8::WeakExternalString> wes = isolateimpl->m_external_strings[value].Get(isolate);
-                    auto ext = ToImpl<WeakExternalString>(wes);
-                    map = reinterpret_cast<BaseMap*>(FromHeapPointer(ext->m_map));
-                    resource = ext->m_resource;
-                } else {
+                if (!ExternalString::Lookup(isolateimpl, value, &map, &resource)) {
                     map = isolateimpl->m_string_map;
                 }
                 break;
@@ -89,12 +164,14 @@ Local<v8::Value> Value::New(const Context *ctx, JSValueRef value, BaseMap *map)
                 }
                 JSValueRef proxyless = JSCPrivate::JSObjectGetProxyTarget(context, (JSObjectRef)value);
                 if (proxyless == 0) proxyless = value;
-                JSValueRef exception = 0;
-                JSValueRef isArrayBuffer = exec(ctx->m_ctxRef, "return _1 instanceof ArrayBuffer", 1, &proxyless, &exception);
-                if (!exception && JSValueToBoolean(ctx->m_ctxRef, isArrayBuffer)) {
+                type_info = BasicTypeInfo(ctx->m_ctxRef, value);
+                if (proxyless == value ? (type_info & kTypeArrayBuffer) :
+                    JSValueGetTypedArrayType(ctx->m_ctxRef, proxyless, nullptr) == kJSTypedArrayTypeArrayBuffer) {
                     map = isolateimpl->m_array_buffer_map;
+                } else if (type_info & (kTypeFunction | kTypeTypedArray)) {
+                    map = isolateimpl->m_value_map;
                 } else {
-                    exception = 0;
+                    JSValueRef exception = 0;
                     JSValueRef isSymbol = exec(ctx->m_ctxRef, "return typeof _1 === 'symbol'", 1, &proxyless, &exception);
                     if (!exception && JSValueToBoolean(ctx->m_ctxRef, isSymbol)) {
                         map = isolateimpl->m_symbol_map;
@@ -119,11 +196,12 @@ Local<v8::Value> Value::New(const Context *ctx, JSValueRef value, BaseMap *map)
     
     auto impl = static_cast<Value *>(HeapAllocator::Alloc(isolateimpl, map));
     impl->m_value = value;
+    impl->m_type_info = type_info;
     if (t == kJSTypeString) {
         * reinterpret_cast<void**>(reinterpret_cast<intptr_t>(impl) +
                                    v8::internal::Internals::kStringResourceOffset) = resource;
     }
-    JSValueProtect(ctx->m_ctxRef, impl->m_value);
+    Root(ctx->m_ctxRef, impl->m_value);
     if (t == kJSTypeNumber) {
         reinterpret_cast<v8::internal::HeapNumber*>(ToHeapPointer(impl))->set_value(num);
     }
@@ -163,12 +241,12 @@ bool v8::Value::IsName() const { return IsString() || IsSymbol(); }
 /**
  * Returns true if this value is a symbol.
  */
-IS(IsSymbol, "return typeof _1 === 'symbol'")
+IS_TYPE(IsSymbol, kTypeInfoBasic, kTypeSymbol)
 
 /**
  * Returns true if this value is a function.
  */
-IS(IsFunction, "return typeof _1 === 'function'")
+IS_TYPE(IsFunction, kTypeInfoBasic, kTypeFunction)
 
 /**
  * Returns true if this value is an array. Note that it will return false for
@@ -271,12 +349,12 @@ IS(IsSymbolObject, "return (typeof _1 === 'object' && _1 !== null && typeof _1.v
 /**
  * Returns true if this value is a NativeError.
  */
-IS(IsNativeError, "return _1 instanceof Error")
+IS_TYPE(IsNativeError, kTypeInfoExtended, kTypeNativeError)
 
 /**
  * Returns true if this value is a RegExp.
  */
-IS(IsRegExp, "return Object.prototype.toString.call( _1 ) === '[object RegExp]';")
+IS_TYPE(IsRegExp, kTypeInfoExtended, kTypeRegExp)
 
 /**
  * Returns true if this value is an async function.
@@ -296,17 +374,17 @@ IS(IsGeneratorObject, "return _1 && typeof _1[Symbol.iterator] === 'function'")
 /**
  * Returns true if this value is a Promise.
  */
-IS(IsPromise, "return _1 && Promise && Promise.resolve && Promise.resolve(_1) == _1")
+IS_TYPE(IsPromise, kTypeInfoExtended, kTypePromise)
 
 /**
  * Returns true if this value is a Map.
  */
-IS(IsMap, "return _1 instanceof Map")
+IS_TYPE(IsMap, kTypeInfoExtended, kTypeMap)
 
 /**
  * Returns true if this value is a Set.
  */
-IS(IsSet, "return _1 instanceof Set")
+IS_TYPE(IsSet, kTypeInfoExtended, kTypeSet)
 
 /**
  * Returns true if this value is a Map Iterator.
@@ -321,77 +399,80 @@ bool v8::Value::IsSetIterator() const { return false; } // FIXME
 /**
  * Returns true if this value is a WeakMap.
  */
-IS(IsWeakMap, "return _1 instanceof WeakMap")
+IS_TYPE(IsWeakMap, kTypeInfoExtended, kTypeWeakMap)
 
 /**
  * Returns true if this value is a WeakSet.
  */
-IS(IsWeakSet, "return _1 instanceof WeakSet")
+IS_TYPE(IsWeakSet, kTypeInfoExtended, kTypeWeakSet)
 
 /**
  * Returns true if this value is an ArrayBuffer.
  */
-IS(IsArrayBuffer, "return _1 instanceof ArrayBuffer")
+IS_TYPE(IsArrayBuffer, kTypeInfoBasic, kTypeArrayBuffer)
 
 /**
  * Returns true if this value is an ArrayBufferView.
  */
-IS(IsArrayBufferView, "return _1 && _1.buffer instanceof ArrayBuffer && _1.byteLength !== undefined")
+bool v8::Value::IsArrayBufferView() const
+{
+    return IsTypedArray() || IsDataView();
+}
 
 /**
  * Returns true if this value is one of TypedArrays.
  */
-IS(IsTypedArray, "return _1 && ArrayBuffer.isView(_1) && Object.prototype.toString.call(_1) !== '[object DataView]'")
+IS_TYPE(IsTypedArray, kTypeInfoBasic, kTypeTypedArray)
 
 /**
  * Returns true if this value is an Uint8Array.
  */
-IS(IsUint8Array, "return _1 instanceof Uint8Array")
+IS_TYPED_ARRAY(IsUint8Array, kJSTypedArrayTypeUint8Array)
 
 /**
  * Returns true if this value is an Uint8ClampedArray.
  */
-IS(IsUint8ClampedArray, "return _1 instanceof Uint8ClampedArray")
+IS_TYPED_ARRAY(IsUint8ClampedArray, kJSTypedArrayTypeUint8ClampedArray)
 
 /**
  * Returns true if this value is an Int8Array.
  */
-IS(IsInt8Array, "return _1 instanceof Int8Array")
+IS_TYPED_ARRAY(IsInt8Array, kJSTypedArrayTypeInt8Array)
 
 /**
  * Returns true if this value is an Uint16Array.
  */
-IS(IsUint16Array, "return _1 instanceof Uint16Array")
+IS_TYPED_ARRAY(IsUint16Array, kJSTypedArrayTypeUint16Array)
 
 /**
  * Returns true if this value is an Int16Array.
  */
-IS(IsInt16Array, "return _1 instanceof Int16Array")
+IS_TYPED_ARRAY(IsInt16Array, kJSTypedArrayTypeInt16Array)
 
 /**
  * Returns true if this value is an Uint32Array.
  */
-IS(IsUint32Array, "return _1 instanceof Uint32Array")
+IS_TYPED_ARRAY(IsUint32Array, kJSTypedArrayTypeUint32Array)
 
 /**
  * Returns true if this value is an Int32Array.
  */
-IS(IsInt32Array, "return _1 instanceof Int32Array")
+IS_TYPED_ARRAY(IsInt32Array, kJSTypedArrayTypeInt32Array)
 
 /**
  * Returns true if this value is a Float32Array.
  */
-IS(IsFloat32Array, "return _1 instanceof Float32Array")
+IS_TYPED_ARRAY(IsFloat32Array, kJSTypedArrayTypeFloat32Array)
 
 /**
  * Returns true if this value is a Float64Array.
  */
-IS(IsFloat64Array, "return _1 instanceof Float64Array")
+IS_TYPED_ARRAY(IsFloat64Array, kJSTypedArrayTypeFloat64Array)
 
 /**
  * Returns true if this value is a DataView.
  */
-IS(IsDataView, "return _1 && Object.prototype.toString.call(_1) === '[object DataView]'")
+IS_TYPE(IsDataView, kTypeInfoExtended, kTypeDataView)
 
 /**
  * Returns true if this value is a SharedArrayBuffer.
@@ -495,9 +576,21 @@ bool v8::Value::SameValue(Local<v8::Value> that) const
 Local<v8::String> v8::Value::TypeOf(Isolate* isolate)
 {
     FROMTHIS(c,v);
-    JSValueRef exception = nullptr;
-    JSValueRef to = exec(c->m_ctxRef, "return typeof _1", 1, &v);
-    return V82JSC::String::New(isolate, JSValueToStringCopy(c->m_ctxRef, to, &exception));
+    const char *type = "object";
+    switch (JSValueGetType(c->m_ctxRef, v)) {
+        case kJSTypeUndefined: type = "undefined"; break;
+        case kJSTypeBoolean:   type = "boolean"; break;
+        case kJSTypeNumber:    type = "number"; break;
+        case kJSTypeString:    type = "string"; break;
+        case kJSTypeNull:      break;
+        default: {
+            uint32_t info = GetTypeInfo(this, V82JSC::Value::kTypeInfoBasic);
+            if (info & V82JSC::Value::kTypeSymbol) type = "symbol";
+            else if (info & V82JSC::Value::kTypeFunction) type = "function";
+            break;
+        }
+    }
+    return v8::String::NewFromUtf8(isolate, type, v8::NewStringType::kInternalized).ToLocalChecked();
 }
 
 Maybe<bool> v8::Value::InstanceOf(Local<v8::Context> context, Local<Object> object)
@@ -508,11 +601,11 @@ Maybe<bool> v8::Value::InstanceOf(Local<v8::Context> context, Local<Object> obje
         ToJSValueRef(object, context)
     };
     LocalException exception(ToIsolateImpl(ToContextImpl(context)));
-    JSValueRef is = exec(c->m_ctxRef, "return _1 instanceof _2", 2, args, &exception);
+    bool is = JSValueIsInstanceOfConstructor(c->m_ctxRef, v, (JSObjectRef)args[1], &exception);
     if (exception.ShouldThrow()) {
         return Nothing<bool>();
     }
-    return _maybe<bool>(JSValueToBoolean(c->m_ctxRef, is)).toMaybe();
+    return _maybe<bool>(is).toMaybe();
 }
 
 MaybeLocal<v8::Uint32> v8::Value::ToArrayIndex(Local<v8::Context> context) const
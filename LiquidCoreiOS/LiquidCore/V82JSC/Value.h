@@ -18,15 +18,57 @@ struct Value : HeapObject {
     uint64_t reserved2_; // For string, resource is stored here
     uint64_t reserved3_; // For string, resource data is stored here
     JSValueRef m_secondary_value;
+    uint32_t m_type_info; // TypeInfo bits, filled in lazily for objects
+    
+    // What kind of object m_value is, so that the v8::Value::IsXxx() predicates don't have to ask JS
+    enum TypeInfo : uint32_t {
+        kTypeInfoBasic        = 1 << 0, // The bits below that the C API can answer are valid
+        kTypeInfoExtended     = 1 << 1, // The bits below that need JS to work out are valid
+        kTypeFunction         = 1 << 2,
+        kTypeArrayBuffer      = 1 << 3,
+        kTypeTypedArray       = 1 << 4,
+        kTypeDataView         = 1 << 5,
+        kTypeMap              = 1 << 6,
+        kTypeSet              = 1 << 7,
+        kTypeWeakMap          = 1 << 8,
+        kTypeWeakSet          = 1 << 9,
+        kTypePromise          = 1 << 10,
+        kTypeRegExp           = 1 << 11,
+        kTypeNativeError      = 1 << 12,
+        kTypeSymbol           = 1 << 13,
+        kTypedArrayTypeShift  = 16,       // JSTypedArrayType of a typed array
+    };
     
     static void Constructor(Value *obj) {}
     static int Destructor(HeapContext& contet, Value *obj)
     {
-        if (obj->m_value) JSValueUnprotect(obj->GetNullContext(), obj->m_value);
-        if (obj->m_secondary_value) JSValueUnprotect(obj->GetNullContext(), obj->m_secondary_value);
+        if (obj->m_value) Unroot(obj->GetNullContext(), obj->m_value);
+        if (obj->m_secondary_value) Unroot(obj->GetNullContext(), obj->m_secondary_value);
         RemoveObjectFromMap(obj->GetIsolate(), (JSObjectRef)obj->m_value);
         return 0;
     }
+    static void VisitJSValues(Value *obj, RootVisitor visit, void *data)
+    {
+        if (obj->m_value) visit(obj->m_value, data);
+        if (obj->m_secondary_value) visit(obj->m_secondary_value, data);
+    }
+    
+    // A value's JS values live as long as it does.  With the private API the isolate's marking
+    // constraint marks them all in one pass over the heap on each collection, which is much
+    // cheaper than a protect and unprotect apiece, each a trip through JSC's protected set.
+    // Without it there is no constraint, so they are protected.
+    static inline void Root(JSContextRef ctx, JSValueRef value)
+    {
+#ifndef USE_JAVASCRIPTCORE_PRIVATE_API
+        JSValueProtect(ctx, value);
+#endif
+    }
+    static inline void Unroot(JSContextRef ctx, JSValueRef value)
+    {
+#ifndef USE_JAVASCRIPTCORE_PRIVATE_API
+        JSValueUnprotect(ctx, value);
+#endif
+    }
     
     static void RemoveObjectFromMap(IsolateImpl* iso, JSObjectRef o);
 
@@ -43,6 +85,33 @@ struct WeakValue : Value {
         // Don't call value destructor
         return 0;
     }
+    static void VisitJSValues(WeakValue *obj, RootVisitor visit, void *data)
+    {
+        // Weak, so not rooted
+    }
+};
+
+// m_value is the promise, settled by calling m_resolve or m_reject
+struct PromiseResolver : Value {
+    JSObjectRef m_resolve;
+    JSObjectRef m_reject;
+    
+    static void Constructor(PromiseResolver *obj)
+    {
+        Value::Constructor(obj);
+    }
+    static int Destructor(HeapContext& context, PromiseResolver *obj)
+    {
+        if (obj->m_resolve) Unroot(obj->GetNullContext(), obj->m_resolve);
+        if (obj->m_reject) Unroot(obj->GetNullContext(), obj->m_reject);
+        return Value::Destructor(context, obj);
+    }
+    static void VisitJSValues(PromiseResolver *obj, RootVisitor visit, void *data)
+    {
+        Value::VisitJSValues(obj, visit, data);
+        if (obj->m_resolve) visit(obj->m_resolve, data);
+        if (obj->m_reject) visit(obj->m_reject, data);
+    }
 };
     
 } /* namepsace V82JSC */
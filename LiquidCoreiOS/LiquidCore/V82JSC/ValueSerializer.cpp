@@ -5,8 +5,709 @@
  * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
  */
 #include "V82JSC.h"
+#include "Object.h"
+#include <cmath>
+#include <unordered_map>
 
 using namespace v8;
+using V82JSC::ToContextRef;
+using V82JSC::ToContextImpl;
+using V82JSC::ToIsolateImpl;
+using V82JSC::ToJSValueRef;
+using V82JSC::exec;
+using V82JSC::LocalException;
+
+/*
+ * This is a port of V8's own wire format (src/value-serializer.cc), so that data written here can be
+ * read by V8 on Android and vice versa.  Only the current version is written.  Versions 11 and 12 can be
+ * read, but the legacy (version 0) format cannot.
+ */
+static const uint32_t kLatestVersion = 13;
+static const uint32_t kMinimumNonLegacyVersion = 13;
+static const int kMaxDepth = 512;
+
+enum class SerializationTag : uint8_t {
+    // version:uint32_t (if at beginning of data, sets version > 0)
+    kVersion = 0xFF,
+    // ignore
+    kPadding = '\0',
+    // refTableSize:uint32_t (previously used for sanity checks; safe to ignore)
+    kVerifyObjectCount = '?',
+    // Oddballs (no data).
+    kTheHole = '-',
+    kUndefined = '_',
+    kNull = '0',
+    kTrue = 'T',
+    kFalse = 'F',
+    // Number represented as 32-bit integer, ZigZag-encoded
+    kInt32 = 'I',
+    // Number represented as 32-bit unsigned integer, varint-encoded
+    kUint32 = 'U',
+    // Number represented as a 64-bit double (host byte order)
+    kDouble = 'N',
+    // byteLength:uint32_t, then raw data
+    kUtf8String = 'S',
+    kOneByteString = '"',
+    kTwoByteString = 'c',
+    // Reference to a serialized object. objectID:uint32_t
+    kObjectReference = '^',
+    // Beginning of a JS object.
+    kBeginJSObject = 'o',
+    // End of a JS object. numProperties:uint32_t
+    kEndJSObject = '{',
+    // Beginning of a sparse JS array. length:uint32_t
+    kBeginSparseJSArray = 'a',
+    // End of a sparse JS array. numProperties:uint32_t length:uint32_t
+    kEndSparseJSArray = '@',
+    // Beginning of a dense JS array. length:uint32_t
+    kBeginDenseJSArray = 'A',
+    // End of a dense JS array. numProperties:uint32_t length:uint32_t
+    kEndDenseJSArray = '$',
+    // Date. millisSinceEpoch:double
+    kDate = 'D',
+    // Boolean object. No data.
+    kTrueObject = 'y',
+    kFalseObject = 'x',
+    // Number object. value:double
+    kNumberObject = 'n',
+    // String object. A string follows.
+    kStringObject = 's',
+    // Regular expression. A string follows, then flags:uint32_t.
+    kRegExp = 'R',
+    // Beginning of a JS map.
+    kBeginJSMap = ';',
+    // End of a JS map. length:uint32_t.
+    kEndJSMap = ':',
+    // Beginning of a JS set.
+    kBeginJSSet = '\'',
+    // End of a JS set. length:uint32_t.
+    kEndJSSet = ',',
+    // Array buffer. byteLength:uint32_t, then raw data.
+    kArrayBuffer = 'B',
+    // Array buffer (transferred). transferID:uint32_t
+    kArrayBufferTransfer = 't',
+    // View into an array buffer, which is serialized just before it.
+    // subtag:ArrayBufferViewTag, byteOffset:uint32_t, byteLength:uint32_t
+    kArrayBufferView = 'V',
+    // Shared array buffer. transferID:uint32_t
+    kSharedArrayBuffer = 'u',
+    // Compiled WebAssembly module.
+    kWasmModule = 'W',
+    // A wasm module object transfer. next value is its index.
+    kWasmModuleTransfer = 'w',
+    // The delegate is responsible for processing all following data.
+    kHostObject = '\\',
+};
+
+enum class ArrayBufferViewTag : uint8_t {
+    kInt8Array = 'b',
+    kUint8Array = 'B',
+    kUint8ClampedArray = 'C',
+    kInt16Array = 'w',
+    kUint16Array = 'W',
+    kInt32Array = 'd',
+    kUint32Array = 'D',
+    kFloat32Array = 'f',
+    kFloat64Array = 'F',
+    kDataView = '?',
+};
+
+static const struct {
+    JSTypedArrayType type;
+    ArrayBufferViewTag tag;
+    unsigned element_size;
+} s_view_types[] = {
+    { kJSTypedArrayTypeInt8Array, ArrayBufferViewTag::kInt8Array, 1 },
+    { kJSTypedArrayTypeUint8Array, ArrayBufferViewTag::kUint8Array, 1 },
+    { kJSTypedArrayTypeUint8ClampedArray, ArrayBufferViewTag::kUint8ClampedArray, 1 },
+    { kJSTypedArrayTypeInt16Array, ArrayBufferViewTag::kInt16Array, 2 },
+    { kJSTypedArrayTypeUint16Array, ArrayBufferViewTag::kUint16Array, 2 },
+    { kJSTypedArrayTypeInt32Array, ArrayBufferViewTag::kInt32Array, 4 },
+    { kJSTypedArrayTypeUint32Array, ArrayBufferViewTag::kUint32Array, 4 },
+    { kJSTypedArrayTypeFloat32Array, ArrayBufferViewTag::kFloat32Array, 4 },
+    { kJSTypedArrayTypeFloat64Array, ArrayBufferViewTag::kFloat64Array, 8 },
+};
+
+// Same bits as JSRegExp::Flags
+static const char s_regexp_flags[] = "gimyus";
+
+// The order here must match the codes returned by the classify script below
+enum ReceiverKind {
+    kPlainObject,
+    kUncloneable,
+    kRegExp,
+    kMap,
+    kSet,
+    kSharedArrayBuffer,
+    kDataView,
+    kBooleanObject,
+    kNumberObject,
+    kStringObject,
+    kArray,
+    kDate,
+    kArrayBuffer,
+    kTypedArray,
+    kHostObject,
+};
+
+static ReceiverKind Classify(JSContextRef ctx, JSObjectRef obj, JSValueRef *exception)
+{
+    JSTypedArrayType type = JSValueGetTypedArrayType(ctx, obj, nullptr);
+    if (type == kJSTypedArrayTypeArrayBuffer) return kArrayBuffer;
+    if (type != kJSTypedArrayTypeNone) return kTypedArray;
+    if (JSValueIsArray(ctx, obj)) return kArray;
+    if (JSValueIsDate(ctx, obj)) return kDate;
+    auto wrap = V82JSC::TrackedObject::getPrivateInstance(ctx, obj);
+    if (wrap && wrap->m_num_internal_fields > 0) return kHostObject;
+
+    JSValueRef kind = exec(ctx,
+                           "if (typeof _1 === 'function' || typeof _1 === 'symbol') return 1;"
+                           "switch (Object.prototype.toString.call(_1)) {"
+                           "  case '[object Object]': return 0;"
+                           "  case '[object RegExp]': return 2;"
+                           "  case '[object Map]': return 3;"
+                           "  case '[object Set]': return 4;"
+                           "  case '[object SharedArrayBuffer]': return 5;"
+                           "  case '[object DataView]': return 6;"
+                           "  case '[object Boolean]': return 7;"
+                           "  case '[object Number]': return 8;"
+                           "  case '[object String]': return 9;"
+                           "  case '[object Error]': case '[object Arguments]': case '[object Promise]':"
+                           "  case '[object WeakMap]': case '[object WeakSet]': case '[object Symbol]':"
+                           "  case '[object Generator]': return 1;"
+                           "}"
+                           "return 0;", 1, (JSValueRef*)&obj, exception);
+    if (*exception) return kUncloneable;
+    return static_cast<ReceiverKind>((int)JSValueToNumber(ctx, kind, nullptr));
+}
+
+// Returns true if 'key' is the canonical form of an array index
+static bool IsArrayIndex(JSStringRef key, uint32_t *index)
+{
+    size_t length = JSStringGetLength(key);
+    const JSChar *chars = JSStringGetCharactersPtr(key);
+    if (length == 0 || length > 10 || (chars[0] == '0' && length > 1)) return false;
+    uint64_t value = 0;
+    for (size_t i=0; i<length; i++) {
+        if (chars[i] < '0' || chars[i] > '9') return false;
+        value = value * 10 + (chars[i] - '0');
+    }
+    if (value >= 0xFFFFFFFFu) return false;
+    *index = static_cast<uint32_t>(value);
+    return true;
+}
+
+static JSValueRef GetLength(JSContextRef ctx, JSObjectRef obj, JSValueRef *exception)
+{
+    static JSStringRef s_length = JSStringCreateWithUTF8CString("length");
+    return JSObjectGetProperty(ctx, obj, s_length, exception);
+}
+
+struct ValueSerializer::PrivateData {
+    PrivateData(Isolate *isolate, ValueSerializer::Delegate *delegate) :
+        m_isolate(isolate), m_delegate(delegate) {}
+    ~PrivateData()
+    {
+        if (m_buffer) {
+            if (m_delegate) {
+                m_delegate->FreeBufferMemory(m_buffer);
+            } else {
+                free(m_buffer);
+            }
+        }
+        if (m_gctx) {
+            for (auto i=m_id_map.begin(); i!=m_id_map.end(); ++i) JSValueUnprotect(m_gctx, i->first);
+            for (auto i=m_transfer_map.begin(); i!=m_transfer_map.end(); ++i) JSValueUnprotect(m_gctx, i->first);
+            JSGlobalContextRelease(m_gctx);
+        }
+    }
+
+    void Enter(JSContextRef ctx)
+    {
+        if (!m_gctx) {
+            m_gctx = JSContextGetGlobalContext(ctx);
+            JSGlobalContextRetain(m_gctx);
+        }
+    }
+
+    void WriteTag(SerializationTag tag)
+    {
+        uint8_t raw_tag = static_cast<uint8_t>(tag);
+        WriteRawBytes(&raw_tag, sizeof(raw_tag));
+    }
+
+    template <typename T> void WriteVarint(T value)
+    {
+        static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value,
+                      "Only unsigned integer types can be written as varints.");
+        uint8_t stack_buffer[sizeof(T) * 8 / 7 + 1];
+        uint8_t* next_byte = &stack_buffer[0];
+        do {
+            *next_byte = (value & 0x7f) | 0x80;
+            next_byte++;
+            value >>= 7;
+        } while (value);
+        *(next_byte - 1) &= 0x7f;
+        WriteRawBytes(stack_buffer, next_byte - stack_buffer);
+    }
+
+    template <typename T> void WriteZigZag(T value)
+    {
+        using UnsignedT = typename std::make_unsigned<T>::type;
+        WriteVarint((static_cast<UnsignedT>(value) << 1) ^ (value >> (8 * sizeof(T) - 1)));
+    }
+
+    void WriteDouble(double value)
+    {
+        WriteRawBytes(&value, sizeof(value));
+    }
+
+    void WriteRawBytes(const void* source, size_t length)
+    {
+        uint8_t *dest = ReserveRawBytes(length);
+        if (dest) memcpy(dest, source, length);
+    }
+
+    uint8_t * ReserveRawBytes(size_t bytes)
+    {
+        size_t old_size = m_buffer_size;
+        size_t new_size = old_size + bytes;
+        if (new_size > m_buffer_capacity && !ExpandBuffer(new_size)) {
+            return nullptr;
+        }
+        m_buffer_size = new_size;
+        return &m_buffer[old_size];
+    }
+
+    bool ExpandBuffer(size_t required_capacity)
+    {
+        size_t requested_capacity = std::max(required_capacity, m_buffer_capacity * 2) + 64;
+        size_t provided_capacity = 0;
+        void* new_buffer = nullptr;
+        if (m_delegate) {
+            new_buffer = m_delegate->ReallocateBufferMemory(m_buffer, requested_capacity, &provided_capacity);
+        } else {
+            new_buffer = realloc(m_buffer, requested_capacity);
+            provided_capacity = requested_capacity;
+        }
+        if (!new_buffer) {
+            m_out_of_memory = true;
+            return false;
+        }
+        m_buffer = reinterpret_cast<uint8_t*>(new_buffer);
+        m_buffer_capacity = provided_capacity;
+        return true;
+    }
+
+    void WriteNumber(double number)
+    {
+        if (number >= std::numeric_limits<int32_t>::min() && number <= std::numeric_limits<int32_t>::max() &&
+            number == std::floor(number) && !(number == 0 && std::signbit(number))) {
+            WriteTag(SerializationTag::kInt32);
+            WriteZigZag<int32_t>(static_cast<int32_t>(number));
+        } else {
+            WriteTag(SerializationTag::kDouble);
+            WriteDouble(number);
+        }
+    }
+
+    void WriteString(JSStringRef str)
+    {
+        const JSChar *chars = JSStringGetCharactersPtr(str);
+        size_t length = JSStringGetLength(str);
+        size_t i = 0;
+        while (i < length && chars[i] <= 0xFF) i++;
+        if (i == length) {
+            WriteTag(SerializationTag::kOneByteString);
+            WriteVarint<uint32_t>(static_cast<uint32_t>(length));
+            uint8_t *dest = ReserveRawBytes(length);
+            if (dest) {
+                for (i=0; i<length; i++) dest[i] = static_cast<uint8_t>(chars[i]);
+            }
+        } else {
+            uint32_t byte_length = static_cast<uint32_t>(length * sizeof(JSChar));
+            // The existing reading code expects 16-byte strings to be aligned.
+            size_t varint_length = 0;
+            for (uint32_t v = byte_length; ; v >>= 7) { varint_length++; if (v < 0x80) break; }
+            if ((m_buffer_size + 1 + varint_length) & 1) WriteTag(SerializationTag::kPadding);
+            WriteTag(SerializationTag::kTwoByteString);
+            WriteVarint<uint32_t>(byte_length);
+            WriteRawBytes(chars, byte_length);
+        }
+    }
+
+    void WriteString(JSContextRef ctx, JSValueRef value)
+    {
+        JSStringRef str = JSValueToStringCopy(ctx, value, nullptr);
+        WriteString(str);
+        JSStringRelease(str);
+    }
+
+    bool ThrowIfOutOfMemory()
+    {
+        if (m_out_of_memory) {
+            ThrowDataCloneError("Data cannot be cloned, out of memory.");
+            return false;
+        }
+        return true;
+    }
+
+    void ThrowDataCloneError(const char *message)
+    {
+        Local<String> msg = String::NewFromUtf8(m_isolate, message, NewStringType::kNormal).ToLocalChecked();
+        if (m_delegate) {
+            m_delegate->ThrowDataCloneError(msg);
+        } else {
+            m_isolate->ThrowException(Exception::Error(msg));
+        }
+        m_failed = true;
+    }
+
+    void ThrowDataCloneError(JSContextRef ctx, JSValueRef value)
+    {
+        JSValueRef described = exec(ctx,
+                                    "try {"
+                                    "  if (typeof _1 === 'function') return String(_1);"
+                                    "  if (typeof _1 === 'symbol') return _1.toString();"
+                                    "  var p = Object.getPrototypeOf(_1), c = p && p.constructor && p.constructor.name;"
+                                    "  return '#<' + (c || 'Object') + '>';"
+                                    "} catch (e) { return '#<Object>'; }", 1, &value);
+        JSStringRef str = JSValueToStringCopy(ctx, described, nullptr);
+        std::string message(JSStringGetMaximumUTF8CStringSize(str), '\0');
+        message.resize(JSStringGetUTF8CString(str, &message[0], message.size()) - 1);
+        JSStringRelease(str);
+        ThrowDataCloneError((message + " could not be cloned.").c_str());
+    }
+
+    bool WriteObject(JSContextRef ctx, JSValueRef value)
+    {
+        m_out_of_memory = false;
+        switch (JSValueGetType(ctx, value)) {
+            case kJSTypeUndefined:
+                WriteTag(SerializationTag::kUndefined);
+                return ThrowIfOutOfMemory();
+            case kJSTypeNull:
+                WriteTag(SerializationTag::kNull);
+                return ThrowIfOutOfMemory();
+            case kJSTypeBoolean:
+                WriteTag(JSValueToBoolean(ctx, value) ? SerializationTag::kTrue : SerializationTag::kFalse);
+                return ThrowIfOutOfMemory();
+            case kJSTypeNumber:
+                WriteNumber(JSValueToNumber(ctx, value, nullptr));
+                return ThrowIfOutOfMemory();
+            case kJSTypeString:
+                WriteString(ctx, value);
+                return ThrowIfOutOfMemory();
+            case kJSTypeObject:
+                return WriteJSReceiver(ctx, (JSObjectRef)value);
+            default:
+                ThrowDataCloneError(ctx, value);
+                return false;
+        }
+    }
+
+    bool WriteJSReceiver(JSContextRef ctx, JSObjectRef obj)
+    {
+        // If the object has already been serialized, just write its ID.
+        auto found = m_id_map.find(obj);
+        if (found != m_id_map.end()) {
+            WriteTag(SerializationTag::kObjectReference);
+            WriteVarint(found->second);
+            return ThrowIfOutOfMemory();
+        }
+
+        ReceiverKind kind = Classify(ctx, obj, m_exception);
+        if (*m_exception) return false;
+
+        // Views have their buffer serialized first, before they are assigned an ID
+        if ((kind == kTypedArray || kind == kDataView) && !m_treat_array_buffer_views_as_host_objects) {
+            JSValueRef buffer = kind == kTypedArray ?
+                JSObjectGetTypedArrayBuffer(ctx, obj, m_exception) :
+                exec(ctx, "return _1.buffer", 1, (JSValueRef*)&obj, m_exception);
+            if (*m_exception || !WriteJSReceiver(ctx, (JSObjectRef)buffer)) return false;
+        }
+
+        // Otherwise, allocate an ID for it.
+        m_id_map[obj] = m_next_id++;
+        JSValueProtect(ctx, obj);
+
+        if (kind == kUncloneable) {
+            ThrowDataCloneError(ctx, obj);
+            return false;
+        }
+        if (++m_depth > kMaxDepth) {
+            m_isolate->ThrowException(Exception::RangeError(
+                String::NewFromUtf8(m_isolate, "Maximum call stack size exceeded", NewStringType::kNormal)
+                    .ToLocalChecked()));
+            m_failed = true;
+            return false;
+        }
+        bool ok = WriteJSReceiver(ctx, obj, kind);
+        m_depth --;
+        return ok;
+    }
+
+    bool WriteJSReceiver(JSContextRef ctx, JSObjectRef obj, ReceiverKind kind)
+    {
+        switch (kind) {
+            case kArray:
+                return WriteJSArray(ctx, obj);
+            case kPlainObject: {
+                JSValueRef keys = exec(ctx, "return Object.keys(_1)", 1, (JSValueRef*)&obj, m_exception);
+                if (*m_exception) return false;
+                WriteTag(SerializationTag::kBeginJSObject);
+                uint32_t properties_written;
+                if (!WriteJSObjectProperties(ctx, obj, (JSObjectRef)keys, 0, true, &properties_written)) {
+                    return false;
+                }
+                WriteTag(SerializationTag::kEndJSObject);
+                WriteVarint<uint32_t>(properties_written);
+                return ThrowIfOutOfMemory();
+            }
+            case kHostObject:
+                return WriteHostObject(ctx, obj);
+            case kDate: {
+                JSValueRef time = exec(ctx, "return Date.prototype.getTime.call(_1)", 1,
+                                       (JSValueRef*)&obj, m_exception);
+                if (*m_exception) return false;
+                WriteTag(SerializationTag::kDate);
+                WriteDouble(JSValueToNumber(ctx, time, nullptr));
+                return ThrowIfOutOfMemory();
+            }
+            case kBooleanObject: {
+                JSValueRef inner = exec(ctx, "return Boolean.prototype.valueOf.call(_1)", 1,
+                                        (JSValueRef*)&obj, m_exception);
+                if (*m_exception) return false;
+                WriteTag(JSValueToBoolean(ctx, inner) ? SerializationTag::kTrueObject :
+                         SerializationTag::kFalseObject);
+                return ThrowIfOutOfMemory();
+            }
+            case kNumberObject: {
+                JSValueRef inner = exec(ctx, "return Number.prototype.valueOf.call(_1)", 1,
+                                        (JSValueRef*)&obj, m_exception);
+                if (*m_exception) return false;
+                WriteTag(SerializationTag::kNumberObject);
+                WriteDouble(JSValueToNumber(ctx, inner, nullptr));
+                return ThrowIfOutOfMemory();
+            }
+            case kStringObject: {
+                JSValueRef inner = exec(ctx, "return String.prototype.valueOf.call(_1)", 1,
+                                        (JSValueRef*)&obj, m_exception);
+                if (*m_exception) return false;
+                WriteTag(SerializationTag::kStringObject);
+                WriteString(ctx, inner);
+                return ThrowIfOutOfMemory();
+            }
+            case kRegExp: {
+                JSValueRef parts = exec(ctx, "return [_1.source, _1.flags]", 1, (JSValueRef*)&obj, m_exception);
+                if (*m_exception) return false;
+                JSStringRef flags = JSValueToStringCopy(ctx,
+                    JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)parts, 1, nullptr), nullptr);
+                uint32_t raw_flags = 0;
+                const JSChar *chars = JSStringGetCharactersPtr(flags);
+                for (size_t i=0; i<JSStringGetLength(flags); i++) {
+                    const char *bit = chars[i] < 0x80 ? strchr(s_regexp_flags, (char)chars[i]) : nullptr;
+                    if (bit && *bit) raw_flags |= 1 << (bit - s_regexp_flags);
+                }
+                JSStringRelease(flags);
+                WriteTag(SerializationTag::kRegExp);
+                WriteString(ctx, JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)parts, 0, nullptr));
+                WriteVarint<uint32_t>(raw_flags);
+                return ThrowIfOutOfMemory();
+            }
+            case kMap:
+            case kSet: {
+                // First copy the entries, since getters could mutate them.
+                JSValueRef entries = kind == kMap ?
+                    exec(ctx, "var a = []; Map.prototype.forEach.call(_1, function(v, k) { a.push(k, v); });"
+                         "return a;", 1, (JSValueRef*)&obj, m_exception) :
+                    exec(ctx, "var a = []; Set.prototype.forEach.call(_1, function(v) { a.push(v); });"
+                         "return a;", 1, (JSValueRef*)&obj, m_exception);
+                if (*m_exception) return false;
+                uint32_t length = static_cast<uint32_t>(JSValueToNumber(ctx,
+                    GetLength(ctx, (JSObjectRef)entries, nullptr), nullptr));
+                WriteTag(kind == kMap ? SerializationTag::kBeginJSMap : SerializationTag::kBeginJSSet);
+                for (uint32_t i=0; i<length; i++) {
+                    if (!WriteObject(ctx, JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)entries, i, nullptr))) {
+                        return false;
+                    }
+                }
+                WriteTag(kind == kMap ? SerializationTag::kEndJSMap : SerializationTag::kEndJSSet);
+                WriteVarint<uint32_t>(length);
+                return ThrowIfOutOfMemory();
+            }
+            case kArrayBuffer: {
+                auto transfer = m_transfer_map.find(obj);
+                if (transfer != m_transfer_map.end()) {
+                    WriteTag(SerializationTag::kArrayBufferTransfer);
+                    WriteVarint(transfer->second);
+                    return ThrowIfOutOfMemory();
+                }
+                size_t byte_length = JSObjectGetArrayBufferByteLength(ctx, obj, m_exception);
+                void *bytes = JSObjectGetArrayBufferBytesPtr(ctx, obj, m_exception);
+                if (*m_exception) return false;
+                if (!bytes && byte_length) {
+                    ThrowDataCloneError("An ArrayBuffer is neutered and could not be cloned.");
+                    return false;
+                }
+                if (byte_length > std::numeric_limits<uint32_t>::max()) {
+                    ThrowDataCloneError(ctx, obj);
+                    return false;
+                }
+                WriteTag(SerializationTag::kArrayBuffer);
+                WriteVarint<uint32_t>(static_cast<uint32_t>(byte_length));
+                WriteRawBytes(bytes, byte_length);
+                return ThrowIfOutOfMemory();
+            }
+            case kSharedArrayBuffer: {
+                if (!m_delegate) {
+                    ThrowDataCloneError(ctx, obj);
+                    return false;
+                }
+                Local<SharedArrayBuffer> sab =
+                    V82JSC::Value::New(ToContextImpl(m_context), obj).As<SharedArrayBuffer>();
+                uint32_t index;
+                if (!m_delegate->GetSharedArrayBufferId(m_isolate, sab).To(&index)) {
+                    m_failed = true;
+                    return false;
+                }
+                WriteTag(SerializationTag::kSharedArrayBuffer);
+                WriteVarint(index);
+                return ThrowIfOutOfMemory();
+            }
+            case kTypedArray:
+            case kDataView:
+                if (m_treat_array_buffer_views_as_host_objects) {
+                    return WriteHostObject(ctx, obj);
+                }
+                return WriteJSArrayBufferView(ctx, obj, kind);
+            default:
+                ThrowDataCloneError(ctx, obj);
+                return false;
+        }
+    }
+
+    bool WriteJSArray(JSContextRef ctx, JSObjectRef array)
+    {
+        uint32_t length = static_cast<uint32_t>(JSValueToNumber(ctx, GetLength(ctx, array, m_exception), nullptr));
+        if (*m_exception) return false;
+
+        // V8 decides between dense and sparse based on elements kind.  The closest we can get is to
+        // write arrays densely when they have no holes.
+        JSValueRef shape = exec(ctx,
+                                "var n = _1.length, i;"
+                                "for (i = 0; i < n; i++) if (!Object.prototype.hasOwnProperty.call(_1, i)) break;"
+                                "var k = Object.keys(_1);"
+                                "return i < n ? [false, k] : [true, k.slice(n)];", 1, (JSValueRef*)&array, m_exception);
+        if (*m_exception) return false;
+        bool dense = JSValueToBoolean(ctx, JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)shape, 0, nullptr));
+        JSObjectRef keys = (JSObjectRef) JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)shape, 1, nullptr);
+
+        uint32_t properties_written = 0;
+        if (dense) {
+            WriteTag(SerializationTag::kBeginDenseJSArray);
+            WriteVarint<uint32_t>(length);
+            for (uint32_t i=0; i<length; i++) {
+                JSValueRef element = JSObjectGetPropertyAtIndex(ctx, array, i, m_exception);
+                if (*m_exception || !WriteObject(ctx, element)) return false;
+            }
+            if (!WriteJSObjectProperties(ctx, array, keys, 0, true, &properties_written)) {
+                return false;
+            }
+            WriteTag(SerializationTag::kEndDenseJSArray);
+        } else {
+            WriteTag(SerializationTag::kBeginSparseJSArray);
+            WriteVarint<uint32_t>(length);
+            if (!WriteJSObjectProperties(ctx, array, keys, 0, true, &properties_written)) {
+                return false;
+            }
+            WriteTag(SerializationTag::kEndSparseJSArray);
+        }
+        WriteVarint<uint32_t>(properties_written);
+        WriteVarint<uint32_t>(length);
+        return ThrowIfOutOfMemory();
+    }
+
+    bool WriteJSObjectProperties(JSContextRef ctx, JSObjectRef object, JSObjectRef keys, uint32_t start,
+                                 bool keep_numbers, uint32_t *properties_written)
+    {
+        uint32_t length = static_cast<uint32_t>(JSValueToNumber(ctx, GetLength(ctx, keys, nullptr), nullptr));
+        *properties_written = 0;
+        for (uint32_t i=start; i<length; i++) {
+            JSStringRef key = JSValueToStringCopy(ctx, JSObjectGetPropertyAtIndex(ctx, keys, i, nullptr), nullptr);
+            JSValueRef value = JSObjectGetProperty(ctx, object, key, m_exception);
+            if (*m_exception) {
+                JSStringRelease(key);
+                return false;
+            }
+            uint32_t index;
+            if (keep_numbers && IsArrayIndex(key, &index)) {
+                WriteNumber(index);
+            } else {
+                WriteString(key);
+            }
+            JSStringRelease(key);
+            if (!ThrowIfOutOfMemory() || !WriteObject(ctx, value)) return false;
+            (*properties_written) ++;
+        }
+        return true;
+    }
+
+    bool WriteJSArrayBufferView(JSContextRef ctx, JSObjectRef view, ReceiverKind kind)
+    {
+        ArrayBufferViewTag tag = ArrayBufferViewTag::kDataView;
+        size_t byte_offset, byte_length;
+        if (kind == kTypedArray) {
+            JSTypedArrayType type = JSValueGetTypedArrayType(ctx, view, nullptr);
+            for (auto& t : s_view_types) {
+                if (t.type == type) tag = t.tag;
+            }
+            byte_offset = JSObjectGetTypedArrayByteOffset(ctx, view, m_exception);
+            byte_length = JSObjectGetTypedArrayByteLength(ctx, view, m_exception);
+        } else {
+            JSValueRef extent = exec(ctx, "return [_1.byteOffset, _1.byteLength]", 1,
+                                     (JSValueRef*)&view, m_exception);
+            if (*m_exception) return false;
+            byte_offset = JSValueToNumber(ctx, JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)extent, 0, 0), 0);
+            byte_length = JSValueToNumber(ctx, JSObjectGetPropertyAtIndex(ctx, (JSObjectRef)extent, 1, 0), 0);
+        }
+        if (*m_exception) return false;
+        WriteTag(SerializationTag::kArrayBufferView);
+        WriteVarint(static_cast<uint8_t>(tag));
+        WriteVarint(static_cast<uint32_t>(byte_offset));
+        WriteVarint(static_cast<uint32_t>(byte_length));
+        return ThrowIfOutOfMemory();
+    }
+
+    bool WriteHostObject(JSContextRef ctx, JSObjectRef obj)
+    {
+        WriteTag(SerializationTag::kHostObject);
+        if (!m_delegate) {
+            ThrowDataCloneError(ctx, obj);
+            return false;
+        }
+        Local<Object> object = V82JSC::Value::New(ToContextImpl(m_context), obj).As<Object>();
+        bool ok = m_delegate->WriteHostObject(m_isolate, object).FromMaybe(false);
+        if (!ok) m_failed = true;
+        return ok;
+    }
+
+    Isolate *m_isolate;
+    ValueSerializer::Delegate *m_delegate;
+    uint8_t *m_buffer = nullptr;
+    size_t m_buffer_size = 0;
+    size_t m_buffer_capacity = 0;
+    bool m_out_of_memory = false;
+    bool m_treat_array_buffer_views_as_host_objects = false;
+    bool m_failed = false;
+    int m_depth = 0;
+    uint32_t m_next_id = 0;
+    std::unordered_map<JSObjectRef, uint32_t> m_id_map;
+    std::unordered_map<JSObjectRef, uint32_t> m_transfer_map;
+    JSGlobalContextRef m_gctx = 0;
+    Local<Context> m_context;
+    JSValueRef *m_exception = nullptr;
+};
 
 /**
  * The embedder overrides this method to write some kind of host object, if
@@ -15,7 +716,8 @@ using namespace v8;
  */
 Maybe<bool> ValueSerializer::Delegate::WriteHostObject(Isolate* isolate, Local<Object> object)
 {
-    assert(0);
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate,
+        "#<Object> could not be cloned.", NewStringType::kNormal).ToLocalChecked()));
     return Nothing<bool>();
 }
 
@@ -32,14 +734,14 @@ Maybe<bool> ValueSerializer::Delegate::WriteHostObject(Isolate* isolate, Local<O
 Maybe<uint32_t> ValueSerializer::Delegate::GetSharedArrayBufferId(Isolate* isolate,
                                                                   Local<SharedArrayBuffer> shared_array_buffer)
 {
-    assert(0);
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate,
+        "#<SharedArrayBuffer> could not be cloned.", NewStringType::kNormal).ToLocalChecked()));
     return Nothing<uint32_t>();
 }
 
 Maybe<uint32_t> ValueSerializer::Delegate::GetWasmModuleTransferId(Isolate* isolate,
                                                                    Local<WasmCompiledModule> module)
 {
-    assert(0);
     return Nothing<uint32_t>();
 }
 
@@ -55,8 +757,8 @@ Maybe<uint32_t> ValueSerializer::Delegate::GetWasmModuleTransferId(Isolate* isol
 void* ValueSerializer::Delegate::ReallocateBufferMemory(void* old_buffer, size_t size,
                                      size_t* actual_size)
 {
-    assert(0);
-    return nullptr;
+    *actual_size = size;
+    return realloc(old_buffer, size);
 }
 
 /**
@@ -64,21 +766,20 @@ void* ValueSerializer::Delegate::ReallocateBufferMemory(void* old_buffer, size_t
  */
 void ValueSerializer::Delegate::FreeBufferMemory(void* buffer)
 {
-    assert(0);
+    free(buffer);
 }
 
-ValueSerializer::ValueSerializer(Isolate* isolate)
+ValueSerializer::ValueSerializer(Isolate* isolate) : ValueSerializer(isolate, nullptr)
 {
-    assert(0);
 }
 
-ValueSerializer::ValueSerializer(Isolate* isolate, Delegate* delegate)
+ValueSerializer::ValueSerializer(Isolate* isolate, Delegate* delegate) :
+    private_(new PrivateData(isolate, delegate))
 {
-    assert(0);
 }
 ValueSerializer::~ValueSerializer()
 {
-    assert(0);
+    delete private_;
 }
 
 /**
@@ -86,7 +787,8 @@ ValueSerializer::~ValueSerializer()
  */
 void ValueSerializer::WriteHeader()
 {
-    assert(0);
+    private_->WriteTag(SerializationTag::kVersion);
+    private_->WriteVarint(kLatestVersion);
 }
 
 /**
@@ -94,8 +796,26 @@ void ValueSerializer::WriteHeader()
  */
 Maybe<bool> ValueSerializer::WriteValue(Local<Context> context, Local<Value> value)
 {
-    assert(0);
-    return Nothing<bool>();
+    HandleScope scope(context->GetIsolate());
+    Context::Scope context_scope(context);
+    JSContextRef ctx = ToContextRef(context);
+    LocalException exception(ToIsolateImpl(ToContextImpl(context)));
+
+    private_->Enter(ctx);
+    private_->m_context = context;
+    private_->m_exception = &exception;
+    private_->m_failed = false;
+    bool ok = private_->WriteObject(ctx, ToJSValueRef(value, context));
+    private_->m_exception = nullptr;
+    private_->m_context.Clear();
+
+    if (!ok) return Nothing<bool>();
+    return Just(true);
+}
+
+std::vector<uint8_t> ValueSerializer::ReleaseBuffer()
+{
+    return std::vector<uint8_t>(private_->m_buffer, private_->m_buffer + private_->m_buffer_size);
 }
 
 /**
@@ -106,8 +826,11 @@ Maybe<bool> ValueSerializer::WriteValue(Local<Context> context, Local<Value> val
  */
 std::pair<uint8_t*, size_t> ValueSerializer::Release()
 {
-    assert(0);
-    return std::pair<uint8_t*, size_t>(nullptr,0);
+    auto result = std::make_pair(private_->m_buffer, private_->m_buffer_size);
+    private_->m_buffer = nullptr;
+    private_->m_buffer_size = 0;
+    private_->m_buffer_capacity = 0;
+    return result;
 }
 
 /**
@@ -118,7 +841,20 @@ std::pair<uint8_t*, size_t> ValueSerializer::Release()
 void ValueSerializer::TransferArrayBuffer(uint32_t transfer_id,
                          Local<ArrayBuffer> array_buffer)
 {
-    assert(0);
+    HandleScope scope(private_->m_isolate);
+    Local<Context> context = V82JSC::OperatingContext(private_->m_isolate);
+    JSObjectRef buffer = (JSObjectRef) ToJSValueRef(array_buffer, context);
+    private_->Enter(ToContextRef(context));
+    if (private_->m_transfer_map.count(buffer) == 0) {
+        JSValueProtect(ToContextRef(context), buffer);
+    }
+    private_->m_transfer_map[buffer] = transfer_id;
+}
+
+void ValueSerializer::TransferSharedArrayBuffer(uint32_t transfer_id,
+                                                Local<SharedArrayBuffer> shared_array_buffer)
+{
+    TransferArrayBuffer(transfer_id, Local<ArrayBuffer>::Cast(Local<Value>(shared_array_buffer)));
 }
 
 /**
@@ -130,7 +866,7 @@ void ValueSerializer::TransferArrayBuffer(uint32_t transfer_id,
  */
 void ValueSerializer::SetTreatArrayBufferViewsAsHostObjects(bool mode)
 {
-    assert(0);
+    private_->m_treat_array_buffer_views_as_host_objects = mode;
 }
 
 /**
@@ -140,21 +876,572 @@ void ValueSerializer::SetTreatArrayBufferViewsAsHostObjects(bool mode)
  */
 void ValueSerializer::WriteUint32(uint32_t value)
 {
-    assert(0);
+    private_->WriteVarint<uint32_t>(value);
 }
 void ValueSerializer::WriteUint64(uint64_t value)
 {
-    assert(0);
+    private_->WriteVarint<uint64_t>(value);
 }
 void ValueSerializer::WriteDouble(double value)
 {
-    assert(0);
+    private_->WriteDouble(value);
 }
 void ValueSerializer::WriteRawBytes(const void* source, size_t length)
 {
-    assert(0);
+    private_->WriteRawBytes(source, length);
 }
 
+struct ValueDeserializer::PrivateData {
+    PrivateData(Isolate *isolate, const uint8_t* data, size_t size, ValueDeserializer::Delegate *delegate) :
+        m_isolate(isolate), m_delegate(delegate), m_position(data), m_end(data + size) {}
+    ~PrivateData()
+    {
+        if (m_gctx) {
+            for (auto i=m_id_map.begin(); i!=m_id_map.end(); ++i) if (*i) JSValueUnprotect(m_gctx, *i);
+            for (auto i=m_transfer_map.begin(); i!=m_transfer_map.end(); ++i) JSValueUnprotect(m_gctx, i->second);
+            JSGlobalContextRelease(m_gctx);
+        }
+    }
+
+    void Enter(JSContextRef ctx)
+    {
+        if (!m_gctx) {
+            m_gctx = JSContextGetGlobalContext(ctx);
+            JSGlobalContextRetain(m_gctx);
+        }
+    }
+
+    bool PeekTag(SerializationTag *tag) const
+    {
+        const uint8_t* peek_position = m_position;
+        do {
+            if (peek_position >= m_end) return false;
+            *tag = static_cast<SerializationTag>(*peek_position);
+            peek_position++;
+        } while (*tag == SerializationTag::kPadding);
+        return true;
+    }
+
+    bool ReadTag(SerializationTag *tag)
+    {
+        do {
+            if (m_position >= m_end) return false;
+            *tag = static_cast<SerializationTag>(*m_position);
+            m_position++;
+        } while (*tag == SerializationTag::kPadding);
+        return true;
+    }
+
+    template <typename T> bool ReadVarint(T *out)
+    {
+        static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value,
+                      "Only unsigned integer types can be read as varints.");
+        T value = 0;
+        unsigned shift = 0;
+        bool has_another_byte;
+        do {
+            if (m_position >= m_end) return false;
+            uint8_t byte = *m_position;
+            if (shift < sizeof(T) * 8) {
+                value |= static_cast<T>(byte & 0x7f) << shift;
+                shift += 7;
+            }
+            has_another_byte = byte & 0x80;
+            m_position++;
+        } while (has_another_byte);
+        *out = value;
+        return true;
+    }
+
+    template <typename T> bool ReadZigZag(T *out)
+    {
+        using UnsignedT = typename std::make_unsigned<T>::type;
+        UnsignedT unsigned_value;
+        if (!ReadVarint<UnsignedT>(&unsigned_value)) return false;
+        *out = static_cast<T>((unsigned_value >> 1) ^ -static_cast<T>(unsigned_value & 1));
+        return true;
+    }
+
+    bool ReadDouble(double *value)
+    {
+        if (m_end - m_position < (ptrdiff_t) sizeof(double)) return false;
+        memcpy(value, m_position, sizeof(double));
+        m_position += sizeof(double);
+        if (std::isnan(*value)) *value = std::numeric_limits<double>::quiet_NaN();
+        return true;
+    }
+
+    bool ReadRawBytes(size_t length, const uint8_t **data)
+    {
+        if (length > static_cast<size_t>(m_end - m_position)) return false;
+        *data = m_position;
+        m_position += length;
+        return true;
+    }
+
+    void AddObjectWithID(JSContextRef ctx, uint32_t id, JSObjectRef object)
+    {
+        if (id >= m_id_map.size()) m_id_map.resize(id + 1, nullptr);
+        m_id_map[id] = object;
+        JSValueProtect(ctx, object);
+    }
+
+    bool ReadObject(JSContextRef ctx, JSValueRef *result)
+    {
+        if (++m_depth > kMaxDepth) return false;
+        bool ok = ReadObjectInternal(ctx, result);
+        m_depth --;
+
+        // ArrayBufferView is special in that it consumes the value before it
+        SerializationTag tag;
+        if (ok && PeekTag(&tag) && tag == SerializationTag::kArrayBufferView && JSValueIsObject(ctx, *result) &&
+            JSValueGetTypedArrayType(ctx, *result, nullptr) == kJSTypedArrayTypeArrayBuffer) {
+            ReadTag(&tag);
+            ok = ReadJSArrayBufferView(ctx, (JSObjectRef)*result, result);
+        }
+        return ok;
+    }
+
+    bool ReadObjectInternal(JSContextRef ctx, JSValueRef *result)
+    {
+        SerializationTag tag;
+        if (!ReadTag(&tag)) return false;
+        switch (tag) {
+            case SerializationTag::kVerifyObjectCount: {
+                // Read the count and ignore it.
+                uint32_t count;
+                if (!ReadVarint<uint32_t>(&count)) return false;
+                return ReadObject(ctx, result);
+            }
+            case SerializationTag::kUndefined:
+                *result = JSValueMakeUndefined(ctx);
+                return true;
+            case SerializationTag::kNull:
+                *result = JSValueMakeNull(ctx);
+                return true;
+            case SerializationTag::kTrue:
+                *result = JSValueMakeBoolean(ctx, true);
+                return true;
+            case SerializationTag::kFalse:
+                *result = JSValueMakeBoolean(ctx, false);
+                return true;
+            case SerializationTag::kInt32: {
+                int32_t number;
+                if (!ReadZigZag<int32_t>(&number)) return false;
+                *result = JSValueMakeNumber(ctx, number);
+                return true;
+            }
+            case SerializationTag::kUint32: {
+                uint32_t number;
+                if (!ReadVarint<uint32_t>(&number)) return false;
+                *result = JSValueMakeNumber(ctx, number);
+                return true;
+            }
+            case SerializationTag::kDouble: {
+                double number;
+                if (!ReadDouble(&number)) return false;
+                *result = JSValueMakeNumber(ctx, number);
+                return true;
+            }
+            case SerializationTag::kUtf8String:
+            case SerializationTag::kOneByteString:
+            case SerializationTag::kTwoByteString:
+                return ReadString(ctx, tag, result);
+            case SerializationTag::kObjectReference: {
+                uint32_t id;
+                if (!ReadVarint<uint32_t>(&id) || id >= m_id_map.size() || !m_id_map[id]) return false;
+                *result = m_id_map[id];
+                return true;
+            }
+            case SerializationTag::kBeginJSObject:
+                return ReadJSObject(ctx, result);
+            case SerializationTag::kBeginSparseJSArray:
+                return ReadSparseJSArray(ctx, result);
+            case SerializationTag::kBeginDenseJSArray:
+                return ReadDenseJSArray(ctx, result);
+            case SerializationTag::kDate: {
+                double value;
+                if (!ReadDouble(&value)) return false;
+                uint32_t id = m_next_id++;
+                JSValueRef time = JSValueMakeNumber(ctx, value);
+                JSObjectRef date = JSObjectMakeDate(ctx, 1, &time, m_exception);
+                if (*m_exception) return false;
+                AddObjectWithID(ctx, id, date);
+                *result = date;
+                return true;
+            }
+            case SerializationTag::kTrueObject:
+            case SerializationTag::kFalseObject:
+            case SerializationTag::kNumberObject:
+            case SerializationTag::kStringObject:
+                return ReadJSValue(ctx, tag, result);
+            case SerializationTag::kRegExp:
+                return ReadJSRegExp(ctx, result);
+            case SerializationTag::kBeginJSMap:
+            case SerializationTag::kBeginJSSet:
+                return ReadJSCollection(ctx, tag == SerializationTag::kBeginJSMap, result);
+            case SerializationTag::kArrayBuffer:
+                return ReadJSArrayBuffer(ctx, result);
+            case SerializationTag::kArrayBufferTransfer:
+            case SerializationTag::kSharedArrayBuffer: {
+                uint32_t id = m_next_id++;
+                uint32_t transfer_id;
+                if (!ReadVarint<uint32_t>(&transfer_id) || m_transfer_map.count(transfer_id) == 0) return false;
+                AddObjectWithID(ctx, id, m_transfer_map[transfer_id]);
+                *result = m_transfer_map[transfer_id];
+                return true;
+            }
+            case SerializationTag::kHostObject:
+                return ReadHostObject(ctx, result);
+            default:
+                // Before there was an explicit tag for host objects, all unknown tags
+                // were delegated to the host.  WebAssembly is not supported.
+                if (m_version < 13 && tag != SerializationTag::kWasmModule &&
+                    tag != SerializationTag::kWasmModuleTransfer) {
+                    m_position--;
+                    return ReadHostObject(ctx, result);
+                }
+                return false;
+        }
+    }
+
+    bool ReadString(JSContextRef ctx, SerializationTag tag, JSValueRef *result)
+    {
+        uint32_t byte_length;
+        const uint8_t *bytes;
+        if (!ReadVarint<uint32_t>(&byte_length) ||
+            byte_length > static_cast<uint32_t>(std::numeric_limits<int32_t>::max()) ||
+            !ReadRawBytes(byte_length, &bytes)) {
+            return false;
+        }
+        JSStringRef str;
+        if (tag == SerializationTag::kUtf8String) {
+            std::string utf8(reinterpret_cast<const char*>(bytes), byte_length);
+            str = JSStringCreateWithUTF8CString(utf8.c_str());
+        } else if (tag == SerializationTag::kOneByteString) {
+            std::vector<JSChar> chars(bytes, bytes + byte_length);
+            str = JSStringCreateWithCharacters(chars.data(), chars.size());
+        } else if (tag == SerializationTag::kTwoByteString && byte_length % sizeof(JSChar) == 0) {
+            // Copy out, since the data need not be aligned
+            std::vector<JSChar> chars(byte_length / sizeof(JSChar));
+            memcpy(chars.data(), bytes, byte_length);
+            str = JSStringCreateWithCharacters(chars.data(), chars.size());
+        } else {
+            return false;
+        }
+        *result = JSValueMakeString(ctx, str);
+        JSStringRelease(str);
+        return true;
+    }
+
+    // Strings nested in other values carry their own tag, except before version 12
+    bool ReadNestedString(JSContextRef ctx, JSValueRef *result)
+    {
+        if (m_version < 12) return ReadString(ctx, SerializationTag::kUtf8String, result);
+        return ReadObject(ctx, result) && JSValueIsString(ctx, *result);
+    }
+
+    bool ReadJSObject(JSContextRef ctx, JSValueRef *result)
+    {
+        uint32_t id = m_next_id++;
+        JSObjectRef object = JSObjectMake(ctx, nullptr, nullptr);
+        AddObjectWithID(ctx, id, object);
+
+        uint32_t num_properties, expected_num_properties;
+        if (!ReadJSObjectProperties(ctx, object, SerializationTag::kEndJSObject, &num_properties) ||
+            !ReadVarint<uint32_t>(&expected_num_properties) || num_properties != expected_num_properties) {
+            return false;
+        }
+        *result = object;
+        return true;
+    }
+
+    bool ReadSparseJSArray(JSContextRef ctx, JSValueRef *result)
+    {
+        uint32_t length;
+        if (!ReadVarint<uint32_t>(&length)) return false;
+
+        uint32_t id = m_next_id++;
+        JSObjectRef array = MakeArray(ctx, length);
+        if (!array) return false;
+        AddObjectWithID(ctx, id, array);
+
+        uint32_t num_properties, expected_num_properties, expected_length;
+        if (!ReadJSObjectProperties(ctx, array, SerializationTag::kEndSparseJSArray, &num_properties) ||
+            !ReadVarint<uint32_t>(&expected_num_properties) || !ReadVarint<uint32_t>(&expected_length) ||
+            num_properties != expected_num_properties || length != expected_length) {
+            return false;
+        }
+        *result = array;
+        return true;
+    }
+
+    bool ReadDenseJSArray(JSContextRef ctx, JSValueRef *result)
+    {
+        // Since each entry will take at least one byte to encode, if there are fewer bytes than
+        // that we can fail fast.
+        uint32_t length;
+        if (!ReadVarint<uint32_t>(&length) || length > static_cast<size_t>(m_end - m_position)) {
+            return false;
+        }
+
+        uint32_t id = m_next_id++;
+        JSObjectRef array = MakeArray(ctx, length);
+        if (!array) return false;
+        AddObjectWithID(ctx, id, array);
+
+        for (uint32_t i=0; i<length; i++) {
+            SerializationTag tag;
+            if (PeekTag(&tag) && tag == SerializationTag::kTheHole) {
+                ReadTag(&tag);
+                continue;
+            }
+            JSValueRef element;
+            if (!ReadObject(ctx, &element)) return false;
+
+            // Serialization versions less than 11 encode the hole the same as undefined.
+            if (m_version < 11 && JSValueIsUndefined(ctx, element)) continue;
+
+            JSObjectSetPropertyAtIndex(ctx, array, i, element, m_exception);
+            if (*m_exception) return false;
+        }
+
+        uint32_t num_properties, expected_num_properties, expected_length;
+        if (!ReadJSObjectProperties(ctx, array, SerializationTag::kEndDenseJSArray, &num_properties) ||
+            !ReadVarint<uint32_t>(&expected_num_properties) || !ReadVarint<uint32_t>(&expected_length) ||
+            num_properties != expected_num_properties || length != expected_length) {
+            return false;
+        }
+        *result = array;
+        return true;
+    }
+
+    JSObjectRef MakeArray(JSContextRef ctx, uint32_t length)
+    {
+        JSObjectRef array = JSObjectMakeArray(ctx, 0, nullptr, m_exception);
+        if (*m_exception) return nullptr;
+        static JSStringRef s_length = JSStringCreateWithUTF8CString("length");
+        JSObjectSetProperty(ctx, array, s_length, JSValueMakeNumber(ctx, length), 0, m_exception);
+        return *m_exception ? nullptr : array;
+    }
+
+    bool ReadJSObjectProperties(JSContextRef ctx, JSObjectRef object, SerializationTag end_tag,
+                                uint32_t *num_properties)
+    {
+        static JSStringRef s_proto = JSStringCreateWithUTF8CString("__proto__");
+        for (*num_properties = 0; ; (*num_properties)++) {
+            SerializationTag tag;
+            if (!PeekTag(&tag)) return false;
+            if (tag == end_tag) {
+                ReadTag(&tag);
+                return true;
+            }
+
+            JSValueRef key, value;
+            if (!ReadObject(ctx, &key) || !(JSValueIsString(ctx, key) || JSValueIsNumber(ctx, key)) ||
+                !ReadObject(ctx, &value)) {
+                return false;
+            }
+            if (JSValueIsNumber(ctx, key)) {
+                double number = JSValueToNumber(ctx, key, nullptr);
+                if (number >= 0 && number < 0xFFFFFFFFu && number == std::floor(number)) {
+                    JSObjectSetPropertyAtIndex(ctx, object, static_cast<unsigned>(number), value, m_exception);
+                    if (*m_exception) return false;
+                    continue;
+                }
+            }
+            JSStringRef name = JSValueToStringCopy(ctx, key, m_exception);
+            if (*m_exception) return false;
+            if (JSStringIsEqual(name, s_proto)) {
+                // Define it, rather than run the __proto__ setter
+                JSValueRef args[] = { object, key, value };
+                exec(ctx, "Object.defineProperty(_1, _2, "
+                     "{ value: _3, writable: true, enumerable: true, configurable: true })", 3, args, m_exception);
+            } else {
+                JSObjectSetProperty(ctx, object, name, value, kJSPropertyAttributeNone, m_exception);
+            }
+            JSStringRelease(name);
+            if (*m_exception) return false;
+        }
+    }
+
+    bool ReadJSValue(JSContextRef ctx, SerializationTag tag, JSValueRef *result)
+    {
+        uint32_t id = m_next_id++;
+        JSValueRef inner;
+        switch (tag) {
+            case SerializationTag::kTrueObject:
+            case SerializationTag::kFalseObject:
+                inner = JSValueMakeBoolean(ctx, tag == SerializationTag::kTrueObject);
+                break;
+            case SerializationTag::kNumberObject: {
+                double number;
+                if (!ReadDouble(&number)) return false;
+                inner = JSValueMakeNumber(ctx, number);
+                break;
+            }
+            default:
+                if (!ReadNestedString(ctx, &inner)) return false;
+                break;
+        }
+        JSValueRef wrapper = exec(ctx, "return Object(_1)", 1, &inner, m_exception);
+        if (*m_exception) return false;
+        AddObjectWithID(ctx, id, (JSObjectRef)wrapper);
+        *result = wrapper;
+        return true;
+    }
+
+    bool ReadJSRegExp(JSContextRef ctx, JSValueRef *result)
+    {
+        uint32_t id = m_next_id++;
+        JSValueRef pattern;
+        uint32_t raw_flags;
+        if (!ReadNestedString(ctx, &pattern) || !ReadVarint<uint32_t>(&raw_flags) ||
+            raw_flags >= (1u << (sizeof(s_regexp_flags) - 1))) {
+            return false;
+        }
+        char flags[sizeof(s_regexp_flags)];
+        size_t count = 0;
+        for (size_t i=0; i<sizeof(s_regexp_flags) - 1; i++) {
+            if (raw_flags & (1 << i)) flags[count++] = s_regexp_flags[i];
+        }
+        flags[count] = 0;
+        JSStringRef sflags = JSStringCreateWithUTF8CString(flags);
+        JSValueRef args[] = { pattern, JSValueMakeString(ctx, sflags) };
+        JSStringRelease(sflags);
+        JSObjectRef regexp = JSObjectMakeRegExp(ctx, 2, args, m_exception);
+        if (*m_exception) return false;
+        AddObjectWithID(ctx, id, regexp);
+        *result = regexp;
+        return true;
+    }
+
+    bool ReadJSCollection(JSContextRef ctx, bool is_map, JSValueRef *result)
+    {
+        uint32_t id = m_next_id++;
+        JSValueRef collection = is_map ?
+            exec(ctx, "return new Map()", 0, nullptr, m_exception) :
+            exec(ctx, "return new Set()", 0, nullptr, m_exception);
+        if (*m_exception) return false;
+        AddObjectWithID(ctx, id, (JSObjectRef)collection);
+
+        SerializationTag end_tag = is_map ? SerializationTag::kEndJSMap : SerializationTag::kEndJSSet;
+        uint32_t length = 0;
+        while (true) {
+            SerializationTag tag;
+            if (!PeekTag(&tag)) return false;
+            if (tag == end_tag) {
+                ReadTag(&tag);
+                break;
+            }
+            JSValueRef args[3] = { collection };
+            if (!ReadObject(ctx, &args[1])) return false;
+            if (is_map) {
+                if (!ReadObject(ctx, &args[2])) return false;
+                exec(ctx, "Map.prototype.set.call(_1, _2, _3)", 3, args, m_exception);
+                length += 2;
+            } else {
+                exec(ctx, "Set.prototype.add.call(_1, _2)", 2, args, m_exception);
+                length++;
+            }
+            if (*m_exception) return false;
+        }
+
+        uint32_t expected_length;
+        if (!ReadVarint<uint32_t>(&expected_length) || length != expected_length) {
+            return false;
+        }
+        *result = collection;
+        return true;
+    }
+
+    bool ReadJSArrayBuffer(JSContextRef ctx, JSValueRef *result)
+    {
+        uint32_t id = m_next_id++;
+        uint32_t byte_length;
+        if (!ReadVarint<uint32_t>(&byte_length) || byte_length > static_cast<size_t>(m_end - m_position)) {
+            return false;
+        }
+        Local<ArrayBuffer> buffer = ArrayBuffer::New(m_isolate, byte_length);
+        JSObjectRef array_buffer = (JSObjectRef) ToJSValueRef(buffer, m_context);
+        void *bytes = JSObjectGetArrayBufferBytesPtr(ctx, array_buffer, m_exception);
+        if (*m_exception) return false;
+        memcpy(bytes, m_position, byte_length);
+        m_position += byte_length;
+        AddObjectWithID(ctx, id, array_buffer);
+        *result = array_buffer;
+        return true;
+    }
+
+    bool ReadJSArrayBufferView(JSContextRef ctx, JSObjectRef buffer, JSValueRef *result)
+    {
+        size_t buffer_byte_length = JSObjectGetArrayBufferByteLength(ctx, buffer, nullptr);
+        uint8_t tag = 0;
+        uint32_t byte_offset = 0;
+        uint32_t byte_length = 0;
+        if (!ReadVarint<uint8_t>(&tag) || !ReadVarint<uint32_t>(&byte_offset) ||
+            !ReadVarint<uint32_t>(&byte_length) || byte_offset > buffer_byte_length ||
+            byte_length > buffer_byte_length - byte_offset) {
+            return false;
+        }
+        uint32_t id = m_next_id++;
+        JSValueRef view;
+        if (static_cast<ArrayBufferViewTag>(tag) == ArrayBufferViewTag::kDataView) {
+            JSValueRef args[] = { buffer, JSValueMakeNumber(ctx, byte_offset), JSValueMakeNumber(ctx, byte_length) };
+            view = exec(ctx, "return new DataView(_1, _2, _3)", 3, args, m_exception);
+        } else {
+            auto t = std::find_if(std::begin(s_view_types), std::end(s_view_types),
+                                  [tag](decltype(s_view_types[0])& t) { return (uint8_t)t.tag == tag; });
+            if (t == std::end(s_view_types) || byte_offset % t->element_size != 0 ||
+                byte_length % t->element_size != 0) {
+                return false;
+            }
+            view = JSObjectMakeTypedArrayWithArrayBufferAndOffset(ctx, t->type, buffer, byte_offset,
+                                                                  byte_length / t->element_size, m_exception);
+        }
+        if (*m_exception) return false;
+        AddObjectWithID(ctx, id, (JSObjectRef)view);
+        *result = view;
+        return true;
+    }
+
+    bool ReadHostObject(JSContextRef ctx, JSValueRef *result)
+    {
+        if (!m_delegate) return false;
+        uint32_t id = m_next_id++;
+        Local<Object> object;
+        if (!m_delegate->ReadHostObject(m_isolate).ToLocal(&object)) {
+            m_failed = true;
+            return false;
+        }
+        JSObjectRef host = (JSObjectRef) ToJSValueRef(object, m_context);
+        AddObjectWithID(ctx, id, host);
+        *result = host;
+        return true;
+    }
+
+    void ThrowError(const char *message)
+    {
+        m_isolate->ThrowException(Exception::Error(
+            String::NewFromUtf8(m_isolate, message, NewStringType::kNormal).ToLocalChecked()));
+    }
+
+    Isolate *m_isolate;
+    ValueDeserializer::Delegate *m_delegate;
+    const uint8_t *m_position;
+    const uint8_t *m_end;
+    uint32_t m_version = 0;
+    bool m_supports_legacy_wire_format = false;
+    bool m_failed = false;
+    int m_depth = 0;
+    uint32_t m_next_id = 0;
+    std::vector<JSObjectRef> m_id_map;
+    std::unordered_map<uint32_t, JSObjectRef> m_transfer_map;
+    JSGlobalContextRef m_gctx = 0;
+    Local<Context> m_context;
+    JSValueRef *m_exception = nullptr;
+};
+
 /**
  * The embedder overrides this method to read some kind of host object, if
  * possible. If not, a suitable exception should be thrown and
@@ -162,7 +1449,8 @@ void ValueSerializer::WriteRawBytes(const void* source, size_t length)
  */
 MaybeLocal<Object> ValueDeserializer::Delegate::ReadHostObject(Isolate* isolate)
 {
-    assert(0);
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate,
+        "Unable to deserialize cloned data.", NewStringType::kNormal).ToLocalChecked()));
     return MaybeLocal<Object>();
 }
 
@@ -173,22 +1461,23 @@ MaybeLocal<Object> ValueDeserializer::Delegate::ReadHostObject(Isolate* isolate)
 MaybeLocal<WasmCompiledModule> ValueDeserializer::Delegate::GetWasmModuleFromId(
                                         Isolate* isolate, uint32_t transfer_id)
 {
-    assert(0);
+    isolate->ThrowException(Exception::Error(String::NewFromUtf8(isolate,
+        "Unable to deserialize cloned data.", NewStringType::kNormal).ToLocalChecked()));
     return MaybeLocal<WasmCompiledModule>();
 }
 
-ValueDeserializer::ValueDeserializer(Isolate* isolate, const uint8_t* data, size_t size)
+ValueDeserializer::ValueDeserializer(Isolate* isolate, const uint8_t* data, size_t size) :
+    ValueDeserializer(isolate, data, size, nullptr)
 {
-    assert(0);
 }
 ValueDeserializer::ValueDeserializer(Isolate* isolate, const uint8_t* data, size_t size,
-                  Delegate* delegate)
+                  Delegate* delegate) :
+    private_(new PrivateData(isolate, data, size, delegate))
 {
-    assert(0);
 }
 ValueDeserializer::~ValueDeserializer()
 {
-    assert(0);
+    delete private_;
 }
 
 /**
@@ -197,8 +1486,19 @@ ValueDeserializer::~ValueDeserializer()
  */
 Maybe<bool> ValueDeserializer::ReadHeader(Local<Context> context)
 {
-    assert(0);
-    return Nothing<bool>();
+    SerializationTag tag;
+    if (private_->PeekTag(&tag) && tag == SerializationTag::kVersion) {
+        private_->ReadTag(&tag);
+        if (!private_->ReadVarint<uint32_t>(&private_->m_version) || private_->m_version > kLatestVersion) {
+            private_->ThrowError("Unable to deserialize cloned data due to invalid or unsupported version.");
+            return Nothing<bool>();
+        }
+    }
+    if (private_->m_version < kMinimumNonLegacyVersion && !private_->m_supports_legacy_wire_format) {
+        private_->ThrowError("Unable to deserialize cloned data due to invalid or unsupported version.");
+        return Nothing<bool>();
+    }
+    return Just(true);
 }
 
 /**
@@ -206,8 +1506,28 @@ Maybe<bool> ValueDeserializer::ReadHeader(Local<Context> context)
  */
 MaybeLocal<v8::Value> ValueDeserializer::ReadValue(Local<Context> context)
 {
-    assert(0);
-    return MaybeLocal<v8::Value>();
+    EscapableHandleScope scope(context->GetIsolate());
+    Context::Scope context_scope(context);
+    JSContextRef ctx = ToContextRef(context);
+    LocalException exception(ToIsolateImpl(ToContextImpl(context)));
+
+    private_->Enter(ctx);
+    private_->m_context = context;
+    private_->m_exception = &exception;
+    private_->m_failed = false;
+    JSValueRef result = 0;
+    // The stack-based legacy format (version 0) is not supported
+    bool ok = private_->m_version > 0 && private_->ReadObject(ctx, &result);
+    private_->m_exception = nullptr;
+    private_->m_context.Clear();
+
+    if (!ok) {
+        if (!exception.ShouldThrow() && !private_->m_failed) {
+            private_->ThrowError("Unable to deserialize cloned data.");
+        }
+        return MaybeLocal<Value>();
+    }
+    return scope.Escape(V82JSC::Value::New(ToContextImpl(context), result));
 }
 
 /**
@@ -217,7 +1537,16 @@ MaybeLocal<v8::Value> ValueDeserializer::ReadValue(Local<Context> context)
 void ValueDeserializer::TransferArrayBuffer(uint32_t transfer_id,
                          Local<ArrayBuffer> array_buffer)
 {
-    assert(0);
+    HandleScope scope(private_->m_isolate);
+    Local<Context> context = V82JSC::OperatingContext(private_->m_isolate);
+    JSObjectRef buffer = (JSObjectRef) ToJSValueRef(array_buffer, context);
+    private_->Enter(ToContextRef(context));
+    auto found = private_->m_transfer_map.find(transfer_id);
+    if (found != private_->m_transfer_map.end()) {
+        JSValueUnprotect(ToContextRef(context), found->second);
+    }
+    JSValueProtect(ToContextRef(context), buffer);
+    private_->m_transfer_map[transfer_id] = buffer;
 }
 
 /**
@@ -228,7 +1557,7 @@ void ValueDeserializer::TransferArrayBuffer(uint32_t transfer_id,
 void ValueDeserializer::TransferSharedArrayBuffer(uint32_t id,
                                Local<SharedArrayBuffer> shared_array_buffer)
 {
-    assert(0);
+    TransferArrayBuffer(id, Local<ArrayBuffer>::Cast(Local<Value>(shared_array_buffer)));
 }
 
 /**
@@ -240,7 +1569,7 @@ void ValueDeserializer::TransferSharedArrayBuffer(uint32_t id,
  */
 void ValueDeserializer::SetSupportsLegacyWireFormat(bool supports_legacy_wire_format)
 {
-    assert(0);
+    private_->m_supports_legacy_wire_format = supports_legacy_wire_format;
 }
 
 /**
@@ -248,7 +1577,7 @@ void ValueDeserializer::SetSupportsLegacyWireFormat(bool supports_legacy_wire_fo
  */
 void ValueDeserializer::SetExpectInlineWasm(bool allow_inline_wasm)
 {
-    assert(0);
+    // WebAssembly modules are never deserialized
 }
 
 /**
@@ -258,8 +1587,7 @@ void ValueDeserializer::SetExpectInlineWasm(bool allow_inline_wasm)
  */
 uint32_t ValueDeserializer::GetWireFormatVersion() const
 {
-    assert(0);
-    return 0;
+    return private_->m_version;
 }
 
 /**
@@ -269,21 +1597,17 @@ uint32_t ValueDeserializer::GetWireFormatVersion() const
  */
 bool ValueDeserializer::ReadUint32(uint32_t* value)
 {
-    assert(0);
-    return false;
+    return private_->ReadVarint<uint32_t>(value);
 }
 bool ValueDeserializer::ReadUint64(uint64_t* value)
 {
-    assert(0);
-    return false;
+    return private_->ReadVarint<uint64_t>(value);
 }
 bool ValueDeserializer::ReadDouble(double* value)
 {
-    assert(0);
-    return false;
+    return private_->ReadDouble(value);
 }
 bool ValueDeserializer::ReadRawBytes(size_t length, const void** data)
 {
-    assert(0);
-    return false;
+    return private_->ReadRawBytes(length, reinterpret_cast<const uint8_t**>(data));
 }
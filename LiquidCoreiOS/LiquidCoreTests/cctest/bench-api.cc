@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Microbenchmarks for the V8 API calls that node makes most, measured against V82JSC.  They
+ * register as ordinary cctests in the file "bench-api", so that they run with the same shim:
+ *
+ *   cctest_main bench-api         (all of them)
+ *   cctest_main bench-api/Name    (just one)
+ *
+ * Each prints one line per case:  BENCH <name> <ops/sec> ops/sec (<ns/op> ns/op)
+ * except for garbage collection, which reports the pause for each live heap size.
+ */
+
+#include <chrono>
+#include <cstdio>
+
+#include "test/cctest/cctest.h"
+
+using ::v8::ArrayBuffer;
+using ::v8::Context;
+using ::v8::Function;
+using ::v8::FunctionTemplate;
+using ::v8::HandleScope;
+using ::v8::Isolate;
+using ::v8::Local;
+using ::v8::Number;
+using ::v8::Object;
+using ::v8::String;
+using ::v8::Value;
+
+namespace {
+
+const int kIterations = 100000;
+
+// Runs |fn| |iterations| times, after a tenth as many untimed runs, and reports the rate
+template <typename F>
+void Bench(const char *name, int iterations, F fn)
+{
+    for (int i = 0; i < iterations / 10; i++) fn();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) fn();
+    double ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count();
+
+    printf("BENCH %s %.0f ops/sec (%.1f ns/op)\n", name, iterations * 1e9 / ns, ns / iterations);
+}
+
+Local<String> NewString(Isolate *isolate, const char *s)
+{
+    return String::NewFromUtf8(isolate, s, v8::NewStringType::kNormal).ToLocalChecked();
+}
+
+void ReturnFirst(const v8::FunctionCallbackInfo<Value>& info)
+{
+    if (info.Length() > 0) info.GetReturnValue().Set(info[0]);
+}
+
+} /* namespace */
+
+TEST(BenchObjectGetSet) {
+    LocalContext env;
+    Isolate *isolate = env->GetIsolate();
+    HandleScope scope(isolate);
+    Local<Context> context = env.local();
+    Local<Object> object = Object::New(isolate);
+    Local<String> key = NewString(isolate, "key");
+    Local<Value> value = Number::New(isolate, 42);
+
+    Bench("Object::Set", kIterations, [&]() {
+        HandleScope inner(isolate);
+        object->Set(context, key, value).FromJust();
+    });
+    Bench("Object::Get", kIterations, [&]() {
+        HandleScope inner(isolate);
+        object->Get(context, key).ToLocalChecked();
+    });
+    Bench("Object::Get (index)", kIterations, [&]() {
+        HandleScope inner(isolate);
+        object->Get(context, 0).ToLocalChecked();
+    });
+}
+
+TEST(BenchFunctionCall) {
+    LocalContext env;
+    Isolate *isolate = env->GetIsolate();
+    HandleScope scope(isolate);
+    Local<Context> context = env.local();
+    Local<Value> arg = Number::New(isolate, 1);
+
+    Local<Function> js = Local<Function>::Cast(CompileRun("(function(a) { return a; })"));
+    Bench("Function::Call (JS)", kIterations, [&]() {
+        HandleScope inner(isolate);
+        js->Call(context, context->Global(), 1, &arg).ToLocalChecked();
+    });
+
+    Local<Function> native =
+        FunctionTemplate::New(isolate, ReturnFirst)->GetFunction(context).ToLocalChecked();
+    Bench("Function::Call (native)", kIterations, [&]() {
+        HandleScope inner(isolate);
+        native->Call(context, context->Global(), 1, &arg).ToLocalChecked();
+    });
+
+    // JS calling back into a FunctionTemplate callback, which is how node's bindings are reached
+    context->Global()->Set(context, NewString(isolate, "native"), native).FromJust();
+    Local<Function> loop = Local<Function>::Cast(CompileRun(
+        "(function(n) { for (var i = 0; i < n; i++) native(i); })"));
+    Local<Value> count = Number::New(isolate, 1000);
+    Bench("JS -> native callback (x1000)", kIterations / 1000, [&]() {
+        HandleScope inner(isolate);
+        loop->Call(context, context->Global(), 1, &count).ToLocalChecked();
+    });
+}
+
+TEST(BenchFunctionTemplate) {
+    LocalContext env;
+    Isolate *isolate = env->GetIsolate();
+    HandleScope scope(isolate);
+    Local<Context> context = env.local();
+
+    Local<FunctionTemplate> templ = FunctionTemplate::New(isolate, ReturnFirst);
+    Bench("FunctionTemplate::GetFunction (cached)", kIterations, [&]() {
+        HandleScope inner(isolate);
+        templ->GetFunction(context).ToLocalChecked();
+    });
+    Bench("FunctionTemplate::New + GetFunction", kIterations / 10, [&]() {
+        HandleScope inner(isolate);
+        FunctionTemplate::New(isolate, ReturnFirst)->GetFunction(context).ToLocalChecked();
+    });
+}
+
+TEST(BenchStrings) {
+    LocalContext env;
+    Isolate *isolate = env->GetIsolate();
+    HandleScope scope(isolate);
+
+    const char *text = "The quick brown fox jumps over the lazy dog";
+    Bench("String::NewFromUtf8", kIterations, [&]() {
+        HandleScope inner(isolate);
+        NewString(isolate, text);
+    });
+    Bench("String::NewFromUtf8 (internalized)", kIterations, [&]() {
+        HandleScope inner(isolate);
+        String::NewFromUtf8(isolate, text, v8::NewStringType::kInternalized).ToLocalChecked();
+    });
+
+    Local<String> string = NewString(isolate, text);
+    Bench("String::Utf8Value", kIterations, [&]() {
+        String::Utf8Value utf8(string);
+    });
+    Bench("String::Length", kIterations, [&]() {
+        string->Length();
+    });
+}
+
+TEST(BenchValues) {
+    LocalContext env;
+    Isolate *isolate = env->GetIsolate();
+    HandleScope scope(isolate);
+
+    Bench("Number::New", kIterations, [&]() {
+        HandleScope inner(isolate);
+        Number::New(isolate, 3.14);
+    });
+    Bench("HandleScope open/close", kIterations, [&]() {
+        HandleScope inner(isolate);
+    });
+    Bench("ArrayBuffer::New (64 bytes)", kIterations / 10, [&]() {
+        HandleScope inner(isolate);
+        ArrayBuffer::New(isolate, 64);
+    });
+    Bench("Isolate::GetCurrent", kIterations, [&]() {
+        Isolate::GetCurrent();
+    });
+}
+
+TEST(BenchGarbageCollection) {
+    LocalContext env;
+    Isolate *isolate = env->GetIsolate();
+    HandleScope scope(isolate);
+    Local<Context> context = env.local();
+
+    // Pause time for a full collection as the live heap grows
+    for (int live = 1000; live <= 1000000; live *= 10) {
+        HandleScope inner(isolate);
+        Local<v8::Array> retained = v8::Array::New(isolate, live);
+        for (int i = 0; i < live; i++) {
+            retained->Set(context, i, Object::New(isolate)).FromJust();
+        }
+        CcTest::CollectAllGarbage();
+
+        const int collections = 5;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < collections; i++) CcTest::CollectAllGarbage();
+        double ms = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count() / collections;
+        printf("BENCH GC pause (%d live objects) %.2f ms\n", live, ms);
+    }
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Stress tests for the V82JSC heap (HeapAllocator).  Each round allocates a mix of short-lived
+ * strings, numbers, weak persistents, FixedArrays and ArrayBuffers, keeps some of them alive and
+ * then forces a collection, so that allocation throughput, GC pauses and the state of the chunk
+ * list can be followed over time.  Two shapes of live set are covered: a steady one, where new
+ * objects replace old ones, and a growing one.
+ *
+ *   cctest_main stress-heap         (both)
+ *   cctest_main stress-heap/Name    (just one)
+ *
+ * Each round prints:
+ *   STRESS <name> round <n> live <objects> <allocs/sec> allocs/sec pause <ms> ms
+ *          chunks <n> free <slots> fragmentation <fraction>
+ * and each test ends with the distribution of its pauses.
+ */
+
+#include "V82JSC.h"
+#include "Context.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "test/cctest/cctest.h"
+
+using ::v8::ArrayBuffer;
+using ::v8::Global;
+using ::v8::HandleScope;
+using ::v8::Isolate;
+using ::v8::Local;
+using ::v8::Number;
+using ::v8::Object;
+using ::v8::String;
+using ::v8::Value;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const int kRounds = 20;
+const int kAllocationsPerRound = 50000;
+
+// Deterministic, so that runs can be compared with each other
+struct Random {
+    uint32_t state = 12345;
+    uint32_t Next(uint32_t limit)
+    {
+        state = state * 1103515245 + 12345;
+        return (state >> 16) % limit;
+    }
+};
+
+int s_weak_collected = 0;
+
+void WeakCallback(const v8::WeakCallbackInfo<Global<Object>>& info)
+{
+    info.GetParameter()->Reset();
+    delete info.GetParameter();
+    s_weak_collected ++;
+}
+
+// FixedArrays are internal (node only sees them as context embedder data), so they are made
+// the way Context::SetEmbedderData makes them
+Local<Value> NewFixedArray(Isolate *isolate, int length)
+{
+    V82JSC::IsolateImpl *iso = V82JSC::ToIsolateImpl(isolate);
+    auto array = reinterpret_cast<V82JSC::FixedArray*>(V82JSC::HeapAllocator::Alloc(iso,
+        iso->m_fixed_array_map, sizeof(V82JSC::FixedArray) + length * sizeof(v8::internal::Object*)));
+    array->m_size = length;
+    memset(array->m_elements, 0, length * sizeof(v8::internal::Object*));
+    return V82JSC::CreateLocal<v8::EmbeddedFixedArray>(isolate, array);
+}
+
+// Allocates one object of the mix.  Weak persistents are handed straight to the collector and
+// are never part of the live set, so an empty handle comes back for them.
+Local<Value> Allocate(Isolate *isolate, Random& random)
+{
+    static const char *text = "a short-lived string that is only ever used once";
+    switch (random.Next(5)) {
+        case 0:
+            return String::NewFromUtf8(isolate, text, v8::NewStringType::kNormal,
+                                       1 + random.Next(48)).ToLocalChecked();
+        case 1:
+            // Not a Smi, so that it takes a slot
+            return Number::New(isolate, random.Next(1000000) + 0.5);
+        case 2: {
+            auto weak = new Global<Object>(isolate, Object::New(isolate));
+            weak->SetWeak(weak, WeakCallback, v8::WeakCallbackType::kParameter);
+            return Local<Value>();
+        }
+        case 3:
+            return NewFixedArray(isolate, 1 + random.Next(64));
+        default:
+            return ArrayBuffer::New(isolate, 16 + random.Next(4096));
+    }
+}
+
+class Stress {
+public:
+    Stress(const char *name, Isolate *isolate) : m_name(name), m_isolate(isolate) {}
+
+    // One round: |allocations| objects, of which those at |keep_every| intervals are kept
+    // alive in place of (steady) or in addition to (growing) the ones already kept
+    void Round(int round, int allocations, int keep_every, bool grow, size_t steady_size)
+    {
+        auto start = Clock::now();
+        for (int i = 0; i < allocations; i++) {
+            HandleScope scope(m_isolate);
+            Local<Value> value = Allocate(m_isolate, m_random);
+            if (value.IsEmpty() || i % keep_every) continue;
+            if (grow || m_live.size() < steady_size) {
+                m_live.emplace_back(m_isolate, value);
+            } else {
+                m_live[m_next++ % m_live.size()].Reset(m_isolate, value);
+            }
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        start = Clock::now();
+        CcTest::CollectAllGarbage();
+        double pause = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        m_pauses.push_back(pause);
+
+        V82JSC::HeapAllocator::Stats stats;
+        V82JSC::HeapAllocator::GetStats(V82JSC::ToIsolateImpl(m_isolate), &stats);
+        double fragmentation = stats.free_slots ?
+            1.0 - (double) (stats.free_blocks * 64) / stats.free_slots : 0;
+
+        printf("STRESS %s round %d live %zu %.0f allocs/sec pause %.2f ms "
+               "chunks %zu free %zu fragmentation %.3f\n",
+               m_name, round, m_live.size(), allocations / seconds, pause, stats.chunks,
+               stats.free_slots, fragmentation);
+    }
+
+    void Finish()
+    {
+        std::sort(m_pauses.begin(), m_pauses.end());
+        auto percentile = [&](double p) {
+            return m_pauses[std::min(m_pauses.size() - 1, (size_t) (p * m_pauses.size()))];
+        };
+        printf("STRESS %s pauses p50 %.2f ms p90 %.2f ms p99 %.2f ms max %.2f ms "
+               "(%d weak callbacks)\n", m_name, percentile(0.50), percentile(0.90),
+               percentile(0.99), m_pauses.back(), s_weak_collected);
+
+        for (auto& live : m_live) live.Reset();
+        m_live.clear();
+        CcTest::CollectAllGarbage();
+    }
+
+private:
+    const char *m_name;
+    Isolate *m_isolate;
+    Random m_random;
+    std::vector<Global<Value>> m_live;
+    size_t m_next = 0;
+    std::vector<double> m_pauses;
+};
+
+} /* namespace */
+
+TEST(StressHeapSteadyState) {
+    LocalContext env;
+    Isolate *isolate = env->GetIsolate();
+    HandleScope scope(isolate);
+
+    s_weak_collected = 0;
+    Stress stress("steady", isolate);
+    for (int round = 0; round < kRounds; round++) {
+        stress.Round(round, kAllocationsPerRound, 10, false, 10000);
+    }
+    stress.Finish();
+}
+
+TEST(StressHeapGrowing) {
+    LocalContext env;
+    Isolate *isolate = env->GetIsolate();
+    HandleScope scope(isolate);
+
+    s_weak_collected = 0;
+    Stress stress("growing", isolate);
+    for (int round = 0; round < kRounds; round++) {
+        stress.Round(round, kAllocationsPerRound, 10, true, 0);
+    }
+    stress.Finish();
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * ValueSerializer and ValueDeserializer.  Values are round-tripped through the wire format,
+ * and the bytes written for the simple cases are checked against what V8 itself writes for
+ * them, so that data can go between iOS and Android in either direction.
+ *
+ *   cctest_main test-serializer
+ */
+
+#include <vector>
+
+#include "test/cctest/cctest.h"
+
+using ::v8::ArrayBuffer;
+using ::v8::Context;
+using ::v8::HandleScope;
+using ::v8::Integer;
+using ::v8::Isolate;
+using ::v8::Local;
+using ::v8::Maybe;
+using ::v8::MaybeLocal;
+using ::v8::Object;
+using ::v8::ObjectTemplate;
+using ::v8::String;
+using ::v8::TryCatch;
+using ::v8::Value;
+using ::v8::ValueDeserializer;
+using ::v8::ValueSerializer;
+
+namespace {
+
+std::vector<uint8_t> Serialize(Local<Context> context, Local<Value> value,
+                               ValueSerializer::Delegate *delegate = nullptr)
+{
+    ValueSerializer serializer(context->GetIsolate(), delegate);
+    serializer.WriteHeader();
+    CHECK(serializer.WriteValue(context, value).FromMaybe(false));
+    return serializer.ReleaseBuffer();
+}
+
+Local<Value> Deserialize(Local<Context> context, const std::vector<uint8_t>& data)
+{
+    ValueDeserializer deserializer(context->GetIsolate(), data.data(), data.size());
+    CHECK(deserializer.ReadHeader(context).FromMaybe(false));
+    return deserializer.ReadValue(context).ToLocalChecked();
+}
+
+void CheckBytes(const std::vector<uint8_t>& actual, const std::vector<uint8_t>& expected)
+{
+    CHECK_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        CHECK_EQ(expected[i], actual[i]);
+    }
+}
+
+// Writes a host object's one internal field as a uint32, and reads it back into a new instance
+class HostDelegate : public ValueSerializer::Delegate, public ValueDeserializer::Delegate {
+public:
+    HostDelegate(Isolate *isolate, Local<ObjectTemplate> templ) :
+        m_isolate(isolate), m_template(isolate, templ) {}
+    ~HostDelegate() { m_template.Reset(); }
+
+    void ThrowDataCloneError(Local<String> message) override
+    {
+        m_isolate->ThrowException(v8::Exception::Error(message));
+    }
+
+    Maybe<bool> WriteHostObject(Isolate *isolate, Local<Object> object) override
+    {
+        m_serializer->WriteUint32(object->GetInternalField(0)->Uint32Value(
+            isolate->GetCurrentContext()).FromJust());
+        return v8::Just(true);
+    }
+
+    MaybeLocal<Object> ReadHostObject(Isolate *isolate) override
+    {
+        uint32_t value;
+        if (!m_deserializer->ReadUint32(&value)) return MaybeLocal<Object>();
+        Local<Context> context = isolate->GetCurrentContext();
+        Local<Object> object = m_template.Get(isolate)->NewInstance(context).ToLocalChecked();
+        object->SetInternalField(0, Integer::NewFromUnsigned(isolate, value));
+        return object;
+    }
+
+    ValueSerializer *m_serializer = nullptr;
+    ValueDeserializer *m_deserializer = nullptr;
+
+private:
+    Isolate *m_isolate;
+    v8::Global<ObjectTemplate> m_template;
+};
+
+} /* namespace */
+
+TEST(ValueSerializerGoldenBytes) {
+    LocalContext env;
+    HandleScope scope(env->GetIsolate());
+    Local<Context> context = env.local();
+
+    CheckBytes(Serialize(context, CompileRun("undefined")), { 0xFF, 0x0D, '_' });
+    CheckBytes(Serialize(context, CompileRun("42")), { 0xFF, 0x0D, 'I', 0x54 });
+    CheckBytes(Serialize(context, CompileRun("-1")), { 0xFF, 0x0D, 'I', 0x01 });
+    // Latin-1 strings are written one byte to a character
+    CheckBytes(Serialize(context, CompileRun("'abc'")), { 0xFF, 0x0D, '"', 0x03, 'a', 'b', 'c' });
+    CheckBytes(Serialize(context, CompileRun("'\\u00e9'")), { 0xFF, 0x0D, '"', 0x01, 0xE9 });
+    // Anything else two, aligned so that the characters start on an even offset
+    CheckBytes(Serialize(context, CompileRun("'\\u4e2d'")), { 0xFF, 0x0D, 'c', 0x02, 0x2D, 0x4E });
+    CheckBytes(Serialize(context, CompileRun("({a: 1})")),
+               { 0xFF, 0x0D, 'o', '"', 0x01, 'a', 'I', 0x02, '{', 0x01 });
+    CheckBytes(Serialize(context, CompileRun("new Uint8Array([1, 2, 3]).buffer")),
+               { 0xFF, 0x0D, 'B', 0x03, 0x01, 0x02, 0x03 });
+    CheckBytes(Serialize(context, CompileRun("var o = {}; o.self = o; o")),
+               { 0xFF, 0x0D, 'o', '"', 0x04, 's', 'e', 'l', 'f', '^', 0x00, '{', 0x01 });
+}
+
+TEST(ValueSerializerRoundTripStrings) {
+    LocalContext env;
+    HandleScope scope(env->GetIsolate());
+    Local<Context> context = env.local();
+
+    const char *sources[] = {
+        "''", "'abc'", "'caf\\u00e9'", "'\\u4e2d\\u6587'", "'a\\u4e2d'", "'\\ud83d\\ude00'",
+        "new Array(200).join('x')",
+    };
+    for (const char *source : sources) {
+        Local<Value> value = CompileRun(source);
+        Local<Value> result = Deserialize(context, Serialize(context, value));
+        CHECK(result->IsString());
+        CHECK(value->StrictEquals(result));
+    }
+
+    // The same string twice in one object is written, and read, twice
+    Local<Value> result = Deserialize(context, Serialize(context,
+        CompileRun("({a: '\\u4e2d', b: 'xyz', c: '\\u4e2d'})")));
+    CHECK(result->IsObject());
+    context->Global()->Set(context, v8_str("result"), result).FromJust();
+    CHECK(CompileRun("result.a === '\\u4e2d' && result.b === 'xyz' && result.c === result.a")
+        ->IsTrue());
+}
+
+TEST(ValueSerializerRoundTripArrayBuffers) {
+    LocalContext env;
+    HandleScope scope(env->GetIsolate());
+    Local<Context> context = env.local();
+
+    Local<Value> result = Deserialize(context, Serialize(context,
+        CompileRun("new Uint8Array([1, 2, 3, 255]).buffer")));
+    CHECK(result->IsArrayBuffer());
+    ArrayBuffer::Contents contents = result.As<ArrayBuffer>()->GetContents();
+    CHECK_EQ(4u, contents.ByteLength());
+    const uint8_t *data = static_cast<const uint8_t*>(contents.Data());
+    CHECK_EQ(1, data[0]);
+    CHECK_EQ(2, data[1]);
+    CHECK_EQ(3, data[2]);
+    CHECK_EQ(255, data[3]);
+
+    result = Deserialize(context, Serialize(context, CompileRun("new ArrayBuffer(0)")));
+    CHECK(result->IsArrayBuffer());
+    CHECK_EQ(0u, result.As<ArrayBuffer>()->ByteLength());
+
+    // Views share the buffer written just before them
+    result = Deserialize(context, Serialize(context, CompileRun(
+        "var b = new ArrayBuffer(8); new Uint8Array(b)[5] = 7;"
+        "({whole: new Uint8Array(b), part: new Uint16Array(b, 2, 2)})")));
+    context->Global()->Set(context, v8_str("result"), result).FromJust();
+    CHECK(CompileRun("result.whole.buffer === result.part.buffer && result.whole[5] === 7 &&"
+                     "result.part.byteOffset === 2 && result.part.length === 2")->IsTrue());
+}
+
+TEST(ValueSerializerRoundTripCircular) {
+    LocalContext env;
+    HandleScope scope(env->GetIsolate());
+    Local<Context> context = env.local();
+
+    Local<Value> result = Deserialize(context, Serialize(context, CompileRun(
+        "var o = {n: 1}; o.self = o; o.list = [o, {back: o}]; o")));
+    context->Global()->Set(context, v8_str("result"), result).FromJust();
+    CHECK(CompileRun("result.n === 1 && result.self === result && result.list[0] === result &&"
+                     "result.list[1].back === result")->IsTrue());
+
+    result = Deserialize(context, Serialize(context, CompileRun(
+        "var a = []; a[0] = a; var m = new Map(); m.set(m, a); m")));
+    context->Global()->Set(context, v8_str("result"), result).FromJust();
+    CHECK(CompileRun("var e = result.entries().next().value;"
+                     "e[0] === result && Array.isArray(e[1]) && e[1][0] === e[1]")->IsTrue());
+}
+
+TEST(ValueSerializerRoundTripHostObjects) {
+    LocalContext env;
+    Isolate *isolate = env->GetIsolate();
+    HandleScope scope(isolate);
+    Local<Context> context = env.local();
+
+    Local<ObjectTemplate> templ = ObjectTemplate::New(isolate);
+    templ->SetInternalFieldCount(1);
+    Local<Object> host = templ->NewInstance(context).ToLocalChecked();
+    host->SetInternalField(0, Integer::New(isolate, 1234));
+    context->Global()->Set(context, v8_str("host"), host).FromJust();
+    Local<Value> value = CompileRun("({first: host, second: host})");
+
+    // Without a delegate there is nothing to write them with
+    {
+        TryCatch try_catch(isolate);
+        ValueSerializer serializer(isolate);
+        serializer.WriteHeader();
+        CHECK(serializer.WriteValue(context, value).IsNothing());
+        CHECK(try_catch.HasCaught());
+    }
+
+    HostDelegate delegate(isolate, templ);
+    ValueSerializer serializer(isolate, &delegate);
+    delegate.m_serializer = &serializer;
+    serializer.WriteHeader();
+    CHECK(serializer.WriteValue(context, value).FromMaybe(false));
+    std::vector<uint8_t> data = serializer.ReleaseBuffer();
+
+    ValueDeserializer deserializer(isolate, data.data(), data.size(), &delegate);
+    delegate.m_deserializer = &deserializer;
+    CHECK(deserializer.ReadHeader(context).FromMaybe(false));
+    Local<Value> result = deserializer.ReadValue(context).ToLocalChecked();
+    context->Global()->Set(context, v8_str("result"), result).FromJust();
+    CHECK(CompileRun("result.first !== host && result.first === result.second")->IsTrue());
+    Local<Object> first = CompileRun("result.first").As<Object>();
+    CHECK_EQ(1234u, first->GetInternalField(0)->Uint32Value(context).FromJust());
+}
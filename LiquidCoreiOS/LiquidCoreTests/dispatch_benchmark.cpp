@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Host-to-JS dispatch benchmark.  Floods a running process's loop with empty work from 1, 2,
+ * 4 and 8 host threads at once, through each of process_async(), process_sync(),
+ * process_sync_timeout() and process_interrupt(), and measures the sustained rate and the
+ * end-to-end latency of a message (from the call on the host thread to the start of its work
+ * on the process's thread; for the synchronous paths, the whole round trip).  LCMicroService's
+ * emit*() batches onto process_async(), so its cost per event is bounded by that path's.
+ *
+ *   { "messages": n, "benchmarks": [
+ *       { "path": ..., "threads": n, "messages_per_sec": x, "p50_ns": x, "p99_ns": x }, ... ] }
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "JavaScriptCore/JavaScript.h"
+#include "NodeBridge.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+inline uint64_t Now()
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now().time_since_epoch()).count();
+}
+
+// Waits for |total| messages to be accounted for
+class Countdown {
+public:
+    explicit Countdown(int total) : m_left(total) {}
+    void Done()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_left == 0) m_cv.notify_all();
+    }
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_left == 0; });
+    }
+private:
+    int m_left;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+// One asynchronous message, timed to when it starts on the process's thread
+struct Message {
+    uint64_t sent;
+    uint64_t *latency;
+    Countdown *countdown;
+};
+
+void Received(void *data)
+{
+    auto message = reinterpret_cast<Message*>(data);
+    *message->latency = Now() - message->sent;
+    message->countdown->Done();
+}
+
+void Nothing(void *data) {}
+
+void Add(std::string& json, const char *path, int threads, int messages, uint64_t total_ns,
+         std::vector<uint64_t>& latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[std::min(latencies.size() - 1, (size_t) (p * latencies.size()))];
+    };
+    if (json.back() != '[') json += ",";
+    json += "{\"path\":\""; json += path; json += "\"";
+    json += ",\"threads\":" + std::to_string(threads);
+    json += ",\"messages_per_sec\":" +
+        std::to_string(total_ns ? messages * 1e9 / total_ns : 0.0);
+    json += ",\"p50_ns\":" + std::to_string(percentile(0.50));
+    json += ",\"p99_ns\":" + std::to_string(percentile(0.99));
+    json += "}";
+}
+
+// Runs |send| for |per_thread| messages on each of |threads| threads, all started together
+template <typename F>
+uint64_t Flood(int threads, int per_thread, F send)
+{
+    std::vector<std::thread> senders;
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    for (int t = 0; t < threads; t++) {
+        senders.emplace_back([&, t]() {
+            ready++;
+            while (!go) std::this_thread::yield();
+            for (int i = 0; i < per_thread; i++) send(t, i);
+        });
+    }
+    while (ready < threads) std::this_thread::yield();
+    uint64_t start = Now();
+    go = true;
+    for (auto& sender : senders) sender.join();
+    return start;
+}
+
+// A synchronous path, timed over the whole round trip
+template <typename F>
+void RoundTrips(std::string& json, const char *path, int threads, int per_thread, F call)
+{
+    std::vector<uint64_t> latencies((size_t) (threads * per_thread));
+    uint64_t start = Flood(threads, per_thread, [&](int t, int i) {
+        uint64_t sent = Now();
+        call();
+        latencies[(size_t) (t * per_thread + i)] = Now() - sent;
+    });
+    Add(json, path, threads, threads * per_thread, Now() - start, latencies);
+}
+
+} /* namespace */
+
+/*
+ * |token| is a started process that stays alive for the duration.  Must not be called on its
+ * thread.  Returns the JSON report, which the caller must free().
+ */
+extern "C" char * process_dispatch_benchmark(void *token, int messages)
+{
+    std::string json = "{\"messages\":" + std::to_string(messages) + ",\"benchmarks\":[";
+
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        const int per_thread = std::max(1, messages / threads);
+        const int total = per_thread * threads;
+
+        {
+            std::vector<uint64_t> latencies((size_t) total);
+            std::vector<Message> sent((size_t) total);
+            Countdown countdown(total);
+            uint64_t start = Flood(threads, per_thread, [&](int t, int i) {
+                Message *message = &sent[(size_t) (t * per_thread + i)];
+                message->latency = &latencies[(size_t) (t * per_thread + i)];
+                message->countdown = &countdown;
+                message->sent = Now();
+                process_async(token, Received, message);
+            });
+            countdown.Wait();
+            Add(json, "process_async", threads, total, Now() - start, latencies);
+        }
+
+        RoundTrips(json, "process_sync", threads, per_thread, [token]() {
+            process_sync(token, Nothing, nullptr);
+        });
+        RoundTrips(json, "process_sync_timeout", threads, per_thread, [token]() {
+            process_sync_timeout(token, Nothing, nullptr, 0);
+        });
+        RoundTrips(json, "process_interrupt", threads, per_thread, [token]() {
+            process_interrupt(token, Nothing, nullptr, 0);
+        });
+    }
+
+    json += "]}";
+    return strdup(json.c_str());
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Bare JSC runner for the cross-engine suite (LiquidCoreAndroid/src/androidTest/assets/
+ * engine_benchmark.js).  Runs the script in a global context of its own, straight on
+ * JavaScriptCore with neither node nor V82JSC in the way, so that setting its results against
+ * those of the same script run through process_startup_benchmark() shows the cost of the shim.
+ *
+ * The script sees __benchmark_now(), a monotonic clock in milliseconds, and reports with
+ * __benchmark_report(json) as it would under node.
+ */
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "JavaScriptCore/JavaScript.h"
+
+namespace {
+
+std::string ToString(JSContextRef ctx, JSValueRef value)
+{
+    std::string out;
+    JSStringRef string = JSValueToStringCopy(ctx, value, nullptr);
+    if (string) {
+        size_t size = JSStringGetMaximumUTF8CStringSize(string);
+        std::vector<char> buffer(size);
+        JSStringGetUTF8CString(string, buffer.data(), size);
+        out = buffer.data();
+        JSStringRelease(string);
+    }
+    return out;
+}
+
+JSValueRef Now(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+               size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception)
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return JSValueMakeNumber(ctx, std::chrono::duration<double, std::milli>(now).count());
+}
+
+JSValueRef Report(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                  size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception)
+{
+    auto report = reinterpret_cast<std::string*>(JSObjectGetPrivate(function));
+    if (report && argumentCount > 0) *report = ToString(ctx, arguments[0]);
+    return JSValueMakeUndefined(ctx);
+}
+
+// A global function with |data| as its private data
+void Install(JSContextRef ctx, const char *name, JSObjectCallAsFunctionCallback callback,
+             void *data)
+{
+    JSClassDefinition definition = kJSClassDefinitionEmpty;
+    definition.callAsFunction = callback;
+    JSClassRef cls = JSClassCreate(&definition);
+    JSObjectRef function = JSObjectMake(ctx, cls, data);
+    JSClassRelease(cls);
+
+    JSStringRef jsname = JSStringCreateWithUTF8CString(name);
+    JSObjectSetProperty(ctx, JSContextGetGlobalObject(ctx), jsname, function,
+                        kJSPropertyAttributeDontEnum, nullptr);
+    JSStringRelease(jsname);
+}
+
+} /* namespace */
+
+/*
+ * Returns the script's report, or {"error": ...} if it threw, which the caller must free().
+ */
+extern "C" char * process_engine_benchmark(const char *script)
+{
+    std::string report;
+    JSGlobalContextRef ctx = JSGlobalContextCreate(nullptr);
+    Install(ctx, "__benchmark_now", Now, nullptr);
+    Install(ctx, "__benchmark_report", Report, &report);
+
+    JSStringRef source = JSStringCreateWithUTF8CString(script);
+    JSStringRef url = JSStringCreateWithUTF8CString("engine_benchmark.js");
+    JSValueRef exception = nullptr;
+    JSEvaluateScript(ctx, source, nullptr, url, 0, &exception);
+    JSStringRelease(url);
+    JSStringRelease(source);
+
+    if (exception) {
+        JSStringRef message = JSStringCreateWithUTF8CString(ToString(ctx, exception).c_str());
+        JSValueRef error = JSValueMakeString(ctx, message);
+        JSStringRelease(message);
+        JSStringRef json = JSValueCreateJSONString(ctx, error, 0, nullptr);
+        size_t size = JSStringGetMaximumUTF8CStringSize(json);
+        std::vector<char> buffer(size);
+        JSStringGetUTF8CString(json, buffer.data(), size);
+        JSStringRelease(json);
+        report = std::string("{\"error\":") + buffer.data() + "}";
+    }
+    JSGlobalContextRelease(ctx);
+    return strdup(report.empty() ? "null" : report.c_str());
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+/*
+ * Memory footprint benchmark.  For each count in |counts|, starts that many node processes
+ * side by side, all running the same bundle, lets them settle and measures the app's memory;
+ * then lets them exit before the next count.  What matters is the marginal cost of one more
+ * service, which is what snapshot sharing, isolate recycling and shared VMs are there to cut.
+ *
+ * Sizes are in KB, relative to before the first process started.  The footprint is the task's
+ * phys_footprint, which is what jetsam goes by; "private_dirty_kb" is its internal (dirty,
+ * unshared) part.  The breakdown is: the JSC heaps together with the V82JSC chunks, bytes
+ * held by the ArrayBuffer allocators, the malloc zones and dirty thread stacks:
+ *
+ *   { "baseline": { ... }, "steps": [ { "services": n, "footprint_kb": x,
+ *       "private_dirty_kb": x, "per_service_footprint_kb": x, "marginal_footprint_kb": x,
+ *       "components_kb": { "js_heap": x, "array_buffers": x, "native_heap": x,
+ *                          "thread_stacks": x } }, ... ] }
+ *
+ * The bundle keeps running until it is told to stop, so it should do its set-up and leave
+ * nothing pending of its own.
+ */
+
+#include <mach/mach.h>
+#include <malloc/malloc.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "JavaScriptCore/JavaScript.h"
+#include "NodeBridge.h"
+
+namespace {
+
+std::atomic<bool> s_released(false);
+
+struct Service {
+    std::string bundle;
+    void *token = nullptr;
+    bool started = false;
+    bool exited = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+struct Footprint {
+    uint64_t footprint_kb = 0;
+    uint64_t private_dirty_kb = 0;
+    uint64_t stack_dirty_kb = 0;
+    uint64_t native_heap_kb = 0;
+};
+
+Footprint Measure()
+{
+    Footprint f;
+    task_vm_info_data_t info;
+    mach_msg_type_number_t count = TASK_VM_INFO_COUNT;
+    if (task_info(mach_task_self(), TASK_VM_INFO, (task_info_t) &info, &count) == KERN_SUCCESS) {
+        f.footprint_kb = info.phys_footprint / 1024;
+        f.private_dirty_kb = info.internal / 1024;
+    }
+
+    // Thread stacks are the regions tagged as such
+    vm_address_t address = 0;
+    natural_t depth = 0;
+    for (;;) {
+        vm_size_t size = 0;
+        vm_region_submap_info_data_64_t region;
+        mach_msg_type_number_t region_count = VM_REGION_SUBMAP_INFO_COUNT_64;
+        if (vm_region_recurse_64(mach_task_self(), &address, &size, &depth,
+                                 (vm_region_recurse_info_t) &region, &region_count) != KERN_SUCCESS) {
+            break;
+        }
+        if (region.is_submap) {
+            depth++;
+            continue;
+        }
+        if (region.user_tag == VM_MEMORY_STACK) {
+            f.stack_dirty_kb += (uint64_t) region.pages_dirtied * vm_page_size / 1024;
+        }
+        address += size;
+    }
+
+    malloc_statistics_t stats;
+    malloc_zone_statistics(nullptr, &stats);
+    f.native_heap_kb = stats.size_in_use / 1024;
+    return f;
+}
+
+JSValueRef Released(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject,
+                    size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception)
+{
+    return JSValueMakeBoolean(ctx, s_released);
+}
+
+void OnStart(void *data, JSContextRef ctx, JSContextGroupRef group)
+{
+    auto service = reinterpret_cast<Service*>(data);
+
+    JSClassDefinition definition = kJSClassDefinitionEmpty;
+    definition.callAsFunction = Released;
+    JSClassRef cls = JSClassCreate(&definition);
+    JSStringRef name = JSStringCreateWithUTF8CString("__benchmark_released");
+    JSObjectSetProperty(ctx, JSContextGetGlobalObject(ctx), name,
+                        JSObjectMake(ctx, cls, nullptr), kJSPropertyAttributeDontEnum, nullptr);
+    JSStringRelease(name);
+    JSClassRelease(cls);
+
+    // Holds the process open until the benchmark lets go
+    std::string source = service->bundle +
+        "\n;(function() { var hold = setInterval(function() {"
+        " if (__benchmark_released()) clearInterval(hold); }, 50); })();\n";
+    JSStringRef script = JSStringCreateWithUTF8CString(source.c_str());
+    JSStringRef url = JSStringCreateWithUTF8CString("benchmark_bundle.js");
+    JSEvaluateScript(ctx, script, nullptr, url, 0, nullptr);
+    JSStringRelease(url);
+    JSStringRelease(script);
+
+    std::lock_guard<std::mutex> lk(service->mutex);
+    service->started = true;
+    service->cv.notify_all();
+}
+
+void OnExit(void *data, int code)
+{
+    auto service = reinterpret_cast<Service*>(data);
+    std::lock_guard<std::mutex> lk(service->mutex);
+    service->started = true;
+    service->exited = true;
+    service->cv.notify_all();
+}
+
+std::string Kb(const char *name, double kb, bool first = false)
+{
+    return std::string(first ? "\"" : ",\"") + name + "\":" + std::to_string(kb);
+}
+
+uint64_t Above(uint64_t value, uint64_t base)
+{
+    return value > base ? value - base : 0;
+}
+
+} /* namespace */
+
+/*
+ * Returns the JSON report, which the caller must free().
+ */
+extern "C" char * process_memory_benchmark(const char *bundle, const int *counts, int steps)
+{
+    const Footprint baseline = Measure();
+    std::string json = "{\"baseline\":{";
+    json += Kb("footprint_kb", baseline.footprint_kb, true);
+    json += Kb("private_dirty_kb", baseline.private_dirty_kb);
+    json += "},\"steps\":[";
+
+    uint64_t previous_footprint = 0;
+    int previous_count = 0;
+    std::vector<Service*> previous;
+    for (int step = 0; step < steps; step++) {
+        const int n = counts[step];
+        s_released = false;
+        std::vector<Service*> services;
+        for (int i = 0; i < n; i++) {
+            auto service = new Service();
+            service->bundle = bundle;
+            service->token = process_start(OnStart, OnExit, service);
+            services.push_back(service);
+        }
+        for (auto service : services) {
+            std::unique_lock<std::mutex> lk(service->mutex);
+            service->cv.wait(lk, [service]() { return service->started; });
+        }
+        // Disposing of the last process tears down the platform, so the previous step's are
+        // only let go once these have started
+        for (auto service : previous) {
+            process_dispose(service->token);
+            delete service;
+        }
+        previous.clear();
+        // Let start-up garbage and lazily compiled code settle before looking
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        uint64_t js_heap = 0, array_buffers = 0;
+        for (auto service : services) {
+            ProcessResourceUsage usage;
+            if (process_get_resource_usage(service->token, &usage)) {
+                js_heap += usage.heap_used;
+                array_buffers += usage.external_memory;
+            }
+        }
+        const Footprint f = Measure();
+        const uint64_t footprint = Above(f.footprint_kb, baseline.footprint_kb);
+
+        if (step) json += ",";
+        json += "{\"services\":" + std::to_string(n);
+        json += Kb("footprint_kb", footprint);
+        json += Kb("private_dirty_kb", Above(f.private_dirty_kb, baseline.private_dirty_kb));
+        json += Kb("per_service_footprint_kb", n ? (double) footprint / n : 0);
+        json += Kb("marginal_footprint_kb", n != previous_count ?
+                   ((double) footprint - previous_footprint) / (n - previous_count) : 0);
+        json += ",\"components_kb\":{";
+        json += Kb("js_heap", js_heap / 1024.0, true);
+        json += Kb("array_buffers", array_buffers / 1024.0);
+        json += Kb("native_heap", Above(f.native_heap_kb, baseline.native_heap_kb));
+        json += Kb("thread_stacks", Above(f.stack_dirty_kb, baseline.stack_dirty_kb));
+        json += "}}";
+        previous_footprint = footprint;
+        previous_count = n;
+
+        s_released = true;
+        for (auto service : services) {
+            std::unique_lock<std::mutex> lk(service->mutex);
+            service->cv.wait(lk, [service]() { return service->exited; });
+        }
+        previous = services;
+    }
+    for (auto service : previous) {
+        process_dispose(service->token);
+        delete service;
+    }
+
+    json += "]}";
+    return strdup(json.c_str());
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+#ifndef JSContextGroupRefFinalizer_h
+#define JSContextGroupRefFinalizer_h
+
+#include <JavaScriptCore/JSContextRef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+@function
+@abstract Sets how many class finalizers a context group runs per event loop turn.
+@param group The JSContextGroup to configure.
+@param budget The maximum number of finalize callbacks to run before yielding.  0 is treated
+ as 1.  The default is 256.
+@discussion LiquidCore extension.  Finalize callbacks for garbage collected class instances
+ are not run during garbage collection but queued and run afterwards from the group's event
+ loop, at most budget of them at a time.  Groups without an event loop run them as soon as
+ the collection completes.
+*/
+JS_EXPORT void JSContextGroupSetFinalizerBudget(JSContextGroupRef group, unsigned budget);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSContextGroupRefFinalizer_h */
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+#ifndef JSContextRefBatch_h
+#define JSContextRefBatch_h
+
+#include <JavaScriptCore/JSContextRef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+@function
+@abstract Enters a context for a sequence of API calls on the current thread.
+@param ctx The execution context to enter.
+@discussion LiquidCore extension.  Until the matching JSContextEndBatch, the calling thread
+ holds the context's lock and stays entered into the context, so each API call in between
+ does not have to acquire and release them.  Batches may nest but must be ended in reverse
+ order on the thread that began them.  Other threads using the same context group block
+ until the batch ends.  If the group runs on an event loop thread and the caller is not on
+ that thread, calls are still forwarded to it individually and the batch has no effect.
+*/
+JS_EXPORT void JSContextBeginBatch(JSContextRef ctx);
+
+/*!
+@function
+@abstract Ends a batch started with JSContextBeginBatch.
+@param ctx The execution context passed to the matching JSContextBeginBatch.
+*/
+JS_EXPORT void JSContextEndBatch(JSContextRef ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSContextRefBatch_h */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2018 Eric Lange
+ *
+ * Distributed under the MIT License.  See LICENSE.md at
+ * https://github.com/LiquidPlayer/LiquidCore for terms and conditions.
+ */
+
+#ifndef JSValueRefJSON_h
+#define JSValueRefJSON_h
+
+#include <JavaScriptCore/JSValueRef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+@function
+@abstract Creates a JavaScript value from UTF-16 JSON text without creating a JSString.
+@param ctx The execution context to use.
+@param chars The JSON text.  It is only read during the call.
+@param numChars The number of characters in chars.
+@result A JSValue containing the parsed value, or NULL if the input is invalid.
+@discussion LiquidCore extension.
+*/
+JS_EXPORT JSValueRef JSValueMakeFromJSONCharacters(JSContextRef ctx, const JSChar* chars,
+    size_t numChars);
+
+/*!
+@function
+@abstract Serializes a JavaScript value to JSON directly into a caller-provided buffer.
+@param ctx The execution context to use.
+@param value The value to serialize.
+@param indent The number of spaces to indent when nesting.  If 0, the resulting JSON will not
+ contain newlines.  The size of the indent is clamped to 10 spaces.
+@param buffer The destination for the UTF-16 JSON text.  No terminator is written.
+@param capacity The number of characters buffer can hold.
+@param exception A pointer to a JSValueRef in which to store an exception, if any.  Pass NULL
+ if you do not care to store an exception.
+@result The length of the JSON text in characters, or 0 if the value could not be serialized.
+ If the result is larger than capacity, only the first capacity characters were written and
+ the call can be repeated with a larger buffer.
+@discussion LiquidCore extension.
+*/
+JS_EXPORT size_t JSValueCreateJSONStringInto(JSContextRef ctx, JSValueRef value, unsigned indent,
+    JSChar* buffer, size_t capacity, JSValueRef* exception);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSValueRefJSON_h */
@@ -980,6 +980,14 @@ UV_EXTERN int uv_queue_work(uv_loop_t* loop,
 
 UV_EXTERN int uv_cancel(uv_req_t* req);
 
+/*
+ * Threadpool settings.  The size only applies if set before the first request
+ * is queued.  A loop's work priority is 1 to have its requests go ahead of
+ * other loops', 0 for the default, and -1 to keep it to half of the threads.
+ */
+UV_EXTERN int uv_threadpool_set_size(unsigned int size);
+UV_EXTERN int uv_loop_set_work_priority(uv_loop_t* loop, int priority);
+
 
 struct uv_cpu_info_s {
   char* model;
@@ -29,55 +29,193 @@
 
 #define MAX_THREADPOOL_SIZE 128
 
+/* Work is queued per loop and per kind, rather than in one global FIFO, so
+ * that loops sharing the pool take turns and quick file system requests go
+ * ahead of bulk copies and compression.  Slow I/O and work from background
+ * loops are each held to half of the threads, so that neither can keep the
+ * rest waiting.
+ */
+struct uv__work_client {
+  uv_loop_t* loop;
+  int priority;
+  QUEUE lanes[UV__WORK_NKINDS];
+  QUEUE member;
+};
+
 static uv_once_t once = UV_ONCE_INIT;
 static uv_cond_t cond;
 static uv_mutex_t mutex;
 static unsigned int idle_threads;
 static unsigned int nthreads;
+static unsigned int requested_threads;
 static uv_thread_t* threads;
 static uv_thread_t default_threads[4];
-static QUEUE exit_message;
-static QUEUE wq;
+static int exiting;
+static QUEUE clients;
+/* Takes the work of any loop its own record couldn't be allocated for. */
+static struct uv__work_client overflow_client;
+static unsigned int slow_io_running;
+static unsigned int background_running;
 static volatile int initialized;
 
+/* Lanes in the order they are served. */
+static const enum uv__work_kind lane_order[UV__WORK_NKINDS] = {
+  UV__WORK_FAST_IO,
+  UV__WORK_CPU,
+  UV__WORK_SLOW_IO
+};
+
 
 static void uv__cancelled(struct uv__work* w) {
   abort();
 }
 
 
+static unsigned int half_threads(void) {
+  return (nthreads + 1) / 2;
+}
+
+
+static int client_idle(struct uv__work_client* c) {
+  unsigned int i;
+
+  for (i = 0; i < UV__WORK_NKINDS; i++)
+    if (!QUEUE_EMPTY(&c->lanes[i]))
+      return 0;
+
+  return 1;
+}
+
+
+/* Must be called with the global mutex held. */
+static struct uv__work_client* find_client(uv_loop_t* loop, int create) {
+  struct uv__work_client* c;
+  unsigned int i;
+  QUEUE* q;
+
+  QUEUE_FOREACH(q, &clients) {
+    c = QUEUE_DATA(q, struct uv__work_client, member);
+    if (c->loop == loop)
+      return c;
+  }
+
+  if (!create)
+    return NULL;
+
+  c = uv__malloc(sizeof(*c));
+  if (c == NULL)
+    return &overflow_client;
+
+  c->loop = loop;
+  c->priority = 0;
+  for (i = 0; i < UV__WORK_NKINDS; i++)
+    QUEUE_INIT(&c->lanes[i]);
+  QUEUE_INSERT_TAIL(&clients, &c->member);
+  return c;
+}
+
+
+/* The next request to run, or NULL if nothing may run now.  Within a lane
+ * higher priority loops go first, and loops of the same priority take turns.
+ * Must be called with the global mutex held.
+ */
+static QUEUE* next_work(enum uv__work_kind* kind, int* background) {
+  struct uv__work_client* best;
+  struct uv__work_client* c;
+  unsigned int i;
+  QUEUE* next;
+  QUEUE* q;
+  QUEUE* lane;
+
+  /* Records for loops that have nothing queued and no setting to keep. */
+  for (q = QUEUE_HEAD(&clients); q != &clients; q = next) {
+    next = QUEUE_NEXT(q);
+    c = QUEUE_DATA(q, struct uv__work_client, member);
+    if (c != &overflow_client && c->priority == 0 && client_idle(c)) {
+      QUEUE_REMOVE(q);
+      uv__free(c);
+    }
+  }
+
+  for (i = 0; i < UV__WORK_NKINDS; i++) {
+    *kind = lane_order[i];
+    if (*kind == UV__WORK_SLOW_IO && slow_io_running >= half_threads())
+      continue;
+
+    best = NULL;
+    QUEUE_FOREACH(q, &clients) {
+      c = QUEUE_DATA(q, struct uv__work_client, member);
+      if (QUEUE_EMPTY(&c->lanes[*kind]))
+        continue;
+      if (c->priority < 0 && background_running >= half_threads())
+        continue;
+      if (best == NULL || c->priority > best->priority)
+        best = c;
+    }
+
+    if (best != NULL) {
+      /* To the back of the line. */
+      QUEUE_REMOVE(&best->member);
+      QUEUE_INSERT_TAIL(&clients, &best->member);
+
+      lane = &best->lanes[*kind];
+      *background = best->priority < 0;
+      return QUEUE_HEAD(lane);
+    }
+  }
+
+  return NULL;
+}
+
+
 /* To avoid deadlock with uv_cancel() it's crucial that the worker
  * never holds the global mutex and the loop-local mutex at the same time.
  */
 static void worker(void* arg) {
   struct uv__work* w;
+  enum uv__work_kind kind;
+  int background;
+  int running;
   QUEUE* q;
 
   (void) arg;
+  running = 0;
+  kind = UV__WORK_CPU;
+  background = 0;
 
   for (;;) {
     uv_mutex_lock(&mutex);
 
-    while (QUEUE_EMPTY(&wq)) {
+    if (running) {
+      if (kind == UV__WORK_SLOW_IO)
+        slow_io_running -= 1;
+      if (background)
+        background_running -= 1;
+      running = 0;
+    }
+
+    while (!exiting && (q = next_work(&kind, &background)) == NULL) {
       idle_threads += 1;
       uv_cond_wait(&cond, &mutex);
       idle_threads -= 1;
     }
 
-    q = QUEUE_HEAD(&wq);
-
-    if (q == &exit_message)
+    if (exiting) {
       uv_cond_signal(&cond);
-    else {
-      QUEUE_REMOVE(q);
-      QUEUE_INIT(q);  /* Signal uv_cancel() that the work req is
-                             executing. */
+      uv_mutex_unlock(&mutex);
+      break;
     }
 
-    uv_mutex_unlock(&mutex);
+    QUEUE_REMOVE(q);
+    QUEUE_INIT(q);  /* Signal uv_cancel() that the work req is
+                       executing. */
+    if (kind == UV__WORK_SLOW_IO)
+      slow_io_running += 1;
+    if (background)
+      background_running += 1;
+    running = 1;
 
-    if (q == &exit_message)
-      break;
+    uv_mutex_unlock(&mutex);
 
     w = QUEUE_DATA(q, struct uv__work, wq);
     w->work(w);
@@ -92,9 +230,12 @@ static void worker(void* arg) {
 }
 
 
-static void post(QUEUE* q) {
+static void post(uv_loop_t* loop, QUEUE* q, enum uv__work_kind kind) {
+  struct uv__work_client* c;
+
   uv_mutex_lock(&mutex);
-  QUEUE_INSERT_TAIL(&wq, q);
+  c = find_client(loop, 1);
+  QUEUE_INSERT_TAIL(&c->lanes[kind], q);
   if (idle_threads > 0)
     uv_cond_signal(&cond);
   uv_mutex_unlock(&mutex);
@@ -105,10 +246,16 @@ static void post(QUEUE* q) {
 UV_DESTRUCTOR(static void cleanup(void)) {
   unsigned int i;
 
+  struct uv__work_client* c;
+  QUEUE* q;
+
   if (initialized == 0)
     return;
 
-  post(&exit_message);
+  uv_mutex_lock(&mutex);
+  exiting = 1;
+  uv_cond_signal(&cond);
+  uv_mutex_unlock(&mutex);
 
   for (i = 0; i < nthreads; i++)
     if (uv_thread_join(threads + i))
@@ -117,11 +264,20 @@ UV_DESTRUCTOR(static void cleanup(void)) {
   if (threads != default_threads)
     uv__free(threads);
 
+  while (!QUEUE_EMPTY(&clients)) {
+    q = QUEUE_HEAD(&clients);
+    QUEUE_REMOVE(q);
+    c = QUEUE_DATA(q, struct uv__work_client, member);
+    if (c != &overflow_client)
+      uv__free(c);
+  }
+
   uv_mutex_destroy(&mutex);
   uv_cond_destroy(&cond);
 
   threads = NULL;
   nthreads = 0;
+  exiting = 0;
   initialized = 0;
 }
 #endif
@@ -135,6 +291,8 @@ static void init_threads(void) {
   val = getenv("UV_THREADPOOL_SIZE");
   if (val != NULL)
     nthreads = atoi(val);
+  if (requested_threads != 0)
+    nthreads = requested_threads;
   if (nthreads == 0)
     nthreads = 1;
   if (nthreads > MAX_THREADPOOL_SIZE)
@@ -155,7 +313,12 @@ static void init_threads(void) {
   if (uv_mutex_init(&mutex))
     abort();
 
-  QUEUE_INIT(&wq);
+  QUEUE_INIT(&clients);
+  overflow_client.loop = NULL;
+  overflow_client.priority = 0;
+  for (i = 0; i < UV__WORK_NKINDS; i++)
+    QUEUE_INIT(&overflow_client.lanes[i]);
+  QUEUE_INSERT_TAIL(&clients, &overflow_client.member);
 
   for (i = 0; i < nthreads; i++)
     if (uv_thread_create(threads + i, worker, NULL))
@@ -186,15 +349,73 @@ static void init_once(void) {
 }
 
 
+int uv_threadpool_set_size(unsigned int size) {
+  if (initialized)
+    return UV_EBUSY;
+
+  requested_threads = size;
+  return 0;
+}
+
+
+int uv_loop_set_work_priority(uv_loop_t* loop, int priority) {
+  struct uv__work_client* c;
+
+  if (priority < -1 || priority > 1)
+    return UV_EINVAL;
+
+  uv_once(&once, init_once);
+  uv_mutex_lock(&mutex);
+  c = find_client(loop, priority != 0);
+  if (c == &overflow_client) {
+    uv_mutex_unlock(&mutex);
+    return priority == 0 ? 0 : UV_ENOMEM;
+  }
+  if (c != NULL)
+    c->priority = priority;
+  /* Work held back from a background loop may now be free to run. */
+  if (idle_threads > 0)
+    uv_cond_broadcast(&cond);
+  uv_mutex_unlock(&mutex);
+
+  return 0;
+}
+
+
+void uv__work_loop_close(uv_loop_t* loop) {
+  struct uv__work_client* c;
+
+  if (initialized == 0)
+    return;
+
+  uv_mutex_lock(&mutex);
+  c = find_client(loop, 0);
+  if (c != NULL && c != &overflow_client) {
+    /* A closed loop has nothing queued, so the record would otherwise only
+     * go if its priority were 0, and a new loop at the same address would
+     * take the old one's priority. */
+    if (client_idle(c)) {
+      QUEUE_REMOVE(&c->member);
+      uv__free(c);
+    } else {
+      c->priority = 0;
+      c->loop = NULL;
+    }
+  }
+  uv_mutex_unlock(&mutex);
+}
+
+
 void uv__work_submit(uv_loop_t* loop,
                      struct uv__work* w,
+                     enum uv__work_kind kind,
                      void (*work)(struct uv__work* w),
                      void (*done)(struct uv__work* w, int status)) {
   uv_once(&once, init_once);
   w->loop = loop;
   w->work = work;
   w->done = done;
-  post(&w->wq);
+  post(loop, &w->wq, kind);
 }
 
 
@@ -278,7 +499,11 @@ int uv_queue_work(uv_loop_t* loop,
   req->loop = loop;
   req->work_cb = work_cb;
   req->after_work_cb = after_work_cb;
-  uv__work_submit(loop, &req->work_req, uv__queue_work, uv__queue_done);
+  uv__work_submit(loop,
+                  &req->work_req,
+                  UV__WORK_CPU,
+                  uv__queue_work,
+                  uv__queue_done);
   return 0;
 }
 
@@ -121,7 +121,11 @@
 #define POST                                                                  \
   do {                                                                        \
     if (cb != NULL) {                                                         \
-      uv__work_submit(loop, &req->work_req, uv__fs_work, uv__fs_done);        \
+      uv__work_submit(loop,                                                   \
+                      &req->work_req,                                         \
+                      uv__fs_work_kind(req),                                  \
+                      uv__fs_work,                                            \
+                      uv__fs_done);                                           \
       return 0;                                                               \
     }                                                                         \
     else {                                                                    \
@@ -132,6 +136,18 @@
   while (0)
 
 
+/* Copies are bulk work, and wait behind everything else in the threadpool. */
+static enum uv__work_kind uv__fs_work_kind(const uv_fs_t* req) {
+  switch (req->fs_type) {
+    case UV_FS_COPYFILE:
+    case UV_FS_SENDFILE:
+      return UV__WORK_SLOW_IO;
+    default:
+      return UV__WORK_FAST_IO;
+  }
+}
+
+
 static ssize_t uv__fs_fdatasync(uv_fs_t* req) {
 #if defined(__linux__) || defined(__sun) || defined(__NetBSD__)
   return fdatasync(req->file);
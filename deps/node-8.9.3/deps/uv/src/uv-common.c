@@ -637,6 +637,7 @@ int uv_loop_close(uv_loop_t* loop) {
   }
 
   uv__loop_close(loop);
+  uv__work_loop_close(loop);
 
 #ifndef NDEBUG
   saved_data = loop->data;
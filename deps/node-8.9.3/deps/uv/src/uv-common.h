@@ -113,12 +113,22 @@ void uv__fs_poll_close(uv_fs_poll_t* handle);
 
 int uv__getaddrinfo_translate_error(int sys_err);    /* EAI_* error. */
 
+enum uv__work_kind {
+  UV__WORK_CPU,
+  UV__WORK_FAST_IO,
+  UV__WORK_SLOW_IO,
+  UV__WORK_NKINDS
+};
+
 void uv__work_submit(uv_loop_t* loop,
                      struct uv__work *w,
+                     enum uv__work_kind kind,
                      void (*work)(struct uv__work *w),
                      void (*done)(struct uv__work *w, int status));
 
 void uv__work_done(uv_async_t* handle);
+/* Forgets the loop's record in the threadpool, priority and all. */
+void uv__work_loop_close(uv_loop_t* loop);
 
 size_t uv__count_bufs(const uv_buf_t bufs[], unsigned int nbufs);
 
@@ -55,7 +55,11 @@
   do {                                                                        \
     if (cb != NULL) {                                                         \
       uv__req_register(loop, req);                                            \
-      uv__work_submit(loop, &req->work_req, uv__fs_work, uv__fs_done);        \
+      uv__work_submit(loop,                                                   \
+                      &req->work_req,                                         \
+                      uv__fs_work_kind(req),                                  \
+                      uv__fs_work,                                            \
+                      uv__fs_done);                                           \
       return 0;                                                               \
     } else {                                                                  \
       uv__fs_work(&req->work_req);                                            \
@@ -64,6 +68,18 @@
   }                                                                           \
   while (0)
 
+
+/* Copies are bulk work, and wait behind everything else in the threadpool. */
+static enum uv__work_kind uv__fs_work_kind(const uv_fs_t* req) {
+  switch (req->fs_type) {
+    case UV_FS_COPYFILE:
+    case UV_FS_SENDFILE:
+      return UV__WORK_SLOW_IO;
+    default:
+      return UV__WORK_FAST_IO;
+  }
+}
+
 #define SET_REQ_RESULT(req, result_value)                                   \
   do {                                                                      \
     req->result = (result_value);                                           \
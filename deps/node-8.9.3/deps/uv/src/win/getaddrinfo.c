@@ -364,6 +364,7 @@ int uv_getaddrinfo(uv_loop_t* loop,
   if (getaddrinfo_cb) {
     uv__work_submit(loop,
                     &req->work_req,
+                    UV__WORK_FAST_IO,
                     uv__getaddrinfo_work,
                     uv__getaddrinfo_done);
     return 0;